@@ -0,0 +1,51 @@
+#!/bin/sh
+# Compares two "make bench" result files and fails on regressions, so CI
+# can gate merges on throughput.
+#
+# usage: bench-compare.sh <baseline.csv> <new.csv> [tolerance-percent]
+#
+# Each file holds "benchmark,case,unit,value" lines as written by the
+# bench tools with -C.  A measurement regresses when it is worse than the
+# baseline by more than the tolerance (default 10%): lower for MBps,
+# higher for ns.  Cases present in only one of the files are reported but
+# don't fail the comparison.
+
+if [ $# -lt 2 ] || [ ! -r "$1" ] || [ ! -r "$2" ]; then
+	echo "usage: $0 <baseline.csv> <new.csv> [tolerance-percent]" >&2
+	exit 2
+fi
+
+TOLERANCE="${3:-10}"
+
+awk -F, -v tol="$TOLERANCE" '
+NR == FNR {
+	base[$1 "," $2] = $4
+	unit[$1 "," $2] = $3
+	next
+}
+{
+	key = $1 "," $2
+	if (!(key in base)) {
+		printf "NEW        %-40s %10s %s\n", key, $4, $3
+		next
+	}
+	old = base[key]
+	seen[key] = 1
+	delta = old ? ($4 - old) * 100 / old : 0
+	worse = (unit[key] == "ns") ? delta > tol : delta < -tol
+	if (worse) {
+		printf "REGRESSION %-40s %10s -> %-10s (%+.1f%%)\n", \
+			key, old, $4, delta
+		status = 1
+	} else {
+		printf "ok         %-40s %10s -> %-10s (%+.1f%%)\n", \
+			key, old, $4, delta
+	}
+}
+END {
+	for (key in base)
+		if (!(key in seen))
+			printf "MISSING    %-40s %10s %s\n", \
+				key, base[key], unit[key]
+	exit status
+}' "$1" "$2"
@@ -26,6 +26,7 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <signal.h>
 
 const char *argp_program_version="decode_tm6000 version 0.0.1";
 const char *argp_program_bug_address="Mauro Carvalho Chehab <mchehab@kernel.org>";
@@ -42,7 +43,6 @@ const struct argp_option options[] = {
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
-static char outbuf[692224];
 static int debug=0, audio=0, use_mmap=1, nbufs=4;
 static float freq_mhz=193.25;
 static char *devicename="/dev/video0";
@@ -129,12 +129,55 @@ const char *tm6000_msg_type[]= {
 #define dprintf(fmt,arg...) \
 	if (debug) fprintf(stderr, fmt, ##arg)
 
+/*
+ * The stream is parsed in batches from one large buffer: a packet is a
+ * 4 byte header whose last byte is the 0x47 sync marker, followed by a
+ * fixed 180 byte payload. Incoming chunks are appended at ring_head,
+ * the parser consumes whole packets at ring_tail, and the residue is
+ * compacted to the front before every refill so the sync scan never has
+ * to deal with a wrap.
+ */
+#define TM6000_HDR_LEN	4
+#define TM6000_PKT_LEN	(TM6000_HDR_LEN + TM6000_URB_MSG_LEN)
+#define RING_SIZE	(4*1024*1024)
+
+static unsigned char ring[RING_SIZE];
+static unsigned int ring_head, ring_tail;
+
+/* drop accounting, reported on exit */
+static unsigned long long stat_pkts, stat_resyncs, stat_skipped;
+static unsigned long long stat_dropped, stat_oversized;
+
+static volatile sig_atomic_t interrupted;
+
+static void sigint_handler (int sig)
+{
+	interrupted = 1;
+}
+
+static void print_stats (void)
+{
+	fprintf(stderr,
+		"packets %llu, resyncs %llu, skipped bytes %llu, "
+		"dropped bytes %llu, oversized %llu\n",
+		stat_pkts, stat_resyncs, stat_skipped,
+		stat_dropped, stat_oversized);
+}
+
 static int recebe_buffer (struct v4l2_buffer *v4l2_buf, struct v4l2_t_buf *buf)
 {
+	size_t n = buf->length;
+	size_t room = RING_SIZE - ring_head;
+
 	dprintf("Received %zd bytes\n", buf->length);
 fflush(stdout);
-	memcpy (outbuf,buf->start,buf->length);
-	return buf->length;
+	if (n > room) {
+		stat_dropped += n - room;
+		n = room;
+	}
+	memcpy (ring + ring_head, buf->start, n);
+	ring_head += n;
+	return n;
 }
 
 
@@ -219,45 +262,51 @@ static int read_stream (struct v4l2_driver *drv, int fd)
 
 		return v4l2_rcvbuf(drv, recebe_buffer);
 	} else {
-		int size=read(fd, outbuf, sizeof(outbuf));
+		int size=read(fd, ring + ring_head, RING_SIZE - ring_head);
+		if (size>0)
+			ring_head += size;
 		return size;
 	}
 
 	return 0;
 }
 
-static int read_char (struct v4l2_driver *drv, int fd)
+/*
+ * Top up the ring until at least one whole packet is buffered. One
+ * refill usually appends a whole captured chunk (or, when reading a
+ * file, fills most of the ring), so the parser runs through hundreds
+ * of packets per syscall.
+ */
+static int fill_ring (struct v4l2_driver *drv, int fd)
 {
-	static int sizebuf=0;
-	static unsigned char *p=NULL;
-	unsigned char c;
-
-	if (sizebuf<=0) {
-		sizebuf=read_stream(drv,fd);
-		if (sizebuf<=0)
+	if (ring_tail) {
+		memmove(ring, ring + ring_tail, ring_head - ring_tail);
+		ring_head -= ring_tail;
+		ring_tail = 0;
+	}
+	while (ring_head - ring_tail < TM6000_PKT_LEN) {
+		if (interrupted)
+			return -1;
+		if (read_stream(drv,fd)<=0)
 			return -1;
-		p=(unsigned char *)outbuf;
 	}
-	c=*p;
-	p++;
-	sizebuf--;
-
-	return c;
+	return 0;
 }
 
 
 int main (int argc, char*argv[])
 {
 	int fd;
-	unsigned int i;
-	unsigned char buf[TM6000_URB_MSG_LEN], img[720*2*480] = {};
+	unsigned char img[720*2*480] = {};
 	unsigned int  cmd, size, field, block, line, pos=0;
 	unsigned long header=0;
-	int           linesize=720*2,skip=0;
+	int           linesize=720*2;
 	struct v4l2_driver drv;
 
 	argp_parse (&argp, argc, argv, 0, 0, 0);
 
+	signal(SIGINT, sigint_handler);
+
 	if (mode!=INPUT) {
 		if (prepare_read (&drv)<0)
 			return -1;
@@ -283,34 +332,53 @@ int main (int argc, char*argv[])
 		dprintf("file %s opened for output\n",filename);
 
 		do {
+			ring_head = ring_tail = 0;
 			size=read_stream (&drv,fd);
 
-			if (size<=0) {
+			if (size<=0 || interrupted) {
 				close (fd);
 				return -1;
 			}
 			dprintf("writing %d bytes\n",size);
-			fwrite(outbuf,1, size,fout);
+			fwrite(ring,1, size,fout);
 //			fflush(fout);
 		} while (1);
 	}
 
 
-	while (1) {
-		skip=0;
-		header=0;
-		do {
-			int c;
-			c=read_char (&drv,fd);
-			if (c<0) {
-				perror("read");
-				return -1;
+	while (!interrupted) {
+		const unsigned char *p, *payload;
+
+		if (ring_head - ring_tail < TM6000_PKT_LEN) {
+			if (fill_ring(&drv,fd)<0)
+				break;
+			continue;
+		}
+
+		p = ring + ring_tail;
+		if (p[TM6000_HDR_LEN-1] != 0x47) {
+			/* lost sync: memchr does the byte hunting */
+			const unsigned char *sync;
+
+			sync = memchr(p + TM6000_HDR_LEN - 1, 0x47,
+				      ring_head - ring_tail - (TM6000_HDR_LEN-1));
+			stat_resyncs++;
+			if (!sync) {
+				stat_skipped += ring_head - ring_tail -
+						(TM6000_HDR_LEN-1);
+				ring_tail = ring_head - (TM6000_HDR_LEN-1);
+			} else {
+				stat_skipped += sync - p -
+						(TM6000_HDR_LEN-1);
+				ring_tail = (sync - ring) - (TM6000_HDR_LEN-1);
 			}
+			continue;
+		}
 
-			header=(header>>8)&0xffffff;
-			header=header|(c<<24);
-			skip++;
-		} while ( (((header>>24)&0xff) != 0x47) );
+		header = p[0] | (p[1]<<8) | (p[2]<<16) | ((unsigned long)0x47<<24);
+		payload = p + TM6000_HDR_LEN;
+		ring_tail += TM6000_PKT_LEN;
+		stat_pkts++;
 
 		/* split the header fields */
 		size  = (((header & 0x7e)<<1) -1) * 4;
@@ -319,17 +387,6 @@ int main (int argc, char*argv[])
 		line  = (header>>12) & 0x1ff;
 		cmd   = (header>>21) & 0x7;
 
-		/* Read the remaining buffer */
-		for (i=0;i<sizeof(buf);i++) {
-			int c;
-			c=read_char (&drv,fd);
-			if (c<0) {
-				perror("read");
-				return -1;
-			}
-			buf[i]=c;
-		}
-
 		/* FIXME: Mounts the image as field0+field1
 			* It should, instead, check if the user selected
 			* entrelaced or non-entrelaced mode
@@ -338,28 +395,32 @@ int main (int argc, char*argv[])
 					block*TM6000_URB_MSG_LEN;
 
 			/* Prints debug info */
-		dprintf("0x%08x (skip %d), %s size=%d, line=%d, field=%d, block=%d\n",
-				(unsigned int)header, skip,
+		dprintf("0x%08x, %s size=%d, line=%d, field=%d, block=%d\n",
+				(unsigned int)header,
 				 tm6000_msg_type[cmd],
 				 size, line, field, block);
 
 		/* Don't allow to write out of the buffer */
-		if (pos+sizeof(buf) > sizeof(img))
+		if (pos+TM6000_URB_MSG_LEN > sizeof(img)) {
+			stat_oversized++;
 			cmd = TM6000_URB_MSG_ERR;
+		}
 
 		/* handles each different URB message */
 		switch(cmd) {
 		case TM6000_URB_MSG_VIDEO:
 			/* Fills video buffer */
-			memcpy(buf,&img[pos],sizeof(buf));
+			memcpy(&img[pos],payload,TM6000_URB_MSG_LEN);
+			break;
 		case TM6000_URB_MSG_AUDIO:
 			if (audio)
-				fwrite(buf,sizeof(buf),1,stdout);
+				fwrite(payload,TM6000_URB_MSG_LEN,1,stdout);
 //		case TM6000_URB_MSG_VBI:
 //		case TM6000_URB_MSG_PTS:
 		break;
 		}
 	}
+	print_stats();
 	close(fd);
 	return 0;
 }
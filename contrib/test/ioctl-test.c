@@ -10,6 +10,11 @@
    This tool should be run whenever a new ioctl is added, or when fields
    are added to existing structs used by ioctls.
 
+   Several devices may be given on the command line: each device is
+   swept by its own thread and a per-ioctl-family timing report is
+   printed at the end, so a full sweep over many (slow) devices takes
+   about as long as the slowest single device.
+
    To compile as a 32-bit executable when on a 64-bit architecture use:
 
    	gcc -o ioctl-test32 ioctl-test.c -I../../include -m32
@@ -32,9 +37,12 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -42,13 +50,59 @@
 
 #include "ioctl-test.h"
 
-int main(int argc, char **argv)
+#define MAX_DEVICES	32
+#define MAX_FAMILIES	8
+
+/*
+ * The table itself stays in .rodata; what is sorted once at startup is
+ * an index over it, keyed on the ioctl value, so every sweep walks the
+ * commands in numerical order no matter how the generator emitted them.
+ */
+static unsigned sweep_order[S_IOCTLS];
+
+/* timing per ioctl family ("video", "subdev", ...) */
+struct family_stats {
+	const char *type;
+	unsigned calls;
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+	const char *max_name;
+};
+
+struct sweep {
+	const char *device;
+	unsigned maxlen;
+	int quiet;
+	int failed;
+	/* sweep output, buffered so threads don't interleave */
+	char *log;
+	size_t log_size;
+	unsigned num_families;
+	struct family_stats families[MAX_FAMILIES];
+};
+
+static int cmp_cmd(const void *a, const void *b)
+{
+	u_int32_t ca = ioctls[*(const unsigned *)a].cmd;
+	u_int32_t cb = ioctls[*(const unsigned *)b].cmd;
+
+	return ca < cb ? -1 : ca > cb;
+}
+
+static struct family_stats *family(struct sweep *s, const char *type)
 {
-	int fd = 0;
 	unsigned i;
-	unsigned maxlen = 0;
-	int cmd_errors = 0;
-	char *device = "/dev/video0";
+
+	for (i = 0; i < s->num_families; i++)
+		if (!strcmp(s->families[i].type, type))
+			return &s->families[i];
+	s->families[s->num_families].type = type;
+	return &s->families[s->num_families++];
+}
+
+static void *sweep_device(void *arg)
+{
+	struct sweep *s = arg;
 	char marker[8] = { 0xde, 0xad, 0xbe, 0xef, 0xad, 0xbc, 0xcb, 0xda };
 	char p[sizeof(union v4l_parms) + 2 * sizeof(marker)];
 	static const char *dirs[] = {
@@ -57,10 +111,120 @@ int main(int argc, char **argv)
 		" IOR",
 		"IOWR"
 	};
+	FILE *out;
+	unsigned i;
+	int fd;
+
+	out = open_memstream(&s->log, &s->log_size);
+	if (out == NULL) {
+		s->failed = 1;
+		return NULL;
+	}
+
+	if ((fd = open(s->device, O_RDONLY | O_NONBLOCK)) < 0) {
+		fprintf(out, "Couldn't open %s\n", s->device);
+		fclose(out);
+		s->failed = 1;
+		return NULL;
+	}
+
+	for (i = 0; i < S_IOCTLS; i++) {
+		unsigned idx = sweep_order[i];
+		const char *name = ioctls[idx].name;
+		u_int32_t cmd = ioctls[idx].cmd;
+		int dir = _IOC_DIR(cmd);
+		char type = _IOC_TYPE(cmd);
+		int nr = _IOC_NR(cmd);
+		int sz = _IOC_SIZE(cmd);
+		struct family_stats *fam;
+		struct timespec t0, t1;
+		unsigned long long ns;
+
+		/* Only apply the pertinent ioctl's to the device */
+		if (!strstr(s->device, ioctls[idx].type))
+			continue;
+
+		/* Check whether the front and back markers aren't overwritten.
+		   Useful to verify the compat32 code. */
+		memset(&p, 0, sizeof(p));
+		memcpy(p, marker, sizeof(marker));
+		memcpy(p + sz + sizeof(marker), marker, sizeof(marker));
+		errno = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		ioctl(fd, cmd, (void *)&p[sizeof(marker)]);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		if (!s->quiet)
+			fprintf(out, "ioctl 0x%08x = %s('%c', %2d, %4d) = %-*s: %s\n",
+				cmd, dirs[dir], type, nr, sz,
+				s->maxlen, name, strerror(errno));
+		if (memcmp(p, marker, sizeof(marker))) {
+			fprintf(out, "%s: front marker overwritten!\n", name);
+			s->failed = 1;
+		}
+		if (memcmp(p + sizeof(marker) + sz, marker, sizeof(marker))) {
+			fprintf(out, "%s: back marker overwritten!\n", name);
+			s->failed = 1;
+		}
+
+		ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+			(t1.tv_nsec - t0.tv_nsec);
+		fam = family(s, ioctls[idx].type);
+		fam->calls++;
+		fam->total_ns += ns;
+		if (ns > fam->max_ns) {
+			fam->max_ns = ns;
+			fam->max_name = name;
+		}
+	}
+	close(fd);
+	fclose(out);
+	return NULL;
+}
+
+static void usage(void)
+{
+	printf("Usage: ioctl-test [-q] [device]...\n"
+	       "  -q  quiet: only report marker corruption and the timing summary\n"
+	       "\n"
+	       "If no device is given, /dev/video0 is used.\n");
+}
+
+int main(int argc, char **argv)
+{
+	static struct sweep sweeps[MAX_DEVICES];
+	pthread_t threads[MAX_DEVICES];
+	unsigned num_devices = 0;
+	unsigned maxlen = 0;
+	int cmd_errors = 0;
+	int failed = 0;
+	int quiet = 0;
+	unsigned d, i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "qh")) != -1) {
+		switch (opt) {
+		case 'q':
+			quiet = 1;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return -1;
+		}
+	}
+	for (; optind < argc; optind++) {
+		if (num_devices == MAX_DEVICES) {
+			fprintf(stderr, "Too many devices (max %d)\n",
+				MAX_DEVICES);
+			return -1;
+		}
+		sweeps[num_devices++].device = argv[optind];
+	}
+	if (num_devices == 0)
+		sweeps[num_devices++].device = "/dev/video0";
 
-	if (argv[1])
-		device = argv[1];
-	
 	for (i = 0; i < S_IOCTLS; i++) {
 		unsigned cmp_cmd;
 
@@ -75,43 +239,48 @@ int main(int argc, char **argv)
 					ioctls[i].name, ioctls[i].cmd, cmp_cmd);
 			cmd_errors = 1;
 		}
+		sweep_order[i] = i;
 	}
 	if (cmd_errors)
 		return -1;
+	qsort(sweep_order, S_IOCTLS, sizeof(sweep_order[0]), cmp_cmd);
 
-	if ((fd = open(device, O_RDONLY|O_NONBLOCK)) < 0) {
-		fprintf(stderr, "Couldn't open %s\n", device);
-		return -1;
+	for (d = 0; d < num_devices; d++) {
+		sweeps[d].maxlen = maxlen;
+		sweeps[d].quiet = quiet;
+		if (pthread_create(&threads[d], NULL, sweep_device, &sweeps[d])) {
+			fprintf(stderr, "Couldn't start thread for %s\n",
+				sweeps[d].device);
+			return -1;
+		}
 	}
 
-	for (i = 0; i < S_IOCTLS; i++) {
-		char buf[maxlen + 100];
-		const char *name = ioctls[i].name;
-		u_int32_t cmd = ioctls[i].cmd;
-		int dir = _IOC_DIR(cmd);
-		char type = _IOC_TYPE(cmd);
-		int nr = _IOC_NR(cmd);
-		int sz = _IOC_SIZE(cmd);
+	for (d = 0; d < num_devices; d++) {
+		struct sweep *s = &sweeps[d];
 
-		/* Only apply the pertinent ioctl's to the device */
-		if (!strstr(device, ioctls[i].type))
+		pthread_join(threads[d], NULL);
+		if (s->log) {
+			fputs(s->log, stderr);
+			free(s->log);
+		}
+		failed |= s->failed;
+	}
+
+	for (d = 0; d < num_devices; d++) {
+		struct sweep *s = &sweeps[d];
+
+		if (s->failed && !s->num_families)
 			continue;
+		printf("%s:\n", s->device);
+		for (i = 0; i < s->num_families; i++) {
+			struct family_stats *fam = &s->families[i];
 
-		/* Check whether the front and back markers aren't overwritten.
-		   Useful to verify the compat32 code. */
-		memset(&p, 0, sizeof(p));
-		memcpy(p, marker, sizeof(marker));
-		memcpy(p + sz + sizeof(marker), marker, sizeof(marker));
-		sprintf(buf, "ioctl 0x%08x = %s('%c', %2d, %4d) = %-*s",
-			cmd, dirs[dir], type, nr, sz, maxlen, name);
-		errno = 0;
-		ioctl(fd, cmd, (void *)&p[sizeof(marker)]);
-		perror(buf);
-		if (memcmp(p, marker, sizeof(marker)))
-			fprintf(stderr, "%s: front marker overwritten!\n", name);
-		if (memcmp(p + sizeof(marker) + sz, marker, sizeof(marker)))
-			fprintf(stderr, "%s: back marker overwritten!\n", name);
+			printf("  %-8s: %3u ioctls in %8.3f ms, avg %7.1f us, max %7.1f us (%s)\n",
+			       fam->type, fam->calls,
+			       fam->total_ns / 1000000.0,
+			       fam->total_ns / 1000.0 / fam->calls,
+			       fam->max_ns / 1000.0, fam->max_name);
+		}
 	}
-	close (fd);
-	return 0;
+	return failed ? 1 : 0;
 }
@@ -103,14 +103,26 @@ struct dev_info {
 	int fd;
 	struct v4l2_format fmt;
 
+	/* zero-copy lending from libv4l2; buf is the v4l2_read fallback
+	   and the snapshot staging area */
+	int use_peek;
+	int want_snapshot;
 	unsigned char buf[SIZE];
 	int debug;
 #define D_TIMING 1
 };
 
+/* persistent textures for the xpm UI icons */
+#define MAX_ICONS 16
+
 struct sdl {
 	SDL_Window *window;
-	SDL_Surface *screen, *liveview;
+	SDL_Renderer *renderer;
+	SDL_Texture *frame_tex;	/* streaming texture, capture sized */
+	int tex_w, tex_h;
+
+	struct { char **xpm; SDL_Texture *tex; int w, h; } icons[MAX_ICONS];
+	int num_icons;
 
 	int wx, wy; /* Window size */
 	int sx, sy; /* Live view size */
@@ -135,52 +147,50 @@ struct sdl {
 	struct dev_info *dev;
 };
 
-typedef struct {
-	uint8_t r, g, b, alpha;
-} pixel;
-
 #define d_raw 1
 
-static void sfc_put_pixel(SDL_Surface* liveview, int x, int y, pixel *p)
-{
-	Uint32* p_liveview = (Uint32*)liveview->pixels;
-	p_liveview += y*liveview->w+x;
-	*p_liveview = SDL_MapRGBA(liveview->format, p->r, p->g, p->b, p->alpha);
-}
-
-static void sdl_begin_paint(struct sdl *m)
-{
-	/* Fill the surface white */
-	SDL_FillRect(m->liveview, NULL, SDL_MapRGB( m->liveview->format, 0, 0, 0 ));
-
-	SDL_LockSurface(m->liveview);
-}
-
-static void sdl_finish_paint(struct sdl *m) {
-	SDL_UnlockSurface(m->liveview);
-	SDL_Rect rcDest = { m->bx, m->by, m->sx, m->sy };
-
-	SDL_BlitSurface(m->liveview, NULL, m->screen, &rcDest);
-	SDL_UpdateWindowSurfaceRects(m->window, &rcDest, 1);
-}
-
 static void sdl_paint_image(struct sdl *m, char **xpm, int x, int y) {
-	SDL_Surface *image = IMG_ReadXPMFromArray(xpm);
-	if (!image) {
-		printf("IMG_Load: %s\n", IMG_GetError());
-		exit(1);
-	}
-
-	int x_pos = x - image->w/2, y_pos = y - image->h/2;
+	SDL_Texture *tex = NULL;
+	int w = 0, h = 0;
+
+	for (int i = 0; i < m->num_icons; i++)
+		if (m->icons[i].xpm == xpm) {
+			tex = m->icons[i].tex;
+			w = m->icons[i].w;
+			h = m->icons[i].h;
+			break;
+		}
 
-	SDL_Rect rcDest = { x_pos, y_pos, image->w, image->h };
-	int r = SDL_BlitSurface(image, NULL, m->screen, &rcDest);
+	if (!tex) {
+		SDL_Surface *image = IMG_ReadXPMFromArray(xpm);
+		if (!image) {
+			printf("IMG_Load: %s\n", IMG_GetError());
+			exit(1);
+		}
+		tex = SDL_CreateTextureFromSurface(m->renderer, image);
+		if (!tex) {
+			printf("Couldn't create icon texture: %s\n", SDL_GetError());
+			exit(1);
+		}
+		w = image->w;
+		h = image->h;
+		SDL_FreeSurface(image);
+		if (m->num_icons == MAX_ICONS) {
+			printf("Too many icons\n");
+			exit(1);
+		}
+		m->icons[m->num_icons].xpm = xpm;
+		m->icons[m->num_icons].tex = tex;
+		m->icons[m->num_icons].w = w;
+		m->icons[m->num_icons].h = h;
+		m->num_icons++;
+	}
 
-	if (r) {
+	SDL_Rect rcDest = { x - w/2, y - h/2, w, h };
+	if (SDL_RenderCopy(m->renderer, tex, NULL, &rcDest)) {
 		printf("Error blitting: %s\n", SDL_GetError());
 		exit(1);
 	}
-	SDL_FreeSurface(image);
 }
 
 static void cam_exposure_limits(struct sdl *m, struct v4l2_queryctrl *qctrl)
@@ -274,16 +284,18 @@ static double cam_get_focus(struct sdl *m)
 	return cam_convert_focus(m, cam_get_focus_diopter(m));
 }
 
-static void sdl_line_color(struct sdl *m, int x1, int y1, int x2, int y2, Uint32 color)
+static void sdl_line_color(struct sdl *m, int x1, int y1, int x2, int y2,
+			   int r, int g, int b)
 {
 	SDL_Rect rcDest = { x1, y1, x2-x1+1, y2-y1+1};
 
-	SDL_FillRect(m->screen, &rcDest, color);
+	SDL_SetRenderDrawColor(m->renderer, r, g, b, SDL_ALPHA_OPAQUE);
+	SDL_RenderFillRect(m->renderer, &rcDest);
 }
 
 static void sdl_line(struct sdl *m, int x1, int y1, int x2, int y2)
 {
-	sdl_line_color(m, x1, y1, x2, y2, SDL_MapRGB( m->liveview->format, 255, 255, 255 ));
+	sdl_line_color(m, x1, y1, x2, y2, 255, 255, 255);
 }
 
 static void sdl_digit(struct sdl *m, int x, int y, int s, int i)
@@ -653,21 +665,19 @@ static void sdl_paint_ui(struct sdl *m)
 		"................",
 	};
 */
-	SDL_FillRect(m->screen, NULL, SDL_MapRGB( m->liveview->format, 0, 0, 0 ));
-
 	{
 		/* Paint grid */
 		int x, y;
 		int nx = m->nx;
 		for (x=1; x<nx; x++) {
 			int x_ = (x*m->wx)/nx;
-			sdl_line_color(m, x_, 1, x_, m->wy-1, SDL_MapRGB( m->liveview->format, 40, 40, 40 ));
+			sdl_line_color(m, x_, 1, x_, m->wy-1, 40, 40, 40);
 		}
 
 		int ny = m->ny;
 		for (y=1; y<nx; y++) {
 			int y_ = (y*m->wy)/ny;
-			sdl_line_color(m, 1, y_, m->wx-1, y_, SDL_MapRGB( m->liveview->format, 40, 40, 40 ));
+			sdl_line_color(m, 1, y_, m->wx-1, y_, 40, 40, 40);
 		}
 
 	}
@@ -685,7 +695,6 @@ static void sdl_paint_ui(struct sdl *m)
 	sdl_paint_button(m, ok_xpm,    -1, -1, 1);
 
 	sdl_paint_slider(m);
-	SDL_UpdateWindowSurface(m->window);
 }
 
 static double usec_to_time(double v)
@@ -693,16 +702,23 @@ static double usec_to_time(double v)
 	return 1/(v*.000001);
 }
 
-static void sdl_status(struct sdl *m, double avg)
+/* fps/latency readout plus the exposure/gain/focus numbers */
+static void sdl_status(struct sdl *m, double fps, double lat)
 {
 	int ox = 0;
 	int oy = m->wy/2;
 	int s = 3;
-	SDL_Rect rcDest = { ox, oy, s*25, s*40 };
+	SDL_Rect rcDest = { ox, oy, s*25, s*60 };
+
+	SDL_SetRenderDrawColor(m->renderer, 30, 30, 30, SDL_ALPHA_OPAQUE);
+	SDL_RenderFillRect(m->renderer, &rcDest);
 
-	SDL_FillRect(m->screen, &rcDest, SDL_MapRGB( m->liveview->format, 30, 30, 30 ));
+	if (fps > 999) fps = 999;
+	sdl_number(m, ox, oy, s, 3, fps);
+	oy += s*10;
 
-	sdl_number(m, ox, oy, s, 3, avg*1000);
+	if (lat > 999) lat = 999;
+	sdl_number(m, ox, oy, s, 3, lat*1000);
 	oy += s*10;
 
 	{
@@ -729,42 +745,6 @@ static void sdl_status(struct sdl *m, double avg)
 			x = 100/x; /* centimeters */
 		sdl_number(m, ox, oy, s, 3, x);
 	}
-
-	SDL_UpdateWindowSurfaceRects(m->window, &rcDest, 1);
-}
-static pixel buf_pixel(struct v4l2_format *fmt, unsigned char *buf, int x, int y)
-{
-	pixel p = { 0, 0, 0, 0 };
-	int pos = x + y*fmt->fmt.pix.width;
-
-	p.alpha = 128;
-
-	switch (fmt->fmt.pix.pixelformat) {
-	case V4L2_PIX_FMT_SGRBG10:
-		{
-			short *b2 = (void *)buf;
-			x &= ~1;
-			y &= ~1;
-			p.g = b2[x + y*fmt->fmt.pix.width] /4;
-			p.r = b2[x + y*fmt->fmt.pix.width+1] /4;
-			p.b = b2[x + (y+1)*fmt->fmt.pix.width] /4;
-		}
-		break;
-
-	case V4L2_PIX_FMT_RGB24:
-		pos *= 3;
-		p.r = buf[pos];
-		p.g = buf[pos+1];
-		p.b = buf[pos+2];
-		break;
-
-	default:
-		printf("Wrong pixel format!\n");
-		fmt_print(fmt);
-		exit(1);
-	}
-
-	return p;
 }
 
 static char *fmt_name(struct v4l2_format *fmt)
@@ -804,54 +784,93 @@ static void sdl_key(struct sdl *m, int c)
 
 static int sdl_render_statistics(struct sdl *m)
 {
-	pixel white;
 	double focus, gain, exposure;
 
-	white.r = (Uint8)0xff;
-	white.g = (Uint8)0xff;
-	white.b = (Uint8)0xff;
-	white.alpha = (Uint8)128;
-
 	exposure = cam_get_exposure(m);
 	gain = v4l2_get_control(m->fd, 0x00980913) / 65535.;
 	focus = cam_get_focus(m);
 
-	for (int x=0; x<m->sx && x<m->sx*focus; x++)
-		sfc_put_pixel(m->liveview, x, 0, &white);
-
-	for (int y=0; y<m->sy && y<m->sy*gain; y++)
-		sfc_put_pixel(m->liveview, 0, y, &white);
-
-	for (int y=0; y<m->sy && y<m->sy*exposure; y++)
-		sfc_put_pixel(m->liveview, m->sx-1, y, &white);
+	SDL_SetRenderDrawColor(m->renderer, 255, 255, 255, SDL_ALPHA_OPAQUE);
 
-	for (int x=0; x<m->sx; x++)
-		sfc_put_pixel(m->liveview, x, m->sy-1, &white);
+	if (focus > 0) {
+		int len = m->sx*focus > m->sx ? m->sx : m->sx*focus;
+		SDL_RenderDrawLine(m->renderer, m->bx, m->by,
+				   m->bx + len - 1, m->by);
+	}
+	if (gain > 0) {
+		int len = m->sy*gain > m->sy ? m->sy : m->sy*gain;
+		SDL_RenderDrawLine(m->renderer, m->bx, m->by,
+				   m->bx, m->by + len - 1);
+	}
+	if (exposure > 0) {
+		int len = m->sy*exposure > m->sy ? m->sy : m->sy*exposure;
+		SDL_RenderDrawLine(m->renderer, m->bx + m->sx-1, m->by,
+				   m->bx + m->sx-1, m->by + len - 1);
+	}
+	SDL_RenderDrawLine(m->renderer, m->bx, m->by + m->sy-1,
+			   m->bx + m->sx-1, m->by + m->sy-1);
 
 	return 0;
 }
 
-static void sdl_render(struct sdl *m, unsigned char *buf, struct v4l2_format *fmt)
+/*
+ * One whole presentation pass: the UI, the frame streamed into the
+ * persistent texture, the statistics overlay and the status numbers.
+ * The texture upload is the only per-frame copy left; cropping and
+ * scaling are done by the GPU via the source rectangle.
+ */
+static void sdl_render(struct sdl *m, unsigned char *buf,
+		       struct v4l2_format *fmt, double fps, double lat)
 {
 	float zoom = m->zoom;
+	int w = fmt->fmt.pix.width;
+	int h = fmt->fmt.pix.height;
+
 	if (!m->window)
 		return;
 
-	sdl_begin_paint(m);
-	int x0 = (fmt->fmt.pix.width - m->sx*m->factor/zoom)/2;
-	int y0 = (fmt->fmt.pix.height - m->sy*m->factor/zoom)/2;
-
-	for (int y = 0; y < m->sy; y++)
-		for (int x = 0; x < m->sx; x++) {
-			int x1 = x0+x*m->factor/zoom;
-			int y1 = y0+y*m->factor/zoom;
-			pixel p = buf_pixel(fmt, buf, x1, y1);
-			p.alpha = 128;
-			sfc_put_pixel(m->liveview, x, y, &p);
+	if (fmt->fmt.pix.pixelformat != V4L2_PIX_FMT_RGB24) {
+		printf("Wrong pixel format!\n");
+		fmt_print(fmt);
+		exit(1);
+	}
+
+	if (m->frame_tex && (m->tex_w != w || m->tex_h != h)) {
+		SDL_DestroyTexture(m->frame_tex);
+		m->frame_tex = NULL;
+	}
+	if (!m->frame_tex) {
+		m->frame_tex = SDL_CreateTexture(m->renderer,
+						 SDL_PIXELFORMAT_RGB24,
+						 SDL_TEXTUREACCESS_STREAMING,
+						 w, h);
+		if (!m->frame_tex) {
+			printf("Couldn't create frame texture: %s\n",
+			       SDL_GetError());
+			exit(1);
 		}
+		m->tex_w = w;
+		m->tex_h = h;
+	}
+	int pitch = fmt->fmt.pix.bytesperline ? (int)fmt->fmt.pix.bytesperline : 3 * w;
+	SDL_UpdateTexture(m->frame_tex, NULL, buf, pitch);
+
+	SDL_SetRenderDrawColor(m->renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+	SDL_RenderClear(m->renderer);
+	sdl_paint_ui(m);
+
+	SDL_Rect rcSrc = {
+		(w - m->sx*m->factor/zoom)/2,
+		(h - m->sy*m->factor/zoom)/2,
+		m->sx*m->factor/zoom,
+		m->sy*m->factor/zoom
+	};
+	SDL_Rect rcDest = { m->bx, m->by, m->sx, m->sy };
+	SDL_RenderCopy(m->renderer, m->frame_tex, &rcSrc, &rcDest);
 
 	sdl_render_statistics(m);
-	sdl_finish_paint(m);
+	sdl_status(m, fps, lat);
+	SDL_RenderPresent(m->renderer);
 }
 
 static void sdl_sync_settings(struct sdl *m)
@@ -874,9 +893,14 @@ static void sdl_init_window(struct sdl *m)
 
 	SDL_SetWindowFullscreen(m->window, m->do_full*SDL_WINDOW_FULLSCREEN_DESKTOP);
 
-	m->screen = SDL_GetWindowSurface(m->window);
-	if (!m->screen) {
-		printf("Couldn't create screen\n");
+	if (m->renderer)
+		return;
+	m->renderer = SDL_CreateRenderer(m->window, -1,
+					 SDL_RENDERER_ACCELERATED);
+	if (!m->renderer)
+		m->renderer = SDL_CreateRenderer(m->window, -1, 0);
+	if (!m->renderer) {
+		printf("Couldn't create renderer: %s\n", SDL_GetError());
 		exit(1);
 	}
 }
@@ -926,13 +950,6 @@ static void sdl_set_size(struct sdl *m, int _sx)
 	m->bx = (m->wx-m->sx)/2;
 	m->by = (m->wy-m->sy)/2;
 
-	m->liveview = SDL_CreateRGBSurface(0,m->sx,m->sy,32,0,0,0,0);
-	if (!m->liveview) {
-		printf("Couldn't create liveview\n");
-		exit(1);
-	}
-
-	sdl_paint_ui(m);
 	sdl_sync_settings(m);
 }
 
@@ -1078,12 +1095,10 @@ static void sdl_mouse(struct sdl *m, SDL_Event event)
 		switch (nx) {
 		case 0:
 			m->do_focus ^= 1;
-			sdl_paint_ui(m);
 			sdl_sync_settings(m);
 			return;
 		case -1:
 			m->do_exposure ^= 1;
-			sdl_paint_ui(m);
 			sdl_sync_settings(m);
 			return;
 		}
@@ -1092,7 +1107,6 @@ static void sdl_mouse(struct sdl *m, SDL_Event event)
 		switch (nx) {
 		case -1:
 			m->slider_mode = (m->slider_mode + 1) % M_NUM;
-			sdl_paint_ui(m);
 		}
 		break;
 	case -2:
@@ -1108,12 +1122,10 @@ static void sdl_mouse(struct sdl *m, SDL_Event event)
 			exit(0);
 		case 1:
 			m->do_flash ^= 1;
-			sdl_paint_ui(m);
 			sdl_sync_settings(m);
 			return;
 		case 2:
 			m->do_white ^= 1;
-			sdl_paint_ui(m);
 			sdl_sync_settings(m);
 			return;
 		case -3:
@@ -1124,8 +1136,8 @@ static void sdl_mouse(struct sdl *m, SDL_Event event)
 				sdl_set_size(m, 256);
 			return;
 		case -1:
-			sdl_paint_ui(m);
-			any_write(m->dev);
+			/* snapshot: the main loop stages the next frame */
+			m->dev->want_snapshot = 1;
 			return;
 		}
 		break;
@@ -1161,10 +1173,6 @@ static void sdl_iteration(struct sdl *m)
 			default: sdl_key(m, event.key.keysym.sym);
 			}
 			break;
-		case SDL_WINDOWEVENT:
-			if (event.window.event == SDL_WINDOWEVENT_EXPOSED)
-				sdl_paint_ui(m);
-			break;
 		case SDL_MOUSEBUTTONDOWN:
 			sdl_mouse(m, event);
 			break;
@@ -1212,29 +1220,45 @@ int main(void)
 	sdl_init(&sdl, &dev);
 	sdl_set_size(&sdl, 256);
 
-	double loop = dtime(), max = 0, avg = .200;
+	double loop = dtime(), max = 0, avg = .200, lat = 0;
+	dev.use_peek = 1;
 	if (dev.debug & D_TIMING)
 		printf("startup took %f\n", loop);
 
 	for (i=0; i<500000; i++) {
-		int num = v4l2_read(dev.fd, dev.buf, SIZE);
+		unsigned char *frame;
+		ssize_t num;
+
+		if (dev.use_peek) {
+			num = v4l2_peek_frame(dev.fd, &frame);
+			if (num < 0 && errno == ENOSYS) {
+				printf("Zero-copy capture unsupported, using v4l2_read\n");
+				dev.use_peek = 0;
+			}
+		}
+		if (!dev.use_peek) {
+			num = v4l2_read(dev.fd, dev.buf, SIZE);
+			frame = dev.buf;
+		}
 		if (num < 0) {
 			printf("Could not read frame\n");
 			return 1;
 		}
 		{
 			double d = dtime();
-			sdl_render(&sdl, dev.buf, fmt);
+			sdl_render(&sdl, frame, fmt, 1/avg, lat);
+			lat = dtime() - d;
 			if (dev.debug & D_TIMING)
-				printf("Render took %f\n", dtime() - d);
+				printf("Render took %f\n", lat);
 		}
-		{
-			double d = dtime();
-			for (int i = 0; i<1; i++)
-				sdl_status(&sdl, avg);
-			if (dev.debug & D_TIMING)
-				printf("Status took %f\n", dtime() - d);
+		if (dev.want_snapshot) {
+			if (frame != dev.buf)
+				memcpy(dev.buf, frame, num);
+			dev.want_snapshot = 0;
+			any_write(&dev);
 		}
+		if (dev.use_peek)
+			v4l2_release_frame(dev.fd);
 
 		sdl_iteration(&sdl);
 		double now = dtime();
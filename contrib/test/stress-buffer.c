@@ -10,131 +10,413 @@
  *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
  *  GNU General Public License for more details.
  *
- *  stress-buffer tool makes infinite calls using read() for
- *  any device specified by the command argument.
+ *  stress-buffer exercises the buffer allocation path of one or more
+ *  video devices: every cycle requests buffers with REQBUFS (alternated
+ *  with CREATE_BUFS when the driver supports it), mmaps and touches
+ *  them, unmaps and frees them again.  Cycles run concurrently from
+ *  several threads, each cycle is timed, and resident set growth is
+ *  tracked over the run, so allocator regressions (CMA fragmentation
+ *  slowdowns in particular) show up as rising cycle latency or RSS.
  *
- *  The size of buffer shall be a random number from 0 up to 1000.
+ *  With -l/-r the tool turns into a pass/fail regression gate: it exits
+ *  non-zero when any cycle exceeds the latency budget or the RSS grows
+ *  beyond the given limit.
  *
- *  Also is automatically created a file called: stats-M-D-Y-h-m-s.txt
- *  in current directory with data executed.
- *
- *  The stress test is performed by several read() calls,
- *  and it helped to identify real issues like:
- *
- *  - memory leaks
- *  - specific crashs that are rare and hard to reproduce
- *
- *  To compile:
- *             gcc -o stress-buffer stress-buffer.c -Wall
+ *  The historic read() stress behaviour (random sized reads in a loop,
+ *  good at shaking out rare crashes and leaks) is kept behind -R.
  *
  *  To execute:
- *             ./stress-buffer /dev/device_for_test
- *
- *  Example:
- *             ./stress-buffer /dev/video0
+ *             ./stress-buffer -c 1000 -t 4 -l 50 /dev/video0 /dev/video1
  */
 
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
-#include <sys/ioctl.h>
 #include <stdlib.h>
-#include <time.h>
 #include <string.h>
-#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
-int main(int argc, char **argv)
+#include <linux/videodev2.h>
+
+#define MAX_DEVICES	16
+#define MAX_THREADS	64
+#define MAX_BUFFERS	32
+
+static unsigned opt_threads = 1;	/* threads per device */
+static unsigned opt_cycles = 1000;	/* 0 = run until interrupted */
+static unsigned opt_buffers = 4;
+static unsigned opt_latency_ms;		/* 0 = no latency budget */
+static unsigned opt_rss_kb;		/* 0 = no RSS budget */
+static int opt_read_mode;
+
+struct worker {
+	pthread_t tid;
+	const char *device;
+	int fd;
+	enum v4l2_buf_type type;
+	int has_create_bufs;
+
+	/* results */
+	unsigned cycles;
+	unsigned ebusy_retries;
+	unsigned over_budget;
+	unsigned long long lat_min_ns;
+	unsigned long long lat_max_ns;
+	unsigned long long lat_total_ns;
+	int failed;
+};
+
+static unsigned long long now_ns(void)
 {
-	char buffer[1000];
-	char fname[100];
-	int fd, ret, magic_buffer_size, cnt = 0;
-	time_t t1, t2;
-	double dif;
-	time_t current;
-	struct tm *timep;
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* VmRSS of this process in KiB, 0 when it can't be read */
+static unsigned long rss_kb(void)
+{
+	char line[128];
+	unsigned long rss = 0;
+	FILE *f = fopen("/proc/self/status", "r");
+
+	if (!f)
+		return 0;
+	while (fgets(line, sizeof(line), f))
+		if (sscanf(line, "VmRSS: %lu kB", &rss) == 1)
+			break;
+	fclose(f);
+	return rss;
+}
+
+static int is_mplane(enum v4l2_buf_type type)
+{
+	return type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ||
+	       type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+}
+
+static int pick_buf_type(int fd, enum v4l2_buf_type *type)
+{
+	struct v4l2_capability cap;
+	__u32 caps;
 
-	FILE *fd_file;
+	memset(&cap, 0, sizeof(cap));
+	if (ioctl(fd, VIDIOC_QUERYCAP, &cap) < 0)
+		return -1;
+	caps = cap.capabilities & V4L2_CAP_DEVICE_CAPS ?
+		cap.device_caps : cap.capabilities;
 
-	if (argc != 2) {
-		printf("Usage: %s /dev/device_to_test\n", argv[0]);
+	if (caps & V4L2_CAP_VIDEO_CAPTURE)
+		*type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		*type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else if (caps & V4L2_CAP_VIDEO_OUTPUT)
+		*type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+	else if (caps & V4L2_CAP_VIDEO_OUTPUT_MPLANE)
+		*type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+	else {
+		errno = EINVAL;
 		return -1;
 	}
+	return 0;
+}
 
-	current = time(NULL);
-	timep = localtime(&current);
+/*
+ * REQBUFS can fail with EBUSY when another thread currently owns the
+ * queue of the same device; that contention is part of the stress, so
+ * retry and count it rather than fail.
+ */
+static int reqbufs(struct worker *w, unsigned count)
+{
+	struct v4l2_requestbuffers req;
 
-	memset(fname, 0, sizeof(fname));
+	for (;;) {
+		memset(&req, 0, sizeof(req));
+		req.count = count;
+		req.type = w->type;
+		req.memory = V4L2_MEMORY_MMAP;
+		if (!ioctl(w->fd, VIDIOC_REQBUFS, &req))
+			return req.count;
+		if (errno != EBUSY)
+			return -1;
+		w->ebusy_retries++;
+		usleep(1000);
+	}
+}
 
-	snprintf(fname, sizeof(fname), "stats-%.2d-%.2d-%.2d-%.2d-%.2d-%.2d.txt",
-		timep->tm_mon+1, timep->tm_mday, timep->tm_year + 1900,
-		timep->tm_hour,	timep->tm_min, timep->tm_sec);
+static int create_bufs(struct worker *w, unsigned count)
+{
+	struct v4l2_create_buffers cr;
 
-	fd_file = fopen(fname, "a+");
-	if (!fd_file) {
-		perror("error opening file");
+	memset(&cr, 0, sizeof(cr));
+	cr.count = count;
+	cr.memory = V4L2_MEMORY_MMAP;
+	cr.format.type = w->type;
+	if (ioctl(w->fd, VIDIOC_G_FMT, &cr.format) < 0)
 		return -1;
-	}
+	if (ioctl(w->fd, VIDIOC_CREATE_BUFS, &cr) < 0)
+		return -1;
+	return cr.count;
+}
 
-	srand(time(NULL));
+static int map_and_touch(struct worker *w, unsigned count)
+{
+	void *map[MAX_BUFFERS];
+	size_t len[MAX_BUFFERS];
+	unsigned i, mapped = 0;
+	int ret = 0;
 
-	while (1) {
+	for (i = 0; i < count && i < MAX_BUFFERS; i++) {
+		struct v4l2_buffer buf;
+		struct v4l2_plane plane;
+		off_t off;
 
-		if (time(&t1) < 0) {
-			perror("time_t t1");
-			fclose(fd_file);
-			return -1;
+		memset(&buf, 0, sizeof(buf));
+		memset(&plane, 0, sizeof(plane));
+		buf.index = i;
+		buf.type = w->type;
+		if (is_mplane(w->type)) {
+			buf.m.planes = &plane;
+			buf.length = 1;
 		}
-
-		fd = open(argv[1], O_RDONLY);
-		if (fd < 0) {
-			perror("error opening device");
-			fclose(fd_file);
-			return -1;
+		if (ioctl(w->fd, VIDIOC_QUERYBUF, &buf) < 0) {
+			ret = -1;
+			break;
+		}
+		if (is_mplane(w->type)) {
+			len[i] = plane.length;
+			off = plane.m.mem_offset;
+		} else {
+			len[i] = buf.length;
+			off = buf.m.offset;
 		}
+		map[i] = mmap(NULL, len[i], PROT_READ | PROT_WRITE,
+			      MAP_SHARED, w->fd, off);
+		if (map[i] == MAP_FAILED) {
+			ret = -1;
+			break;
+		}
+		mapped++;
+		/* fault in the first page so the allocation is real */
+		*(volatile unsigned char *)map[i];
+	}
+	for (i = 0; i < mapped; i++)
+		munmap(map[i], len[i]);
+	return ret;
+}
 
-		/* Random number 0 - 1000 */
-		magic_buffer_size = rand() % sizeof(buffer);
+static void *worker_thread(void *arg)
+{
+	struct worker *w = arg;
+	unsigned cycle;
 
-		memset(buffer, 0, sizeof(buffer));
+	w->lat_min_ns = ~0ULL;
 
-		ret = access(fname, W_OK);
-		if (ret < 0) {
-			close(fd);
-			perror("Error");
-			return -1;
+	for (cycle = 0; !opt_cycles || cycle < opt_cycles; cycle++) {
+		unsigned long long t0 = now_ns(), dt;
+		int count;
+
+		/* every other cycle goes through CREATE_BUFS, if supported */
+		if (w->has_create_bufs && (cycle & 1)) {
+			if (reqbufs(w, 0) < 0) {
+				w->failed = 1;
+				break;
+			}
+			count = create_bufs(w, opt_buffers);
+		} else {
+			count = reqbufs(w, opt_buffers);
+		}
+		if (count < 0 || map_and_touch(w, count) < 0 ||
+		    reqbufs(w, 0) < 0) {
+			fprintf(stderr, "%s: cycle %u: %s\n",
+				w->device, cycle, strerror(errno));
+			w->failed = 1;
+			break;
 		}
 
-		ret = read(fd, buffer, magic_buffer_size);
+		dt = now_ns() - t0;
+		if (dt < w->lat_min_ns)
+			w->lat_min_ns = dt;
+		if (dt > w->lat_max_ns)
+			w->lat_max_ns = dt;
+		w->lat_total_ns += dt;
+		if (opt_latency_ms && dt > opt_latency_ms * 1000000ULL)
+			w->over_budget++;
+		w->cycles++;
+	}
+	return NULL;
+}
+
+/* The historic stress: endless random sized read() calls */
+static int read_stress(const char *device)
+{
+	char buffer[1000];
+	unsigned cnt = 0;
+
+	srand(time(NULL));
+	for (;;) {
+		int fd = open(device, O_RDONLY);
+		int ret;
+
+		if (fd < 0) {
+			perror(device);
+			return 1;
+		}
+		ret = read(fd, buffer, rand() % sizeof(buffer));
 		if (ret < 0) {
-			fprintf(fd_file, "[%s] error reading buffer - [%s]\n",
-				argv[1], strerror(errno));
-			fflush(fd_file);
 			perror("error reading buffer from device");
-			return -1;
+			close(fd);
+			return 1;
 		}
+		close(fd);
+		if (!(++cnt % 1000))
+			printf("%u reads\n", cnt);
+	}
+}
 
-		if (time(&t2) < 0) {
-			perror("time_t t2");
-			fclose(fd_file);
-			return -1;
+static void usage(const char *prog)
+{
+	printf("Usage: %s [options] <device> [<device>...]\n"
+	       "  -t, --threads=<n>  threads per device (default 1)\n"
+	       "  -c, --cycles=<n>   cycles per thread, 0 = endless (default 1000)\n"
+	       "  -b, --buffers=<n>  buffers per cycle (default 4, max %d)\n"
+	       "  -l, --latency=<ms> fail when a cycle exceeds <ms> milliseconds\n"
+	       "  -r, --rss=<kb>     fail when RSS grows more than <kb> KiB\n"
+	       "  -R, --read         legacy mode: endless random sized read()s\n",
+	       prog, MAX_BUFFERS);
+}
+
+static const struct option long_opts[] = {
+	{ "threads", required_argument, NULL, 't' },
+	{ "cycles", required_argument, NULL, 'c' },
+	{ "buffers", required_argument, NULL, 'b' },
+	{ "latency", required_argument, NULL, 'l' },
+	{ "rss", required_argument, NULL, 'r' },
+	{ "read", no_argument, NULL, 'R' },
+	{ "help", no_argument, NULL, 'h' },
+	{ NULL, 0, NULL, 0 }
+};
+
+int main(int argc, char **argv)
+{
+	struct worker workers[MAX_THREADS];
+	unsigned long rss_start, rss_end;
+	unsigned long long t0, elapsed_ns;
+	unsigned num_workers = 0, total_cycles = 0, total_over = 0;
+	unsigned i;
+	int failed = 0, ch;
+
+	while ((ch = getopt_long(argc, argv, "t:c:b:l:r:Rh",
+				 long_opts, NULL)) != -1) {
+		switch (ch) {
+		case 't':
+			opt_threads = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			opt_cycles = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			opt_buffers = strtoul(optarg, NULL, 0);
+			if (opt_buffers > MAX_BUFFERS)
+				opt_buffers = MAX_BUFFERS;
+			break;
+		case 'l':
+			opt_latency_ms = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			opt_rss_kb = strtoul(optarg, NULL, 0);
+			break;
+		case 'R':
+			opt_read_mode = 1;
+			break;
+		case 'h':
+			usage(argv[0]);
+			return 0;
+		default:
+			usage(argv[0]);
+			return 1;
 		}
+	}
+	if (optind >= argc || !opt_threads) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (opt_read_mode)
+		return read_stress(argv[optind]);
 
-		dif = difftime(t2, t1);
+	memset(workers, 0, sizeof(workers));
+	for (i = optind; i < (unsigned)argc && i - optind < MAX_DEVICES; i++) {
+		unsigned t;
 
-		printf("Seconds: [%d] - Test Number: [%d] - Read [%d] bytes\n",
-			(int)dif, cnt, ret);
+		for (t = 0; t < opt_threads; t++) {
+			struct worker *w;
 
-		fprintf(fd_file, "Seconds: [%.2f] - Test number: [%d] - Read [%d] bytes\n",
-			dif,  cnt, ret);
+			if (num_workers >= MAX_THREADS) {
+				fprintf(stderr, "too many threads (max %d)\n",
+					MAX_THREADS);
+				return 1;
+			}
+			w = &workers[num_workers];
+			w->device = argv[i];
+			w->fd = open(w->device, O_RDWR);
+			if (w->fd < 0 || pick_buf_type(w->fd, &w->type) < 0) {
+				perror(w->device);
+				return 1;
+			}
+			/* probe once whether CREATE_BUFS is implemented */
+			w->has_create_bufs = create_bufs(w, 0) >= 0;
+			num_workers++;
+		}
+	}
 
-		fflush(fd_file);
+	rss_start = rss_kb();
+	t0 = now_ns();
+	for (i = 0; i < num_workers; i++)
+		pthread_create(&workers[i].tid, NULL, worker_thread,
+			       &workers[i]);
+	for (i = 0; i < num_workers; i++)
+		pthread_join(workers[i].tid, NULL);
+	elapsed_ns = now_ns() - t0;
+	rss_end = rss_kb();
 
-		cnt++;
+	for (i = 0; i < num_workers; i++) {
+		struct worker *w = &workers[i];
 
-		close(fd);
+		printf("%s: %u cycles, latency min/avg/max %.2f/%.2f/%.2f ms, "
+		       "%u over budget, %u EBUSY retries%s\n",
+		       w->device, w->cycles,
+		       w->cycles ? w->lat_min_ns / 1e6 : 0.0,
+		       w->cycles ? w->lat_total_ns / 1e6 / w->cycles : 0.0,
+		       w->lat_max_ns / 1e6,
+		       w->over_budget, w->ebusy_retries,
+		       w->failed ? " (FAILED)" : "");
+		total_cycles += w->cycles;
+		total_over += w->over_budget;
+		failed |= w->failed;
+		close(w->fd);
+	}
+
+	printf("total: %u cycles in %.2f s (%.1f cycles/s), RSS %lu -> %lu KiB\n",
+	       total_cycles, elapsed_ns / 1e9,
+	       total_cycles * 1e9 / elapsed_ns, rss_start, rss_end);
 
+	if (opt_latency_ms && total_over) {
+		fprintf(stderr, "FAIL: %u cycles exceeded the %u ms budget\n",
+			total_over, opt_latency_ms);
+		failed = 1;
 	}
-	return 0;
+	if (opt_rss_kb && rss_end > rss_start + opt_rss_kb) {
+		fprintf(stderr, "FAIL: RSS grew by %lu KiB (budget %u KiB)\n",
+			rss_end - rss_start, opt_rss_kb);
+		failed = 1;
+	}
+	return failed;
 }
@@ -34,6 +34,7 @@
 #define _DVB_DEMUX_H
 
 #include <linux/dvb/dmx.h>
+#include <unistd.h> /* size_t */
 
 #ifdef __cplusplus
 extern "C" {
@@ -150,6 +151,85 @@ int dvb_set_section_filter(int dmxfd, int pid, unsigned filtsize,
  */
 int dvb_get_pmt_pid(int dmxfd, int sid);
 
+struct dvb_dmx_ring;
+
+/**
+ * @brief A borrowed chunk of demux data, owned by a struct dvb_dmx_ring
+ * @ingroup demux
+ *
+ * @param data	pointer to the demux data. Valid until the chunk is given
+ *		back with dvb_dmx_ring_put()
+ * @param size	number of bytes at @p data
+ * @param index	ring index of the chunk. Internal to the ring; should not
+ *		be modified by the caller
+ */
+struct dvb_dmx_buf {
+	const unsigned char *data;
+	size_t size;
+	unsigned index;
+};
+
+/**
+ * @brief Sets up memory-mapped streaming I/O on a demux file descriptor
+ * @ingroup demux
+ *
+ * @param dmxfd		File descriptor for the demux device
+ * @param num_buffers	number of ring buffers to request
+ * @param bufsize	size, in bytes, of each ring buffer
+ *
+ * Requests a kernel demux ring (DMX_REQBUFS), maps its buffers and queues
+ * them. Demux data is then consumed with dvb_dmx_ring_get(), which borrows
+ * a filled buffer straight from the kernel ring without copying it, and
+ * dvb_dmx_ring_put(), which gives the buffer back to the kernel once the
+ * caller is done with it, e. g. after writing it to disk.
+ *
+ * On Kernels or drivers without memory-mapped demux support, the returned
+ * ring transparently falls back to read() into an internal buffer, with
+ * the same get/put usage.
+ *
+ * @return Returns the new ring on success, NULL otherwise.
+ */
+struct dvb_dmx_ring *dvb_dmx_ring_open(int dmxfd, unsigned num_buffers,
+				       unsigned bufsize);
+
+/**
+ * @brief Borrows the next filled buffer from a demux ring
+ * @ingroup demux
+ *
+ * @param ring	ring returned by dvb_dmx_ring_open()
+ * @param buf	filled with the borrowed data range on success
+ *
+ * Blocks until demux data is available, up to the same retry time used by
+ * the other demux wrappers. Each successful call must be paired with a
+ * dvb_dmx_ring_put() of the same @p buf; with memory-mapped rings, the
+ * kernel can't reuse the buffer until it is given back.
+ *
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int dvb_dmx_ring_get(struct dvb_dmx_ring *ring, struct dvb_dmx_buf *buf);
+
+/**
+ * @brief Gives a borrowed buffer back to a demux ring
+ * @ingroup demux
+ *
+ * @param ring	ring returned by dvb_dmx_ring_open()
+ * @param buf	buffer obtained with dvb_dmx_ring_get()
+ *
+ * @return Returns 0 on success, -1 otherwise.
+ */
+int dvb_dmx_ring_put(struct dvb_dmx_ring *ring, struct dvb_dmx_buf *buf);
+
+/**
+ * @brief Unmaps and frees a demux ring
+ * @ingroup demux
+ *
+ * @param ring	ring returned by dvb_dmx_ring_open()
+ *
+ * Any buffers still borrowed become invalid. The demux file descriptor
+ * itself is not closed.
+ */
+void dvb_dmx_ring_close(struct dvb_dmx_ring *ring);
+
 #ifdef __cplusplus
 }
 #endif
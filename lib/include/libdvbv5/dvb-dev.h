@@ -474,6 +474,64 @@ struct dvb_v5_descriptors *dvb_dev_scan(struct dvb_open_descriptor *open_dev,
 					unsigned other_nit,
 					unsigned timeout_multiply);
 
+struct dvb_file;
+
+/**
+ * @brief Scans a transponder list using several frontends in parallel
+ * @ingroup frontend_scan
+ *
+ * @param open_devs	array with one opened demux (DVB_DEVICE_DEMUX)
+ *			dvb_open_descriptor per frontend to be used on the
+ *			scan. Each descriptor should belong to its own
+ *			struct dvb_device, with the frontend already opened.
+ * @param num_devs	number of elements at the open_devs array
+ * @param dvb_file	struct dvb_file with the transponders to be scanned.
+ *			If new transponders are detected via the NIT tables,
+ *			new entries are appended to it during the scan.
+ * @param dvb_file_new	pointer to a struct dvb_file pointer where the
+ *			discovered services will be stored, as if filled by
+ *			dvb_store_channel().
+ * @param check_frontend a pointer to a function that will show the frontend
+ *			status while tuning into a transponder. It may be
+ *			called concurrently by different frontends.
+ * @param args		a pointer, opaque to libdvbv5, that will be used when
+ *			calling check_frontend. It should contain any parameters
+ *			that could be needed by check_frontend.
+ * @param other_nit	Use alternate table IDs for NIT and other tables
+ * @param timeout_multiply Improves the timeout for each table reception, by
+ *			using a bigger timeout.
+ * @param get_detected	if different than zero, uses the frontend parameters
+ *			obtained from the device driver (such as modulation,
+ *			FEC, etc)
+ * @param get_nit	if different than zero, uses the parameters obtained
+ *			from the MPEG-TS NIT table to add newly detected
+ *			transponders
+ * @param add_new_freqs	if different than zero, adds the transponders found
+ *			on the NIT tables to the scan, as
+ *			dvb_add_scaned_transponders() would do
+ *
+ * This function implements the same scan loop that applications usually
+ * build around dvb_dev_scan(), but distributing the transponder list
+ * between the num_devs frontends: each frontend picks the next transponder
+ * that still needs to be tuned, scans it with dvb_dev_scan() and merges
+ * the discovered services into dvb_file_new, with the needed locking. As
+ * tuning and waiting for the MPEG-TS tables dominates the scan time, the
+ * scan speed improves nearly linearly with the number of frontends.
+ *
+ * @return Returns the number of scanned frequencies, or -1 if the scan
+ * was aborted or on error.
+ */
+int dvb_dev_scan_parallel(struct dvb_open_descriptor **open_devs,
+			  unsigned num_devs,
+			  struct dvb_file *dvb_file,
+			  struct dvb_file **dvb_file_new,
+			  check_frontend_t *check_frontend,
+			  void *args,
+			  unsigned other_nit,
+			  unsigned timeout_multiply,
+			  int get_detected, int get_nit,
+			  int add_new_freqs);
+
 /* From dvb-dev-remote.c */
 
 #ifdef HAVE_DVBV5_REMOTE
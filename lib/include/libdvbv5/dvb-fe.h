@@ -397,6 +397,48 @@ void dvb_fe_prt_parms(const struct dvb_v5_fe_parms *parms);
  */
 int dvb_fe_set_parms(struct dvb_v5_fe_parms *parms);
 
+/**
+ * @brief Starts an asynchronous tune
+ * @ingroup frontend
+ *
+ * @param parms	struct dvb_v5_fe_parms pointer to the opened device
+ *
+ * Non-blocking variant of dvb_fe_set_parms(). On satellite delivery
+ * systems, the DiSEqC command sequence contains mandatory delays that
+ * dvb_fe_set_parms() spends sleeping; this call instead returns the delay
+ * to the caller, so that a single thread can keep several frontends tuning
+ * concurrently, using one timer (or poll() timeout) per frontend.
+ *
+ * Once the tune was submitted, the lock can be watched with
+ * dvb_fe_get_stats() or dvb_fe_monitor().
+ *
+ * This call acts directly on the local frontend device. On remote
+ * frontends accessed via the dvb-dev API, use dvb_fe_set_parms() instead.
+ *
+ * @return Return 0 if the tune was already submitted to the hardware, a
+ *	positive number of milliseconds to wait before calling
+ *	dvb_fe_set_parms_advance(), or a negative error code.
+ */
+int dvb_fe_set_parms_start(struct dvb_v5_fe_parms *parms);
+
+/**
+ * @brief Advances an asynchronous tune started by dvb_fe_set_parms_start()
+ * @ingroup frontend
+ *
+ * @param parms	struct dvb_v5_fe_parms pointer to the opened device
+ *
+ * Executes the next step of the DiSEqC command sequence, once the delay
+ * returned by the previous dvb_fe_set_parms_start() or
+ * dvb_fe_set_parms_advance() call has elapsed. When the sequence finishes,
+ * it submits the tune to the hardware.
+ *
+ * @return Return 0 if the tune was submitted to the hardware, a positive
+ *	number of milliseconds to wait before calling it again, or a
+ *	negative error code. Calling it without a tune in flight returns
+ *	-EINVAL.
+ */
+int dvb_fe_set_parms_advance(struct dvb_v5_fe_parms *parms);
+
 /**
  * @brief Prints all the properties at the cache
  * @ingroup frontend
@@ -602,6 +644,50 @@ int dvb_fe_snprintf_eng(char *buf, int len, float val);
  */
 int dvb_fe_get_event(struct dvb_v5_fe_parms *parms);
 
+/**
+ * @typedef int (*dvb_fe_monitor_cb)(struct dvb_v5_fe_parms *parms,
+ *				     fe_status_t status, void *user_priv)
+ * @brief callback used by dvb_fe_monitor() to report frontend status
+ * @ingroup frontend
+ *
+ * @param parms		struct dvb_v5_fe_parms pointer to the opened device
+ * @param status	the last known frontend status
+ * @param user_priv	pointer given to dvb_fe_monitor()
+ *
+ * The statistics for the frontend can be read from inside the callback
+ * with dvb_fe_retrieve_stats() and friends. Returning zero keeps the
+ * monitor running; a non-zero value stops it.
+ */
+typedef int (*dvb_fe_monitor_cb)(struct dvb_v5_fe_parms *parms,
+				 fe_status_t status, void *user_priv);
+
+/**
+ * @brief Watches the frontend status without polling for statistics
+ * @ingroup frontend
+ *
+ * @param parms		struct dvb_v5_fe_parms pointer to the opened device
+ * @param callback	function called on each signal event or period
+ * @param user_priv	pointer passed as-is to @p callback
+ * @param timeout_ms	period, in ms, on which @p callback is called when
+ *			no event arrived. Negative waits for events forever.
+ *
+ * Blocks watching the frontend event interface (FE_GET_EVENT via poll).
+ * The DTV_STAT_* property set cached at @p parms is refreshed only when
+ * the signal status actually changes; when the wait times out, the
+ * callback is called with the cached statistics, without issuing any
+ * ioctl. On frontends without an event queue, it degrades to refreshing
+ * the statistics every @p timeout_ms.
+ *
+ * The monitor returns when the callback returns non-zero or when the
+ * abort flag of @p parms is set.
+ *
+ * @return It returns 0 if success, a negative errno otherwise. Negative
+ * values returned by the callback are passed along.
+ */
+int dvb_fe_monitor(struct dvb_v5_fe_parms *parms,
+		   dvb_fe_monitor_cb callback, void *user_priv,
+		   int timeout_ms);
+
 /*
  * Other functions, associated to SEC/LNB/DISEqC
  *
@@ -228,6 +228,10 @@ struct dvb_parse_file {
  * @var FILE_VDR
  *	@brief File is at DVR format (as supported on version 2.1.6).
  *	       Note: this is only supported as an output format.
+ * @var FILE_DVBV5_BIN
+ *	@brief File is at the libdvbv5 binary indexed format. Faster to
+ *	       read than the text formats on big channel lists, and allows
+ *	       seeking a single service via dvb_bin_file_lookup().
  */
 enum dvb_file_formats {
 	FILE_UNKNOWN,
@@ -235,6 +239,7 @@ enum dvb_file_formats {
 	FILE_CHANNEL,
 	FILE_DVBV5,
 	FILE_VDR,
+	FILE_DVBV5_BIN,
 };
 
 struct dvb_v5_descriptors;
@@ -320,6 +325,67 @@ struct dvb_file *dvb_read_file(const char *fname);
  */
 int dvb_write_file(const char *fname, struct dvb_file *dvb_file);
 
+/**
+ * @brief Read a file at the libdvbv5 binary indexed format
+ * @ingroup file
+ *
+ * @param fname		file name
+ *
+ * @return It returns a pointer to struct dvb_file describing the entries that
+ * were read from the file. If it fails, NULL is returned.
+ */
+struct dvb_file *dvb_read_bin_file(const char *fname);
+
+/**
+ * @brief Write a file at the libdvbv5 binary indexed format
+ * @ingroup file
+ *
+ * @param fname		file name
+ * @param dvb_file	contents of the file to be written
+ *
+ * The file is written with a hash index keyed by the channel name and by
+ * the visual channel number, and can be read back either entirely, with
+ * dvb_read_bin_file(), or one service at a time, with
+ * dvb_bin_file_lookup(). The format is machine-dependent: files should be
+ * converted with the text formats when moved across machines.
+ *
+ * @return It returns zero if success, or -1 if it fails.
+ */
+int dvb_write_bin_file(const char *fname, struct dvb_file *dvb_file);
+
+/**
+ * @brief Append entries to a file at the libdvbv5 binary indexed format
+ * @ingroup file
+ *
+ * @param fname		file name
+ * @param dvb_file	entries to be appended
+ *
+ * Appends the entries of @p dvb_file to an existing binary file, creating
+ * it when needed. The already stored records are not rewritten: only the
+ * hash index at the end of the file is rebuilt, which keeps rescans cheap
+ * on big channel lists.
+ *
+ * @return It returns zero if success, or -1 if it fails.
+ */
+int dvb_append_bin_file(const char *fname, struct dvb_file *dvb_file);
+
+/**
+ * @brief Seeks services on a binary indexed file without reading it all
+ * @ingroup file
+ *
+ * @param fname		file name
+ * @param name		channel name or visual channel number to seek
+ *
+ * Looks up @p name on the file's hash index, comparing it against the
+ * channel name and the visual channel number of the stored services, in a
+ * case-insensitive way, and reads only the matched records.
+ *
+ * @return It returns a pointer to a struct dvb_file with the matched
+ * entries, with zero entries when nothing matched. If it fails, NULL is
+ * returned.
+ */
+struct dvb_file *dvb_bin_file_lookup(const char *fname, const char *name);
+
 /**
  * @brief Read a file on any format natively supported by
  *			    the library
@@ -353,6 +419,33 @@ int dvb_write_file_format(const char *fname,
 			  uint32_t delsys,
 			  enum dvb_file_formats format);
 
+/**
+ * @brief Converts a channel file between two formats, one entry at a
+ *			    time
+ * @ingroup file
+ *
+ * @param in_fname	input file name
+ * @param in_delsys	Delivery system of the input file, as specified by
+ *			enum fe_delivery_system. Used only by formats that
+ *			don't store the delivery system (like FILE_ZAP)
+ * @param in_format	Format of the input file
+ * @param out_fname	output file name
+ * @param out_delsys	Delivery system of the output file
+ * @param out_format	Format of the output file
+ *
+ * Unlike pairing dvb_read_file_format() with dvb_write_file_format(),
+ * each entry is written (and its memory reused) right after being
+ * parsed, so converting a file takes a constant amount of memory, no
+ * matter how many services it has. Formats without an entry-by-entry
+ * parser (FILE_VDR, FILE_DVBV5_BIN) are converted through an in-memory
+ * struct dvb_file instead.
+ *
+ * @return It returns zero if success, or a negative value if it fails.
+ */
+int dvb_convert_file_format(const char *in_fname, uint32_t in_delsys,
+			    enum dvb_file_formats in_format,
+			    const char *out_fname, uint32_t out_delsys,
+			    enum dvb_file_formats out_format);
 
 /**
  * @brief Stores a key/value pair on a DVB file entry
@@ -270,6 +270,37 @@ struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *parms, int
 					  unsigned other_nit,
 					  unsigned timeout_multiply);
 
+/**
+ * @brief Scans a DVB stream using several demux file descriptors in parallel
+ * @ingroup frontend_scan
+ *
+ * @param parms			pointer to struct dvb_v5_fe_parms created when
+ *				the frontend is opened
+ * @param dmx_fds		array of opened demux file descriptors
+ * @param num_fds		number of file descriptors at @ref dmx_fds
+ * @param delivery_system	delivery system to be scanned
+ * @param other_nit		use alternate table IDs for NIT and other tables
+ * @param timeout_multiply	improves the timeout for each table reception
+ * 				by using a value that will multiply the wait
+ *				time.
+ *
+ * Works like dvb_get_ts_tables(), but keeps one section filter active per
+ * demux file descriptor, polling all of them at the same time. Each table
+ * completes as soon as its last section arrives, so the time spent on a
+ * transponder is bound by the slowest table instead of the sum of all the
+ * table timeouts. Passing a single file descriptor is equivalent to
+ * dvb_get_ts_tables().
+ *
+ * On sucess, it returns a pointer to a struct dvb_v5_descriptors, that can
+ * either be used to tune into a service or to be stored inside a file.
+ */
+struct dvb_v5_descriptors *dvb_get_ts_tables_multi(struct dvb_v5_fe_parms *parms,
+						   int *dmx_fds,
+						   unsigned num_fds,
+						   uint32_t delivery_system,
+						   unsigned other_nit,
+						   unsigned timeout_multiply);
+
 /**
  * @brief frees a struct dvb_v5_descriptors
  * @ingroup frontend_scan
@@ -345,6 +376,38 @@ struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *parms,
 						unsigned other_nit,
 						unsigned timeout_multiply);
 
+/**
+ * @brief Scans a transponder using several demux file descriptors in parallel
+ * @ingroup frontend_scan
+ *
+ * @param parms		pointer to struct dvb_v5_fe_parms created when the
+ *			frontend is opened
+ * @param entry		DVB file entry that corresponds to a transponder to be
+ * 			tuned
+ * @param dmx_fds		array of opened demux file descriptors
+ * @param num_fds		number of file descriptors at @ref dmx_fds
+ * @param check_frontend	a pointer to a function that will show the frontend
+ *			status while tuning into a transponder
+ * @param args		a pointer, opaque to libdvbv5, that will be used when
+ *			calling check_frontend. It should contain any parameters
+ *			that could be needed by check_frontend.
+ * @param other_nit		Use alternate table IDs for NIT and other tables
+ * @param timeout_multiply	Improves the timeout for each table reception, by
+ *
+ * Works like dvb_scan_transponder(), but collects the MPEG tables via
+ * dvb_get_ts_tables_multi(), with one section filter active per demux file
+ * descriptor. Each file descriptor should be an independent open of the
+ * demux device, as the filter state belongs to the file description.
+ */
+struct dvb_v5_descriptors *dvb_scan_transponder_multi(struct dvb_v5_fe_parms *parms,
+						      struct dvb_entry *entry,
+						      int *dmx_fds,
+						      unsigned num_fds,
+						      check_frontend_t *check_frontend,
+						      void *args,
+						      unsigned other_nit,
+						      unsigned timeout_multiply);
+
 
 /**
  * @brief Add new transponders to a dvb_file
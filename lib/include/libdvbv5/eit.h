@@ -84,7 +84,9 @@
  * @param running_status	running status of the event. The status can
  *				be translated to string via
  *				dvb_eit_running_status_name string table.
- * @param descriptor		pointer to struct dvb_desc
+ * @param descriptor		pointer to struct dvb_desc. Filled on demand:
+ *				use dvb_table_eit_event_descriptors() to
+ *				access the descriptors of an event
  * @param next			pointer to struct dvb_table_eit_event
  * @param tm_start		event start (in struct tm format)
  * @param duration		duration in seconds
@@ -94,6 +96,12 @@
  * converting the integer fields to the CPU endianness, and converting the
  * timestamps to a way that it is better handled on Linux.
  *
+ * The descriptors of an event are not decoded when the table is parsed:
+ * only the raw bytes are kept. They're decoded, at the first access, by
+ * dvb_table_eit_event_descriptors(). This makes harvesting a full EPG a
+ * lot cheaper, as typically only a small fraction of the events has its
+ * descriptors ever looked at.
+ *
  * The undocumented parameters are used only internally by the API and/or
  * are fields that are reserved. They shouldn't be used, as they may change
  * on future API releases.
@@ -122,6 +130,8 @@ struct dvb_table_eit_event {
 	struct tm start;
 	uint32_t duration;
 	uint16_t service_id;
+	uint8_t *raw_desc;
+	uint16_t raw_desc_length;
 } __attribute__((packed));
 
 /**
@@ -199,6 +209,25 @@ ssize_t dvb_table_eit_init (struct dvb_v5_fe_parms *parms, const uint8_t *buf,
  */
 void dvb_table_eit_free(struct dvb_table_eit *table);
 
+/**
+ * @brief Returns the descriptors of an EIT event, decoding them on the
+ *	  first access
+ * @ingroup dvb_table
+ *
+ * @param parms	struct dvb_v5_fe_parms pointer to the opened device
+ * @param event	pointer to struct dvb_table_eit_event
+ *
+ * dvb_table_eit_init() only stores the raw descriptor bytes of each
+ * event. This function decodes them into the dvb_table_eit_event::descriptor
+ * linked list at the first call for a given event; later calls just
+ * return the already decoded list.
+ *
+ * @return A pointer to the first struct dvb_desc of the event, or NULL
+ * if the event has no descriptors or if decoding them failed.
+ */
+struct dvb_desc *dvb_table_eit_event_descriptors(struct dvb_v5_fe_parms *parms,
+						 struct dvb_table_eit_event *event);
+
 /**
  * @brief Prints the content of the DVB EIT table
  * @ingroup dvb_table
@@ -70,6 +70,91 @@ LIBV4L_PUBLIC void *v4l2_mmap(void *start, size_t length, int prot, int flags,
 		int fd, int64_t offset);
 LIBV4L_PUBLIC int v4l2_munmap(void *_start, size_t length);
 
+/* v4l2_peek_frame / v4l2_release_frame: zero-copy replacement for
+   v4l2_read().
+
+   v4l2_peek_frame dequeues one frame and lends the buffer holding it to
+   the caller, instead of copying it into a caller supplied buffer as
+   v4l2_read() does. When no conversion is needed this is the mmap-ed
+   driver buffer itself, so capturing raw frames this way costs no copy
+   at all. Each peeked frame must be handed back with v4l2_release_frame
+   before the next peek (only one frame can be lent out at a time, a
+   second peek fails with errno EBUSY) and the pointer is only valid
+   until the release or until the stream state is changed.
+
+   Like v4l2_read this uses mmap streaming mode under the hood; on
+   drivers where that is not possible it fails with errno ENOSYS and the
+   caller should fall back to v4l2_read().
+
+   v4l2_peek_frame returns the size of the frame in bytes, or -1 with
+   errno set on error. v4l2_release_frame returns 0 on success. */
+LIBV4L_PUBLIC ssize_t v4l2_peek_frame(int fd, unsigned char **frame);
+LIBV4L_PUBLIC int v4l2_release_frame(int fd);
+
+struct v4l2_buffer;
+
+/* v4l2_dqbuf_multi: dequeue up to count buffers with a single call.
+
+   Fill bufs[0]'s type and memory fields as you would for VIDIOC_DQBUF;
+   the remaining elements are filled in by libv4l2. The first dequeue
+   honors the fd's blocking mode, after that only buffers which are
+   already ready are dequeued, so the call never waits for the camera
+   once it has a frame. Format conversion is done per dequeued buffer,
+   just as with v4l2_ioctl(VIDIOC_DQBUF).
+
+   Returns the number of buffers dequeued (which may be less than count),
+   or -1 with errno set if the first dequeue fails. */
+LIBV4L_PUBLIC int v4l2_dqbuf_multi(int fd, struct v4l2_buffer *bufs, int count);
+
+
+/* v4l2_set_memory_budget: soft cap, in bytes, on the conversion /
+   read-emulation buffer working set of this device.
+
+   When set, libv4l2 requests at most budget / frame-size buffers (but
+   never fewer than 2) when it sets up streaming itself, instead of the
+   default buffer count. This bounds what a 4K stream pins per device.
+   Buffer counts chosen by the application through VIDIOC_REQBUFS are
+   not overridden. Independent of the budget, the conversion buffer
+   pages are released back to the kernel on STREAMOFF (once none of them
+   are mmap-ed anymore), so idle devices don't hold on to full-rate
+   buffer memory.
+
+   Returns 0 on success, -1 with errno EINVAL when the fd is not handled
+   by libv4l2. */
+LIBV4L_PUBLIC int v4l2_set_memory_budget(int fd, size_t bytes);
+
+/* v4l2_export_buffer: export a capture buffer as a DMABUF fd
+   (VIDIOC_EXPBUF) for zero-copy handoff to a GPU or encoder.
+
+   The dmabuf refers to the raw driver buffer, so this only works when
+   libv4lconvert is not converting the stream: when conversion is active
+   the call fails with errno ENOTSUP and the application must fall back
+   to reading the converted frames. flags is passed through to the
+   driver (O_CLOEXEC, O_RDONLY, ...).
+
+   Returns the dmabuf fd (owned by the caller) or -1 with errno set. */
+LIBV4L_PUBLIC int v4l2_export_buffer(int fd, int buffer_index, int flags);
+
+/* Per-device performance counters, kept with a few relaxed atomics per
+   frame so they can stay enabled in production. All counters are
+   monotonic from the open of the device; the time counters are in
+   nanoseconds. Only the libv4l2-managed streaming and conversion paths
+   are counted, frames passed straight through to the driver are not. */
+struct v4l2_stats {
+	uint64_t frames;	/* frames dequeued or read */
+	uint64_t dqbuf_wait_ns;	/* time spent blocked waiting for a frame */
+	uint64_t convert_ns;	/* time spent converting / copying frame data */
+	uint64_t bytes_copied;	/* frame bytes converted or copied */
+	uint64_t lock_wait_ns;	/* time spent waiting for the stream lock */
+};
+
+/* Takes a snapshot of the counters for the given fd. Returns 0 on success,
+   -1 with errno EINVAL when the fd is not handled by libv4l2.
+
+   Setting the LIBV4L2_STATS environment variable (to anything) also dumps
+   the counters to v4l2_log_file (or stderr) when a device is closed. */
+LIBV4L_PUBLIC int v4l2_get_stats(int fd, struct v4l2_stats *stats);
+
 
 /* Misc utility functions */
 
@@ -321,6 +321,82 @@ LIBV4L_PUBLIC void v4l2_rds_reset(struct v4l2_rds *handle, bool reset_statistics
  * 				on RDS capable V4L2 devices */
 LIBV4L_PUBLIC uint32_t v4l2_rds_add(struct v4l2_rds *handle, struct v4l2_rds_data *rds_data);
 
+/* returns the accumulated bitmask of fields (V4L2_RDS_PI, V4L2_RDS_PS, ...)
+ * that were updated since the previous call, and resets the accumulator.
+ * This lets consumers react to changes at their own pace instead of
+ * inspecting the handle after every block; it is safe to call from a
+ * different thread than the one decoding the blocks */
+LIBV4L_PUBLIC uint32_t v4l2_rds_get_changed_fields(struct v4l2_rds *handle);
+
+/* enables asynchronous decoding for the handle: raw blocks queued with
+ * v4l2_rds_add_async() are decoded by a worker thread, so the thread doing
+ * the radio I/O doesn't pay for the group decoding
+ * @cb:		called from the worker after every decoded group that updated
+ * 				fields in the handle; may be NULL. The handle must only be
+ * 				read from the callback while asynchronous decoding is enabled
+ * @cb_arg: 	opaque pointer passed through to the callback
+ * @return:	0 on success, -EBUSY if already enabled, or a negative errno */
+LIBV4L_PUBLIC int v4l2_rds_enable_async(struct v4l2_rds *handle,
+		void (*cb)(struct v4l2_rds *handle, uint32_t updated_fields,
+			   void *cb_arg),
+		void *cb_arg);
+
+/* stops asynchronous decoding: drains the queued blocks, joins the worker
+ * thread and frees the queue. Called implicitly by v4l2_rds_destroy() */
+LIBV4L_PUBLIC void v4l2_rds_disable_async(struct v4l2_rds *handle);
+
+/* queues a raw RDS block for asynchronous decoding; only one thread may
+ * queue blocks for a given handle (the queue is single-producer)
+ * @return:	true if the block was queued, false if the queue is full or
+ * 				asynchronous decoding isn't enabled
+ * @rds_data: 	3 bytes of raw RDS data, obtained by calling read()
+ * 				on RDS capable V4L2 devices */
+LIBV4L_PUBLIC bool v4l2_rds_add_async(struct v4l2_rds *handle, struct v4l2_rds_data *rds_data);
+
+/* opaque manager for decoding many stations at once (e.g. band scans):
+ * it keeps one decoding context per frequency, created on demand, and a
+ * shared pool of interned PS/RT strings */
+struct v4l2_rds_mc;
+
+/* a single raw RDS block tagged with the frequency it was received on,
+ * used for bulk-adding interleaved scan data */
+struct v4l2_rds_mc_block {
+	uint32_t frequency;		/* in kHz */
+	struct v4l2_rds_data data;
+};
+
+/* creates a new multi-station manager
+ * @is_rbds:	standard used by all contexts: true=RBDS, false=RDS */
+LIBV4L_PUBLIC struct v4l2_rds_mc *v4l2_rds_mc_create(bool is_rbds);
+
+/* frees the manager, all its decoding contexts and the interned strings;
+ * pointers returned by the v4l2_rds_mc_* functions become invalid */
+LIBV4L_PUBLIC void v4l2_rds_mc_destroy(struct v4l2_rds_mc *mc);
+
+/* returns the decoding context tracking the given frequency, creating it
+ * if the frequency wasn't seen before. NULL on allocation failure */
+LIBV4L_PUBLIC struct v4l2_rds *v4l2_rds_mc_get(struct v4l2_rds_mc *mc, uint32_t freq);
+
+/* routes one raw block to the context tracking the given frequency
+ * @return:	bitmask with updated fields, like v4l2_rds_add() */
+LIBV4L_PUBLIC uint32_t v4l2_rds_mc_add(struct v4l2_rds_mc *mc, uint32_t freq,
+		struct v4l2_rds_data *rds_data);
+
+/* decodes an array of (frequency, block) pairs in one pass
+ * @return:	bitmask with all fields updated by any of the blocks */
+LIBV4L_PUBLIC uint32_t v4l2_rds_mc_add_blocks(struct v4l2_rds_mc *mc,
+		struct v4l2_rds_mc_block *blocks, unsigned int num_blocks);
+
+/* returns the shared copy of the given string from the interning pool,
+ * adding it if needed; the copy stays valid until the manager is destroyed */
+LIBV4L_PUBLIC const char *v4l2_rds_mc_intern(struct v4l2_rds_mc *mc, const char *str);
+
+/* return the interned PS / RT string of the station tracked at the given
+ * frequency, or NULL if it hasn't been validly decoded yet. Stations
+ * broadcasting the same string share a single copy */
+LIBV4L_PUBLIC const char *v4l2_rds_mc_get_ps(struct v4l2_rds_mc *mc, uint32_t freq);
+LIBV4L_PUBLIC const char *v4l2_rds_mc_get_rt(struct v4l2_rds_mc *mc, uint32_t freq);
+
 /*
  * group of functions to translate numerical RDS data into strings
  *
@@ -110,6 +110,11 @@ LIBV4L_PUBLIC int v4lconvert_needs_conversion(struct v4lconvert_data *data,
     - be called only once per frame
    Otherwise this may result in unintended double conversions !
 
+   Setting bytesperline in dest_fmt larger than a packed line makes the
+   conversion write dest lines padded out to that stride (the luma stride
+   for the planar yuv formats, chroma lines use half of it), for apps
+   which need stride aligned buffers (GPU upload, hw encoders, ...).
+
    Returns the amount of bytes written to dest and -1 on error */
 LIBV4L_PUBLIC int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *src_fmt,  /* in */
@@ -151,6 +156,46 @@ LIBV4L_PUBLIC int v4lconvert_supported_dst_format(unsigned int pixelformat);
 LIBV4L_PUBLIC int v4lconvert_get_fps(struct v4lconvert_data *data);
 LIBV4L_PUBLIC void v4lconvert_set_fps(struct v4lconvert_data *data, int fps);
 
+/* Get/set the number of threads used to convert a frame. Banding capable
+   conversions (packed pixel formats to RGB24 / BGR24) are then split into
+   horizontal bands which are converted on a persistent worker-thread pool.
+   0 selects the number of available processors, 1 (the default) keeps
+   everything on the calling thread. The initial value can also be set
+   through the LIBV4LCONVERT_THREADS environment variable. */
+LIBV4L_PUBLIC void v4lconvert_set_num_threads(struct v4lconvert_data *data,
+		int num_threads);
+LIBV4L_PUBLIC int v4lconvert_get_num_threads(struct v4lconvert_data *data);
+
+/* The intermediate buffers used while converting are carved out of one
+   scratch arena which grows to the high-water mark of what the stream
+   needs and is then reused frame after frame. v4lconvert_get_scratch_size
+   returns its current size in bytes, v4lconvert_trim_scratch releases it
+   (it will be re-allocated on demand by the next conversion, so only call
+   this between streams / after format renegotiation). */
+LIBV4L_PUBLIC int v4lconvert_get_scratch_size(struct v4lconvert_data *data);
+LIBV4L_PUBLIC void v4lconvert_trim_scratch(struct v4lconvert_data *data);
+
+/* Asynchronous version of v4lconvert_convert: submit hands the frame to a
+   worker thread and returns immediately, collect waits for the conversion
+   to finish and returns the amount of bytes written to dest (or -1 + errno,
+   just like v4lconvert_convert). This allows decoding / converting frame N
+   to overlap with consuming frame N - 1 in a capture loop:
+
+	v4lconvert_convert_submit(data, ..., frame N);
+	consume(frame N - 1);
+	v4lconvert_convert_collect(data);
+
+   At most one frame may be in flight per v4lconvert_data context; a second
+   submit before collect fails with EBUSY, collect without a submitted frame
+   fails with EINVAL. The src and dest buffers must stay valid (and dest must
+   not be read) until the frame is collected, and no other functions may be
+   called on the context while a frame is in flight. */
+LIBV4L_PUBLIC int v4lconvert_convert_submit(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,  /* in */
+		const struct v4l2_format *dest_fmt, /* in */
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size);
+LIBV4L_PUBLIC int v4lconvert_convert_collect(struct v4lconvert_data *data);
+
 /* Fixup bytesperline and sizeimage for supported destination formats */
 LIBV4L_PUBLIC void v4lconvert_fixup_fmt(struct v4l2_format *fmt);
 
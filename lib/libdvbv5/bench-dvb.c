@@ -0,0 +1,224 @@
+/*
+ * Microbenchmark for the libdvbv5 section parsing hot paths
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+/*
+ * Times dvb_crc32() and the EIT table/descriptor parsers over synthetic
+ * sections, so changes to the section code can be checked for throughput
+ * regressions without a tuner.  Not installed; build and run it from the
+ * build tree:
+ *
+ *	make bench-dvb && ./bench-dvb [-C] [seconds-per-case]
+ *
+ * -C emits one "benchmark,case,unit,value" line per measurement, for
+ * the top-level "make bench" results file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libdvbv5/dvb-fe.h>
+#include <libdvbv5/crc32.h>
+#include <libdvbv5/descriptors.h>
+#include <libdvbv5/eit.h>
+
+#define TS_PACKET_SIZE	188
+
+static int csv;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, const char *what, double mbps)
+{
+	if (csv)
+		printf("%s,%s,MBps,%.1f\n", name, what, mbps);
+	else
+		printf("%-16s %-16s %10.1f MB/s\n", name, what, mbps);
+}
+
+/* 12 bytes up to the descriptors, as on the wire */
+#define EIT_EVENT_HDR_SIZE	12
+
+static int add_short_event_desc(uint8_t *p, unsigned event)
+{
+	char name[32], text[64];
+	int name_len, text_len;
+
+	name_len = snprintf(name, sizeof(name), "Event %u", event);
+	text_len = snprintf(text, sizeof(text),
+			    "Synthetic event %u used by bench-dvb", event);
+
+	p[0] = 0x4d;	/* short_event_descriptor */
+	p[1] = 3 + 1 + name_len + 1 + text_len;
+	memcpy(p + 2, "eng", 3);
+	p[5] = name_len;
+	memcpy(p + 6, name, name_len);
+	p[6 + name_len] = text_len;
+	memcpy(p + 7 + name_len, text, text_len);
+
+	return 2 + p[1];
+}
+
+/*
+ * Builds an EIT section with n_events events, each carrying one
+ * short_event descriptor, roughly what a real EPG harvest sees.
+ */
+static int build_eit_section(uint8_t *buf, unsigned n_events)
+{
+	uint8_t *p = buf;
+	unsigned i;
+
+	memset(buf, 0, 8);
+	buf[0] = DVB_TABLE_EIT;
+	buf[1] = 0x80;		/* section_syntax_indicator, length below */
+	buf[3] = 0x02;		/* service_id = 0x0002 */
+	buf[5] = 0x01;		/* current_next */
+	p += 8;
+
+	/* transport_id, network_id, last segment/table */
+	memset(p, 0, 6);
+	p[1] = 0x10;
+	p[3] = 0x20;
+	p += 6;
+
+	for (i = 0; i < n_events; i++) {
+		int dlen;
+
+		p[0] = i >> 8;
+		p[1] = i & 0xff;
+		/* start: MJD + hh:mm:ss in BCD */
+		p[2] = 0xc0;
+		p[3] = 0x79;
+		p[4] = 0x12;
+		p[5] = 0x30;
+		p[6] = 0x00;
+		/* duration: 30 minutes */
+		p[7] = 0x00;
+		p[8] = 0x30;
+		p[9] = 0x00;
+
+		dlen = add_short_event_desc(p + EIT_EVENT_HDR_SIZE, i);
+		p[10] = (4 << 5) | (dlen >> 8);		/* running */
+		p[11] = dlen & 0xff;
+		p += EIT_EVENT_HDR_SIZE + dlen;
+	}
+
+	buf[1] |= ((p - buf - 3) >> 8) & 0x0f;
+	buf[2] = (p - buf - 3) & 0xff;
+
+	return p - buf;
+}
+
+static void bench_crc32(const char *what, const uint8_t *buf, size_t len,
+			double seconds_per_case)
+{
+	double start, elapsed;
+	long loops = 0;
+	uint32_t crc = 0xffffffff;
+
+	dvb_crc32((uint8_t *)buf, len, crc);
+	start = now();
+	do {
+		crc = dvb_crc32((uint8_t *)buf, len, crc);
+		loops++;
+		elapsed = now() - start;
+	} while (elapsed < seconds_per_case);
+
+	/* keep the result alive so the loop isn't optimized out */
+	if (crc == 0xdeadbeef)
+		fprintf(stderr, "!");
+
+	report("dvb_crc32", what, loops * len / elapsed / (1024 * 1024));
+}
+
+int main(int argc, char **argv)
+{
+	double seconds_per_case = 0.25;
+	struct dvb_v5_fe_parms *parms;
+	uint8_t section[4096], crcbuf[4096];
+	int section_len;
+	double start, elapsed;
+	long loops;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-C"))
+			csv = 1;
+		else
+			seconds_per_case = atof(argv[i]);
+	}
+	if (seconds_per_case <= 0) {
+		fprintf(stderr, "usage: bench-dvb [-C] [seconds-per-case]\n");
+		return 1;
+	}
+
+	parms = dvb_fe_dummy();
+	if (!parms)
+		return 1;
+
+	srand(1);
+	for (i = 0; (size_t)i < sizeof(crcbuf); i++)
+		crcbuf[i] = rand() & 0xff;
+
+	bench_crc32("ts_packet", crcbuf, TS_PACKET_SIZE, seconds_per_case);
+	bench_crc32("section_4k", crcbuf, sizeof(crcbuf), seconds_per_case);
+
+	section_len = build_eit_section(section, 24);
+
+	/* table parse alone: descriptors stay raw, as on an EPG scan */
+	loops = 0;
+	start = now();
+	do {
+		struct dvb_table_eit *eit = NULL;
+
+		if (dvb_table_eit_init(parms, section, section_len, &eit) < 0) {
+			fprintf(stderr, "bench-dvb: EIT parse failed\n");
+			return 1;
+		}
+		dvb_table_eit_free(eit);
+		loops++;
+		elapsed = now() - start;
+	} while (elapsed < seconds_per_case);
+	report("eit_parse", "24_events",
+	       loops * section_len / elapsed / (1024 * 1024));
+
+	/* table parse plus descriptor decode of every event */
+	loops = 0;
+	start = now();
+	do {
+		struct dvb_table_eit *eit = NULL;
+		struct dvb_table_eit_event *event;
+
+		if (dvb_table_eit_init(parms, section, section_len, &eit) < 0) {
+			fprintf(stderr, "bench-dvb: EIT parse failed\n");
+			return 1;
+		}
+		for (event = eit->event; event; event = event->next)
+			dvb_table_eit_event_descriptors(parms, event);
+		dvb_table_eit_free(eit);
+		loops++;
+		elapsed = now() - start;
+	} while (elapsed < seconds_per_case);
+	report("eit_parse_desc", "24_events",
+	       loops * section_len / elapsed / (1024 * 1024));
+
+	dvb_fe_close(parms);
+	return 0;
+}
@@ -293,20 +293,44 @@ static const struct cCountry country_list[] = {
 
 #define COUNTRY_COUNT (sizeof(country_list)/sizeof(struct cCountry))
 
-static int cmp_alpha2(const void *key, const void *b)
-{
-	const struct cCountry *elem = b;
+/*
+ * An alpha-2 code indexes a 26 x 26 table directly, so lookups are a
+ * single table load. The alpha-3 codes are searched via a separate
+ * index sorted by the three-letter name, as country_list itself is
+ * sorted by the alpha-2 one. Both indexes are built on first use.
+ */
+static short alpha2_idx[26 * 26];
+static short alpha3_idx[COUNTRY_COUNT];
+static int country_idx_built;
 
-	return strcasecmp(key, elem->alpha2_name);
+static int cmp_alpha3_idx(const void *a, const void *b)
+{
+	return strcasecmp(country_list[*(const short *)a].alpha3_name,
+			  country_list[*(const short *)b].alpha3_name);
 }
 
-static int cmp_alpha3(const void *key, const void *b)
+static int cmp_alpha3_key(const void *key, const void *b)
 {
-	const struct cCountry *elem = b;
-
-	return strcasecmp(key, elem->alpha3_name);
+	return strcasecmp(key, country_list[*(const short *)b].alpha3_name);
 }
 
+static void country_idx_build(void)
+{
+	const char *a2;
+	unsigned i;
+
+	for (i = 0; i < 26 * 26; i++)
+		alpha2_idx[i] = -1;
+	for (i = 0; i < COUNTRY_COUNT; i++) {
+		a2 = country_list[i].alpha2_name;
+		if (a2[0])	/* skip the COUNTRY_UNKNOWN placeholder */
+			alpha2_idx[(a2[0] - 'A') * 26 + (a2[1] - 'A')] = i;
+		alpha3_idx[i] = i;
+	}
+	qsort(alpha3_idx, COUNTRY_COUNT, sizeof(alpha3_idx[0]),
+	      cmp_alpha3_idx);
+	country_idx_built = 1;
+}
 
 /* convert ISO 3166-1 two-letter constant (alpha-2)
  * to index number
@@ -314,11 +338,19 @@ static int cmp_alpha3(const void *key, const void *b)
  */
 enum dvb_country_t dvb_country_a2_to_id(const char *name)
 {
-	const struct cCountry *p;
+	int c0, c1, idx;
+
+	if (!country_idx_built)
+		country_idx_build();
 
-	p = bsearch(name, country_list,
-			COUNTRY_COUNT, sizeof(country_list[0]), cmp_alpha2);
-	return p ? p->id : COUNTRY_UNKNOWN;
+	if (!isalpha((unsigned char)name[0]) ||
+	    !isalpha((unsigned char)name[1]) || name[2])
+		return COUNTRY_UNKNOWN;
+
+	c0 = toupper((unsigned char)name[0]) - 'A';
+	c1 = toupper((unsigned char)name[1]) - 'A';
+	idx = alpha2_idx[c0 * 26 + c1];
+	return idx >= 0 ? country_list[idx].id : COUNTRY_UNKNOWN;
 }
 
 /* convert ISO 3166-1 three-letter constant (alpha-3)
@@ -327,11 +359,14 @@ enum dvb_country_t dvb_country_a2_to_id(const char *name)
  */
 enum dvb_country_t dvb_country_a3_to_id(const char *name)
 {
-	const struct cCountry *p;
+	const short *p;
+
+	if (!country_idx_built)
+		country_idx_build();
 
-	p = bsearch(name, country_list,
-			COUNTRY_COUNT, sizeof(country_list[0]), cmp_alpha3);
-	return p ? p->id : COUNTRY_UNKNOWN;
+	p = bsearch(name, alpha3_idx,
+			COUNTRY_COUNT, sizeof(alpha3_idx[0]), cmp_alpha3_key);
+	return p ? country_list[*p].id : COUNTRY_UNKNOWN;
 }
 
 
@@ -381,10 +416,17 @@ static const char * cats[] = {
 
 enum dvb_country_t dvb_guess_user_country(void)
 {
+	static enum dvb_country_t cached_id = COUNTRY_UNKNOWN;
+	static int cached;
 	char * buf, * pch, * pbuf;
 	unsigned cat;
 	enum dvb_country_t id = COUNTRY_UNKNOWN;
 
+	/* The locale won't change behind our back: guess only once */
+	if (cached)
+		return cached_id;
+	cached = 1;
+
 	for (cat = 0; cat < sizeof(cats)/sizeof(cats[0]); cat++) {
 
 		// the returned char * should be "C", "POSIX" or something valid.
@@ -418,9 +460,11 @@ enum dvb_country_t dvb_guess_user_country(void)
 		if (strlen(pbuf) == 2)
 			id = dvb_country_a2_to_id(pbuf);
 		free(buf);
-		if (id != COUNTRY_UNKNOWN)
-			return id;
+		if (id != COUNTRY_UNKNOWN) {
+			cached_id = id;
+			break;
+		}
 	}
 
-	return COUNTRY_UNKNOWN;
+	return cached_id;
 }
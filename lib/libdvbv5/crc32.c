@@ -18,6 +18,12 @@
  *
  */
 
+#include <config.h>
+
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
 #include <libdvbv5/crc32.h>
 
 static uint32_t crctab[256] = {
@@ -66,9 +72,53 @@ static uint32_t crctab[256] = {
   0xbcb4666d, 0xb8757bda, 0xb5365d03, 0xb1f740b4
 };
 
-inline uint32_t dvb_crc32(uint8_t *data, size_t len, uint32_t crc)
+/*
+ * Slice-by-8 tables, derived from crctab at the first dvb_crc32() call.
+ * crc8tab[0] is crctab itself; crc8tab[k][i] extends the remainder of
+ * byte i by k more zero bytes, which allows consuming 8 input bytes per
+ * iteration with eight independent table lookups instead of a serial
+ * byte-by-byte loop.
+ */
+static uint32_t crc8tab[8][256];
+
+static void dvb_crc32_init_tables(void)
 {
-  while(len--)
+  unsigned i, k;
+
+  for (i = 0; i < 256; i++)
+    crc8tab[0][i] = crctab[i];
+
+  for (k = 1; k < 8; k++)
+    for (i = 0; i < 256; i++)
+      crc8tab[k][i] = (crc8tab[k - 1][i] << 8) ^
+		      crctab[(crc8tab[k - 1][i] >> 24) & 0xff];
+}
+
+#ifdef HAVE_PTHREAD
+static pthread_once_t dvb_crc32_once = PTHREAD_ONCE_INIT;
+#endif
+
+uint32_t dvb_crc32(uint8_t *data, size_t len, uint32_t crc)
+{
+#ifdef HAVE_PTHREAD
+  pthread_once(&dvb_crc32_once, dvb_crc32_init_tables);
+#else
+  if (!crc8tab[7][1])
+    dvb_crc32_init_tables();
+#endif
+
+  while (len >= 8) {
+    uint32_t q = crc ^ ((uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+			(uint32_t)data[2] << 8 | (uint32_t)data[3]);
+
+    crc = crc8tab[7][(q >> 24) & 0xff] ^ crc8tab[6][(q >> 16) & 0xff] ^
+	  crc8tab[5][(q >> 8) & 0xff] ^ crc8tab[4][q & 0xff] ^
+	  crc8tab[3][data[4]] ^ crc8tab[2][data[5]] ^
+	  crc8tab[1][data[6]] ^ crc8tab[0][data[7]];
+    data += 8;
+    len -= 8;
+  }
+  while (len--)
     crc = (crc << 8) ^ crctab[((crc >> 24) ^ *data++) & 0xff];
   return crc;
 }
@@ -64,6 +64,121 @@ static void dvb_desc_init(uint8_t type, uint8_t length, struct dvb_desc *desc)
 	desc->next   = NULL;
 }
 
+/*
+ * Descriptor arena. A table section carries up to a few dozen descriptors
+ * and they're all parsed, linked and - later - freed together, so instead
+ * of one calloc() per descriptor, dvb_desc_parse() sizes one arena for the
+ * whole descriptor loop and bump-allocates the nodes from it. Each node is
+ * preceded by a hidden pointer back to its arena, and the arena counts the
+ * live nodes carved from it, so dvb_desc_free() releases the entire arena
+ * with a single free() when the last node of the list goes away.
+ */
+struct dvb_desc_arena {
+	unsigned int refcount;
+	size_t used;
+	size_t size;
+};
+
+#define DVB_DESC_ARENA_ALIGN (2 * sizeof(void *))
+
+static size_t dvb_desc_arena_round(size_t size)
+{
+	return (size + DVB_DESC_ARENA_ALIGN - 1) & ~(DVB_DESC_ARENA_ALIGN - 1);
+}
+
+static struct dvb_desc_arena *dvb_desc_arena_new(size_t size)
+{
+	struct dvb_desc_arena *arena;
+
+	arena = calloc(1, dvb_desc_arena_round(sizeof(*arena)) + size);
+	if (!arena)
+		return NULL;
+	arena->size = size;
+	return arena;
+}
+
+static struct dvb_desc *dvb_desc_arena_carve(struct dvb_desc_arena *arena,
+					     size_t size)
+{
+	char *mem = (char *)arena + dvb_desc_arena_round(sizeof(*arena));
+	struct dvb_desc *desc;
+
+	size = DVB_DESC_ARENA_ALIGN + dvb_desc_arena_round(size);
+	if (arena->used + size > arena->size)
+		return NULL;
+
+	desc = (struct dvb_desc *)(mem + arena->used + DVB_DESC_ARENA_ALIGN);
+	((struct dvb_desc_arena **)desc)[-1] = arena;
+	arena->used += size;
+	arena->refcount++;
+	return desc;
+}
+
+static struct dvb_desc *dvb_desc_arena_alloc(struct dvb_desc_arena *arena,
+					     size_t size)
+{
+	struct dvb_desc *desc = NULL;
+
+	if (arena)
+		desc = dvb_desc_arena_carve(arena, size);
+	if (!desc) {
+		/*
+		 * The arena was sized upfront for the whole descriptor loop,
+		 * so this only happens on a pre-scan mismatch or when the
+		 * arena allocation itself failed: give the node its own
+		 * single-entry arena.
+		 */
+		arena = dvb_desc_arena_new(DVB_DESC_ARENA_ALIGN +
+					   dvb_desc_arena_round(size));
+		if (!arena)
+			return NULL;
+		desc = dvb_desc_arena_carve(arena, size);
+	}
+	return desc;
+}
+
+static void dvb_desc_arena_put(struct dvb_desc *desc)
+{
+	struct dvb_desc_arena *arena = ((struct dvb_desc_arena **)desc)[-1];
+
+	if (!--arena->refcount)
+		free(arena);
+}
+
+static void dvb_desc_arena_release_unused(struct dvb_desc_arena *arena)
+{
+	if (arena && !arena->refcount)
+		free(arena);
+}
+
+/* Mirrors the dvb_desc_parse() loop to size the arena for all its nodes */
+static size_t dvb_desc_parse_size(const uint8_t *buf, uint16_t buflen)
+{
+	const uint8_t *ptr = buf, *endbuf = buf + buflen;
+	size_t total = 0;
+
+	while (ptr + 2 <= endbuf) {
+		uint8_t desc_type = ptr[0];
+		uint8_t desc_len  = ptr[1];
+		size_t size;
+
+		if (desc_type == 0xff)
+			break;
+		ptr += 2;
+		if (ptr + desc_len > endbuf)
+			break;
+		if (dvb_descriptors[desc_type].init)
+			size = dvb_descriptors[desc_type].size;
+		else
+			size = sizeof(struct dvb_desc) + desc_len;
+		if (!size)
+			break;
+		total += DVB_DESC_ARENA_ALIGN + dvb_desc_arena_round(size);
+		ptr += desc_len;
+	}
+	return total;
+}
+
 static int dvb_desc_default_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf, struct dvb_desc *desc)
 {
 	memcpy(desc->data, buf, desc->length);
@@ -136,11 +251,22 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			   uint16_t buflen, struct dvb_desc **head_desc)
 {
 	const uint8_t *ptr = buf, *endbuf = buf + buflen;
+	struct dvb_desc_arena *arena = NULL;
 	struct dvb_desc *current = NULL;
 	struct dvb_desc *last = NULL;
+	size_t arena_size;
 
 	*head_desc = NULL;
 
+	/*
+	 * Pre-scan the loop and do a single allocation for all the
+	 * descriptors of this section. If it fails, the nodes fall back to
+	 * individual arenas at dvb_desc_arena_alloc().
+	 */
+	arena_size = dvb_desc_parse_size(buf, buflen);
+	if (arena_size)
+		arena = dvb_desc_arena_new(arena_size);
+
 	while (ptr + 2 <= endbuf ) {
 		uint8_t desc_type = ptr[0];
 		uint8_t desc_len  = ptr[1];
@@ -148,6 +274,7 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 
 		if (desc_type == 0xff ) {
 			dvb_logwarn("%s: stopping at invalid descriptor 0xff", __func__);
+			dvb_desc_arena_release_unused(arena);
 			return 0;
 		}
 
@@ -156,6 +283,7 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		if (ptr + desc_len > endbuf) {
 			dvb_logerr("%s: short read of %zd/%d bytes parsing descriptor %#02x",
 				   __func__, endbuf - ptr, desc_len, desc_type);
+			dvb_desc_arena_release_unused(arena);
 			return -1;
 		}
 
@@ -183,12 +311,14 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		}
 		if (!size) {
 			dvb_logerr("descriptor type 0x%02x has no size defined", desc_type);
+			dvb_desc_arena_release_unused(arena);
 			return -2;
 		}
 
-		current = calloc(1, size);
+		current = dvb_desc_arena_alloc(arena, size);
 		if (!current) {
 			dvb_logerr("%s: out of memory", __func__);
+			dvb_desc_arena_release_unused(arena);
 			return -3;
 		}
 		dvb_desc_init(desc_type, desc_len, current); /* initialize the standard header */
@@ -198,7 +328,13 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 			if (parms->verbose)
 				dvb_hexdump(parms, "content: ", ptr, desc_len);
 
-			free(current);
+			/*
+			 * The order matters: if current is the only node
+			 * carved from the arena, putting it also frees the
+			 * arena.
+			 */
+			dvb_desc_arena_release_unused(arena);
+			dvb_desc_arena_put(current);
 			return -4;
 		}
 		if (!*head_desc)
@@ -208,6 +344,7 @@ int dvb_desc_parse(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		last = current;
 		ptr += current->length;     /* standard descriptor header plus descriptor length */
 	}
+	dvb_desc_arena_release_unused(arena);
 	return 0;
 }
 
@@ -231,7 +368,7 @@ void dvb_desc_free(struct dvb_desc **list)
 		desc = desc->next;
 		if (dvb_descriptors[tmp->type].free)
 			dvb_descriptors[tmp->type].free(tmp);
-		free(tmp);
+		dvb_desc_arena_put(tmp);
 	}
 	*list = NULL;
 }
@@ -0,0 +1,736 @@
+/*
+ * Copyright (c) 2011-2014 - Mauro Carvalho Chehab
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation version 2.1 of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ */
+
+/*
+ * Binary indexed channel list format.
+ *
+ * Large operator databases (tens of thousands of services) take too long
+ * to re-parse from the text formats at every tool startup. This format
+ * stores the very same data carried by struct dvb_entry as fixed binary
+ * records, followed by an open-addressing hash index keyed by the channel
+ * name and by the visual channel number, so a single service can be found
+ * without materializing the whole list.
+ *
+ * The file is meant to be mmap'ed and is read in place: records use the
+ * writer's byte order, which is checked on open. Rescans append new
+ * records over the old index and only the index is rebuilt, so growing a
+ * big file doesn't rewrite it. The text formats remain the import/export
+ * path.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <libdvbv5/dvb-file.h>
+
+#include <config.h>
+
+#ifdef ENABLE_NLS
+# include "gettext.h"
+# include <libintl.h>
+# define _(string) dgettext(LIBDVBV5_DOMAIN, string)
+
+#else
+# define _(string) string
+#endif
+
+# define N_(string) string
+
+#define DVB_BIN_MAGIC		"DVBV5BIN"
+#define DVB_BIN_VERSION		1
+#define DVB_BIN_BYTE_ORDER	0x01020304
+
+struct dvb_bin_header {
+	char		magic[8];
+	uint32_t	version;
+	uint32_t	byte_order;	/* DVB_BIN_BYTE_ORDER, as written */
+	uint32_t	n_entries;
+	uint32_t	reserved;
+	uint64_t	index_offset;	/* records span [header, index) */
+};
+
+/*
+ * One channel record. The fixed part below is followed by:
+ *	n_props		pairs of uint32_t { cmd, data }
+ *	video_pid_len	uint16_t PIDs
+ *	audio_pid_len	uint16_t PIDs
+ *	other_el_pid_len pairs of uint16_t { pid, type }
+ *	the channel, vchannel, location and lnb strings, NUL-terminated
+ *	(an empty string stands for an absent field)
+ * and the record is padded to a multiple of 4 bytes, so that the next
+ * record keeps its uint32_t members naturally aligned.
+ */
+struct dvb_bin_entry {
+	uint32_t	size;		/* total record size, in bytes */
+	uint16_t	service_id;
+	uint16_t	network_id;
+	uint16_t	transport_id;
+	uint16_t	n_props;
+	uint16_t	video_pid_len;
+	uint16_t	audio_pid_len;
+	uint16_t	other_el_pid_len;
+	uint16_t	reserved;
+	int32_t		sat_number;
+	uint32_t	freq_bpf;
+	uint32_t	diseqc_wait;
+};
+
+/*
+ * The index is an open-addressing hash table with linear probing. Each
+ * entry record contributes one key per non-empty channel name and one per
+ * visual channel number; collisions are solved by comparing the strings
+ * inside the pointed record. An empty slot has hash == 0.
+ */
+struct dvb_bin_index {
+	uint32_t	n_buckets;	/* power of two */
+	uint32_t	n_keys;
+};
+
+struct dvb_bin_key {
+	uint32_t	hash;
+	uint32_t	offset;		/* file offset of the entry record */
+};
+
+#define DVB_BIN_ALIGN(x)	(((x) + 3) & ~(uint32_t)3)
+
+/* Case-insensitive FNV-1a, as the text formats match names with strcasecmp */
+static uint32_t dvb_bin_hash(const char *s)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (*s) {
+		hash ^= tolower((unsigned char)*s++);
+		hash *= 0x01000193;
+	}
+	if (!hash)
+		hash = 1;	/* zero marks an empty slot */
+	return hash;
+}
+
+static uint32_t dvb_bin_entry_size(struct dvb_entry *entry)
+{
+	uint32_t size = sizeof(struct dvb_bin_entry);
+
+	size += entry->n_props * 2 * sizeof(uint32_t);
+	size += entry->video_pid_len * sizeof(uint16_t);
+	size += entry->audio_pid_len * sizeof(uint16_t);
+	size += entry->other_el_pid_len * 2 * sizeof(uint16_t);
+	size += (entry->channel ? strlen(entry->channel) : 0) + 1;
+	size += (entry->vchannel ? strlen(entry->vchannel) : 0) + 1;
+	size += (entry->location ? strlen(entry->location) : 0) + 1;
+	size += (entry->lnb ? strlen(entry->lnb) : 0) + 1;
+
+	return DVB_BIN_ALIGN(size);
+}
+
+static void dvb_bin_pack_entry(struct dvb_entry *entry, void *buf)
+{
+	struct dvb_bin_entry *rec = buf;
+	uint32_t *prop;
+	uint16_t *pid;
+	char *p;
+	unsigned i;
+
+	memset(buf, 0, dvb_bin_entry_size(entry));
+
+	rec->size = dvb_bin_entry_size(entry);
+	rec->service_id = entry->service_id;
+	rec->network_id = entry->network_id;
+	rec->transport_id = entry->transport_id;
+	rec->n_props = entry->n_props;
+	rec->video_pid_len = entry->video_pid_len;
+	rec->audio_pid_len = entry->audio_pid_len;
+	rec->other_el_pid_len = entry->other_el_pid_len;
+	rec->sat_number = entry->sat_number;
+	rec->freq_bpf = entry->freq_bpf;
+	rec->diseqc_wait = entry->diseqc_wait;
+
+	prop = (uint32_t *)(rec + 1);
+	for (i = 0; i < entry->n_props; i++) {
+		*prop++ = entry->props[i].cmd;
+		*prop++ = entry->props[i].u.data;
+	}
+
+	pid = (uint16_t *)prop;
+	for (i = 0; i < entry->video_pid_len; i++)
+		*pid++ = entry->video_pid[i];
+	for (i = 0; i < entry->audio_pid_len; i++)
+		*pid++ = entry->audio_pid[i];
+	for (i = 0; i < entry->other_el_pid_len; i++) {
+		*pid++ = entry->other_el_pid[i].pid;
+		*pid++ = entry->other_el_pid[i].type;
+	}
+
+	p = (char *)pid;
+	p = stpcpy(p, entry->channel ? entry->channel : "") + 1;
+	p = stpcpy(p, entry->vchannel ? entry->vchannel : "") + 1;
+	p = stpcpy(p, entry->location ? entry->location : "") + 1;
+	stpcpy(p, entry->lnb ? entry->lnb : "");
+}
+
+/*
+ * Validates that the record at offset fits in the file and that its
+ * variable-length payload is consistent with the sizes it announces.
+ * Returns the record size, or 0 if the file is corrupted.
+ */
+static uint32_t dvb_bin_check_entry(void *map, uint64_t limit, uint64_t offset)
+{
+	struct dvb_bin_entry *rec;
+	uint32_t payload;
+
+	if (offset + sizeof(*rec) > limit)
+		return 0;
+	rec = (struct dvb_bin_entry *)((char *)map + offset);
+	if (rec->size < sizeof(*rec) || offset + rec->size > limit)
+		return 0;
+	/* entry->props[] is a fixed DTV_MAX_COMMAND array */
+	if (rec->n_props > DTV_MAX_COMMAND)
+		return 0;
+
+	payload = sizeof(*rec);
+	payload += rec->n_props * 2 * sizeof(uint32_t);
+	payload += rec->video_pid_len * sizeof(uint16_t);
+	payload += rec->audio_pid_len * sizeof(uint16_t);
+	payload += rec->other_el_pid_len * 2 * sizeof(uint16_t);
+	payload += 4;	/* at least the four NUL terminators */
+	if (payload > rec->size)
+		return 0;
+	/* The strings must end within the record */
+	if (*((char *)rec + rec->size - 1) != '\0')
+		return 0;
+	/*
+	 * The unpackers walk four NUL-terminated strings after the pid
+	 * arrays; make sure all four terminators are inside the record
+	 * so the walk can't run past it.
+	 */
+	{
+		const char *p = (const char *)rec + payload - 4;
+		const char *end = (const char *)rec + rec->size;
+		unsigned nuls = 0;
+
+		while (p < end)
+			if (!*p++)
+				nuls++;
+		if (nuls < 4)
+			return 0;
+	}
+
+	return rec->size;
+}
+
+static struct dvb_entry *dvb_bin_unpack_entry(struct dvb_bin_entry *rec)
+{
+	struct dvb_entry *entry;
+	uint32_t *prop;
+	uint16_t *pid;
+	char *p;
+	unsigned i;
+
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->service_id = rec->service_id;
+	entry->network_id = rec->network_id;
+	entry->transport_id = rec->transport_id;
+	entry->n_props = rec->n_props;
+	entry->sat_number = rec->sat_number;
+	entry->freq_bpf = rec->freq_bpf;
+	entry->diseqc_wait = rec->diseqc_wait;
+
+	prop = (uint32_t *)(rec + 1);
+	for (i = 0; i < rec->n_props; i++) {
+		entry->props[i].cmd = *prop++;
+		entry->props[i].u.data = *prop++;
+	}
+
+	pid = (uint16_t *)prop;
+	if (rec->video_pid_len) {
+		entry->video_pid = calloc(rec->video_pid_len,
+					  sizeof(*entry->video_pid));
+		if (!entry->video_pid)
+			goto error;
+		entry->video_pid_len = rec->video_pid_len;
+		for (i = 0; i < rec->video_pid_len; i++)
+			entry->video_pid[i] = *pid++;
+	}
+	if (rec->audio_pid_len) {
+		entry->audio_pid = calloc(rec->audio_pid_len,
+					  sizeof(*entry->audio_pid));
+		if (!entry->audio_pid)
+			goto error;
+		entry->audio_pid_len = rec->audio_pid_len;
+		for (i = 0; i < rec->audio_pid_len; i++)
+			entry->audio_pid[i] = *pid++;
+	}
+	if (rec->other_el_pid_len) {
+		entry->other_el_pid = calloc(rec->other_el_pid_len,
+					     sizeof(*entry->other_el_pid));
+		if (!entry->other_el_pid)
+			goto error;
+		entry->other_el_pid_len = rec->other_el_pid_len;
+		for (i = 0; i < rec->other_el_pid_len; i++) {
+			entry->other_el_pid[i].pid = *pid++;
+			entry->other_el_pid[i].type = *pid++;
+		}
+	}
+
+	p = (char *)pid;
+	if (*p)
+		entry->channel = strdup(p);
+	p += strlen(p) + 1;
+	if (*p)
+		entry->vchannel = strdup(p);
+	p += strlen(p) + 1;
+	if (*p)
+		entry->location = strdup(p);
+	p += strlen(p) + 1;
+	if (*p)
+		entry->lnb = strdup(p);
+
+	return entry;
+
+error:
+	free(entry->video_pid);
+	free(entry->audio_pid);
+	free(entry->other_el_pid);
+	free(entry);
+	return NULL;
+}
+
+static void dvb_bin_index_add(struct dvb_bin_key *keys, uint32_t n_buckets,
+			      uint32_t hash, uint32_t offset)
+{
+	uint32_t i = hash & (n_buckets - 1);
+
+	while (keys[i].hash)
+		i = (i + 1) & (n_buckets - 1);
+	keys[i].hash = hash;
+	keys[i].offset = offset;
+}
+
+/* The channel and vchannel strings are the first two in the payload */
+static void dvb_bin_entry_names(struct dvb_bin_entry *rec,
+				char **channel, char **vchannel)
+{
+	char *p = (char *)(rec + 1) +
+		  rec->n_props * 2 * sizeof(uint32_t) +
+		  (rec->video_pid_len + rec->audio_pid_len +
+		   rec->other_el_pid_len * 2) * sizeof(uint16_t);
+
+	*channel = p;
+	*vchannel = p + strlen(p) + 1;
+}
+
+/*
+ * Scans the records in [sizeof(header), limit) and writes a fresh index
+ * at limit, with one key per non-empty channel name and vchannel.
+ * Returns 0 on success, -1 otherwise.
+ */
+static int dvb_bin_write_index(int fd, void *map, uint64_t limit,
+			       uint32_t n_entries)
+{
+	struct dvb_bin_index idx;
+	struct dvb_bin_key *keys;
+	uint64_t offset;
+	uint32_t size, n_buckets;
+	ssize_t len;
+
+	n_buckets = 16;
+	while (n_buckets < 4 * n_entries)
+		n_buckets <<= 1;
+
+	keys = calloc(n_buckets, sizeof(*keys));
+	if (!keys) {
+		perror("calloc");
+		return -1;
+	}
+
+	idx.n_buckets = n_buckets;
+	idx.n_keys = 0;
+
+	for (offset = sizeof(struct dvb_bin_header); offset < limit;
+	     offset += size) {
+		struct dvb_bin_entry *rec;
+		char *channel, *vchannel;
+
+		size = dvb_bin_check_entry(map, limit, offset);
+		if (!size) {
+			free(keys);
+			return -1;
+		}
+		rec = (struct dvb_bin_entry *)((char *)map + offset);
+		dvb_bin_entry_names(rec, &channel, &vchannel);
+		if (*channel) {
+			dvb_bin_index_add(keys, n_buckets,
+					  dvb_bin_hash(channel), offset);
+			idx.n_keys++;
+		}
+		if (*vchannel && strcasecmp(vchannel, channel)) {
+			dvb_bin_index_add(keys, n_buckets,
+					  dvb_bin_hash(vchannel), offset);
+			idx.n_keys++;
+		}
+	}
+
+	len = pwrite(fd, &idx, sizeof(idx), limit);
+	if (len == sizeof(idx))
+		len = pwrite(fd, keys, n_buckets * sizeof(*keys),
+			     limit + sizeof(idx));
+	free(keys);
+	if (len != (ssize_t)(n_buckets * sizeof(*keys))) {
+		perror("pwrite");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Maps an existing file, checking header sanity. Returns the mapped size
+ * via map_size, or -1 on error.
+ */
+static int dvb_bin_map_file(const char *fname, int fd, void **map,
+			    uint64_t *map_size)
+{
+	struct dvb_bin_header *header;
+	struct stat st;
+
+	if (fstat(fd, &st) == -1) {
+		perror(fname);
+		return -1;
+	}
+	if ((uint64_t)st.st_size < sizeof(*header)) {
+		fprintf(stderr, _("%s: not a DVBv5 binary file\n"), fname);
+		return -1;
+	}
+
+	*map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (*map == MAP_FAILED) {
+		perror(fname);
+		return -1;
+	}
+	*map_size = st.st_size;
+
+	header = *map;
+	if (memcmp(header->magic, DVB_BIN_MAGIC, sizeof(header->magic)) ||
+	    header->version != DVB_BIN_VERSION ||
+	    header->byte_order != DVB_BIN_BYTE_ORDER ||
+	    header->index_offset < sizeof(*header) ||
+	    header->index_offset > *map_size) {
+		fprintf(stderr,
+			_("%s: not a DVBv5 binary file for this machine\n"),
+			fname);
+		munmap(*map, *map_size);
+		return -1;
+	}
+
+	return 0;
+}
+
+int dvb_write_bin_file(const char *fname, struct dvb_file *dvb_file)
+{
+	struct dvb_bin_header header;
+	struct dvb_entry *entry;
+	void *buf, *map;
+	uint64_t offset;
+	uint32_t size, max_size = 0;
+	struct stat st;
+	int fd, ret = -1;
+
+	fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		perror(fname);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, DVB_BIN_MAGIC, sizeof(header.magic));
+	header.version = DVB_BIN_VERSION;
+	header.byte_order = DVB_BIN_BYTE_ORDER;
+
+	offset = sizeof(header);
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		size = dvb_bin_entry_size(entry);
+		if (size > max_size)
+			max_size = size;
+		header.n_entries++;
+		offset += size;
+	}
+	header.index_offset = offset;
+
+	buf = malloc(max_size ? max_size : 1);
+	if (!buf) {
+		perror("malloc");
+		goto ret;
+	}
+
+	offset = sizeof(header);
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		size = dvb_bin_entry_size(entry);
+		dvb_bin_pack_entry(entry, buf);
+		if (pwrite(fd, buf, size, offset) != (ssize_t)size) {
+			perror(fname);
+			free(buf);
+			goto ret;
+		}
+		offset += size;
+	}
+	free(buf);
+
+	if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		perror(fname);
+		goto ret;
+	}
+
+	/* Index the records just written */
+	if (fstat(fd, &st) == -1) {
+		perror(fname);
+		goto ret;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror(fname);
+		goto ret;
+	}
+	ret = dvb_bin_write_index(fd, map, header.index_offset,
+				  header.n_entries);
+	munmap(map, st.st_size);
+
+ret:
+	close(fd);
+	return ret;
+}
+
+int dvb_append_bin_file(const char *fname, struct dvb_file *dvb_file)
+{
+	struct dvb_bin_header header;
+	struct dvb_entry *entry;
+	void *buf, *map;
+	uint64_t offset, map_size;
+	uint32_t size, max_size = 0;
+	struct stat st;
+	int fd, ret = -1;
+
+	fd = open(fname, O_RDWR);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			return dvb_write_bin_file(fname, dvb_file);
+		perror(fname);
+		return -1;
+	}
+
+	if (dvb_bin_map_file(fname, fd, &map, &map_size) == -1) {
+		close(fd);
+		return -1;
+	}
+	memcpy(&header, map, sizeof(header));
+	munmap(map, map_size);
+
+	/* New records overwrite the old index, which is rebuilt at the end */
+	offset = header.index_offset;
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		size = dvb_bin_entry_size(entry);
+		if (size > max_size)
+			max_size = size;
+	}
+
+	buf = malloc(max_size ? max_size : 1);
+	if (!buf) {
+		perror("malloc");
+		goto ret;
+	}
+
+	for (entry = dvb_file->first_entry; entry; entry = entry->next) {
+		size = dvb_bin_entry_size(entry);
+		dvb_bin_pack_entry(entry, buf);
+		if (pwrite(fd, buf, size, offset) != (ssize_t)size) {
+			perror(fname);
+			free(buf);
+			goto ret;
+		}
+		header.n_entries++;
+		offset += size;
+	}
+	free(buf);
+
+	header.index_offset = offset;
+	if (pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+		perror(fname);
+		goto ret;
+	}
+	if (ftruncate(fd, offset) == -1) {
+		perror(fname);
+		goto ret;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		perror(fname);
+		goto ret;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		perror(fname);
+		goto ret;
+	}
+	ret = dvb_bin_write_index(fd, map, header.index_offset,
+				  header.n_entries);
+	munmap(map, st.st_size);
+
+ret:
+	close(fd);
+	return ret;
+}
+
+struct dvb_file *dvb_read_bin_file(const char *fname)
+{
+	struct dvb_bin_header *header;
+	struct dvb_file *dvb_file;
+	struct dvb_entry **tail;
+	void *map;
+	uint64_t offset, map_size;
+	uint32_t size;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		perror(fname);
+		return NULL;
+	}
+	if (dvb_bin_map_file(fname, fd, &map, &map_size) == -1) {
+		close(fd);
+		return NULL;
+	}
+	header = map;
+
+	dvb_file = calloc(1, sizeof(*dvb_file));
+	if (!dvb_file) {
+		perror("calloc");
+		goto error;
+	}
+
+	tail = &dvb_file->first_entry;
+	for (offset = sizeof(*header); offset < header->index_offset;
+	     offset += size) {
+		struct dvb_entry *entry;
+
+		size = dvb_bin_check_entry(map, header->index_offset, offset);
+		if (!size) {
+			fprintf(stderr, _("%s: corrupted entry at %llu\n"),
+				fname, (unsigned long long)offset);
+			goto error;
+		}
+		entry = dvb_bin_unpack_entry((struct dvb_bin_entry *)
+					     ((char *)map + offset));
+		if (!entry)
+			goto error;
+		*tail = entry;
+		tail = &entry->next;
+		dvb_file->n_entries++;
+	}
+
+	munmap(map, map_size);
+	close(fd);
+	return dvb_file;
+
+error:
+	dvb_file_free(dvb_file);
+	munmap(map, map_size);
+	close(fd);
+	return NULL;
+}
+
+struct dvb_file *dvb_bin_file_lookup(const char *fname, const char *name)
+{
+	struct dvb_bin_header *header;
+	struct dvb_bin_index idx;
+	struct dvb_bin_key *keys;
+	struct dvb_file *dvb_file = NULL;
+	struct dvb_entry **tail;
+	void *map;
+	uint64_t map_size;
+	uint32_t hash, i, probes;
+	int fd;
+
+	fd = open(fname, O_RDONLY);
+	if (fd == -1) {
+		perror(fname);
+		return NULL;
+	}
+	if (dvb_bin_map_file(fname, fd, &map, &map_size) == -1) {
+		close(fd);
+		return NULL;
+	}
+	header = map;
+
+	if (header->index_offset + sizeof(idx) > map_size)
+		goto ret;
+	memcpy(&idx, (char *)map + header->index_offset, sizeof(idx));
+	if (!idx.n_buckets || (idx.n_buckets & (idx.n_buckets - 1)) ||
+	    header->index_offset + sizeof(idx) +
+	    (uint64_t)idx.n_buckets * sizeof(*keys) > map_size)
+		goto ret;
+	keys = (struct dvb_bin_key *)((char *)map + header->index_offset +
+				      sizeof(idx));
+
+	dvb_file = calloc(1, sizeof(*dvb_file));
+	if (!dvb_file)
+		goto ret;
+	tail = &dvb_file->first_entry;
+
+	hash = dvb_bin_hash(name);
+	for (i = hash & (idx.n_buckets - 1), probes = 0;
+	     keys[i].hash && probes < idx.n_buckets;
+	     i = (i + 1) & (idx.n_buckets - 1), probes++) {
+		struct dvb_bin_entry *rec;
+		struct dvb_entry *entry;
+		char *channel, *vchannel;
+
+		if (keys[i].hash != hash)
+			continue;
+		if (!dvb_bin_check_entry(map, header->index_offset,
+					 keys[i].offset))
+			continue;
+		rec = (struct dvb_bin_entry *)((char *)map + keys[i].offset);
+		dvb_bin_entry_names(rec, &channel, &vchannel);
+		if (strcasecmp(channel, name) && strcasecmp(vchannel, name))
+			continue;
+
+		entry = dvb_bin_unpack_entry(rec);
+		if (!entry)
+			break;
+		*tail = entry;
+		tail = &entry->next;
+		dvb_file->n_entries++;
+	}
+
+ret:
+	munmap(map, map_size);
+	close(fd);
+	return dvb_file;
+}
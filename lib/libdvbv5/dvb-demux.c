@@ -33,6 +33,7 @@
 #include <errno.h>
 
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -154,6 +155,148 @@ int dvb_set_section_filter(int dmxfd, int pid, unsigned filtsize,
 	return 0;
 }
 
+/*
+ * Memory-mapped demux ring. When the kernel supports DMX_REQBUFS, the
+ * buffers filled by the demux are borrowed by the caller as-is, so the
+ * data goes from the driver to its consumer without any copy. When it
+ * does not, get/put degrade to read() into an internal buffer.
+ */
+struct dvb_dmx_ring {
+	int fd;
+	unsigned num_buffers;	/* 0 on the read() fallback */
+	unsigned bufsize;
+	void **buffers;
+	unsigned *lengths;
+	unsigned char *read_buf;
+};
+
+struct dvb_dmx_ring *dvb_dmx_ring_open(int dmxfd, unsigned num_buffers,
+				       unsigned bufsize)
+{
+	struct dmx_requestbuffers reqbufs;
+	struct dvb_dmx_ring *ring;
+	unsigned i;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return NULL;
+	ring->fd = dmxfd;
+	ring->bufsize = bufsize;
+
+	memset(&reqbufs, 0, sizeof(reqbufs));
+	reqbufs.count = num_buffers;
+	reqbufs.size = bufsize;
+	if (xioctl(dmxfd, DMX_REQBUFS, &reqbufs) == -1) {
+		/* No mmap streaming support: fall back to read() */
+		ring->read_buf = malloc(bufsize);
+		if (!ring->read_buf) {
+			free(ring);
+			return NULL;
+		}
+		return ring;
+	}
+
+	ring->buffers = calloc(reqbufs.count, sizeof(*ring->buffers));
+	ring->lengths = calloc(reqbufs.count, sizeof(*ring->lengths));
+	if (!ring->buffers || !ring->lengths)
+		goto error;
+
+	for (i = 0; i < reqbufs.count; i++) {
+		struct dmx_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+		buf.index = i;
+		if (xioctl(dmxfd, DMX_QUERYBUF, &buf) == -1) {
+			perror("DMX_QUERYBUF failed");
+			goto error;
+		}
+
+		ring->buffers[i] = mmap(NULL, buf.length,
+					PROT_READ | PROT_WRITE, MAP_SHARED,
+					dmxfd, buf.offset);
+		if (ring->buffers[i] == MAP_FAILED) {
+			ring->buffers[i] = NULL;
+			perror("demux buffer mmap failed");
+			goto error;
+		}
+		ring->lengths[i] = buf.length;
+		ring->num_buffers++;
+
+		if (xioctl(dmxfd, DMX_QBUF, &buf) == -1) {
+			perror("DMX_QBUF failed");
+			goto error;
+		}
+	}
+
+	return ring;
+
+error:
+	dvb_dmx_ring_close(ring);
+	return NULL;
+}
+
+int dvb_dmx_ring_get(struct dvb_dmx_ring *ring, struct dvb_dmx_buf *buf)
+{
+	struct dmx_buffer dbuf;
+	int count;
+
+	if (!ring->num_buffers) {
+		if (((count = read(ring->fd, ring->read_buf, ring->bufsize)) < 0) &&
+		    errno == EOVERFLOW)
+			count = read(ring->fd, ring->read_buf, ring->bufsize);
+		if (count < 0)
+			return -1;
+
+		buf->data = ring->read_buf;
+		buf->size = count;
+		buf->index = 0;
+		return 0;
+	}
+
+	memset(&dbuf, 0, sizeof(dbuf));
+	if (xioctl(ring->fd, DMX_DQBUF, &dbuf) == -1)
+		return -1;
+	if (dbuf.index >= ring->num_buffers)
+		return -1;
+
+	buf->data = ring->buffers[dbuf.index];
+	buf->size = dbuf.bytesused;
+	buf->index = dbuf.index;
+	return 0;
+}
+
+int dvb_dmx_ring_put(struct dvb_dmx_ring *ring, struct dvb_dmx_buf *buf)
+{
+	struct dmx_buffer dbuf;
+
+	if (!ring->num_buffers)
+		return 0;
+
+	if (buf->index >= ring->num_buffers)
+		return -1;
+
+	memset(&dbuf, 0, sizeof(dbuf));
+	dbuf.index = buf->index;
+	if (xioctl(ring->fd, DMX_QBUF, &dbuf) == -1)
+		return -1;
+	return 0;
+}
+
+void dvb_dmx_ring_close(struct dvb_dmx_ring *ring)
+{
+	unsigned i;
+
+	if (!ring)
+		return;
+
+	for (i = 0; i < ring->num_buffers; i++)
+		munmap(ring->buffers[i], ring->lengths[i]);
+	free(ring->buffers);
+	free(ring->lengths);
+	free(ring->read_buf);
+	free(ring);
+}
+
 int dvb_get_pmt_pid(int patfd, int sid)
 {
 	int count;
@@ -788,15 +788,34 @@ static struct dvb_v5_descriptors *dvb_local_scan(struct dvb_open_descriptor *ope
 	struct dvb_device_priv *dvb = open_dev->dvb;
 	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
 	struct dvb_v5_descriptors *desc;
-	int fd = open_dev->fd;
+	int fds[3];
+	unsigned num_fds = 1, i;
 
 	if (dev->dvb_type != DVB_DEVICE_DEMUX) {
 		dvb_logerr(_("dvb_dev_scan: expecting a demux descriptor"));
 		return NULL;
 	}
 
-	desc = dvb_scan_transponder(dvb->d.fe_parms, entry, fd, check_frontend,
-				    args, other_nit, timeout_multiply);
+	/*
+	 * Each opened demux file descriptor provides an independent section
+	 * filter. Open a few extra ones, so the tables can be read in
+	 * parallel. If the device is out of filters, scan with what we got.
+	 */
+	fds[0] = open_dev->fd;
+	for (i = 1; i < ARRAY_SIZE(fds); i++) {
+		int fd = open(dev->path, O_RDWR | O_NONBLOCK);
+
+		if (fd < 0)
+			break;
+		fds[num_fds++] = fd;
+	}
+
+	desc = dvb_scan_transponder_multi(dvb->d.fe_parms, entry, fds, num_fds,
+					  check_frontend, args, other_nit,
+					  timeout_multiply);
+
+	for (i = 1; i < num_fds; i++)
+		close(fds[i]);
 
 	return desc;
 }
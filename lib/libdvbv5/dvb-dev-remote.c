@@ -39,6 +39,7 @@
 #include <resolv.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "dvb-fe-priv.h"
 #include "dvb-dev-priv.h"
@@ -77,6 +78,7 @@ struct ringbuffer {
 	ssize_t read, write;
 	char buf[RINGBUF_SIZE];
 	pthread_mutex_t lock;
+	pthread_cond_t cond;
 };
 
 #define CMD_SIZE	80
@@ -227,6 +229,36 @@ static ssize_t prepare_data(struct dvb_v5_fe_parms_priv *parms,
 	return ret;
 }
 
+/*
+ * Sends the length prefix and the message body to the server with a
+ * single writev() call, so the whole frame reaches the socket at once
+ * and payloads don't need to be copied into yet another buffer.
+ * Loops on partial writes.
+ */
+static int send_iov(int fd, struct iovec *iov, int iovcnt)
+{
+	ssize_t ret;
+
+	while (iovcnt) {
+		ret = writev(fd, iov, iovcnt);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		while (iovcnt && (size_t)ret >= iov->iov_len) {
+			ret -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base = (char *)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+	return 0;
+}
+
 static struct queued_msg *send_fmt(struct dvb_device_priv *dvb, int fd,
 				   const char *cmd, const char *fmt, ...)
 	__attribute__ (( format( printf, 4, 5 )));
@@ -238,7 +270,8 @@ static struct queued_msg *send_fmt(struct dvb_device_priv *dvb, int fd,
 	struct dvb_dev_remote_priv *priv = dvb->priv;
 	struct queued_msg *msg, *msgs;
 	char buf[REMOTE_BUF_SIZE], *p = buf, *endp = &buf[sizeof(buf)];
-	int ret, len, err;
+	struct iovec iov[2];
+	int ret, len;
 	int32_t i32;
 	va_list ap;
 
@@ -300,22 +333,16 @@ static struct queued_msg *send_fmt(struct dvb_device_priv *dvb, int fd,
 
 	pthread_mutex_lock(&msg->lock);
 	i32 = htobe32(p - buf);
-	ret = send(fd, (void *)&i32, 4, MSG_MORE);
-	if (ret != 4) {
-		err = 1;
-	} else {
-		err = 0;
-		ret = write(fd, buf, p - buf);
-	}
-	if (ret < 0 || (ret < p - buf) || err) {
+	iov[0].iov_base = &i32;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = p - buf;
+	if (send_iov(fd, iov, 2) < 0) {
 		pthread_mutex_destroy(&msg->lock);
 		pthread_cond_destroy(&msg->cond);
 		free(msg);
 		msg = NULL;
-		if (ret < 0)
-			dvb_perror("write");
-		else
-			dvb_logerr("incomplete send");
+		dvb_perror("writev");
 		stack_dump(parms);
 	} else {
 		/* Add it to the message queue */
@@ -334,8 +361,9 @@ static struct queued_msg *send_buf(struct dvb_device_priv *dvb, int fd,
 	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
 	struct dvb_dev_remote_priv *priv = dvb->priv;
 	struct queued_msg *msg, *msgs;
-	char buf[REMOTE_BUF_SIZE], *p = buf, *endp = &buf[sizeof(buf)];
-	int ret, len, err;
+	char hdr[CMD_SIZE + 8], *p = hdr, *endp = &hdr[sizeof(hdr)];
+	struct iovec iov[3];
+	int len;
 	int32_t i32;
 
 	msg = calloc(1, sizeof(*msg));
@@ -368,7 +396,7 @@ static struct queued_msg *send_buf(struct dvb_device_priv *dvb, int fd,
 	len = strlen(cmd);
 	if (p + len + 4 > endp) {
 		dvb_logdbg("buffer too short for command: pos: %zd, len:%d, buffer size:%zd",
-				p - buf, len, sizeof(buf));
+				p - hdr, len, sizeof(hdr));
 		stack_dump(parms);
 		pthread_mutex_unlock(&priv->lock_io);
 		free(msg);
@@ -380,8 +408,8 @@ static struct queued_msg *send_buf(struct dvb_device_priv *dvb, int fd,
 	memcpy(p, cmd, len);
 	p += len;
 
-	/* Copy buffer contents */
-	if (in_size >= p - buf + REMOTE_BUF_SIZE) {
+	/* The daemon reads a message into a REMOTE_BUF_SIZE buffer */
+	if (in_size >= (size_t)(p - hdr) + REMOTE_BUF_SIZE) {
 		dvb_logdbg("buffer to big!");
 		stack_dump(parms);
 		pthread_mutex_unlock(&priv->lock_io);
@@ -389,26 +417,23 @@ static struct queued_msg *send_buf(struct dvb_device_priv *dvb, int fd,
 		return NULL;
 	}
 
-	memcpy(p, in_buf, in_size);
-	p += in_size;
-
-	i32 = htobe32(p - buf);
-	ret = send(fd, (void *)&i32, 4, MSG_MORE);
-	if (ret != 4) {
-		err = 1;
-	} else {
-		err = 0;
-		ret = write(fd, buf, p - buf);
-	}
-	if (ret < 0 || (ret < p - buf) || err) {
+	/*
+	 * Send the frame directly from the caller's buffer, instead of
+	 * copying it after the header.
+	 */
+	i32 = htobe32((p - hdr) + in_size);
+	iov[0].iov_base = &i32;
+	iov[0].iov_len = 4;
+	iov[1].iov_base = hdr;
+	iov[1].iov_len = p - hdr;
+	iov[2].iov_base = (void *)in_buf;
+	iov[2].iov_len = in_size;
+	if (send_iov(fd, iov, 3) < 0) {
 		pthread_mutex_destroy(&msg->lock);
 		pthread_cond_destroy(&msg->cond);
 		free(msg);
 		msg = NULL;
-		if (ret < 0)
-			dvb_perror("write");
-		else
-			dvb_logerr("incomplete send");
+		dvb_perror("writev");
 		stack_dump(parms);
 	} else {
 		/* Add it to the message queue */
@@ -562,6 +587,7 @@ static void write_ringbuffer(struct dvb_open_descriptor *open_dev,
 	if ((unsigned)((ringbuf->write - ringbuf->read) % RINGBUF_SIZE) < size)
 		ringbuf->rc = -EOVERFLOW;
 
+	pthread_cond_broadcast(&ringbuf->cond);
 	pthread_mutex_unlock(&ringbuf->lock);
 }
 
@@ -569,21 +595,29 @@ static void read_ringbuffer(struct dvb_open_descriptor *open_dev,
 			    size_t *len, char *buf)
 {
 	struct ringbuffer *ringbuf = (struct ringbuffer *)open_dev;
-	ssize_t size, split;
+	ssize_t size, split, avail;
+	size_t want = *len;
 
-	/* Sets the read size */
-	if (*len > REMOTE_BUF_SIZE)
-		*len = REMOTE_BUF_SIZE;
+	/* Minimal amount to block for, keeping the old read semantics */
+	if (want > REMOTE_BUF_SIZE)
+		want = REMOTE_BUF_SIZE;
 
 	/* Wait for data to arrive */
 	pthread_mutex_lock(&ringbuf->lock);
-	while ((unsigned)((ringbuf->write - ringbuf->read) % RINGBUF_SIZE) < *len) {
-		pthread_mutex_unlock(&ringbuf->lock);
-		usleep(1);
-		pthread_mutex_lock(&ringbuf->lock);
-	}
+	do {
+		avail = (ringbuf->write - ringbuf->read + RINGBUF_SIZE) %
+			RINGBUF_SIZE;
+		if ((size_t)avail >= want || ringbuf->rc)
+			break;
+		pthread_cond_wait(&ringbuf->cond, &ringbuf->lock);
+	} while (1);
 
-	size = *len;
+	/*
+	 * Drain in bulk: return everything that has accumulated meanwhile,
+	 * up to what the caller asked for, so a reader that fell behind
+	 * catches up with fewer calls.
+	 */
+	size = *len < (size_t)avail ? (ssize_t)*len : avail;
 
 	*len = 0;
 	split = (ringbuf->read + size > RINGBUF_SIZE) ? RINGBUF_SIZE - ringbuf->read : 0;
@@ -721,7 +755,11 @@ static void *receive_data(void *privdata)
 
 						found = 1;
 						if (retval < 0) {
+							/* Wake up blocked readers */
+							pthread_mutex_lock(&ringbuf->lock);
 							ringbuf->rc = retval;
+							pthread_cond_broadcast(&ringbuf->cond);
+							pthread_mutex_unlock(&ringbuf->lock);
 							continue;
 						}
 						write_ringbuffer(cur, args_size, args);
@@ -1079,6 +1117,7 @@ static struct dvb_open_descriptor *dvb_remote_open(struct dvb_device_priv *dvb,
 
 	/* Initialize ringbuffer data*/
 	pthread_mutex_init(&ringbuf->lock, NULL);
+	pthread_cond_init(&ringbuf->cond, NULL);
 
 	cur = &dvb->open_list;
 	while (cur->next)
@@ -1135,6 +1174,7 @@ error:
 	for (cur = &dvb->open_list; cur->next; cur = cur->next) {
 		if (cur->next == open_dev) {
 			cur->next = open_dev->next;
+			pthread_cond_destroy(&ringbuffer->cond);
 			pthread_mutex_destroy(&ringbuffer->lock);
 			free(ringbuffer);
 			goto ret;
@@ -25,9 +25,15 @@
 
 #include <config.h>
 
+#ifdef HAVE_PTHREAD
+#  include <pthread.h>
+#endif
+
 #include "dvb-fe-priv.h"
 #include "dvb-dev-priv.h"
 
+#include <libdvbv5/dvb-file.h>
+
 #ifdef ENABLE_NLS
 # include "gettext.h"
 # include <libintl.h>
@@ -342,6 +348,248 @@ struct dvb_v5_descriptors *dvb_dev_scan(struct dvb_open_descriptor *open_dev,
 			 timeout_multiply);
 }
 
+/*
+ * Shared state of a parallel scan. The transponder list is consumed via a
+ * cursor (next) protected by a lock; workers also serialize on the same
+ * lock when storing the discovered services and when appending the new
+ * transponders found on the NIT tables, as both operations change lists
+ * that are shared between all frontends.
+ */
+struct dvb_dev_scan_ctx {
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t lock;
+	pthread_cond_t done;
+#endif
+	struct dvb_file *dvb_file;
+	struct dvb_file **dvb_file_new;
+	struct dvb_entry *next;
+	check_frontend_t *check_frontend;
+	void *args;
+	unsigned other_nit;
+	unsigned timeout_multiply;
+	int get_detected;
+	int get_nit;
+	int add_new_freqs;
+	unsigned busy;
+	int count;
+	int abort;
+};
+
+struct dvb_dev_scan_worker {
+	struct dvb_dev_scan_ctx *ctx;
+	struct dvb_open_descriptor *open_dev;
+#ifdef HAVE_PTHREAD
+	pthread_t id;
+	int started;
+#endif
+	int count;
+};
+
+static void dvb_dev_scan_lock(struct dvb_dev_scan_ctx *ctx)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&ctx->lock);
+#endif
+}
+
+static void dvb_dev_scan_unlock(struct dvb_dev_scan_ctx *ctx)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&ctx->lock);
+#endif
+}
+
+static void *dvb_dev_scan_worker(void *data)
+{
+	struct dvb_dev_scan_worker *worker = data;
+	struct dvb_dev_scan_ctx *ctx = worker->ctx;
+	struct dvb_device_priv *dvb = worker->open_dev->dvb;
+	struct dvb_v5_fe_parms_priv *parms = (void *)dvb->d.fe_parms;
+
+	while (1) {
+		struct dvb_v5_descriptors *dvb_scan_handler;
+		struct dvb_entry *entry, *tail;
+		uint32_t freq = 0, pol, stream_id;
+		int shift, num, aborted;
+
+		dvb_dev_scan_lock(ctx);
+		while (1) {
+			if (ctx->abort) {
+				dvb_dev_scan_unlock(ctx);
+				return NULL;
+			}
+
+			/*
+			 * Claim the next entry that still needs to be tuned,
+			 * discarding duplicated frequencies and entries
+			 * without any frequency at all.
+			 */
+			for (entry = ctx->next; entry; entry = entry->next) {
+				if (dvb_retrieve_entry_prop(entry, DTV_FREQUENCY, &freq))
+					continue;
+				shift = dvb_estimate_freq_shift(&parms->p);
+
+				if (dvb_retrieve_entry_prop(entry, DTV_POLARIZATION, &pol))
+					pol = POLARIZATION_OFF;
+
+				if (dvb_retrieve_entry_prop(entry, DTV_STREAM_ID, &stream_id))
+					stream_id = NO_STREAM_ID_FILTER;
+
+				if (dvb_new_entry_is_needed(ctx->dvb_file->first_entry,
+							    entry, freq, shift,
+							    pol, stream_id))
+					break;
+			}
+			if (entry)
+				break;
+
+			/*
+			 * The list was exhausted, but scans still in flight
+			 * on other frontends may append new transponders
+			 * found on the NIT tables. Wait for them before
+			 * giving up.
+			 */
+			if (!ctx->busy) {
+				dvb_dev_scan_unlock(ctx);
+				return NULL;
+			}
+#ifdef HAVE_PTHREAD
+			pthread_cond_wait(&ctx->done, &ctx->lock);
+#endif
+		}
+		ctx->next = entry->next;
+		ctx->busy++;
+		num = ++ctx->count;
+		dvb_dev_scan_unlock(ctx);
+
+		dvb_log(_("Scanning frequency #%d %d"), num, freq);
+
+		dvb_scan_handler = dvb_dev_scan(worker->open_dev, entry,
+						ctx->check_frontend, ctx->args,
+						ctx->other_nit,
+						ctx->timeout_multiply);
+
+		dvb_dev_scan_lock(ctx);
+		ctx->busy--;
+		if (parms->p.abort)
+			ctx->abort = 1;
+		if (dvb_scan_handler && !ctx->abort) {
+			dvb_store_channel(ctx->dvb_file_new, &parms->p,
+					  dvb_scan_handler, ctx->get_detected,
+					  ctx->get_nit);
+
+			if (ctx->add_new_freqs) {
+				for (tail = entry; tail->next; tail = tail->next);
+				dvb_add_scaned_transponders(&parms->p,
+							    dvb_scan_handler,
+							    ctx->dvb_file->first_entry,
+							    entry);
+				/*
+				 * If this worker's cursor view was already
+				 * exhausted, point it at the entries that
+				 * were just appended.
+				 */
+				if (!ctx->next && tail->next)
+					ctx->next = tail->next;
+			}
+			worker->count++;
+		}
+		aborted = ctx->abort;
+#ifdef HAVE_PTHREAD
+		pthread_cond_broadcast(&ctx->done);
+#endif
+		dvb_dev_scan_unlock(ctx);
+
+		dvb_scan_free_handler_table(dvb_scan_handler);
+
+		if (aborted)
+			return NULL;
+	}
+}
+
+int dvb_dev_scan_parallel(struct dvb_open_descriptor **open_devs,
+			  unsigned num_devs,
+			  struct dvb_file *dvb_file,
+			  struct dvb_file **dvb_file_new,
+			  check_frontend_t *check_frontend,
+			  void *args,
+			  unsigned other_nit,
+			  unsigned timeout_multiply,
+			  int get_detected, int get_nit,
+			  int add_new_freqs)
+{
+	struct dvb_dev_scan_ctx ctx;
+	struct dvb_dev_scan_worker *workers;
+	struct dvb_v5_fe_parms_priv *parms;
+	unsigned i;
+
+	if (!num_devs || !open_devs || !dvb_file || !dvb_file_new)
+		return -1;
+
+	parms = (void *)open_devs[0]->dvb->d.fe_parms;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.dvb_file = dvb_file;
+	ctx.dvb_file_new = dvb_file_new;
+	ctx.next = dvb_file->first_entry;
+	ctx.check_frontend = check_frontend;
+	ctx.args = args;
+	ctx.other_nit = other_nit;
+	ctx.timeout_multiply = timeout_multiply;
+	ctx.get_detected = get_detected;
+	ctx.get_nit = get_nit;
+	ctx.add_new_freqs = add_new_freqs;
+
+	workers = calloc(num_devs, sizeof(*workers));
+	if (!workers) {
+		dvb_perror(_("calloc"));
+		return -1;
+	}
+
+	for (i = 0; i < num_devs; i++) {
+		workers[i].ctx = &ctx;
+		workers[i].open_dev = open_devs[i];
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&ctx.lock, NULL);
+	pthread_cond_init(&ctx.done, NULL);
+
+	if (num_devs > 1) {
+		for (i = 0; i < num_devs; i++) {
+			if (pthread_create(&workers[i].id, NULL,
+					   dvb_dev_scan_worker, &workers[i]))
+				dvb_perror(_("pthread_create"));
+			else
+				workers[i].started = 1;
+		}
+		for (i = 0; i < num_devs; i++) {
+			if (workers[i].started)
+				pthread_join(workers[i].id, NULL);
+		}
+	} else {
+		dvb_dev_scan_worker(&workers[0]);
+	}
+
+	pthread_cond_destroy(&ctx.done);
+	pthread_mutex_destroy(&ctx.lock);
+#else
+	if (num_devs > 1)
+		dvb_logwarn(_("Compiled without pthread support. Scanning with one frontend only"));
+	dvb_dev_scan_worker(&workers[0]);
+#endif
+
+	for (i = 0; i < num_devs; i++)
+		dvb_log(_("Frontend #%d scanned %d transponder(s)"),
+			i, workers[i].count);
+	dvb_log(_("Scanned %d frequency(ies) with %d frontend(s)"),
+		ctx.count, num_devs);
+
+	free(workers);
+
+	return ctx.abort ? -1 : ctx.count;
+}
+
 /* Frontend functions that can be overriden */
 
 int dvb_set_sys(struct dvb_v5_fe_parms *p, fe_delivery_system_t sys)
@@ -20,6 +20,8 @@
 #ifndef __DVB_FE_PRIV_H
 #define __DVB_FE_PRIV_H
 
+#include <iconv.h>
+
 #include <libdvbv5/dvb-fe.h>
 #include <libdvbv5/countries.h>
 
@@ -56,6 +58,19 @@ struct dvb_v5_stats {
 
 struct dvb_device_priv;
 
+/* Number of opened iconv converters kept per frontend */
+#define DVB_ICONV_CACHE_SIZE	4
+
+/*
+ * An opened iconv converter, kept across string conversions so that
+ * iconv_open() isn't called for every string. Managed by dvb_iconv_get().
+ */
+struct dvb_iconv_cache {
+	char				*input_charset;
+	char				*output_charset;
+	iconv_t				cd;
+};
+
 struct dvb_v5_fe_parms_priv {
 	/* dvbv_v4_fe_parms should be the first element on this struct */
 	struct dvb_v5_fe_parms		p;
@@ -76,8 +91,24 @@ struct dvb_v5_fe_parms_priv {
 	int				high_band;
 	unsigned			freq_offset;
 
+	/* DiSEqC sequencing state, used by the asynchronous tune code */
+	int				diseqc_step;
+	int				diseqc_high_band;
+	int				diseqc_pol_v;
+	int				diseqc_vol_high;
+	int				diseqc_tone_on;
+	uint32_t			diseqc_freq;
+	uint16_t			diseqc_t;
+
+	/* In-flight parameter copy, while an asynchronous tune is pending */
+	struct dvb_v5_fe_parms_priv	*tune_parms;
+
 	dvb_logfunc_priv		logfunc_priv;
 	void				*logpriv;
+
+	/* Cached charset converters, used by the parse_string code */
+	struct dvb_iconv_cache		iconv_cache[DVB_ICONV_CACHE_SIZE];
+	unsigned			iconv_cache_next;
 };
 
 /* Functions used internally by dvb-dev.c. Aren't part of the API */
@@ -86,6 +117,14 @@ int dvb_fe_open_fname(struct dvb_v5_fe_parms_priv *parms, char *fname,
 void dvb_v5_free(struct dvb_v5_fe_parms_priv *parms);
 void __dvb_fe_close(struct dvb_v5_fe_parms_priv *parms);
 
+/*
+ * Satellite tune sequencing, used by the asynchronous tune API. Both return
+ * a positive number of milliseconds to wait before the next _advance() call,
+ * zero when the sequence finished or a negative error code.
+ */
+int dvb_sat_set_parms_start(struct dvb_v5_fe_parms_priv *parms);
+int dvb_sat_set_parms_advance(struct dvb_v5_fe_parms_priv *parms);
+
 /* Functions that can be overriden to be executed remotely */
 int __dvb_set_sys(struct dvb_v5_fe_parms *p, fe_delivery_system_t sys);
 int __dvb_fe_get_parms(struct dvb_v5_fe_parms *p);
@@ -19,12 +19,14 @@
 
 #include "dvb-fe-priv.h"
 #include "dvb-v5.h"
+#include <parse_string.h>
 #include <libdvbv5/dvb-dev.h>
 #include <libdvbv5/countries.h>
 #include <libdvbv5/dvb-v5-std.h>
 
 #include <inttypes.h>
 #include <math.h>
+#include <poll.h>
 #include <stddef.h>
 #include <time.h>
 #include <unistd.h>
@@ -32,6 +34,8 @@
 
 #include <config.h>
 
+#include "../v4l-trace.h"
+
 #ifdef ENABLE_NLS
 # include "gettext.h"
 # include <libintl.h>
@@ -80,11 +84,76 @@ static void libdvbv5_initialize(void)
 #endif
 }
 
+static void dvb_iconv_cache_free(struct dvb_v5_fe_parms_priv *parms)
+{
+	int i;
+
+	for (i = 0; i < DVB_ICONV_CACHE_SIZE; i++) {
+		struct dvb_iconv_cache *entry = &parms->iconv_cache[i];
+
+		if (entry->cd)
+			iconv_close(entry->cd);
+		free(entry->input_charset);
+		free(entry->output_charset);
+	}
+}
+
+iconv_t dvb_iconv_get(struct dvb_v5_fe_parms *p,
+		      const char *input_charset,
+		      const char *output_charset)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_iconv_cache *entry;
+	iconv_t cd;
+	int i;
+
+	for (i = 0; i < DVB_ICONV_CACHE_SIZE; i++) {
+		entry = &parms->iconv_cache[i];
+		if (!entry->cd || !entry->input_charset)
+			continue;
+		if (strcasecmp(entry->input_charset, input_charset) ||
+		    strcasecmp(entry->output_charset, output_charset))
+			continue;
+
+		/* Discard any conversion state left by the previous string */
+		iconv(entry->cd, NULL, NULL, NULL, NULL);
+		return entry->cd;
+	}
+
+	cd = iconv_open(output_charset, input_charset);
+	if (cd == (iconv_t)-1)
+		return cd;
+
+	entry = &parms->iconv_cache[parms->iconv_cache_next];
+	parms->iconv_cache_next = (parms->iconv_cache_next + 1) %
+				  DVB_ICONV_CACHE_SIZE;
+	if (entry->cd)
+		iconv_close(entry->cd);
+	free(entry->input_charset);
+	free(entry->output_charset);
+
+	entry->cd = cd;
+	entry->input_charset = strdup(input_charset);
+	entry->output_charset = strdup(output_charset);
+	if (!entry->input_charset || !entry->output_charset) {
+		/* Still owned by the cache, but will never match again */
+		free(entry->input_charset);
+		free(entry->output_charset);
+		entry->input_charset = NULL;
+		entry->output_charset = NULL;
+	}
+
+	return cd;
+}
+
 void dvb_v5_free(struct dvb_v5_fe_parms_priv *parms)
 {
 	if (parms->fname)
 		free(parms->fname);
 
+	dvb_iconv_cache_free(parms);
+
+	free(parms->tune_parms);
 	free(parms);
 }
 
@@ -873,57 +942,58 @@ static void dvb_setup_delsys_default(struct dvb_v5_fe_parms *p)
 	}
 }
 
-int __dvb_fe_set_parms(struct dvb_v5_fe_parms *p)
+static void dvb_fe_set_lna(struct dvb_v5_fe_parms_priv *parms)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)p;
-	/* Use a temporary copy of the parameters so we can safely perform
-	 * adjustments for satellite */
-	struct dvb_v5_fe_parms_priv tmp_parms = *parms;
+	struct dtv_properties prop;
+	struct dvb_v5_fe_parms_priv tmp_lna_parms;
+
+	if (parms->p.lna == LNA_AUTO || parms->p.legacy_fe)
+		return;
 
+	memset(&prop, 0, sizeof(prop));
+	prop.props = tmp_lna_parms.dvb_prop;
+
+	prop.props[0].cmd = DTV_LNA;
+	prop.props[0].u.data = parms->p.lna;
+	prop.num = 1;
+	if (xioctl(parms->fd, FE_SET_PROPERTY, &prop) == -1) {
+		dvb_perror(_("Setting LNA"));
+		parms->p.lna = LNA_AUTO;
+	} else if (parms->p.lna != LNA_AUTO && parms->p.verbose)
+		dvb_logdbg(_("LNA is %s"), parms->p.lna ? _("ON") : _("OFF"));
+}
+
+/*
+ * Common tail of the blocking and asynchronous tune paths: submits the
+ * already adjusted properties at *tmp_parms to the frontend.
+ */
+static int dvb_fe_submit_parms(struct dvb_v5_fe_parms_priv *parms,
+			       struct dvb_v5_fe_parms_priv *tmp_parms)
+{
 	struct dtv_properties prop;
 	struct dvb_frontend_parameters v3_parms;
 	uint32_t bw;
 
-	if (parms->p.lna != LNA_AUTO && !parms->p.legacy_fe) {
-		struct dvb_v5_fe_parms_priv tmp_lna_parms;
-
-		memset(&prop, 0, sizeof(prop));
-		prop.props = tmp_lna_parms.dvb_prop;
-
-		prop.props[0].cmd = DTV_LNA;
-		prop.props[0].u.data = parms->p.lna;
-		prop.num = 1;
-		if (xioctl(parms->fd, FE_SET_PROPERTY, &prop) == -1) {
-			dvb_perror(_("Setting LNA"));
-			parms->p.lna = LNA_AUTO;
-		} else if (parms->p.lna != LNA_AUTO && parms->p.verbose)
-			dvb_logdbg(_("LNA is %s"), parms->p.lna ? _("ON") : _("OFF"));
-	}
+#ifdef HAVE_USDT
+	{
+		uint32_t freq = 0;
 
-	if (dvb_fe_is_satellite(tmp_parms.p.current_sys)) {
-		dvb_sat_set_parms(&tmp_parms.p);
-		/*
-		 * even though the frequncy prop is kept un-modified here,
-		 * a later call to dvb_fe_get_parms() issues FE_GET_PROPERTY
-		 * ioctl and overwrites it with the offset-ed value from
-		 * the FE. So we need to save the offset here and
-		 * re-add it in dvb_fe_get_parms().
-		 * note that dvbv5-{scan,zap} utilities call dvb_fe_get_parms()
-		 * indirectly from check_frontend() via dvb_fe_get_stats().
-		 */
-		parms->freq_offset = tmp_parms.freq_offset;
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_FREQUENCY, &freq);
+		v4l_trace(libdvbv5, tune_start, parms->fd,
+			  tmp_parms->p.current_sys, freq);
 	}
+#endif
 
-	dvb_setup_delsys_default(p);
+	dvb_setup_delsys_default(&parms->p);
 
 	/* Filter out any user DTV_foo property such as DTV_POLARIZATION */
-	tmp_parms.n_props = dvb_copy_fe_props(tmp_parms.dvb_prop,
-					      tmp_parms.n_props,
-					      tmp_parms.dvb_prop);
+	tmp_parms->n_props = dvb_copy_fe_props(tmp_parms->dvb_prop,
+					      tmp_parms->n_props,
+					      tmp_parms->dvb_prop);
 
 	memset(&prop, 0, sizeof(prop));
-	prop.props = tmp_parms.dvb_prop;
-	prop.num = tmp_parms.n_props;
+	prop.props = tmp_parms->dvb_prop;
+	prop.num = tmp_parms->n_props;
 	prop.props[prop.num].cmd = DTV_TUNE;
 	prop.num++;
 
@@ -937,49 +1007,134 @@ int __dvb_fe_set_parms(struct dvb_v5_fe_parms *p)
 		return 0;
 	}
 	/* DVBv3 call */
-	dvb_fe_retrieve_parm(&tmp_parms.p, DTV_FREQUENCY, &v3_parms.frequency);
-	dvb_fe_retrieve_parm(&tmp_parms.p, DTV_INVERSION, &v3_parms.inversion);
-	switch (tmp_parms.p.current_sys) {
+	dvb_fe_retrieve_parm(&tmp_parms->p, DTV_FREQUENCY, &v3_parms.frequency);
+	dvb_fe_retrieve_parm(&tmp_parms->p, DTV_INVERSION, &v3_parms.inversion);
+	switch (tmp_parms->p.current_sys) {
 	case SYS_DVBS:
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_SYMBOL_RATE, &v3_parms.u.qpsk.symbol_rate);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_INNER_FEC, &v3_parms.u.qpsk.fec_inner);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_SYMBOL_RATE, &v3_parms.u.qpsk.symbol_rate);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_INNER_FEC, &v3_parms.u.qpsk.fec_inner);
 		break;
 	case SYS_DVBC_ANNEX_AC:
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_SYMBOL_RATE, &v3_parms.u.qam.symbol_rate);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_INNER_FEC, &v3_parms.u.qam.fec_inner);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_MODULATION, &v3_parms.u.qam.modulation);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_SYMBOL_RATE, &v3_parms.u.qam.symbol_rate);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_INNER_FEC, &v3_parms.u.qam.fec_inner);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_MODULATION, &v3_parms.u.qam.modulation);
 		break;
 	case SYS_ATSC:
 	case SYS_ATSCMH:
 	case SYS_DVBC_ANNEX_B:
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_MODULATION, &v3_parms.u.vsb.modulation);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_MODULATION, &v3_parms.u.vsb.modulation);
 		break;
 	case SYS_DVBT:
 		for (bw = 0; fe_bandwidth_name[bw] != 0; bw++) {
 			if (fe_bandwidth_name[bw] == v3_parms.u.ofdm.bandwidth)
 				break;
 		}
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_BANDWIDTH_HZ, &bw);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_CODE_RATE_HP, &v3_parms.u.ofdm.code_rate_HP);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_CODE_RATE_LP, &v3_parms.u.ofdm.code_rate_LP);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_MODULATION, &v3_parms.u.ofdm.constellation);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_TRANSMISSION_MODE, &v3_parms.u.ofdm.transmission_mode);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_GUARD_INTERVAL, &v3_parms.u.ofdm.guard_interval);
-		dvb_fe_retrieve_parm(&tmp_parms.p, DTV_HIERARCHY, &v3_parms.u.ofdm.hierarchy_information);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_BANDWIDTH_HZ, &bw);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_CODE_RATE_HP, &v3_parms.u.ofdm.code_rate_HP);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_CODE_RATE_LP, &v3_parms.u.ofdm.code_rate_LP);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_MODULATION, &v3_parms.u.ofdm.constellation);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_TRANSMISSION_MODE, &v3_parms.u.ofdm.transmission_mode);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_GUARD_INTERVAL, &v3_parms.u.ofdm.guard_interval);
+		dvb_fe_retrieve_parm(&tmp_parms->p, DTV_HIERARCHY, &v3_parms.u.ofdm.hierarchy_information);
 		break;
 	default:
 		return -EINVAL;
 	}
-	if (xioctl(tmp_parms.fd, FE_SET_FRONTEND, &v3_parms) == -1) {
+	if (xioctl(tmp_parms->fd, FE_SET_FRONTEND, &v3_parms) == -1) {
 		dvb_perror("FE_SET_FRONTEND");
-		if (tmp_parms.p.verbose)
-			dvb_fe_prt_parms(&tmp_parms.p);
+		if (tmp_parms->p.verbose)
+			dvb_fe_prt_parms(&tmp_parms->p);
 		return -errno;
 	}
 
 	return 0;
 }
 
+int __dvb_fe_set_parms(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	/* Use a temporary copy of the parameters so we can safely perform
+	 * adjustments for satellite */
+	struct dvb_v5_fe_parms_priv tmp_parms = *parms;
+
+	dvb_fe_set_lna(parms);
+
+	if (dvb_fe_is_satellite(tmp_parms.p.current_sys)) {
+		dvb_sat_set_parms(&tmp_parms.p);
+		/*
+		 * even though the frequncy prop is kept un-modified here,
+		 * a later call to dvb_fe_get_parms() issues FE_GET_PROPERTY
+		 * ioctl and overwrites it with the offset-ed value from
+		 * the FE. So we need to save the offset here and
+		 * re-add it in dvb_fe_get_parms().
+		 * note that dvbv5-{scan,zap} utilities call dvb_fe_get_parms()
+		 * indirectly from check_frontend() via dvb_fe_get_stats().
+		 */
+		parms->freq_offset = tmp_parms.freq_offset;
+	}
+
+	return dvb_fe_submit_parms(parms, &tmp_parms);
+}
+
+int dvb_fe_set_parms_start(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_v5_fe_parms_priv *tmp_parms;
+	int rc;
+
+	/* A new tune cancels any sequence still in flight */
+	free(parms->tune_parms);
+	parms->tune_parms = NULL;
+
+	dvb_fe_set_lna(parms);
+
+	tmp_parms = malloc(sizeof(*tmp_parms));
+	if (!tmp_parms) {
+		dvb_logerr(_("%s: out of memory"), __func__);
+		return -ENOMEM;
+	}
+	*tmp_parms = *parms;
+
+	if (dvb_fe_is_satellite(tmp_parms->p.current_sys)) {
+		rc = dvb_sat_set_parms_start(tmp_parms);
+		if (rc > 0) {
+			parms->tune_parms = tmp_parms;
+			return rc;
+		}
+		/* See the comment at __dvb_fe_set_parms() */
+		parms->freq_offset = tmp_parms->freq_offset;
+	}
+
+	rc = dvb_fe_submit_parms(parms, tmp_parms);
+	free(tmp_parms);
+	return rc;
+}
+
+int dvb_fe_set_parms_advance(struct dvb_v5_fe_parms *p)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_v5_fe_parms_priv *tmp_parms = parms->tune_parms;
+	int rc;
+
+	if (!tmp_parms)
+		return -EINVAL;
+
+	rc = dvb_sat_set_parms_advance(tmp_parms);
+	if (rc > 0)
+		return rc;
+
+	/*
+	 * The DiSEqC sequence finished: submit the tune. As on the blocking
+	 * path, a DiSEqC failure doesn't prevent the tune itself.
+	 */
+	parms->tune_parms = NULL;
+	parms->freq_offset = tmp_parms->freq_offset;
+
+	rc = dvb_fe_submit_parms(parms, tmp_parms);
+	free(tmp_parms);
+	return rc;
+}
+
 static struct dtv_stats *dvb_fe_store_stats(struct dvb_v5_fe_parms_priv *parms,
 			      unsigned cmd,
 			      enum fecap_scale_params scale,
@@ -1457,8 +1612,10 @@ int __dvb_fe_get_stats(struct dvb_v5_fe_parms *p)
 	/* if lock has obtained, get DVB parameters */
 	if (status != parms->stats.prev_status) {
 		if ((status & FE_HAS_LOCK) &&
-		    parms->stats.prev_status != status)
+		    parms->stats.prev_status != status) {
+			v4l_trace(libdvbv5, fe_lock, parms->fd, status);
 			dvb_fe_get_parms(&parms->p);
+		}
 		parms->stats.prev_status = status;
 	}
 
@@ -1596,6 +1753,72 @@ int dvb_fe_get_event(struct dvb_v5_fe_parms *p)
 	return dvb_fe_get_stats(&parms->p);
 }
 
+int dvb_fe_monitor(struct dvb_v5_fe_parms *p,
+		   dvb_fe_monitor_cb callback, void *user_priv,
+		   int timeout_ms)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)p;
+	struct dvb_frontend_event event;
+	struct pollfd pfd;
+	fe_status_t status = 0;
+	uint32_t st;
+	int ret, has_events = 1;
+
+	if (parms->fd < 0 || !callback)
+		return -EINVAL;
+
+	while (!parms->p.abort) {
+		pfd.fd = parms->fd;
+		pfd.events = POLLIN | POLLPRI;
+		pfd.revents = 0;
+
+		ret = poll(&pfd, 1, timeout_ms);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			dvb_perror("poll");
+			return -errno;
+		}
+
+		if (!ret) {
+			/*
+			 * No signal event. On frontends with an event queue,
+			 * the stats cached at the parms are still current,
+			 * so no ioctl is issued; otherwise, this is the
+			 * refresh period of the plain polling fallback.
+			 */
+			if (!has_events)
+				dvb_fe_get_stats(&parms->p);
+		} else if (has_events &&
+			   ioctl(parms->fd, FE_GET_EVENT, &event) != -1) {
+			/* The signal changed: refresh the cached stats */
+			status = event.status;
+			dvb_fe_get_stats(&parms->p);
+		} else {
+			if (has_events &&
+			    (errno == EOPNOTSUPP || errno == ENOTTY)) {
+				dvb_logwarn(_("frontend has no event queue, using periodic polling"));
+				has_events = 0;
+			} else if (has_events && errno != EINTR &&
+				   errno != EWOULDBLOCK) {
+				dvb_perror("FE_GET_EVENT");
+				return -errno;
+			}
+			dvb_fe_get_stats(&parms->p);
+		}
+
+		if (!has_events &&
+		    !dvb_fe_retrieve_stats(&parms->p, DTV_STATUS, &st))
+			status = st;
+
+		ret = callback(&parms->p, status, user_priv);
+		if (ret)
+			return ret > 0 ? 0 : ret;
+	}
+
+	return 0;
+}
+
 struct metric_prefixes {
 	int multiply_factor;
 	char *symbol;
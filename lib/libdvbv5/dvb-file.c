@@ -218,6 +218,161 @@ static void adjust_delsys(struct dvb_entry *entry)
 	}
 }
 
+/*
+ * Frees the dynamically allocated data hanging off one entry, without
+ * freeing the entry itself. Pair of what fill_entry() and friends
+ * allocate; used by the entry-by-entry parsers, which recycle a single
+ * struct dvb_entry instead of building a list.
+ */
+static void dvb_free_entry_data(struct dvb_entry *entry)
+{
+	if (entry->channel)
+		free(entry->channel);
+	if (entry->vchannel)
+		free(entry->vchannel);
+	if (entry->location)
+		free(entry->location);
+	if (entry->video_pid)
+		free(entry->video_pid);
+	if (entry->audio_pid)
+		free(entry->audio_pid);
+	if (entry->other_el_pid)
+		free(entry->other_el_pid);
+	if (entry->lnb)
+		free(entry->lnb);
+}
+
+/*
+ * Parses one line of a one-entry-per-line format into a zeroed entry.
+ * Returns 1 if the entry was filled, 0 if the line carries no entry
+ * (comment, blank line) and -1 on error, with the cause in err_msg.
+ */
+static int dvb_parse_entry_oneline(char *buf, uint32_t delsys,
+				   const struct dvb_parse_file *parse_file,
+				   struct dvb_entry *entry, char *err_msg)
+{
+	const char *delimiter = parse_file->delimiter;
+	const struct dvb_parse_struct *formats = parse_file->formats;
+	const struct dvb_parse_struct *fmt;
+	const struct dvb_parse_table *table;
+	char *p;
+	int i, j;
+	int has_inversion;
+
+	p = buf;
+	while (*p == ' ')
+		p++;
+	if (*p == '\n' || *p == '#' || *p == '\a' || *p == '\0')
+		return 0;
+
+	if (parse_file->has_delsys_id) {
+		p = strtok(p, delimiter);
+		if (!p) {
+			sprintf(err_msg, _("unknown delivery system type for %.30s"),
+				buf);
+			return -1;
+		}
+
+		/* Parse the type of the delivery system */
+		for (i = 0; formats[i].id != NULL; i++) {
+			if (!strcmp(p, formats[i].id))
+				break;
+		}
+		if (!formats[i].id) {
+			sprintf(err_msg, _("Doesn't know how to handle delimiter '%s'"),
+				p);
+			return -1;
+		}
+	} else {
+		/* Seek for the delivery system */
+		for (i = 0; formats[i].delsys != 0; i++) {
+			if (formats[i].delsys == delsys)
+				break;
+		}
+		if (!formats[i].delsys) {
+			sprintf(err_msg, _("Doesn't know how to parse delivery system %d"),
+				delsys);
+			return -1;
+		}
+	}
+
+
+	fmt = &formats[i];
+	entry->sat_number = -1;
+	entry->props[entry->n_props].cmd = DTV_DELIVERY_SYSTEM;
+	entry->props[entry->n_props++].u.data = fmt->delsys;
+	has_inversion = 0;
+	for (i = 0; i < fmt->size; i++) {
+		table = &fmt->table[i];
+		if (delsys && !i) {
+			p = strtok(p, delimiter);
+		} else
+			p = strtok(NULL, delimiter);
+		if (p && *p == '#')
+			p = NULL;
+		if (!p && !fmt->table[i].has_default_value) {
+			sprintf(err_msg, _("parameter %i (%s) missing"),
+				i, dvb_cmd_name(table->prop));
+			return -1;
+		}
+		if (p && table->size) {
+			for (j = 0; j < table->size; j++)
+				if (!table->table[j] || !strcasecmp(table->table[j], p))
+					break;
+			if (j == table->size) {
+				sprintf(err_msg, _("parameter %s invalid: %s"),
+					dvb_cmd_name(table->prop), p);
+				return -1;
+			}
+			if (table->prop == DTV_BANDWIDTH_HZ)
+				j = fe_bandwidth_name[j];
+			entry->props[entry->n_props].cmd = table->prop;
+			entry->props[entry->n_props++].u.data = j;
+		} else {
+			long v;
+
+			if (!p)
+				v = fmt->table[i].default_value;
+			else
+				v = atol(p);
+
+			if (table->mult_factor)
+				v *= table->mult_factor;
+
+			switch (table->prop) {
+			case DTV_VIDEO_PID:
+				entry->video_pid = calloc(sizeof(*entry->video_pid), 1);
+				entry->video_pid_len = 1;
+				entry->video_pid[0] = v;
+				break;
+			case DTV_AUDIO_PID:
+				entry->audio_pid = calloc(sizeof(*entry->audio_pid), 1);
+				entry->audio_pid_len = 1;
+				entry->audio_pid[0] = v;
+				break;
+			case DTV_SERVICE_ID:
+				entry->service_id = v;
+				break;
+			case DTV_CH_NAME:
+				entry->channel = calloc(strlen(p) + 1, 1);
+				strcpy(entry->channel, p);
+				break;
+			default:
+				entry->props[entry->n_props].cmd = table->prop;
+				entry->props[entry->n_props++].u.data = v;
+			}
+		}
+		if (table->prop == DTV_INVERSION)
+			has_inversion = 1;
+	}
+	if (!has_inversion) {
+		entry->props[entry->n_props].cmd = DTV_INVERSION;
+		entry->props[entry->n_props++].u.data = INVERSION_AUTO;
+	}
+	adjust_delsys(entry);
+	return 1;
+}
+
 /*
  * Generic parse function for all formats each channel is contained into
  * just one line.
@@ -226,19 +381,14 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 					  uint32_t delsys,
 					  const struct dvb_parse_file *parse_file)
 {
-	const char *delimiter = parse_file->delimiter;
-	const struct dvb_parse_struct *formats = parse_file->formats;
-	char *buf = NULL, *p;
+	char *buf = NULL;
 	size_t size = 0;
 	int len = 0;
-	int i, j, line = 0;
+	int ret, line = 0;
 	struct dvb_file *dvb_file;
 	FILE *fd;
-	const struct dvb_parse_struct *fmt;
-	struct dvb_entry *entry = NULL;
-	const struct dvb_parse_table *table;
+	struct dvb_entry *entry = NULL, *new_entry = NULL;
 	char err_msg[80];
-	int has_inversion;
 
 	dvb_file = calloc(sizeof(*dvb_file), 1);
 	if (!dvb_file) {
@@ -259,126 +409,25 @@ struct dvb_file *dvb_parse_format_oneline(const char *fname,
 			break;
 		line++;
 
-		p = buf;
-		while (*p == ' ')
-			p++;
-		if (*p == '\n' || *p == '#' || *p == '\a' || *p == '\0')
+		if (!new_entry)
+			new_entry = calloc(sizeof(*new_entry), 1);
+		ret = dvb_parse_entry_oneline(buf, delsys, parse_file,
+					      new_entry, err_msg);
+		if (ret < 0)
+			goto error;
+		if (!ret)
 			continue;
 
-		if (parse_file->has_delsys_id) {
-			p = strtok(p, delimiter);
-			if (!p) {
-				sprintf(err_msg, _("unknown delivery system type for %s"),
-					p);
-				goto error;
-			}
-
-			/* Parse the type of the delivery system */
-			for (i = 0; formats[i].id != NULL; i++) {
-				if (!strcmp(p, formats[i].id))
-					break;
-			}
-			if (!formats[i].id) {
-				sprintf(err_msg, _("Doesn't know how to handle delimiter '%s'"),
-					p);
-				goto error;
-			}
-		} else {
-			/* Seek for the delivery system */
-			for (i = 0; formats[i].delsys != 0; i++) {
-				if (formats[i].delsys == delsys)
-					break;
-			}
-			if (!formats[i].delsys) {
-				sprintf(err_msg, _("Doesn't know how to parse delivery system %d"),
-					delsys);
-				goto error;
-			}
-		}
-
-
-		fmt = &formats[i];
-		if (!entry) {
-			dvb_file->first_entry = calloc(sizeof(*entry), 1);
-			entry = dvb_file->first_entry;
-		} else {
-			entry->next = calloc(sizeof(*entry), 1);
-			entry = entry->next;
-		}
-		entry->sat_number = -1;
-		entry->props[entry->n_props].cmd = DTV_DELIVERY_SYSTEM;
-		entry->props[entry->n_props++].u.data = fmt->delsys;
-		has_inversion = 0;
-		for (i = 0; i < fmt->size; i++) {
-			table = &fmt->table[i];
-			if (delsys && !i) {
-				p = strtok(p, delimiter);
-			} else
-				p = strtok(NULL, delimiter);
-			if (p && *p == '#')
-				p = NULL;
-			if (!p && !fmt->table[i].has_default_value) {
-				sprintf(err_msg, _("parameter %i (%s) missing"),
-					i, dvb_cmd_name(table->prop));
-				goto error;
-			}
-			if (p && table->size) {
-				for (j = 0; j < table->size; j++)
-					if (!table->table[j] || !strcasecmp(table->table[j], p))
-						break;
-				if (j == table->size) {
-					sprintf(err_msg, _("parameter %s invalid: %s"),
-						dvb_cmd_name(table->prop), p);
-					goto error;
-				}
-				if (table->prop == DTV_BANDWIDTH_HZ)
-					j = fe_bandwidth_name[j];
-				entry->props[entry->n_props].cmd = table->prop;
-                                entry->props[entry->n_props++].u.data = j;
-			} else {
-				long v;
-
-				if (!p)
-					v = fmt->table[i].default_value;
-				else
-					v = atol(p);
-
-				if (table->mult_factor)
-					v *= table->mult_factor;
-
-				switch (table->prop) {
-				case DTV_VIDEO_PID:
-					entry->video_pid = calloc(sizeof(*entry->video_pid), 1);
-					entry->video_pid_len = 1;
-					entry->video_pid[0] = v;
-					break;
-				case DTV_AUDIO_PID:
-					entry->audio_pid = calloc(sizeof(*entry->audio_pid), 1);
-					entry->audio_pid_len = 1;
-					entry->audio_pid[0] = v;
-					break;
-				case DTV_SERVICE_ID:
-					entry->service_id = v;
-					break;
-				case DTV_CH_NAME:
-					entry->channel = calloc(strlen(p) + 1, 1);
-					strcpy(entry->channel, p);
-					break;
-				default:
-					entry->props[entry->n_props].cmd = table->prop;
-					entry->props[entry->n_props++].u.data = v;
-				}
-			}
-			if (table->prop == DTV_INVERSION)
-				has_inversion = 1;
-		}
-		if (!has_inversion) {
-			entry->props[entry->n_props].cmd = DTV_INVERSION;
-			entry->props[entry->n_props++].u.data = INVERSION_AUTO;
-		}
-		adjust_delsys(entry);
+		if (!entry)
+			dvb_file->first_entry = new_entry;
+		else
+			entry->next = new_entry;
+		entry = new_entry;
+		new_entry = NULL;
 	} while (1);
 	fclose(fd);
+	if (new_entry)
+		free(new_entry);
 	if (buf)
 		free(buf);
 	return dvb_file;
@@ -387,6 +436,8 @@ error:
 	fprintf (stderr, _("ERROR %s while parsing line %d of %s\n"),
 		 err_msg, line, fname);
 	dvb_file_free(dvb_file);
+	dvb_free_entry_data(new_entry);
+	free(new_entry);
 	fclose(fd);
 	if (buf)
 		free(buf);
@@ -420,147 +471,164 @@ static uint32_t get_compat_format(uint32_t delivery_system)
 	}
 }
 
-int dvb_write_format_oneline(const char *fname,
-			     struct dvb_file *dvb_file,
-			     uint32_t delsys,
-			     const struct dvb_parse_file *parse_file)
+/*
+ * Writes one entry at a one-entry-per-line format. Returns 0 if success
+ * and -1 on error, with the cause in err_msg.
+ */
+static int dvb_write_entry_oneline(FILE *fp, const char *fname, int line,
+				   struct dvb_entry *entry, uint32_t delsys,
+				   const struct dvb_parse_file *parse_file,
+				   char *err_msg)
 {
 	const char delimiter = parse_file->delimiter[0];
 	const struct dvb_parse_struct *formats = parse_file->formats;
-	int i, j, line = 0, first;
-	FILE *fp;
 	const struct dvb_parse_struct *fmt;
-	struct dvb_entry *entry;
 	const struct dvb_parse_table *table;
 	uint32_t data;
-	char err_msg[80];
 	uint32_t delsys_compat = 0;
+	int i, j, first;
 
-	fp = fopen(fname, "w");
-	if (!fp) {
-		perror(fname);
-		return -errno;
-	}
-
-	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
-		for (i = 0; i < entry->n_props; i++) {
-			if (entry->props[i].cmd == DTV_DELIVERY_SYSTEM) {
-				delsys = entry->props[i].u.data;
-				break;
-			}
+	for (i = 0; i < entry->n_props; i++) {
+		if (entry->props[i].cmd == DTV_DELIVERY_SYSTEM) {
+			delsys = entry->props[i].u.data;
+			break;
 		}
+	}
 
+	for (i = 0; formats[i].delsys != 0; i++) {
+		if (formats[i].delsys == delsys)
+			break;
+	}
+	if (!formats[i].delsys) {
+		delsys_compat = get_compat_format(delsys);
 		for (i = 0; formats[i].delsys != 0; i++) {
-			if (formats[i].delsys == delsys)
+			if (formats[i].delsys == delsys_compat) {
+				delsys = delsys_compat;
 				break;
-		}
-		if (!formats[i].delsys) {
-			delsys_compat = get_compat_format(delsys);
-			for (i = 0; formats[i].delsys != 0; i++) {
-				if (formats[i].delsys == delsys_compat) {
-					delsys = delsys_compat;
-					break;
-				}
 			}
 		}
-		if (formats[i].delsys == 0) {
-			sprintf(err_msg,
-				 _("delivery system %d not supported on this format"),
-				 delsys);
-			goto error;
-		}
-		adjust_delsys(entry);
-		if (parse_file->has_delsys_id) {
-			fprintf(fp, "%s", formats[i].id);
+	}
+	if (formats[i].delsys == 0) {
+		sprintf(err_msg,
+			 _("delivery system %d not supported on this format"),
+			 delsys);
+		return -1;
+	}
+	adjust_delsys(entry);
+	if (parse_file->has_delsys_id) {
+		fprintf(fp, "%s", formats[i].id);
+		first = 0;
+	} else
+		first = 1;
+
+	fmt = &formats[i];
+	for (i = 0; i < fmt->size; i++) {
+		table = &fmt->table[i];
+
+		if (first)
 			first = 0;
-		} else
-			first = 1;
+		else
+			fprintf(fp, "%c", delimiter);
 
-		fmt = &formats[i];
-		for (i = 0; i < fmt->size; i++) {
-			table = &fmt->table[i];
-
-			if (first)
-				first = 0;
-			else
-				fprintf(fp, "%c", delimiter);
-
-			for (j = 0; j < entry->n_props; j++)
-				if (entry->props[j].cmd == table->prop)
-					break;
-			if (fmt->table[i].has_default_value &&
-			   (j < entry->n_props) &&
-			   (fmt->table[i].default_value == entry->props[j].u.data))
+		for (j = 0; j < entry->n_props; j++)
+			if (entry->props[j].cmd == table->prop)
 				break;
-			if (table->size && j < entry->n_props) {
-				data = entry->props[j].u.data;
-
-				if (table->prop == DTV_BANDWIDTH_HZ) {
-					for (j = 0; j < ARRAY_SIZE(fe_bandwidth_name); j++) {
-						if (fe_bandwidth_name[j] == data) {
-							data = j;
-							break;
-						}
+		if (fmt->table[i].has_default_value &&
+		   (j < entry->n_props) &&
+		   (fmt->table[i].default_value == entry->props[j].u.data))
+			break;
+		if (table->size && j < entry->n_props) {
+			data = entry->props[j].u.data;
+
+			if (table->prop == DTV_BANDWIDTH_HZ) {
+				for (j = 0; j < ARRAY_SIZE(fe_bandwidth_name); j++) {
+					if (fe_bandwidth_name[j] == data) {
+						data = j;
+						break;
 					}
-					if (j == ARRAY_SIZE(fe_bandwidth_name))
-						data = BANDWIDTH_AUTO;
-				}
-				if (data >= table->size) {
-					sprintf(err_msg,
-						 _("value not supported"));
-					goto error;
 				}
+				if (j == ARRAY_SIZE(fe_bandwidth_name))
+					data = BANDWIDTH_AUTO;
+			}
+			if (data >= table->size) {
+				sprintf(err_msg,
+					 _("value not supported"));
+				return -1;
+			}
 
-				fprintf(fp, "%s", table->table[data]);
-			} else {
-				switch (table->prop) {
-				case DTV_VIDEO_PID:
-					if (!entry->video_pid) {
-						fprintf(stderr,
-							_("WARNING: missing video PID while parsing entry %d of %s\n"),
-							line, fname);
-						fprintf(fp, "%d",0);
-					} else
-						fprintf(fp, "%d",
-							entry->video_pid[0]);
-					break;
-				case DTV_AUDIO_PID:
-					if (!entry->audio_pid) {
+			fprintf(fp, "%s", table->table[data]);
+		} else {
+			switch (table->prop) {
+			case DTV_VIDEO_PID:
+				if (!entry->video_pid) {
+					fprintf(stderr,
+						_("WARNING: missing video PID while parsing entry %d of %s\n"),
+						line, fname);
+					fprintf(fp, "%d",0);
+				} else
+					fprintf(fp, "%d",
+						entry->video_pid[0]);
+				break;
+			case DTV_AUDIO_PID:
+				if (!entry->audio_pid) {
+					fprintf(stderr,
+						_("WARNING: missing audio PID while parsing entry %d of %s\n"),
+						line, fname);
+					fprintf(fp, "%d",0);
+				} else
+					fprintf(fp, "%d",
+						entry->audio_pid[0]);
+				break;
+			case DTV_SERVICE_ID:
+				fprintf(fp, "%d", entry->service_id);
+				break;
+			case DTV_CH_NAME:
+				fprintf(fp, "%s", entry->channel);
+				break;
+			default:
+				if (j >= entry->n_props) {
+					if (fmt->table[i].has_default_value) {
+						data = fmt->table[i].default_value;
+					} else {
 						fprintf(stderr,
-							_("WARNING: missing audio PID while parsing entry %d of %s\n"),
+							_("property %s not supported while parsing entry %d of %s\n"),
+							dvb_cmd_name(table->prop),
 							line, fname);
-						fprintf(fp, "%d",0);
-					} else
-						fprintf(fp, "%d",
-							entry->audio_pid[0]);
-					break;
-				case DTV_SERVICE_ID:
-					fprintf(fp, "%d", entry->service_id);
-					break;
-				case DTV_CH_NAME:
-					fprintf(fp, "%s", entry->channel);
-					break;
-				default:
-					if (j >= entry->n_props) {
-						if (fmt->table[i].has_default_value) {
-							data = fmt->table[i].default_value;
-						} else {
-							fprintf(stderr,
-								_("property %s not supported while parsing entry %d of %s\n"),
-								dvb_cmd_name(table->prop),
-								line, fname);
-							data = 0;
-						}
-					} else {
-						data = entry->props[j].u.data;
+						data = 0;
 					}
-
-					fprintf(fp, "%d", data);
-					break;
+				} else {
+					data = entry->props[j].u.data;
 				}
+
+				fprintf(fp, "%d", data);
+				break;
 			}
 		}
-		fprintf(fp, "\n");
+	}
+	fprintf(fp, "\n");
+	return 0;
+}
+
+int dvb_write_format_oneline(const char *fname,
+			     struct dvb_file *dvb_file,
+			     uint32_t delsys,
+			     const struct dvb_parse_file *parse_file)
+{
+	int line = 0;
+	FILE *fp;
+	struct dvb_entry *entry;
+	char err_msg[80];
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
+	}
+
+	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
+		if (dvb_write_entry_oneline(fp, fname, line, entry, delsys,
+					    parse_file, err_msg))
+			goto error;
 		line++;
 	};
 	fclose (fp);
@@ -742,15 +810,113 @@ static int fill_entry(struct dvb_entry *entry, char *key, char *value)
 }
 
 
+/*
+ * Reads the next [CHANNEL] group of a file at libdvbv5 format into a
+ * zeroed entry. As an entry only ends at the next group (or at EOF),
+ * the line that starts the next entry is kept at *buf, with *have_header
+ * flagging it, so the next call picks it up from there.
+ * Returns 1 if an entry was filled, 0 at the end of the file and -1 on
+ * error, with the cause in err_msg.
+ */
+static int dvb_read_entry(FILE *fd, char **buf, size_t *size, int *line,
+			  int *have_header, struct dvb_entry *entry,
+			  char *err_msg)
+{
+	char *p, *key, *value;
+	int len, rc;
+
+	/* Seek the start of the next channel group */
+	while (!*have_header) {
+		len = getline(buf, size, fd);
+		if (len <= 0)
+			return 0;
+		(*line)++;
+		p = *buf;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\n' || *p == '#' || *p == '\a' || *p == '\0')
+			continue;
+		if (*p != '[') {
+			sprintf(err_msg, _("key/value without a channel group"));
+			return -1;
+		}
+		*have_header = 1;
+	}
+	*have_header = 0;
+
+	entry->sat_number = -1;
+	p = *buf;
+	while (*p == ' ' || *p == '\t')
+		p++;
+	p++;
+	p = strtok(p, "]");
+	if (!p) {
+		sprintf(err_msg, _("Missing channel group"));
+		return -1;
+	}
+	if (!strcasecmp(p, CHANNEL))
+		p += strlen(CHANNEL);
+	while (*p == ' ' || *p == '\t')
+		p++;
+	if (*p) {
+		entry->channel = calloc(strlen(p) + 1, 1);
+		strcpy(entry->channel, p);
+	}
+
+	do {
+		len = getline(buf, size, fd);
+		if (len <= 0)
+			break;
+		(*line)++;
+		p = *buf;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '\n' || *p == '#' || *p == '\a' || *p == '\0')
+			continue;
+
+		if (*p == '[') {
+			/* NEW Entry: keep the line for the next call */
+			*have_header = 1;
+			break;
+		}
+
+		key = strtok(p, "=");
+		if (!key) {
+			sprintf(err_msg, _("missing key"));
+			return -1;
+		}
+		p = &key[strlen(key) - 1];
+		while ((p > key) && (*(p - 1) == ' ' || *(p - 1) == '\t'))
+			p--;
+		*p = 0;
+		value = strtok(NULL, "\n");
+		if (!value) {
+			sprintf(err_msg, _("missing value"));
+			return -1;
+		}
+		while (*value == ' ' || *value == '\t')
+			value++;
+
+		rc = fill_entry(entry, key, value);
+		if (rc == -2) {
+			sprintf(err_msg, _("value %s is invalid for %s"),
+				value, key);
+			return -1;
+		}
+	} while (1);
+
+	adjust_delsys(entry);
+	return 1;
+}
+
 struct dvb_file *dvb_read_file(const char *fname)
 {
-	char *buf = NULL, *p, *key, *value;
+	char *buf = NULL;
 	size_t size = 0;
-	int len = 0;
-	int line = 0, rc;
+	int line = 0, have_header = 0, ret;
 	struct dvb_file *dvb_file;
 	FILE *fd;
-	struct dvb_entry *entry = NULL;
+	struct dvb_entry *entry = NULL, *new_entry = NULL;
 	char err_msg[80];
 
 	dvb_file = calloc(sizeof(*dvb_file), 1);
@@ -767,75 +933,24 @@ struct dvb_file *dvb_read_file(const char *fname)
 	}
 
 	do {
-		len = getline(&buf, &size, fd);
-		if (len <= 0)
+		new_entry = calloc(sizeof(*new_entry), 1);
+		ret = dvb_read_entry(fd, &buf, &size, &line, &have_header,
+				     new_entry, err_msg);
+		if (ret < 0)
+			goto error;
+		if (!ret)
 			break;
-		line++;
-		p = buf;
-		while (*p == ' ' || *p == '\t')
-			p++;
-		if (*p == '\n' || *p == '#' || *p == '\a' || *p == '\0')
-			continue;
 
-		if (*p == '[') {
-			/* NEW Entry */
-			if (!entry) {
-				dvb_file->first_entry = calloc(sizeof(*entry), 1);
-				entry = dvb_file->first_entry;
-			} else {
-				adjust_delsys(entry);
-				entry->next = calloc(sizeof(*entry), 1);
-				entry = entry->next;
-			}
-			entry->sat_number = -1;
-			p++;
-			p = strtok(p, "]");
-			if (!p) {
-				sprintf(err_msg, _("Missing channel group"));
-				goto error;
-			}
-			if (!strcasecmp(p, CHANNEL))
-				p += strlen(CHANNEL);
-			while (*p == ' ' || *p == '\t')
-				p++;
-			if (*p) {
-				entry->channel = calloc(strlen(p) + 1, 1);
-				strcpy(entry->channel, p);
-			}
-		} else {
-			if (!entry) {
-				sprintf(err_msg, _("key/value without a channel group"));
-				goto error;
-			}
-			key = strtok(p, "=");
-			if (!key) {
-				sprintf(err_msg, _("missing key"));
-				goto error;
-			}
-			p = &key[strlen(key) - 1];
-			while ((p > key) && (*(p - 1) == ' ' || *(p - 1) == '\t'))
-				p--;
-			*p = 0;
-			value = strtok(NULL, "\n");
-			if (!value) {
-				sprintf(err_msg, _("missing value"));
-				goto error;
-			}
-			while (*value == ' ' || *value == '\t')
-				value++;
-
-			rc = fill_entry(entry, key, value);
-			if (rc == -2) {
-				sprintf(err_msg, _("value %s is invalid for %s"),
-					value, key);
-				goto error;
-			}
-		}
+		if (!entry)
+			dvb_file->first_entry = new_entry;
+		else
+			entry->next = new_entry;
+		entry = new_entry;
+		new_entry = NULL;
 	} while (1);
+	free(new_entry);
 	if (buf)
 		free(buf);
-	if (entry)
-		adjust_delsys(entry);
 	fclose(fd);
 	return dvb_file;
 
@@ -845,130 +960,140 @@ error:
 	if (buf)
 		free(buf);
 	dvb_file_free(dvb_file);
+	dvb_free_entry_data(new_entry);
+	free(new_entry);
 	fclose(fd);
 	return NULL;
 };
 
-int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
+/*
+ * Writes one entry at the libdvbv5 format.
+ */
+static void dvb_write_entry(FILE *fp, struct dvb_entry *entry)
 {
-	FILE *fp;
-	int i;
-	struct dvb_entry *entry = dvb_file->first_entry;
 	static const char *off = "OFF";
+	int i;
 
-	fp = fopen(fname, "w");
-	if (!fp) {
-		perror(fname);
-		return -errno;
+	adjust_delsys(entry);
+	if (entry->channel) {
+		fprintf(fp, "[%s]\n", entry->channel);
+		if (entry->vchannel)
+			fprintf(fp, "\tVCHANNEL = %s\n", entry->vchannel);
+	} else {
+		fprintf(fp, "[CHANNEL]\n");
 	}
 
-	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
-		adjust_delsys(entry);
-		if (entry->channel) {
-			fprintf(fp, "[%s]\n", entry->channel);
-			if (entry->vchannel)
-				fprintf(fp, "\tVCHANNEL = %s\n", entry->vchannel);
-		} else {
-			fprintf(fp, "[CHANNEL]\n");
-		}
-
-		if (entry->service_id)
-			fprintf(fp, "\tSERVICE_ID = %d\n", entry->service_id);
+	if (entry->service_id)
+		fprintf(fp, "\tSERVICE_ID = %d\n", entry->service_id);
 
-		if (entry->network_id)
-			fprintf(fp, "\tNETWORK_ID = %d\n", entry->network_id);
+	if (entry->network_id)
+		fprintf(fp, "\tNETWORK_ID = %d\n", entry->network_id);
 
-		if (entry->transport_id)
-			fprintf(fp, "\tTRANSPORT_ID = %d\n", entry->transport_id);
+	if (entry->transport_id)
+		fprintf(fp, "\tTRANSPORT_ID = %d\n", entry->transport_id);
 
-		if (entry->video_pid_len){
-			fprintf(fp, "\tVIDEO_PID =");
-			for (i = 0; i < entry->video_pid_len; i++)
-				fprintf(fp, " %d", entry->video_pid[i]);
-			fprintf(fp, "\n");
-		}
+	if (entry->video_pid_len){
+		fprintf(fp, "\tVIDEO_PID =");
+		for (i = 0; i < entry->video_pid_len; i++)
+			fprintf(fp, " %d", entry->video_pid[i]);
+		fprintf(fp, "\n");
+	}
 
-		if (entry->audio_pid_len) {
-			fprintf(fp, "\tAUDIO_PID =");
-			for (i = 0; i < entry->audio_pid_len; i++)
-				fprintf(fp, " %d", entry->audio_pid[i]);
-			fprintf(fp, "\n");
-		}
+	if (entry->audio_pid_len) {
+		fprintf(fp, "\tAUDIO_PID =");
+		for (i = 0; i < entry->audio_pid_len; i++)
+			fprintf(fp, " %d", entry->audio_pid[i]);
+		fprintf(fp, "\n");
+	}
 
-		if (entry->other_el_pid_len) {
-			int type = -1;
-			for (i = 0; i < entry->other_el_pid_len; i++) {
-				if (type != entry->other_el_pid[i].type) {
-					type = entry->other_el_pid[i].type;
-					if (i)
-						fprintf(fp, "\n");
-					fprintf(fp, "\tPID_%02x =", type);
-				}
-				fprintf(fp, " %d", entry->other_el_pid[i].pid);
+	if (entry->other_el_pid_len) {
+		int type = -1;
+		for (i = 0; i < entry->other_el_pid_len; i++) {
+			if (type != entry->other_el_pid[i].type) {
+				type = entry->other_el_pid[i].type;
+				if (i)
+					fprintf(fp, "\n");
+				fprintf(fp, "\tPID_%02x =", type);
 			}
-			fprintf(fp, "\n");
-		}
-
-		if (entry->sat_number >= 0) {
-			fprintf(fp, "\tSAT_NUMBER = %d\n",
-				entry->sat_number);
+			fprintf(fp, " %d", entry->other_el_pid[i].pid);
 		}
+		fprintf(fp, "\n");
+	}
 
-		if (entry->freq_bpf > 0) {
-			fprintf(fp, "\tFREQ_BPF = %d\n",
-				entry->freq_bpf);
-		}
+	if (entry->sat_number >= 0) {
+		fprintf(fp, "\tSAT_NUMBER = %d\n",
+			entry->sat_number);
+	}
 
-		if (entry->diseqc_wait > 0) {
-			fprintf(fp, "\tDISEQC_WAIT = %d\n",
-				entry->diseqc_wait);
-		}
-		if (entry->lnb)
-				fprintf(fp, "\tLNB = %s\n", entry->lnb);
+	if (entry->freq_bpf > 0) {
+		fprintf(fp, "\tFREQ_BPF = %d\n",
+			entry->freq_bpf);
+	}
 
-		for (i = 0; i < entry->n_props; i++) {
-			const char * const *attr_name = dvb_attr_names(entry->props[i].cmd);
-			const char *buf;
+	if (entry->diseqc_wait > 0) {
+		fprintf(fp, "\tDISEQC_WAIT = %d\n",
+			entry->diseqc_wait);
+	}
+	if (entry->lnb)
+			fprintf(fp, "\tLNB = %s\n", entry->lnb);
 
-			if (attr_name) {
-				int j;
+	for (i = 0; i < entry->n_props; i++) {
+		const char * const *attr_name = dvb_attr_names(entry->props[i].cmd);
+		const char *buf;
 
-				for (j = 0; j < entry->props[i].u.data; j++) {
-					if (!*attr_name)
-						break;
-					attr_name++;
-				}
-			}
+		if (attr_name) {
+			int j;
 
-			if (entry->props[i].cmd == DTV_COUNTRY_CODE) {
-				buf = dvb_country_to_2letters(entry->props[i].u.data);
-				attr_name = &buf;
+			for (j = 0; j < entry->props[i].u.data; j++) {
+				if (!*attr_name)
+					break;
+				attr_name++;
 			}
+		}
 
-			switch (entry->props[i].cmd) {
-			/* Handle parameters with optional values */
-			case DTV_PLS_CODE:
-			case DTV_PLS_MODE:
-				if (entry->props[i].u.data == (unsigned)-1)
-					continue;
-				break;
-			case DTV_PILOT:
-				if (entry->props[i].u.data == (unsigned)-1)
-					attr_name = &off;
-				break;
-			}
+		if (entry->props[i].cmd == DTV_COUNTRY_CODE) {
+			buf = dvb_country_to_2letters(entry->props[i].u.data);
+			attr_name = &buf;
+		}
 
-			if (!attr_name || !*attr_name)
-				fprintf(fp, "\t%s = %u\n",
-					dvb_cmd_name(entry->props[i].cmd),
-					entry->props[i].u.data);
-			else
-				fprintf(fp, "\t%s = %s\n",
-					dvb_cmd_name(entry->props[i].cmd),
-					*attr_name);
+		switch (entry->props[i].cmd) {
+		/* Handle parameters with optional values */
+		case DTV_PLS_CODE:
+		case DTV_PLS_MODE:
+			if (entry->props[i].u.data == (unsigned)-1)
+				continue;
+			break;
+		case DTV_PILOT:
+			if (entry->props[i].u.data == (unsigned)-1)
+				attr_name = &off;
+			break;
 		}
-		fprintf(fp, "\n");
+
+		if (!attr_name || !*attr_name)
+			fprintf(fp, "\t%s = %u\n",
+				dvb_cmd_name(entry->props[i].cmd),
+				entry->props[i].u.data);
+		else
+			fprintf(fp, "\t%s = %s\n",
+				dvb_cmd_name(entry->props[i].cmd),
+				*attr_name);
+	}
+	fprintf(fp, "\n");
+}
+
+int dvb_write_file(const char *fname, struct dvb_file *dvb_file)
+{
+	FILE *fp;
+	struct dvb_entry *entry;
+
+	fp = fopen(fname, "w");
+	if (!fp) {
+		perror(fname);
+		return -errno;
 	}
+
+	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next)
+		dvb_write_entry(fp, entry);
 	fclose(fp);
 	return 0;
 };
@@ -1481,6 +1606,8 @@ enum dvb_file_formats dvb_parse_format(const char *name)
 		return FILE_DVBV5;
 	if (!strcasecmp(name, "VDR"))
 		return FILE_VDR;
+	if (!strcasecmp(name, "DVBV5BIN"))
+		return FILE_DVBV5_BIN;
 
 	fprintf(stderr, _("File format %s is unknown\n"), name);
 	return FILE_UNKNOWN;
@@ -1569,6 +1696,9 @@ struct dvb_file *dvb_read_file_format(const char *fname,
 	case FILE_DVBV5:
 		dvb_file = dvb_read_file(fname);
 		break;
+	case FILE_DVBV5_BIN:
+		dvb_file = dvb_read_bin_file(fname);
+		break;
 	case FILE_VDR:
 		/* FIXME: add support for VDR input */
 		fprintf(stderr, _("Currently, VDR format is supported only for output\n"));
@@ -1604,6 +1734,9 @@ int dvb_write_file_format(const char *fname,
 	case FILE_DVBV5:
 		ret = dvb_write_file(fname, dvb_file);
 		break;
+	case FILE_DVBV5_BIN:
+		ret = dvb_write_bin_file(fname, dvb_file);
+		break;
 	case FILE_VDR:
 		ret = dvb_write_format_vdr(fname, dvb_file);
 		break;
@@ -1613,3 +1746,130 @@ int dvb_write_file_format(const char *fname,
 
 	return ret;
 }
+
+int dvb_convert_file_format(const char *in_fname, uint32_t in_delsys,
+			    enum dvb_file_formats in_format,
+			    const char *out_fname, uint32_t out_delsys,
+			    enum dvb_file_formats out_format)
+{
+	const struct dvb_parse_file *in_parse = NULL, *out_parse = NULL;
+	struct dvb_entry *entry;
+	struct dvb_file *dvb_file;
+	char *buf = NULL;
+	size_t size = 0;
+	int in_line = 0, out_line = 0, have_header = 0;
+	int ret = 0, parsed;
+	char err_msg[80];
+	FILE *in_fp, *out_fp;
+
+	switch (in_format) {
+	case FILE_CHANNEL:		/* DVB channel/transponder old format */
+		in_parse = &channel_file_format;
+		in_delsys = SYS_UNDEFINED;
+		break;
+	case FILE_ZAP:
+		in_parse = &channel_file_zap_format;
+		break;
+	case FILE_DVBV5:
+		break;
+	default:
+		goto compat;
+	}
+
+	switch (out_format) {
+	case FILE_CHANNEL:		/* DVB channel/transponder old format */
+		out_parse = &channel_file_format;
+		out_delsys = SYS_UNDEFINED;
+		break;
+	case FILE_ZAP:
+		out_parse = &channel_file_zap_format;
+		break;
+	case FILE_DVBV5:
+		break;
+	default:
+		goto compat;
+	}
+
+	in_fp = fopen(in_fname, "r");
+	if (!in_fp) {
+		perror(in_fname);
+		return -errno;
+	}
+	out_fp = fopen(out_fname, "w");
+	if (!out_fp) {
+		perror(out_fname);
+		fclose(in_fp);
+		return -errno;
+	}
+
+	entry = calloc(sizeof(*entry), 1);
+	if (!entry) {
+		perror(_("Allocating memory for dvb_entry"));
+		fclose(in_fp);
+		fclose(out_fp);
+		return -ENOMEM;
+	}
+
+	do {
+		if (in_parse) {
+			int len = getline(&buf, &size, in_fp);
+
+			if (len <= 0)
+				break;
+			in_line++;
+			parsed = dvb_parse_entry_oneline(buf, in_delsys,
+							 in_parse, entry,
+							 err_msg);
+		} else {
+			parsed = dvb_read_entry(in_fp, &buf, &size, &in_line,
+						&have_header, entry, err_msg);
+			if (!parsed)
+				break;
+		}
+		if (parsed < 0) {
+			fprintf(stderr, _("ERROR %s while parsing line %d of %s\n"),
+				err_msg, in_line, in_fname);
+			ret = -1;
+			break;
+		}
+		if (!parsed)
+			continue;
+
+		if (out_parse)
+			ret = dvb_write_entry_oneline(out_fp, out_fname,
+						      out_line, entry,
+						      out_delsys, out_parse,
+						      err_msg);
+		else
+			dvb_write_entry(out_fp, entry);
+		if (ret < 0) {
+			fprintf(stderr, _("ERROR: %s while parsing entry %d of %s\n"),
+				err_msg, out_line, out_fname);
+			break;
+		}
+		out_line++;
+
+		dvb_free_entry_data(entry);
+		memset(entry, 0, sizeof(*entry));
+	} while (1);
+	dvb_free_entry_data(entry);
+	free(entry);
+	if (buf)
+		free(buf);
+	fclose(in_fp);
+	fclose(out_fp);
+	return ret;
+
+compat:
+	/*
+	 * Formats without an entry-by-entry parser (VDR output, the
+	 * binary indexed format): convert through an in-memory list.
+	 */
+	dvb_file = dvb_read_file_format(in_fname, in_delsys, in_format);
+	if (!dvb_file)
+		return -1;
+	ret = dvb_write_file_format(out_fname, dvb_file, out_delsys,
+				    out_format);
+	dvb_file_free(dvb_file);
+	return ret;
+}
@@ -17,8 +17,10 @@
  *
  */
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <strings.h> /* strcasecmp */
 
@@ -311,13 +313,55 @@ static const struct dvb_sat_lnb_priv lnb_array[] = {
 	},
 };
 
-int dvb_sat_search_lnb(const char *name)
+/*
+ * Open-addressed alias index, so that per-tuning LNB searches don't
+ * re-scan the whole table. It is built once, on the first search;
+ * with 64 slots for the aliases above, collisions stay short.
+ */
+#define LNB_HASH_SIZE	64	/* power of two, > 2 * ARRAY_SIZE(lnb_array) */
+
+static signed char lnb_hash_idx[LNB_HASH_SIZE];
+static int lnb_hash_built;
+
+static uint32_t lnb_hash_alias(const char *name)
 {
-	int i = 0;
+	uint32_t hash = 0x811c9dc5;
+
+	while (*name) {
+		hash ^= tolower((unsigned char)*name++);
+		hash *= 0x01000193;
+	}
+	return hash & (LNB_HASH_SIZE - 1);
+}
+
+static void lnb_hash_build(void)
+{
+	uint32_t slot;
+	int i;
 
+	memset(lnb_hash_idx, -1, sizeof(lnb_hash_idx));
 	for (i = 0; i < ARRAY_SIZE(lnb_array); i++) {
+		slot = lnb_hash_alias(lnb_array[i].desc.alias);
+		while (lnb_hash_idx[slot] >= 0)
+			slot = (slot + 1) & (LNB_HASH_SIZE - 1);
+		lnb_hash_idx[slot] = i;
+	}
+	lnb_hash_built = 1;
+}
+
+int dvb_sat_search_lnb(const char *name)
+{
+	uint32_t slot;
+	int i;
+
+	if (!lnb_hash_built)
+		lnb_hash_build();
+
+	slot = lnb_hash_alias(name);
+	while ((i = lnb_hash_idx[slot]) >= 0) {
 		if (!strcasecmp(name, lnb_array[i].desc.alias))
 			return i;
+		slot = (slot + 1) & (LNB_HASH_SIZE - 1);
 	}
 	return -1;
 }
@@ -510,80 +554,130 @@ static int dvbsat_scr_odu_channel_change(struct dvb_v5_fe_parms_priv *parms,
 	return dvb_fe_diseqc_cmd(&parms->p, cmd->len, cmd->msg);
 }
 
-static int dvbsat_diseqc_set_input(struct dvb_v5_fe_parms_priv *parms,
-				   uint16_t t)
+/* Steps of the DiSEqC command sequence, with the mandated delays between them */
+enum dvbsat_diseqc_step {
+	DISEQC_SEQ_SEC_SETUP = 0,
+	DISEQC_SEQ_CMD,
+	DISEQC_SEQ_BURST,
+	DISEQC_SEQ_TONE,
+	DISEQC_SEQ_DONE,
+};
+
+/*
+ * Executes one step of the DiSEqC sequence. Returns a positive number of
+ * milliseconds to wait before the next step, zero when the sequence is
+ * complete or a negative error code. The inter-step state is kept at the
+ * parms struct, so that one thread can interleave sequences on several
+ * frontends instead of sleeping on each one.
+ */
+static int dvbsat_diseqc_advance(struct dvb_v5_fe_parms_priv *parms,
+				 uint16_t t)
 {
-	int rc;
-	enum dvb_sat_polarization pol;
-	int pol_v;
-	int high_band = parms->high_band;
 	int sat_number = parms->p.sat_number;
-	int vol_high = 0;
-	int tone_on = 0;
-	struct diseqc_cmd cmd;
 	const struct dvb_sat_lnb_priv *lnb = (void *)parms->p.lnb;
+	struct diseqc_cmd cmd;
+	int rc;
 
-	if (sat_number < 0 && t) {
-		dvb_logwarn(_("DiSEqC disabled. Can't tune using SCR/Unicable."));
-		return 0;
-	}
+	switch (parms->diseqc_step) {
+	case DISEQC_SEQ_SEC_SETUP: {
+		enum dvb_sat_polarization pol;
 
-	dvb_fe_retrieve_parm(&parms->p, DTV_POLARIZATION, &pol);
-	pol_v = (pol == POLARIZATION_V) || (pol == POLARIZATION_R);
-
-	if (!lnb->freqrange[0].rangeswitch) {
-		/*
-		 * Bandstacking switches don't use 2 bands nor use
-		 * DISEqC for setting the polarization. It also doesn't
-		 * use any tone/tone burst
-		 */
-		pol_v = 0;
-		high_band = 1;
-		if (parms->p.current_sys == SYS_ISDBS)
-			vol_high = 1;
-	} else {
-		/* Adjust voltage/tone accordingly */
-		if (sat_number < 2) {
-			vol_high = pol_v ? 0 : 1;
-			tone_on = high_band;
+		if (sat_number < 0 && t) {
+			dvb_logwarn(_("DiSEqC disabled. Can't tune using SCR/Unicable."));
+			parms->diseqc_step = DISEQC_SEQ_DONE;
+			return 0;
 		}
-	}
 
-	rc = dvb_fe_sec_voltage(&parms->p, 1, vol_high);
-	if (rc)
-		return rc;
+		dvb_fe_retrieve_parm(&parms->p, DTV_POLARIZATION, &pol);
+		parms->diseqc_pol_v = (pol == POLARIZATION_V) || (pol == POLARIZATION_R);
+		parms->diseqc_high_band = parms->high_band;
+		parms->diseqc_vol_high = 0;
+		parms->diseqc_tone_on = 0;
+
+		if (!lnb->freqrange[0].rangeswitch) {
+			/*
+			 * Bandstacking switches don't use 2 bands nor use
+			 * DISEqC for setting the polarization. It also doesn't
+			 * use any tone/tone burst
+			 */
+			parms->diseqc_pol_v = 0;
+			parms->diseqc_high_band = 1;
+			if (parms->p.current_sys == SYS_ISDBS)
+				parms->diseqc_vol_high = 1;
+		} else {
+			/* Adjust voltage/tone accordingly */
+			if (sat_number < 2) {
+				parms->diseqc_vol_high = parms->diseqc_pol_v ? 0 : 1;
+				parms->diseqc_tone_on = parms->high_band;
+			}
+		}
 
-	rc = dvb_fe_sec_tone(&parms->p, SEC_TONE_OFF);
-	if (rc)
-		return rc;
+		rc = dvb_fe_sec_voltage(&parms->p, 1, parms->diseqc_vol_high);
+		if (rc)
+			return rc;
 
-	if (sat_number >= 0) {
-		/* DiSEqC is enabled. Send DiSEqC commands */
-		usleep(15 * 1000);
+		rc = dvb_fe_sec_tone(&parms->p, SEC_TONE_OFF);
+		if (rc)
+			return rc;
+
+		if (sat_number < 0) {
+			/* DiSEqC is disabled: no commands, no delays */
+			parms->diseqc_step = DISEQC_SEQ_DONE;
+			return dvb_fe_sec_tone(&parms->p, parms->diseqc_tone_on ?
+					       SEC_TONE_ON : SEC_TONE_OFF);
+		}
 
+		/* DiSEqC is enabled. Send DiSEqC commands */
+		parms->diseqc_step = DISEQC_SEQ_CMD;
+		return 15;
+	}
+	case DISEQC_SEQ_CMD:
 		if (!t)
-			rc = dvbsat_diseqc_write_to_port_group(parms, &cmd, high_band,
-								pol_v, sat_number);
+			rc = dvbsat_diseqc_write_to_port_group(parms, &cmd,
+								parms->diseqc_high_band,
+								parms->diseqc_pol_v,
+								sat_number);
 		else
-			rc = dvbsat_scr_odu_channel_change(parms, &cmd, high_band,
-								pol_v, sat_number, t);
+			rc = dvbsat_scr_odu_channel_change(parms, &cmd,
+								parms->diseqc_high_band,
+								parms->diseqc_pol_v,
+								sat_number, t);
 
 		if (rc) {
 			dvb_logerr(_("sending diseq failed"));
 			return rc;
 		}
-		usleep((15 + parms->p.diseqc_wait) * 1000);
-
+		parms->diseqc_step = DISEQC_SEQ_BURST;
+		return 15 + parms->p.diseqc_wait;
+	case DISEQC_SEQ_BURST:
 		/* miniDiSEqC/Toneburst commands are defined only for up to 2 sattelites */
-		if (parms->p.sat_number < 2) {
-			rc = dvb_fe_diseqc_burst(&parms->p, parms->p.sat_number);
+		if (sat_number < 2) {
+			rc = dvb_fe_diseqc_burst(&parms->p, sat_number);
 			if (rc)
 				return rc;
 		}
-		usleep(15 * 1000);
+		parms->diseqc_step = DISEQC_SEQ_TONE;
+		return 15;
+	case DISEQC_SEQ_TONE:
+		parms->diseqc_step = DISEQC_SEQ_DONE;
+		return dvb_fe_sec_tone(&parms->p, parms->diseqc_tone_on ?
+				       SEC_TONE_ON : SEC_TONE_OFF);
+	default:
+		return 0;
 	}
+}
 
-	rc = dvb_fe_sec_tone(&parms->p, tone_on ? SEC_TONE_ON : SEC_TONE_OFF);
+static int dvbsat_diseqc_set_input(struct dvb_v5_fe_parms_priv *parms,
+				   uint16_t t)
+{
+	int rc;
+
+	parms->diseqc_step = DISEQC_SEQ_SEC_SETUP;
+	do {
+		rc = dvbsat_diseqc_advance(parms, t);
+		if (rc > 0)
+			usleep(rc * 1000);
+	} while (rc > 0);
 
 	return rc;
 }
@@ -725,3 +819,42 @@ int dvb_sat_set_parms(struct dvb_v5_fe_parms *p)
 	return rc;
 }
 
+int dvb_sat_set_parms_start(struct dvb_v5_fe_parms_priv *parms)
+{
+	uint32_t freq;
+	uint16_t t = 0;
+
+	freq = dvb_sat_get_freq(&parms->p, &t);
+	if (!freq)
+		return -EINVAL;
+
+	if (parms->p.verbose)
+		dvb_log("frequency: %.2f MHz, high_band: %d", freq / 1000., parms->high_band);
+
+	parms->diseqc_freq = freq;
+	parms->diseqc_t = t;
+	parms->diseqc_step = DISEQC_SEQ_SEC_SETUP;
+
+	return dvb_sat_set_parms_advance(parms);
+}
+
+int dvb_sat_set_parms_advance(struct dvb_v5_fe_parms_priv *parms)
+{
+	uint32_t freq;
+	int rc;
+
+	rc = dvbsat_diseqc_advance(parms, parms->diseqc_t);
+	if (rc > 0)
+		return rc;
+
+	/* As on dvb_sat_set_parms(), the frequency is stored even on error */
+	freq = parms->diseqc_freq - parms->freq_offset;
+
+	if (parms->p.verbose)
+		dvb_log("L-Band frequency: %.2f MHz (offset = %.2f MHz)", freq / 1000., parms->freq_offset/1000.);
+
+	dvb_fe_store_parm(&parms->p, DTV_FREQUENCY, freq);
+
+	return rc;
+}
+
@@ -27,9 +27,11 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <sys/stat.h>
@@ -63,6 +65,8 @@
 
 #include <config.h>
 
+#include "../v4l-trace.h"
+
 #ifdef ENABLE_NLS
 # include "gettext.h"
 # include <libintl.h>
@@ -143,13 +147,67 @@ struct dvb_table_filter_ext_priv {
 	int ext_id;
 	int first_section;
 	int done;
+
+	/* next extension (index + 1) on the same hash bucket, 0 ends it */
+	int hash_next;
 };
 
+/*
+ * Number of extension ID hash buckets. Must be a power of two. Tables
+ * carry one extension per service (EIT) or per transport (NIT/SDT), so
+ * this covers a typical full-TS harvest with short chains.
+ */
+#define DVB_EXT_HASH_SIZE	64
+
 struct dvb_table_filter_priv {
 	int num_extensions;
+	int num_done;
 	struct dvb_table_filter_ext_priv *extensions;
+
+	/* per-bucket extension index + 1, 0 if the bucket is empty */
+	int ext_hash[DVB_EXT_HASH_SIZE];
 };
 
+/*
+ * Finds the extension that collects the sections with the given
+ * extension ID, adding a new one at the first section seen. Called once
+ * per received section, so the lookup is a hash bucket walk instead of
+ * a scan over all extensions.
+ * Returns NULL if out of memory.
+ */
+static struct dvb_table_filter_ext_priv *
+dvb_table_filter_get_ext(struct dvb_table_filter_priv *priv,
+			 struct dvb_table_header *h, int *new)
+{
+	struct dvb_table_filter_ext_priv *ext;
+	unsigned bucket = (h->id ^ (h->id >> 6)) % DVB_EXT_HASH_SIZE;
+	int i;
+
+	for (i = priv->ext_hash[bucket]; i;
+	     i = priv->extensions[i - 1].hash_next) {
+		ext = &priv->extensions[i - 1];
+		if (ext->ext_id == h->id) {
+			*new = 0;
+			return ext;
+		}
+	}
+
+	ext = realloc(priv->extensions,
+		      sizeof(*ext) * (priv->num_extensions + 1));
+	if (!ext)
+		return NULL;
+	priv->extensions = ext;
+	ext += priv->num_extensions;
+	memset(ext, 0, sizeof(*ext));
+	ext->ext_id = h->id;
+	ext->first_section = h->section_id;
+	ext->last_section = h->last_section;
+	ext->hash_next = priv->ext_hash[bucket];
+	priv->ext_hash[bucket] = ++priv->num_extensions;
+	*new = 1;
+	return ext;
+}
+
 static int dvb_parse_section_alloc(struct dvb_v5_fe_parms_priv *parms,
 				   struct dvb_table_filter *sect)
 {
@@ -190,11 +248,14 @@ static int dvb_parse_section(struct dvb_v5_fe_parms_priv *parms,
 	struct dvb_table_filter_priv *priv;
 	struct dvb_table_filter_ext_priv *ext;
 	unsigned char tid;
-	int i = 0, new = 0;
+	int new = 0;
 
 	memcpy(&h, buf, sizeof(struct dvb_table_header));
 	dvb_table_header_init(&h);
 
+	v4l_trace(libdvbv5, section, parms->fd, h.table_id, h.id,
+		  h.section_id);
+
 	if (parms->p.verbose)
 		dvb_log(_("%s: received table 0x%02x, extension ID 0x%04x, section %d/%d"),
 			__func__, h.table_id, h.id, h.section_id, h.last_section);
@@ -205,47 +266,18 @@ static int dvb_parse_section(struct dvb_v5_fe_parms_priv *parms,
 		return -1;
 	}
 	priv = sect->priv;
-	ext = priv->extensions;
 	tid = h.table_id;
 
-	if (!ext) {
-		ext = calloc(sizeof(struct dvb_table_filter_ext_priv), 1);
-		if (!ext) {
-			dvb_logerr(_("%s: out of memory"), __func__);
-			return -1;
-		}
-		ext->ext_id = h.id;
-		ext->first_section = h.section_id;
-		ext->last_section = h.last_section;
-		priv->extensions = ext;
-		priv->num_extensions = 1;
-		new = 1;
-	} else {
-		/* search for an specific TS ID */
-		if (sect->ts_id != -1) {
-			if (h.id != sect->ts_id)
-				return 0;
-		}
+	/* search for an specific TS ID */
+	if (priv->num_extensions && sect->ts_id != -1) {
+		if (h.id != sect->ts_id)
+			return 0;
+	}
 
-		for (i = 0; i < priv->num_extensions; i++, ext++) {
-			if (ext->ext_id == h.id)
-				break;
-		}
-		if (i == priv->num_extensions) {
-			priv->num_extensions++;
-			priv->extensions = realloc(priv->extensions, sizeof(struct dvb_table_filter_ext_priv) * (priv->num_extensions));
-			ext = priv->extensions;
-			if (!ext) {
-				dvb_logerr(_("%s: out of memory"), __func__);
-				return -1;
-			}
-			ext += i;
-			memset(ext, 0, sizeof(struct dvb_table_filter_ext_priv));
-			ext->ext_id = h.id;
-			ext->first_section = h.section_id;
-			ext->last_section = h.last_section;
-			new = 1;
-		}
+	ext = dvb_table_filter_get_ext(priv, &h, &new);
+	if (!ext) {
+		dvb_logerr(_("%s: out of memory"), __func__);
+		return -1;
 	}
 
 	if (!new) { /* Check if the table was already parsed, but not on first pass */
@@ -268,6 +300,7 @@ static int dvb_parse_section(struct dvb_v5_fe_parms_priv *parms,
 					__func__, h.table_id, ext->ext_id, h.section_id, h.last_section);
 
 			ext->done = 1;
+			priv->num_done++;
 
 			goto ret;
 		}
@@ -291,6 +324,7 @@ static int dvb_parse_section(struct dvb_v5_fe_parms_priv *parms,
 			dvb_log(_("%s: table 0x%02x, extension ID 0x%04x: done"),
 				__func__, h.table_id, h.id);
 		ext->done = 1;
+		priv->num_done++;
 	}
 
 	if (!ext->done)
@@ -298,13 +332,13 @@ static int dvb_parse_section(struct dvb_v5_fe_parms_priv *parms,
 
 ret:
 	/* Check if all extensions are done */
-	for (ext = priv->extensions, i = 0; i < priv->num_extensions; i++, ext++) {
-		if (!ext->done) {
-			if (parms->p.verbose)
-				dvb_log(_("%s: extension not completed yet: 0x%04x"),
-						__func__, ext->ext_id);
-			return 0;
-		}
+	if (priv->num_done < priv->num_extensions) {
+		if (parms->p.verbose)
+			dvb_log(_("%s: %d of %d extensions not completed yet"),
+					__func__,
+					priv->num_extensions - priv->num_done,
+					priv->num_extensions);
+		return 0;
 	}
 
 	/* Section was fully parsed */
@@ -447,200 +481,459 @@ void dvb_scan_free_handler_table(struct dvb_v5_descriptors *dvb_scan_handler)
 	free(dvb_scan_handler);
 }
 
-struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
-					     int dmx_fd,
-					     uint32_t delivery_system,
-					     unsigned other_nit,
-					     unsigned timeout_multiply)
+/* Standard timeouts, in seconds, for each table */
+static void dvb_scan_table_times(uint32_t delivery_system,
+				 int *atsc_filter,
+				 unsigned *pat_pmt_time,
+				 unsigned *vct_time,
+				 unsigned *sdt_time,
+				 unsigned *nit_time)
 {
-	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
-	int rc;
-	unsigned pat_pmt_time, sdt_time, nit_time, vct_time;
-	int atsc_filter = 0;
-	unsigned num_pmt = 0;
-
-	struct dvb_v5_descriptors *dvb_scan_handler;
+	*atsc_filter = 0;
+	*vct_time = 0;
 
-	dvb_scan_handler = dvb_scan_alloc_handler_table(delivery_system);
-	if (!dvb_scan_handler)
-		return NULL;
-
-	if (!timeout_multiply)
-		timeout_multiply = 1;
-
-	/* Get standard timeouts for each table */
 	switch(delivery_system) {
 		case SYS_DVBC_ANNEX_A:
 		case SYS_DVBC_ANNEX_C:
 		case SYS_DVBS:
 		case SYS_DVBS2:
 		case SYS_TURBO:
-			pat_pmt_time = 1;
-			sdt_time = 2;
-			nit_time = 10;
+			*pat_pmt_time = 1;
+			*sdt_time = 2;
+			*nit_time = 10;
 			break;
 		case SYS_DVBT:
 		case SYS_DVBT2:
-			pat_pmt_time = 1;
-			sdt_time = 2;
-			nit_time = 12;
+			*pat_pmt_time = 1;
+			*sdt_time = 2;
+			*nit_time = 12;
 			break;
 		case SYS_ISDBT:
-			pat_pmt_time = 1;
-			sdt_time = 2;
-			nit_time = 12;
+			*pat_pmt_time = 1;
+			*sdt_time = 2;
+			*nit_time = 12;
 			break;
 		case SYS_ATSC:
-			atsc_filter = ATSC_TABLE_TVCT;
-			pat_pmt_time = 2;
-			vct_time = 2;
-			sdt_time = 5;
-			nit_time = 5;
+			*atsc_filter = ATSC_TABLE_TVCT;
+			*pat_pmt_time = 2;
+			*vct_time = 2;
+			*sdt_time = 5;
+			*nit_time = 5;
 			break;
 		case SYS_DVBC_ANNEX_B:
-			atsc_filter = ATSC_TABLE_CVCT;
-			pat_pmt_time = 2;
-			vct_time = 2;
-			sdt_time = 5;
-			nit_time = 5;
+			*atsc_filter = ATSC_TABLE_CVCT;
+			*pat_pmt_time = 2;
+			*vct_time = 2;
+			*sdt_time = 5;
+			*nit_time = 5;
 			break;
 		default:
-			pat_pmt_time = 1;
-			sdt_time = 2;
-			nit_time = 10;
+			*pat_pmt_time = 1;
+			*sdt_time = 2;
+			*nit_time = 10;
 			break;
 	};
 
-	/* PAT table */
-	rc = dvb_read_section(&parms->p, dmx_fd,
-			      DVB_TABLE_PAT, DVB_TABLE_PAT_PID,
-			      (void **)&dvb_scan_handler->pat,
-			      pat_pmt_time * timeout_multiply);
-	if (parms->p.abort)
-		return dvb_scan_handler;
-	if (rc < 0) {
-		dvb_logerr(_("error while waiting for PAT table"));
-		dvb_scan_free_handler_table(dvb_scan_handler);
-		return NULL;
+}
+
+/*
+ * One table wanted by dvb_get_ts_tables(), collected by the joint poll
+ * loop below. The demux runs all the section filters concurrently, each
+ * on its own file descriptor, so the dwell time on a transponder is set
+ * by the slowest table instead of the sum of all the tables.
+ */
+enum dvb_table_req_state {
+	DVB_TABLE_REQ_PENDING,
+	DVB_TABLE_REQ_RUNNING,
+	DVB_TABLE_REQ_FINISHED,
+};
+
+struct dvb_table_req {
+	const char *name;
+	struct dvb_table_filter tab;
+	unsigned timeout;		/* seconds */
+	int dep;			/* request to wait for, or -1 */
+	int fd;				/* demux fd, while running */
+	struct timespec deadline;
+	enum dvb_table_req_state state;
+	int ret;
+};
+
+static void dvb_table_req_fill(struct dvb_table_req *req, const char *name,
+			       unsigned char tid, uint16_t pid, void **table,
+			       unsigned timeout, int dep)
+{
+	memset(req, 0, sizeof(*req));
+	req->name = name;
+	req->tab.tid = tid;
+	req->tab.pid = pid;
+	req->tab.ts_id = -1;
+	req->tab.table = table;
+	req->timeout = timeout;
+	req->dep = dep;
+	req->fd = -1;
+	req->ret = -1;
+}
+
+static int dvb_table_req_start(struct dvb_v5_fe_parms_priv *parms,
+			       struct dvb_table_req *req, int fd)
+{
+	uint8_t mask = 0xff;
+	int ret;
+
+	ret = dvb_parse_section_alloc(parms, &req->tab);
+	if (ret < 0)
+		return ret;
+
+	if (dvb_set_section_filter(fd, req->tab.pid, 1, &req->tab.tid,
+				   &mask, NULL,
+				   DMX_IMMEDIATE_START | DMX_CHECK_CRC)) {
+		dvb_table_filter_free(&req->tab);
+		return -1;
 	}
+
+	clock_gettime(CLOCK_MONOTONIC, &req->deadline);
+	req->deadline.tv_sec += req->timeout;
+	req->fd = fd;
+	req->state = DVB_TABLE_REQ_RUNNING;
+
 	if (parms->p.verbose)
-		dvb_table_pat_print(&parms->p, dvb_scan_handler->pat);
+		dvb_log(_("%s: waiting for table ID 0x%02x, program ID 0x%02x"),
+			__func__, req->tab.tid, req->tab.pid);
+
+	return 0;
+}
+
+static void dvb_table_req_finish(struct dvb_v5_fe_parms_priv *parms,
+				 struct dvb_table_req *req, int ret)
+{
+	if (req->state == DVB_TABLE_REQ_RUNNING) {
+		dvb_dmx_stop(req->fd);
+		dvb_table_filter_free(&req->tab);
+	}
+	req->fd = -1;
+	req->ret = ret;
+	req->state = DVB_TABLE_REQ_FINISHED;
+
+	if (ret < 0)
+		dvb_logerr(_("error while reading the %s table"), req->name);
+	else if (parms->p.verbose && *req->tab.table) {
+		switch (req->tab.tid) {
+		case DVB_TABLE_PAT:
+			dvb_table_pat_print(&parms->p, *req->tab.table);
+			break;
+		case ATSC_TABLE_TVCT:
+		case ATSC_TABLE_CVCT:
+			atsc_table_vct_print(&parms->p, *req->tab.table);
+			break;
+		case DVB_TABLE_PMT:
+			dvb_table_pmt_print(&parms->p, *req->tab.table);
+			break;
+		case DVB_TABLE_NIT:
+		case DVB_TABLE_NIT2:
+			dvb_table_nit_print(&parms->p, *req->tab.table);
+			break;
+		case DVB_TABLE_SDT:
+		case DVB_TABLE_SDT2:
+			dvb_table_sdt_print(&parms->p, *req->tab.table);
+			break;
+		}
+	}
+}
+
+static int dvb_table_req_ms_left(struct dvb_table_req *req,
+				 struct timespec *now)
+{
+	int64_t ms;
 
-	/* ATSC-specific VCT table */
+	ms = (req->deadline.tv_sec - now->tv_sec) * 1000 +
+	     (req->deadline.tv_nsec - now->tv_nsec) / 1000000;
+	if (ms < 0)
+		ms = 0;
+	return ms > INT32_MAX ? INT32_MAX : ms;
+}
+
+struct dvb_v5_descriptors *dvb_get_ts_tables_multi(struct dvb_v5_fe_parms *__p,
+						   int *dmx_fds,
+						   unsigned num_fds,
+						   uint32_t delivery_system,
+						   unsigned other_nit,
+						   unsigned timeout_multiply)
+{
+	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
+	struct dvb_v5_descriptors *dvb_scan_handler;
+	struct dvb_table_req *reqs;
+	unsigned n_reqs = 0, num_pmt = 0;
+	unsigned pat_pmt_time, sdt_time, nit_time, vct_time;
+	int atsc_filter = 0;
+	int pat_req, vct_req = -1, sdt_req = -1, nit_req;
+	uint8_t *buf;
+	unsigned i, j;
+
+	if (!dmx_fds || !num_fds)
+		return NULL;
+
+	dvb_scan_handler = dvb_scan_alloc_handler_table(delivery_system);
+	if (!dvb_scan_handler)
+		return NULL;
+
+	if (!timeout_multiply)
+		timeout_multiply = 1;
+
+	dvb_scan_table_times(delivery_system, &atsc_filter, &pat_pmt_time,
+			     &vct_time, &sdt_time, &nit_time);
+
+	reqs = calloc(6, sizeof(*reqs));
+	buf = calloc(DVB_MAX_PAYLOAD_PACKET_SIZE, 1);
+	if (!reqs || !buf) {
+		dvb_logerr(_("%s: out of memory"), __func__);
+		goto fail;
+	}
+
+	pat_req = n_reqs;
+	dvb_table_req_fill(&reqs[n_reqs++], "PAT",
+			   DVB_TABLE_PAT, DVB_TABLE_PAT_PID,
+			   (void **)&dvb_scan_handler->pat,
+			   pat_pmt_time * timeout_multiply, -1);
 	if (atsc_filter) {
-		rc = dvb_read_section(&parms->p, dmx_fd,
-				      atsc_filter, ATSC_TABLE_VCT_PID,
-				      (void **)&dvb_scan_handler->vct,
-				      vct_time * timeout_multiply);
-		if (parms->p.abort)
-			return dvb_scan_handler;
-		if (rc < 0)
-			dvb_logerr(_("error while waiting for VCT table"));
-		else if (parms->p.verbose)
-			atsc_table_vct_print(&parms->p, dvb_scan_handler->vct);
+		vct_req = n_reqs;
+		dvb_table_req_fill(&reqs[n_reqs++], "VCT",
+				   atsc_filter, ATSC_TABLE_VCT_PID,
+				   (void **)&dvb_scan_handler->vct,
+				   vct_time * timeout_multiply, -1);
+	}
+	nit_req = n_reqs;
+	dvb_table_req_fill(&reqs[n_reqs++], "NIT",
+			   DVB_TABLE_NIT, DVB_TABLE_NIT_PID,
+			   (void **)&dvb_scan_handler->nit,
+			   nit_time * timeout_multiply, -1);
+	sdt_req = n_reqs;
+	dvb_table_req_fill(&reqs[n_reqs++], "SDT",
+			   DVB_TABLE_SDT, DVB_TABLE_SDT_PID,
+			   (void **)&dvb_scan_handler->sdt,
+			   sdt_time * timeout_multiply, vct_req);
+	if (other_nit) {
+		dvb_table_req_fill(&reqs[n_reqs], "other NIT",
+				   DVB_TABLE_NIT2, DVB_TABLE_NIT_PID,
+				   (void **)&dvb_scan_handler->nit,
+				   nit_time * timeout_multiply, nit_req);
+		n_reqs++;
+		dvb_table_req_fill(&reqs[n_reqs], "other SDT",
+				   DVB_TABLE_SDT2, DVB_TABLE_SDT_PID,
+				   (void **)&dvb_scan_handler->sdt,
+				   sdt_time * timeout_multiply, sdt_req);
+		n_reqs++;
 	}
 
-	/* PMT tables */
-	dvb_scan_handler->program = calloc(dvb_scan_handler->pat->programs,
-					   sizeof(*dvb_scan_handler->program));
+	while (!parms->p.abort) {
+		struct pollfd pfds[num_fds];
+		int pfd_req[num_fds];
+		struct timespec now;
+		unsigned running = 0, finished = 0;
+		int pat_just_done = 0, timeout_ms = -1, ret;
+
+		/* Start whatever can run on an idle demux filter */
+		for (i = 0; i < n_reqs; i++) {
+			struct dvb_table_req *req = &reqs[i];
+			int fd = -1;
+
+			if (req->state != DVB_TABLE_REQ_PENDING)
+				continue;
+			if (req->dep >= 0 &&
+			    reqs[req->dep].state != DVB_TABLE_REQ_FINISHED)
+				continue;
+
+			/* ATSC streams with a VCT table have no SDT */
+			if ((int)i == sdt_req && dvb_scan_handler->vct &&
+			    !other_nit) {
+				req->state = DVB_TABLE_REQ_FINISHED;
+				req->ret = 0;
+				continue;
+			}
 
-	dvb_pat_program_foreach(program, dvb_scan_handler->pat) {
-		dvb_scan_handler->program[num_pmt].pat_pgm = program;
+			for (j = 0; j < num_fds; j++) {
+				unsigned k;
 
-		if (!program->service_id) {
-			if (parms->p.verbose)
-				dvb_log(_("Program #%d is network PID: 0x%04x"),
-					num_pmt, program->pid);
-			num_pmt++;
+				for (k = 0; k < n_reqs; k++)
+					if (reqs[k].state == DVB_TABLE_REQ_RUNNING &&
+					    reqs[k].fd == dmx_fds[j])
+						break;
+				if (k == n_reqs) {
+					fd = dmx_fds[j];
+					break;
+				}
+			}
+			if (fd < 0)
+				break;		/* all filters are busy */
+
+			if (dvb_table_req_start(parms, req, fd) < 0)
+				dvb_table_req_finish(parms, req, -1);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (i = 0; i < n_reqs; i++) {
+			struct dvb_table_req *req = &reqs[i];
+			int left;
+
+			if (req->state == DVB_TABLE_REQ_FINISHED)
+				finished++;
+			if (req->state != DVB_TABLE_REQ_RUNNING)
+				continue;
+			pfds[running].fd = req->fd;
+			pfds[running].events = POLLIN;
+			pfds[running].revents = 0;
+			pfd_req[running] = i;
+			running++;
+			left = dvb_table_req_ms_left(req, &now);
+			if (timeout_ms < 0 || left < timeout_ms)
+				timeout_ms = left;
+		}
+		if (!running) {
+			if (finished == n_reqs)
+				break;
 			continue;
 		}
-		if (parms->p.verbose)
-			dvb_log(_("Program #%d ID 0x%04x, service ID 0x%04x"),
-				num_pmt, program->pid, program->service_id);
-		rc = dvb_read_section(&parms->p, dmx_fd,
-				      DVB_TABLE_PMT, program->pid,
-				      (void **)&dvb_scan_handler->program[num_pmt].pmt,
-				      pat_pmt_time * timeout_multiply);
-		if (parms->p.abort) {
-			dvb_scan_handler->num_program = num_pmt + 1;
-			return dvb_scan_handler;
+
+		ret = poll(pfds, running, timeout_ms);
+		if (ret == -1) {
+			if (errno == EINTR)
+				continue;
+			dvb_perror("poll");
+			break;
 		}
-		if (rc < 0) {
-			dvb_logerr(_("error while reading the PMT table for service 0x%04x"),
-				   program->service_id);
-			dvb_scan_handler->program[num_pmt].pmt = NULL;
-		} else {
-			if (parms->p.verbose)
-				dvb_table_pmt_print(&parms->p,
-						    dvb_scan_handler->program[num_pmt].pmt);
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		for (i = 0; i < running; i++) {
+			struct dvb_table_req *req = &reqs[pfd_req[i]];
+			ssize_t buf_length;
+			uint32_t crc;
+
+			if (!(pfds[i].revents & POLLIN)) {
+				if (!dvb_table_req_ms_left(req, &now))
+					dvb_table_req_finish(parms, req, -1);
+				continue;
+			}
+
+			buf_length = read(req->fd, buf,
+					  DVB_MAX_PAYLOAD_PACKET_SIZE);
+			if (buf_length < 0) {
+				if (errno == EOVERFLOW || errno == EINTR ||
+				    errno == EAGAIN)
+					continue;
+				dvb_perror(_("dvb_read_section: read error"));
+				dvb_table_req_finish(parms, req, -2);
+				continue;
+			}
+			if (!buf_length) {
+				dvb_logerr(_("%s: buf returned an empty buffer"),
+					   __func__);
+				dvb_table_req_finish(parms, req, -1);
+				continue;
+			}
+			crc = dvb_crc32(buf, buf_length, 0xFFFFFFFF);
+			if (crc != 0) {
+				dvb_logerr(_("%s: crc error"), __func__);
+				dvb_table_req_finish(parms, req, -3);
+				continue;
+			}
+
+			ret = dvb_parse_section(parms, &req->tab, buf,
+						buf_length);
+			if (ret < 0) {
+				dvb_table_req_finish(parms, req, ret);
+			} else if (ret > 0) {
+				dvb_table_req_finish(parms, req, 0);
+				if (pfd_req[i] == pat_req)
+					pat_just_done = 1;
+			}
 		}
-		num_pmt++;
-	}
-	dvb_scan_handler->num_program = num_pmt;
-
-	/* NIT table */
-	rc = dvb_read_section(&parms->p, dmx_fd,
-			      DVB_TABLE_NIT, DVB_TABLE_NIT_PID,
-			      (void **)&dvb_scan_handler->nit,
-			      nit_time * timeout_multiply);
-	if (parms->p.abort)
-		return dvb_scan_handler;
-	if (rc < 0)
-		dvb_logerr(_("error while reading the NIT table"));
-	else if (parms->p.verbose)
-		dvb_table_nit_print(&parms->p, dvb_scan_handler->nit);
-
-	/* SDT table */
-	if (!dvb_scan_handler->vct || other_nit) {
-		rc = dvb_read_section(&parms->p, dmx_fd,
-				DVB_TABLE_SDT, DVB_TABLE_SDT_PID,
-				(void **)&dvb_scan_handler->sdt,
-				sdt_time * timeout_multiply);
-		if (parms->p.abort)
-			return dvb_scan_handler;
-		if (rc < 0)
-			dvb_logerr(_("error while reading the SDT table"));
-		else if (parms->p.verbose)
-			dvb_table_sdt_print(&parms->p, dvb_scan_handler->sdt);
-	}
 
-	/* NIT/SDT other tables */
-	if (other_nit) {
-		if (parms->p.verbose)
-			dvb_log(_("Parsing other NIT/SDT"));
-		rc = dvb_read_section(&parms->p, dmx_fd,
-				      DVB_TABLE_NIT2, DVB_TABLE_NIT_PID,
-				      (void **)&dvb_scan_handler->nit,
-				      nit_time * timeout_multiply);
-		if (parms->p.abort)
-			return dvb_scan_handler;
-		if (rc < 0)
-			dvb_logerr(_("error while reading the NIT table"));
-		else if (parms->p.verbose)
-			dvb_table_nit_print(&parms->p, dvb_scan_handler->nit);
-
-		rc = dvb_read_section(&parms->p, dmx_fd,
-				DVB_TABLE_SDT2, DVB_TABLE_SDT_PID,
-				(void **)&dvb_scan_handler->sdt,
-				sdt_time * timeout_multiply);
-		if (parms->p.abort)
-			return dvb_scan_handler;
-		if (rc < 0)
-			dvb_logerr(_("error while reading the SDT table"));
-		else if (parms->p.verbose)
-			dvb_table_sdt_print(&parms->p, dvb_scan_handler->sdt);
+		if (reqs[pat_req].state == DVB_TABLE_REQ_FINISHED &&
+		    reqs[pat_req].ret < 0) {
+			dvb_logerr(_("error while waiting for PAT table"));
+			goto fail;
+		}
+
+		/* The PAT arrived: ask for the PMT of each service */
+		if (pat_just_done) {
+			struct dvb_table_req *tmp;
+			unsigned programs = dvb_scan_handler->pat->programs;
+
+			tmp = realloc(reqs, (n_reqs + programs) *
+				      sizeof(*reqs));
+			if (!tmp) {
+				dvb_logerr(_("%s: out of memory"), __func__);
+				goto fail;
+			}
+			reqs = tmp;
+
+			dvb_scan_handler->program = calloc(programs,
+				sizeof(*dvb_scan_handler->program));
+			if (!dvb_scan_handler->program) {
+				dvb_logerr(_("%s: out of memory"), __func__);
+				goto fail;
+			}
+
+			dvb_pat_program_foreach(program, dvb_scan_handler->pat) {
+				dvb_scan_handler->program[num_pmt].pat_pgm = program;
+
+				if (!program->service_id) {
+					if (parms->p.verbose)
+						dvb_log(_("Program #%d is network PID: 0x%04x"),
+							num_pmt, program->pid);
+					num_pmt++;
+					continue;
+				}
+				if (parms->p.verbose)
+					dvb_log(_("Program #%d ID 0x%04x, service ID 0x%04x"),
+						num_pmt, program->pid,
+						program->service_id);
+				dvb_table_req_fill(&reqs[n_reqs++], "PMT",
+					DVB_TABLE_PMT, program->pid,
+					(void **)&dvb_scan_handler->program[num_pmt].pmt,
+					pat_pmt_time * timeout_multiply, -1);
+				num_pmt++;
+			}
+			dvb_scan_handler->num_program = num_pmt;
+		}
 	}
 
+	for (i = 0; i < n_reqs; i++)
+		if (reqs[i].state == DVB_TABLE_REQ_RUNNING)
+			dvb_table_req_finish(parms, &reqs[i], 0);
+
+	free(reqs);
+	free(buf);
 	return dvb_scan_handler;
+
+fail:
+	for (i = 0; i < n_reqs; i++)
+		if (reqs && reqs[i].state == DVB_TABLE_REQ_RUNNING)
+			dvb_table_req_finish(parms, &reqs[i], 0);
+	free(reqs);
+	free(buf);
+	dvb_scan_free_handler_table(dvb_scan_handler);
+	return NULL;
 }
 
-struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *__p,
-					        struct dvb_entry *entry,
-						int dmx_fd,
-					        check_frontend_t *check_frontend,
-					        void *args,
-						unsigned other_nit,
-						unsigned timeout_multiply)
+struct dvb_v5_descriptors *dvb_get_ts_tables(struct dvb_v5_fe_parms *__p,
+					     int dmx_fd,
+					     uint32_t delivery_system,
+					     unsigned other_nit,
+					     unsigned timeout_multiply)
+{
+	return dvb_get_ts_tables_multi(__p, &dmx_fd, 1, delivery_system,
+				       other_nit, timeout_multiply);
+}
+
+struct dvb_v5_descriptors *dvb_scan_transponder_multi(struct dvb_v5_fe_parms *__p,
+						      struct dvb_entry *entry,
+						      int *dmx_fds,
+						      unsigned num_fds,
+						      check_frontend_t *check_frontend,
+						      void *args,
+						      unsigned other_nit,
+						      unsigned timeout_multiply)
 {
 	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
 	struct dvb_v5_descriptors *dvb_scan_handler = NULL;
@@ -687,7 +980,7 @@ struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *__p,
 	if (rc < 0)
 		return NULL;
 
-	dvb_scan_handler = dvb_get_ts_tables(&parms->p, dmx_fd,
+	dvb_scan_handler = dvb_get_ts_tables_multi(&parms->p, dmx_fds, num_fds,
 					parms->p.current_sys,
 					other_nit,
 					timeout_multiply);
@@ -695,6 +988,19 @@ struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *__p,
 	return dvb_scan_handler;
 }
 
+struct dvb_v5_descriptors *dvb_scan_transponder(struct dvb_v5_fe_parms *__p,
+					        struct dvb_entry *entry,
+						int dmx_fd,
+					        check_frontend_t *check_frontend,
+					        void *args,
+						unsigned other_nit,
+						unsigned timeout_multiply)
+{
+	return dvb_scan_transponder_multi(__p, entry, &dmx_fd, 1,
+					  check_frontend, args,
+					  other_nit, timeout_multiply);
+}
+
 int dvb_estimate_freq_shift(struct dvb_v5_fe_parms *__p)
 {
 	struct dvb_v5_fe_parms_priv *parms = (void *)__p;
@@ -312,7 +312,7 @@ void dvb_iconv_to_charset(struct dvb_v5_fe_parms *parms,
 	strcpy(out_cs, output_charset);
 	strcat(out_cs, CS_OPTIONS);
 
-	iconv_t cd = iconv_open(out_cs, input_charset);
+	iconv_t cd = dvb_iconv_get(parms, input_charset, out_cs);
 	if (cd == (iconv_t)(-1)) {
 		memcpy(p, src, len);
 		p[len] = '\0';
@@ -322,7 +322,6 @@ void dvb_iconv_to_charset(struct dvb_v5_fe_parms *parms,
 			dvb_log("Try setting GCONV_PATH to the bundled gconv dir.\n");
 	} else {
 		iconv(cd, (ICONV_CONST char **)&src, &len, &p, &destlen);
-		iconv_close(cd);
 		*p = '\0';
 	}
 }
@@ -358,6 +357,36 @@ static void charset_conversion(struct dvb_v5_fe_parms *parms, char **dest, const
 		} else
 			need_conversion = 0;
 
+	/* Special handler for ISO-8859-1 */
+	} else if (!strcasecmp(input_charset, "ISO-8859-1")) {
+		char *p = *dest;
+		unsigned char *tmp;
+		const unsigned char *p1;
+
+		/*
+		 * ISO-8859-1 bytes match their Unicode code points, so the
+		 * UTF-8 expansion doesn't need a code table
+		 */
+		for (p1 = s; p1 < s + len; p1++) {
+			if (*p1 < 0x80)
+				*p++ = *p1;
+			else {
+				*p++ = 0xc0 | (*p1 >> 6);
+				*p++ = 0x80 | (*p1 & 0x3f);
+			}
+		}
+		*p = '\0';
+
+		/* If desired charset is not UTF-8, prepare for conversion */
+		if (strcasecmp(parms->output_charset, "UTF-8")) {
+			tmp = (unsigned char *)*dest;
+			len = p - *dest;
+
+			*dest = malloc(destlen + 1);
+			input_charset = "UTF-8";
+			s = tmp;
+		} else
+			need_conversion = 0;
 	}
 
 	/* Convert from original charset to the desired one */
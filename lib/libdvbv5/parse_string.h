@@ -16,12 +16,25 @@
  * Or, point your browser to http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
  */
 
+#include <iconv.h>
+
 #if HAVE_VISIBILITY
 #pragma GCC visibility push(hidden)
 #endif
 
 struct dvb_v5_fe_parms;
 
+/*
+ * Returns an iconv converter from input_charset to output_charset, opening
+ * one and caching it on the frontend parms at the first use. The returned
+ * handle is owned by the cache and must not be closed by the caller; it is
+ * released together with the parms. Returns (iconv_t)-1 when the conversion
+ * is not supported.
+ */
+iconv_t dvb_iconv_get(struct dvb_v5_fe_parms *parms,
+		      const char *input_charset,
+		      const char *output_charset);
+
 void dvb_iconv_to_charset(struct dvb_v5_fe_parms *parms,
 			  char *dest,
 			  size_t destlen,
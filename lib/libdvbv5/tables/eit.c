@@ -88,6 +88,8 @@ ssize_t dvb_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		bswap16(event->bitfield2);
 		event->descriptor = NULL;
 		event->next = NULL;
+		event->raw_desc = NULL;
+		event->raw_desc_length = 0;
 		dvb_time(event->dvbstart, &event->start);
 		event->duration = dvb_bcd((uint32_t) event->dvbduration[0]) * 3600 +
 				  dvb_bcd((uint32_t) event->dvbduration[1]) * 60 +
@@ -98,7 +100,11 @@ ssize_t dvb_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 		*head = event;
 		head = &(*head)->next;
 
-		/* parse the descriptors */
+		/*
+		 * Store the raw descriptors. They're only decoded at the
+		 * first call to dvb_table_eit_event_descriptors(), as most
+		 * events of an EPG harvest never have them accessed.
+		 */
 		if (event->desc_length > 0) {
 			uint16_t desc_length = event->desc_length;
 			if (p + desc_length > endbuf) {
@@ -106,10 +112,13 @@ ssize_t dvb_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 					   endbuf - p, desc_length);
 				desc_length = endbuf - p;
 			}
-			if (dvb_desc_parse(parms, p, desc_length,
-					      &event->descriptor) != 0) {
+			event->raw_desc = malloc(desc_length);
+			if (!event->raw_desc) {
+				dvb_logerr("%s: out of memory", __func__);
 				return -5;
 			}
+			memcpy(event->raw_desc, p, desc_length);
+			event->raw_desc_length = desc_length;
 			p += desc_length;
 		}
 	}
@@ -119,11 +128,31 @@ ssize_t dvb_table_eit_init(struct dvb_v5_fe_parms *parms, const uint8_t *buf,
 	return p - buf;
 }
 
+struct dvb_desc *dvb_table_eit_event_descriptors(struct dvb_v5_fe_parms *parms,
+						 struct dvb_table_eit_event *event)
+{
+	if (event->descriptor || !event->raw_desc)
+		return event->descriptor;
+
+	if (dvb_desc_parse(parms, event->raw_desc, event->raw_desc_length,
+			   &event->descriptor) != 0)
+		return NULL;
+
+	/* Decoded: the raw copy isn't needed anymore */
+	free(event->raw_desc);
+	event->raw_desc = NULL;
+	event->raw_desc_length = 0;
+
+	return event->descriptor;
+}
+
 void dvb_table_eit_free(struct dvb_table_eit *eit)
 {
 	struct dvb_table_eit_event *event = eit->event;
 	while (event) {
 		dvb_desc_free((struct dvb_desc **) &event->descriptor);
+		if (event->raw_desc)
+			free(event->raw_desc);
 		struct dvb_table_eit_event *tmp = event;
 		event = event->next;
 		free(tmp);
@@ -140,7 +169,7 @@ void dvb_table_eit_print(struct dvb_v5_fe_parms *parms, struct dvb_table_eit *ei
 	dvb_loginfo("|- last segment       %d", eit->last_segment);
 	dvb_loginfo("|- last table         %d", eit->last_table_id);
 	dvb_loginfo("|\\  event_id");
-	const struct dvb_table_eit_event *event = eit->event;
+	struct dvb_table_eit_event *event = eit->event;
 	uint16_t events = 0;
 	while (event) {
 		char start[255];
@@ -151,7 +180,7 @@ void dvb_table_eit_print(struct dvb_v5_fe_parms *parms, struct dvb_table_eit *ei
 		dvb_loginfo("|   Duration              %dh %dm %ds", event->duration / 3600, (event->duration % 3600) / 60, event->duration % 60);
 		dvb_loginfo("|   free CA mode          %d", event->free_CA_mode);
 		dvb_loginfo("|   running status        %d: %s", event->running_status, dvb_eit_running_status_name[event->running_status] );
-		dvb_desc_print(parms, event->descriptor);
+		dvb_desc_print(parms, dvb_table_eit_event_descriptors(parms, event));
 		event = event->next;
 		events++;
 	}
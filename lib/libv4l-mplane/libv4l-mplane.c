@@ -57,6 +57,17 @@ struct mplane_plugin {
 		};
 		unsigned int mplane;
 	};
+	/*
+	 * Cached multi-planar translation of the active format, seeded by
+	 * S_FMT/G_FMT.  While valid, G_FMT is answered from here without a
+	 * driver round trip, which matters for applications that re-check
+	 * the format on their per-frame path.  Only single-plane formats
+	 * are cached; everything else keeps taking the slow path and its
+	 * EINVAL.  Invalidated by S_FMT and by the ioctls that can change
+	 * the active format as a side effect.
+	 */
+	unsigned int fmt_valid : 1;
+	struct v4l2_format fmt;
 };
 
 #define SIMPLE_CONVERT_IOCTL(fd, cmd, arg, __struc) ({		\
@@ -201,8 +212,8 @@ static void sanitize_format(struct v4l2_format *fmt)
 	       sizeof(fmt->fmt.pix) - offset);
 }
 
-static int try_set_fmt_ioctl(int fd, unsigned long int cmd,
-			     struct v4l2_format *arg)
+static int try_set_fmt_ioctl(struct mplane_plugin *plugin, int fd,
+			     unsigned long int cmd, struct v4l2_format *arg)
 {
 	struct v4l2_format fmt = { 0 };
 	struct v4l2_format *org = arg;
@@ -239,6 +250,11 @@ static int try_set_fmt_ioctl(int fd, unsigned long int cmd,
 	fmt.fmt.pix_mp.plane_fmt[0].sizeimage = org->fmt.pix.sizeimage;
 
 	ret = SYS_IOCTL(fd, cmd, &fmt);
+	if (cmd == VIDIOC_S_FMT) {
+		plugin->fmt_valid = !ret && fmt.fmt.pix_mp.num_planes == 1;
+		if (plugin->fmt_valid)
+			plugin->fmt = fmt;
+	}
 	if (ret)
 		return ret;
 
@@ -316,7 +332,26 @@ static int create_bufs_ioctl(int fd, unsigned long int cmd,
 	return ret;
 }
 
-static int get_fmt_ioctl(int fd, unsigned long int cmd, struct v4l2_format *arg)
+static void mplane_to_pix(const struct v4l2_format *fmt,
+			  struct v4l2_format *org)
+{
+	memset(&org->fmt.pix, 0, sizeof(org->fmt.pix));
+	org->fmt.pix.width = fmt->fmt.pix_mp.width;
+	org->fmt.pix.height = fmt->fmt.pix_mp.height;
+	org->fmt.pix.pixelformat = fmt->fmt.pix_mp.pixelformat;
+	org->fmt.pix.field = fmt->fmt.pix_mp.field;
+	org->fmt.pix.colorspace = fmt->fmt.pix_mp.colorspace;
+	org->fmt.pix.xfer_func = fmt->fmt.pix_mp.xfer_func;
+	org->fmt.pix.ycbcr_enc = fmt->fmt.pix_mp.ycbcr_enc;
+	org->fmt.pix.quantization = fmt->fmt.pix_mp.quantization;
+	org->fmt.pix.bytesperline = fmt->fmt.pix_mp.plane_fmt[0].bytesperline;
+	org->fmt.pix.sizeimage = fmt->fmt.pix_mp.plane_fmt[0].sizeimage;
+	org->fmt.pix.priv = V4L2_PIX_FMT_PRIV_MAGIC;
+	org->fmt.pix.flags = fmt->fmt.pix_mp.flags;
+}
+
+static int get_fmt_ioctl(struct mplane_plugin *plugin, int fd,
+			 unsigned long int cmd, struct v4l2_format *arg)
 {
 	struct v4l2_format fmt = { 0 };
 	struct v4l2_format *org = arg;
@@ -337,23 +372,16 @@ static int get_fmt_ioctl(int fd, unsigned long int cmd, struct v4l2_format *arg)
 		return SYS_IOCTL(fd, cmd, arg);
 	}
 
+	if (plugin->fmt_valid && plugin->fmt.type == fmt.type) {
+		mplane_to_pix(&plugin->fmt, org);
+		return 0;
+	}
+
 	ret = SYS_IOCTL(fd, cmd, &fmt);
 	if (ret)
 		return ret;
 
-	memset(&org->fmt.pix, 0, sizeof(org->fmt.pix));
-	org->fmt.pix.width = fmt.fmt.pix_mp.width;
-	org->fmt.pix.height = fmt.fmt.pix_mp.height;
-	org->fmt.pix.pixelformat = fmt.fmt.pix_mp.pixelformat;
-	org->fmt.pix.field = fmt.fmt.pix_mp.field;
-	org->fmt.pix.colorspace = fmt.fmt.pix_mp.colorspace;
-	org->fmt.pix.xfer_func = fmt.fmt.pix_mp.xfer_func;
-	org->fmt.pix.ycbcr_enc = fmt.fmt.pix_mp.ycbcr_enc;
-	org->fmt.pix.quantization = fmt.fmt.pix_mp.quantization;
-	org->fmt.pix.bytesperline = fmt.fmt.pix_mp.plane_fmt[0].bytesperline;
-	org->fmt.pix.sizeimage = fmt.fmt.pix_mp.plane_fmt[0].sizeimage;
-	org->fmt.pix.priv = V4L2_PIX_FMT_PRIV_MAGIC;
-	org->fmt.pix.flags = fmt.fmt.pix_mp.flags;
+	mplane_to_pix(&fmt, org);
 
 	/*
 	 * If the device doesn't support just one plane, there's
@@ -364,6 +392,9 @@ static int get_fmt_ioctl(int fd, unsigned long int cmd, struct v4l2_format *arg)
 		return -1;
 	}
 
+	plugin->fmt = fmt;
+	plugin->fmt_valid = 1;
+
 	return ret;
 }
 
@@ -411,14 +442,25 @@ static int buf_ioctl(int fd, unsigned long int cmd, struct v4l2_buffer *arg)
 static int plugin_ioctl(void *dev_ops_priv, int fd,
 			unsigned long int cmd, void *arg)
 {
+	struct mplane_plugin *plugin = dev_ops_priv;
+
 	switch (cmd) {
 	case VIDIOC_QUERYCAP:
 		return querycap_ioctl(fd, cmd, arg);
 	case VIDIOC_TRY_FMT:
 	case VIDIOC_S_FMT:
-		return try_set_fmt_ioctl(fd, cmd, arg);
+		return try_set_fmt_ioctl(plugin, fd, cmd, arg);
 	case VIDIOC_G_FMT:
-		return get_fmt_ioctl(fd, cmd, arg);
+		return get_fmt_ioctl(plugin, fd, cmd, arg);
+	case VIDIOC_S_INPUT:
+	case VIDIOC_S_OUTPUT:
+	case VIDIOC_S_STD:
+	case VIDIOC_S_DV_TIMINGS:
+	case VIDIOC_S_SELECTION:
+	case VIDIOC_S_CROP:
+		/* may change the active format behind the cache */
+		plugin->fmt_valid = 0;
+		return SYS_IOCTL(fd, cmd, arg);
 	case VIDIOC_ENUM_FMT:
 		return SIMPLE_CONVERT_IOCTL(fd, cmd, arg, v4l2_fmtdesc);
 	case VIDIOC_S_PARM:
@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <pthread.h>
+#include <libv4l1-videodev.h>
 
 #include "../libv4lconvert/libv4lsyscall-priv.h"
 
@@ -72,6 +73,12 @@ struct v4l1_dev_info {
 	unsigned int min_width, min_height, max_width, max_height;
 	unsigned int width, height;
 	unsigned char *v4l1_frame_pointer;
+	/* Cached get-ioctl answers, valid when the matching V4L1_*_CACHED
+	   flag is set; invalidated by the corresponding set-calls so that
+	   apps polling VIDIOCGCAP / VIDIOCGPICT every frame don't cause a
+	   burst of v4l2 ioctls each time */
+	struct video_capability cached_cap;
+	struct video_picture cached_pic;
 };
 
 /* From log.c */
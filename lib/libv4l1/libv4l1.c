@@ -71,6 +71,8 @@
 #define V4L1_SUPPORTS_ENUMSTD   0x02
 #define V4L1_PIX_FMT_TOUCHED    0x04
 #define V4L1_PIX_SIZE_TOUCHED   0x08
+#define V4L1_CAP_CACHED         0x10
+#define V4L1_PIC_CACHED         0x20
 
 static pthread_mutex_t v4l1_open_mutex = PTHREAD_MUTEX_INITIALIZER;
 static struct v4l1_dev_info devices[V4L1_MAX_DEVICES] = {
@@ -166,6 +168,9 @@ static int v4l1_set_format(int index, unsigned int width,
 	unsigned int v4l2_pixfmt;
 	struct v4l2_format fmt2 = { .type = V4L2_BUF_TYPE_VIDEO_CAPTURE };
 
+	/* The palette / depth part of the VIDIOCGPICT answer may change */
+	devices[index].flags &= ~V4L1_PIC_CACHED;
+
 	if (v4l1_pal != -1) {
 		v4l2_pixfmt = palette_to_pixelformat(v4l1_pal);
 		if (!v4l2_pixfmt) {
@@ -500,6 +505,7 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 
 	/* do we need to take the stream lock for this ioctl? */
 	switch (request) {
+	case VIDIOCGCAP:
 	case VIDIOCSPICT:
 	case VIDIOCGPICT:
 	case VIDIOCSWIN:
@@ -518,6 +524,17 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		struct v4l2_framebuffer fbuf = { 0, };
 		struct v4l2_capability cap2 = { { 0 }, };
 
+		/* The capabilities of a device do not change, so after the
+		   first call we can answer this from memory, saving a bunch of
+		   ioctls for apps which re-query them on their capture path */
+		if (devices[index].flags & V4L1_CAP_CACHED) {
+			*cap = devices[index].cached_cap;
+			result = 0;
+			break;
+		}
+
+		memset(cap, 0, sizeof(*cap));
+
 		result = v4l2_ioctl(fd, VIDIOC_QUERYCAP, &cap2);
 		if (result < 0)
 			break;
@@ -552,6 +569,9 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		cap->minheight = devices[index].min_height;
 		cap->maxwidth  = devices[index].max_width;
 		cap->maxheight = devices[index].max_height;
+
+		devices[index].cached_cap = *cap;
+		devices[index].flags |= V4L1_CAP_CACHED;
 		break;
 	}
 
@@ -575,6 +595,15 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		struct video_picture *pic = arg;
 		int i;
 
+		/* Answer from memory when neither the format nor the controls
+		   have been touched since we last built the answer, legacy apps
+		   tend to do a VIDIOCGPICT for every frame they capture */
+		if (devices[index].flags & V4L1_PIC_CACHED) {
+			*pic = devices[index].cached_pic;
+			result = 0;
+			break;
+		}
+
 		/* If our v4l2 pixformat has no corresponding v4l1 palette, and
 		   the app has not touched the pixformat sofar, try setting a
 		   palette which does (and which we emulate when necessary) so
@@ -609,6 +638,9 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		if (i >= 0)
 			pic->brightness = i;
 
+		devices[index].cached_pic = *pic;
+		devices[index].flags |= V4L1_PIC_CACHED;
+
 		result = 0;
 		break;
 	}
@@ -809,6 +841,7 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		result = v4l2_ioctl(fd, request, arg);
 
 		if (result == 0 && fmt2->type == V4L2_BUF_TYPE_VIDEO_CAPTURE) {
+			devices[index].flags &= ~V4L1_PIC_CACHED;
 			if (devices[index].v4l2_pixfmt != fmt2->fmt.pix.pixelformat) {
 				devices[index].v4l2_pixfmt = fmt2->fmt.pix.pixelformat;
 				devices[index].v4l1_pal =
@@ -1178,6 +1211,14 @@ int v4l1_ioctl(int fd, unsigned long int request, ...)
 		/* Pass through libv4l2 for applications which are using v4l2 through
 		   libv4l1 (this can happen with the v4l1compat.so wrapper preloaded */
 		result = v4l2_ioctl(fd, request, arg);
+
+		/* Control changes done through the v4l2 API feed into the
+		   VIDIOCGPICT answer, so drop the cached one */
+		switch (request) {
+		case VIDIOC_S_CTRL:
+		case VIDIOC_S_EXT_CTRLS:
+			devices[index].flags &= ~V4L1_PIC_CACHED;
+		}
 		break;
 	}
 
@@ -0,0 +1,130 @@
+/*
+ * Microbenchmark for the libv4l2 ioctl interposition overhead
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ */
+
+/*
+ * Times plain ioctl() against v4l2_ioctl() on the same device, so the
+ * per call cost of the libv4l2 wrapping can be tracked.  Needs a video
+ * device; the vivid driver is enough.  Not installed; build and run it
+ * from the build tree:
+ *
+ *	make bench-v4l2 && ./bench-v4l2 [-C] [/dev/videoX]
+ *
+ * -C emits one "benchmark,case,unit,value" line per measurement, for
+ * the top-level "make bench" results file.  Without a usable device the
+ * program reports that and exits successfully, so batch runs go on.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <linux/videodev2.h>
+
+#include "../include/libv4l2.h"
+
+#define LOOPS 20000
+
+static int csv;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, double ns_per_call)
+{
+	if (csv)
+		printf("v4l2_ioctl,%s,ns,%.0f\n", what, ns_per_call);
+	else
+		printf("%-24s %8.0f ns/call\n", what, ns_per_call);
+}
+
+static double bench_ioctls(int fd, int (*do_ioctl)(int fd, unsigned long cmd, ...))
+{
+	struct v4l2_capability cap;
+	double start;
+	int i;
+
+	/* warm up */
+	for (i = 0; i < 16; i++)
+		do_ioctl(fd, VIDIOC_QUERYCAP, &cap);
+
+	start = now();
+	for (i = 0; i < LOOPS; i++)
+		do_ioctl(fd, VIDIOC_QUERYCAP, &cap);
+
+	return (now() - start) / LOOPS * 1e9;
+}
+
+static int plain_ioctl(int fd, unsigned long cmd, ...)
+{
+	void *arg;
+	va_list ap;
+
+	va_start(ap, cmd);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	return ioctl(fd, cmd, arg);
+}
+
+int main(int argc, char **argv)
+{
+	const char *device = "/dev/video0";
+	double raw_ns, v4l2_ns;
+	int fd, v4l2_fd;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-C"))
+			csv = 1;
+		else
+			device = argv[i];
+	}
+
+	fd = open(device, O_RDWR);
+	if (fd < 0) {
+		fprintf(stderr,
+			"bench-v4l2: cannot open %s (%s), skipping\n",
+			device, strerror(errno));
+		return 0;
+	}
+	raw_ns = bench_ioctls(fd, plain_ioctl);
+	close(fd);
+
+	v4l2_fd = v4l2_open(device, O_RDWR);
+	if (v4l2_fd < 0) {
+		fprintf(stderr,
+			"bench-v4l2: v4l2_open(%s) failed (%s), skipping\n",
+			device, strerror(errno));
+		return 0;
+	}
+	v4l2_ns = bench_ioctls(v4l2_fd, v4l2_ioctl);
+	v4l2_close(v4l2_fd);
+
+	report("querycap_raw", raw_ns);
+	report("querycap_libv4l2", v4l2_ns);
+	report("querycap_overhead", v4l2_ns - raw_ns);
+
+	return 0;
+}
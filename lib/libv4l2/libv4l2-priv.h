@@ -81,9 +81,17 @@ struct v4l2_dev_info {
 	struct v4l2_format src_fmt;
 	/* fmt as seen by the application (iow after conversion) */
 	struct v4l2_format dest_fmt;
-	pthread_mutex_t stream_lock;
+	/* Taken shared by QBUF / DQBUF so a producer thread can keep queuing
+	   buffers while a consumer thread converts a dequeued frame, taken
+	   exclusive by everything which changes stream state */
+	pthread_rwlock_t stream_lock;
+	/* Serializes concurrent dequeuers, as they share the conversion
+	   context; only ever taken with trylock while holding stream_lock */
+	pthread_mutex_t dequeue_lock;
 	unsigned int no_frames;
 	unsigned int nreadbuffers;
+	/* soft cap for the conversion / read-emulation working set, 0 = none */
+	size_t memory_budget;
 	int fps;
 	int first_frame;
 	struct v4lconvert_data *convert;
@@ -93,13 +101,18 @@ struct v4l2_dev_info {
 	/* Frame bookkeeping is only done when in read or mmap-conversion mode */
 	unsigned char *frame_pointers[V4L2_MAX_NO_FRAMES];
 	int frame_sizes[V4L2_MAX_NO_FRAMES];
-	int frame_queued; /* 1 status bit per frame */
+	int frame_queued; /* 1 status bit per frame, accessed with __atomic ops */
 	int frame_info_generation;
 	/* mapping tracking of our fake (converting mmap) frame buffers */
 	unsigned char frame_map_count[V4L2_MAX_NO_FRAMES];
 	/* buffer when doing conversion and using read() for read() */
 	int readbuf_size;
 	unsigned char *readbuf;
+	/* frame lending state for v4l2_peek_frame / v4l2_release_frame */
+	int frame_lent;
+	int lent_frame_index; /* driver buffer lent out raw, -1 otherwise */
+	/* performance counters, updated with relaxed atomics */
+	struct v4l2_stats stats;
 	/* plugin info */
 	void *plugin_library;
 	void *dev_ops_priv;
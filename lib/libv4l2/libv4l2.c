@@ -68,8 +68,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include "../v4l-trace.h"
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <poll.h>
+#include <time.h>
 #include "libv4l2.h"
 #include "libv4l2-priv.h"
 #include "libv4l-plugin.h"
@@ -100,6 +103,138 @@ static struct v4l2_dev_info devices[V4L2_MAX_DEVICES] = {
 };
 static int devices_used;
 
+/*
+ * fd -> devices[] index map so that the hot interposition paths
+ * (v4l2_ioctl / v4l2_read / ...) can look up an fd in O(1) instead of
+ * scanning devices[].  Readers are lock free: the map is published with an
+ * atomic pointer store and afterwards only modified through single byte
+ * index updates.  All modifications (registering on open, clearing on
+ * close, growing) are done with v4l2_open_mutex held.  Growing the map
+ * rebuilds it from devices[], which is authoritative, and publishes the
+ * bigger copy; the old one is intentionally leaked since racing readers
+ * may still be using it; with doubling the leaked maps sum to at most
+ * the size of the final one.
+ */
+struct v4l2_fd_map {
+	int size;
+	signed char map[];	/* devices[] index for each fd, or -1 */
+};
+
+#define V4L2_FD_MAP_MIN_SIZE 256
+
+static struct v4l2_fd_map *v4l2_fd_map;
+
+static void v4l2_fd_map_set(int fd, int index)
+{
+	struct v4l2_fd_map *map = __atomic_load_n(&v4l2_fd_map,
+						  __ATOMIC_RELAXED);
+
+	if (!map || fd >= map->size) {
+		struct v4l2_fd_map *new_map;
+		int new_size = map ? map->size : V4L2_FD_MAP_MIN_SIZE;
+		int i;
+
+		if (index == -1)
+			return; /* no entry to clear */
+
+		while (fd >= new_size)
+			new_size *= 2;
+		new_map = malloc(sizeof(*new_map) + new_size);
+		if (!new_map)
+			return; /* lookups fall back to the linear scan */
+		new_map->size = new_size;
+		memset(new_map->map, -1, new_size);
+		/*
+		 * Rebuild from devices[] rather than copying the old map:
+		 * if an earlier grow failed its fd is only findable by the
+		 * linear scan, and copying the old map would shadow it with
+		 * a -1 entry forever.  devices[] is stable here since all
+		 * callers hold v4l2_open_mutex.
+		 */
+		for (i = 0; i < V4L2_MAX_DEVICES; i++)
+			if (devices[i].fd >= 0 && devices[i].fd < new_size)
+				new_map->map[devices[i].fd] = i;
+		new_map->map[fd] = index;
+		__atomic_store_n(&v4l2_fd_map, new_map, __ATOMIC_RELEASE);
+		return;
+	}
+
+	__atomic_store_n(&map->map[fd], (signed char)index, __ATOMIC_RELEASE);
+}
+
+static uint64_t v4l2_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#define V4L2_STAT_ADD(index, field, val) \
+	__atomic_fetch_add(&devices[index].stats.field, (val), \
+			__ATOMIC_RELAXED)
+
+static void v4l2_copy_stats(int index, struct v4l2_stats *stats)
+{
+	stats->frames = __atomic_load_n(&devices[index].stats.frames,
+			__ATOMIC_RELAXED);
+	stats->dqbuf_wait_ns = __atomic_load_n(
+			&devices[index].stats.dqbuf_wait_ns, __ATOMIC_RELAXED);
+	stats->convert_ns = __atomic_load_n(&devices[index].stats.convert_ns,
+			__ATOMIC_RELAXED);
+	stats->bytes_copied = __atomic_load_n(
+			&devices[index].stats.bytes_copied, __ATOMIC_RELAXED);
+	stats->lock_wait_ns = __atomic_load_n(
+			&devices[index].stats.lock_wait_ns, __ATOMIC_RELAXED);
+}
+
+static void v4l2_dump_stats(int index)
+{
+	FILE *f = v4l2_log_file ? v4l2_log_file : stderr;
+	struct v4l2_stats stats;
+
+	v4l2_copy_stats(index, &stats);
+	fprintf(f, "libv4l2: stats for fd %d: %llu frames, "
+			"%llu bytes copied, %llu.%06llu s frame wait, "
+			"%llu.%06llu s converting, %llu.%06llu s lock wait\n",
+			devices[index].fd,
+			(unsigned long long)stats.frames,
+			(unsigned long long)stats.bytes_copied,
+			(unsigned long long)(stats.dqbuf_wait_ns / 1000000000),
+			(unsigned long long)(stats.dqbuf_wait_ns % 1000000000 / 1000),
+			(unsigned long long)(stats.convert_ns / 1000000000),
+			(unsigned long long)(stats.convert_ns % 1000000000 / 1000),
+			(unsigned long long)(stats.lock_wait_ns / 1000000000),
+			(unsigned long long)(stats.lock_wait_ns % 1000000000 / 1000));
+	fflush(f);
+}
+
+/* The default dev_ops are plain wrappers around the raw syscalls (see
+   libv4lconvert.c), so when no plugin has claimed the device we can branch
+   to the syscall directly instead of paying an indirect call per request.
+   In builds without plugin support the branch compiles away entirely. */
+static int v4l2_dev_ioctl(int index, unsigned long int request, void *arg)
+{
+#if defined(HAVE_V4L_PLUGINS)
+	if (devices[index].dev_ops != v4lconvert_get_default_dev_ops())
+		return devices[index].dev_ops->ioctl(
+				devices[index].dev_ops_priv,
+				devices[index].fd, request, arg);
+#endif
+	return SYS_IOCTL(devices[index].fd, request, arg);
+}
+
+static ssize_t v4l2_dev_read(int index, void *buf, size_t len)
+{
+#if defined(HAVE_V4L_PLUGINS)
+	if (devices[index].dev_ops != v4lconvert_get_default_dev_ops())
+		return devices[index].dev_ops->read(
+				devices[index].dev_ops_priv,
+				devices[index].fd, buf, len);
+#endif
+	return SYS_READ(devices[index].fd, buf, len);
+}
+
 static int v4l2_ensure_convert_mmap_buf(int index)
 {
 	if (devices[index].convert_mmap_buf != MAP_FAILED) {
@@ -136,10 +271,22 @@ static int v4l2_request_read_buffers(int index)
 	   and thus the needed buffer size may have changed. */
 	req.count = (devices[index].no_frames) ? devices[index].no_frames :
 		devices[index].nreadbuffers;
+
+	/* Fit the working set into the app's memory budget, but always keep
+	   enough buffers to stream (one queued while one is converted) */
+	if (devices[index].memory_budget &&
+			devices[index].convert_mmap_frame_size) {
+		unsigned int max_bufs = devices[index].memory_budget /
+			devices[index].convert_mmap_frame_size;
+
+		if (max_bufs < 2)
+			max_bufs = 2;
+		if (req.count > max_bufs)
+			req.count = max_bufs;
+	}
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_REQBUFS, &req);
+	result = v4l2_dev_ioctl(index, VIDIOC_REQBUFS, &req);
 	V4L2_PERROR("%s:  VIDIOC_REQBUFS", __func__);
 	if (result < 0) {
 		int saved_err = errno;
@@ -170,8 +317,7 @@ static void v4l2_unrequest_read_buffers(int index)
 	req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
 	V4L2_PERROR("%s:  VIDIOC_REQBUFS", __func__);
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_REQBUFS, &req) < 0)
+	if (v4l2_dev_ioctl(index, VIDIOC_REQBUFS, &req) < 0)
 		return;
 
 	devices[index].no_frames = MIN(req.count, V4L2_MAX_NO_FRAMES);
@@ -193,9 +339,7 @@ static int v4l2_map_buffers(int index)
 		buf.memory = V4L2_MEMORY_MMAP;
 		buf.index = i;
 		buf.reserved = buf.reserved2 = 0;
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_QUERYBUF, &buf);
+		result = v4l2_dev_ioctl(index, VIDIOC_QUERYBUF, &buf);
 	V4L2_PERROR("%s:  VIDIOC_QUERYBUF", __func__);
 		if (result) {
 			int saved_err = errno;
@@ -240,15 +384,33 @@ static void v4l2_unmap_buffers(int index)
 	}
 }
 
+/* Release the conversion buffer pages back to the kernel when nothing can
+   reference them anymore, so streamed-off devices do not pin a full set of
+   frame buffers. The mapping itself stays; the pages are faulted back in
+   zero-filled by the next conversion. */
+static void v4l2_reclaim_convert_mmap_buf(int index)
+{
+	unsigned int i;
+
+	if (devices[index].convert_mmap_buf == MAP_FAILED ||
+			devices[index].frame_lent)
+		return;
+
+	for (i = 0; i < devices[index].no_frames; i++)
+		if (devices[index].frame_map_count[i])
+			return;
+
+	madvise(devices[index].convert_mmap_buf,
+			devices[index].convert_mmap_buf_size, MADV_DONTNEED);
+}
+
 static int v4l2_streamon(int index)
 {
 	int result;
 	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
 	if (!(devices[index].flags & V4L2_STREAMON)) {
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_STREAMON, &type);
+		result = v4l2_dev_ioctl(index, VIDIOC_STREAMON, &type);
 	V4L2_PERROR("%s:  VIDIOC_STREAMON", __func__);
 		if (result) {
 			int saved_err = errno;
@@ -270,9 +432,7 @@ static int v4l2_streamoff(int index)
 	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
 	if (devices[index].flags & V4L2_STREAMON) {
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_STREAMOFF, &type);
+		result = v4l2_dev_ioctl(index, VIDIOC_STREAMOFF, &type);
 	V4L2_PERROR("%s:  VIDIOC_STREAMOFF", __func__);
 		if (result) {
 			int saved_err = errno;
@@ -284,7 +444,10 @@ static int v4l2_streamoff(int index)
 		devices[index].flags &= ~V4L2_STREAMON;
 
 		/* Stream off also dequeues all our buffers! */
-		devices[index].frame_queued = 0;
+		__atomic_store_n(&devices[index].frame_queued, 0,
+				__ATOMIC_RELAXED);
+
+		v4l2_reclaim_convert_mmap_buf(index);
 	}
 
 	return 0;
@@ -295,15 +458,18 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 	int result;
 	struct v4l2_buffer buf;
 
-	if (devices[index].frame_queued & (1 << buffer_index))
+	/* The bitmask is advisory bookkeeping, the driver orders the actual
+	   buffer hand-over; relaxed atomics just keep the bits intact when
+	   queue and dequeue threads update them concurrently */
+	if (__atomic_load_n(&devices[index].frame_queued, __ATOMIC_RELAXED) &
+			(1 << buffer_index))
 		return 0;
 
 	memset(&buf, 0, sizeof(buf));
 	buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	buf.memory = V4L2_MEMORY_MMAP;
 	buf.index  = buffer_index;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_QBUF, &buf);
+	result = v4l2_dev_ioctl(index, VIDIOC_QBUF, &buf);
 	V4L2_PERROR("%s:  VIDIOC_QBUF", __func__);
 	if (result) {
 		int saved_err = errno;
@@ -313,15 +479,18 @@ static int v4l2_queue_read_buffer(int index, int buffer_index)
 		return result;
 	}
 
-	devices[index].frame_queued |= 1 << buffer_index;
+	__atomic_fetch_or(&devices[index].frame_queued, 1 << buffer_index,
+			__ATOMIC_RELAXED);
+	v4l_trace(libv4l2, buf_requeue, devices[index].fd, buffer_index);
 	return 0;
 }
 
 static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
-		unsigned char *dest, int dest_size)
+		unsigned char *dest, int dest_size, int stream_lock_shared)
 {
 	const int max_tries = V4L2_IGNORE_FIRST_FRAME_ERRORS + 1;
 	int result, tries = max_tries, frame_info_gen;
+	uint64_t start;
 
 	/* Make sure we have the real v4l2 buffers mapped */
 	result = v4l2_map_buffers(index);
@@ -330,12 +499,15 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 
 	do {
 		frame_info_gen = devices[index].frame_info_generation;
-		pthread_mutex_unlock(&devices[index].stream_lock);
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				devices[index].fd, VIDIOC_DQBUF, buf);
+		pthread_rwlock_unlock(&devices[index].stream_lock);
+		start = v4l2_now_ns();
+		result = v4l2_dev_ioctl(index, VIDIOC_DQBUF, buf);
+		V4L2_STAT_ADD(index, dqbuf_wait_ns, v4l2_now_ns() - start);
 	V4L2_PERROR("%s:  VIDIOC_DQBUF", __func__);
-		pthread_mutex_lock(&devices[index].stream_lock);
+		if (stream_lock_shared)
+			pthread_rwlock_rdlock(&devices[index].stream_lock);
+		else
+			pthread_rwlock_wrlock(&devices[index].stream_lock);
 		if (result) {
 			if (errno != EAGAIN) {
 				int saved_err = errno;
@@ -346,19 +518,27 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 			return result;
 		}
 
-		devices[index].frame_queued &= ~(1 << buf->index);
+		__atomic_fetch_and(&devices[index].frame_queued,
+				~(1 << buf->index), __ATOMIC_RELAXED);
+
+		v4l_trace(libv4l2, buf_dequeue, devices[index].fd, buf->index,
+			  buf->bytesused);
 
 		if (frame_info_gen != devices[index].frame_info_generation) {
 			errno = -EINVAL;
 			return -1;
 		}
 
+		start = v4l2_now_ns();
 		result = v4lconvert_convert(devices[index].convert,
 				&devices[index].src_fmt, &devices[index].dest_fmt,
 				devices[index].frame_pointers[buf->index],
 				buf->bytesused, dest ? dest : (devices[index].convert_mmap_buf +
 					buf->index * devices[index].convert_mmap_frame_size),
 				dest_size);
+		V4L2_STAT_ADD(index, convert_ns, v4l2_now_ns() - start);
+		v4l_trace(libv4l2, buf_convert, devices[index].fd, buf->index,
+			  result);
 
 		if (devices[index].first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
@@ -404,6 +584,11 @@ static int v4l2_dequeue_and_convert(int index, struct v4l2_buffer *buf,
 		errno = 0;
 	}
 
+	if (result >= 0) {
+		V4L2_STAT_ADD(index, frames, 1);
+		V4L2_STAT_ADD(index, bytes_copied, result);
+	}
+
 	return result;
 }
 
@@ -426,10 +611,11 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 	}
 
 	do {
-		result = devices[index].dev_ops->read(
-				devices[index].dev_ops_priv,
-				devices[index].fd, devices[index].readbuf,
+		uint64_t start = v4l2_now_ns();
+
+		result = v4l2_dev_read(index, devices[index].readbuf,
 				buf_size);
+		V4L2_STAT_ADD(index, dqbuf_wait_ns, v4l2_now_ns() - start);
 		if (result <= 0) {
 			if (result && errno != EAGAIN) {
 				int saved_err = errno;
@@ -440,9 +626,11 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 			return result;
 		}
 
+		start = v4l2_now_ns();
 		result = v4lconvert_convert(devices[index].convert,
 				&devices[index].src_fmt, &devices[index].dest_fmt,
 				devices[index].readbuf, result, dest, dest_size);
+		V4L2_STAT_ADD(index, convert_ns, v4l2_now_ns() - start);
 
 		if (devices[index].first_frame) {
 			/* Always treat convert errors as EAGAIN during the first few frames, as
@@ -481,6 +669,11 @@ static int v4l2_read_and_convert(int index, unsigned char *dest, int dest_size)
 		errno = 0;
 	}
 
+	if (result >= 0) {
+		V4L2_STAT_ADD(index, frames, 1);
+		V4L2_STAT_ADD(index, bytes_copied, result);
+	}
+
 	return result;
 }
 
@@ -511,7 +704,9 @@ static int v4l2_activate_read_stream(int index)
 {
 	int result;
 
-	if ((devices[index].flags & V4L2_STREAMON) || devices[index].frame_queued) {
+	if ((devices[index].flags & V4L2_STREAMON) ||
+			__atomic_load_n(&devices[index].frame_queued,
+				__ATOMIC_RELAXED)) {
 		errno = EBUSY;
 		return -1;
 	}
@@ -557,6 +752,18 @@ static int v4l2_needs_conversion(int index)
 			&devices[index].src_fmt, &devices[index].dest_fmt);
 }
 
+/* Returns 1 when v4l2_map_buffers() would be a no-op */
+static int v4l2_frame_pointers_mapped(int index)
+{
+	unsigned int i;
+
+	for (i = 0; i < devices[index].no_frames; i++)
+		if (devices[index].frame_pointers[i] == MAP_FAILED)
+			return 0;
+
+	return 1;
+}
+
 static void v4l2_set_conversion_buf_params(int index, struct v4l2_buffer *buf)
 {
 	if (!v4l2_needs_conversion(index))
@@ -587,9 +794,7 @@ static int v4l2_buffers_mapped(int index)
 			buf.memory = V4L2_MEMORY_MMAP;
 			buf.index = i;
 			buf.reserved = buf.reserved2 = 0;
-			if (devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
-					devices[index].fd, VIDIOC_QUERYBUF,
+			if (v4l2_dev_ioctl(index, VIDIOC_QUERYBUF,
 					&buf)) {
 	V4L2_PERROR("%s:  VIDIOC_QUERYBUF", __func__);
 				int saved_err = errno;
@@ -749,6 +954,7 @@ no_capture:
 			devices[index].plugin_library = plugin_library;
 			devices[index].dev_ops_priv = dev_ops_priv;
 			devices[index].dev_ops = dev_ops;
+			v4l2_fd_map_set(fd, index);
 			break;
 		}
 	}
@@ -781,10 +987,12 @@ no_capture:
 	v4l2_set_src_and_dest_format(index, &devices[index].src_fmt,
 				     &devices[index].dest_fmt);
 
-	pthread_mutex_init(&devices[index].stream_lock, NULL);
+	pthread_rwlock_init(&devices[index].stream_lock, NULL);
+	pthread_mutex_init(&devices[index].dequeue_lock, NULL);
 
 	devices[index].no_frames = 0;
 	devices[index].nreadbuffers = V4L2_DEFAULT_NREADBUFFERS;
+	devices[index].memory_budget = 0;
 	devices[index].convert = convert;
 	devices[index].convert_mmap_buf = MAP_FAILED;
 	devices[index].convert_mmap_buf_size = 0;
@@ -795,6 +1003,9 @@ no_capture:
 	devices[index].frame_queued = 0;
 	devices[index].readbuf = NULL;
 	devices[index].readbuf_size = 0;
+	devices[index].frame_lent = 0;
+	devices[index].lent_frame_index = -1;
+	memset(&devices[index].stats, 0, sizeof(devices[index].stats));
 
 	if (index >= devices_used)
 		devices_used = index + 1;
@@ -816,10 +1027,17 @@ static int v4l2_get_index(int fd)
 {
 	int index;
 
+	struct v4l2_fd_map *map;
+
 	/* We never handle fd -1 */
 	if (fd == -1)
 		return -1;
 
+	map = __atomic_load_n(&v4l2_fd_map, __ATOMIC_ACQUIRE);
+	if (map && fd < map->size)
+		return __atomic_load_n(&map->map[fd], __ATOMIC_ACQUIRE);
+
+	/* no map entry for this fd (allocation failure): scan as before */
 	for (index = 0; index < devices_used; index++)
 		if (devices[index].fd == fd)
 			break;
@@ -841,10 +1059,10 @@ int v4l2_close(int fd)
 
 	/* Abuse stream_lock to stop 2 closes from racing and trying to free
 	   the resources twice */
-	pthread_mutex_lock(&devices[index].stream_lock);
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
 	devices[index].open_count--;
 	result = devices[index].open_count != 0;
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_rwlock_unlock(&devices[index].stream_lock);
 
 	if (result)
 		return 0;
@@ -866,15 +1084,24 @@ int v4l2_close(int fd)
 		devices[index].convert_mmap_buf = MAP_FAILED;
 		devices[index].convert_mmap_buf_size = 0;
 	}
+	if (getenv("LIBV4L2_STATS"))
+		v4l2_dump_stats(index);
 	v4lconvert_destroy(devices[index].convert);
 	free(devices[index].readbuf);
 	devices[index].readbuf = NULL;
 	devices[index].readbuf_size = 0;
+	devices[index].frame_lent = 0;
+	devices[index].lent_frame_index = -1;
 
 	/* Remove the fd from our list of managed fds before closing it, because as
 	   soon as we've done the actual close, the fd maybe returned by an open() in
-	   another thread and we don't want to intercept calls to this new fd. */
+	   another thread and we don't want to intercept calls to this new fd.
+	   Take v4l2_open_mutex so the clear cannot race a concurrent open growing
+	   the map, which would publish a copy still holding the stale entry. */
+	pthread_mutex_lock(&v4l2_open_mutex);
 	devices[index].fd = -1;
+	v4l2_fd_map_set(fd, -1);
+	pthread_mutex_unlock(&v4l2_open_mutex);
 
 	/* Since we've marked the fd as no longer used, and freed the resources,
 	   redo the close in case it was interrupted */
@@ -1030,9 +1257,7 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 		return result;
 
 	req_pix_fmt = src_fmt.fmt.pix;
-	result = devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-					       devices[index].fd,
-					       VIDIOC_S_FMT, &src_fmt);
+	result = v4l2_dev_ioctl(index, VIDIOC_S_FMT, &src_fmt);
 	if (result) {
 		int saved_err = errno;
 		V4L2_PERROR("setting pixformat");
@@ -1059,9 +1284,7 @@ static int v4l2_s_fmt(int index, struct v4l2_format *dest_fmt)
 			.type = V4L2_BUF_TYPE_VIDEO_CAPTURE,
 		};
 		V4L2_PERROR("%s:  VIDIOC_G_PARM", __func__);
-		if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-						  devices[index].fd,
-						  VIDIOC_G_PARM, &parm))
+		if (v4l2_dev_ioctl(index, VIDIOC_G_PARM, &parm))
 			return 0;
 		v4l2_update_fps(index, &parm);
 	}
@@ -1075,6 +1298,7 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 	va_list ap;
 	int result, index, saved_err;
 	int is_capture_request = 0, stream_needs_locking = 0;
+	int stream_locking_shared = 0, dequeue_locked = 0;
 
 	va_start(ap, request);
 	arg = va_arg(ap, void *);
@@ -1154,6 +1378,8 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 				V4L2_BUF_TYPE_VIDEO_CAPTURE) {
 			is_capture_request = 1;
 			stream_needs_locking = 1;
+			if (request == VIDIOC_QBUF || request == VIDIOC_DQBUF)
+				stream_locking_shared = 1;
 		}
 		break;
 	case VIDIOC_STREAMON:
@@ -1188,9 +1414,7 @@ int v4l2_ioctl(int fd, unsigned long int request, ...)
 
 	if (!is_capture_request) {
 no_capture_request:
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, request, arg);
+		result = v4l2_dev_ioctl(index, request, arg);
 		saved_err = errno;
 		v4l2_log_ioctl(request, arg, result);
 		errno = saved_err;
@@ -1199,7 +1423,23 @@ no_capture_request:
 
 
 	if (stream_needs_locking) {
-		pthread_mutex_lock(&devices[index].stream_lock);
+		uint64_t lock_start = v4l2_now_ns();
+
+		/* QBUF and DQBUF take the lock shared, so a producer thread
+		   queuing buffers does not serialize against a consumer thread
+		   converting a dequeued frame. V4L2_STREAM_TOUCHED is set once
+		   and never cleared, so a racy unlocked read of it can only
+		   make us fall back to the exclusive lock. */
+		if (stream_locking_shared &&
+				(devices[index].flags & V4L2_STREAM_TOUCHED)) {
+			pthread_rwlock_rdlock(&devices[index].stream_lock);
+			V4L2_STAT_ADD(index, lock_wait_ns,
+					v4l2_now_ns() - lock_start);
+			goto stream_locked;
+		}
+		stream_locking_shared = 0;
+		pthread_rwlock_wrlock(&devices[index].stream_lock);
+		V4L2_STAT_ADD(index, lock_wait_ns, v4l2_now_ns() - lock_start);
 		/* If this is the first stream-related ioctl, and we should only allow
 		   libv4lconvert supported destination formats (so that it can do flipping,
 		   processing, etc.) and the current destination format is not supported,
@@ -1217,6 +1457,7 @@ no_capture_request:
 		}
 		devices[index].flags |= V4L2_STREAM_TOUCHED;
 	}
+stream_locked:
 
 	switch (request) {
 	case VIDIOC_QUERYCTRL:
@@ -1246,9 +1487,7 @@ no_capture_request:
 	case VIDIOC_QUERYCAP: {
 		struct v4l2_capability *cap = arg;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_QUERYCAP, cap);
+		result = v4l2_dev_ioctl(index, VIDIOC_QUERYCAP, cap);
 		if (result == 0) {
 			/* We always support read() as we fake it using mmap mode */
 			cap->capabilities |= V4L2_CAP_READWRITE;
@@ -1296,17 +1535,13 @@ no_capture_request:
 		unsigned int orig_dest_pixelformat =
 			devices[index].dest_fmt.fmt.pix.pixelformat;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, request, arg);
+		result = v4l2_dev_ioctl(index, request, arg);
 		if (result)
 			break;
 
 		/* These ioctls may have changed the device's fmt */
 		src_fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_G_FMT, &src_fmt);
+		result = v4l2_dev_ioctl(index, VIDIOC_G_FMT, &src_fmt);
 		if (result) {
 			V4L2_PERROR("getting pixformat after %s",
 				     v4l2_ioctls[_IOC_NR(request)]);
@@ -1355,9 +1590,7 @@ no_capture_request:
 		if (req->count > V4L2_MAX_NO_FRAMES)
 			req->count = V4L2_MAX_NO_FRAMES;
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_REQBUFS, req);
+		result = v4l2_dev_ioctl(index, VIDIOC_REQBUFS, req);
 		if (result < 0)
 			break;
 		result = 0; /* some drivers return the number of buffers on success */
@@ -1378,9 +1611,7 @@ no_capture_request:
 
 		/* Do a real query even when converting to let the driver fill in
 		   things like buf->field */
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_QUERYBUF, buf);
+		result = v4l2_dev_ioctl(index, VIDIOC_QUERYBUF, buf);
 
 		v4l2_set_conversion_buf_params(index, buf);
 		break;
@@ -1389,6 +1620,18 @@ no_capture_request:
 	case VIDIOC_QBUF: {
 		struct v4l2_buffer *buf = arg;
 
+		/* Upgrade to the exclusive lock when the stream state must
+		   change; the conditions are rechecked under the new lock */
+		if (stream_locking_shared &&
+				((devices[index].flags &
+				  V4L2_STREAM_CONTROLLED_BY_READ) ||
+				 (v4l2_needs_conversion(index) &&
+				  !v4l2_frame_pointers_mapped(index)))) {
+			pthread_rwlock_unlock(&devices[index].stream_lock);
+			pthread_rwlock_wrlock(&devices[index].stream_lock);
+			stream_locking_shared = 0;
+		}
+
 		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
@@ -1402,9 +1645,7 @@ no_capture_request:
 				break;
 		}
 
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, VIDIOC_QBUF, arg);
+		result = v4l2_dev_ioctl(index, VIDIOC_QBUF, arg);
 
 		v4l2_set_conversion_buf_params(index, buf);
 		break;
@@ -1413,6 +1654,31 @@ no_capture_request:
 	case VIDIOC_DQBUF: {
 		struct v4l2_buffer *buf = arg;
 
+		/* Upgrade to the exclusive lock when the stream state must
+		   change, and also when another thread is already dequeuing;
+		   concurrent dequeuers share the conversion context so they
+		   may never convert at the same time. Note the trylock: the
+		   dequeue_lock holder never blocks on the dequeue_lock, so
+		   this cannot deadlock. */
+		if (stream_locking_shared) {
+			if ((devices[index].flags &
+			     V4L2_STREAM_CONTROLLED_BY_READ) ||
+					(v4l2_needs_conversion(index) &&
+					 (devices[index].convert_mmap_buf ==
+					  MAP_FAILED ||
+					  !v4l2_frame_pointers_mapped(index))) ||
+					pthread_mutex_trylock(
+						&devices[index].dequeue_lock)) {
+				pthread_rwlock_unlock(
+						&devices[index].stream_lock);
+				pthread_rwlock_wrlock(
+						&devices[index].stream_lock);
+				stream_locking_shared = 0;
+			} else {
+				dequeue_locked = 1;
+			}
+		}
+
 		if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
 			result = v4l2_deactivate_read_stream(index);
 			if (result)
@@ -1420,15 +1686,25 @@ no_capture_request:
 		}
 
 		if (!v4l2_needs_conversion(index)) {
-			pthread_mutex_unlock(&devices[index].stream_lock);
-			result = devices[index].dev_ops->ioctl(
-					devices[index].dev_ops_priv,
-					fd, VIDIOC_DQBUF, buf);
-			pthread_mutex_lock(&devices[index].stream_lock);
+			uint64_t start;
+
+			pthread_rwlock_unlock(&devices[index].stream_lock);
+			start = v4l2_now_ns();
+			result = v4l2_dev_ioctl(index, VIDIOC_DQBUF, buf);
+			V4L2_STAT_ADD(index, dqbuf_wait_ns,
+					v4l2_now_ns() - start);
+			if (stream_locking_shared)
+				pthread_rwlock_rdlock(
+						&devices[index].stream_lock);
+			else
+				pthread_rwlock_wrlock(
+						&devices[index].stream_lock);
 			if (result) {
 				saved_err = errno;
 				V4L2_PERROR("dequeuing buf");
 				errno = saved_err;
+			} else {
+				V4L2_STAT_ADD(index, frames, 1);
 			}
 			break;
 		}
@@ -1441,7 +1717,8 @@ no_capture_request:
 			break;
 
 		result = v4l2_dequeue_and_convert(index, buf, 0,
-				devices[index].convert_mmap_frame_size);
+				devices[index].convert_mmap_frame_size,
+				stream_locking_shared);
 		if (result >= 0) {
 			buf->bytesused = result;
 			result = 0;
@@ -1478,9 +1755,7 @@ no_capture_request:
 			v4l2_adjust_src_fmt_to_fps(index, fps);
 		}
 
-		result = devices[index].dev_ops->ioctl(
-						devices[index].dev_ops_priv,
-						fd, VIDIOC_S_PARM, parm);
+		result = v4l2_dev_ioctl(index, VIDIOC_S_PARM, parm);
 		if (result)
 			break;
 
@@ -1489,14 +1764,14 @@ no_capture_request:
 	}
 
 	default:
-		result = devices[index].dev_ops->ioctl(
-				devices[index].dev_ops_priv,
-				fd, request, arg);
+		result = v4l2_dev_ioctl(index, request, arg);
 		break;
 	}
 
+	if (dequeue_locked)
+		pthread_mutex_unlock(&devices[index].dequeue_lock);
 	if (stream_needs_locking)
-		pthread_mutex_unlock(&devices[index].stream_lock);
+		pthread_rwlock_unlock(&devices[index].stream_lock);
 
 	saved_err = errno;
 	v4l2_log_ioctl(request, arg, result);
@@ -1531,8 +1806,7 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 		return;
 
 	req_pix_fmt = src_fmt.fmt.pix;
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_S_FMT, &src_fmt))
+	if (v4l2_dev_ioctl(index, VIDIOC_S_FMT, &src_fmt))
 		return;
 
 	v4l2_set_src_and_dest_format(index, &src_fmt, &dest_fmt);
@@ -1559,8 +1833,7 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 	src_fmt = orig_src_fmt;
 	dest_fmt = orig_dest_fmt;
 	req_pix_fmt = src_fmt.fmt.pix;
-	if (devices[index].dev_ops->ioctl(devices[index].dev_ops_priv,
-			devices[index].fd, VIDIOC_S_FMT, &src_fmt)) {
+	if (v4l2_dev_ioctl(index, VIDIOC_S_FMT, &src_fmt)) {
 		V4L2_PERROR("restoring src fmt");
 		return;
 	}
@@ -1572,10 +1845,91 @@ static void v4l2_adjust_src_fmt_to_fps(int index, int fps)
 		V4L2_LOG_ERR("dest fmt different after restoring src fmt");
 }
 
+int v4l2_dqbuf_multi(int fd, struct v4l2_buffer *bufs, int count)
+{
+	int index, result = 0, n = 0;
+	struct v4l2_buffer template;
+	int saved_err;
+
+	index = v4l2_get_index(fd);
+	if (index == -1 || count <= 0 || !bufs) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* type / memory / reserved fields to use for every dequeue */
+	template = bufs[0];
+
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+
+	if (devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ) {
+		result = v4l2_deactivate_read_stream(index);
+		if (result)
+			goto leave;
+	}
+
+	while (n < count) {
+		struct v4l2_buffer *buf = &bufs[n];
+
+		if (n) {
+			struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+			/* after the first buffer only drain what is ready,
+			   never wait for the camera */
+			if (poll(&pfd, 1, 0) <= 0 || !(pfd.revents & POLLIN))
+				break;
+			*buf = template;
+		}
+
+		if (!v4l2_needs_conversion(index)) {
+			uint64_t start;
+
+			pthread_rwlock_unlock(&devices[index].stream_lock);
+			start = v4l2_now_ns();
+			result = v4l2_dev_ioctl(index, VIDIOC_DQBUF, buf);
+			V4L2_STAT_ADD(index, dqbuf_wait_ns,
+					v4l2_now_ns() - start);
+			pthread_rwlock_wrlock(&devices[index].stream_lock);
+			if (result) {
+				saved_err = errno;
+				V4L2_PERROR("dequeuing buf");
+				errno = saved_err;
+				break;
+			}
+			V4L2_STAT_ADD(index, frames, 1);
+			n++;
+			continue;
+		}
+
+		result = v4l2_ensure_convert_mmap_buf(index);
+		if (result)
+			break;
+
+		result = v4l2_dequeue_and_convert(index, buf, 0,
+				devices[index].convert_mmap_frame_size, 0);
+		if (result < 0)
+			break;
+
+		buf->bytesused = result;
+		result = 0;
+		v4l2_set_conversion_buf_params(index, buf);
+		n++;
+	}
+
+leave:
+	pthread_rwlock_unlock(&devices[index].stream_lock);
+
+	/* an error on a later buffer still returns the earlier ones */
+	if (n == 0 && result)
+		return -1;
+	return n;
+}
+
 ssize_t v4l2_read(int fd, void *dest, size_t n)
 {
 	ssize_t result;
 	int saved_errno;
+	uint64_t lock_start;
 	int index = v4l2_get_index(fd);
 
 	if (index == -1)
@@ -1586,16 +1940,16 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 		return -1;
 	}
 
-	pthread_mutex_lock(&devices[index].stream_lock);
+	lock_start = v4l2_now_ns();
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+	V4L2_STAT_ADD(index, lock_wait_ns, v4l2_now_ns() - lock_start);
 
 	/* When not converting and the device supports read(), let the kernel handle
 	   it */
 	if (devices[index].convert == NULL ||
 	    ((devices[index].flags & V4L2_SUPPORTS_READ) &&
 			!v4l2_needs_conversion(index))) {
-		result = devices[index].dev_ops->read(
-				devices[index].dev_ops_priv,
-				fd, dest, n);
+		result = v4l2_dev_read(index, dest, n);
 		goto leave;
 	}
 
@@ -1625,7 +1979,7 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 
 		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
-		result = v4l2_dequeue_and_convert(index, &buf, dest, n);
+		result = v4l2_dequeue_and_convert(index, &buf, dest, n, 0);
 
 		if (result >= 0)
 			v4l2_queue_read_buffer(index, buf.index);
@@ -1633,12 +1987,205 @@ ssize_t v4l2_read(int fd, void *dest, size_t n)
 
 leave:
 	saved_errno = errno;
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_rwlock_unlock(&devices[index].stream_lock);
 	errno = saved_errno;
 
 	return result;
 }
 
+ssize_t v4l2_peek_frame(int fd, unsigned char **frame)
+{
+	ssize_t result = -1;
+	struct v4l2_buffer buf;
+	int index = v4l2_get_index(fd);
+
+	if (index == -1 || !frame) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+
+	if (devices[index].frame_lent) {
+		errno = EBUSY;
+		goto leave;
+	}
+
+	/* Lending only works when we control the stream through mmap mode,
+	   if switching the driver to mmap mode failed for v4l2_read() it
+	   will fail for us too, see the comment there. */
+	if (devices[index].flags & V4L2_USE_READ_FOR_READ) {
+		errno = ENOSYS;
+		goto leave;
+	}
+
+	if (!(devices[index].flags & V4L2_STREAM_CONTROLLED_BY_READ)) {
+		result = v4l2_activate_read_stream(index);
+		if (result) {
+			if (errno != EBUSY)
+				errno = ENOSYS;
+			result = -1;
+			goto leave;
+		}
+	}
+
+	if (v4l2_needs_conversion(index)) {
+		/* Convert into our fake mmap buffer and lend that; the driver
+		   buffer can then be re-queued right away. */
+		result = v4l2_ensure_convert_mmap_buf(index);
+		if (result)
+			goto leave;
+
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		result = v4l2_dequeue_and_convert(index, &buf, 0,
+				devices[index].convert_mmap_frame_size, 0);
+		if (result < 0)
+			goto leave;
+
+		v4l2_queue_read_buffer(index, buf.index);
+		*frame = devices[index].convert_mmap_buf + buf.index *
+			devices[index].convert_mmap_frame_size;
+		devices[index].lent_frame_index = -1;
+	} else {
+		uint64_t start;
+
+		/* Lend the mmap-ed driver buffer itself, it gets re-queued
+		   on v4l2_release_frame() */
+		memset(&buf, 0, sizeof(buf));
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		pthread_rwlock_unlock(&devices[index].stream_lock);
+		start = v4l2_now_ns();
+		result = v4l2_dev_ioctl(index, VIDIOC_DQBUF, &buf);
+		V4L2_STAT_ADD(index, dqbuf_wait_ns, v4l2_now_ns() - start);
+		pthread_rwlock_wrlock(&devices[index].stream_lock);
+		if (result) {
+			int saved_err = errno;
+
+			V4L2_PERROR("dequeuing buf");
+			errno = saved_err;
+			goto leave;
+		}
+
+		__atomic_fetch_and(&devices[index].frame_queued,
+				~(1 << buf.index), __ATOMIC_RELAXED);
+		*frame = devices[index].frame_pointers[buf.index];
+		devices[index].lent_frame_index = buf.index;
+		result = buf.bytesused;
+		V4L2_STAT_ADD(index, frames, 1);
+	}
+	devices[index].frame_lent = 1;
+
+leave:
+	pthread_rwlock_unlock(&devices[index].stream_lock);
+	return result;
+}
+
+int v4l2_release_frame(int fd)
+{
+	int result = 0;
+	int index = v4l2_get_index(fd);
+
+	if (index == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+
+	if (!devices[index].frame_lent) {
+		errno = EINVAL;
+		result = -1;
+		goto leave;
+	}
+
+	if (devices[index].lent_frame_index >= 0)
+		result = v4l2_queue_read_buffer(index,
+				devices[index].lent_frame_index);
+
+	devices[index].frame_lent = 0;
+	devices[index].lent_frame_index = -1;
+
+leave:
+	pthread_rwlock_unlock(&devices[index].stream_lock);
+	return result;
+}
+
+int v4l2_set_memory_budget(int fd, size_t bytes)
+{
+	int index = v4l2_get_index(fd);
+
+	if (index == -1) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+	devices[index].memory_budget = bytes;
+	pthread_rwlock_unlock(&devices[index].stream_lock);
+	return 0;
+}
+
+int v4l2_export_buffer(int fd, int buffer_index, int flags)
+{
+	struct v4l2_exportbuffer expbuf;
+	int result;
+	int index = v4l2_get_index(fd);
+
+	memset(&expbuf, 0, sizeof(expbuf));
+	expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	expbuf.index = buffer_index;
+	expbuf.flags = flags;
+
+	/* Not a libv4l2 managed fd, no bookkeeping to protect */
+	if (index == -1) {
+		if (SYS_IOCTL(fd, VIDIOC_EXPBUF, &expbuf))
+			return -1;
+		return expbuf.fd;
+	}
+
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
+
+	/* The dmabuf refers to the raw driver buffer; handing it out while
+	   libv4lconvert rewrites every frame into the fake mmap buffers
+	   would give the importer unconverted data, so the zero-copy path
+	   is only allowed when no conversion is active */
+	if (v4l2_needs_conversion(index)) {
+		errno = ENOTSUP;
+		result = -1;
+		goto leave;
+	}
+
+	result = v4l2_dev_ioctl(index, VIDIOC_EXPBUF, &expbuf);
+	if (result) {
+		int saved_err = errno;
+
+		V4L2_PERROR("exporting buffer %d", buffer_index);
+		errno = saved_err;
+		result = -1;
+	} else {
+		result = expbuf.fd;
+	}
+
+leave:
+	pthread_rwlock_unlock(&devices[index].stream_lock);
+	return result;
+}
+
+int v4l2_get_stats(int fd, struct v4l2_stats *stats)
+{
+	int index = v4l2_get_index(fd);
+
+	if (index == -1 || !stats) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	v4l2_copy_stats(index, stats);
+	return 0;
+}
+
 ssize_t v4l2_write(int fd, const void *buffer, size_t n)
 {
 	int index = v4l2_get_index(fd);
@@ -1680,7 +2227,7 @@ void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
 		return (void *)SYS_MMAP(start, length, prot, flags, fd, offset);
 	}
 
-	pthread_mutex_lock(&devices[index].stream_lock);
+	pthread_rwlock_wrlock(&devices[index].stream_lock);
 
 	buffer_index = offset & 0xff;
 	if (buffer_index >= devices[index].no_frames ||
@@ -1706,7 +2253,7 @@ void *v4l2_mmap(void *start, size_t length, int prot, int flags, int fd,
 			buffer_index, result);
 
 leave:
-	pthread_mutex_unlock(&devices[index].stream_lock);
+	pthread_rwlock_unlock(&devices[index].stream_lock);
 
 	return result;
 }
@@ -1730,7 +2277,7 @@ int v4l2_munmap(void *_start, size_t length)
 		if (index != devices_used) {
 			int unmapped = 0;
 
-			pthread_mutex_lock(&devices[index].stream_lock);
+			pthread_rwlock_wrlock(&devices[index].stream_lock);
 
 			buffer_index = (start - devices[index].convert_mmap_buf) / length;
 
@@ -1745,7 +2292,7 @@ int v4l2_munmap(void *_start, size_t length)
 				unmapped = 1;
 			}
 
-			pthread_mutex_unlock(&devices[index].stream_lock);
+			pthread_rwlock_unlock(&devices[index].stream_lock);
 
 			if (unmapped) {
 				V4L2_LOG("v4l2 fake buffer munmap %p, %d\n", start, (int)length);
@@ -18,6 +18,7 @@
 
 #include <config.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <glob.h>
@@ -44,28 +45,39 @@
 
    v4l2_plugin_* function indicates by it's first argument if plugin was used,
    and if it was not then v4l2_* functions proceed with their usual behavior.
+
+   The plugin directory is only walked (and the plugins only dlopen-ed) on
+   the first open; after that the loaded plugins are cached for the lifetime
+   of the process and each open just asks every cached plugin whether it
+   wants the device. The libraries are never dlclose-d.
 */
 
 #define PLUGINS_PATTERN LIBV4L2_PLUGIN_DIR "/*.so"
 
-void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
-		      const struct libv4l_dev_ops **dev_ops_ret)
+static pthread_mutex_t plugin_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int plugin_cache_loaded;
+static int plugin_cache_count;
+static struct v4l2_plugin_cache_entry {
+	void *library;
+	const struct libv4l_dev_ops *ops;
+} *plugin_cache;
+
+static void v4l2_plugin_load_cache(void)
 {
 	char *error;
 	int glob_ret, i;
-	void *plugin_library = NULL;
-	const struct libv4l_dev_ops *libv4l2_plugin = NULL;
+	void *plugin_library;
+	const struct libv4l_dev_ops *libv4l2_plugin;
+	struct v4l2_plugin_cache_entry *new_cache;
 	glob_t globbuf;
 
-	*dev_ops_ret = v4lconvert_get_default_dev_ops();
-	*plugin_lib_ret = NULL;
-	*plugin_priv_ret = NULL;
-
 	glob_ret = glob(PLUGINS_PATTERN, 0, NULL, &globbuf);
 
 	if (glob_ret == GLOB_NOSPACE)
 		return;
 
+	plugin_cache_loaded = 1;
+
 	if (glob_ret == GLOB_ABORTED || glob_ret == GLOB_NOMATCH)
 		goto leave;
 
@@ -94,27 +106,54 @@ void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
 			continue;
 		}
 
-		*plugin_priv_ret = libv4l2_plugin->init(fd);
+		new_cache = realloc(plugin_cache,
+				(plugin_cache_count + 1) * sizeof(*plugin_cache));
+		if (!new_cache) {
+			dlclose(plugin_library);
+			break;
+		}
+		plugin_cache = new_cache;
+		plugin_cache[plugin_cache_count].library = plugin_library;
+		plugin_cache[plugin_cache_count].ops = libv4l2_plugin;
+		plugin_cache_count++;
+	}
+
+leave:
+	globfree(&globbuf);
+}
+
+void v4l2_plugin_init(int fd, void **plugin_lib_ret, void **plugin_priv_ret,
+		      const struct libv4l_dev_ops **dev_ops_ret)
+{
+	int i;
+
+	*dev_ops_ret = v4lconvert_get_default_dev_ops();
+	*plugin_lib_ret = NULL;
+	*plugin_priv_ret = NULL;
+
+	pthread_mutex_lock(&plugin_cache_lock);
+	if (!plugin_cache_loaded)
+		v4l2_plugin_load_cache();
+	pthread_mutex_unlock(&plugin_cache_lock);
+
+	for (i = 0; i < plugin_cache_count; i++) {
+		*plugin_priv_ret = plugin_cache[i].ops->init(fd);
 		if (!*plugin_priv_ret) {
 			V4L2_LOG("PLUGIN: plugin open() returned NULL\n");
-			dlclose(plugin_library);
 			continue;
 		}
 
-		*plugin_lib_ret = plugin_library;
-		*dev_ops_ret = libv4l2_plugin;
+		*plugin_lib_ret = plugin_cache[i].library;
+		*dev_ops_ret = plugin_cache[i].ops;
 		break;
 	}
-
-leave:
-	globfree(&globbuf);
 }
 
 void v4l2_plugin_cleanup(void *plugin_lib, void *plugin_priv,
 			 const struct libv4l_dev_ops *dev_ops)
 {
-	if (plugin_lib) {
+	/* Note the plugin library itself stays loaded, it is shared by all
+	   opens of all devices in this process */
+	if (plugin_lib)
 		dev_ops->close(plugin_priv);
-		dlclose(plugin_lib);
-	}
 }
@@ -6,6 +6,8 @@
 
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -22,6 +24,8 @@
 
 #include "../include/libv4l2rds.h"
 
+struct rds_async_state;
+
 /* struct to encapsulate the private state information of the decoding process */
 /* the fields (except for handle) are for internal use only - new information
  * is decoded and stored in them until it can be verified and copied to the
@@ -73,6 +77,14 @@ struct rds_private_state {
 	 * be done */
 	struct v4l2_rds_group rds_group;
 	struct v4l2_rds_data rds_data_raw[4];
+
+	/* bitmask of fields updated since the last call of
+	 * v4l2_rds_get_changed_fields() */
+	uint32_t changed_fields;
+
+	/* asynchronous decoding state, NULL unless enabled by
+	 * v4l2_rds_enable_async() */
+	struct rds_async_state *async;
 };
 
 /* states of the RDS block into group decoding state machine */
@@ -236,8 +248,10 @@ static bool rds_compare_group(const struct v4l2_rds_group *a,
 
 /* checks if an entry for the given PI already exists and returns the index
  * of that entry if so. Else it adds a new entry to the TMC-Tuning table and returns
- * the index of the new field */
-static int rds_add_tmc_station(struct rds_private_state *priv_state, uint16_t pi)
+ * the index of the new field
+ * @added:	if non-NULL, set to true when a new entry was created */
+static int rds_add_tmc_station(struct rds_private_state *priv_state, uint16_t pi,
+			       bool *added)
 {
 	struct v4l2_tmc_tuning *tuning = &priv_state->handle.tmc.tuning;
 	uint8_t index = tuning->index;
@@ -251,6 +265,8 @@ static int rds_add_tmc_station(struct rds_private_state *priv_state, uint16_t pi
 	}
 	/* if the the maximum table size is reached, overwrite old
 	 * entries, starting at the oldest one = 0 */
+	if (added)
+		*added = true;
 	tuning->station[index].pi = pi;
 	tuning->index = (index+1 < MAX_TMC_ALT_STATIONS) ? (index+1) : 0;
 	tuning->station_cnt = (size+1 <= MAX_TMC_ALT_STATIONS) ? (size+1) : MAX_TMC_ALT_STATIONS;
@@ -264,7 +280,7 @@ static bool rds_add_tmc_af(struct rds_private_state *priv_state)
 	struct v4l2_tmc_alt_freq *afi;
 	uint16_t pi_on = grp->data_d_msb << 8 | grp->data_d_lsb;
 	uint8_t variant = grp->data_b_lsb & 0x0f;
-	uint8_t station_index = rds_add_tmc_station(priv_state, pi_on);
+	uint8_t station_index = rds_add_tmc_station(priv_state, pi_on, NULL);
 	uint8_t af_index;
 	uint8_t mapped_af_index;
 	uint32_t freq_a = rds_decode_af(grp->data_c_msb, true);
@@ -311,6 +327,8 @@ static bool rds_add_tmc_af(struct rds_private_state *priv_state)
 		 * frequency, update the mapped frequency in this case */
 		for (int i = 0; i < afi->mapped_af_size; i++) {
 			if (freq_a == afi->mapped_af_tuning[i]) {
+				if (afi->mapped_af[i] == freq_b)
+					return false;
 				afi->mapped_af[i] = freq_b;
 				return true;
 			}
@@ -559,49 +577,62 @@ static uint32_t rds_decode_tmc_tuning(struct rds_private_state *priv_state)
 	struct v4l2_rds_tmc *tmc = &priv_state->handle.tmc;
 	uint8_t variant_code = group->data_b_lsb & 0x0f;
 	uint16_t pi_on = (group->data_d_msb << 8) | group->data_d_lsb;
+	bool changed = false;
 	uint8_t index;
 
 	/* variants 4 and 5 carry the service provider name */
 	if (variant_code >= 4 && variant_code <= 5) {
 		int offset = 4 * (variant_code - 4);
-		tmc->spn[0 + offset] = group->data_c_msb;
-		tmc->spn[1 + offset] = group->data_c_lsb;
-		tmc->spn[2 + offset] = group->data_d_msb;
-		tmc->spn[3 + offset] = group->data_d_lsb;
+		uint8_t spn[4] = { group->data_c_msb, group->data_c_lsb,
+				   group->data_d_msb, group->data_d_lsb };
+
+		changed = memcmp(&tmc->spn[offset], spn, 4) != 0;
+		memcpy(&tmc->spn[offset], spn, 4);
 
 	/* variant 6 provides specific frequencies for the same RDS-TMC service
 	 * on a network with a different PI code */
 	/* variant 7 provides mapped frequency pair information which should only
 	 * be used if the terminal is tuned to the tuning frequency */
 	} else if (variant_code == 6 || variant_code == 7) {
-		rds_add_tmc_af(priv_state);
+		changed = rds_add_tmc_af(priv_state);
 
-	/* variant 8 indicates up to 2 PI codes of adjacent networks carrying 
-	 * the same RDS-TMC service on all transmitters of the network */ 
+	/* variant 8 indicates up to 2 PI codes of adjacent networks carrying
+	 * the same RDS-TMC service on all transmitters of the network */
 	} else if (variant_code == 8) {
 		uint16_t pi_on_2 = (group->data_c_msb << 8) | group->data_c_lsb;
 
 		/* try to add both transmitted PI codes to the table */
-		rds_add_tmc_station(priv_state, pi_on);
+		rds_add_tmc_station(priv_state, pi_on, &changed);
 		/* PI = 0 is used as a filler code */
 		if (pi_on_2 != 0)
-			rds_add_tmc_station(priv_state, pi_on_2);
+			rds_add_tmc_station(priv_state, pi_on_2, &changed);
 
-	/* variant 9 provides PI codes of other networks with different system 
+	/* variant 9 provides PI codes of other networks with different system
 	 * parameters */
 	} else if (variant_code == 9) {
-		index = rds_add_tmc_station(priv_state, pi_on);
+		uint8_t sid, msg, ltn;
+
+		index = rds_add_tmc_station(priv_state, pi_on, &changed);
 
 		/* bits 0 - 5 contain the service-ID of the ON */
-		tmc->tuning.station[index].sid = group->data_c_lsb & 0x3F;
+		sid = group->data_c_lsb & 0x3F;
 		/* bits 6-10 contain the msg parameters of the ON */
-		tmc->tuning.station[index].msg = (group->data_c_msb & 0x03) << 2;
-		tmc->tuning.station[index].msg |= (group->data_c_lsb >> 6) & 0x03;
+		msg = (group->data_c_msb & 0x03) << 2;
+		msg |= (group->data_c_lsb >> 6) & 0x03;
 		/* bits 11-15 contain the database-ID of the ON */
-		tmc->tuning.station[index].ltn = group->data_c_msb >> 2;
+		ltn = group->data_c_msb >> 2;
+
+		changed |= tmc->tuning.station[index].sid != sid ||
+			   tmc->tuning.station[index].msg != msg ||
+			   tmc->tuning.station[index].ltn != ltn;
+		tmc->tuning.station[index].sid = sid;
+		tmc->tuning.station[index].msg = msg;
+		tmc->tuning.station[index].ltn = ltn;
 	}
 
-	return V4L2_RDS_TMC_TUNING;
+	/* only report the update if the tuning tables really changed, so
+	 * consumers don't re-scan them at block rate */
+	return changed ? V4L2_RDS_TMC_TUNING : 0;
 }
 
 static bool rds_add_oda(struct rds_private_state *priv_state, struct v4l2_rds_oda oda)
@@ -1340,8 +1371,10 @@ struct v4l2_rds *v4l2_rds_create(bool is_rbds)
 
 void v4l2_rds_destroy(struct v4l2_rds *handle)
 {
-	if (handle)
+	if (handle) {
+		v4l2_rds_disable_async(handle);
 		free(handle);
+	}
 }
 
 void v4l2_rds_reset(struct v4l2_rds *handle, bool reset_statistics)
@@ -1352,11 +1385,13 @@ void v4l2_rds_reset(struct v4l2_rds *handle, bool reset_statistics)
 	/* store members of handle that shouldn't be affected by reset */
 	bool is_rbds = handle->is_rbds;
 	struct v4l2_rds_statistics rds_statistics = handle->rds_statistics;
+	struct rds_async_state *async = priv_state->async;
 
 	/* reset the handle */
 	memset(priv_state, 0, sizeof(*priv_state));
 	/* re-initialize members */
 	handle->is_rbds = is_rbds;
+	priv_state->async = async;
 	if (!reset_statistics)
 		handle->rds_statistics = rds_statistics;
 }
@@ -1436,6 +1471,10 @@ uint32_t v4l2_rds_add(struct v4l2_rds *handle, struct v4l2_rds_data *rds_data)
 			rds_decode_d(priv_state, &rds_data_raw[3]);
 			/* decode group type dependent fields */
 			updated_fields |= rds_decode_group(priv_state);
+			if (updated_fields)
+				__atomic_fetch_or(&priv_state->changed_fields,
+						  updated_fields,
+						  __ATOMIC_RELEASE);
 			return updated_fields;
 		}
 		rds_stats->group_error_cnt++;
@@ -1451,6 +1490,287 @@ uint32_t v4l2_rds_add(struct v4l2_rds *handle, struct v4l2_rds_data *rds_data)
 	return 0;
 }
 
+uint32_t v4l2_rds_get_changed_fields(struct v4l2_rds *handle)
+{
+	struct rds_private_state *priv_state = (struct rds_private_state *) handle;
+
+	/* atomic, so the mask can be consumed from another thread than the
+	 * one decoding the blocks (e.g. with asynchronous decoding) */
+	return __atomic_exchange_n(&priv_state->changed_fields, 0,
+				   __ATOMIC_ACQUIRE);
+}
+
+/* single-producer single-consumer ring buffer for raw RDS blocks, used by
+ * the asynchronous decoding mode. The I/O thread only writes the head index
+ * and the decoding worker only writes the tail index, so the ring works
+ * without locks: the slot contents are published by the release store of
+ * the head and the semaphore just keeps the worker from busy-waiting */
+#define RDS_ASYNC_RING_SIZE 2048	/* number of blocks, power of two */
+
+struct rds_async_state {
+	struct v4l2_rds_data ring[RDS_ASYNC_RING_SIZE];
+	unsigned int head;		/* written by the producer only */
+	unsigned int tail;		/* written by the worker only */
+	sem_t avail;
+	pthread_t worker;
+	bool running;
+	void (*cb)(struct v4l2_rds *handle, uint32_t updated_fields,
+		   void *cb_arg);
+	void *cb_arg;
+	struct rds_private_state *priv_state;
+};
+
+static void *rds_async_worker(void *arg)
+{
+	struct rds_async_state *async = arg;
+	struct v4l2_rds_data rds_data;
+	uint32_t updated_fields;
+	unsigned int head, tail;
+
+	for (;;) {
+		if (sem_wait(&async->avail) && errno == EINTR)
+			continue;
+
+		tail = async->tail;
+		head = __atomic_load_n(&async->head, __ATOMIC_ACQUIRE);
+		if (tail == head) {
+			/* woken up with an empty ring: time to quit */
+			if (!__atomic_load_n(&async->running, __ATOMIC_ACQUIRE))
+				break;
+			continue;
+		}
+
+		rds_data = async->ring[tail & (RDS_ASYNC_RING_SIZE - 1)];
+		__atomic_store_n(&async->tail, tail + 1, __ATOMIC_RELEASE);
+
+		updated_fields = v4l2_rds_add(&async->priv_state->handle,
+					      &rds_data);
+		if (updated_fields && async->cb)
+			async->cb(&async->priv_state->handle, updated_fields,
+				  async->cb_arg);
+	}
+	return NULL;
+}
+
+int v4l2_rds_enable_async(struct v4l2_rds *handle,
+			  void (*cb)(struct v4l2_rds *handle,
+				     uint32_t updated_fields, void *cb_arg),
+			  void *cb_arg)
+{
+	struct rds_private_state *priv_state = (struct rds_private_state *) handle;
+	struct rds_async_state *async;
+	int ret;
+
+	if (priv_state->async)
+		return -EBUSY;
+
+	async = calloc(1, sizeof(*async));
+	if (!async)
+		return -ENOMEM;
+
+	sem_init(&async->avail, 0, 0);
+	async->cb = cb;
+	async->cb_arg = cb_arg;
+	async->priv_state = priv_state;
+	async->running = true;
+
+	ret = pthread_create(&async->worker, NULL, rds_async_worker, async);
+	if (ret) {
+		sem_destroy(&async->avail);
+		free(async);
+		return -ret;
+	}
+
+	priv_state->async = async;
+	return 0;
+}
+
+void v4l2_rds_disable_async(struct v4l2_rds *handle)
+{
+	struct rds_private_state *priv_state = (struct rds_private_state *) handle;
+	struct rds_async_state *async = priv_state->async;
+
+	if (!async)
+		return;
+	priv_state->async = NULL;
+
+	/* the worker drains the pending blocks before it reacts to this */
+	__atomic_store_n(&async->running, false, __ATOMIC_RELEASE);
+	sem_post(&async->avail);
+	pthread_join(async->worker, NULL);
+
+	sem_destroy(&async->avail);
+	free(async);
+}
+
+bool v4l2_rds_add_async(struct v4l2_rds *handle, struct v4l2_rds_data *rds_data)
+{
+	struct rds_private_state *priv_state = (struct rds_private_state *) handle;
+	struct rds_async_state *async = priv_state->async;
+	unsigned int head, tail;
+
+	if (!async)
+		return false;
+
+	head = async->head;
+	tail = __atomic_load_n(&async->tail, __ATOMIC_ACQUIRE);
+	if (head - tail >= RDS_ASYNC_RING_SIZE)
+		return false;	/* ring full: the caller decides what to drop */
+
+	async->ring[head & (RDS_ASYNC_RING_SIZE - 1)] = *rds_data;
+	__atomic_store_n(&async->head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&async->avail);
+	return true;
+}
+
+/* multi-station manager: one decoding context per tracked frequency, plus
+ * a pool of interned strings. PS and RT strings repeat across stations and
+ * over time, so handing out one shared copy per distinct string keeps the
+ * memory per tracked station low when tens of stations are followed */
+#define RDS_MC_HASH_SIZE 64	/* buckets, both for stations and strings */
+
+struct rds_mc_string {
+	struct rds_mc_string *next;
+	char str[];
+};
+
+struct rds_mc_station {
+	struct rds_mc_station *next;
+	uint32_t freq;
+	struct v4l2_rds *handle;
+};
+
+struct v4l2_rds_mc {
+	bool is_rbds;
+	struct rds_mc_station *stations[RDS_MC_HASH_SIZE];
+	struct rds_mc_string *strings[RDS_MC_HASH_SIZE];
+};
+
+static uint32_t rds_mc_hash(const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	uint32_t hash = 0x811c9dc5;
+
+	while (len--) {
+		hash ^= *p++;
+		hash *= 0x01000193;
+	}
+	return hash & (RDS_MC_HASH_SIZE - 1);
+}
+
+struct v4l2_rds_mc *v4l2_rds_mc_create(bool is_rbds)
+{
+	struct v4l2_rds_mc *mc = calloc(1, sizeof(*mc));
+
+	if (mc)
+		mc->is_rbds = is_rbds;
+	return mc;
+}
+
+void v4l2_rds_mc_destroy(struct v4l2_rds_mc *mc)
+{
+	struct rds_mc_station *station, *next_station;
+	struct rds_mc_string *string, *next_string;
+
+	if (!mc)
+		return;
+
+	for (int i = 0; i < RDS_MC_HASH_SIZE; i++) {
+		for (station = mc->stations[i]; station; station = next_station) {
+			next_station = station->next;
+			v4l2_rds_destroy(station->handle);
+			free(station);
+		}
+		for (string = mc->strings[i]; string; string = next_string) {
+			next_string = string->next;
+			free(string);
+		}
+	}
+	free(mc);
+}
+
+struct v4l2_rds *v4l2_rds_mc_get(struct v4l2_rds_mc *mc, uint32_t freq)
+{
+	uint32_t bucket = rds_mc_hash(&freq, sizeof(freq));
+	struct rds_mc_station *station;
+
+	for (station = mc->stations[bucket]; station; station = station->next)
+		if (station->freq == freq)
+			return station->handle;
+
+	station = malloc(sizeof(*station));
+	if (!station)
+		return NULL;
+	station->freq = freq;
+	station->handle = v4l2_rds_create(mc->is_rbds);
+	if (!station->handle) {
+		free(station);
+		return NULL;
+	}
+	station->next = mc->stations[bucket];
+	mc->stations[bucket] = station;
+	return station->handle;
+}
+
+uint32_t v4l2_rds_mc_add(struct v4l2_rds_mc *mc, uint32_t freq,
+			 struct v4l2_rds_data *rds_data)
+{
+	struct v4l2_rds *handle = v4l2_rds_mc_get(mc, freq);
+
+	return handle ? v4l2_rds_add(handle, rds_data) : 0;
+}
+
+uint32_t v4l2_rds_mc_add_blocks(struct v4l2_rds_mc *mc,
+				struct v4l2_rds_mc_block *blocks,
+				unsigned int num_blocks)
+{
+	uint32_t updated_fields = 0;
+
+	while (num_blocks--) {
+		updated_fields |= v4l2_rds_mc_add(mc, blocks->frequency,
+						  &blocks->data);
+		blocks++;
+	}
+	return updated_fields;
+}
+
+const char *v4l2_rds_mc_intern(struct v4l2_rds_mc *mc, const char *str)
+{
+	size_t len = strlen(str);
+	uint32_t bucket = rds_mc_hash(str, len);
+	struct rds_mc_string *string;
+
+	for (string = mc->strings[bucket]; string; string = string->next)
+		if (!strcmp(string->str, str))
+			return string->str;
+
+	string = malloc(sizeof(*string) + len + 1);
+	if (!string)
+		return NULL;
+	memcpy(string->str, str, len + 1);
+	string->next = mc->strings[bucket];
+	mc->strings[bucket] = string;
+	return string->str;
+}
+
+const char *v4l2_rds_mc_get_ps(struct v4l2_rds_mc *mc, uint32_t freq)
+{
+	struct v4l2_rds *handle = v4l2_rds_mc_get(mc, freq);
+
+	if (!handle || !(handle->valid_fields & V4L2_RDS_PS))
+		return NULL;
+	return v4l2_rds_mc_intern(mc, (const char *)handle->ps);
+}
+
+const char *v4l2_rds_mc_get_rt(struct v4l2_rds_mc *mc, uint32_t freq)
+{
+	struct v4l2_rds *handle = v4l2_rds_mc_get(mc, freq);
+
+	if (!handle || !(handle->valid_fields & V4L2_RDS_RT))
+		return NULL;
+	return v4l2_rds_mc_intern(mc, (const char *)handle->rt);
+}
+
 const char *v4l2_rds_get_pty_str(const struct v4l2_rds *handle)
 {
 	const uint8_t pty = handle->pty;
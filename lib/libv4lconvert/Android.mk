@@ -3,8 +3,10 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES := \
+    bands.c \
     bayer.c \
     cpia1.c \
+    cpu.c \
     crop.c \
     flip.c \
     helper.c \
@@ -17,6 +19,7 @@ LOCAL_SRC_FILES := \
     libv4lconvert.c \
     mr97310a.c \
     pac207.c \
+    pipeline.c \
     rgbyuv.c \
     se401.c \
     sn9c10x.c \
@@ -0,0 +1,378 @@
+/*
+
+# Multi-threaded banded frame conversion
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include "libv4lconvert-priv.h"
+
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+/* Do not bother spinning up the workers for small frames */
+#define V4LCONVERT_BANDS_MIN_PIXELS (256 * 1024)
+
+/*
+ * Persistent worker-thread pool.  v4lconvert_threadpool_run() splits
+ * [0, height) into bands of rows_per_band rows which are handed out to the
+ * workers and to the calling thread itself, then waits until all bands are
+ * done.  The pool is created lazily on the first threaded conversion and
+ * lives as long as the v4lconvert_data context.
+ */
+struct v4lconvert_threadpool {
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	pthread_t *threads;
+	int num_workers;
+	int stop;
+	/* current job, protected by lock */
+	unsigned int seq;
+	void (*func)(void *arg, int start_row, int rows);
+	void *arg;
+	int height;
+	int rows_per_band;
+	int next_row;
+	int active;
+};
+
+/* Grab and convert bands until the current job runs out of rows.
+   Must be called with pool->lock held, returns with it held. */
+static void v4lconvert_threadpool_work(struct v4lconvert_threadpool *pool)
+{
+	while (pool->next_row < pool->height) {
+		int start = pool->next_row;
+		int rows = MIN(pool->rows_per_band, pool->height - start);
+
+		pool->next_row += rows;
+		pool->active++;
+		pthread_mutex_unlock(&pool->lock);
+		pool->func(pool->arg, start, rows);
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->active == 0 && pool->next_row >= pool->height)
+			pthread_cond_signal(&pool->done);
+	}
+}
+
+static void *v4lconvert_threadpool_worker(void *arg)
+{
+	struct v4lconvert_threadpool *pool = arg;
+	unsigned int seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->stop) {
+		if (pool->seq == seen || pool->next_row >= pool->height) {
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+		seen = pool->seq;
+		v4lconvert_threadpool_work(pool);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+struct v4lconvert_threadpool *v4lconvert_threadpool_create(int num_workers)
+{
+	struct v4lconvert_threadpool *pool;
+	int i;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->threads = calloc(num_workers, sizeof(pthread_t));
+	if (!pool->threads) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 0; i < num_workers; i++) {
+		if (pthread_create(&pool->threads[i], NULL,
+				   v4lconvert_threadpool_worker, pool)) {
+			pool->num_workers = i;
+			v4lconvert_threadpool_destroy(pool);
+			return NULL;
+		}
+	}
+	pool->num_workers = num_workers;
+
+	return pool;
+}
+
+void v4lconvert_threadpool_destroy(struct v4lconvert_threadpool *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = 1;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->num_workers; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool->threads);
+	free(pool);
+}
+
+void v4lconvert_threadpool_run(struct v4lconvert_threadpool *pool,
+		void (*func)(void *arg, int start_row, int rows), void *arg,
+		int height, int row_align)
+{
+	int bands = pool->num_workers + 1;
+	int rows = (height + bands - 1) / bands;
+
+	rows = (rows + row_align - 1) & ~(row_align - 1);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->func = func;
+	pool->arg = arg;
+	pool->height = height;
+	pool->rows_per_band = rows;
+	pool->next_row = 0;
+	pool->seq++;
+	pthread_cond_broadcast(&pool->work);
+	/* the calling thread converts bands too */
+	v4lconvert_threadpool_work(pool);
+	while (pool->active)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Banded conversions.  Only conversions where every output row depends on
+ * at most rows [2n, 2n + 1] of the source can be split into horizontal
+ * bands; that covers the packed source formats below, planar sources keep
+ * the single threaded path.
+ */
+enum v4lconvert_band_op {
+	V4L_BAND_YUYV,
+	V4L_BAND_YVYU,
+	V4L_BAND_UYVY,
+	V4L_BAND_RGB565,
+	V4L_BAND_GREY,
+	V4L_BAND_Y16,
+	V4L_BAND_COPY24,
+	V4L_BAND_SWAP24,
+	V4L_BAND_RGB32,
+};
+
+struct v4lconvert_band_job {
+	const unsigned char *src;
+	unsigned char *dest;
+	int width;
+	int stride;		/* bytes per source row */
+	int dest_stride;	/* bytes per dest row */
+	enum v4lconvert_band_op op;
+	int flag;		/* bgr resp. little_endian argument */
+};
+
+static void v4lconvert_band_func(void *arg, int start_row, int rows)
+{
+	struct v4lconvert_band_job *job = arg;
+	const unsigned char *src = job->src + (size_t)start_row * job->stride;
+	unsigned char *dest = job->dest +
+		(size_t)start_row * job->dest_stride;
+
+	switch (job->op) {
+	case V4L_BAND_YUYV:
+		if (job->flag)
+			v4lconvert_yuyv_to_bgr24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		else
+			v4lconvert_yuyv_to_rgb24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		break;
+	case V4L_BAND_YVYU:
+		if (job->flag)
+			v4lconvert_yvyu_to_bgr24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		else
+			v4lconvert_yvyu_to_rgb24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		break;
+	case V4L_BAND_UYVY:
+		if (job->flag)
+			v4lconvert_uyvy_to_bgr24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		else
+			v4lconvert_uyvy_to_rgb24(src, dest, job->width, rows,
+						 job->stride,
+						 job->dest_stride);
+		break;
+	case V4L_BAND_RGB565:
+		if (job->flag)
+			v4lconvert_rgb565_to_bgr24(src, dest, job->width, rows,
+						   job->stride,
+						   job->dest_stride);
+		else
+			v4lconvert_rgb565_to_rgb24(src, dest, job->width, rows,
+						   job->stride,
+						   job->dest_stride);
+		break;
+	case V4L_BAND_GREY:
+		v4lconvert_grey_to_rgb24(src, dest, job->width, rows,
+					 job->dest_stride);
+		break;
+	case V4L_BAND_Y16:
+		v4lconvert_y16_to_rgb24(src, dest, job->width, rows,
+					job->dest_stride, job->flag);
+		break;
+	case V4L_BAND_COPY24:
+		v4lconvert_copy_rect(dest, src, rows, job->width * 3,
+				     job->dest_stride, job->stride);
+		break;
+	case V4L_BAND_SWAP24:
+		v4lconvert_swap_rgb(src, dest, job->width, rows,
+				    job->dest_stride);
+		break;
+	case V4L_BAND_RGB32:
+		v4lconvert_rgb32_to_rgb24(src, dest, job->width, rows,
+					  job->dest_stride, job->flag);
+		break;
+	}
+}
+
+/* Returns 1 when the conversion was done here, 0 when the caller should
+   use the regular single threaded path (also on any kind of trouble, so
+   short frames etc. get reported by the code that already handles them) */
+int v4lconvert_bands_convert(struct v4lconvert_data *data, unsigned char *src,
+		int src_size, unsigned char *dest, struct v4l2_format *fmt,
+		unsigned int dest_pix_fmt, int dest_stride)
+{
+	struct v4lconvert_band_job job;
+	int width = fmt->fmt.pix.width;
+	int height = fmt->fmt.pix.height;
+	int bgr = dest_pix_fmt == V4L2_PIX_FMT_BGR24;
+	int min_size;
+
+	if (data->num_threads <= 1)
+		return 0;
+
+	if (dest_pix_fmt != V4L2_PIX_FMT_RGB24 &&
+	    dest_pix_fmt != V4L2_PIX_FMT_BGR24)
+		return 0;
+
+	if ((size_t)width * height < V4LCONVERT_BANDS_MIN_PIXELS ||
+	    height < 2 * data->num_threads)
+		return 0;
+
+	job.src = src;
+	job.dest = dest;
+	job.width = width;
+	job.dest_stride = dest_stride > 0 ? dest_stride : width * 3;
+	job.flag = bgr;
+
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_YUYV:
+		job.op = V4L_BAND_YUYV;
+		job.stride = fmt->fmt.pix.bytesperline;
+		min_size = width * height * 2;
+		break;
+	case V4L2_PIX_FMT_YVYU:
+		job.op = V4L_BAND_YVYU;
+		job.stride = fmt->fmt.pix.bytesperline;
+		min_size = width * height * 2;
+		break;
+	case V4L2_PIX_FMT_UYVY:
+		job.op = V4L_BAND_UYVY;
+		job.stride = fmt->fmt.pix.bytesperline;
+		min_size = width * height * 2;
+		break;
+	case V4L2_PIX_FMT_RGB565:
+		job.op = V4L_BAND_RGB565;
+		job.stride = fmt->fmt.pix.bytesperline;
+		min_size = width * height * 2;
+		break;
+	case V4L2_PIX_FMT_GREY:
+	case V4L2_PIX_FMT_Y4:
+	case V4L2_PIX_FMT_Y6:
+		job.op = V4L_BAND_GREY;
+		job.stride = width;
+		min_size = width * height;
+		break;
+	case V4L2_PIX_FMT_Y16:
+	case V4L2_PIX_FMT_Y16_BE:
+		job.op = V4L_BAND_Y16;
+		job.stride = width * 2;
+		job.flag = fmt->fmt.pix.pixelformat == V4L2_PIX_FMT_Y16;
+		min_size = width * height * 2;
+		break;
+	case V4L2_PIX_FMT_RGB24:
+		job.op = bgr ? V4L_BAND_SWAP24 : V4L_BAND_COPY24;
+		job.stride = width * 3;
+		min_size = width * height * 3;
+		break;
+	case V4L2_PIX_FMT_BGR24:
+		job.op = bgr ? V4L_BAND_COPY24 : V4L_BAND_SWAP24;
+		job.stride = width * 3;
+		min_size = width * height * 3;
+		break;
+	case V4L2_PIX_FMT_RGB32:
+	case V4L2_PIX_FMT_XRGB32:
+	case V4L2_PIX_FMT_ARGB32:
+		job.op = V4L_BAND_RGB32;
+		job.stride = width * 4;
+		job.src++;	/* skip the alpha / padding byte */
+		min_size = width * height * 4;
+		break;
+	case V4L2_PIX_FMT_BGR32:
+	case V4L2_PIX_FMT_XBGR32:
+	case V4L2_PIX_FMT_ABGR32:
+		job.op = V4L_BAND_RGB32;
+		job.stride = width * 4;
+		job.flag = !bgr;
+		min_size = width * height * 4;
+		break;
+	default:
+		return 0;
+	}
+
+	if (job.stride <= 0 || src_size < min_size)
+		return 0;
+
+	if (!data->threadpool) {
+		data->threadpool =
+			v4lconvert_threadpool_create(data->num_threads - 1);
+		if (!data->threadpool) {
+			data->num_threads = 1;
+			return 0;
+		}
+	}
+
+	v4lconvert_threadpool_run(data->threadpool, v4lconvert_band_func,
+				  &job, height, 2);
+	return 1;
+}
@@ -41,8 +41,295 @@
  * patterns.                                                  *
  **************************************************************/
 
+/*
+ * SIMD fast path for the interior rows of the bilinear demosaic below
+ * (SSSE3 on x86, NEON on ARM, selected at runtime).  The kernels compute
+ * exactly the same rounded sums as the scalar pair loops, so the output
+ * is bit identical; the first/last line, the first/last pixels of a row
+ * and odd tails are still done by the scalar code.  Note the demosaic
+ * walks the image with a three bayer-row window producing one output row
+ * at a time, so the working set already fits L1 and the win here is
+ * doing the neighbour averaging 8 pixel pairs at a time.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V4LCONVERT_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#ifdef V4LCONVERT_X86_SIMD
+
+/*
+ * Processes 8 bayer pixel pairs (48 output bytes) per iteration.  For
+ * each pair the scalar loop produces the 6 bytes
+ *
+ *	t0 t1 C0 | s0 C1 s1	(blue line, swapped roles on a red line)
+ *
+ * where t0/t1 are 4-neighbour averages, s0/s1 2-neighbour averages and
+ * C0/C1 the center bayer values.  These are computed in 16 bit lanes on
+ * the even/odd columns of the three input rows, merged pairwise into
+ * three vectors of 16 bit units and interleaved with pshufb.
+ */
+__attribute__((target("ssse3")))
+static const unsigned char *v4lconvert_bayer_line_ssse3(
+		const unsigned char *bayer, const unsigned char *bayer_end,
+		unsigned char **bgrp, unsigned int stride, int blue_line)
+{
+	unsigned char *bgr = *bgrp;
+	const __m128i lows = _mm_set1_epi16(0x00ff);
+	const __m128i two = _mm_set1_epi16(2);
+	const __m128i one = _mm_set1_epi16(1);
+	/* unit u of x/y/z goes to output unit 3u / 3u+1 / 3u+2 */
+	const __m128i mx0 = _mm_setr_epi8(0, 1, -1, -1, -1, -1, 2, 3,
+					  -1, -1, -1, -1, 4, 5, -1, -1);
+	const __m128i my0 = _mm_setr_epi8(-1, -1, 0, 1, -1, -1, -1, -1,
+					  2, 3, -1, -1, -1, -1, 4, 5);
+	const __m128i mz0 = _mm_setr_epi8(-1, -1, -1, -1, 0, 1, -1, -1,
+					  -1, -1, 2, 3, -1, -1, -1, -1);
+	const __m128i mx1 = _mm_setr_epi8(-1, -1, 6, 7, -1, -1, -1, -1,
+					  8, 9, -1, -1, -1, -1, 10, 11);
+	const __m128i my1 = _mm_setr_epi8(-1, -1, -1, -1, 6, 7, -1, -1,
+					  -1, -1, 8, 9, -1, -1, -1, -1);
+	const __m128i mz1 = _mm_setr_epi8(4, 5, -1, -1, -1, -1, 6, 7,
+					  -1, -1, -1, -1, 8, 9, -1, -1);
+	const __m128i mx2 = _mm_setr_epi8(-1, -1, -1, -1, 12, 13, -1, -1,
+					  -1, -1, 14, 15, -1, -1, -1, -1);
+	const __m128i my2 = _mm_setr_epi8(10, 11, -1, -1, -1, -1, 12, 13,
+					  -1, -1, -1, -1, 14, 15, -1, -1);
+	const __m128i mz2 = _mm_setr_epi8(-1, -1, 10, 11, -1, -1, -1, -1,
+					  12, 13, -1, -1, -1, -1, 14, 15);
+
+	for (; bayer + 16 <= bayer_end; bayer += 16) {
+		__m128i a0 = _mm_loadu_si128((const __m128i *)bayer);
+		__m128i a2 = _mm_loadu_si128((const __m128i *)(bayer + 2));
+		__m128i b0 = _mm_loadu_si128((const __m128i *)(bayer + stride));
+		__m128i b2 = _mm_loadu_si128((const __m128i *)(bayer + stride + 2));
+		__m128i c0 = _mm_loadu_si128((const __m128i *)(bayer + 2 * stride));
+		__m128i c2 = _mm_loadu_si128((const __m128i *)(bayer + 2 * stride + 2));
+		__m128i ae0 = _mm_and_si128(a0, lows);
+		__m128i ao0 = _mm_srli_epi16(a0, 8);
+		__m128i ae2 = _mm_and_si128(a2, lows);
+		__m128i be0 = _mm_and_si128(b0, lows);
+		__m128i bo0 = _mm_srli_epi16(b0, 8);
+		__m128i be2 = _mm_and_si128(b2, lows);
+		__m128i bo2 = _mm_srli_epi16(b2, 8);
+		__m128i ce0 = _mm_and_si128(c0, lows);
+		__m128i co0 = _mm_srli_epi16(c0, 8);
+		__m128i ce2 = _mm_and_si128(c2, lows);
+		__m128i t0, t1, s0, s1, x, y, z;
+
+		/* (corner sum + 2) >> 2 and (cross sum + 2) >> 2 */
+		t0 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(ae0, ae2),
+				_mm_add_epi16(_mm_add_epi16(ce0, ce2), two)), 2);
+		t1 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(ao0, be0),
+				_mm_add_epi16(_mm_add_epi16(be2, co0), two)), 2);
+		/* vertical resp. horizontal neighbour averages */
+		s0 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(ae2, ce2),
+				one), 1);
+		s1 = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(bo0, bo2),
+				one), 1);
+
+		if (blue_line) {
+			x = _mm_or_si128(t0, _mm_slli_epi16(t1, 8));
+			y = _mm_or_si128(bo0, _mm_slli_epi16(s0, 8));
+			z = _mm_or_si128(be2, _mm_slli_epi16(s1, 8));
+		} else {
+			x = _mm_or_si128(bo0, _mm_slli_epi16(t1, 8));
+			y = _mm_or_si128(t0, _mm_slli_epi16(s1, 8));
+			z = _mm_or_si128(be2, _mm_slli_epi16(s0, 8));
+		}
+
+		_mm_storeu_si128((__m128i *)bgr, _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(x, mx0),
+					     _mm_shuffle_epi8(y, my0)),
+				_mm_shuffle_epi8(z, mz0)));
+		_mm_storeu_si128((__m128i *)(bgr + 16), _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(x, mx1),
+					     _mm_shuffle_epi8(y, my1)),
+				_mm_shuffle_epi8(z, mz1)));
+		_mm_storeu_si128((__m128i *)(bgr + 32), _mm_or_si128(
+				_mm_or_si128(_mm_shuffle_epi8(x, mx2),
+					     _mm_shuffle_epi8(y, my2)),
+				_mm_shuffle_epi8(z, mz2)));
+		bgr += 48;
+	}
+
+	*bgrp = bgr;
+	return bayer;
+}
+
+/*
+ * Unpack kernels for the raw bayer 10/16 bit wire formats, 16 pixels per
+ * iteration.  Like the scalar loops below they may run in place on the
+ * source frame: the write pointer never catches up with the read pointer
+ * and loads happen before the store of each block.
+ */
+__attribute__((target("ssse3")))
+static unsigned long v4lconvert_bayer10p_to_bayer8_ssse3(
+		const unsigned char *bayer10p, unsigned char *bayer8,
+		unsigned long len)
+{
+	/* 4 high bytes out of every packed group of 5 */
+	const __m128i m0 = _mm_setr_epi8(0, 1, 2, 3, 5, 6, 7, 8,
+					 10, 11, 12, 13, -1, -1, -1, -1);
+	const __m128i m1 = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1,
+					 -1, -1, -1, -1, 11, 12, 13, 14);
+	unsigned long i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)bayer10p);
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(bayer10p + 4));
+
+		_mm_storeu_si128((__m128i *)(bayer8 + i),
+				 _mm_or_si128(_mm_shuffle_epi8(v0, m0),
+					      _mm_shuffle_epi8(v1, m1)));
+		bayer10p += 20;
+	}
+	return i;
+}
+
+__attribute__((target("ssse3")))
+static int v4lconvert_bayer16_to_bayer8_ssse3(const unsigned char *bayer16,
+		unsigned char *bayer8, int len, int shift)
+{
+	const __m128i lows = _mm_set1_epi16(0x00ff);
+	int i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i v0 = _mm_loadu_si128((const __m128i *)(bayer16 + 2 * i));
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(bayer16 + 2 * i + 16));
+
+		v0 = _mm_and_si128(_mm_srli_epi16(v0, shift), lows);
+		v1 = _mm_and_si128(_mm_srli_epi16(v1, shift), lows);
+		_mm_storeu_si128((__m128i *)(bayer8 + i),
+				 _mm_packus_epi16(v0, v1));
+	}
+	return i;
+}
+
+#endif /* V4LCONVERT_X86_SIMD */
+
+#ifdef V4LCONVERT_NEON_SIMD
+
+#ifdef __aarch64__
+static unsigned long v4lconvert_bayer10p_to_bayer8_neon(
+		const unsigned char *bayer10p, unsigned char *bayer8,
+		unsigned long len)
+{
+	/* 4 high bytes out of every packed group of 5, 255 selects zero */
+	const uint8x16_t m0 = { 0, 1, 2, 3, 5, 6, 7, 8,
+				10, 11, 12, 13, 255, 255, 255, 255 };
+	const uint8x16_t m1 = { 255, 255, 255, 255, 255, 255, 255, 255,
+				255, 255, 255, 255, 11, 12, 13, 14 };
+	unsigned long i;
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t v0 = vld1q_u8(bayer10p);
+		uint8x16_t v1 = vld1q_u8(bayer10p + 4);
+
+		vst1q_u8(bayer8 + i, vorrq_u8(vqtbl1q_u8(v0, m0),
+					      vqtbl1q_u8(v1, m1)));
+		bayer10p += 20;
+	}
+	return i;
+}
+#endif
+
+static int v4lconvert_bayer16_to_bayer8_neon(const unsigned char *bayer16,
+		unsigned char *bayer8, int len, int shift)
+{
+	int i;
+
+	if (shift == 8) {
+		for (i = 0; i + 16 <= len; i += 16)
+			vst1q_u8(bayer8 + i, vld2q_u8(bayer16 + 2 * i).val[1]);
+	} else {
+		for (i = 0; i + 16 <= len; i += 16) {
+			uint16x8_t v0 = vshrq_n_u16(
+					vld1q_u16((const uint16_t *)(const void *)
+						  (bayer16 + 2 * i)), 2);
+			uint16x8_t v1 = vshrq_n_u16(
+					vld1q_u16((const uint16_t *)(const void *)
+						  (bayer16 + 2 * i + 16)), 2);
+
+			vst1q_u8(bayer8 + i, vcombine_u8(vmovn_u16(v0),
+							 vmovn_u16(v1)));
+		}
+	}
+	return i;
+}
+
+static const unsigned char *v4lconvert_bayer_line_neon(
+		const unsigned char *bayer, const unsigned char *bayer_end,
+		unsigned char **bgrp, unsigned int stride, int blue_line)
+{
+	unsigned char *bgr = *bgrp;
+
+	for (; bayer + 16 <= bayer_end; bayer += 16) {
+		/* de-interleave the even / odd bayer columns of each row */
+		uint8x8x2_t a0 = vld2_u8(bayer);
+		uint8x8x2_t a2 = vld2_u8(bayer + 2);
+		uint8x8x2_t b0 = vld2_u8(bayer + stride);
+		uint8x8x2_t b2 = vld2_u8(bayer + stride + 2);
+		uint8x8x2_t c0 = vld2_u8(bayer + 2 * stride);
+		uint8x8x2_t c2 = vld2_u8(bayer + 2 * stride + 2);
+		uint16x8_t t0, t1, s0, s1;
+		uint16x8x3_t out;
+
+		t0 = vrshrq_n_u16(vaddq_u16(vaddl_u8(a0.val[0], a2.val[0]),
+				vaddl_u8(c0.val[0], c2.val[0])), 2);
+		t1 = vrshrq_n_u16(vaddq_u16(vaddl_u8(a0.val[1], b0.val[0]),
+				vaddl_u8(b2.val[0], c0.val[1])), 2);
+		s0 = vrshrq_n_u16(vaddl_u8(a2.val[0], c2.val[0]), 1);
+		s1 = vrshrq_n_u16(vaddl_u8(b0.val[1], b2.val[1]), 1);
+
+		if (blue_line) {
+			out.val[0] = vorrq_u16(t0, vshlq_n_u16(t1, 8));
+			out.val[1] = vorrq_u16(vmovl_u8(b0.val[1]),
+					       vshlq_n_u16(s0, 8));
+			out.val[2] = vorrq_u16(vmovl_u8(b2.val[0]),
+					       vshlq_n_u16(s1, 8));
+		} else {
+			out.val[0] = vorrq_u16(vmovl_u8(b0.val[1]),
+					       vshlq_n_u16(t1, 8));
+			out.val[1] = vorrq_u16(t0, vshlq_n_u16(s1, 8));
+			out.val[2] = vorrq_u16(vmovl_u8(b2.val[0]),
+					       vshlq_n_u16(s0, 8));
+		}
+
+		vst3q_u16((uint16_t *)(void *)bgr, out);
+		bgr += 48;
+	}
+
+	*bgrp = bgr;
+	return bayer;
+}
+
+#endif /* V4LCONVERT_NEON_SIMD */
+
+/* Demosaic whole pixel pairs of an interior row, returns where the
+   scalar code should pick up (borders and odd tails) */
+static const unsigned char *v4lconvert_bayer_line_simd(
+		const unsigned char *bayer, const unsigned char *bayer_end,
+		unsigned char **bgrp, unsigned int stride, int blue_line)
+{
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3)
+		return v4lconvert_bayer_line_ssse3(bayer, bayer_end, bgrp,
+						   stride, blue_line);
+#elif defined(V4LCONVERT_NEON_SIMD)
+	return v4lconvert_bayer_line_neon(bayer, bayer_end, bgrp,
+					  stride, blue_line);
+#endif
+	return bayer;
+}
+
 /* inspired by OpenCV's Bayer decoding */
-static void v4lconvert_border_bayer_line_to_bgr24(
+void v4lconvert_border_bayer_line_to_bgr24(
 		const unsigned char *bayer, const unsigned char *adjacent_bayer,
 		unsigned char *bgr, int width, const int start_with_green, const int blue_line)
 {
@@ -162,145 +449,158 @@ static void v4lconvert_border_bayer_line_to_bgr24(
 	}
 }
 
-/* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
-static void bayer_to_rgbbgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt,
+/* From libdc1394, which on turn was based on OpenCV's Bayer decoding.
+   Renders one interior destination row; bayer points at the source row
+   directly above it, with the two rows below at bayer + stride and
+   bayer + 2 * stride. */
+void v4lconvert_bayer_row_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, const unsigned int stride,
 		int start_with_green, int blue_line)
 {
-	/* render the first line */
-	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
-			start_with_green, blue_line);
-	bgr += width * 3;
-
-	/* reduce height by 2 because of the special case top/bottom line */
-	for (height -= 2; height; height--) {
-		int t0, t1;
-		/* (width - 2) because of the border */
-		const unsigned char *bayer_end = bayer + (width - 2);
-
-		if (start_with_green) {
+	int t0, t1;
+	/* (width - 2) because of the border */
+	const unsigned char *bayer_end = bayer + (width - 2);
 
-			t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
-			/* Write first pixel */
-			t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride];
-			} else {
-				*bgr++ = bayer[stride];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
+	if (start_with_green) {
 
-			/* Write second pixel */
-			t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-			} else {
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t0;
-			}
-			bayer++;
+		t0 = (bayer[1] + bayer[stride * 2 + 1] + 1) >> 1;
+		/* Write first pixel */
+		t1 = (bayer[0] + bayer[stride * 2] + bayer[stride + 1] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride];
 		} else {
-			/* Write first pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride];
-				*bgr++ = t0;
-			}
+			*bgr++ = bayer[stride];
+			*bgr++ = t1;
+			*bgr++ = t0;
 		}
 
+		/* Write second pixel */
+		t1 = (bayer[stride] + bayer[stride + 2] + 1) >> 1;
 		if (blue_line) {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t1;
-			}
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
 		} else {
-			for (; bayer <= bayer_end - 2; bayer += 2) {
-				t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
-					bayer[stride * 2 + 2] + 2) >> 2;
-				t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
-					bayer[stride * 2 + 1] + 2) >> 2;
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-
-				t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-				t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t0;
 		}
+		bayer++;
+	} else {
+		/* Write first pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride];
+			*bgr++ = t0;
+		}
+	}
 
-		if (bayer < bayer_end) {
-			/* write second to last pixel */
+	bayer = v4lconvert_bayer_line_simd(bayer, bayer_end, &bgr,
+					   stride, blue_line);
+
+	if (blue_line) {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
 			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
 				bayer[stride * 2 + 2] + 2) >> 2;
 			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
 				bayer[stride * 2 + 1] + 2) >> 2;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
-			/* write last pixel */
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+
 			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = bayer[stride + 2];
-				*bgr++ = t0;
-			}
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t1;
+		}
+	} else {
+		for (; bayer <= bayer_end - 2; bayer += 2) {
+			t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+				bayer[stride * 2 + 2] + 2) >> 2;
+			t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+				bayer[stride * 2 + 1] + 2) >> 2;
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
 
-			bayer++;
+			t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+			t1 = (bayer[stride + 1] + bayer[stride + 3] + 1) >> 1;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
+	}
 
+	if (bayer < bayer_end) {
+		/* write second to last pixel */
+		t0 = (bayer[0] + bayer[2] + bayer[stride * 2] +
+			bayer[stride * 2 + 2] + 2) >> 2;
+		t1 = (bayer[1] + bayer[stride] + bayer[stride + 2] +
+			bayer[stride * 2 + 1] + 2) >> 2;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
 		} else {
-			/* write last pixel */
-			t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
-			t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
-			if (blue_line) {
-				*bgr++ = t0;
-				*bgr++ = t1;
-				*bgr++ = bayer[stride + 1];
-			} else {
-				*bgr++ = bayer[stride + 1];
-				*bgr++ = t1;
-				*bgr++ = t0;
-			}
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
+		}
+		/* write last pixel */
+		t0 = (bayer[2] + bayer[stride * 2 + 2] + 1) >> 1;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = bayer[stride + 2];
+			*bgr++ = t0;
+		}
 
+		bayer++;
+
+	} else {
+		/* write last pixel */
+		t0 = (bayer[0] + bayer[stride * 2] + 1) >> 1;
+		t1 = (bayer[1] + bayer[stride * 2 + 1] + bayer[stride] + 1) / 3;
+		if (blue_line) {
+			*bgr++ = t0;
+			*bgr++ = t1;
+			*bgr++ = bayer[stride + 1];
+		} else {
+			*bgr++ = bayer[stride + 1];
+			*bgr++ = t1;
+			*bgr++ = t0;
 		}
 
-		/* skip 2 border pixels and padding */
-		bayer += (stride - width) + 2;
+	}
+}
 
+/* From libdc1394, which on turn was based on OpenCV's Bayer decoding */
+static void bayer_to_rgbbgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, int height, const unsigned int stride, int dest_stride, unsigned int pixfmt,
+		int start_with_green, int blue_line)
+{
+	/* render the first line */
+	v4lconvert_border_bayer_line_to_bgr24(bayer, bayer + stride, bgr, width,
+			start_with_green, blue_line);
+	bgr += dest_stride;
+
+	/* reduce height by 2 because of the special case top/bottom line */
+	for (height -= 2; height; height--) {
+		v4lconvert_bayer_row_to_bgr24(bayer, bgr, width, stride,
+				start_with_green, blue_line);
+		bgr += dest_stride;
+		bayer += stride;
 		blue_line = !blue_line;
 		start_with_green = !start_with_green;
 	}
@@ -311,9 +611,9 @@ static void bayer_to_rgbbgr24(const unsigned char *bayer,
 }
 
 void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+		unsigned char *bgr, int width, int height, const unsigned int stride, int dest_stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, dest_stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt != V4L2_PIX_FMT_SBGGR8		/* blue line */
@@ -321,9 +621,9 @@ void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
 }
 
 void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
-		unsigned char *bgr, int width, int height, const unsigned int stride, unsigned int pixfmt)
+		unsigned char *bgr, int width, int height, const unsigned int stride, int dest_stride, unsigned int pixfmt)
 {
-	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, pixfmt,
+	bayer_to_rgbbgr24(bayer, bgr, width, height, stride, dest_stride, pixfmt,
 			pixfmt == V4L2_PIX_FMT_SGBRG8		/* start with green */
 			|| pixfmt == V4L2_PIX_FMT_SGRBG8,
 			pixfmt == V4L2_PIX_FMT_SBGGR8		/* blue line */
@@ -635,20 +935,37 @@ void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 void v4lconvert_bayer10_to_bayer8(void *bayer10,
 		unsigned char *bayer8, int width, int height)
 {
-	int i;
+	int i = 0;
 	uint16_t *src = bayer10;
 
-	for (i = 0; i < width * height; i++)
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3)
+		i = v4lconvert_bayer16_to_bayer8_ssse3(bayer10, bayer8,
+				width * height, 2);
+#elif defined(V4LCONVERT_NEON_SIMD)
+	i = v4lconvert_bayer16_to_bayer8_neon(bayer10, bayer8,
+			width * height, 2);
+#endif
+	for (; i < width * height; i++)
 		bayer8[i] = src[i] >> 2;
 }
 
 void v4lconvert_bayer10p_to_bayer8(unsigned char *bayer10p,
 		unsigned char *bayer8, int width, int height)
 {
-	unsigned long i;
+	unsigned long i = 0;
 	unsigned long len = width * height;
 
-	for (i = 0; i < len ; i += 4) {
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3)
+		i = v4lconvert_bayer10p_to_bayer8_ssse3(bayer10p, bayer8, len);
+#elif defined(V4LCONVERT_NEON_SIMD) && defined(__aarch64__)
+	i = v4lconvert_bayer10p_to_bayer8_neon(bayer10p, bayer8, len);
+#endif
+	bayer10p += i / 4 * 5;
+	bayer8 += i;
+
+	for (; i < len ; i += 4) {
 		/*
 		 * Do not use a second loop, hoping that
 		 * a clever compiler with understand the
@@ -666,8 +983,16 @@ void v4lconvert_bayer10p_to_bayer8(unsigned char *bayer10p,
 void v4lconvert_bayer16_to_bayer8(unsigned char *bayer16,
 		unsigned char *bayer8, int width, int height)
 {
-	int i;
-
-	for (i = 0; i < width * height; i++)
+	int i = 0;
+
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3)
+		i = v4lconvert_bayer16_to_bayer8_ssse3(bayer16, bayer8,
+				width * height, 8);
+#elif defined(V4LCONVERT_NEON_SIMD)
+	i = v4lconvert_bayer16_to_bayer8_neon(bayer16, bayer8,
+			width * height, 8);
+#endif
+	for (; i < width * height; i++)
 		bayer8[i] = bayer16[2*i+1];
 }
@@ -0,0 +1,314 @@
+/*
+
+# Microbenchmark for the libv4lconvert conversion kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+/*
+ * Times the conversion routines from rgbyuv.c, bayer.c, flip.c and crop.c
+ * over a set of common resolutions and reports MB/s of source data
+ * processed, so kernel changes can be checked for regressions without a
+ * camera.  Not installed; build and run it from the build tree:
+ *
+ *	make bench-convert && ./bench-convert [-C] [seconds-per-case]
+ *
+ * -C emits one "benchmark,case,unit,value" line per measurement, for
+ * the top-level "make bench" results file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libv4lconvert-priv.h"
+
+static struct v4l2_format src_fmt, dest_fmt;
+static int csv;
+
+static void bench_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_yuyv_to_rgb24(src, dest, width, height, width * 2, width * 3);
+}
+
+static void bench_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_yuyv_to_bgr24(src, dest, width, height, width * 2, width * 3);
+}
+
+static void bench_yuyv_to_yuv420(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_yuyv_to_yuv420(src, dest, width, height, width * 2, 0);
+}
+
+static void bench_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_uyvy_to_rgb24(src, dest, width, height, width * 2, width * 3);
+}
+
+static void bench_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_yvyu_to_rgb24(src, dest, width, height, width * 2, width * 3);
+}
+
+static void bench_yuv420_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_yuv420_to_rgb24(src, dest, width, height, width, width * 3, 0);
+}
+
+static void bench_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_nv12_to_rgb24(src, dest, width, height, width, width * 3, 0);
+}
+
+static void bench_rgb24_to_yuv420(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_rgb24_to_yuv420(src, dest, &src_fmt, 0, 0, 3);
+}
+
+static void bench_swap_rgb(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_swap_rgb(src, dest, width, height, width * 3);
+}
+
+static void bench_rgb32_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_rgb32_to_rgb24(src, dest, width, height, width * 3, 0);
+}
+
+static void bench_rgb565_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_rgb565_to_rgb24(src, dest, width, height, width * 2, width * 3);
+}
+
+static void bench_grey_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_grey_to_rgb24(src, dest, width, height, width * 3);
+}
+
+static void bench_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_y16_to_rgb24(src, dest, width, height, width * 3, 1);
+}
+
+static void bench_bayer_to_rgb24(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_bayer_to_rgb24(src, dest, width, height, width, width * 3,
+			V4L2_PIX_FMT_SBGGR8);
+}
+
+static void bench_bayer_to_yuv420(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	v4lconvert_bayer_to_yuv420(src, dest, width, height, width,
+			V4L2_PIX_FMT_SBGGR8, 0);
+}
+
+static void bench_bayer10p_to_bayer8(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	/* runs in place on the source in the real pipeline, not here */
+	memcpy(dest, src, width * height * 5 / 4);
+	v4lconvert_bayer10p_to_bayer8(dest, dest, width, height);
+}
+
+static void bench_bayer16_to_bayer8(const unsigned char *src,
+		unsigned char *dest, int width, int height)
+{
+	memcpy(dest, src, width * height * 2);
+	v4lconvert_bayer16_to_bayer8(dest, dest, width, height);
+}
+
+static void bench_rotate90(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_rotate90((unsigned char *)src, dest, &src_fmt);
+}
+
+static void bench_flip(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_flip((unsigned char *)src, dest, &src_fmt, 1, 1);
+}
+
+static void bench_crop(const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	v4lconvert_crop((unsigned char *)src, dest, &src_fmt, &dest_fmt);
+}
+
+static const struct benchmark {
+	const char *name;
+	void (*run)(const unsigned char *src, unsigned char *dest,
+			int width, int height);
+	int src_bpp_num, src_bpp_den;	/* source bytes per pixel */
+	unsigned int src_pixfmt;	/* for the fmt based routines */
+} benchmarks[] = {
+	/* rgbyuv.c */
+	{ "yuyv_to_rgb24",       bench_yuyv_to_rgb24,       2, 1, 0 },
+	{ "yuyv_to_bgr24",       bench_yuyv_to_bgr24,       2, 1, 0 },
+	{ "yuyv_to_yuv420",      bench_yuyv_to_yuv420,      2, 1, 0 },
+	{ "uyvy_to_rgb24",       bench_uyvy_to_rgb24,       2, 1, 0 },
+	{ "yvyu_to_rgb24",       bench_yvyu_to_rgb24,       2, 1, 0 },
+	{ "yuv420_to_rgb24",     bench_yuv420_to_rgb24,     3, 2, 0 },
+	{ "nv12_to_rgb24",       bench_nv12_to_rgb24,       3, 2, 0 },
+	{ "rgb24_to_yuv420",     bench_rgb24_to_yuv420,     3, 1,
+						V4L2_PIX_FMT_RGB24 },
+	{ "swap_rgb",            bench_swap_rgb,            3, 1, 0 },
+	{ "rgb32_to_rgb24",      bench_rgb32_to_rgb24,      4, 1, 0 },
+	{ "rgb565_to_rgb24",     bench_rgb565_to_rgb24,     2, 1, 0 },
+	{ "grey_to_rgb24",       bench_grey_to_rgb24,       1, 1, 0 },
+	{ "y16_to_rgb24",        bench_y16_to_rgb24,        2, 1, 0 },
+	/* bayer.c */
+	{ "bayer_to_rgb24",      bench_bayer_to_rgb24,      1, 1, 0 },
+	{ "bayer_to_yuv420",     bench_bayer_to_yuv420,     1, 1, 0 },
+	{ "bayer10p_to_bayer8",  bench_bayer10p_to_bayer8,  5, 4, 0 },
+	{ "bayer16_to_bayer8",   bench_bayer16_to_bayer8,   2, 1, 0 },
+	/* flip.c */
+	{ "rotate90_rgb24",      bench_rotate90,            3, 1,
+						V4L2_PIX_FMT_RGB24 },
+	{ "flip_hv_rgb24",       bench_flip,                3, 1,
+						V4L2_PIX_FMT_RGB24 },
+	/* crop.c */
+	{ "crop_rgb24",          bench_crop,                3, 1,
+						V4L2_PIX_FMT_RGB24 },
+};
+
+static const struct resolution {
+	int width, height;
+} resolutions[] = {
+	{  640,  480 },
+	{ 1280,  720 },
+	{ 1920, 1080 },
+	{ 3840, 2160 },
+};
+
+#define ARRAY_ELEMS(x) ((int)(sizeof(x) / sizeof((x)[0])))
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void set_fmt(struct v4l2_format *fmt, unsigned int pixfmt,
+		int width, int height)
+{
+	memset(fmt, 0, sizeof(*fmt));
+	fmt->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	fmt->fmt.pix.width = width;
+	fmt->fmt.pix.height = height;
+	fmt->fmt.pix.pixelformat = pixfmt;
+	fmt->fmt.pix.bytesperline = width * 3;
+	fmt->fmt.pix.sizeimage = width * height * 3;
+}
+
+int main(int argc, char **argv)
+{
+	double seconds_per_case = 0.25;
+	unsigned char *src, *dest;
+	size_t bufsize;
+	int b, r, i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-C"))
+			csv = 1;
+		else
+			seconds_per_case = atof(argv[i]);
+	}
+	if (seconds_per_case <= 0) {
+		fprintf(stderr, "usage: bench-convert [-C] [seconds-per-case]\n");
+		return 1;
+	}
+
+	/* largest resolution at 4 bytes/pixel, destinations at 3 */
+	bufsize = (size_t)3840 * 2160 * 4;
+	src = malloc(bufsize);
+	dest = malloc(bufsize);
+	if (!src || !dest) {
+		fprintf(stderr, "bench-convert: out of memory\n");
+		return 1;
+	}
+	srand(1);
+	for (i = 0; (size_t)i < bufsize; i++)
+		src[i] = rand() & 0xff;
+
+	if (!csv) {
+		printf("%-20s", "");
+		for (r = 0; r < ARRAY_ELEMS(resolutions); r++)
+			printf("%6dx%-6d", resolutions[r].width,
+			       resolutions[r].height);
+		printf("\n");
+	}
+
+	for (b = 0; b < ARRAY_ELEMS(benchmarks); b++) {
+		const struct benchmark *bench = &benchmarks[b];
+
+		if (!csv)
+			printf("%-20s", bench->name);
+		for (r = 0; r < ARRAY_ELEMS(resolutions); r++) {
+			int width = resolutions[r].width;
+			int height = resolutions[r].height;
+			size_t frame_bytes = (size_t)width * height *
+				bench->src_bpp_num / bench->src_bpp_den;
+			double start, elapsed;
+			long frames = 0;
+
+			set_fmt(&src_fmt, bench->src_pixfmt, width, height);
+			set_fmt(&dest_fmt, bench->src_pixfmt, width, height);
+
+			/* warm up, then measure whole frames */
+			bench->run(src, dest, width, height);
+			start = now();
+			do {
+				bench->run(src, dest, width, height);
+				frames++;
+				elapsed = now() - start;
+			} while (elapsed < seconds_per_case);
+
+			if (csv)
+				printf("%s,%dx%d,MBps,%.1f\n", bench->name,
+				       width, height, frames * frame_bytes /
+				       elapsed / (1024 * 1024));
+			else
+				printf("%11.0f ", frames * frame_bytes /
+				       elapsed / (1024 * 1024));
+		}
+		if (!csv)
+			printf("   MB/s\n");
+	}
+
+	free(src);
+	free(dest);
+	return 0;
+}
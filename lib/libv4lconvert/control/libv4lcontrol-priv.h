@@ -26,6 +26,22 @@
 
 #define V4LCONTROL_SHM_SIZE 4096
 
+/* The shm segment is written and read concurrently by all processes using
+   the device without any kernel side synchronisation. Single values are
+   aligned words so individual loads and stores cannot tear, but readers
+   taking multiple values could see a mix of old and new ones when another
+   process is in the middle of updating several controls. A sequence counter
+   guards against this: writers make it odd for the duration of an update,
+   readers retry until they see an unchanged even value. Writers are
+   serialised by an flock() on the shm fd, which the kernel releases even
+   when a writer is killed mid-update; a counter left odd by such a death is
+   healed by the next writer, and readers bound their spin and fall back to
+   the old unsynchronised read so nobody ever hangs on it. The counter lives
+   in the *last* word of the segment, well past the control values, so that
+   the layout stays compatible with older libv4l versions; those never touch
+   the counter and simply keep today's unsynchronised behavior. */
+#define V4LCONTROL_SHM_SEQ_IDX (V4LCONTROL_SHM_SIZE / sizeof(unsigned int) - 1)
+
 #define V4LCONTROL_SUPPORTS_NEXT_CTRL 0x01
 #define V4LCONTROL_MEMORY_IS_MALLOCED 0x02
 
@@ -33,6 +49,7 @@ struct v4lcontrol_flags_info;
 
 struct v4lcontrol_data {
 	int fd;                   /* Device fd */
+	int shm_fd;               /* shm segment fd, kept open for flock() */
 	int bandwidth;            /* Connection bandwidth (0 = unknown) */
 	int flags;                /* Flags for this device */
 	int priv_flags;           /* Internal use only flags */
@@ -24,6 +24,7 @@
 #include <sys/sysmacros.h>
 #endif
 #include <sys/mman.h>
+#include <sys/file.h>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <ctype.h>
@@ -264,6 +265,9 @@ static const struct v4lcontrol_flags_info v4lcontrol_flags[] = {
 
 static const struct v4l2_queryctrl fake_controls[V4LCONTROL_COUNT];
 
+static void v4lcontrol_write_begin(struct v4lcontrol_data *data);
+static void v4lcontrol_write_end(struct v4lcontrol_data *data);
+
 static const char *asus_board_vendor[] = {
 	"ASUSTeK Computer Inc.",
 	"ASUSTeK Computer INC.",
@@ -587,6 +591,7 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 	}
 
 	data->fd = fd;
+	data->shm_fd = -1;
 	data->dev_ops = dev_ops;
 	data->dev_ops_priv = dev_ops_priv;
 
@@ -730,11 +735,14 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 		/* Retreive a pointer to the shm object */
 		data->shm_values = mmap(NULL, V4LCONTROL_SHM_SIZE, (PROT_READ | PROT_WRITE),
 				MAP_SHARED, shm_fd, 0);
-		close(shm_fd);
 
 		if (data->shm_values == MAP_FAILED) {
 			perror("libv4lcontrol: error shm mmap failed");
 			data->shm_values = NULL;
+			close(shm_fd);
+		} else {
+			/* Kept open: flock() on it serialises writers */
+			data->shm_fd = shm_fd;
 		}
 	} else
 		perror("libv4lcontrol: error creating shm segment failed");
@@ -757,6 +765,8 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 		/* Initialize the new shm object we created */
 		memset(data->shm_values, 0, V4LCONTROL_SHM_SIZE);
 
+		v4lcontrol_write_begin(data);
+
 		for (i = 0; i < V4LCONTROL_COUNT; i++)
 			data->shm_values[i] = fake_controls[i].default_value;
 
@@ -765,6 +775,8 @@ struct v4lcontrol_data *v4lcontrol_create(int fd, void *dev_ops_priv,
 
 		if (data->flags_info && data->flags_info->default_gamma)
 			data->shm_values[V4LCONTROL_GAMMA] = data->flags_info->default_gamma;
+
+		v4lcontrol_write_end(data);
 	}
 
 	return data;
@@ -782,6 +794,8 @@ void v4lcontrol_destroy(struct v4lcontrol_data *data)
 		else
 			munmap(data->shm_values, V4LCONTROL_SHM_SIZE);
 	}
+	if (data->shm_fd >= 0)
+		close(data->shm_fd);
 	free(data);
 }
 
@@ -901,6 +915,85 @@ int v4lcontrol_vidioc_queryctrl(struct v4lcontrol_data *data, void *arg)
 	return retval;
 }
 
+/* Seqlock over the shm values, see the comment in libv4lcontrol-priv.h.
+   Writers hold an flock() on the shm fd, so only one process updates at a
+   time and the kernel drops the lock if a writer dies mid-update; concurrent
+   sets from multiple processes remain last-write-wins. Readers must never
+   block on the counter: the spin is bounded and gives up into the old
+   unsynchronised read, since a writer killed between begin and end can
+   leave the counter odd. We use __sync_synchronize() rather then the newer
+   __atomic builtins as we still support quite old compilers. */
+#define V4LCONTROL_SEQ_MAX_SPIN 10000
+
+static unsigned int v4lcontrol_read_begin(struct v4lcontrol_data *data)
+{
+	volatile unsigned int *seq = &data->shm_values[V4LCONTROL_SHM_SEQ_IDX];
+	unsigned int val;
+	int spins = V4LCONTROL_SEQ_MAX_SPIN;
+
+	/* A writer only has a few word stores to do, so just spin; give
+	   up on a counter stuck odd by a writer that died mid-update */
+	while (((val = *seq) & 1) && --spins)
+		;
+
+	__sync_synchronize();
+	return val;
+}
+
+static int v4lcontrol_read_retry(struct v4lcontrol_data *data,
+		unsigned int start)
+{
+	volatile unsigned int *seq = &data->shm_values[V4LCONTROL_SHM_SEQ_IDX];
+
+	/* Gave up on a stuck counter: accept the unsynchronised read,
+	   which is all that older libv4l versions ever did */
+	if (start & 1)
+		return 0;
+
+	__sync_synchronize();
+	return *seq != start;
+}
+
+static void v4lcontrol_write_begin(struct v4lcontrol_data *data)
+{
+	volatile unsigned int *seq = &data->shm_values[V4LCONTROL_SHM_SEQ_IDX];
+
+	/* Fails only for the process local malloc fallback, where there
+	   is nothing to serialise against anyway */
+	if (data->shm_fd >= 0)
+		while (flock(data->shm_fd, LOCK_EX) && errno == EINTR)
+			;
+
+	/* (val + 1) | 1 is the next odd value, healing a counter left
+	   odd by a writer killed before write_end */
+	*seq = (*seq + 1) | 1;
+	__sync_synchronize();
+}
+
+static void v4lcontrol_write_end(struct v4lcontrol_data *data)
+{
+	volatile unsigned int *seq = &data->shm_values[V4LCONTROL_SHM_SEQ_IDX];
+
+	__sync_synchronize();
+	*seq = *seq + 1;
+
+	if (data->shm_fd >= 0)
+		flock(data->shm_fd, LOCK_UN);
+}
+
+/* Take a consistent snapshot of all shm values in one read section */
+static void v4lcontrol_snapshot_values(struct v4lcontrol_data *data,
+		unsigned int values[V4LCONTROL_COUNT])
+{
+	unsigned int seq;
+
+	do {
+		seq = v4lcontrol_read_begin(data);
+		memcpy(values, data->shm_values,
+				V4LCONTROL_COUNT * sizeof(unsigned int));
+	} while (v4lcontrol_read_retry(data, seq));
+}
+
 int v4lcontrol_vidioc_g_ctrl(struct v4lcontrol_data *data, void *arg)
 {
 	int i;
@@ -981,13 +1074,18 @@ int v4lcontrol_vidioc_g_ext_ctrls(struct v4lcontrol_data *data, void *arg)
 	if (res)
 		return res;
 
-	for (i = 0; i < ctrls->count; i++) {
-		for (j = 0; j < V4LCONTROL_COUNT; j++)
-			if ((data->controls & (1 << j)) &&
-			    ctrls->controls[i].id == fake_controls[j].id) {
-				ctrls->controls[i].value = data->shm_values[j];
-				break;
-			}
+	if (data->controls) {
+		unsigned int values[V4LCONTROL_COUNT];
+
+		v4lcontrol_snapshot_values(data, values);
+		for (i = 0; i < ctrls->count; i++) {
+			for (j = 0; j < V4LCONTROL_COUNT; j++)
+				if ((data->controls & (1 << j)) &&
+				    ctrls->controls[i].id == fake_controls[j].id) {
+					ctrls->controls[i].value = values[j];
+					break;
+				}
+		}
 	}
 	return 0;
 }
@@ -1006,7 +1104,9 @@ int v4lcontrol_vidioc_s_ctrl(struct v4lcontrol_data *data, void *arg)
 				return -1;
 			}
 
+			v4lcontrol_write_begin(data);
 			data->shm_values[i] = ctrl->value;
+			v4lcontrol_write_end(data);
 			return 0;
 		}
 
@@ -1069,6 +1169,7 @@ int v4lcontrol_vidioc_s_ext_ctrls(struct v4lcontrol_data *data, void *arg)
 	if (res)
 		return res;
 
+	v4lcontrol_write_begin(data);
 	for (i = 0; i < ctrls->count; i++) {
 		for (j = 0; j < V4LCONTROL_COUNT; j++)
 			if ((data->controls & (1 << j)) &&
@@ -1077,6 +1178,7 @@ int v4lcontrol_vidioc_s_ext_ctrls(struct v4lcontrol_data *data, void *arg)
 				break;
 			}
 	}
+	v4lcontrol_write_end(data);
 	return 0;
 }
 
@@ -1104,17 +1206,41 @@ int v4lcontrol_get_ctrl(struct v4lcontrol_data *data, int ctrl)
 	return 0;
 }
 
+int v4lcontrol_get_all_ctrls(struct v4lcontrol_data *data,
+		unsigned int values[V4LCONTROL_COUNT])
+{
+	if (!data->controls) {
+		memset(values, 0, V4LCONTROL_COUNT * sizeof(unsigned int));
+		return 0;
+	}
+
+	v4lcontrol_snapshot_values(data, values);
+
+	/* Special case for devices with flipped input */
+	if ((data->controls & (1 << V4LCONTROL_HFLIP)) &&
+			(data->flags & V4LCONTROL_HFLIPPED))
+		values[V4LCONTROL_HFLIP] = !values[V4LCONTROL_HFLIP];
+	if ((data->controls & (1 << V4LCONTROL_VFLIP)) &&
+			(data->flags & V4LCONTROL_VFLIPPED))
+		values[V4LCONTROL_VFLIP] = !values[V4LCONTROL_VFLIP];
+
+	return data->controls;
+}
+
 int v4lcontrol_controls_changed(struct v4lcontrol_data *data)
 {
+	unsigned int values[V4LCONTROL_COUNT];
 	int res;
 
 	if (!data->controls)
 		return 0;
 
-	res = memcmp(data->shm_values, data->old_values,
+	v4lcontrol_snapshot_values(data, values);
+
+	res = memcmp(values, data->old_values,
 			V4LCONTROL_COUNT * sizeof(unsigned int));
 
-	memcpy(data->old_values, data->shm_values,
+	memcpy(data->old_values, values,
 			V4LCONTROL_COUNT * sizeof(unsigned int));
 
 	return res;
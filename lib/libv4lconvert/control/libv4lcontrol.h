@@ -59,6 +59,13 @@ int v4lcontrol_get_bandwidth(struct v4lcontrol_data *data);
 /* Functions used by v4lprocessing to get the control state */
 int v4lcontrol_get_flags(struct v4lcontrol_data *data);
 int v4lcontrol_get_ctrl(struct v4lcontrol_data *data, int ctrl);
+/* Fill values[] with a consistent snapshot of all emulated controls in one
+   operation, so that callers polling several controls do not see a mix of
+   old and new values when another process is changing them. Entries for
+   controls which are not emulated for this device are set to 0. Returns the
+   mask of emulated controls (the same bits as used by v4lcontrol_get_ctrl). */
+int v4lcontrol_get_all_ctrls(struct v4lcontrol_data *data,
+		unsigned int values[V4LCONTROL_COUNT]);
 /* Check if the controls have changed since the last time this function
    was called */
 int v4lcontrol_controls_changed(struct v4lcontrol_data *data);
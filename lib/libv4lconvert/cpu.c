@@ -0,0 +1,55 @@
+/*
+
+# Runtime CPU capability detection for the SIMD conversion kernels
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include "libv4lconvert-priv.h"
+
+/*
+ * Returns the best instruction set level the CPU supports, resolved once
+ * on the first call (v4lconvert_create() does that up front so the hot
+ * conversion paths always hit the cached value).  The levels are
+ * cumulative per architecture: AVX2 implies SSSE3 implies SSE2.
+ */
+int v4lconvert_cpu_level(void)
+{
+	static int level = -1;
+
+	if (level >= 0)
+		return level;
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+	/* too old for reliable target attributes / __builtin_cpu_supports */
+	level = V4LCONVERT_CPU_SCALAR;
+#elif defined(__i386__) || defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		level = V4LCONVERT_CPU_AVX2;
+	else if (__builtin_cpu_supports("ssse3"))
+		level = V4LCONVERT_CPU_SSSE3;
+	else if (__builtin_cpu_supports("sse2"))
+		level = V4LCONVERT_CPU_SSE2;
+	else
+		level = V4LCONVERT_CPU_SCALAR;
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+	level = V4LCONVERT_CPU_NEON;
+#else
+	level = V4LCONVERT_CPU_SCALAR;
+#endif
+	return level;
+}
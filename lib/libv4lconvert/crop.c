@@ -20,9 +20,164 @@
 
  */
 
+#include <stdint.h>
 #include <string.h>
 #include "libv4lconvert-priv.h"
 
+/*
+ * Strided-copy engine for the pure rectangle-extraction paths below.
+ * Cropping a ROI out of a large frame is plain memory movement, but the
+ * per-line memcpy() calls are too short for libc to ever switch to
+ * non-temporal stores, so a multi-megapixel crop drags the whole source
+ * frame through the cache line by line.  The SSE2 kernel streams the
+ * destination rows with movntdq once the rectangle is large enough that
+ * it would trash the cache anyway; smaller crops and the head/tail of
+ * unaligned rows take the regular store path, which is also what the
+ * NEON kernel always uses (no non-temporal hint there).
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V4LCONVERT_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+/* Stream the destination instead of caching it once the rectangle
+   exceeds this many bytes */
+#define V4LCONVERT_COPY_RECT_STREAM_SIZE (1024 * 1024)
+
+#ifdef V4LCONVERT_X86_SIMD
+
+__attribute__((target("sse2")))
+static void v4lconvert_copy_rect_sse2(unsigned char *dest,
+		const unsigned char *src, int rows, int row_bytes,
+		int dest_stride, int src_stride, int stream)
+{
+	int y, x;
+
+	for (y = 0; y < rows; y++) {
+		const unsigned char *s = src;
+		unsigned char *d = dest;
+		int len = row_bytes;
+
+		/* align the stores; movntdq requires it and aligned
+		   regular stores are no worse */
+		x = (-(uintptr_t)d) & 15;
+		if (x) {
+			if (x > len)
+				x = len;
+			memcpy(d, s, x);
+			d += x;
+			s += x;
+			len -= x;
+		}
+
+		if (stream) {
+			for (; len >= 64; len -= 64, s += 64, d += 64) {
+				__m128i v0 = _mm_loadu_si128((const __m128i *)s);
+				__m128i v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+				__m128i v2 = _mm_loadu_si128((const __m128i *)(s + 32));
+				__m128i v3 = _mm_loadu_si128((const __m128i *)(s + 48));
+
+				_mm_stream_si128((__m128i *)d, v0);
+				_mm_stream_si128((__m128i *)(d + 16), v1);
+				_mm_stream_si128((__m128i *)(d + 32), v2);
+				_mm_stream_si128((__m128i *)(d + 48), v3);
+			}
+			for (; len >= 16; len -= 16, s += 16, d += 16)
+				_mm_stream_si128((__m128i *)d,
+						_mm_loadu_si128((const __m128i *)s));
+		} else {
+			for (; len >= 64; len -= 64, s += 64, d += 64) {
+				__m128i v0 = _mm_loadu_si128((const __m128i *)s);
+				__m128i v1 = _mm_loadu_si128((const __m128i *)(s + 16));
+				__m128i v2 = _mm_loadu_si128((const __m128i *)(s + 32));
+				__m128i v3 = _mm_loadu_si128((const __m128i *)(s + 48));
+
+				_mm_store_si128((__m128i *)d, v0);
+				_mm_store_si128((__m128i *)(d + 16), v1);
+				_mm_store_si128((__m128i *)(d + 32), v2);
+				_mm_store_si128((__m128i *)(d + 48), v3);
+			}
+			for (; len >= 16; len -= 16, s += 16, d += 16)
+				_mm_store_si128((__m128i *)d,
+						_mm_loadu_si128((const __m128i *)s));
+		}
+		if (len)
+			memcpy(d, s, len);
+
+		src += src_stride;
+		dest += dest_stride;
+	}
+	if (stream)
+		_mm_sfence();
+}
+
+#endif
+
+#ifdef V4LCONVERT_NEON_SIMD
+
+static void v4lconvert_copy_rect_neon(unsigned char *dest,
+		const unsigned char *src, int rows, int row_bytes,
+		int dest_stride, int src_stride)
+{
+	int y;
+
+	for (y = 0; y < rows; y++) {
+		const unsigned char *s = src;
+		unsigned char *d = dest;
+		int len = row_bytes;
+
+		for (; len >= 64; len -= 64, s += 64, d += 64) {
+			uint8x16_t v0 = vld1q_u8(s);
+			uint8x16_t v1 = vld1q_u8(s + 16);
+			uint8x16_t v2 = vld1q_u8(s + 32);
+			uint8x16_t v3 = vld1q_u8(s + 48);
+
+			vst1q_u8(d, v0);
+			vst1q_u8(d + 16, v1);
+			vst1q_u8(d + 32, v2);
+			vst1q_u8(d + 48, v3);
+		}
+		if (len)
+			memcpy(d, s, len);
+
+		src += src_stride;
+		dest += dest_stride;
+	}
+}
+
+#endif
+
+void v4lconvert_copy_rect(unsigned char *dest, const unsigned char *src,
+		int rows, int row_bytes, int dest_stride, int src_stride)
+{
+	int y;
+
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSE2 && row_bytes >= 64) {
+		v4lconvert_copy_rect_sse2(dest, src, rows, row_bytes,
+				dest_stride, src_stride,
+				(long)rows * row_bytes >=
+					V4LCONVERT_COPY_RECT_STREAM_SIZE);
+		return;
+	}
+#elif defined(V4LCONVERT_NEON_SIMD)
+	if (row_bytes >= 64) {
+		v4lconvert_copy_rect_neon(dest, src, rows, row_bytes,
+				dest_stride, src_stride);
+		return;
+	}
+#endif
+	for (y = 0; y < rows; y++) {
+		memcpy(dest, src, row_bytes);
+		src += src_stride;
+		dest += dest_stride;
+	}
+}
 
 static void v4lconvert_reduceandcrop_rgbbgr24(
 		unsigned char *src, unsigned char *dest,
@@ -49,17 +204,15 @@ static void v4lconvert_reduceandcrop_rgbbgr24(
 static void v4lconvert_crop_rgbbgr24(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
 {
-	int x;
 	int startx = (src_fmt->fmt.pix.width - dest_fmt->fmt.pix.width) / 2;
 	int starty = (src_fmt->fmt.pix.height - dest_fmt->fmt.pix.height) / 2;
 
 	src += starty * src_fmt->fmt.pix.bytesperline + 3 * startx;
 
-	for (x = 0; x < dest_fmt->fmt.pix.height; x++) {
-		memcpy(dest, src, dest_fmt->fmt.pix.width * 3);
-		src += src_fmt->fmt.pix.bytesperline;
-		dest += dest_fmt->fmt.pix.bytesperline;
-	}
+	v4lconvert_copy_rect(dest, src, dest_fmt->fmt.pix.height,
+			dest_fmt->fmt.pix.width * 3,
+			dest_fmt->fmt.pix.bytesperline,
+			src_fmt->fmt.pix.bytesperline);
 }
 
 static void v4lconvert_reduceandcrop_yuv420(
@@ -112,35 +265,36 @@ static void v4lconvert_reduceandcrop_yuv420(
 static void v4lconvert_crop_yuv420(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt)
 {
-	int x;
 	int startx = ((src_fmt->fmt.pix.width - dest_fmt->fmt.pix.width) / 2) & ~1;
 	int starty = ((src_fmt->fmt.pix.height - dest_fmt->fmt.pix.height) / 2) & ~1;
-	unsigned char *mysrc = src + starty * src_fmt->fmt.pix.bytesperline + startx;
 
 	/* Y */
-	for (x = 0; x < dest_fmt->fmt.pix.height; x++) {
-		memcpy(dest, mysrc, dest_fmt->fmt.pix.width);
-		mysrc += src_fmt->fmt.pix.bytesperline;
-		dest += dest_fmt->fmt.pix.bytesperline;
-	}
+	v4lconvert_copy_rect(dest,
+			src + starty * src_fmt->fmt.pix.bytesperline + startx,
+			dest_fmt->fmt.pix.height,
+			dest_fmt->fmt.pix.width,
+			dest_fmt->fmt.pix.bytesperline,
+			src_fmt->fmt.pix.bytesperline);
+	dest += dest_fmt->fmt.pix.height * dest_fmt->fmt.pix.bytesperline;
 
 	/* U */
-	mysrc = src + src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline +
-		(starty / 2) * src_fmt->fmt.pix.bytesperline / 2 + startx / 2;
-	for (x = 0; x < dest_fmt->fmt.pix.height / 2; x++) {
-		memcpy(dest, mysrc, dest_fmt->fmt.pix.width / 2);
-		mysrc += src_fmt->fmt.pix.bytesperline / 2;
-		dest += dest_fmt->fmt.pix.bytesperline / 2;
-	}
+	v4lconvert_copy_rect(dest,
+			src + src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline +
+				(starty / 2) * src_fmt->fmt.pix.bytesperline / 2 + startx / 2,
+			dest_fmt->fmt.pix.height / 2,
+			dest_fmt->fmt.pix.width / 2,
+			dest_fmt->fmt.pix.bytesperline / 2,
+			src_fmt->fmt.pix.bytesperline / 2);
+	dest += (dest_fmt->fmt.pix.height / 2) * (dest_fmt->fmt.pix.bytesperline / 2);
 
 	/* V */
-	mysrc = src + src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline * 5 / 4
-		+ (starty / 2) * src_fmt->fmt.pix.bytesperline / 2 + startx / 2;
-	for (x = 0; x < dest_fmt->fmt.pix.height / 2; x++) {
-		memcpy(dest, mysrc, dest_fmt->fmt.pix.width / 2);
-		mysrc += src_fmt->fmt.pix.bytesperline / 2;
-		dest += dest_fmt->fmt.pix.bytesperline / 2;
-	}
+	v4lconvert_copy_rect(dest,
+			src + src_fmt->fmt.pix.height * src_fmt->fmt.pix.bytesperline * 5 / 4 +
+				(starty / 2) * src_fmt->fmt.pix.bytesperline / 2 + startx / 2,
+			dest_fmt->fmt.pix.height / 2,
+			dest_fmt->fmt.pix.width / 2,
+			dest_fmt->fmt.pix.bytesperline / 2,
+			src_fmt->fmt.pix.bytesperline / 2);
 }
 
 /* Ok, so this is not really cropping, but more the reverse, whatever */
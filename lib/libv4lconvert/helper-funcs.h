@@ -29,6 +29,41 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* When started in shared-memory mode (an "shm" argument and the frame
+   buffers on fd 3) the data payloads live in the shared mapping and only
+   the ints of the protocol travel over the pipes. The first half of the
+   mapping is the compressed source frame, the second half the decompressed
+   destination frame. Returns the size of one half, or 0 when running in
+   plain pipe mode. */
+static int v4lconvert_helper_get_shm(int argc, char *argv[],
+  unsigned char **src_buf, unsigned char **dest_buf)
+{
+  struct stat st;
+  unsigned char *shm;
+
+  if (argc < 2 || strcmp(argv[1], "shm"))
+    return 0;
+
+  if (fstat(3, &st) || st.st_size <= 0) {
+    fprintf(stderr, "%s: error: bad shared memory fd: %s\n", argv[0],
+      strerror(errno));
+    exit(1);
+  }
+
+  shm = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, 3, 0);
+  if (shm == MAP_FAILED) {
+    fprintf(stderr, "%s: error: cannot map shared memory: %s\n", argv[0],
+      strerror(errno));
+    exit(1);
+  }
+
+  *src_buf = shm;
+  *dest_buf = shm + st.st_size / 2;
+  return st.st_size / 2;
+}
 
 static int v4lconvert_helper_write(int fd, const void *b, size_t count,
   char *progname)
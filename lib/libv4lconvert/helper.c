@@ -23,11 +23,18 @@
 #include <string.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include "libv4lconvert-priv.h"
 
 #define READ_END  0
 #define WRITE_END 1
 
+/* Size of one shared frame buffer, matching the helpers' static pipe-mode
+   buffers. The shared memory region holds two of these: source frame first,
+   destination frame second. The helper derives the split from the size of
+   the mapping itself, so this constant only lives here. */
+#define SHM_BUF_SIZE 500000
+
 /* <sigh> Unfortunately I've failed in contact some Authors of decompression
    code of out of tree drivers. So I've no permission to relicense their code
    their code from GPL to LGPL. To work around this, these decompression
@@ -46,9 +53,42 @@
    From the helper to libv4l the following is send:
    int			data length (-1 in case of a decompression error)
    unsigned char[]	data (not present when a decompression error happened)
- */
 
-static int v4lconvert_helper_start(struct v4lconvert_data *data,
+   When the helper is started in shared-memory mode (it gets an "shm"
+   argument and the frame buffers on fd 3) the data payloads above live in
+   the shared mapping instead and only the ints travel over the pipes. */
+
+/* Failure here is not fatal: we simply keep shipping the payloads over the
+   pipes as we've always done. */
+static void v4lconvert_helper_shm_start(struct v4lconvert_data *data)
+{
+#ifdef MFD_CLOEXEC
+	int fd;
+
+	if (data->decompress_shm) /* Still mapped from a previous run */
+		return;
+
+	fd = memfd_create("libv4lconvert-helper", MFD_CLOEXEC);
+	if (fd == -1)
+		return;
+
+	if (ftruncate(fd, 2 * SHM_BUF_SIZE)) {
+		close(fd);
+		return;
+	}
+
+	data->decompress_shm = mmap(NULL, 2 * SHM_BUF_SIZE,
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (data->decompress_shm == MAP_FAILED) {
+		data->decompress_shm = NULL;
+		close(fd);
+		return;
+	}
+	data->decompress_shm_fd = fd;
+#endif
+}
+
+int v4lconvert_helper_start(struct v4lconvert_data *data,
 		const char *helper)
 {
 	if (pipe(data->decompress_in_pipe)) {
@@ -61,6 +101,8 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 		goto error_close_in_pipe;
 	}
 
+	v4lconvert_helper_shm_start(data);
+
 	data->decompress_pid = fork();
 	if (data->decompress_pid == -1) {
 		V4LCONVERT_ERR("with helper fork: %s\n", strerror(errno));
@@ -84,6 +126,15 @@ static int v4lconvert_helper_start(struct v4lconvert_data *data,
 			exit(1);
 		}
 
+		/* Hand the shared frame buffers to the helper on fd 3 */
+		if (data->decompress_shm_fd != -1) {
+			if (dup2(data->decompress_shm_fd, 3) == -1) {
+				perror("libv4lconvert: error with helper dup2");
+				exit(1);
+			}
+			execl(helper, helper, "shm", NULL);
+		}
+
 		/* And execute the helper */
 		execl(helper, helper, NULL);
 
@@ -176,6 +227,17 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 			return -1;
 	}
 
+	/* With shared frame buffers the source frame must be in place before
+	   the ints below are sent, they double as the "frame ready" signal */
+	if (data->decompress_shm) {
+		if (src_size > SHM_BUF_SIZE) {
+			V4LCONVERT_ERR("shared frame buffer to small, need: %d\n",
+					src_size);
+			return -1;
+		}
+		memcpy(data->decompress_shm, src, src_size);
+	}
+
 	if (v4lconvert_helper_write(data, &width, sizeof(int)))
 		return -1;
 
@@ -188,7 +250,8 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 	if (v4lconvert_helper_write(data, &src_size, sizeof(int)))
 		return -1;
 
-	if (v4lconvert_helper_write(data, src, src_size))
+	if (!data->decompress_shm &&
+	    v4lconvert_helper_write(data, src, src_size))
 		return -1;
 
 	if (v4lconvert_helper_read(data, &r, sizeof(int)))
@@ -204,6 +267,15 @@ int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		return -1;
 	}
 
+	if (data->decompress_shm) {
+		if (r > SHM_BUF_SIZE) {
+			V4LCONVERT_ERR("invalid frame size from helper: %d\n", r);
+			return -1;
+		}
+		memcpy(dest, data->decompress_shm + SHM_BUF_SIZE, r);
+		return 0;
+	}
+
 	return v4lconvert_helper_read(data, dest, r);
 }
 
@@ -217,4 +289,13 @@ void v4lconvert_helper_cleanup(struct v4lconvert_data *data)
 		waitpid(data->decompress_pid, &status, 0);
 		data->decompress_pid = -1;
 	}
+
+	if (data->decompress_shm) {
+		munmap(data->decompress_shm, 2 * SHM_BUF_SIZE);
+		data->decompress_shm = NULL;
+	}
+	if (data->decompress_shm_fd != -1) {
+		close(data->decompress_shm_fd);
+		data->decompress_shm_fd = -1;
+	}
 }
@@ -73,8 +73,12 @@
 
 #include <stdint.h>
 #include "tinyjpeg-internal.h"
+#include "libv4lconvert-priv.h"
 
 #define FAST_FLOAT float
+/* jpeglib.h, included via libv4lconvert-priv.h, defines the same values */
+#undef DCTSIZE
+#undef DCTSIZE2
 #define DCTSIZE	   8
 #define DCTSIZE2   (DCTSIZE * DCTSIZE)
 
@@ -114,6 +118,152 @@ static inline unsigned char descale_and_clamp(int x, int shift)
 }
 #endif
 
+/*
+ * SSE2 version of the AA&N IDCT below: pass 1 runs the column butterflies
+ * on 4 columns per vector, pass 2 transposes the workspace and does the
+ * same for the rows, then descales/clamps with packs.  The arithmetic is
+ * the identical sequence of single precision operations per lane, so on
+ * machines doing scalar float math in SSE registers (any x86-64) the
+ * output matches the plain C code bit for bit.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <emmintrin.h>
+#endif
+
+#ifdef V4LCONVERT_X86_SIMD
+
+/* One half (4 lanes) of the 1-D AA&N butterfly, in0..in7 -> out0..out7 */
+#define IDCT_1D_SSE2(in0, in1, in2, in3, in4, in5, in6, in7, \
+		     out0, out1, out2, out3, out4, out5, out6, out7) do { \
+	__m128 tmp10, tmp11, tmp12, tmp13, tmp0_, tmp1_, tmp2_, tmp3_; \
+	__m128 z5, z10, z11, z12, z13, tmp4_, tmp5_, tmp6_, tmp7_; \
+	tmp10 = _mm_add_ps(in0, in4); \
+	tmp11 = _mm_sub_ps(in0, in4); \
+	tmp13 = _mm_add_ps(in2, in6); \
+	tmp12 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(in2, in6), c1414), tmp13); \
+	tmp0_ = _mm_add_ps(tmp10, tmp13); \
+	tmp3_ = _mm_sub_ps(tmp10, tmp13); \
+	tmp1_ = _mm_add_ps(tmp11, tmp12); \
+	tmp2_ = _mm_sub_ps(tmp11, tmp12); \
+	z13 = _mm_add_ps(in5, in3); \
+	z10 = _mm_sub_ps(in5, in3); \
+	z11 = _mm_add_ps(in1, in7); \
+	z12 = _mm_sub_ps(in1, in7); \
+	tmp7_ = _mm_add_ps(z11, z13); \
+	tmp11 = _mm_mul_ps(_mm_sub_ps(z11, z13), c1414); \
+	z5 = _mm_mul_ps(_mm_add_ps(z10, z12), c1847); \
+	tmp10 = _mm_sub_ps(_mm_mul_ps(c1082, z12), z5); \
+	tmp12 = _mm_add_ps(_mm_mul_ps(c2613, z10), z5); \
+	tmp6_ = _mm_sub_ps(tmp12, tmp7_); \
+	tmp5_ = _mm_sub_ps(tmp11, tmp6_); \
+	tmp4_ = _mm_add_ps(tmp10, tmp5_); \
+	out0 = _mm_add_ps(tmp0_, tmp7_); \
+	out7 = _mm_sub_ps(tmp0_, tmp7_); \
+	out1 = _mm_add_ps(tmp1_, tmp6_); \
+	out6 = _mm_sub_ps(tmp1_, tmp6_); \
+	out2 = _mm_add_ps(tmp2_, tmp5_); \
+	out5 = _mm_sub_ps(tmp2_, tmp5_); \
+	out4 = _mm_add_ps(tmp3_, tmp4_); \
+	out3 = _mm_sub_ps(tmp3_, tmp4_); \
+} while (0)
+
+#define TRANSPOSE4_EPI32(a, b, c, d, o0, o1, o2, o3) do { \
+	__m128i ab_lo = _mm_unpacklo_epi32(a, b); \
+	__m128i ab_hi = _mm_unpackhi_epi32(a, b); \
+	__m128i cd_lo = _mm_unpacklo_epi32(c, d); \
+	__m128i cd_hi = _mm_unpackhi_epi32(c, d); \
+	o0 = _mm_unpacklo_epi64(ab_lo, cd_lo); \
+	o1 = _mm_unpackhi_epi64(ab_lo, cd_lo); \
+	o2 = _mm_unpacklo_epi64(ab_hi, cd_hi); \
+	o3 = _mm_unpackhi_epi64(ab_hi, cd_hi); \
+} while (0)
+
+__attribute__((target("sse2")))
+static void tinyjpeg_idct_float_sse2(struct component *compptr,
+		uint8_t *output_buf, int stride)
+{
+	const __m128 c1414 = _mm_set1_ps((FAST_FLOAT) 1.414213562);
+	const __m128 c1847 = _mm_set1_ps((FAST_FLOAT) 1.847759065);
+	const __m128 c1082 = _mm_set1_ps((FAST_FLOAT) 1.082392200);
+	const __m128 c2613 = _mm_set1_ps((FAST_FLOAT) -2.613125930);
+	const __m128i rnd = _mm_set1_epi32(1 << 2);
+	const __m128i c128 = _mm_set1_epi32(128);
+	__m128 ws[8][2];	/* [row][column group] */
+	__m128 col[8][2];	/* transposed: [column][row group] */
+	int g, ctr;
+
+	/* Pass 1: dequantize and idct the columns, 4 at a time */
+	for (g = 0; g < 2; g++) {
+		__m128 in[8];
+
+		for (ctr = 0; ctr < 8; ctr++) {
+			__m128i c = _mm_loadl_epi64((const __m128i *)
+					(compptr->DCT + ctr * DCTSIZE + g * 4));
+
+			c = _mm_srai_epi32(_mm_unpacklo_epi16(c, c), 16);
+			in[ctr] = _mm_mul_ps(_mm_cvtepi32_ps(c),
+					_mm_loadu_ps(compptr->Q_table +
+						     ctr * DCTSIZE + g * 4));
+		}
+		IDCT_1D_SSE2(in[0], in[1], in[2], in[3],
+			     in[4], in[5], in[6], in[7],
+			     ws[0][g], ws[1][g], ws[2][g], ws[3][g],
+			     ws[4][g], ws[5][g], ws[6][g], ws[7][g]);
+	}
+
+	/* Transpose the 8x8 workspace so pass 2 can reuse the butterfly */
+	for (g = 0; g < 2; g++) {
+		int h;
+
+		for (h = 0; h < 2; h++) {
+			__m128 t0 = ws[h * 4 + 0][g];
+			__m128 t1 = ws[h * 4 + 1][g];
+			__m128 t2 = ws[h * 4 + 2][g];
+			__m128 t3 = ws[h * 4 + 3][g];
+
+			_MM_TRANSPOSE4_PS(t0, t1, t2, t3);
+			col[g * 4 + 0][h] = t0;
+			col[g * 4 + 1][h] = t1;
+			col[g * 4 + 2][h] = t2;
+			col[g * 4 + 3][h] = t3;
+		}
+	}
+
+	/* Pass 2: idct the rows (now in the lanes), descale and clamp */
+	for (g = 0; g < 2; g++) {
+		__m128 o[8];
+		__m128i oi[8], rlo[4], rhi[4];
+
+		IDCT_1D_SSE2(col[0][g], col[1][g], col[2][g], col[3][g],
+			     col[4][g], col[5][g], col[6][g], col[7][g],
+			     o[0], o[1], o[2], o[3], o[4], o[5], o[6], o[7]);
+
+		/* descale by 8 and bias like descale_and_clamp() */
+		for (ctr = 0; ctr < 8; ctr++)
+			oi[ctr] = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(
+					_mm_cvttps_epi32(o[ctr]), rnd), 3),
+					c128);
+
+		/* back to row order, pack with unsigned saturation, store */
+		TRANSPOSE4_EPI32(oi[0], oi[1], oi[2], oi[3],
+				 rlo[0], rlo[1], rlo[2], rlo[3]);
+		TRANSPOSE4_EPI32(oi[4], oi[5], oi[6], oi[7],
+				 rhi[0], rhi[1], rhi[2], rhi[3]);
+		for (ctr = 0; ctr < 4; ctr++) {
+			uint8_t *out = output_buf + (g * 4 + ctr) * stride;
+
+			_mm_storel_epi64((__m128i *)out, _mm_packus_epi16(
+					_mm_packs_epi32(rlo[ctr], rhi[ctr]),
+					_mm_setzero_si128()));
+		}
+	}
+}
+
+#endif /* V4LCONVERT_X86_SIMD */
+
 /*
  * Perform dequantization and inverse DCT on one block of coefficients.
  */
@@ -130,6 +280,13 @@ void tinyjpeg_idct_float(struct component *compptr, uint8_t *output_buf, int str
 	int ctr;
 	FAST_FLOAT workspace[DCTSIZE2]; /* buffers data between passes */
 
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSE2) {
+		tinyjpeg_idct_float_sse2(compptr, output_buf, stride);
+		return;
+	}
+#endif
+
 	/* Pass 1: process columns from input, store into work array. */
 
 	inptr = compptr->DCT;
@@ -188,9 +188,9 @@ static int decode_libjpeg_h_samp1(struct v4lconvert_data *data,
 	JSAMPROW y_rows[16], u_rows[8], v_rows[8];
 	JSAMPARRAY rows[3] = { y_rows, u_rows, v_rows };
 
-	uv_buf = v4lconvert_alloc_buffer(width * 16,
-					 &data->convert_pixfmt_buf,
-					 &data->convert_pixfmt_buf_size);
+	uv_buf = v4lconvert_scratch_buffer(data,
+					   V4LCONVERT_CONVERT_PIXFMT_BUF,
+					   width * 16);
 	if (!uv_buf)
 		return v4lconvert_oom_error(data);
 
@@ -337,7 +337,8 @@ int v4lconvert_decode_jpeg_libjpeg(struct v4lconvert_data *data,
 		jpeg_finish_decompress(&data->cinfo);
 #ifndef JCS_EXTENSIONS
 		if (dest_pix_fmt == V4L2_PIX_FMT_BGR24)
-			v4lconvert_swap_rgb(dest, dest, width, height);
+			v4lconvert_swap_rgb(dest, dest, width, height,
+					width * 3);
 #endif
 	} else {
 		int h_samp, v_samp;
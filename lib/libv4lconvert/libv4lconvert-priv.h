@@ -51,6 +51,15 @@
 #define V4LCONVERT_IS_UVC                0x01
 #define V4LCONVERT_USE_TINYJPEG          0x02
 
+/* Scratch buffers handed out by v4lconvert_scratch_buffer() */
+#define V4LCONVERT_CONVERT1_BUF		0
+#define V4LCONVERT_CONVERT2_BUF		1
+#define V4LCONVERT_ROTATE90_BUF		2
+#define V4LCONVERT_FLIP_BUF		3
+#define V4LCONVERT_CONVERT_PIXFMT_BUF	4
+#define V4LCONVERT_STRIDE_BUF		5
+#define V4LCONVERT_NUM_SCRATCH_BUFS	6
+
 struct v4lconvert_data {
 	int fd;
 	int flags; /* bitfield */
@@ -70,18 +79,23 @@ struct v4lconvert_data {
 	/* Bitmask of all supported src_formats which can do for a size */
 	int64_t framesize_supported_src_formats[V4LCONVERT_MAX_FRAMESIZES];
 	unsigned int no_framesizes;
+	/* Framesize probing is deferred from v4lconvert_create() to the
+	   first user of the framesizes cache, these are the indices into
+	   supported_src_pixfmts still to probe */
+	int framesizes_probed;
+	int no_probe_fmts;
+	unsigned char probe_fmts[128];
+	/* On-disk framesize-probe cache identity: driver + bus_info +
+	   driver version from QUERYCAP, empty when caching is off */
+	char framesize_cache_key[64];
 	int bandwidth;
 	int fps;
-	int convert1_buf_size;
-	int convert2_buf_size;
-	int rotate90_buf_size;
-	int flip_buf_size;
-	int convert_pixfmt_buf_size;
-	unsigned char *convert1_buf;
-	unsigned char *convert2_buf;
-	unsigned char *rotate90_buf;
-	unsigned char *flip_buf;
-	unsigned char *convert_pixfmt_buf;
+	/* Scratch buffer arena, all intermediate conversion buffers are
+	   carved out of one slab, see v4lconvert_scratch_buffer() */
+	unsigned char *scratch_slab;
+	int scratch_slab_size;
+	int scratch_off[V4LCONVERT_NUM_SCRATCH_BUFS];
+	int scratch_size[V4LCONVERT_NUM_SCRATCH_BUFS];
 	struct v4lcontrol_data *control;
 	struct v4lprocessing_data *processing;
 	void *dev_ops_priv;
@@ -91,12 +105,21 @@ struct v4lconvert_data {
 	pid_t decompress_pid;
 	int decompress_in_pipe[2];  /* Data from helper to us */
 	int decompress_out_pipe[2]; /* Data from us to helper */
+	int decompress_shm_fd;	    /* Shared frame buffers, -1 when on pipes */
+	unsigned char *decompress_shm;
 
 	/* For mr97310a decoder */
 	int frames_dropped;
 
 	/* For cpia1 decoder */
 	unsigned char *previous_frame;
+
+	/* Worker-thread pool for banded conversion, created on demand */
+	int num_threads;
+	struct v4lconvert_threadpool *threadpool;
+
+	/* Worker thread for submit / collect conversion, created on demand */
+	struct v4lconvert_pipeline *pipeline;
 };
 
 struct v4lconvert_pixfmt {
@@ -112,22 +135,25 @@ void v4lconvert_fixup_fmt(struct v4l2_format *fmt);
 unsigned char *v4lconvert_alloc_buffer(int needed,
 		unsigned char **buf, int *buf_size);
 
+unsigned char *v4lconvert_scratch_buffer(struct v4lconvert_data *data,
+		int buf, int needed);
+
 int v4lconvert_oom_error(struct v4lconvert_data *data);
 
 void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int bgr, int yvu, int bpp);
 
 void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride, int yvu);
+		int width, int height, int stride, int dest_stride, int yvu);
 
 void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride, int yvu);
+		int width, int height, int stride, int dest_stride, int yvu);
 
 void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_yuyv_to_yuv420(const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride, int yvu);
@@ -136,40 +162,40 @@ void v4lconvert_nv16_to_yuyv(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride);
 
 void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dst,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dst,
 		int width, int height, int stride, int yvu);
 
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
-		int width, int height);
+		int width, int height, int dest_stride);
 
 void v4lconvert_swap_uv(const unsigned char *src, unsigned char *dst,
 		const struct v4l2_format *src_fmt);
 
 void v4lconvert_grey_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height);
+		int width, int height, int dest_stride);
 
 void v4lconvert_grey_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt);
 
 void v4lconvert_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int little_endian);
+		int width, int height, int dest_stride, int little_endian);
 
 void v4lconvert_y16_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int little_endian);
 
 void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int bgr);
+		int width, int height, int dest_stride, int bgr);
 
 int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
 	const unsigned char *src, unsigned char *dest, int width, int height);
@@ -178,10 +204,10 @@ int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
 	const unsigned char *src, unsigned char *dest, int width, int height);
 
 void v4lconvert_rgb565_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_rgb565_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride);
+		int width, int height, int stride, int dest_stride);
 
 void v4lconvert_rgb565_to_yuv420(const unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, int yvu);
@@ -239,10 +265,41 @@ int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 		const unsigned char *inp, int src_size, unsigned char *outp,
 		int width, int height);
 
+/* Resumable row-at-a-time variants of the pac207 / mr97310a decoders,
+   used to fuse decompression with the bayer demosaic so only a small
+   strip of bayer rows is ever materialized */
+struct v4lconvert_pac207_row_decoder {
+	const unsigned char *inp;
+	const unsigned char *end;
+	unsigned short bad_header;
+};
+
+void v4lconvert_pac207_row_decoder_init(
+		struct v4lconvert_pac207_row_decoder *pac207,
+		const unsigned char *src, int src_size);
+
+int v4lconvert_pac207_decode_row(void *ctx, unsigned char *outp,
+		int width, int row);
+
 int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
 		const unsigned char *src, int src_size, unsigned char *dst,
 		int width, int height);
 
+struct v4lconvert_mr97310a_row_decoder {
+	const unsigned char *inp;
+	int bitpos;
+	int body_size;
+};
+
+void v4lconvert_mr97310a_row_decoder_init(
+		struct v4lconvert_mr97310a_row_decoder *mr97310a,
+		const unsigned char *src, int src_size);
+
+int v4lconvert_mr97310a_decode_row(void *ctx, unsigned char *outp,
+		int width, int row);
+
+int v4lconvert_mr97310a_handle_overrun(struct v4lconvert_data *data);
+
 int v4lconvert_decode_jl2005bcd(struct v4lconvert_data *data,
 		const unsigned char *src, int src_size,
 		unsigned char *dest, int width, int height);
@@ -257,14 +314,27 @@ void v4lconvert_decode_stv0680(const unsigned char *src, unsigned char *dst,
 		int width, int height);
 
 void v4lconvert_bayer_to_rgb24(const unsigned char *bayer,
-		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+		unsigned char *rgb, int width, int height, const unsigned int stride, int dest_stride, unsigned int pixfmt);
 
 void v4lconvert_bayer_to_bgr24(const unsigned char *bayer,
-		unsigned char *rgb, int width, int height, const unsigned int stride, unsigned int pixfmt);
+		unsigned char *rgb, int width, int height, const unsigned int stride, int dest_stride, unsigned int pixfmt);
 
 void v4lconvert_bayer_to_yuv420(const unsigned char *bayer, unsigned char *yuv,
 		int width, int height, const unsigned int stride, unsigned int src_pixfmt, int yvu);
 
+/* Per-row pieces of the bilinear demosaic, for fused decompress+demosaic
+   paths: the border variant renders the first (or, with the arguments
+   swapped and the flags inverted, the last) line from two bayer rows, the
+   row variant renders interior line y from bayer rows y-1 .. y+1 */
+void v4lconvert_border_bayer_line_to_bgr24(
+		const unsigned char *bayer, const unsigned char *adjacent_bayer,
+		unsigned char *bgr, int width, const int start_with_green,
+		const int blue_line);
+
+void v4lconvert_bayer_row_to_bgr24(const unsigned char *bayer,
+		unsigned char *bgr, int width, const unsigned int stride,
+		int start_with_green, int blue_line);
+
 void v4lconvert_bayer10_to_bayer8(void *bayer10,
 		unsigned char *bayer8, int width, int height);
 
@@ -274,20 +344,23 @@ void v4lconvert_bayer10p_to_bayer8(unsigned char *bayer10p,
 void v4lconvert_bayer16_to_bayer8(unsigned char *bayer16,
 		unsigned char *bayer8, int width, int height);
 
-void v4lconvert_nv12_16l16_to_rgb24(const unsigned char *src,
-		unsigned char *dst, int width, int height);
+void v4lconvert_nv12_16l16_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
+		int width, int height);
 
-void v4lconvert_nv12_16l16_to_bgr24(const unsigned char *src,
-		unsigned char *dst, int width, int height);
+void v4lconvert_nv12_16l16_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
+		int width, int height);
 
-void v4lconvert_nv12_16l16_to_yuv420(const unsigned char *src,
-		unsigned char *dst, int width, int height, int yvu);
+void v4lconvert_nv12_16l16_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dst,
+		int width, int height, int yvu);
 
 void v4lconvert_hsv_to_rgb24(const unsigned char *src, unsigned char *dest,
 		int width, int height, int bgr, int Xin, unsigned char hsv_enc);
 
 void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride, int bgr);
+		int width, int height, int stride, int dest_stride, int bgr);
 
 void v4lconvert_nv12_to_yuv420(const unsigned char *src, unsigned char *dest,
 		int width, int height, int stride, int yvu);
@@ -298,9 +371,48 @@ void v4lconvert_rotate90(unsigned char *src, unsigned char *dest,
 void v4lconvert_flip(unsigned char *src, unsigned char *dest,
 		struct v4l2_format *fmt, int hflip, int vflip);
 
+int v4lconvert_flip_crop_possible(const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt);
+
+void v4lconvert_flip_crop(unsigned char *src, unsigned char *dest,
+		const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt, int hflip, int vflip);
+
 void v4lconvert_crop(unsigned char *src, unsigned char *dest,
 		const struct v4l2_format *src_fmt, const struct v4l2_format *dest_fmt);
 
+/* Strided rectangle copy (SIMD accelerated, non temporal stores for large
+   copies), rows of row_bytes each */
+void v4lconvert_copy_rect(unsigned char *dest, const unsigned char *src,
+		int rows, int row_bytes, int dest_stride, int src_stride);
+
+struct v4lconvert_threadpool *v4lconvert_threadpool_create(int num_workers);
+
+void v4lconvert_threadpool_destroy(struct v4lconvert_threadpool *pool);
+
+void v4lconvert_threadpool_run(struct v4lconvert_threadpool *pool,
+		void (*func)(void *arg, int start_row, int rows), void *arg,
+		int height, int row_align);
+
+int v4lconvert_bands_convert(struct v4lconvert_data *data, unsigned char *src,
+		int src_size, unsigned char *dest, struct v4l2_format *fmt,
+		unsigned int dest_pix_fmt, int dest_stride);
+
+void v4lconvert_pipeline_destroy(struct v4lconvert_pipeline *pipeline);
+
+/* Cumulative CPU instruction set levels, see v4lconvert_cpu_level() */
+#define V4LCONVERT_CPU_SCALAR	0
+/* x86 */
+#define V4LCONVERT_CPU_SSE2	1
+#define V4LCONVERT_CPU_SSSE3	2
+#define V4LCONVERT_CPU_AVX2	3
+/* arm */
+#define V4LCONVERT_CPU_NEON	10
+
+int v4lconvert_cpu_level(void);
+
+int v4lconvert_helper_start(struct v4lconvert_data *data, const char *helper);
+
 int v4lconvert_helper_decompress(struct v4lconvert_data *data,
 		const char *helper, const unsigned char *src, int src_size,
 		unsigned char *dest, int dest_size, int width, int height, int command);
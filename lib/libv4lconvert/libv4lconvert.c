@@ -22,6 +22,7 @@
 #include <config.h>
 #endif
 #include <errno.h>
+#include <limits.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -30,6 +31,7 @@
 #include "libv4lconvert.h"
 #include "libv4lconvert-priv.h"
 #include "libv4lsyscall-priv.h"
+#include "../v4l-trace.h"
 
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
 #define BIT_MASK(nr) (1UL << ((nr) % BITS_PER_LONG))
@@ -96,6 +98,7 @@ const struct libv4l_dev_ops *v4lconvert_get_default_dev_ops()
 
 static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 		unsigned int pixelformat, int index);
+static void v4lconvert_probe_framesizes(struct v4lconvert_data *data);
 
 /*
  * Notes:
@@ -220,6 +223,9 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	int i, j;
 	struct v4lconvert_data *data = calloc(1, sizeof(struct v4lconvert_data));
 	struct v4l2_capability cap;
+#ifdef HAVE_LIBV4LCONVERT_HELPERS
+	const char *helper = NULL;
+#endif
 	/*
 	 * This keeps tracks of device-specific formats for which apps most
 	 * likely don't know. If all a driver can offer are proprietary
@@ -238,7 +244,14 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 	data->dev_ops = dev_ops;
 	data->dev_ops_priv = dev_ops_priv;
 	data->decompress_pid = -1;
+	data->decompress_shm_fd = -1;
 	data->fps = 30;
+	data->num_threads = 1;
+	/* resolve the SIMD dispatch level before the first frame */
+	v4lconvert_cpu_level();
+	if (getenv("LIBV4LCONVERT_THREADS"))
+		v4lconvert_set_num_threads(data,
+				atoi(getenv("LIBV4LCONVERT_THREADS")));
 
 	/* Check supported formats */
 	for (i = 0; ; i++) {
@@ -256,18 +269,50 @@ struct v4lconvert_data *v4lconvert_create_with_dev_ops(int fd, void *dev_ops_pri
 
 		if (j < ARRAY_SIZE(supported_src_pixfmts)) {
 			set_bit(j, data->supported_src_formats);
-			v4lconvert_get_framesizes(data, fmt.pixelformat, j);
+			/* Enumerating the framesizes for every format costs a
+			   lot of ioctls on devices with many formats, defer it
+			   until some caller actually needs them so that
+			   v4l2_open() stays cheap */
+			data->probe_fmts[data->no_probe_fmts++] = j;
 			if (!supported_src_pixfmts[j].needs_conversion)
 				always_needs_conversion = 0;
 		} else
 			always_needs_conversion = 0;
+
+#ifdef HAVE_LIBV4LCONVERT_HELPERS
+		if (fmt.pixelformat == V4L2_PIX_FMT_OV511)
+			helper = LIBV4LCONVERT_PRIV_DIR "/ov511-decomp";
+		else if (fmt.pixelformat == V4L2_PIX_FMT_OV518)
+			helper = LIBV4LCONVERT_PRIV_DIR "/ov518-decomp";
+#endif
 	}
 
 	data->no_formats = i;
 
+#ifdef HAVE_LIBV4LCONVERT_HELPERS
+	/* Pre-spawn the external decompression helper so the fork + exec
+	   latency is not paid on the first captured frame. Failure is not
+	   fatal, v4lconvert_helper_decompress() will retry lazily. */
+	if (helper)
+		v4lconvert_helper_start(data, helper);
+#endif
+
 	/* Check if this cam has any special flags */
 	if (data->dev_ops->ioctl(data->dev_ops_priv, data->fd,
 			VIDIOC_QUERYCAP, &cap) == 0) {
+		char *p;
+
+		/* Identity for the on-disk framesize-probe cache; the
+		   driver version changing (kernel / firmware update)
+		   invalidates old entries by changing the file name */
+		snprintf(data->framesize_cache_key,
+				sizeof(data->framesize_cache_key),
+				"%.15s-%.31s-%08x", (char *)cap.driver,
+				(char *)cap.bus_info, cap.version);
+		for (p = data->framesize_cache_key; *p; p++)
+			if (*p == '/' || *p == ' ')
+				*p = '-';
+
 		if (!strcmp((char *)cap.driver, "uvcvideo"))
 			data->flags |= V4LCONVERT_IS_UVC;
 
@@ -303,6 +348,8 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 	if (!data)
 		return;
 
+	/* first, so the pipeline worker cannot be using data anymore */
+	v4lconvert_pipeline_destroy(data->pipeline);
 	v4lprocessing_destroy(data->processing);
 	v4lcontrol_destroy(data->control);
 	if (data->tinyjpeg) {
@@ -318,11 +365,8 @@ void v4lconvert_destroy(struct v4lconvert_data *data)
 #ifdef HAVE_LIBV4LCONVERT_HELPERS
 	v4lconvert_helper_cleanup(data);
 #endif
-	free(data->convert1_buf);
-	free(data->convert2_buf);
-	free(data->rotate90_buf);
-	free(data->flip_buf);
-	free(data->convert_pixfmt_buf);
+	v4lconvert_threadpool_destroy(data->threadpool);
+	free(data->scratch_slab);
 	free(data->previous_frame);
 	free(data);
 }
@@ -457,6 +501,8 @@ static int v4lconvert_do_try_format_uvc(struct v4lconvert_data *data,
 	int best_format = 0;
 	int best_rank = 100;
 
+	v4lconvert_probe_framesizes(data);
+
 	for (i = 0; i < data->no_framesizes; i++) {
 		if (data->framesizes[i].discrete.width <= dest_fmt->fmt.pix.width &&
 				data->framesizes[i].discrete.height <= dest_fmt->fmt.pix.height) {
@@ -768,6 +814,70 @@ unsigned char *v4lconvert_alloc_buffer(int needed,
 	return *buf;
 }
 
+/* Round scratch buffer sizes up so that small differences between frames
+   (e.g. bytesperline changes) do not cause arena churn */
+#define V4LCONVERT_SCRATCH_ROUND 4096
+
+/* All intermediate conversion buffers are carved out of one slab owned by
+   data, so that format renegotiation on long running streams grows /
+   reuses a single allocation instead of fragmenting the heap with 5
+   separate ones. Buffers never shrink, the slab is the high-water mark of
+   what a stream actually needed; v4lconvert_trim_scratch() releases it.
+
+   Note growing one buffer may move the whole slab and thereby pointers
+   previously handed out for the other buffers, so any buffer which must
+   stay put across a call that can grow the arena has to be reserved
+   before taking pointers (see v4lconvert_convert()). Re-requesting an
+   already reserved size never moves anything. */
+unsigned char *v4lconvert_scratch_buffer(struct v4lconvert_data *data,
+		int buf, int needed)
+{
+	unsigned char *new_slab;
+	int i, tail, delta;
+
+	needed = (needed + V4LCONVERT_SCRATCH_ROUND - 1) &
+		 ~(V4LCONVERT_SCRATCH_ROUND - 1);
+	if (needed <= data->scratch_size[buf])
+		return data->scratch_slab + data->scratch_off[buf];
+
+	delta = needed - data->scratch_size[buf];
+	new_slab = realloc(data->scratch_slab,
+			   data->scratch_slab_size + delta);
+	if (!new_slab)
+		return NULL;
+
+	/* Shift the buffers that live above the grown one */
+	tail = data->scratch_off[buf] + data->scratch_size[buf];
+	memmove(new_slab + tail + delta, new_slab + tail,
+		data->scratch_slab_size - tail);
+
+	data->scratch_slab = new_slab;
+	data->scratch_slab_size += delta;
+	data->scratch_size[buf] = needed;
+	for (i = buf + 1; i < V4LCONVERT_NUM_SCRATCH_BUFS; i++)
+		data->scratch_off[i] += delta;
+
+	return data->scratch_slab + data->scratch_off[buf];
+}
+
+int v4lconvert_get_scratch_size(struct v4lconvert_data *data)
+{
+	return data->scratch_slab_size;
+}
+
+void v4lconvert_trim_scratch(struct v4lconvert_data *data)
+{
+	int i;
+
+	free(data->scratch_slab);
+	data->scratch_slab = NULL;
+	data->scratch_slab_size = 0;
+	for (i = 0; i < V4LCONVERT_NUM_SCRATCH_BUFS; i++) {
+		data->scratch_off[i] = 0;
+		data->scratch_size[i] = 0;
+	}
+}
+
 int v4lconvert_oom_error(struct v4lconvert_data *data)
 {
 	V4LCONVERT_ERR("could not allocate memory\n");
@@ -775,15 +885,187 @@ int v4lconvert_oom_error(struct v4lconvert_data *data)
 	return -1;
 }
 
+/* Strip depth of the fused decompress+demosaic path below. Must be at
+   least 3 (the demosaic window) and is kept small so the strip stays in
+   L1: 18 rows of 640 wide bayer data is under 12 kB. */
+#define V4LCONVERT_BAYER_FUSE_ROWS 16
+
+/* Fused decompress+demosaic: row_decode produces one bayer row per call
+   into a strip of V4LCONVERT_BAYER_FUSE_ROWS + 2 rows and each completed
+   row is immediately demosaiced to rgb/bgr24, so the bayer data never
+   leaves L1 and no full size intermediate buffer is touched. The two
+   extra rows hold copies of the last two decoded rows across strip
+   wrap arounds, both for the three row demosaic window and for the
+   decoders' same-color predictors which reach back two rows.
+
+   Returns 0 on success, the row_decode error (< 0) when decoding fails;
+   errno/error reporting is left to the caller, which also provides the
+   strip of V4LCONVERT_BAYER_FUSE_ROWS + 2 rows. Must not be used when
+   v4lprocessing is active, as processing operates on the full bayer
+   frame this path never builds. */
+static int v4lconvert_bayer_fused_to_rgbbgr24(
+	int (*row_decode)(void *ctx, unsigned char *outp, int width, int row),
+	void *ctx, unsigned char *strip, unsigned char *dest,
+	int width, int height, int dest_stride, unsigned int bayer_pixfmt,
+	int bgr)
+{
+	int start_with_green = bayer_pixfmt == V4L2_PIX_FMT_SGBRG8 ||
+			       bayer_pixfmt == V4L2_PIX_FMT_SGRBG8;
+	int blue_line;
+	int strip_rows = V4LCONVERT_BAYER_FUSE_ROWS + 2;
+	int row, cur, err;
+
+	if (bgr)
+		blue_line = bayer_pixfmt == V4L2_PIX_FMT_SBGGR8 ||
+			    bayer_pixfmt == V4L2_PIX_FMT_SGBRG8;
+	else
+		blue_line = bayer_pixfmt != V4L2_PIX_FMT_SBGGR8 &&
+			    bayer_pixfmt != V4L2_PIX_FMT_SGBRG8;
+
+	/* Rows r - 2 and r - 1 always sit directly above row r's slot */
+	cur = 2;
+	for (row = 0; row < height; row++) {
+		unsigned char *outp = strip + cur * width;
+
+		err = row_decode(ctx, outp, width, row);
+		if (err)
+			return err;
+
+		if (row == 1) {
+			/* rows 0 and 1 are in, render the top border line */
+			v4lconvert_border_bayer_line_to_bgr24(outp - width,
+					outp, dest, width,
+					start_with_green, blue_line);
+			dest += dest_stride;
+		} else if (row >= 2) {
+			/* row r completes the window for interior line r-1 */
+			v4lconvert_bayer_row_to_bgr24(outp - 2 * width, dest,
+					width, width,
+					start_with_green, blue_line);
+			dest += dest_stride;
+			blue_line = !blue_line;
+			start_with_green = !start_with_green;
+		}
+
+		cur++;
+		if (cur == strip_rows) {
+			memcpy(strip, strip + (strip_rows - 2) * width,
+					2 * width);
+			cur = 2;
+		}
+	}
+
+	/* render the bottom border line */
+	v4lconvert_border_bayer_line_to_bgr24(strip + (cur - 1) * width,
+			strip + (cur - 2) * width, dest, width,
+			!start_with_green, !blue_line);
+
+	return 0;
+}
+
+/* Can convert_pixfmt() below write RGB24 / BGR24 output with a padded
+   line stride directly for this source format? */
+static int v4lconvert_pixfmt_can_stride_rgb(unsigned int src_pix_fmt)
+{
+	switch (src_pix_fmt) {
+	case V4L2_PIX_FMT_MJPEG:
+	case V4L2_PIX_FMT_JPEG:
+	case V4L2_PIX_FMT_PJPG:
+	case V4L2_PIX_FMT_JPGL:
+	case V4L2_PIX_FMT_NV12_16L16:
+	case V4L2_PIX_FMT_SE401:
+	case V4L2_PIX_FMT_Y10BPACK:
+	case V4L2_PIX_FMT_HSV24:
+	case V4L2_PIX_FMT_HSV32:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+/* Make fmt reflect a padded destination line stride (bytesperline is the
+   luma stride for the planar yuv formats, chroma lines use half of it,
+   matching v4lconvert_crop()) */
+static void v4lconvert_fixup_stride(struct v4l2_format *fmt, int out_stride)
+{
+	if (!out_stride)
+		return;
+
+	fmt->fmt.pix.bytesperline = out_stride;
+	switch (fmt->fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		fmt->fmt.pix.sizeimage = out_stride * fmt->fmt.pix.height;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		fmt->fmt.pix.sizeimage =
+			out_stride * fmt->fmt.pix.height * 3 / 2;
+		break;
+	}
+}
+
 static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	unsigned char *src, int src_size, unsigned char *dest, int dest_size,
-	struct v4l2_format *fmt, unsigned int dest_pix_fmt)
+	struct v4l2_format *fmt, unsigned int dest_pix_fmt, int dest_stride)
 {
 	int result = 0;
 	unsigned int src_pix_fmt = fmt->fmt.pix.pixelformat;
 	unsigned int width  = fmt->fmt.pix.width;
 	unsigned int height = fmt->fmt.pix.height;
 	unsigned int bytesperline = fmt->fmt.pix.bytesperline;
+	unsigned char *repack_dest = NULL;
+	int rgb_stride = width * 3;
+	int out_stride = 0;
+
+	/* A dest_stride larger than a packed line (GPU upload, encoder
+	   alignment, ...) is written directly by the RGB24 / BGR24 kernels;
+	   the remaining conversions go packed into a scratch buffer and the
+	   rows are repacked once while copying out, which is still one full
+	   frame copy less than the caller restriding packed output itself. */
+	if (dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
+			dest_pix_fmt == V4L2_PIX_FMT_BGR24) {
+		if (dest_stride > (int)(width * 3)) {
+			out_stride = dest_stride;
+			if (v4lconvert_pixfmt_can_stride_rgb(src_pix_fmt))
+				rgb_stride = dest_stride;
+			else
+				repack_dest = dest;
+		}
+	} else {
+		if (dest_stride > (int)width && !(dest_stride & 1)) {
+			out_stride = dest_stride;
+			repack_dest = dest;
+		}
+	}
+
+	if (v4lconvert_bands_convert(data, src, src_size, dest, fmt,
+				     dest_pix_fmt, rgb_stride)) {
+		fmt->fmt.pix.pixelformat = dest_pix_fmt;
+		v4lconvert_fixup_fmt(fmt);
+		v4lconvert_fixup_stride(fmt, out_stride);
+		return 0;
+	}
+
+	if (repack_dest) {
+		int packed_size = dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
+				dest_pix_fmt == V4L2_PIX_FMT_BGR24 ?
+			width * height * 3 : width * height * 3 / 2;
+
+		/* Reserve the conversion buffer too before taking a pointer,
+		   growing the arena for it mid conversion would move ours
+		   (see the scratch buffer comment in v4lconvert_convert) */
+		if (!v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT_PIXFMT_BUF,
+				width * height * 3) ||
+		    !v4lconvert_scratch_buffer(data, V4LCONVERT_STRIDE_BUF,
+				packed_size))
+			return v4lconvert_oom_error(data);
+
+		dest = v4lconvert_scratch_buffer(data, V4LCONVERT_STRIDE_BUF,
+				packed_size);
+		dest_size = packed_size;
+	}
 
 	switch (src_pix_fmt) {
 	/* JPG and variants */
@@ -839,8 +1121,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 
 		if (dest_pix_fmt != V4L2_PIX_FMT_YUV420 &&
 				dest_pix_fmt != V4L2_PIX_FMT_YVU420) {
-			d = v4lconvert_alloc_buffer(width * height * 3 / 2,
-					&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
+			d = v4lconvert_scratch_buffer(data,
+					V4LCONVERT_CONVERT_PIXFMT_BUF,
+					width * height * 3 / 2);
 			if (!d)
 				return v4lconvert_oom_error(data);
 			d_size = width * height * 3 / 2;
@@ -904,12 +1187,14 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuv420_to_rgb24(data->convert_pixfmt_buf, dest, width,
-					height, bytesperline, yvu);
+			v4lconvert_yuv420_to_rgb24(d, dest, width,
+					height, bytesperline, rgb_stride,
+					yvu);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuv420_to_bgr24(data->convert_pixfmt_buf, dest, width,
-					height, bytesperline, yvu);
+			v4lconvert_yuv420_to_bgr24(d, dest, width,
+					height, bytesperline, rgb_stride,
+					yvu);
 			break;
 		}
 		break;
@@ -919,16 +1204,16 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_NV12_16L16:
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_nv12_16l16_to_rgb24(src, dest, width, height);
+			v4lconvert_nv12_16l16_to_rgb24(data, src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_nv12_16l16_to_bgr24(src, dest, width, height);
+			v4lconvert_nv12_16l16_to_bgr24(data, src, dest, width, height);
 			break;
 		case V4L2_PIX_FMT_YUV420:
-			v4lconvert_nv12_16l16_to_yuv420(src, dest, width, height, 0);
+			v4lconvert_nv12_16l16_to_yuv420(data, src, dest, width, height, 0);
 			break;
 		case V4L2_PIX_FMT_YVU420:
-			v4lconvert_nv12_16l16_to_yuv420(src, dest, width, height, 1);
+			v4lconvert_nv12_16l16_to_yuv420(data, src, dest, width, height, 1);
 			break;
 		}
 		break;
@@ -937,10 +1222,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_NV12:
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_nv12_to_rgb24(src, dest, width, height, bytesperline, 0);
+			v4lconvert_nv12_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_nv12_to_rgb24(src, dest, width, height, bytesperline, 1);
+			v4lconvert_nv12_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_nv12_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -965,8 +1252,72 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		unsigned char *tmpbuf;
 		struct v4l2_format tmpfmt = *fmt;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height,
-				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
+		/* For the row based decompressors, decode straight into the
+		   bilinear demosaic through a small L1 resident strip
+		   instead of materializing the bayer frame. Only possible
+		   when nothing (whitebalance, gamma, ...) needs to run on
+		   the intermediate bayer data */
+		if ((src_pix_fmt == V4L2_PIX_FMT_PAC207 ||
+		     src_pix_fmt == V4L2_PIX_FMT_MR97310A) &&
+		    (dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
+		     dest_pix_fmt == V4L2_PIX_FMT_BGR24) &&
+		    !v4lprocessing_active(data->processing)) {
+			int bgr = dest_pix_fmt == V4L2_PIX_FMT_BGR24;
+			int err;
+
+			tmpbuf = v4lconvert_scratch_buffer(data,
+					V4LCONVERT_CONVERT_PIXFMT_BUF,
+					(V4LCONVERT_BAYER_FUSE_ROWS + 2) *
+						width);
+			if (!tmpbuf)
+				return v4lconvert_oom_error(data);
+
+			if (src_pix_fmt == V4L2_PIX_FMT_PAC207) {
+				struct v4lconvert_pac207_row_decoder pac207;
+
+				v4lconvert_pac207_row_decoder_init(&pac207,
+						src, src_size);
+				err = v4lconvert_bayer_fused_to_rgbbgr24(
+						v4lconvert_pac207_decode_row,
+						&pac207, tmpbuf, dest,
+						width, height, rgb_stride,
+						V4L2_PIX_FMT_SBGGR8, bgr);
+				if (err) {
+					if (err == -1)
+						V4LCONVERT_ERR("incomplete pac207 frame\n");
+					else
+						V4LCONVERT_ERR("unknown pac207 row header: 0x%04x\n",
+								(int)pac207.bad_header);
+					/* Corrupt frame, better get another one */
+					errno = EAGAIN;
+					return -1;
+				}
+			} else {
+				struct v4lconvert_mr97310a_row_decoder mr97310a;
+
+				v4lconvert_mr97310a_row_decoder_init(&mr97310a,
+						src, src_size);
+				err = v4lconvert_bayer_fused_to_rgbbgr24(
+						v4lconvert_mr97310a_decode_row,
+						&mr97310a, tmpbuf, dest,
+						width, height, rgb_stride,
+						V4L2_PIX_FMT_SBGGR8, bgr);
+				if (err) {
+					if (v4lconvert_mr97310a_handle_overrun(data)) {
+						/* Corrupt frame, better get another one */
+						errno = EAGAIN;
+						return -1;
+					}
+					/* deliver the partial frame */
+				} else {
+					data->frames_dropped = 0;
+				}
+			}
+			break;
+		}
+
+		tmpbuf = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT_PIXFMT_BUF, width * height);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
 
@@ -1158,10 +1509,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_bayer_to_rgb24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_bayer_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride, src_pix_fmt);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_bayer_to_bgr24(src, dest, width, height, bytesperline, src_pix_fmt);
+			v4lconvert_bayer_to_bgr24(src, dest, width, height,
+					bytesperline, rgb_stride, src_pix_fmt);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_bayer_to_yuv420(src, dest, width, height, bytesperline, src_pix_fmt, 0);
@@ -1182,9 +1535,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_BGR24:
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
-			d = v4lconvert_alloc_buffer(width * height * 3,
-					&data->convert_pixfmt_buf,
-					&data->convert_pixfmt_buf_size);
+			d = v4lconvert_scratch_buffer(data,
+					V4LCONVERT_CONVERT_PIXFMT_BUF,
+					width * height * 3);
 			if (!d)
 				return v4lconvert_oom_error(data);
 
@@ -1201,7 +1554,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 						   width, height);
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_swap_rgb(d, dest, width, height);
+			v4lconvert_swap_rgb(d, dest, width, height, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb24_to_yuv420(d, dest, fmt, 0, 0, 3);
@@ -1224,6 +1577,7 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		case V4L2_PIX_FMT_RGB24:
 	        case V4L2_PIX_FMT_BGR24:
 			v4lconvert_y16_to_rgb24(src, dest, width, height,
+					rgb_stride,
 					src_pix_fmt == V4L2_PIX_FMT_Y16);
 			break;
 		case V4L2_PIX_FMT_YUV420:
@@ -1245,7 +1599,8 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
 	        case V4L2_PIX_FMT_BGR24:
-			v4lconvert_grey_to_rgb24(src, dest, width, height);
+			v4lconvert_grey_to_rgb24(src, dest, width, height,
+					rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 		case V4L2_PIX_FMT_YVU420:
@@ -1282,10 +1637,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_rgb565_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_rgb565_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rgb565_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_rgb565_to_bgr24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb565_to_yuv420(src, dest, fmt, 0);
@@ -1304,10 +1661,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			memcpy(dest, src, width * height * 3);
+			v4lconvert_copy_rect(dest, src, height, width * 3,
+					rgb_stride, width * 3);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_swap_rgb(src, dest, width, height);
+			v4lconvert_swap_rgb(src, dest, width, height,
+					rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 3);
@@ -1326,10 +1685,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_swap_rgb(src, dest, width, height);
+			v4lconvert_swap_rgb(src, dest, width, height,
+					rgb_stride);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			memcpy(dest, src, width * height * 3);
+			v4lconvert_copy_rect(dest, src, height, width * 3,
+					rgb_stride, width * 3);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 0, 3);
@@ -1351,10 +1712,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		src++;
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 0);
+			v4lconvert_rgb32_to_rgb24(src, dest, width, height,
+					rgb_stride, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 1);
+			v4lconvert_rgb32_to_rgb24(src, dest, width, height,
+					rgb_stride, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 0, 0, 4);
@@ -1375,10 +1738,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 1);
+			v4lconvert_rgb32_to_rgb24(src, dest, width, height,
+					rgb_stride, 1);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_rgb32_to_rgb24(src, dest, width, height, 0);
+			v4lconvert_rgb32_to_rgb24(src, dest, width, height,
+					rgb_stride, 0);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_rgb24_to_yuv420(src, dest, fmt, 1, 0, 4);
@@ -1398,11 +1763,11 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
 			v4lconvert_yuv420_to_rgb24(src, dest, width,
-					height, bytesperline, 0);
+					height, bytesperline, rgb_stride, 0);
 			break;
 		case V4L2_PIX_FMT_BGR24:
 			v4lconvert_yuv420_to_bgr24(src, dest, width,
-					height, bytesperline, 0);
+					height, bytesperline, rgb_stride, 0);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			memcpy(dest, src, width * height * 3 / 2);
@@ -1422,11 +1787,11 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
 			v4lconvert_yuv420_to_rgb24(src, dest, width,
-					height, bytesperline, 1);
+					height, bytesperline, rgb_stride, 1);
 			break;
 		case V4L2_PIX_FMT_BGR24:
 			v4lconvert_yuv420_to_bgr24(src, dest, width,
-					height, bytesperline, 1);
+					height, bytesperline, rgb_stride, 1);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_swap_uv(src, dest, fmt);
@@ -1440,8 +1805,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_NV16: {
 		unsigned char *tmpbuf;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height * 2,
-				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
+		tmpbuf = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT_PIXFMT_BUF,
+				width * height * 2);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
 
@@ -1459,10 +1825,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yuyv_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_yuyv_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yuyv_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_yuyv_to_bgr24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_yuyv_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1476,8 +1844,9 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	case V4L2_PIX_FMT_NV61: {
 		unsigned char *tmpbuf;
 
-		tmpbuf = v4lconvert_alloc_buffer(width * height * 2,
-				&data->convert_pixfmt_buf, &data->convert_pixfmt_buf_size);
+		tmpbuf = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT_PIXFMT_BUF,
+				width * height * 2);
 		if (!tmpbuf)
 			return v4lconvert_oom_error(data);
 
@@ -1496,10 +1865,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_yvyu_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_yvyu_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_yvyu_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_yvyu_to_bgr24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			/* Note we use yuyv_to_yuv420 not v4lconvert_yvyu_to_yuv420,
@@ -1520,10 +1891,12 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 		}
 		switch (dest_pix_fmt) {
 		case V4L2_PIX_FMT_RGB24:
-			v4lconvert_uyvy_to_rgb24(src, dest, width, height, bytesperline);
+			v4lconvert_uyvy_to_rgb24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_BGR24:
-			v4lconvert_uyvy_to_bgr24(src, dest, width, height, bytesperline);
+			v4lconvert_uyvy_to_bgr24(src, dest, width, height,
+					bytesperline, rgb_stride);
 			break;
 		case V4L2_PIX_FMT_YUV420:
 			v4lconvert_uyvy_to_yuv420(src, dest, width, height, bytesperline, 0);
@@ -1602,16 +1975,65 @@ static int v4lconvert_convert_pixfmt(struct v4lconvert_data *data,
 	fmt->fmt.pix.pixelformat = dest_pix_fmt;
 	v4lconvert_fixup_fmt(fmt);
 
+	if (repack_dest && result == 0) {
+		/* the jpeg decoders may have updated the dimensions */
+		unsigned int w = fmt->fmt.pix.width;
+		unsigned int h = fmt->fmt.pix.height;
+
+		if (dest_pix_fmt == V4L2_PIX_FMT_RGB24 ||
+				dest_pix_fmt == V4L2_PIX_FMT_BGR24) {
+			v4lconvert_copy_rect(repack_dest, dest, h, w * 3,
+					out_stride, w * 3);
+		} else {
+			v4lconvert_copy_rect(repack_dest, dest, h, w,
+					out_stride, w);
+			v4lconvert_copy_rect(repack_dest + out_stride * h,
+					dest + w * h, h / 2, w / 2,
+					out_stride / 2, w / 2);
+			v4lconvert_copy_rect(repack_dest + out_stride * h +
+						(out_stride / 2) * (h / 2),
+					dest + w * h * 5 / 4, h / 2, w / 2,
+					out_stride / 2, w / 2);
+		}
+	}
+	v4lconvert_fixup_stride(fmt, out_stride);
+
 	return result;
 }
 
+static int v4lconvert_convert_frame(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size);
+
 int v4lconvert_convert(struct v4lconvert_data *data,
 		const struct v4l2_format *src_fmt,  /* in */
 		const struct v4l2_format *dest_fmt, /* in */
 		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
+{
+	int res;
+
+	v4l_trace(libv4lconvert, convert_start,
+		  src_fmt->fmt.pix.pixelformat,
+		  dest_fmt->fmt.pix.pixelformat, src_size);
+	res = v4lconvert_convert_frame(data, src_fmt, dest_fmt,
+				       src, src_size, dest, dest_size);
+	v4l_trace(libv4lconvert, convert_done,
+		  src_fmt->fmt.pix.pixelformat,
+		  dest_fmt->fmt.pix.pixelformat, res);
+	return res;
+}
+
+static int v4lconvert_convert_frame(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size, unsigned char *dest, int dest_size)
 {
 	int res, dest_needed, temp_needed, processing, convert = 0;
-	int rotate90, vflip, hflip, crop;
+	int rotate90, vflip, hflip, crop, fused_flip_crop = 0;
+	int dest_stride = 0;
+	int i, scratch_needed[V4LCONVERT_NUM_SCRATCH_BUFS];
 	unsigned char *convert1_dest = dest;
 	int convert1_dest_size = dest_size;
 	unsigned char *convert2_src = src, *convert2_dest = dest;
@@ -1629,9 +2051,37 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	crop = my_dest_fmt.fmt.pix.width != my_src_fmt.fmt.pix.width ||
 		my_dest_fmt.fmt.pix.height != my_src_fmt.fmt.pix.height;
 
+	/* Apps may ask for destination lines padded out to an aligned stride
+	   (GPU upload, hw encoder alignment, ...) by setting bytesperline in
+	   their dest fmt larger than a packed line; for the planar yuv
+	   formats bytesperline is the luma stride and chroma lines use half
+	   of it. The conversion kernels write such a stride directly instead
+	   of the app repacking a packed frame afterwards. */
+	switch (my_dest_fmt.fmt.pix.pixelformat) {
+	case V4L2_PIX_FMT_RGB24:
+	case V4L2_PIX_FMT_BGR24:
+		if (my_dest_fmt.fmt.pix.bytesperline >
+				my_dest_fmt.fmt.pix.width * 3)
+			dest_stride = my_dest_fmt.fmt.pix.bytesperline;
+		break;
+	case V4L2_PIX_FMT_YUV420:
+	case V4L2_PIX_FMT_YVU420:
+		if (my_dest_fmt.fmt.pix.bytesperline >
+				my_dest_fmt.fmt.pix.width &&
+		    !(my_dest_fmt.fmt.pix.bytesperline & 1))
+			dest_stride = my_dest_fmt.fmt.pix.bytesperline;
+		break;
+	}
+
+	/* rotate90 / flip write packed lines, with a padded dest_stride let
+	   the (strided) crop pass make the final copy into dest */
+	if (dest_stride && (rotate90 || hflip || vflip))
+		crop = 1;
+
 	if (/* If no conversion/processing is needed */
 			(src_fmt->fmt.pix.pixelformat == dest_fmt->fmt.pix.pixelformat &&
-			 !processing && !rotate90 && !hflip && !vflip && !crop) ||
+			 !processing && !rotate90 && !hflip && !vflip && !crop &&
+			 !dest_stride) ||
 			/* or if we should do processing/rotating/flipping but the app tries to
 			   use the native cam format, we just return an unprocessed frame copy */
 			!v4lconvert_supported_dst_format(dest_fmt->fmt.pix.pixelformat)) {
@@ -1644,13 +2094,16 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	switch (my_dest_fmt.fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		dest_needed = my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3;
+		dest_needed = (dest_stride ? dest_stride :
+				(int)my_dest_fmt.fmt.pix.width * 3) *
+			my_dest_fmt.fmt.pix.height;
 		temp_needed = my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
 		break;
 	case V4L2_PIX_FMT_YUV420:
 	case V4L2_PIX_FMT_YVU420:
-		dest_needed =
-			my_dest_fmt.fmt.pix.width * my_dest_fmt.fmt.pix.height * 3 / 2;
+		dest_needed = (dest_stride ? dest_stride :
+				(int)my_dest_fmt.fmt.pix.width) *
+			my_dest_fmt.fmt.pix.height * 3 / 2;
 		temp_needed =
 			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3 / 2;
 		break;
@@ -1683,45 +2136,67 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		 (!rotate90 && !hflip && !vflip && !crop))
 		convert = 1;
 
+	/* When flipping and cropping are the only remaining steps we can do
+	   both in one pass straight into dest, skipping the flip buffer */
+	if ((vflip || hflip) && crop && !rotate90 && !dest_stride)
+		fused_flip_crop = v4lconvert_flip_crop_possible(&my_src_fmt,
+								&my_dest_fmt);
+
 	/* convert_pixfmt (only if convert == 2) -> processing -> convert_pixfmt ->
-	   rotate -> flip -> crop, all steps are optional */
-	if (convert == 2) {
-		convert1_dest = v4lconvert_alloc_buffer(
-				my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3,
-				&data->convert1_buf, &data->convert1_buf_size);
-		if (!convert1_dest)
+	   rotate -> flip -> crop, all steps are optional.
+
+	   All intermediate buffers live in one scratch arena and growing it
+	   for one buffer may move the others, so reserve everything this
+	   frame needs before taking any pointers; re-requesting a reserved
+	   size below cannot move the slab. The pixfmt conversion routines
+	   grab the convert_pixfmt buffer from within the pipeline; when
+	   they write into another scratch buffer reserve it up front at its
+	   worst case (rgb24 sized), when they write straight into dest no
+	   other arena pointers are live and it may grow lazily. */
+	memset(scratch_needed, 0, sizeof(scratch_needed));
+	if (convert == 2 || (convert && (rotate90 || hflip || vflip || crop)))
+		scratch_needed[V4LCONVERT_CONVERT_PIXFMT_BUF] =
+			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
+	if (convert == 2)
+		scratch_needed[V4LCONVERT_CONVERT1_BUF] =
+			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
+	if (convert && (rotate90 || hflip || vflip || crop))
+		scratch_needed[V4LCONVERT_CONVERT2_BUF] = temp_needed;
+	if (rotate90 && (hflip || vflip || crop))
+		scratch_needed[V4LCONVERT_ROTATE90_BUF] = temp_needed;
+	if ((vflip || hflip) && crop && !fused_flip_crop)
+		scratch_needed[V4LCONVERT_FLIP_BUF] = temp_needed;
+
+	for (i = 0; i < V4LCONVERT_NUM_SCRATCH_BUFS; i++)
+		if (scratch_needed[i] &&
+		    !v4lconvert_scratch_buffer(data, i, scratch_needed[i]))
 			return v4lconvert_oom_error(data);
 
+	if (convert == 2) {
+		convert1_dest = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT1_BUF,
+				scratch_needed[V4LCONVERT_CONVERT1_BUF]);
 		convert1_dest_size =
 			my_src_fmt.fmt.pix.width * my_src_fmt.fmt.pix.height * 3;
 		convert2_src = convert1_dest;
 	}
 
 	if (convert && (rotate90 || hflip || vflip || crop)) {
-		convert2_dest = v4lconvert_alloc_buffer(temp_needed,
-				&data->convert2_buf, &data->convert2_buf_size);
-		if (!convert2_dest)
-			return v4lconvert_oom_error(data);
-
+		convert2_dest = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_CONVERT2_BUF, temp_needed);
 		convert2_dest_size = temp_needed;
 		rotate90_src = flip_src = crop_src = convert2_dest;
 	}
 
 	if (rotate90 && (hflip || vflip || crop)) {
-		rotate90_dest = v4lconvert_alloc_buffer(temp_needed,
-				&data->rotate90_buf, &data->rotate90_buf_size);
-		if (!rotate90_dest)
-			return v4lconvert_oom_error(data);
-
+		rotate90_dest = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_ROTATE90_BUF, temp_needed);
 		flip_src = crop_src = rotate90_dest;
 	}
 
-	if ((vflip || hflip) && crop) {
-		flip_dest = v4lconvert_alloc_buffer(temp_needed, &data->flip_buf,
-				&data->flip_buf_size);
-		if (!flip_dest)
-			return v4lconvert_oom_error(data);
-
+	if ((vflip || hflip) && crop && !fused_flip_crop) {
+		flip_dest = v4lconvert_scratch_buffer(data,
+				V4LCONVERT_FLIP_BUF, temp_needed);
 		crop_src = flip_dest;
 	}
 
@@ -1731,7 +2206,7 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		res = v4lconvert_convert_pixfmt(data, src, src_size,
 				convert1_dest, convert1_dest_size,
 				&my_src_fmt,
-				V4L2_PIX_FMT_RGB24);
+				V4L2_PIX_FMT_RGB24, 0);
 		if (res)
 			return res;
 
@@ -1745,7 +2220,8 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 		res = v4lconvert_convert_pixfmt(data, convert2_src, src_size,
 				convert2_dest, convert2_dest_size,
 				&my_src_fmt,
-				my_dest_fmt.fmt.pix.pixelformat);
+				my_dest_fmt.fmt.pix.pixelformat,
+				convert2_dest == dest ? dest_stride : 0);
 		if (res)
 			return res;
 
@@ -1761,6 +2237,12 @@ int v4lconvert_convert(struct v4lconvert_data *data,
 	if (rotate90)
 		v4lconvert_rotate90(rotate90_src, rotate90_dest, &my_src_fmt);
 
+	if (fused_flip_crop) {
+		v4lconvert_flip_crop(flip_src, dest, &my_src_fmt, &my_dest_fmt,
+				     hflip, vflip);
+		return dest_needed;
+	}
+
 	if (hflip || vflip)
 		v4lconvert_flip(flip_src, flip_dest, &my_src_fmt, hflip, vflip);
 
@@ -1775,6 +2257,184 @@ const char *v4lconvert_get_error_message(struct v4lconvert_data *data)
 	return data->error_msg;
 }
 
+/* Run the framesize probing deferred by v4lconvert_create() */
+/*
+ * On-disk cache for the framesize probe results. Walking
+ * VIDIOC_ENUM_FRAMESIZES for every format is a storm of ioctls on
+ * devices with many formats (the reason the probe is already deferred
+ * out of v4lconvert_create()), and the answers only change with the
+ * driver, so repeat opens of a known device can skip it entirely. One
+ * file per device under $XDG_CACHE_HOME/libv4l (~/.cache/libv4l),
+ * named after driver + bus_info + driver version so stale entries are
+ * simply never opened again; the stored format list guards against the
+ * same device exposing a different format set (e.g. module options).
+ */
+#define V4LCONVERT_FRAMESIZE_CACHE_VERSION 1
+
+static FILE *v4lconvert_framesize_cache_open(struct v4lconvert_data *data,
+		int write)
+{
+	char path[PATH_MAX];
+	const char *dir;
+	int n;
+
+	if (!data->framesize_cache_key[0] ||
+	    getenv("LIBV4LCONVERT_NO_CACHE") ||
+	    getuid() != geteuid() || getgid() != getegid())
+		return NULL;
+
+	dir = getenv("XDG_CACHE_HOME");
+	if (dir && *dir)
+		n = snprintf(path, sizeof(path), "%s/libv4l", dir);
+	else {
+		dir = getenv("HOME");
+		if (!dir || !*dir)
+			return NULL;
+		n = snprintf(path, sizeof(path), "%s/.cache", dir);
+		if (n < 0 || n >= (int)sizeof(path))
+			return NULL;
+		if (write)
+			mkdir(path, 0700);
+		n = snprintf(path, sizeof(path), "%s/.cache/libv4l", dir);
+	}
+	if (n < 0 || n >= (int)sizeof(path))
+		return NULL;
+
+	if (write && mkdir(path, 0700) && errno != EEXIST)
+		return NULL;
+
+	if (snprintf(path + n, sizeof(path) - n, "/%s",
+			data->framesize_cache_key) >= (int)(sizeof(path) - n))
+		return NULL;
+
+	return fopen(path, write ? "w" : "r");
+}
+
+static int v4lconvert_framesize_cache_load(struct v4lconvert_data *data)
+{
+	FILE *f = v4lconvert_framesize_cache_open(data, 0);
+	unsigned int i, version, no_fmts, count, type;
+	int ok = 0;
+
+	if (!f)
+		return 0;
+
+	if (fscanf(f, "libv4lconvert-framesizes %u with %u formats:",
+				&version, &no_fmts) != 2 ||
+	    version != V4LCONVERT_FRAMESIZE_CACHE_VERSION ||
+	    no_fmts != (unsigned int)data->no_probe_fmts)
+		goto leave;
+
+	for (i = 0; i < no_fmts; i++) {
+		unsigned int fmt;
+
+		if (fscanf(f, " %u", &fmt) != 1 ||
+		    fmt != data->probe_fmts[i])
+			goto leave;
+	}
+
+	if (fscanf(f, " %u framesizes:", &count) != 1 ||
+	    count > V4LCONVERT_MAX_FRAMESIZES)
+		goto leave;
+
+	for (i = 0; i < count; i++) {
+		struct v4l2_frmsizeenum *size = &data->framesizes[i];
+		long long fmt_mask;
+
+		memset(size, 0, sizeof(*size));
+		if (fscanf(f, " %u %llx", &type, &fmt_mask) != 2)
+			goto leave;
+		size->type = type;
+		data->framesize_supported_src_formats[i] = fmt_mask;
+
+		switch (type) {
+		case V4L2_FRMSIZE_TYPE_DISCRETE:
+			if (fscanf(f, " %u %u", &size->discrete.width,
+						&size->discrete.height) != 2)
+				goto leave;
+			break;
+		case V4L2_FRMSIZE_TYPE_CONTINUOUS:
+		case V4L2_FRMSIZE_TYPE_STEPWISE:
+			if (fscanf(f, " %u %u %u %u %u %u",
+					&size->stepwise.min_width,
+					&size->stepwise.max_width,
+					&size->stepwise.step_width,
+					&size->stepwise.min_height,
+					&size->stepwise.max_height,
+					&size->stepwise.step_height) != 6)
+				goto leave;
+			break;
+		default:
+			goto leave;
+		}
+	}
+
+	data->no_framesizes = count;
+	ok = 1;
+leave:
+	fclose(f);
+	return ok;
+}
+
+static void v4lconvert_framesize_cache_save(struct v4lconvert_data *data)
+{
+	FILE *f = v4lconvert_framesize_cache_open(data, 1);
+	unsigned int i;
+
+	if (!f)
+		return;
+
+	fprintf(f, "libv4lconvert-framesizes %u with %u formats:",
+			V4LCONVERT_FRAMESIZE_CACHE_VERSION,
+			data->no_probe_fmts);
+	for (i = 0; i < (unsigned int)data->no_probe_fmts; i++)
+		fprintf(f, " %u", data->probe_fmts[i]);
+	fprintf(f, "\n%u framesizes:\n", data->no_framesizes);
+
+	for (i = 0; i < data->no_framesizes; i++) {
+		const struct v4l2_frmsizeenum *size = &data->framesizes[i];
+
+		fprintf(f, "%u %llx", size->type, (long long)
+				data->framesize_supported_src_formats[i]);
+		switch (size->type) {
+		case V4L2_FRMSIZE_TYPE_DISCRETE:
+			fprintf(f, " %u %u\n", size->discrete.width,
+					size->discrete.height);
+			break;
+		default:
+			fprintf(f, " %u %u %u %u %u %u\n",
+					size->stepwise.min_width,
+					size->stepwise.max_width,
+					size->stepwise.step_width,
+					size->stepwise.min_height,
+					size->stepwise.max_height,
+					size->stepwise.step_height);
+			break;
+		}
+	}
+	fclose(f);
+}
+
+static void v4lconvert_probe_framesizes(struct v4lconvert_data *data)
+{
+	int i;
+
+	if (data->framesizes_probed)
+		return;
+	data->framesizes_probed = 1;
+
+	if (v4lconvert_framesize_cache_load(data))
+		return;
+	data->no_framesizes = 0;
+
+	for (i = 0; i < data->no_probe_fmts; i++)
+		v4lconvert_get_framesizes(data,
+				supported_src_pixfmts[data->probe_fmts[i]].fmt,
+				data->probe_fmts[i]);
+
+	v4lconvert_framesize_cache_save(data);
+}
+
 static void v4lconvert_get_framesizes(struct v4lconvert_data *data,
 		unsigned int pixelformat, int index)
 {
@@ -1846,6 +2506,8 @@ int v4lconvert_enum_framesizes(struct v4lconvert_data *data,
 				VIDIOC_ENUM_FRAMESIZES, frmsize);
 	}
 
+	v4lconvert_probe_framesizes(data);
+
 	if (frmsize->index >= data->no_framesizes) {
 		errno = EINVAL;
 		return -1;
@@ -1985,6 +2647,30 @@ int v4lconvert_vidioc_s_ext_ctrls(struct v4lconvert_data *data, void *arg)
 	return v4lcontrol_vidioc_s_ext_ctrls(data->control, arg);
 }
 
+void v4lconvert_set_num_threads(struct v4lconvert_data *data, int num_threads)
+{
+	if (num_threads <= 0) {
+		num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (num_threads <= 0)
+			num_threads = 1;
+	}
+	if (num_threads > 64)
+		num_threads = 64;
+
+	if (num_threads == data->num_threads)
+		return;
+
+	/* the pool is re-created with the new size on first use */
+	v4lconvert_threadpool_destroy(data->threadpool);
+	data->threadpool = NULL;
+	data->num_threads = num_threads;
+}
+
+int v4lconvert_get_num_threads(struct v4lconvert_data *data)
+{
+	return data->num_threads;
+}
+
 int v4lconvert_get_fps(struct v4lconvert_data *data)
 {
 	return data->fps;
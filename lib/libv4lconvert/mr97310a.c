@@ -95,113 +95,148 @@ static inline unsigned char get_byte(const unsigned char *inp,
 	return (addr[0] << (bitpos & 7)) | (addr[1] >> (8 - (bitpos & 7)));
 }
 
-int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
-		const unsigned char *inp, int src_size,
-		unsigned char *outp, int width, int height)
+void v4lconvert_mr97310a_row_decoder_init(
+		struct v4lconvert_mr97310a_row_decoder *mr97310a,
+		const unsigned char *src, int src_size)
 {
-	int row, col;
+	if (!decoder_initialized)
+		init_mr97310a_decoder();
+
+	/* remove the header, src_size - 12 because of 12 byte footer */
+	mr97310a->inp = src + 12;
+	mr97310a->bitpos = 0;
+	mr97310a->body_size = src_size - 12;
+}
+
+/* Decode one bayer row; rows 2 and up predict from the previous row of
+   the same bayer colors, so outp[-2 * width - 2] .. outp[-2 * width + 2]
+   must hold the row decoded two calls earlier. Returns 0 on success, -1
+   when the compressed stream ran out before the row was complete. */
+int v4lconvert_mr97310a_decode_row(void *ctx, unsigned char *outp,
+		int width, int row)
+{
+	struct v4lconvert_mr97310a_row_decoder *mr97310a = ctx;
+	const unsigned char *inp = mr97310a->inp;
+	int bitpos = mr97310a->bitpos;
+	int col = 0;
 	int val;
-	int bitpos;
 	unsigned char code;
 	unsigned char lp, tp, tlp, trp;
-	struct v4l2_control min_clockdiv = { .id = MIN_CLOCKDIV_CID };
 
-	if (!decoder_initialized)
-		init_mr97310a_decoder();
+	/* first two pixels in first two rows are stored as raw 8-bit */
+	if (row < 2) {
+		code = get_byte(inp, bitpos);
+		bitpos += 8;
+		*outp++ = code;
 
-	/* remove the header */
-	inp += 12;
+		code = get_byte(inp, bitpos);
+		bitpos += 8;
+		*outp++ = code;
 
-	bitpos = 0;
+		col += 2;
+	}
 
-	/* main decoding loop */
-	for (row = 0; row < height; ++row) {
-		col = 0;
+	while (col < width) {
+		/* get bitcode */
+		code = get_byte(inp, bitpos);
+		/* update bit position */
+		bitpos += table[code].len;
 
-		/* first two pixels in first two rows are stored as raw 8-bit */
-		if (row < 2) {
+		/* calculate pixel value */
+		if (table[code].is_abs) {
+			/* get 5 more bits and use them as absolute value */
 			code = get_byte(inp, bitpos);
-			bitpos += 8;
-			*outp++ = code;
+			val = (code & 0xf8);
+			bitpos += 5;
+
+		} else {
+			/* value is relative to top or left pixel */
+			val = table[code].val;
+			lp = outp[-2];
+			if (row > 1) {
+				tlp = outp[-2 * width - 2];
+				tp  = outp[-2 * width];
+				trp = outp[-2 * width + 2];
+			}
+			if (row < 2) {
+				/* top row: relative to left pixel */
+				val += lp;
+			} else if (col < 2) {
+				/* left column: relative to top pixel */
+				/* initial estimate */
+				val += (tp + trp) / 2;
+			} else if (col > width - 3) {
+				/* left column: relative to top pixel */
+				val += (tp + lp + tlp + 1) / 3;
+				/* main area: weighted average of tlp, trp,
+				 * lp, and tp */
+			} else {
+				tlp >>= 1;
+				trp >>= 1;
+				/* initial estimate for predictor */
+				val += (lp + tp + tlp + trp + 1) / 3;
+			}
+		}
+		/* store pixel */
+		*outp++ = CLIP(val);
+		++col;
+	}
 
-			code = get_byte(inp, bitpos);
-			bitpos += 8;
-			*outp++ = code;
+	mr97310a->inp = inp;
+	mr97310a->bitpos = bitpos;
 
-			col += 2;
-		}
+	if (((bitpos - 1) / 8) >= mr97310a->body_size)
+		return -1;
 
-		while (col < width) {
-			/* get bitcode */
-			code = get_byte(inp, bitpos);
-			/* update bit position */
-			bitpos += table[code].len;
+	return 0;
+}
 
-			/* calculate pixel value */
-			if (table[code].is_abs) {
-				/* get 5 more bits and use them as absolute value */
-				code = get_byte(inp, bitpos);
-				val = (code & 0xf8);
-				bitpos += 5;
+/* Called when the compressed stream ran out mid-frame; returns 0 when the
+   (partial) frame should still be delivered, -1 when it should be dropped
+   with EPIPE/EAGAIN semantics left to the caller. */
+int v4lconvert_mr97310a_handle_overrun(struct v4lconvert_data *data)
+{
+	struct v4l2_control min_clockdiv = { .id = MIN_CLOCKDIV_CID };
 
-			} else {
-				/* value is relative to top or left pixel */
-				val = table[code].val;
-				lp = outp[-2];
-				if (row > 1) {
-					tlp = outp[-2 * width - 2];
-					tp  = outp[-2 * width];
-					trp = outp[-2 * width + 2];
-				}
-				if (row < 2) {
-					/* top row: relative to left pixel */
-					val += lp;
-				} else if (col < 2) {
-					/* left column: relative to top pixel */
-					/* initial estimate */
-					val += (tp + trp) / 2;
-				} else if (col > width - 3) {
-					/* left column: relative to top pixel */
-					val += (tp + lp + tlp + 1) / 3;
-					/* main area: weighted average of tlp, trp,
-					 * lp, and tp */
-				} else {
-					tlp >>= 1;
-					trp >>= 1;
-					/* initial estimate for predictor */
-					val += (lp + tp + tlp + trp + 1) / 3;
-				}
-			}
-			/* store pixel */
-			*outp++ = CLIP(val);
-			++col;
-		}
+	data->frames_dropped++;
+	if (data->frames_dropped == 3) {
+		/* Tell the driver to go slower as
+		   the compression engine is not able to
+		   compress the image enough, we may
+		   fail to do this because older
+		   drivers don't support this */
+		SYS_IOCTL(data->fd, VIDIOC_G_CTRL,
+				&min_clockdiv);
+		min_clockdiv.value++;
+		SYS_IOCTL(data->fd, VIDIOC_S_CTRL,
+				&min_clockdiv);
+		/* We return success here, because if we
+		   return failure for too many frames in a row
+		   libv4l2 will return an error to the
+		   application and some applications abort
+		   on the first error received. */
+		data->frames_dropped = 0;
+		return 0;
+	}
+	V4LCONVERT_ERR("incomplete mr97310a frame\n");
+	return -1;
+}
 
-		/* src_size - 12 because of 12 byte footer */
-		if (((bitpos - 1) / 8) >= (src_size - 12)) {
-			data->frames_dropped++;
-			if (data->frames_dropped == 3) {
-				/* Tell the driver to go slower as
-				   the compression engine is not able to
-				   compress the image enough, we may
-				   fail to do this because older
-				   drivers don't support this */
-				SYS_IOCTL(data->fd, VIDIOC_G_CTRL,
-						&min_clockdiv);
-				min_clockdiv.value++;
-				SYS_IOCTL(data->fd, VIDIOC_S_CTRL,
-						&min_clockdiv);
-				/* We return success here, because if we
-				   return failure for too many frames in a row
-				   libv4l2 will return an error to the
-				   application and some applications abort
-				   on the first error received. */
-				data->frames_dropped = 0;
-				return 0;
-			}
-			V4LCONVERT_ERR("incomplete mr97310a frame\n");
-			return -1;
-		}
+int v4lconvert_decode_mr97310a(struct v4lconvert_data *data,
+		const unsigned char *inp, int src_size,
+		unsigned char *outp, int width, int height)
+{
+	struct v4lconvert_mr97310a_row_decoder mr97310a;
+	int row;
+
+	v4lconvert_mr97310a_row_decoder_init(&mr97310a, inp, src_size);
+
+	/* main decoding loop */
+	for (row = 0; row < height; ++row) {
+		if (v4lconvert_mr97310a_decode_row(&mr97310a, outp, width,
+					row))
+			return v4lconvert_mr97310a_handle_overrun(data);
+		outp += width;
 	}
 
 	data->frames_dropped = 0;
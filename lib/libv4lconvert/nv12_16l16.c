@@ -23,6 +23,24 @@ Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
 #include "libv4lconvert-priv.h"
 #include <string.h>
 
+/*
+ * The tiles of a plane are independent, so the detiling below is tuned
+ * like the other hot conversion paths: the inner loops copy or
+ * deinterleave a whole 16 byte tile row at a time (with SIMD for the
+ * chroma split), the next macroblock is prefetched while the current one
+ * is handled, and large frames are split into bands over the worker
+ * thread pool.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V4LCONVERT_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
 /* The NV12_16L16 format is used in the Conexant cx23415/6/8 MPEG encoder devices.
    It is a macroblock format with separate Y and UV planes, each plane
    consisting of 16x16 values. All lines are always 720 bytes long. If the
@@ -41,7 +59,7 @@ Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
 static const int stride = 720;
 
 static void v4lconvert_nv12_16l16_to_rgb(const unsigned char *src, unsigned char *dest,
-		int width, int height, int rgb)
+		int width, int height, int start, int rows, int rgb)
 {
 	unsigned int y, x, i, j;
 	const unsigned char *y_base = src;
@@ -52,10 +70,10 @@ static void v4lconvert_nv12_16l16_to_rgb(const unsigned char *src, unsigned char
 	int r = rgb ? 0 : 2;
 	int b = 2 - r;
 
-	for (y = 0; y < height; y += 16) {
+	for (y = start; y < start + rows; y += 16) {
 		int mb_y = (y / 16) * (stride / 16);
 		int mb_uv = (y / 32) * (stride / 16);
-		int maxy = (height - y < 16 ? height - y : 16);
+		int maxy = (start + rows - y < 16 ? start + rows - y : 16);
 
 		for (x = 0; x < width; x += 16, mb_y++, mb_uv++) {
 			int maxx = (width - x < 16 ? width - x : 16);
@@ -91,19 +109,78 @@ static void v4lconvert_nv12_16l16_to_rgb(const unsigned char *src, unsigned char
 	}
 }
 
-void v4lconvert_nv12_16l16_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height)
+static void de_macro_uv_scalar(unsigned char *dstu, unsigned char *dstv,
+		const unsigned char *src, int w, int h)
 {
-	v4lconvert_nv12_16l16_to_rgb(src, dest, width, height, 1);
+	unsigned int y, x, i, j;
+
+	for (y = 0; y < h; y += 16) {
+		for (x = 0; x < w; x += 8) {
+			const unsigned char *src_uv = src + y * stride + x * 32;
+			int maxy = (h - y < 16 ? h - y : 16);
+			int maxx = (w - x < 8 ? w - x : 8);
+
+			for (i = 0; i < maxy; i++) {
+				int idx = x + (y + i) * w;
+
+				for (j = 0; j < maxx; j++) {
+					dstu[idx+j] = src_uv[2 * j];
+					dstv[idx+j] = src_uv[2 * j + 1];
+				}
+				src_uv += 16;
+			}
+		}
+	}
 }
 
-void v4lconvert_nv12_16l16_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height)
+#ifdef V4LCONVERT_X86_SIMD
+
+__attribute__((target("sse2")))
+static void de_macro_uv_sse2(unsigned char *dstu, unsigned char *dstv,
+		const unsigned char *src, int w, int h)
 {
-	v4lconvert_nv12_16l16_to_rgb(src, dest, width, height, 0);
+	const __m128i lo_mask = _mm_set1_epi16(0x00ff);
+	unsigned int y, x, i, j;
+
+	for (y = 0; y < h; y += 16) {
+		for (x = 0; x < w; x += 8) {
+			const unsigned char *src_uv = src + y * stride + x * 32;
+			int maxy = (h - y < 16 ? h - y : 16);
+			int maxx = (w - x < 8 ? w - x : 8);
+
+			__builtin_prefetch(src_uv + 256);
+			for (i = 0; i < maxy; i++) {
+				int idx = x + (y + i) * w;
+
+				if (maxx == 8) {
+					/* One tile row: split 8 interleaved
+					   uv pairs into 8 u + 8 v bytes */
+					__m128i uv = _mm_loadu_si128(
+						(const __m128i *)src_uv);
+					__m128i u = _mm_and_si128(uv, lo_mask);
+					__m128i v = _mm_srli_epi16(uv, 8);
+
+					_mm_storel_epi64((__m128i *)(dstu + idx),
+						_mm_packus_epi16(u, u));
+					_mm_storel_epi64((__m128i *)(dstv + idx),
+						_mm_packus_epi16(v, v));
+				} else {
+					for (j = 0; j < maxx; j++) {
+						dstu[idx+j] = src_uv[2 * j];
+						dstv[idx+j] = src_uv[2 * j + 1];
+					}
+				}
+				src_uv += 16;
+			}
+		}
+	}
 }
 
-static void de_macro_uv(unsigned char *dstu, unsigned char *dstv,
+#endif /* V4LCONVERT_X86_SIMD */
+
+#ifdef V4LCONVERT_NEON_SIMD
+
+static void de_macro_uv_neon(unsigned char *dstu, unsigned char *dstv,
 		const unsigned char *src, int w, int h)
 {
 	unsigned int y, x, i, j;
@@ -114,12 +191,20 @@ static void de_macro_uv(unsigned char *dstu, unsigned char *dstv,
 			int maxy = (h - y < 16 ? h - y : 16);
 			int maxx = (w - x < 8 ? w - x : 8);
 
+			__builtin_prefetch(src_uv + 256);
 			for (i = 0; i < maxy; i++) {
 				int idx = x + (y + i) * w;
 
-				for (j = 0; j < maxx; j++) {
-					dstu[idx+j] = src_uv[2 * j];
-					dstv[idx+j] = src_uv[2 * j + 1];
+				if (maxx == 8) {
+					uint8x8x2_t uv = vld2_u8(src_uv);
+
+					vst1_u8(dstu + idx, uv.val[0]);
+					vst1_u8(dstv + idx, uv.val[1]);
+				} else {
+					for (j = 0; j < maxx; j++) {
+						dstu[idx+j] = src_uv[2 * j];
+						dstv[idx+j] = src_uv[2 * j + 1];
+					}
 				}
 				src_uv += 16;
 			}
@@ -127,6 +212,23 @@ static void de_macro_uv(unsigned char *dstu, unsigned char *dstv,
 	}
 }
 
+#endif /* V4LCONVERT_NEON_SIMD */
+
+static void de_macro_uv(unsigned char *dstu, unsigned char *dstv,
+		const unsigned char *src, int w, int h)
+{
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSE2) {
+		de_macro_uv_sse2(dstu, dstv, src, w, h);
+		return;
+	}
+#elif defined(V4LCONVERT_NEON_SIMD)
+	de_macro_uv_neon(dstu, dstv, src, w, h);
+	return;
+#endif
+	de_macro_uv_scalar(dstu, dstv, src, w, h);
+}
+
 static void de_macro_y(unsigned char *dst, const unsigned char *src,
 		int w, int h)
 {
@@ -138,22 +240,141 @@ static void de_macro_y(unsigned char *dst, const unsigned char *src,
 			int maxy = (h - y < 16 ? h - y : 16);
 			int maxx = (w - x < 16 ? w - x : 16);
 
-			for (i = 0; i < maxy; i++) {
-				memcpy(dst + x + (y + i) * w, src_y, maxx);
-				src_y += 16;
+			__builtin_prefetch(src_y + 256);
+			if (maxx == 16) {
+				/* Constant size so the copy of a whole tile
+				   row is a single 16 byte load + store */
+				for (i = 0; i < maxy; i++) {
+					memcpy(dst + x + (y + i) * w, src_y, 16);
+					src_y += 16;
+				}
+			} else {
+				for (i = 0; i < maxy; i++) {
+					memcpy(dst + x + (y + i) * w, src_y, maxx);
+					src_y += 16;
+				}
 			}
 		}
 	}
 }
 
-void v4lconvert_nv12_16l16_to_yuv420(const unsigned char *src, unsigned char *dest,
-		int width, int height, int yvu)
+/* Detile the destination rows [start, start + rows), start and (except
+   for the last band) rows must be multiples of 32 so the chroma tiles
+   stay intact */
+static void v4lconvert_nv12_16l16_to_yuv420_rows(const unsigned char *src,
+		unsigned char *dest, int width, int height, int yvu,
+		int start, int rows)
 {
-	de_macro_y(dest, src, width, height);
-	dest += width * height;
-	src += stride * height;
+	const unsigned char *src_uv = src + stride * height +
+		(start / 2) * stride;
+	unsigned char *dstu = dest + width * height +
+		(start / 2) * (width / 2);
+	unsigned char *dstv = dstu + width * height / 4;
+
+	de_macro_y(dest + start * width, src + start * stride, width, rows);
 	if (yvu)
-		de_macro_uv(dest + width * height / 4, dest, src, width / 2, height / 2);
+		de_macro_uv(dstv, dstu, src_uv, width / 2, rows / 2);
 	else
-		de_macro_uv(dest, dest + width * height / 4, src, width / 2, height / 2);
+		de_macro_uv(dstu, dstv, src_uv, width / 2, rows / 2);
+}
+
+/* Band split over the worker threads, the tiles of each band are
+   independent of all other bands */
+
+enum nv12_16l16_op {
+	NV12_16L16_RGB24,
+	NV12_16L16_BGR24,
+	NV12_16L16_YUV420,
+	NV12_16L16_YVU420,
+};
+
+struct nv12_16l16_job {
+	const unsigned char *src;
+	unsigned char *dest;
+	int width, height;
+	enum nv12_16l16_op op;
+};
+
+static void v4lconvert_nv12_16l16_band_func(void *arg, int start_row, int rows)
+{
+	struct nv12_16l16_job *job = arg;
+
+	switch (job->op) {
+	case NV12_16L16_RGB24:
+	case NV12_16L16_BGR24:
+		v4lconvert_nv12_16l16_to_rgb(job->src, job->dest,
+				job->width, job->height, start_row, rows,
+				job->op == NV12_16L16_RGB24);
+		break;
+	case NV12_16L16_YUV420:
+	case NV12_16L16_YVU420:
+		v4lconvert_nv12_16l16_to_yuv420_rows(job->src, job->dest,
+				job->width, job->height,
+				job->op == NV12_16L16_YVU420, start_row, rows);
+		break;
+	}
+}
+
+/* Returns 1 when the conversion was done over the thread pool, 0 when
+   the caller should use the single threaded path (same gating as
+   v4lconvert_bands_convert()) */
+static int v4lconvert_nv12_16l16_threaded(struct v4lconvert_data *data,
+		struct nv12_16l16_job *job)
+{
+	if (!data || data->num_threads <= 1)
+		return 0;
+	if ((size_t)job->width * job->height < 256 * 1024 ||
+	    job->height < 32 * data->num_threads || job->height % 32)
+		return 0;
+
+	if (!data->threadpool) {
+		data->threadpool =
+			v4lconvert_threadpool_create(data->num_threads - 1);
+		if (!data->threadpool) {
+			data->num_threads = 1;
+			return 0;
+		}
+	}
+
+	/* 32 row alignment keeps whole chroma tiles inside one band */
+	v4lconvert_threadpool_run(data->threadpool,
+				  v4lconvert_nv12_16l16_band_func, job,
+				  job->height, 32);
+	return 1;
+}
+
+void v4lconvert_nv12_16l16_to_rgb24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	struct nv12_16l16_job job = { src, dest, width, height,
+		NV12_16L16_RGB24 };
+
+	if (!v4lconvert_nv12_16l16_threaded(data, &job))
+		v4lconvert_nv12_16l16_to_rgb(src, dest, width, height,
+				0, height, 1);
+}
+
+void v4lconvert_nv12_16l16_to_bgr24(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height)
+{
+	struct nv12_16l16_job job = { src, dest, width, height,
+		NV12_16L16_BGR24 };
+
+	if (!v4lconvert_nv12_16l16_threaded(data, &job))
+		v4lconvert_nv12_16l16_to_rgb(src, dest, width, height,
+				0, height, 0);
+}
+
+void v4lconvert_nv12_16l16_to_yuv420(struct v4lconvert_data *data,
+		const unsigned char *src, unsigned char *dest,
+		int width, int height, int yvu)
+{
+	struct nv12_16l16_job job = { src, dest, width, height,
+		yvu ? NV12_16L16_YVU420 : NV12_16L16_YUV420 };
+
+	if (!v4lconvert_nv12_16l16_threaded(data, &job))
+		v4lconvert_nv12_16l16_to_yuv420_rows(src, dest, width, height,
+				yvu, 0, height);
 }
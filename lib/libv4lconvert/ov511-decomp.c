@@ -614,8 +614,19 @@ static int v4lconvert_ov511_to_yuv420(unsigned char *src, unsigned char *dest,
 int main(int argc, char *argv[])
 {
 	int width, height, yvu, src_size, dest_size;
-	unsigned char src_buf[500000];
-	unsigned char dest_buf[500000];
+	unsigned char pipe_src_buf[500000];
+	unsigned char pipe_dest_buf[500000];
+	unsigned char *src_buf = pipe_src_buf;
+	unsigned char *dest_buf = pipe_dest_buf;
+	int src_buf_size = sizeof(pipe_src_buf);
+	int dest_buf_size = sizeof(pipe_dest_buf);
+	int shm_size = v4lconvert_helper_get_shm(argc, argv,
+			&src_buf, &dest_buf);
+
+	if (shm_size) {
+		src_buf_size = shm_size;
+		dest_buf_size = shm_size;
+	}
 
 	while (1) {
 		if (v4lconvert_helper_read(STDIN_FILENO, &width, sizeof(int), argv[0]))
@@ -630,13 +641,15 @@ int main(int argc, char *argv[])
 		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (src_size > sizeof(src_buf)) {
+		if (src_size > src_buf_size) {
 			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
 					argv[0], src_size);
 			return 2;
 		}
 
-		if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
+		/* In shm mode the source frame is already in place */
+		if (!shm_size &&
+		    v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
 
@@ -645,7 +658,7 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "%s: error: width or height out of bounds\n",
 					argv[0]);
 			dest_size = -1;
-		} else if (dest_size > sizeof(dest_buf)) {
+		} else if (dest_size > dest_buf_size) {
 			fprintf(stderr, "%s: error: dest_buf too small, need: %d\n",
 					argv[0], dest_size);
 			dest_size = -1;
@@ -657,7 +670,7 @@ int main(int argc, char *argv[])
 					argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (dest_size == -1)
+		if (dest_size == -1 || shm_size)
 			continue;
 
 		if (v4lconvert_helper_write(STDOUT_FILENO, dest_buf, dest_size, argv[0]))
@@ -438,6 +438,74 @@ static const struct tree_node treeUVDC[] = {
 
 /* If no node is found, coeffbits and skip will not be modified */
 /* Return: Depth of node found, or -1 if invalid input code */
+/* Decoding a symbol by chasing tree nodes costs a branch per code bit.
+ * Since nearly all codes are short, a table indexed by the top
+ * LOOKUP_BITS input bits resolves them in a single hit; only the rare
+ * longer codes fall back to the tree walk (depth 0 marks those).
+ * Invalid prefixes are stored as depth -1 with zeroed coeffbits/skip,
+ * matching what the tree walk leaves behind in that case. */
+#define LOOKUP_BITS 10
+
+struct lookup_entry {
+	signed char depth;	/* Code length, 0 = fall back, -1 = invalid */
+	signed char coeffbits;
+	signed char skip;
+	char padding;
+};
+
+static struct lookup_entry lookupYAC[1 << LOOKUP_BITS];
+static struct lookup_entry lookupUVAC[1 << LOOKUP_BITS];
+static struct lookup_entry lookupYDC[1 << LOOKUP_BITS];
+static struct lookup_entry lookupUVDC[1 << LOOKUP_BITS];
+
+static void
+buildLookupTable(struct lookup_entry *lut, const struct tree_node *tree)
+{
+	unsigned int code;
+
+	for (code = 0; code < (1 << LOOKUP_BITS); code++) {
+		unsigned int in = code << (32 - LOOKUP_BITS);
+		struct lookup_entry e = { 0, 0, 0, 0 };
+		int node = 0;
+		int i = 0;
+		int depth;
+
+		do {
+			if ((in & 0x80000000) == 0)
+				node = tree[node].left;
+			else
+				node = tree[node].right;
+
+			if (node == -1) {
+				e.depth = -1;
+				break;
+			}
+
+			depth = tree[node].depth;
+			if (depth != -1) {
+				e.depth = depth;
+				e.coeffbits = tree[node].coeffbits;
+				e.skip = tree[node].skip;
+				break;
+			}
+
+			in <<= 1;
+			++i;
+		} while (i < LOOKUP_BITS);
+
+		lut[code] = e;
+	}
+}
+
+static void
+buildLookupTables(void)
+{
+	buildLookupTable(lookupYAC, treeYAC);
+	buildLookupTable(lookupUVAC, treeUVAC);
+	buildLookupTable(lookupYDC, treeYDC);
+	buildLookupTable(lookupUVDC, treeUVDC);
+}
+
 static int
 getNodeAC(unsigned int in, signed char *coeffbits, signed char *skip,
 		const struct tree_node *tree)
@@ -566,14 +634,22 @@ getBytes(int *rawData, struct comp_info *cinfo)
 
 static int
 getACCoefficient(int *rawData, int *coeff, struct comp_info *cinfo,
-		const struct tree_node *tree)
+		const struct tree_node *tree, const struct lookup_entry *lut)
 {
 	int input, bits, bytes, tmp_c;
 	signed char coeffbits = 0;
 	signed char skip = 0;
+	const struct lookup_entry *e;
 
 	input = getBytes(rawData, cinfo);
-	bits = getNodeAC(input, &coeffbits, &skip, tree);
+	e = &lut[(unsigned int)input >> (32 - LOOKUP_BITS)];
+	if (e->depth) {
+		bits = e->depth;
+		coeffbits = e->coeffbits;
+		skip = e->skip;
+	} else {
+		bits = getNodeAC(input, &coeffbits, &skip, tree);
+	}
 
 	if (coeffbits) {
 		input = input << (bits - 1);
@@ -598,13 +674,20 @@ getACCoefficient(int *rawData, int *coeff, struct comp_info *cinfo,
 
 static void
 getDCCoefficient(int *rawData, int *coeff, struct comp_info *cinfo,
-		const struct tree_node *tree)
+		const struct tree_node *tree, const struct lookup_entry *lut)
 {
 	int input, bits, bytes, tmp_c;
 	signed char coeffbits = 0;
+	const struct lookup_entry *e;
 
 	input = getBytes(rawData, cinfo);
-	bits = getNodeDC(input, &coeffbits, tree);
+	e = &lut[(unsigned int)input >> (32 - LOOKUP_BITS)];
+	if (e->depth) {
+		bits = e->depth;
+		coeffbits = e->coeffbits;
+	} else {
+		bits = getNodeDC(input, &coeffbits, tree);
+	}
 
 	if (bits == -1) {
 		bits = 1;	/* Try to re-sync at the next bit */
@@ -645,11 +728,11 @@ huffmanDecoderY(int *C, int *pIn, struct comp_info *cinfo)
 	int i = 1;
 	int k, skip;
 
-	getDCCoefficient(pIn, C, cinfo, treeYDC);
+	getDCCoefficient(pIn, C, cinfo, treeYDC, lookupYDC);
 
 	i = 1;
 	do {
-		skip = getACCoefficient(pIn, &coeff, cinfo, treeYAC);
+		skip = getACCoefficient(pIn, &coeff, cinfo, treeYAC, lookupYAC);
 
 		if (skip == -1) {
 			break;
@@ -679,7 +762,7 @@ huffmanDecoderY(int *C, int *pIn, struct comp_info *cinfo)
 		while (i <= 31)
 			C[i++] = 0;
 	else
-		getACCoefficient(pIn, &coeff, cinfo, treeYAC);
+		getACCoefficient(pIn, &coeff, cinfo, treeYAC, lookupYAC);
 }
 
 /* Same as huffmanDecoderY, except for the tables used */
@@ -690,11 +773,11 @@ huffmanDecoderUV(int *C, int *pIn, struct comp_info *cinfo)
 	int i = 1;
 	int k, skip;
 
-	getDCCoefficient(pIn, C, cinfo, treeUVDC);
+	getDCCoefficient(pIn, C, cinfo, treeUVDC, lookupUVDC);
 
 	i = 1;
 	do {
-		skip = getACCoefficient(pIn, &coeff, cinfo, treeUVAC);
+		skip = getACCoefficient(pIn, &coeff, cinfo, treeUVAC, lookupUVAC);
 
 		if (skip == -1) {
 			break;
@@ -724,7 +807,7 @@ huffmanDecoderUV(int *C, int *pIn, struct comp_info *cinfo)
 		while (i <= 31)
 			C[i++] = 0;
 	else
-		getACCoefficient(pIn, &coeff, cinfo, treeUVAC);
+		getACCoefficient(pIn, &coeff, cinfo, treeUVAC, lookupUVAC);
 }
 
 /******************************************************************************
@@ -1430,8 +1513,21 @@ static int v4lconvert_ov518_to_yuv420(unsigned char *src, unsigned char *dst,
 int main(int argc, char *argv[])
 {
 	int width, height, yvu, src_size, dest_size;
-	unsigned char src_buf[200000];
-	unsigned char dest_buf[500000];
+	unsigned char pipe_src_buf[200000];
+	unsigned char pipe_dest_buf[500000];
+	unsigned char *src_buf = pipe_src_buf;
+	unsigned char *dest_buf = pipe_dest_buf;
+	int src_buf_size = sizeof(pipe_src_buf);
+	int dest_buf_size = sizeof(pipe_dest_buf);
+	int shm_size = v4lconvert_helper_get_shm(argc, argv,
+			&src_buf, &dest_buf);
+
+	buildLookupTables();
+
+	if (shm_size) {
+		src_buf_size = shm_size;
+		dest_buf_size = shm_size;
+	}
 
 	while (1) {
 		if (v4lconvert_helper_read(STDIN_FILENO, &width, sizeof(int), argv[0]))
@@ -1446,13 +1542,15 @@ int main(int argc, char *argv[])
 		if (v4lconvert_helper_read(STDIN_FILENO, &src_size, sizeof(int), argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (src_size > sizeof(src_buf)) {
+		if (src_size > src_buf_size) {
 			fprintf(stderr, "%s: error: src_buf too small, need: %d\n",
 					argv[0], src_size);
 			return 2;
 		}
 
-		if (v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
+		/* In shm mode the source frame is already in place */
+		if (!shm_size &&
+		    v4lconvert_helper_read(STDIN_FILENO, src_buf, src_size, argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
 
@@ -1461,7 +1559,7 @@ int main(int argc, char *argv[])
 			fprintf(stderr, "%s: error: width or height out of bounds\n",
 					argv[0]);
 			dest_size = -1;
-		} else if (dest_size > sizeof(dest_buf)) {
+		} else if (dest_size > dest_buf_size) {
 			fprintf(stderr, "%s: error: dest_buf too small, need: %d\n",
 					argv[0], dest_size);
 			dest_size = -1;
@@ -1473,7 +1571,7 @@ int main(int argc, char *argv[])
 					argv[0]))
 			return 1; /* Erm, no way to recover without loosing sync with libv4l */
 
-		if (dest_size == -1)
+		if (dest_size == -1 || shm_size)
 			continue;
 
 		if (v4lconvert_helper_write(STDOUT_FILENO, dest_buf, dest_size, argv[0]))
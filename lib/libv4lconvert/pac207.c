@@ -151,6 +151,62 @@ pac_decompress_row(const unsigned char *inp, unsigned char *outp, int width,
 	return 2 * ((bitpos + 15) / 16);
 }
 
+void v4lconvert_pac207_row_decoder_init(
+		struct v4lconvert_pac207_row_decoder *pac207,
+		const unsigned char *src, int src_size)
+{
+	pac207->inp = src;
+	pac207->end = src + src_size;
+	pac207->bad_header = 0;
+}
+
+/* Decode one bayer row; outp[-2 * width] must be addressable so that the
+   repeat-line marker can copy the previous row of the same bayer colors.
+   Returns 0 on success, -1 on a truncated frame, -2 on an unknown row
+   header (stored in pac207->bad_header for error reporting). */
+int v4lconvert_pac207_decode_row(void *ctx, unsigned char *outp,
+		int width, int row)
+{
+	struct v4lconvert_pac207_row_decoder *pac207 = ctx;
+	const unsigned char *inp = pac207->inp;
+	unsigned short word;
+
+	if ((inp + 2) > pac207->end)
+		return -1;
+
+	word = getShort(inp);
+	switch (word) {
+	case 0x0FF0:
+		memcpy(outp, inp + 2, width);
+		inp += (2 + width);
+		break;
+	case 0x1EE1:
+		inp += pac_decompress_row(inp, outp, width, 5, 6);
+		break;
+
+	case 0x2DD2:
+		inp += pac_decompress_row(inp, outp, width, 9, 5);
+		break;
+
+	case 0x3CC3:
+		inp += pac_decompress_row(inp, outp, width, 17, 4);
+		break;
+
+	case 0x4BB4:
+		/* skip or copy line? */
+		memcpy(outp, outp - 2 * width, width);
+		inp += 2;
+		break;
+
+	default: /* corrupt frame */
+		pac207->bad_header = word;
+		return -2;
+	}
+
+	pac207->inp = inp;
+	return 0;
+}
+
 int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 		const unsigned char *inp, int src_size, unsigned char *outp,
 		int width, int height)
@@ -159,42 +215,20 @@ int v4lconvert_decode_pac207(struct v4lconvert_data *data,
 	   in myframe->data and return a GBRG pattern in frame->tmpbuffer
 	   remove the header then copy line by line EOL is set with 0x0f 0xf0 marker
 	   or 0x1e 0xe1 for compressed line*/
-	const unsigned char *end = inp + src_size;
-	unsigned short word;
+	struct v4lconvert_pac207_row_decoder pac207;
 	int row;
 
+	v4lconvert_pac207_row_decoder_init(&pac207, inp, src_size);
+
 	/* iterate over all rows */
 	for (row = 0; row < height; row++) {
-		if ((inp + 2) > end) {
+		switch (v4lconvert_pac207_decode_row(&pac207, outp, width, row)) {
+		case -1:
 			V4LCONVERT_ERR("incomplete pac207 frame\n");
 			return -1;
-		}
-		word = getShort(inp);
-		switch (word) {
-		case 0x0FF0:
-			memcpy(outp, inp + 2, width);
-			inp += (2 + width);
-			break;
-		case 0x1EE1:
-			inp += pac_decompress_row(inp, outp, width, 5, 6);
-			break;
-
-		case 0x2DD2:
-			inp += pac_decompress_row(inp, outp, width, 9, 5);
-			break;
-
-		case 0x3CC3:
-			inp += pac_decompress_row(inp, outp, width, 17, 4);
-			break;
-
-		case 0x4BB4:
-			/* skip or copy line? */
-			memcpy(outp, outp - 2 * width, width);
-			inp += 2;
-			break;
-
-		default: /* corrupt frame */
-			V4LCONVERT_ERR("unknown pac207 row header: 0x%04x\n", (int)word);
+		case -2:
+			V4LCONVERT_ERR("unknown pac207 row header: 0x%04x\n",
+					(int)pac207.bad_header);
 			return -1;
 		}
 		outp += width;
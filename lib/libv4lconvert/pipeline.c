@@ -0,0 +1,185 @@
+/*
+
+# Pipelined (submit / collect) frame conversion
+
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as published by
+# the Free Software Foundation; either version 2.1 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Lesser General Public License for more details.
+#
+# You should have received a copy of the GNU Lesser General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
+
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "libv4lconvert-priv.h"
+
+/*
+ * One worker thread runs v4lconvert_convert() for the frame handed over by
+ * v4lconvert_convert_submit(), so that decoding frame N overlaps with the
+ * caller consuming frame N - 1.  At most one frame is in flight; the worker
+ * has exclusive use of the v4lconvert_data context (scratch arena, decoder
+ * state, error message) between submit and collect.
+ */
+
+enum v4lconvert_pipeline_state {
+	V4L_PIPELINE_IDLE,
+	V4L_PIPELINE_PENDING,
+	V4L_PIPELINE_DONE,
+};
+
+struct v4lconvert_pipeline {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thread;
+	int stop;
+	enum v4lconvert_pipeline_state state;
+	/* current frame, owned by the worker until it is collected */
+	struct v4lconvert_data *data;
+	struct v4l2_format src_fmt;
+	struct v4l2_format dest_fmt;
+	unsigned char *src;
+	int src_size;
+	unsigned char *dest;
+	int dest_size;
+	int result;
+	int err;
+};
+
+static void *v4lconvert_pipeline_worker(void *arg)
+{
+	struct v4lconvert_pipeline *pipeline = arg;
+
+	pthread_mutex_lock(&pipeline->lock);
+	while (!pipeline->stop) {
+		if (pipeline->state != V4L_PIPELINE_PENDING) {
+			pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&pipeline->lock);
+
+		errno = 0;
+		pipeline->result = v4lconvert_convert(pipeline->data,
+				&pipeline->src_fmt, &pipeline->dest_fmt,
+				pipeline->src, pipeline->src_size,
+				pipeline->dest, pipeline->dest_size);
+		pipeline->err = errno;
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->state = V4L_PIPELINE_DONE;
+		pthread_cond_signal(&pipeline->cond);
+	}
+	pthread_mutex_unlock(&pipeline->lock);
+	return NULL;
+}
+
+static struct v4lconvert_pipeline *v4lconvert_pipeline_create(
+		struct v4lconvert_data *data)
+{
+	struct v4lconvert_pipeline *pipeline;
+
+	pipeline = calloc(1, sizeof(*pipeline));
+	if (!pipeline)
+		return NULL;
+
+	pipeline->data = data;
+	pthread_mutex_init(&pipeline->lock, NULL);
+	pthread_cond_init(&pipeline->cond, NULL);
+
+	if (pthread_create(&pipeline->thread, NULL,
+			   v4lconvert_pipeline_worker, pipeline)) {
+		pthread_mutex_destroy(&pipeline->lock);
+		pthread_cond_destroy(&pipeline->cond);
+		free(pipeline);
+		return NULL;
+	}
+	return pipeline;
+}
+
+void v4lconvert_pipeline_destroy(struct v4lconvert_pipeline *pipeline)
+{
+	if (!pipeline)
+		return;
+
+	/* wait for an uncollected frame, then stop the worker */
+	pthread_mutex_lock(&pipeline->lock);
+	pipeline->stop = 1;
+	pthread_cond_broadcast(&pipeline->cond);
+	pthread_mutex_unlock(&pipeline->lock);
+	pthread_join(pipeline->thread, NULL);
+
+	pthread_mutex_destroy(&pipeline->lock);
+	pthread_cond_destroy(&pipeline->cond);
+	free(pipeline);
+}
+
+int v4lconvert_convert_submit(struct v4lconvert_data *data,
+		const struct v4l2_format *src_fmt,
+		const struct v4l2_format *dest_fmt,
+		unsigned char *src, int src_size,
+		unsigned char *dest, int dest_size)
+{
+	struct v4lconvert_pipeline *pipeline = data->pipeline;
+
+	if (!pipeline) {
+		pipeline = v4lconvert_pipeline_create(data);
+		if (!pipeline)
+			return v4lconvert_oom_error(data);
+		data->pipeline = pipeline;
+	}
+
+	pthread_mutex_lock(&pipeline->lock);
+	if (pipeline->state != V4L_PIPELINE_IDLE) {
+		pthread_mutex_unlock(&pipeline->lock);
+		V4LCONVERT_ERR("submitted frame has not been collected yet\n");
+		errno = EBUSY;
+		return -1;
+	}
+	pipeline->src_fmt = *src_fmt;
+	pipeline->dest_fmt = *dest_fmt;
+	pipeline->src = src;
+	pipeline->src_size = src_size;
+	pipeline->dest = dest;
+	pipeline->dest_size = dest_size;
+	pipeline->state = V4L_PIPELINE_PENDING;
+	pthread_cond_signal(&pipeline->cond);
+	pthread_mutex_unlock(&pipeline->lock);
+	return 0;
+}
+
+int v4lconvert_convert_collect(struct v4lconvert_data *data)
+{
+	struct v4lconvert_pipeline *pipeline = data->pipeline;
+	int result;
+
+	if (!pipeline) {
+		V4LCONVERT_ERR("no frame has been submitted\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	pthread_mutex_lock(&pipeline->lock);
+	if (pipeline->state == V4L_PIPELINE_IDLE) {
+		pthread_mutex_unlock(&pipeline->lock);
+		V4LCONVERT_ERR("no frame has been submitted\n");
+		errno = EINVAL;
+		return -1;
+	}
+	while (pipeline->state != V4L_PIPELINE_DONE)
+		pthread_cond_wait(&pipeline->cond, &pipeline->lock);
+	pipeline->state = V4L_PIPELINE_IDLE;
+	result = pipeline->result;
+	if (result < 0)
+		errno = pipeline->err;
+	pthread_mutex_unlock(&pipeline->lock);
+	return result;
+}
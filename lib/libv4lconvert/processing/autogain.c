@@ -138,6 +138,18 @@ static int autogain_calculate_lookup_tables(
 		break;
 	}
 
+	/* Exponentially smooth the measured luminance over the (decimated)
+	   analysis frames, so a single noisy or flickering frame does not
+	   yank gain/exposure around between measurements */
+	if (!data->avg_lum_valid) {
+		data->avg_lum_filtered = avg_lum << 8;
+		data->avg_lum_valid = 1;
+	} else {
+		data->avg_lum_filtered +=
+			((avg_lum << 8) - data->avg_lum_filtered) / 2;
+	}
+	avg_lum = (data->avg_lum_filtered + 128) >> 8;
+
 	/* If we are off a multiple of deadzone, do multiple steps to reach the
 	   desired lumination fast (with the risc of a slight overshoot) */
 	target = v4lcontrol_get_ctrl(data->control, V4LCONTROL_AUTOGAIN_TARGET);
@@ -196,7 +208,8 @@ static int autogain_calculate_lookup_tables(
 		   skip the next frame as that is still captured with the old settings,
 		   and another one just to be sure (because if we re-adjust based
 		   on the old settings we might overshoot). */
-		data->lookup_table_update_counter = V4L2PROCESSING_UPDATE_RATE - 2;
+		data->lookup_table_update_counter =
+			data->update_rate > 2 ? data->update_rate - 2 : 0;
 	}
 
 	if (gain != orig_gain) {
@@ -34,9 +34,13 @@ struct v4lprocessing_data {
 	/* True if any of the lookup tables does not contain
 	   linear 0-255 */
 	int lookup_table_active;
-	/* Counts the number of processed frames until a
-	   V4L2PROCESSING_UPDATE_RATE overflow happens */
+	/* Counts the number of processed frames until an
+	   update_rate overflow happens */
 	int lookup_table_update_counter;
+	/* Analysis decimation: frames between measuring filter updates,
+	   defaults to V4L2PROCESSING_UPDATE_RATE, settable through the
+	   LIBV4L_PROCESSING_UPDATE_RATE environment variable */
+	int update_rate;
 	/* RGB/BGR lookup tables */
 	unsigned char comp1[256];
 	unsigned char green[256];
@@ -51,6 +55,9 @@ struct v4lprocessing_data {
 	unsigned char gamma_table[256];
 	/* autogain.c data */
 	int last_gain_correction;
+	/* Exponentially smoothed measured luminance, 8.8 fixed point */
+	int avg_lum_filtered;
+	int avg_lum_valid;
 };
 
 struct v4lprocessing_filter {
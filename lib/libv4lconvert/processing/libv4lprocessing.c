@@ -46,6 +46,19 @@ struct v4lprocessing_data *v4lprocessing_create(int fd, struct v4lcontrol_data *
 	data->fd = fd;
 	data->control = control;
 
+	/* The per-pixel correction is applied every frame from the cached
+	   lookup tables, but the measuring filters only need fresh
+	   statistics at a few Hz; let deployments trade control-loop
+	   reaction time against analysis cost */
+	data->update_rate = V4L2PROCESSING_UPDATE_RATE;
+	if (getenv("LIBV4L_PROCESSING_UPDATE_RATE")) {
+		data->update_rate = atoi(getenv("LIBV4L_PROCESSING_UPDATE_RATE"));
+		if (data->update_rate < 1)
+			data->update_rate = 1;
+		else if (data->update_rate > 100)
+			data->update_rate = 100;
+	}
+
 	return data;
 }
 
@@ -69,6 +82,11 @@ int v4lprocessing_pre_processing(struct v4lprocessing_data *data)
 	return data->do_process;
 }
 
+int v4lprocessing_active(struct v4lprocessing_data *data)
+{
+	return data->do_process;
+}
+
 static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
@@ -89,65 +107,162 @@ static void v4lprocessing_update_lookup_tables(struct v4lprocessing_data *data,
 	}
 }
 
+/*
+ * The lookup tables are applied with NEON tbl instructions on aarch64: a
+ * 256 byte table lookup is 4 chained vqtbl4q_u8 (64 entries each), out of
+ * range indices yield 0 so the partial results can simply be or-ed
+ * together.  x86 has no byte gather below AVX-512, there the plain C
+ * loops are kept.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable vqtbl4q_u8 support */
+#elif defined(__aarch64__)
+#define V4LPROCESSING_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#ifdef V4LPROCESSING_NEON_SIMD
+
+struct v4lprocessing_neon_lut {
+	uint8x16x4_t t[4];
+};
+
+static void v4lprocessing_neon_lut_load(struct v4lprocessing_neon_lut *l,
+		const unsigned char *lut)
+{
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		l->t[i].val[0] = vld1q_u8(lut);
+		l->t[i].val[1] = vld1q_u8(lut + 16);
+		l->t[i].val[2] = vld1q_u8(lut + 32);
+		l->t[i].val[3] = vld1q_u8(lut + 48);
+		lut += 64;
+	}
+}
+
+static uint8x16_t v4lprocessing_neon_lut_lookup(
+		const struct v4lprocessing_neon_lut *l, uint8x16_t idx)
+{
+	const uint8x16_t c64 = vdupq_n_u8(64);
+	uint8x16_t res;
+
+	res = vqtbl4q_u8(l->t[0], idx);
+	idx = vsubq_u8(idx, c64);
+	res = vorrq_u8(res, vqtbl4q_u8(l->t[1], idx));
+	idx = vsubq_u8(idx, c64);
+	res = vorrq_u8(res, vqtbl4q_u8(l->t[2], idx));
+	idx = vsubq_u8(idx, c64);
+	res = vorrq_u8(res, vqtbl4q_u8(l->t[3], idx));
+	return res;
+}
+
+#endif /* V4LPROCESSING_NEON_SIMD */
+
+/* Apply lut_a to the even and lut_b to the odd bytes of n byte pairs */
+static unsigned char *v4lprocessing_lut_pairs(unsigned char *buf, int n,
+		const unsigned char *lut_a, const unsigned char *lut_b)
+{
+#ifdef V4LPROCESSING_NEON_SIMD
+	if (n >= 16) {
+		struct v4lprocessing_neon_lut la, lb;
+
+		v4lprocessing_neon_lut_load(&la, lut_a);
+		v4lprocessing_neon_lut_load(&lb, lut_b);
+		for (; n >= 16; n -= 16) {
+			uint8x16x2_t px = vld2q_u8(buf);
+
+			px.val[0] = v4lprocessing_neon_lut_lookup(&la,
+					px.val[0]);
+			px.val[1] = v4lprocessing_neon_lut_lookup(&lb,
+					px.val[1]);
+			vst2q_u8(buf, px);
+			buf += 32;
+		}
+	}
+#endif
+	while (n--) {
+		*buf = lut_a[*buf];
+		buf++;
+		*buf = lut_b[*buf];
+		buf++;
+	}
+	return buf;
+}
+
+/* Apply the comp1 / green / comp2 luts to n RGB or BGR pixels */
+static unsigned char *v4lprocessing_lut_rgb(struct v4lprocessing_data *data,
+		unsigned char *buf, int n)
+{
+#ifdef V4LPROCESSING_NEON_SIMD
+	if (n >= 16) {
+		struct v4lprocessing_neon_lut l1, lg, l2;
+
+		v4lprocessing_neon_lut_load(&l1, data->comp1);
+		v4lprocessing_neon_lut_load(&lg, data->green);
+		v4lprocessing_neon_lut_load(&l2, data->comp2);
+		for (; n >= 16; n -= 16) {
+			uint8x16x3_t px = vld3q_u8(buf);
+
+			px.val[0] = v4lprocessing_neon_lut_lookup(&l1,
+					px.val[0]);
+			px.val[1] = v4lprocessing_neon_lut_lookup(&lg,
+					px.val[1]);
+			px.val[2] = v4lprocessing_neon_lut_lookup(&l2,
+					px.val[2]);
+			vst3q_u8(buf, px);
+			buf += 48;
+		}
+	}
+#endif
+	while (n--) {
+		*buf = data->comp1[*buf];
+		buf++;
+		*buf = data->green[*buf];
+		buf++;
+		*buf = data->comp2[*buf];
+		buf++;
+	}
+	return buf;
+}
+
 static void v4lprocessing_do_processing(struct v4lprocessing_data *data,
 		unsigned char *buf, const struct v4l2_format *fmt)
 {
-	int x, y;
+	int y;
+	int pad = fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
 
 	switch (fmt->fmt.pix.pixelformat) {
 	case V4L2_PIX_FMT_SGBRG8:
 	case V4L2_PIX_FMT_SGRBG8: /* Bayer patterns starting with green */
 		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp1[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->comp2[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
+			buf = v4lprocessing_lut_pairs(buf,
+					fmt->fmt.pix.width / 2,
+					data->green, data->comp1) + pad;
+			buf = v4lprocessing_lut_pairs(buf,
+					fmt->fmt.pix.width / 2,
+					data->comp2, data->green) + pad;
 		}
 		break;
 
 	case V4L2_PIX_FMT_SBGGR8:
 	case V4L2_PIX_FMT_SRGGB8: /* Bayer patterns *NOT* starting with green */
 		for (y = 0; y < fmt->fmt.pix.height / 2; y++) {
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->comp1[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
-			for (x = 0; x < fmt->fmt.pix.width / 2; x++) {
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp2[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - fmt->fmt.pix.width;
+			buf = v4lprocessing_lut_pairs(buf,
+					fmt->fmt.pix.width / 2,
+					data->comp1, data->green) + pad;
+			buf = v4lprocessing_lut_pairs(buf,
+					fmt->fmt.pix.width / 2,
+					data->green, data->comp2) + pad;
 		}
 		break;
 
 	case V4L2_PIX_FMT_RGB24:
 	case V4L2_PIX_FMT_BGR24:
-		for (y = 0; y < fmt->fmt.pix.height; y++) {
-			for (x = 0; x < fmt->fmt.pix.width; x++) {
-				*buf = data->comp1[*buf];
-				buf++;
-				*buf = data->green[*buf];
-				buf++;
-				*buf = data->comp2[*buf];
-				buf++;
-			}
-			buf += fmt->fmt.pix.bytesperline - 3 * fmt->fmt.pix.width;
-		}
+		pad = fmt->fmt.pix.bytesperline - 3 * fmt->fmt.pix.width;
+		for (y = 0; y < fmt->fmt.pix.height; y++)
+			buf = v4lprocessing_lut_rgb(data, buf,
+					fmt->fmt.pix.width) + pad;
 		break;
 	}
 }
@@ -172,13 +287,17 @@ void v4lprocessing_processing(struct v4lprocessing_data *data,
 	}
 
 	if (data->controls_changed ||
-			data->lookup_table_update_counter == V4L2PROCESSING_UPDATE_RATE) {
+			data->lookup_table_update_counter >= data->update_rate) {
 		data->controls_changed = 0;
 		data->lookup_table_update_counter = 0;
 		/* Do this after resetting lookup_table_update_counter so that filters can
 		   force the next update to be sooner when they changed camera settings */
 		v4lprocessing_update_lookup_tables(data, buf, fmt);
-	} else
+	} else if (whitebalance_filter.active(data) ||
+			autogain_filter.active(data))
+		/* Only the filters which measure the frame need their tables
+		   refreshed periodically, a pure gamma table can stay until
+		   the control changes */
 		data->lookup_table_update_counter++;
 
 	if (data->lookup_table_active)
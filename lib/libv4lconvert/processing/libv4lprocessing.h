@@ -38,6 +38,12 @@ void v4lprocessing_destroy(struct v4lprocessing_data *data);
    return 0 if no processing will be done */
 int v4lprocessing_pre_processing(struct v4lprocessing_data *data);
 
+/* Returns what the last v4lprocessing_pre_processing() call returned,
+   without re-evaluating the filters or touching the changed-controls
+   state; lets the conversion code pick paths that bypass the
+   intermediate buffer processing operates on */
+int v4lprocessing_active(struct v4lprocessing_data *data);
+
 /* Do the actual processing, this is a nop if v4lprocessing_pre_processing()
    returned 0, or if called more than 1 time after a single
    v4lprocessing_pre_processing() call. */
@@ -92,8 +92,528 @@ void v4lconvert_rgb24_to_yuv420(const unsigned char *src, unsigned char *dest,
 
 #define CLIP(color) (unsigned char)(((color) > 0xFF) ? 0xff : (((color) < 0) ? 0 : (color)))
 
+/*
+ * SIMD kernels for the hottest YUV -> RGB24 conversions, with runtime CPU
+ * feature detection (SSSE3/AVX2 on x86, NEON on ARM).  These use the same
+ * multiplication free approximation as the scalar fast paths below:
+ *
+ *	u1 = 129 * (u - 128) / 64
+ *	rg = (3 * (u - 128) + 6 * (v - 128)) / 8
+ *	v1 = 3 * (v - 128) / 2
+ *
+ * All intermediates fit in 16 bits, so 8 (SSE) resp. 16 (AVX2/NEON) pixels
+ * are converted per arithmetic step.  The public entry points fall back to
+ * the plain C loops when no suitable instruction set is available.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V4LCONVERT_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#ifdef V4LCONVERT_X86_SIMD
+
+/* u/v are per pixel pair; duplicate each 16 bit lane to get them per pixel */
+#define V4L_UDUP 0, 1, 0, 1, 4, 5, 4, 5, 8, 9, 8, 9, 12, 13, 12, 13
+#define V4L_VDUP 2, 3, 2, 3, 6, 7, 6, 7, 10, 11, 10, 11, 14, 15, 14, 15
+
+/* 8 pixels: y, u, v epi16 vectors (chroma already per pixel) -> r, g, b */
+#define V4L_YUV16_TO_RGB16(y, u, v, r, g, b)				\
+do {									\
+	__m128i u_ = _mm_sub_epi16(u, _mm_set1_epi16(128));		\
+	__m128i v_ = _mm_sub_epi16(v, _mm_set1_epi16(128));		\
+	__m128i u1 = _mm_srai_epi16(_mm_mullo_epi16(u_,			\
+				_mm_set1_epi16(129)), 6);		\
+	__m128i rg = _mm_srai_epi16(_mm_add_epi16(			\
+				_mm_mullo_epi16(u_, _mm_set1_epi16(3)),	\
+				_mm_mullo_epi16(v_, _mm_set1_epi16(6))), 3); \
+	__m128i v1 = _mm_srai_epi16(_mm_mullo_epi16(v_,			\
+				_mm_set1_epi16(3)), 1);			\
+	r = _mm_add_epi16(y, v1);					\
+	g = _mm_sub_epi16(y, rg);					\
+	b = _mm_add_epi16(y, u1);					\
+} while (0)
+
+/* Same, on 16 pixels at once */
+#define V4L_YUV16X16_TO_RGB16(y, u, v, r, g, b)				\
+do {									\
+	__m256i u_ = _mm256_sub_epi16(u, _mm256_set1_epi16(128));	\
+	__m256i v_ = _mm256_sub_epi16(v, _mm256_set1_epi16(128));	\
+	__m256i u1 = _mm256_srai_epi16(_mm256_mullo_epi16(u_,		\
+				_mm256_set1_epi16(129)), 6);		\
+	__m256i rg = _mm256_srai_epi16(_mm256_add_epi16(		\
+			_mm256_mullo_epi16(u_, _mm256_set1_epi16(3)),	\
+			_mm256_mullo_epi16(v_, _mm256_set1_epi16(6))), 3); \
+	__m256i v1 = _mm256_srai_epi16(_mm256_mullo_epi16(v_,		\
+				_mm256_set1_epi16(3)), 1);		\
+	r = _mm256_add_epi16(y, v1);					\
+	g = _mm256_sub_epi16(y, rg);					\
+	b = _mm256_add_epi16(y, u1);					\
+} while (0)
+
+/* Interleave 3 x 16 r/g/b bytes into 48 bytes of packed RGB24 */
+#define V4L_STORE_RGB24(dest, r, g, b)					\
+do {									\
+	__m128i o0 = _mm_or_si128(_mm_or_si128(				\
+		_mm_shuffle_epi8(r, _mm_setr_epi8(0, -1, -1, 1, -1, -1,	\
+			2, -1, -1, 3, -1, -1, 4, -1, -1, 5)),		\
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, 0, -1, -1, 1, -1,	\
+			-1, 2, -1, -1, 3, -1, -1, 4, -1, -1))),		\
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, 0, -1, -1, 1,	\
+			-1, -1, 2, -1, -1, 3, -1, -1, 4, -1)));		\
+	__m128i o1 = _mm_or_si128(_mm_or_si128(				\
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, -1, 6, -1, -1, 7,	\
+			-1, -1, 8, -1, -1, 9, -1, -1, 10, -1)),		\
+		_mm_shuffle_epi8(g, _mm_setr_epi8(5, -1, -1, 6, -1, -1,	\
+			7, -1, -1, 8, -1, -1, 9, -1, -1, 10))),		\
+		_mm_shuffle_epi8(b, _mm_setr_epi8(-1, 5, -1, -1, 6, -1,	\
+			-1, 7, -1, -1, 8, -1, -1, 9, -1, -1)));		\
+	__m128i o2 = _mm_or_si128(_mm_or_si128(				\
+		_mm_shuffle_epi8(r, _mm_setr_epi8(-1, 11, -1, -1, 12, -1, \
+			-1, 13, -1, -1, 14, -1, -1, 15, -1, -1)),	\
+		_mm_shuffle_epi8(g, _mm_setr_epi8(-1, -1, 11, -1, -1, 12, \
+			-1, -1, 13, -1, -1, 14, -1, -1, 15, -1))),	\
+		_mm_shuffle_epi8(b, _mm_setr_epi8(10, -1, -1, 11, -1, -1, \
+			12, -1, -1, 13, -1, -1, 14, -1, -1, 15)));	\
+	_mm_storeu_si128((__m128i *)(dest), o0);			\
+	_mm_storeu_si128((__m128i *)(dest) + 1, o1);			\
+	_mm_storeu_si128((__m128i *)(dest) + 2, o2);			\
+} while (0)
+
+__attribute__((target("ssse3")))
+static void v4lconvert_packed_yuv_to_rgb24_ssse3(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int uyvy)
+{
+	int j;
+
+	while (--height >= 0) {
+		const unsigned char *s = src;
+
+		for (j = 0; j + 15 < width; j += 16) {
+			__m128i r[2], g[2], b[2], R, G, B;
+			int half;
+
+			for (half = 0; half < 2; half++) {
+				__m128i p = _mm_loadu_si128(
+						(const __m128i *)(s + 16 * half));
+				__m128i y, c, u, v;
+
+				if (uyvy) {
+					y = _mm_srli_epi16(p, 8);
+					c = _mm_and_si128(p,
+						_mm_set1_epi16(0x00ff));
+				} else {
+					y = _mm_and_si128(p,
+						_mm_set1_epi16(0x00ff));
+					c = _mm_srli_epi16(p, 8);
+				}
+				u = _mm_shuffle_epi8(c,
+					_mm_setr_epi8(V4L_UDUP));
+				v = _mm_shuffle_epi8(c,
+					_mm_setr_epi8(V4L_VDUP));
+				V4L_YUV16_TO_RGB16(y, u, v, r[half], g[half],
+						   b[half]);
+			}
+			R = _mm_packus_epi16(r[0], r[1]);
+			G = _mm_packus_epi16(g[0], g[1]);
+			B = _mm_packus_epi16(b[0], b[1]);
+			V4L_STORE_RGB24(dest, R, G, B);
+			s += 32;
+			dest += 48;
+		}
+		for (; j + 1 < width; j += 2) {
+			int u = uyvy ? s[0] : s[1];
+			int v = uyvy ? s[2] : s[3];
+			int y0 = uyvy ? s[1] : s[0];
+			int y1 = uyvy ? s[3] : s[2];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+			*dest++ = CLIP(y0 + v1);
+			*dest++ = CLIP(y0 - rg);
+			*dest++ = CLIP(y0 + u1);
+
+			*dest++ = CLIP(y1 + v1);
+			*dest++ = CLIP(y1 - rg);
+			*dest++ = CLIP(y1 + u1);
+			s += 4;
+		}
+		src += stride;
+		dest += dest_stride - j * 3;
+	}
+}
+
+__attribute__((target("avx2")))
+static void v4lconvert_packed_yuv_to_rgb24_avx2(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int uyvy)
+{
+	int j;
+
+	while (--height >= 0) {
+		const unsigned char *s = src;
+
+		for (j = 0; j + 31 < width; j += 32) {
+			__m256i r[2], g[2], b[2], R, G, B;
+			int half;
+
+			for (half = 0; half < 2; half++) {
+				__m256i p = _mm256_loadu_si256(
+						(const __m256i *)(s + 32 * half));
+				__m256i y, c, u, v;
+
+				if (uyvy) {
+					y = _mm256_srli_epi16(p, 8);
+					c = _mm256_and_si256(p,
+						_mm256_set1_epi16(0x00ff));
+				} else {
+					y = _mm256_and_si256(p,
+						_mm256_set1_epi16(0x00ff));
+					c = _mm256_srli_epi16(p, 8);
+				}
+				u = _mm256_shuffle_epi8(c,
+					_mm256_setr_epi8(V4L_UDUP, V4L_UDUP));
+				v = _mm256_shuffle_epi8(c,
+					_mm256_setr_epi8(V4L_VDUP, V4L_VDUP));
+				V4L_YUV16X16_TO_RGB16(y, u, v, r[half],
+						      g[half], b[half]);
+			}
+			/* packus works per 128 bit lane, restore pixel order */
+			R = _mm256_permute4x64_epi64(
+					_mm256_packus_epi16(r[0], r[1]), 0xd8);
+			G = _mm256_permute4x64_epi64(
+					_mm256_packus_epi16(g[0], g[1]), 0xd8);
+			B = _mm256_permute4x64_epi64(
+					_mm256_packus_epi16(b[0], b[1]), 0xd8);
+			V4L_STORE_RGB24(dest, _mm256_castsi256_si128(R),
+					_mm256_castsi256_si128(G),
+					_mm256_castsi256_si128(B));
+			V4L_STORE_RGB24(dest + 48,
+					_mm256_extracti128_si256(R, 1),
+					_mm256_extracti128_si256(G, 1),
+					_mm256_extracti128_si256(B, 1));
+			s += 64;
+			dest += 96;
+		}
+		for (; j + 1 < width; j += 2) {
+			int u = uyvy ? s[0] : s[1];
+			int v = uyvy ? s[2] : s[3];
+			int y0 = uyvy ? s[1] : s[0];
+			int y1 = uyvy ? s[3] : s[2];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+			*dest++ = CLIP(y0 + v1);
+			*dest++ = CLIP(y0 - rg);
+			*dest++ = CLIP(y0 + u1);
+
+			*dest++ = CLIP(y1 + v1);
+			*dest++ = CLIP(y1 - rg);
+			*dest++ = CLIP(y1 + u1);
+			s += 4;
+		}
+		src += stride;
+		dest += dest_stride - j * 3;
+	}
+}
+
+__attribute__((target("ssse3")))
+static void v4lconvert_nv12_to_rgb24_ssse3(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int bgr)
+{
+	const unsigned char *uvbase = src + stride * height;
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		const unsigned char *ysrc = src + i * stride;
+		const unsigned char *uvsrc = uvbase + (i / 2) * stride;
+
+		for (j = 0; j + 15 < width; j += 16) {
+			__m128i yv = _mm_loadu_si128((const __m128i *)(ysrc + j));
+			__m128i uv = _mm_loadu_si128((const __m128i *)(uvsrc + j));
+			/* one u/v pair per two pixels, spread them out */
+			__m128i u8 = _mm_and_si128(uv, _mm_set1_epi16(0x00ff));
+			__m128i v8 = _mm_srli_epi16(uv, 8);
+			__m128i y0 = _mm_unpacklo_epi8(yv, _mm_setzero_si128());
+			__m128i y1 = _mm_unpackhi_epi8(yv, _mm_setzero_si128());
+			__m128i u0 = _mm_unpacklo_epi16(u8, u8);
+			__m128i u1 = _mm_unpackhi_epi16(u8, u8);
+			__m128i v0 = _mm_unpacklo_epi16(v8, v8);
+			__m128i v1 = _mm_unpackhi_epi16(v8, v8);
+			__m128i r0, g0, b0, r1, g1, b1, R, G, B;
+
+			V4L_YUV16_TO_RGB16(y0, u0, v0, r0, g0, b0);
+			V4L_YUV16_TO_RGB16(y1, u1, v1, r1, g1, b1);
+			R = _mm_packus_epi16(r0, r1);
+			G = _mm_packus_epi16(g0, g1);
+			B = _mm_packus_epi16(b0, b1);
+			if (bgr)
+				V4L_STORE_RGB24(dest, B, G, R);
+			else
+				V4L_STORE_RGB24(dest, R, G, B);
+			dest += 48;
+		}
+		for (; j + 1 < width; j += 2) {
+			int u = uvsrc[j];
+			int v = uvsrc[j + 1];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+			int k;
+
+			for (k = 0; k < 2; k++) {
+				int y = ysrc[j + k];
+
+				if (bgr) {
+					*dest++ = CLIP(y + u1);
+					*dest++ = CLIP(y - rg);
+					*dest++ = CLIP(y + v1);
+				} else {
+					*dest++ = CLIP(y + v1);
+					*dest++ = CLIP(y - rg);
+					*dest++ = CLIP(y + u1);
+				}
+			}
+		}
+		dest += dest_stride - j * 3;
+	}
+}
+
+#endif /* V4LCONVERT_X86_SIMD */
+
+#ifdef V4LCONVERT_NEON_SIMD
+
+/* 8 pixels: y, u, v int16x8 vectors (chroma already per pixel) */
+static inline void v4lconvert_neon_yuv16_to_rgb16(int16x8_t y, int16x8_t u,
+		int16x8_t v, int16x8_t *r, int16x8_t *g, int16x8_t *b)
+{
+	int16x8_t u_ = vsubq_s16(u, vdupq_n_s16(128));
+	int16x8_t v_ = vsubq_s16(v, vdupq_n_s16(128));
+	int16x8_t u1 = vshrq_n_s16(vmulq_n_s16(u_, 129), 6);
+	int16x8_t rg = vshrq_n_s16(vaddq_s16(vmulq_n_s16(u_, 3),
+					     vmulq_n_s16(v_, 6)), 3);
+	int16x8_t v1 = vshrq_n_s16(vmulq_n_s16(v_, 3), 1);
+
+	*r = vaddq_s16(y, v1);
+	*g = vsubq_s16(y, rg);
+	*b = vaddq_s16(y, u1);
+}
+
+/* even/odd pixel lanes + per pixel-pair chroma -> 32 interleaved RGB pixels */
+static inline void v4lconvert_neon_store_rgb24(unsigned char *dest,
+		uint8x16_t ye, uint8x16_t yo, uint8x16_t u8, uint8x16_t v8,
+		int bgr)
+{
+	uint8x16_t re = vdupq_n_u8(0), ge = re, be = re;
+	uint8x16_t ro = re, go = re, bo = re;
+	uint8x16x2_t rz, gz, bz;
+	uint8x16x3_t o;
+	int half;
+
+	for (half = 0; half < 2; half++) {
+		uint8x8_t uh = half ? vget_high_u8(u8) : vget_low_u8(u8);
+		uint8x8_t vh = half ? vget_high_u8(v8) : vget_low_u8(v8);
+		uint8x8_t yeh = half ? vget_high_u8(ye) : vget_low_u8(ye);
+		uint8x8_t yoh = half ? vget_high_u8(yo) : vget_low_u8(yo);
+		int16x8_t u16 = vreinterpretq_s16_u16(vmovl_u8(uh));
+		int16x8_t v16 = vreinterpretq_s16_u16(vmovl_u8(vh));
+		int16x8_t r16, g16, b16;
+		uint8x8_t r8[2], g8[2], b8[2];
+		int eo;
+
+		for (eo = 0; eo < 2; eo++) {
+			int16x8_t y16 = vreinterpretq_s16_u16(
+					vmovl_u8(eo ? yoh : yeh));
+
+			v4lconvert_neon_yuv16_to_rgb16(y16, u16, v16,
+						       &r16, &g16, &b16);
+			r8[eo] = vqmovun_s16(r16);
+			g8[eo] = vqmovun_s16(g16);
+			b8[eo] = vqmovun_s16(b16);
+		}
+		if (half) {
+			re = vcombine_u8(vget_low_u8(re), r8[0]);
+			ro = vcombine_u8(vget_low_u8(ro), r8[1]);
+			ge = vcombine_u8(vget_low_u8(ge), g8[0]);
+			go = vcombine_u8(vget_low_u8(go), g8[1]);
+			be = vcombine_u8(vget_low_u8(be), b8[0]);
+			bo = vcombine_u8(vget_low_u8(bo), b8[1]);
+		} else {
+			re = vcombine_u8(r8[0], r8[0]);
+			ro = vcombine_u8(r8[1], r8[1]);
+			ge = vcombine_u8(g8[0], g8[0]);
+			go = vcombine_u8(g8[1], g8[1]);
+			be = vcombine_u8(b8[0], b8[0]);
+			bo = vcombine_u8(b8[1], b8[1]);
+		}
+	}
+	rz = vzipq_u8(re, ro);
+	gz = vzipq_u8(ge, go);
+	bz = vzipq_u8(be, bo);
+	for (half = 0; half < 2; half++) {
+		o.val[0] = bgr ? bz.val[half] : rz.val[half];
+		o.val[1] = gz.val[half];
+		o.val[2] = bgr ? rz.val[half] : bz.val[half];
+		vst3q_u8(dest + 48 * half, o);
+	}
+}
+
+static void v4lconvert_packed_yuv_to_rgb24_neon(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int uyvy)
+{
+	int j;
+
+	while (--height >= 0) {
+		const unsigned char *s = src;
+
+		for (j = 0; j + 31 < width; j += 32) {
+			uint8x16x4_t p = vld4q_u8(s);
+			uint8x16_t ye = uyvy ? p.val[1] : p.val[0];
+			uint8x16_t yo = uyvy ? p.val[3] : p.val[2];
+			uint8x16_t u8 = uyvy ? p.val[0] : p.val[1];
+			uint8x16_t v8 = uyvy ? p.val[2] : p.val[3];
+
+			v4lconvert_neon_store_rgb24(dest, ye, yo, u8, v8, 0);
+			s += 64;
+			dest += 96;
+		}
+		for (; j + 1 < width; j += 2) {
+			int u = uyvy ? s[0] : s[1];
+			int v = uyvy ? s[2] : s[3];
+			int y0 = uyvy ? s[1] : s[0];
+			int y1 = uyvy ? s[3] : s[2];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+
+			*dest++ = CLIP(y0 + v1);
+			*dest++ = CLIP(y0 - rg);
+			*dest++ = CLIP(y0 + u1);
+
+			*dest++ = CLIP(y1 + v1);
+			*dest++ = CLIP(y1 - rg);
+			*dest++ = CLIP(y1 + u1);
+			s += 4;
+		}
+		src += stride;
+		dest += dest_stride - j * 3;
+	}
+}
+
+static void v4lconvert_nv12_to_rgb24_neon(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int bgr)
+{
+	const unsigned char *uvbase = src + stride * height;
+	int i, j;
+
+	for (i = 0; i < height; i++) {
+		const unsigned char *ysrc = src + i * stride;
+		const unsigned char *uvsrc = uvbase + (i / 2) * stride;
+
+		for (j = 0; j + 31 < width; j += 32) {
+			uint8x16x2_t y = vld2q_u8(ysrc + j);
+			uint8x16x2_t uv = vld2q_u8(uvsrc + j);
+
+			v4lconvert_neon_store_rgb24(dest, y.val[0], y.val[1],
+						    uv.val[0], uv.val[1], bgr);
+			dest += 96;
+		}
+		for (; j + 1 < width; j += 2) {
+			int u = uvsrc[j];
+			int v = uvsrc[j + 1];
+			int u1 = (((u - 128) << 7) +  (u - 128)) >> 6;
+			int rg = (((u - 128) << 1) +  (u - 128) +
+					((v - 128) << 2) + ((v - 128) << 1)) >> 3;
+			int v1 = (((v - 128) << 1) +  (v - 128)) >> 1;
+			int k;
+
+			for (k = 0; k < 2; k++) {
+				int y = ysrc[j + k];
+
+				if (bgr) {
+					*dest++ = CLIP(y + u1);
+					*dest++ = CLIP(y - rg);
+					*dest++ = CLIP(y + v1);
+				} else {
+					*dest++ = CLIP(y + v1);
+					*dest++ = CLIP(y - rg);
+					*dest++ = CLIP(y + u1);
+				}
+			}
+		}
+		dest += dest_stride - j * 3;
+	}
+}
+
+#endif /* V4LCONVERT_NEON_SIMD */
+
+/* Returns 0 when no usable SIMD instruction set is available */
+static int v4lconvert_packed_yuv_to_rgb24_simd(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int uyvy)
+{
+#ifdef V4LCONVERT_X86_SIMD
+	int level = v4lconvert_cpu_level();
+
+	if (level >= V4LCONVERT_CPU_AVX2) {
+		v4lconvert_packed_yuv_to_rgb24_avx2(src, dest, width, height,
+						    stride, dest_stride, uyvy);
+		return 1;
+	}
+	if (level >= V4LCONVERT_CPU_SSSE3) {
+		v4lconvert_packed_yuv_to_rgb24_ssse3(src, dest, width, height,
+						     stride, dest_stride,
+						     uyvy);
+		return 1;
+	}
+#elif defined(V4LCONVERT_NEON_SIMD)
+	v4lconvert_packed_yuv_to_rgb24_neon(src, dest, width, height,
+					    stride, dest_stride, uyvy);
+	return 1;
+#else
+	(void)src; (void)dest; (void)width; (void)height; (void)stride;
+	(void)dest_stride; (void)uyvy;
+#endif
+	return 0;
+}
+
+static int v4lconvert_nv12_to_rgb24_simd(const unsigned char *src,
+		unsigned char *dest, int width, int height, int stride,
+		int dest_stride, int bgr)
+{
+#ifdef V4LCONVERT_X86_SIMD
+	if (v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3) {
+		v4lconvert_nv12_to_rgb24_ssse3(src, dest, width, height,
+					       stride, dest_stride, bgr);
+		return 1;
+	}
+#elif defined(V4LCONVERT_NEON_SIMD)
+	v4lconvert_nv12_to_rgb24_neon(src, dest, width, height, stride,
+				      dest_stride, bgr);
+	return 1;
+#else
+	(void)src; (void)dest; (void)width; (void)height; (void)stride;
+	(void)dest_stride; (void)bgr;
+#endif
+	return 0;
+}
+
 void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride, int yvu)
+		int width, int height, int stride, int dest_stride, int yvu)
 {
 	int i, j;
 
@@ -139,6 +659,7 @@ void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
 			vsrc++;
 		}
 		ysrc += stride - width;
+		dest += dest_stride - j * 3;
 		/* Rewind u and v for next line */
 		if (!(i & 1)) {
 			usrc -= width / 2;
@@ -151,7 +672,7 @@ void v4lconvert_yuv420_to_bgr24(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride, int yvu)
+		int width, int height, int stride, int dest_stride, int yvu)
 {
 	int i, j;
 
@@ -197,6 +718,7 @@ void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
 			vsrc++;
 		}
 		ysrc += stride - width;
+		dest += dest_stride - j * 3;
 		/* Rewind u and v for next line */
 		if (!(i & 1)) {
 			usrc -= width / 2;
@@ -209,7 +731,7 @@ void v4lconvert_yuv420_to_rgb24(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
@@ -232,14 +754,19 @@ void v4lconvert_yuyv_to_bgr24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - width * 2;
+		dest += dest_stride - j * 3;
 	}
 }
 
 void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
+	if (v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width, height,
+						stride, dest_stride, 0))
+		return;
+
 	while (--height >= 0) {
 		for (j = 0; j + 1 < width; j += 2) {
 			int u = src[1];
@@ -259,6 +786,7 @@ void v4lconvert_yuyv_to_rgb24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - (width * 2);
+		dest += dest_stride - j * 3;
 	}
 }
 
@@ -323,7 +851,7 @@ void v4lconvert_nv16_to_yuyv(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
@@ -346,11 +874,12 @@ void v4lconvert_yvyu_to_bgr24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - (width * 2);
+		dest += dest_stride - j * 3;
 	}
 }
 
 void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
@@ -373,11 +902,12 @@ void v4lconvert_yvyu_to_rgb24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - (width * 2);
+		dest += dest_stride - j * 3;
 	}
 }
 
 void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
@@ -400,14 +930,19 @@ void v4lconvert_uyvy_to_bgr24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - width * 2;
+		dest += dest_stride - j * 3;
 	}
 }
 
 void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 
+	if (v4lconvert_packed_yuv_to_rgb24_simd(src, dest, width, height,
+						stride, dest_stride, 1))
+		return;
+
 	while (--height >= 0) {
 		for (j = 0; j + 1 < width; j += 2) {
 			int u = src[0];
@@ -427,6 +962,7 @@ void v4lconvert_uyvy_to_rgb24(const unsigned char *src, unsigned char *dest,
 			src += 4;
 		}
 		src += stride - width * 2;
+		dest += dest_stride - j * 3;
 	}
 }
 
@@ -471,17 +1007,20 @@ void v4lconvert_uyvy_to_yuv420(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_swap_rgb(const unsigned char *src, unsigned char *dst,
-		int width, int height)
+		int width, int height, int dest_stride)
 {
-	int i;
+	int j;
 
-	for (i = 0; i < (width * height); i++) {
-		unsigned char tmp0, tmp1;
-		tmp0 = *src++;
-		tmp1 = *src++;
-		*dst++ = *src++;
-		*dst++ = tmp1;
-		*dst++ = tmp0;
+	while (--height >= 0) {
+		for (j = 0; j < width; j++) {
+			unsigned char tmp0, tmp1;
+			tmp0 = *src++;
+			tmp1 = *src++;
+			*dst++ = *src++;
+			*dst++ = tmp1;
+			*dst++ = tmp0;
+		}
+		dst += dest_stride - width * 3;
 	}
 }
 
@@ -515,7 +1054,7 @@ void v4lconvert_swap_uv(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_rgb565_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 	while (--height >= 0) {
@@ -530,11 +1069,12 @@ void v4lconvert_rgb565_to_rgb24(const unsigned char *src, unsigned char *dest,
 			src += 2;
 		}
 		src += stride - 2 * width;
+		dest += dest_stride - width * 3;
 	}
 }
 
 void v4lconvert_rgb565_to_bgr24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride)
+		int width, int height, int stride, int dest_stride)
 {
 	int j;
 	while (--height >= 0) {
@@ -549,6 +1089,7 @@ void v4lconvert_rgb565_to_bgr24(const unsigned char *src, unsigned char *dest,
 			src += 2;
 		}
 		src += stride - 2 * width;
+		dest += dest_stride - width * 3;
 	}
 }
 
@@ -617,7 +1158,7 @@ void v4lconvert_rgb565_to_yuv420(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int little_endian)
+		int width, int height, int dest_stride, int little_endian)
 {
 	int j;
 
@@ -631,6 +1172,7 @@ void v4lconvert_y16_to_rgb24(const unsigned char *src, unsigned char *dest,
 			*dest++ = *src;
 			src+=2;
 		}
+		dest += dest_stride - width * 3;
 	}
 }
 
@@ -654,7 +1196,7 @@ void v4lconvert_y16_to_yuv420(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_grey_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height)
+		int width, int height, int dest_stride)
 {
 	int j;
 	while (--height >= 0) {
@@ -664,6 +1206,7 @@ void v4lconvert_grey_to_rgb24(const unsigned char *src, unsigned char *dest,
 			*dest++ = *src;
 			src++;
 		}
+		dest += dest_stride - width * 3;
 	}
 }
 
@@ -703,9 +1246,9 @@ int v4lconvert_y10b_to_rgb24(struct v4lconvert_data *data,
 {
 	unsigned char *unpacked_buffer;
 
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
-					&data->convert_pixfmt_buf,
-					&data->convert_pixfmt_buf_size);
+	unpacked_buffer = v4lconvert_scratch_buffer(data,
+					V4LCONVERT_CONVERT_PIXFMT_BUF,
+					width * height * 2);
 	if (!unpacked_buffer)
 		return v4lconvert_oom_error(data);
 
@@ -734,9 +1277,9 @@ int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
 {
 	unsigned char *unpacked_buffer;
 
-	unpacked_buffer = v4lconvert_alloc_buffer(width * height * 2,
-					&data->convert_pixfmt_buf,
-					&data->convert_pixfmt_buf_size);
+	unpacked_buffer = v4lconvert_scratch_buffer(data,
+					V4LCONVERT_CONVERT_PIXFMT_BUF,
+					width * height * 2);
 	if (!unpacked_buffer)
 		return v4lconvert_oom_error(data);
 
@@ -764,7 +1307,7 @@ int v4lconvert_y10b_to_yuv420(struct v4lconvert_data *data,
 }
 
 void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height,int bgr)
+		int width, int height, int dest_stride, int bgr)
 {
 	int j;
 	while (--height >= 0) {
@@ -782,6 +1325,7 @@ void v4lconvert_rgb32_to_rgb24(const unsigned char *src, unsigned char *dest,
 				src+=1;
 			}
 		}
+		dest += dest_stride - width * 3;
 	}
 }
 
@@ -861,12 +1405,17 @@ void v4lconvert_hsv_to_rgb24(const unsigned char *src, unsigned char *dest,
 }
 
 void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
-		int width, int height, int stride, int bgr)
+		int width, int height, int stride, int dest_stride, int bgr)
 {
 	int i, j;
 	const unsigned char *ysrc = src;
 	const unsigned char *uvsrc = src + stride * height;
 
+	/* the SIMD path uses the fast coefficients of the packed YUV paths */
+	if (v4lconvert_nv12_to_rgb24_simd(src, dest, width, height, stride,
+					  dest_stride, bgr))
+		return;
+
 	for (i = 0; i < height; i++) {
 		for (j = 0; j < width; j ++) {
 			if (bgr) {
@@ -884,6 +1433,7 @@ void v4lconvert_nv12_to_rgb24(const unsigned char *src, unsigned char *dest,
 		}
 
 		ysrc += stride - width;
+		dest += dest_stride - j * 3;
 		/* Rewind u and v for next line */
 		if (!(i&1))
 			uvsrc -= width;
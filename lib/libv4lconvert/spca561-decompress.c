@@ -36,7 +36,11 @@ static const unsigned char *input_ptr;
 
 static inline void refill(int *bitfill)
 {
-	if (*bitfill < 8) {
+	/* Top the bucket up to at least 17 bits in one go, so a whole
+	   symbol plus its escape code can be decoded without touching the
+	   input again.  Never fill beyond 24 bits: the extra byte that an
+	   escape path shifts in must still fit the 32 bit bucket. */
+	while (*bitfill <= 16) {
 		bit_bucket = (bit_bucket << 8) | *(input_ptr++);
 		*bitfill += 8;
 	}
@@ -303,6 +307,32 @@ static int fun_F(int cur_byte, int *bitfill)
 	return 0xff;
 }
 
+/*
+ * Flattened lookup tables for the fun_E / fun_F code classes: one peeked
+ * byte indexes the symbol and its bit length directly instead of walking
+ * the mask-and-compare chains above for every pixel.  The tables are
+ * filled once from the original decoders, which also keeps the 0xff
+ * invalid marker and the zero net length of the invalid codes intact.
+ */
+static int tab_E[256], tab_F[256];
+static int nbits_E[256], nbits_F[256];
+static int luts_filled;
+
+static void fill_luts(void)
+{
+	int b, bf;
+
+	for (b = 0; b < 256; b++) {
+		bf = 0;
+		tab_E[b] = fun_E(b, &bf);
+		nbits_E[b] = -bf;
+		bf = 0;
+		tab_F[b] = fun_F(b, &bf);
+		nbits_F[b] = -bf;
+	}
+	luts_filled = 1;
+}
+
 static int internal_spca561_decode(int width, int height,
 		const unsigned char *inbuf,
 		unsigned char *outbuf)
@@ -772,7 +802,7 @@ static int internal_spca561_decode(int width, int height,
 
 		refill(&bitfill);
 
-		cur_byte = (bit_bucket >> (bitfill & 7)) & 0xff;
+		cur_byte = (bit_bucket >> (bitfill - 8)) & 0xff;
 
 		if ((cur_byte & 0x80) == 0) {
 			var_7 = 0;
@@ -793,7 +823,7 @@ static int internal_spca561_decode(int width, int height,
 			int gkw;	/* God knows what */
 
 			refill(&bitfill);
-			cur_byte = bit_bucket >> (bitfill & 7) & 0xff;
+			cur_byte = bit_bucket >> (bitfill - 8) & 0xff;
 
 			pixel_L = output_ptr[-2];
 			pixel_UR = output_ptr[off_up_right];
@@ -852,9 +882,11 @@ static int internal_spca561_decode(int width, int height,
 				if (cur_byte < 4)
 					gkw = fun_D(&bitfill, gkw);
 			} else if (i_hits[index] * 8 >= accum[index]) {
-				gkw = fun_E(cur_byte, &bitfill);
+				bitfill -= nbits_E[cur_byte];
+				gkw = tab_E[cur_byte];
 			} else {
-				gkw = fun_F(cur_byte, &bitfill);
+				bitfill -= nbits_F[cur_byte];
+				gkw = tab_F[cur_byte];
 			}
 
 			if (gkw == 0xff)
@@ -901,6 +933,8 @@ void v4lconvert_decode_spca561(const unsigned char *inbuf,
 	int i;
 	static unsigned char tmpbuf[650 * 490];
 
+	if (!luts_filled)
+		fill_luts();
 	if (internal_spca561_decode(width, height, inbuf, tmpbuf) != 0)
 		return;
 	for (i = 0; i < height; i++)
@@ -1224,6 +1224,236 @@ static void YCrCB_to_BGR24_2x2(struct jdec_private *priv)
 
 
 
+/*
+ * SIMD YCbCr -> RGB24 / BGR24 conversion for the 2x1 and 2x2 subsampled
+ * MCUs produced by virtually every MJPEG webcam.  One line kernel turns
+ * 16 luma samples sharing 8 chroma pairs into 48 output bytes.  The
+ * fixed point math is the same as in the scalar loops above and the
+ * output is identical bit for bit: (y << SCALEBITS) has no fractional
+ * bits, so rounding and shifting the chroma contribution on its own
+ * gives the same result as the combined shift.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define V4LCONVERT_X86_SIMD 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define V4LCONVERT_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#if defined(V4LCONVERT_X86_SIMD) || defined(V4LCONVERT_NEON_SIMD)
+
+#define SCALEBITS       10
+#define ONE_HALF        (1L << (SCALEBITS - 1))
+#define FIX(x)          ((int)((x) * (1UL << SCALEBITS) + 0.5))
+
+#ifdef V4LCONVERT_X86_SIMD
+
+static int tinyjpeg_have_colorspace_simd(void)
+{
+	return v4lconvert_cpu_level() >= V4LCONVERT_CPU_SSSE3;
+}
+
+__attribute__((target("ssse3")))
+static void YCrCB_to_RGB24_line_simd(const unsigned char *Y,
+		const unsigned char *Cb, const unsigned char *Cr,
+		unsigned char *p, int bgr)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c128 = _mm_set1_epi16(128);
+	const __m128i half = _mm_set1_epi32(ONE_HALF);
+	/* (cb, cr) coefficient pairs for _mm_madd_epi16 */
+	const __m128i coef_r = _mm_set1_epi32(FIX(1.40200) << 16);
+	const __m128i coef_g = _mm_set1_epi32(((-FIX(0.71414) & 0xffff) << 16) |
+					      (-FIX(0.34414) & 0xffff));
+	const __m128i coef_b = _mm_set1_epi32(FIX(1.77200));
+	/* scatter 16 R, 16 G and 16 B bytes over three 16 byte stores */
+	const __m128i mr0 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1,
+			3, -1, -1, 4, -1, -1, 5);
+	const __m128i mg0 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1,
+			-1, 3, -1, -1, 4, -1, -1);
+	const __m128i mb0 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2,
+			-1, -1, 3, -1, -1, 4, -1);
+	const __m128i mr1 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8,
+			-1, -1, 9, -1, -1, 10, -1);
+	const __m128i mg1 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1,
+			8, -1, -1, 9, -1, -1, 10);
+	const __m128i mb1 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1,
+			-1, 8, -1, -1, 9, -1, -1);
+	const __m128i mr2 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1,
+			-1, 14, -1, -1, 15, -1, -1);
+	const __m128i mg2 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13,
+			-1, -1, 14, -1, -1, 15, -1);
+	const __m128i mb2 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1,
+			13, -1, -1, 14, -1, -1, 15);
+	__m128i cb16, cr16, pair_lo, pair_hi, yv, y_lo, y_hi;
+	__m128i ar, ag, ab, r, g, b, t;
+
+	cb16 = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)Cb), zero), c128);
+	cr16 = _mm_sub_epi16(_mm_unpacklo_epi8(
+			_mm_loadl_epi64((const __m128i *)Cr), zero), c128);
+	pair_lo = _mm_unpacklo_epi16(cb16, cr16);
+	pair_hi = _mm_unpackhi_epi16(cb16, cr16);
+	yv = _mm_loadu_si128((const __m128i *)Y);
+	y_lo = _mm_unpacklo_epi8(yv, zero);
+	y_hi = _mm_unpackhi_epi8(yv, zero);
+
+#define CHROMA_ADD(coef) \
+	_mm_packs_epi32( \
+		_mm_srai_epi32(_mm_add_epi32( \
+			_mm_madd_epi16(pair_lo, coef), half), SCALEBITS), \
+		_mm_srai_epi32(_mm_add_epi32( \
+			_mm_madd_epi16(pair_hi, coef), half), SCALEBITS))
+
+	ar = CHROMA_ADD(coef_r);
+	ag = CHROMA_ADD(coef_g);
+	ab = CHROMA_ADD(coef_b);
+#undef CHROMA_ADD
+
+	/* each chroma pair covers two horizontally adjacent luma samples */
+	r = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(ar, ar)),
+			     _mm_add_epi16(y_hi, _mm_unpackhi_epi16(ar, ar)));
+	g = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(ag, ag)),
+			     _mm_add_epi16(y_hi, _mm_unpackhi_epi16(ag, ag)));
+	b = _mm_packus_epi16(_mm_add_epi16(y_lo, _mm_unpacklo_epi16(ab, ab)),
+			     _mm_add_epi16(y_hi, _mm_unpackhi_epi16(ab, ab)));
+
+	if (bgr) {
+		t = r;
+		r = b;
+		b = t;
+	}
+
+	_mm_storeu_si128((__m128i *)p, _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(r, mr0), _mm_shuffle_epi8(g, mg0)),
+			_mm_shuffle_epi8(b, mb0)));
+	_mm_storeu_si128((__m128i *)(p + 16), _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(r, mr1), _mm_shuffle_epi8(g, mg1)),
+			_mm_shuffle_epi8(b, mb1)));
+	_mm_storeu_si128((__m128i *)(p + 32), _mm_or_si128(_mm_or_si128(
+			_mm_shuffle_epi8(r, mr2), _mm_shuffle_epi8(g, mg2)),
+			_mm_shuffle_epi8(b, mb2)));
+}
+
+#else /* V4LCONVERT_NEON_SIMD */
+
+static int tinyjpeg_have_colorspace_simd(void)
+{
+	return v4lconvert_cpu_level() >= V4LCONVERT_CPU_NEON;
+}
+
+static void YCrCB_to_RGB24_line_simd(const unsigned char *Y,
+		const unsigned char *Cb, const unsigned char *Cr,
+		unsigned char *p, int bgr)
+{
+	int16x8_t cb = vsubq_s16(vreinterpretq_s16_u16(
+			vmovl_u8(vld1_u8(Cb))), vdupq_n_s16(128));
+	int16x8_t cr = vsubq_s16(vreinterpretq_s16_u16(
+			vmovl_u8(vld1_u8(Cr))), vdupq_n_s16(128));
+	int16x4_t cb_lo = vget_low_s16(cb), cb_hi = vget_high_s16(cb);
+	int16x4_t cr_lo = vget_low_s16(cr), cr_hi = vget_high_s16(cr);
+	/* vrshrn rounds with ONE_HALF before narrowing */
+	int16x8_t ar = vcombine_s16(
+		vrshrn_n_s32(vmull_n_s16(cr_lo, FIX(1.40200)), SCALEBITS),
+		vrshrn_n_s32(vmull_n_s16(cr_hi, FIX(1.40200)), SCALEBITS));
+	int16x8_t ag = vcombine_s16(
+		vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(cb_lo, -FIX(0.34414)),
+				cr_lo, -FIX(0.71414)), SCALEBITS),
+		vrshrn_n_s32(vmlal_n_s16(vmull_n_s16(cb_hi, -FIX(0.34414)),
+				cr_hi, -FIX(0.71414)), SCALEBITS));
+	int16x8_t ab = vcombine_s16(
+		vrshrn_n_s32(vmull_n_s16(cb_lo, FIX(1.77200)), SCALEBITS),
+		vrshrn_n_s32(vmull_n_s16(cb_hi, FIX(1.77200)), SCALEBITS));
+	/* each chroma pair covers two horizontally adjacent luma samples */
+	int16x8x2_t ard = vzipq_s16(ar, ar);
+	int16x8x2_t agd = vzipq_s16(ag, ag);
+	int16x8x2_t abd = vzipq_s16(ab, ab);
+	int16x8_t y_lo = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(Y)));
+	int16x8_t y_hi = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(Y + 8)));
+	uint8x16_t r = vcombine_u8(
+		vqmovun_s16(vaddq_s16(y_lo, ard.val[0])),
+		vqmovun_s16(vaddq_s16(y_hi, ard.val[1])));
+	uint8x16_t g = vcombine_u8(
+		vqmovun_s16(vaddq_s16(y_lo, agd.val[0])),
+		vqmovun_s16(vaddq_s16(y_hi, agd.val[1])));
+	uint8x16_t b = vcombine_u8(
+		vqmovun_s16(vaddq_s16(y_lo, abd.val[0])),
+		vqmovun_s16(vaddq_s16(y_hi, abd.val[1])));
+	uint8x16x3_t rgb;
+
+	rgb.val[0] = bgr ? b : r;
+	rgb.val[1] = g;
+	rgb.val[2] = bgr ? r : b;
+	vst3q_u8(p, rgb);
+}
+
+#endif /* V4LCONVERT_NEON_SIMD */
+
+static void YCrCB_to_RGB24_2x1_lines(struct jdec_private *priv, int bgr)
+{
+	const unsigned char *Y = priv->Y;
+	const unsigned char *Cb = priv->Cb;
+	const unsigned char *Cr = priv->Cr;
+	unsigned char *p = priv->plane[0];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		YCrCB_to_RGB24_line_simd(Y, Cb, Cr, p, bgr);
+		Y += 16;
+		Cb += 8;
+		Cr += 8;
+		p += priv->width * 3;
+	}
+}
+
+static void YCrCB_to_RGB24_2x2_lines(struct jdec_private *priv, int bgr)
+{
+	const unsigned char *Y = priv->Y;
+	const unsigned char *Cb = priv->Cb;
+	const unsigned char *Cr = priv->Cr;
+	unsigned char *p = priv->plane[0];
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		YCrCB_to_RGB24_line_simd(Y, Cb, Cr, p, bgr);
+		YCrCB_to_RGB24_line_simd(Y + 16, Cb, Cr,
+				p + priv->width * 3, bgr);
+		Y += 32;
+		Cb += 8;
+		Cr += 8;
+		p += priv->width * 3 * 2;
+	}
+}
+
+static void YCrCB_to_RGB24_2x1_simd(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_2x1_lines(priv, 0);
+}
+
+static void YCrCB_to_BGR24_2x1_simd(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_2x1_lines(priv, 1);
+}
+
+static void YCrCB_to_RGB24_2x2_simd(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_2x2_lines(priv, 0);
+}
+
+static void YCrCB_to_BGR24_2x2_simd(struct jdec_private *priv)
+{
+	YCrCB_to_RGB24_2x2_lines(priv, 1);
+}
+
+#undef SCALEBITS
+#undef ONE_HALF
+#undef FIX
+
+#endif /* V4LCONVERT_X86_SIMD || V4LCONVERT_NEON_SIMD */
+
 /**
  *  YCrCb -> Grey (1x1)
  *  .---.
@@ -2163,6 +2393,22 @@ static const convert_colorspace_fct convert_colorspace_bgr24[4] = {
 	YCrCB_to_BGR24_2x2,
 };
 
+#if defined(V4LCONVERT_X86_SIMD) || defined(V4LCONVERT_NEON_SIMD)
+static const convert_colorspace_fct convert_colorspace_rgb24_simd[4] = {
+	YCrCB_to_RGB24_1x1,
+	YCrCB_to_RGB24_1x2,
+	YCrCB_to_RGB24_2x1_simd,
+	YCrCB_to_RGB24_2x2_simd,
+};
+
+static const convert_colorspace_fct convert_colorspace_bgr24_simd[4] = {
+	YCrCB_to_BGR24_1x1,
+	YCrCB_to_BGR24_1x2,
+	YCrCB_to_BGR24_2x1_simd,
+	YCrCB_to_BGR24_2x2_simd,
+};
+#endif
+
 static const convert_colorspace_fct convert_colorspace_grey[4] = {
 	YCrCB_to_Grey_1x1,
 	YCrCB_to_Grey_1x2,
@@ -2298,6 +2544,10 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 
 	case TINYJPEG_FMT_RGB24:
 		colorspace_array_conv = convert_colorspace_rgb24;
+#if defined(V4LCONVERT_X86_SIMD) || defined(V4LCONVERT_NEON_SIMD)
+		if (tinyjpeg_have_colorspace_simd())
+			colorspace_array_conv = convert_colorspace_rgb24_simd;
+#endif
 		if (priv->components[0] == NULL)
 			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
 		bytes_per_blocklines[0] = priv->width * 3;
@@ -2306,6 +2556,10 @@ int tinyjpeg_decode(struct jdec_private *priv, int pixfmt)
 
 	case TINYJPEG_FMT_BGR24:
 		colorspace_array_conv = convert_colorspace_bgr24;
+#if defined(V4LCONVERT_X86_SIMD) || defined(V4LCONVERT_NEON_SIMD)
+		if (tinyjpeg_have_colorspace_simd())
+			colorspace_array_conv = convert_colorspace_bgr24_simd;
+#endif
 		if (priv->components[0] == NULL)
 			priv->components[0] = (uint8_t *)malloc(priv->width * priv->height * 3);
 		bytes_per_blocklines[0] = priv->width * 3;
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: LGPL-2.1-or-later */
+/*
+ * Static USDT tracepoints for the v4l-utils libraries.
+ *
+ * With systemtap's <sys/sdt.h> available (and --disable-usdt not given),
+ * each probe compiles to a single nop plus an ELF note that bpftrace,
+ * perf and systemtap resolve by name:
+ *
+ *	bpftrace -l 'usdt:/usr/lib/libv4l2.so.0:*'
+ *
+ * so hooking a site needs no symbol offsets, and an unprobed site costs
+ * one nop.  Without <sys/sdt.h> the probes are defined away entirely.
+ * Probe arguments must stay side effect free: they aren't evaluated on
+ * a disabled build.
+ */
+#ifndef __V4L_TRACE_H
+#define __V4L_TRACE_H
+
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+#define v4l_trace(provider, name, ...) \
+	STAP_PROBEV(provider, name, ##__VA_ARGS__)
+#else
+#define v4l_trace(provider, name, ...) do { } while (0)
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+// SPDX-License-Identifier: LGPL-2.1-only
+/*
+ * bench-fwht: throughput and per-stage timing for the FWHT codec
+ *
+ * Encodes and decodes synthesized frames at 720p/1080p/4K in every
+ * pixel format the codec supports, reporting MB/s with a 95% confidence
+ * interval and a transform/quantize/RLC stage breakdown. The stage
+ * numbers come from the FWHT_BENCH_TIMING hooks in codec-fwht.c, which
+ * are only compiled into this program.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/videodev2.h>
+
+#include "v4l-stream.h"
+
+static const struct {
+	unsigned width;
+	unsigned height;
+	const char *name;
+} resolutions[] = {
+	{ 1280, 720, "720p" },
+	{ 1920, 1080, "1080p" },
+	{ 3840, 2160, "4K" },
+};
+
+static unsigned warmup = 2;
+static unsigned reps = 10;
+static int csv;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * A gradient with soft shapes plus a block of detail that moves between
+ * the two frames of the pair, so P frames exercise both the static-skip
+ * and the motion paths of the encoder.
+ */
+static void fill_frame(__u8 *buf, unsigned size, unsigned width, unsigned phase)
+{
+	unsigned i;
+
+	for (i = 0; i < size; i++) {
+		unsigned x = i % width;
+		unsigned y = i / width;
+
+		buf[i] = 40 + ((x * 120) / width + y / 9 +
+			       (((x / 97) ^ (y / 61)) & 1) * 10) % 180;
+	}
+	for (i = size / 4 + phase * (size / 16); i < size / 2 + phase * (size / 16); i++)
+		buf[i] = (buf[i] + i * 2654435761u) & 0xff;
+}
+
+static void stats(const double *samples, unsigned n, double *mean, double *ci)
+{
+	double sum = 0, var = 0;
+	unsigned i;
+
+	for (i = 0; i < n; i++)
+		sum += samples[i];
+	*mean = sum / n;
+	for (i = 0; i < n; i++)
+		var += (samples[i] - *mean) * (samples[i] - *mean);
+	*ci = n > 1 ? 1.96 * sqrt(var / (n - 1)) / sqrt(n) : 0;
+}
+
+static void print_stages(const char *what, double frames)
+{
+	u64 total = fwht_bench_ns[FWHT_BENCH_TRANSFORM] +
+		    fwht_bench_ns[FWHT_BENCH_QUANTIZE] +
+		    fwht_bench_ns[FWHT_BENCH_RLC];
+
+	if (!total)
+		return;
+	printf("    %s stages: transform %5.1f%%  quantize %5.1f%%  rlc %5.1f%%  (%.2f ms/frame timed)\n",
+	       what,
+	       100.0 * fwht_bench_ns[FWHT_BENCH_TRANSFORM] / total,
+	       100.0 * fwht_bench_ns[FWHT_BENCH_QUANTIZE] / total,
+	       100.0 * fwht_bench_ns[FWHT_BENCH_RLC] / total,
+	       total / frames / 1e6);
+}
+
+static void bench_one(const struct v4l2_fwht_pixfmt_info *info,
+		      unsigned width, unsigned height, const char *res_name)
+{
+	struct codec_ctx *enc, *dec;
+	unsigned insize;
+	__u8 *in[2], *out;
+	double *samples = malloc(reps * sizeof(*samples));
+	double mean, ci;
+	unsigned comp_size[2] = { 0, 0 };
+	unsigned i, r;
+
+	enc = fwht_alloc(info->id, width, height, width, height,
+			 V4L2_FIELD_NONE, V4L2_COLORSPACE_SRGB, 0, 0, 0);
+	dec = fwht_alloc(info->id, width, height, width, height,
+			 V4L2_FIELD_NONE, V4L2_COLORSPACE_SRGB, 0, 0, 0);
+	if (!enc || !dec || !samples) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	/* measure the single-threaded codec, not the thread pool */
+	enc->encode_parallel = 0;
+
+	insize = width * height * info->sizeimage_mult / info->sizeimage_div;
+	in[0] = malloc(insize);
+	in[1] = malloc(insize);
+	out = malloc(insize);
+	if (!in[0] || !in[1] || !out) {
+		fprintf(stderr, "out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	fill_frame(in[0], insize, width, 0);
+	fill_frame(in[1], insize, width, 1);
+
+	char case_name[32];
+
+	snprintf(case_name, sizeof(case_name), "%c%c%c%c_%s",
+		 info->id & 0xff, (info->id >> 8) & 0xff,
+		 (info->id >> 16) & 0xff, (info->id >> 24) & 0xff, res_name);
+	if (!csv)
+		printf("%c%c%c%c %ux%u (%s):\n",
+		       info->id & 0xff, (info->id >> 8) & 0xff,
+		       (info->id >> 16) & 0xff, (info->id >> 24) & 0xff,
+		       width, height, res_name);
+
+	/* encode: alternate the frame pair so I and P frames both occur */
+	for (r = 0; r < warmup; r++)
+		fwht_compress(enc, in[r & 1], insize, &comp_size[r & 1]);
+	for (r = 0; r < reps; r++) {
+		double t0 = now();
+
+		fwht_compress(enc, in[r & 1], insize, &comp_size[r & 1]);
+		samples[r] = now() - t0;
+	}
+	stats(samples, reps, &mean, &ci);
+	if (csv)
+		printf("fwht_encode,%s,MBps,%.1f\n", case_name,
+		       insize / mean / 1e6);
+	else
+		printf("    encode %8.1f MB/s  +/-%4.1f%%  (%6.2f ms/frame, %4.1f%% of raw)\n",
+		       insize / mean / 1e6, 100 * ci / mean, mean * 1e3,
+		       100.0 * (comp_size[0] + comp_size[1]) / (2 * insize));
+
+	if (!csv) {
+		fwht_bench_enable = 1;
+		memset(fwht_bench_ns, 0, sizeof(fwht_bench_ns));
+		for (r = 0; r < reps; r++)
+			fwht_compress(enc, in[r & 1], insize, &comp_size[r & 1]);
+		fwht_bench_enable = 0;
+		print_stages("encode", reps);
+	}
+
+	/*
+	 * Decode: replay one I and one P frame. The refresh of the
+	 * encoder GOP is forced so the pair is self-contained.
+	 */
+	enc->state.gop_cnt = 0;
+	fwht_compress(enc, in[0], insize, &comp_size[0]);
+	memcpy(dec->state.compressed_frame, enc->state.compressed_frame,
+	       comp_size[0]);
+	fwht_compress(enc, in[1], insize, &comp_size[1]);
+
+	__u8 *cframes[2] = { dec->state.compressed_frame,
+			     enc->state.compressed_frame };
+
+	for (r = 0; r < warmup; r++)
+		fwht_decompress(dec, cframes[r & 1], comp_size[r & 1], out, insize);
+	for (r = 0; r < reps; r++) {
+		double t0 = now();
+
+		fwht_decompress(dec, cframes[r & 1], comp_size[r & 1], out, insize);
+		samples[r] = now() - t0;
+	}
+	stats(samples, reps, &mean, &ci);
+	if (csv)
+		printf("fwht_decode,%s,MBps,%.1f\n", case_name,
+		       insize / mean / 1e6);
+	else
+		printf("    decode %8.1f MB/s  +/-%4.1f%%  (%6.2f ms/frame)\n",
+		       insize / mean / 1e6, 100 * ci / mean, mean * 1e3);
+
+	if (!csv) {
+		fwht_bench_enable = 1;
+		memset(fwht_bench_ns, 0, sizeof(fwht_bench_ns));
+		for (r = 0; r < reps; r++)
+			fwht_decompress(dec, cframes[r & 1], comp_size[r & 1], out, insize);
+		fwht_bench_enable = 0;
+		print_stages("decode", reps);
+	}
+
+	for (i = 0; i < 2; i++)
+		free(in[i]);
+	free(out);
+	free(samples);
+	fwht_free(enc);
+	fwht_free(dec);
+}
+
+static void usage(void)
+{
+	printf("Usage: bench-fwht [options]\n"
+	       "  -f <fourcc>  only benchmark this pixel format (e.g. YU12)\n"
+	       "  -s <height>  only benchmark this resolution (720, 1080 or 2160)\n"
+	       "  -r <reps>    timed repetitions per measurement (default %u)\n"
+	       "  -w <reps>    warmup repetitions (default %u)\n"
+	       "  -C           machine readable output (benchmark,case,unit,value)\n"
+	       "  -h           show this help\n", reps, warmup);
+}
+
+int main(int argc, char **argv)
+{
+	__u32 only_fmt = 0;
+	unsigned only_height = 0;
+	unsigned i, f;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:s:r:w:Ch")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strlen(optarg) != 4) {
+				fprintf(stderr, "fourcc must be 4 characters\n");
+				return EXIT_FAILURE;
+			}
+			only_fmt = v4l2_fourcc(optarg[0], optarg[1],
+					       optarg[2], optarg[3]);
+			break;
+		case 's':
+			only_height = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			reps = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			warmup = strtoul(optarg, NULL, 0);
+			break;
+		case 'C':
+			csv = 1;
+			break;
+		case 'h':
+			usage();
+			return 0;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+	if (!reps) {
+		fprintf(stderr, "at least one repetition is needed\n");
+		return EXIT_FAILURE;
+	}
+
+	for (f = 0; ; f++) {
+		const struct v4l2_fwht_pixfmt_info *info = v4l2_fwht_get_pixfmt(f);
+
+		if (!info)
+			break;
+		if (only_fmt && info->id != only_fmt)
+			continue;
+		for (i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+			if (only_height && resolutions[i].height != only_height)
+				continue;
+			bench_one(info, resolutions[i].width,
+				  resolutions[i].height, resolutions[i].name);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1 @@
+../common/codec-fwht.c
\ No newline at end of file
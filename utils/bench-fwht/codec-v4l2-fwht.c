@@ -0,0 +1 @@
+../common/codec-v4l2-fwht.c
\ No newline at end of file
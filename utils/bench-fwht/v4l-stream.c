@@ -0,0 +1 @@
+../common/v4l-stream.c
\ No newline at end of file
@@ -4,11 +4,13 @@
  */
 
 #include <sstream>
+#include <vector>
 
 #include <fcntl.h>
 #include <getopt.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "cec-compliance.h"
@@ -35,6 +37,7 @@ enum Option {
 	OptListTests = 'l',
 	OptExpectWithNoWarnings = 'n',
 	OptNoWarnings = 'N',
+	OptParallel = 'P',
 	OptRemote = 'r',
 	OptReplyThreshold = 'R',
 	OptSkipInfo = 's',
@@ -123,6 +126,7 @@ static struct option long_options[] = {
 	{"skip-info", no_argument, nullptr, OptSkipInfo},
 	{"wall-clock", no_argument, nullptr, OptWallClock},
 	{"interactive", no_argument, nullptr, OptInteractive},
+	{"parallel", no_argument, nullptr, OptParallel},
 	{"reply-threshold", required_argument, nullptr, OptReplyThreshold},
 
 	{"test-adapter", no_argument, nullptr, OptTestAdapter},
@@ -185,6 +189,8 @@ static void usage()
 	       "  -R, --reply-threshold <timeout>\n"
 	       "                       Warn if replies take longer than this threshold (default 1000ms)\n"
 	       "  -i, --interactive    Interactive mode when doing remote tests\n"
+	       "  -P, --parallel       Test the remote devices in parallel child processes, so the\n"
+	       "                       wait-heavy tests of independent devices overlap\n"
 	       "  -t, --timeout <secs> Set the standby/resume timeout to <secs>. Default is 60s.\n"
 	       "\n"
 	       "  -A, --test-adapter                  Test the CEC adapter API\n"
@@ -876,6 +882,146 @@ static void topology_probe_device(struct node *node, unsigned i, unsigned la)
 	}
 }
 
+struct remote_test_result {
+	int tests_total;
+	int tests_ok;
+	int app_result;
+	unsigned warnings;
+};
+
+/*
+ * Run the remote tests for each device in its own child process so the
+ * wait-heavy tests (the standby/resume timers in particular) of
+ * independent devices overlap instead of running back to back. Each
+ * child reopens the device to get a private receive queue, runs the
+ * unchanged testRemote() sequence against a single remote logical
+ * address (so per-device test ordering is identical to a serial run)
+ * and sends its counters back over a pipe. The output of every child
+ * is buffered and printed in logical address order afterwards, so the
+ * report reads like a serial run as well.
+ */
+static void test_remotes_parallel(struct node &node, struct cec_log_addrs &laddrs,
+				  unsigned remote_la_mask, unsigned test_tags)
+{
+	struct remote_child {
+		unsigned la;
+		pid_t pid;
+		int out_fd;
+		int res_fd;
+		std::string output;
+		struct remote_test_result res;
+	};
+	std::vector<remote_child> children;
+
+	fflush(stdout);
+	for (unsigned to = 0; to <= 15; to++) {
+		if ((node.adap_la_mask & (1 << to)) ||
+		    !(remote_la_mask & (1 << to)))
+			continue;
+
+		int out_pipe[2], res_pipe[2];
+
+		if (pipe(out_pipe) || pipe(res_pipe)) {
+			fprintf(stderr, "pipe: %s\n", strerror(errno));
+			std::exit(EXIT_FAILURE);
+		}
+
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			fprintf(stderr, "fork: %s\n", strerror(errno));
+			std::exit(EXIT_FAILURE);
+		}
+		if (pid == 0) {
+			struct node child_node = node;
+			struct remote_test_result res;
+
+			close(out_pipe[0]);
+			close(res_pipe[0]);
+			dup2(out_pipe[1], STDOUT_FILENO);
+			close(out_pipe[1]);
+			child_node.fd = open(node.device, O_RDWR);
+			if (child_node.fd < 0) {
+				fprintf(stderr, "Failed to open %s: %s\n",
+					node.device, strerror(errno));
+				std::exit(EXIT_FAILURE);
+			}
+			tests_total = tests_ok = app_result = 0;
+			warnings = 0;
+			for (unsigned i = 0; i < node.num_log_addrs; i++) {
+				child_node.prim_devtype = laddrs.primary_device_type[i];
+				testRemote(&child_node, node.log_addr[i], to,
+					   test_tags, false);
+			}
+			fflush(stdout);
+			res.tests_total = tests_total;
+			res.tests_ok = tests_ok;
+			res.app_result = app_result;
+			res.warnings = warnings;
+			if (write(res_pipe[1], &res, sizeof(res)) < (ssize_t)sizeof(res))
+				std::exit(EXIT_FAILURE);
+			std::exit(app_result);
+		}
+		close(out_pipe[1]);
+		close(res_pipe[1]);
+		children.push_back({ to, pid, out_pipe[0], res_pipe[0], "", {} });
+	}
+
+	/*
+	 * Drain the output pipes of all children as the data arrives so
+	 * no child ever blocks on a full pipe.
+	 */
+	unsigned open_fds = children.size();
+
+	while (open_fds) {
+		fd_set rd_fds;
+		int max_fd = -1;
+		char buf[4096];
+
+		FD_ZERO(&rd_fds);
+		for (auto &child : children) {
+			if (child.out_fd < 0)
+				continue;
+			FD_SET(child.out_fd, &rd_fds);
+			if (child.out_fd > max_fd)
+				max_fd = child.out_fd;
+		}
+		if (select(max_fd + 1, &rd_fds, nullptr, nullptr, nullptr) <= 0)
+			continue;
+		for (auto &child : children) {
+			if (child.out_fd < 0 || !FD_ISSET(child.out_fd, &rd_fds))
+				continue;
+
+			ssize_t n = read(child.out_fd, buf, sizeof(buf));
+
+			if (n > 0) {
+				child.output.append(buf, n);
+				continue;
+			}
+			close(child.out_fd);
+			child.out_fd = -1;
+			open_fds--;
+		}
+	}
+
+	for (auto &child : children) {
+		int wstatus = 0;
+
+		if (read(child.res_fd, &child.res, sizeof(child.res)) < (ssize_t)sizeof(child.res))
+			memset(&child.res, 0, sizeof(child.res));
+		close(child.res_fd);
+		waitpid(child.pid, &wstatus, 0);
+		fputs(child.output.c_str(), stdout);
+		tests_total += child.res.tests_total;
+		tests_ok += child.res.tests_ok;
+		warnings += child.res.warnings;
+		if (child.res.app_result)
+			app_result = child.res.app_result;
+		else if (WIFEXITED(wstatus) && WEXITSTATUS(wstatus))
+			app_result = WEXITSTATUS(wstatus);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	std::string device;
@@ -1266,7 +1412,14 @@ int main(int argc, char **argv)
 	if (remote_la >= 0)
 		remote_la_mask = 1 << remote_la;
 
-	if (test_remote) {
+	if (options[OptParallel] && options[OptInteractive]) {
+		fprintf(stderr, "--parallel cannot be combined with --interactive, testing serially.\n");
+		options[OptParallel] = 0;
+	}
+
+	if (test_remote && options[OptParallel]) {
+		test_remotes_parallel(node, laddrs, remote_la_mask, test_tags);
+	} else if (test_remote) {
 		for (unsigned i = 0; i < node.num_log_addrs; i++) {
 			unsigned from = node.log_addr[i];
 			node.prim_devtype = laddrs.primary_device_type[i];
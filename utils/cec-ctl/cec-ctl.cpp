@@ -110,6 +110,8 @@ enum Option {
 	OptIgnore,
 	OptStorePin,
 	OptAnalyzePin,
+	OptMonitorToFile,
+	OptBatch,
 	OptRcTVProfile1,
 	OptRcTVProfile2,
 	OptRcTVProfile3,
@@ -179,6 +181,8 @@ static struct option long_options[] = {
 	{ "ignore", required_argument, nullptr, OptIgnore },
 	{ "store-pin", required_argument, nullptr, OptStorePin },
 	{ "analyze-pin", required_argument, nullptr, OptAnalyzePin },
+	{ "monitor-to-file", required_argument, nullptr, OptMonitorToFile },
+	{ "batch", no_argument, nullptr, OptBatch },
 	{ "no-reply", no_argument, nullptr, OptToggleNoReply },
 	{ "non-blocking", no_argument, nullptr, OptNonBlocking },
 	{ "logical-address", no_argument, nullptr, OptLogicalAddress },
@@ -323,6 +327,10 @@ static void usage()
 	       "                           Use - for stdout.\n"
 	       "  --analyze-pin <from>     Analyze the low-level CEC pin changes from the file <from>.\n"
 	       "                           Use - for stdin.\n"
+	       "  --monitor-to-file <to>   Store monitored messages and events in raw binary form\n"
+	       "                           to the file <to> instead of formatting them.\n"
+	       "  --batch                  Queue all transmits at once and wait for the completions\n"
+	       "                           afterwards, reporting per-message latency.\n"
 	       "  --test-power-cycle [polls=<n>][,sleep=<secs>]\n"
 	       "                           Test power cycle behavior of the display. It polls up to\n"
 	       "                           <n> times (default 15), waiting for a state change. If\n"
@@ -870,13 +878,131 @@ static void wait_for_msgs(const struct node &node, __u32 monitor_time)
 
 #define MONITOR_FL_DROPPED_EVENTS     (1 << 16)
 
-static void monitor(const struct node &node, __u32 monitor_time, const char *store_pin)
+/*
+ * Preallocated single-producer single-consumer ring between the drain
+ * thread and the formatter. The drain thread only writes mon_head, the
+ * formatter only writes mon_tail; entries that don't fit are counted in
+ * mon_overflows instead of stalling the drain.
+ */
+#define MON_RING_SIZE 4096	/* entries, power of two */
+
+struct mon_entry {
+	bool is_msg;
+	struct cec_event ev;
+	struct cec_msg msg;
+};
+
+static const char *monitor_to_file;
+static struct mon_entry mon_ring[MON_RING_SIZE];
+static unsigned mon_head;
+static unsigned mon_tail;
+static __u64 mon_overflows;
+static bool mon_stop;
+
+static void mon_push(const struct mon_entry &entry)
 {
-	__u32 monitor = CEC_MODE_MONITOR;
+	unsigned head = mon_head;
+	unsigned tail = __atomic_load_n(&mon_tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail >= MON_RING_SIZE) {
+		__atomic_add_fetch(&mon_overflows, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	mon_ring[head & (MON_RING_SIZE - 1)] = entry;
+	__atomic_store_n(&mon_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Keep this loop tight: it only dequeues events and messages and copies
+ * them into the ring. All formatting and file I/O happens on the other
+ * side of the ring, so stalled output (ssh, slow disk) can no longer
+ * cause pin transition events to be lost.
+ */
+static void *monitor_drain_thread(void *arg)
+{
+	const struct node *node = static_cast<const struct node *>(arg);
+	int fd = node->fd;
+	struct mon_entry entry;
 	fd_set rd_fds;
 	fd_set ex_fds;
+
+	while (!__atomic_load_n(&mon_stop, __ATOMIC_ACQUIRE)) {
+		struct timeval tv = { 0, 100000 };
+		int res;
+
+		FD_ZERO(&rd_fds);
+		FD_ZERO(&ex_fds);
+		FD_SET(fd, &rd_fds);
+		FD_SET(fd, &ex_fds);
+		res = select(fd + 1, &rd_fds, nullptr, &ex_fds, &tv);
+		if (res < 0)
+			break;
+		if (FD_ISSET(fd, &rd_fds)) {
+			memset(&entry.msg, 0, sizeof(entry.msg));
+			res = ioctl(fd, CEC_RECEIVE, &entry.msg);
+			if (res && errno == ENODEV) {
+				fprintf(stderr, "Device was disconnected.\n");
+				break;
+			}
+			if (!res) {
+				entry.is_msg = true;
+				mon_push(entry);
+			}
+		}
+		if (FD_ISSET(fd, &ex_fds)) {
+			if (!ioctl(fd, CEC_DQEVENT, &entry.ev)) {
+				entry.is_msg = false;
+				mon_push(entry);
+			}
+		}
+	}
+	__atomic_store_n(&mon_stop, true, __ATOMIC_RELEASE);
+	return nullptr;
+}
+
+/*
+ * Binary capture format for --monitor-to-file: an 8-byte magic, the
+ * sizes of the two structs (so a reader can detect layout changes),
+ * then one record per entry: a __u32 type (0 = event, 1 = message)
+ * followed by the raw struct. Nothing is formatted at capture time.
+ */
+#define MON_BIN_MAGIC "CECMON01"
+#define MON_BIN_MAGIC_LEN 8
+
+static FILE *monitor_bin_open(const char *fname)
+{
+	__u32 sizes[2] = { sizeof(struct cec_event), sizeof(struct cec_msg) };
+	FILE *f = fopen(fname, "wb");
+
+	if (f == nullptr) {
+		fprintf(stderr, "Failed to open %s: %s\n", fname,
+			strerror(errno));
+		std::exit(EXIT_FAILURE);
+	}
+	fwrite(MON_BIN_MAGIC, MON_BIN_MAGIC_LEN, 1, f);
+	fwrite(sizes, sizeof(sizes), 1, f);
+	return f;
+}
+
+static void monitor_bin_write(FILE *f, const struct mon_entry &entry)
+{
+	__u32 type = entry.is_msg;
+
+	fwrite(&type, sizeof(type), 1, f);
+	if (entry.is_msg)
+		fwrite(&entry.msg, sizeof(entry.msg), 1, f);
+	else
+		fwrite(&entry.ev, sizeof(entry.ev), 1, f);
+}
+
+static void monitor(const struct node &node, __u32 monitor_time, const char *store_pin)
+{
+	__u32 monitor = CEC_MODE_MONITOR;
 	int fd = node.fd;
 	FILE *fstore = nullptr;
+	FILE *fbin = nullptr;
+	unsigned idle_polls = 0;
+	pthread_t drain;
 	time_t t, start_minute;
 
 	if (options[OptMonitorAll])
@@ -933,28 +1059,55 @@ static void monitor(const struct node &node, __u32 monitor_time, const char *sto
 	if (fstore != stdout)
 		printf("\n");
 
+	if (monitor_to_file)
+		fbin = monitor_bin_open(monitor_to_file);
+
 	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 	start_minute = time(nullptr);
 	t = start_minute + monitor_time;
 
+	if (pthread_create(&drain, nullptr, monitor_drain_thread,
+			   const_cast<struct node *>(&node))) {
+		fprintf(stderr, "Failed to create the drain thread\n");
+		std::exit(EXIT_FAILURE);
+	}
+
+	/*
+	 * From here on this thread is only the formatter: it consumes the
+	 * ring that the drain thread fills and does all the (potentially
+	 * slow) formatting and file I/O.
+	 */
 	while (1) {
 		time_t now = time(nullptr);
-		struct timeval tv = { 1, 0 };
-		bool pin_event = false;
-		int res;
+		unsigned tail = mon_tail;
+		unsigned head;
 
 		fflush(stdout);
 		if (monitor_time && now >= t)
 			break;
-		FD_ZERO(&rd_fds);
-		FD_ZERO(&ex_fds);
-		FD_SET(fd, &rd_fds);
-		FD_SET(fd, &ex_fds);
-		res = select(fd + 1, &rd_fds, nullptr, &ex_fds, &tv);
-		if (res < 0)
+		if (__atomic_load_n(&mon_stop, __ATOMIC_ACQUIRE))
 			break;
-		if (store_pin && now - start_minute > 60 &&
-		    (FD_ISSET(fd, &rd_fds) || FD_ISSET(fd, &ex_fds))) {
+		head = __atomic_load_n(&mon_head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			/*
+			 * Mirror the old behavior of generating an
+			 * end-of-bit event if the bus was idle for about
+			 * a second after the last pin transition.
+			 */
+			if (++idle_polls >= 100 && eob_ts) {
+				struct timespec ts;
+				__u64 ts64;
+
+				clock_gettime(CLOCK_MONOTONIC, &ts);
+				ts64 = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+				generate_eob_event(ts64, fstore);
+				idle_polls = 0;
+			}
+			usleep(10000);
+			continue;
+		}
+		idle_polls = 0;
+		if (store_pin && now - start_minute > 60) {
 			/*
 			 * The drift between the monotonic and wallclock
 			 * time can be quite high (1 ms per minute), so
@@ -970,53 +1123,51 @@ static void monitor(const struct node &node, __u32 monitor_time, const char *sto
 			fflush(fstore);
 			start_minute = now;
 		}
-		if (FD_ISSET(fd, &rd_fds)) {
-			struct cec_msg msg = { };
-
-			res = doioctl(&node, CEC_RECEIVE, &msg);
-			if (res == ENODEV) {
-				fprintf(stderr, "Device was disconnected.\n");
-				break;
-			}
-			if (!res && fstore != stdout)
-				show_msg(msg);
-		}
-		if (FD_ISSET(fd, &ex_fds)) {
-			struct cec_event ev;
-
-			if (doioctl(&node, CEC_DQEVENT, &ev))
-				continue;
-			if (ev.event == CEC_EVENT_PIN_CEC_LOW ||
-			    ev.event == CEC_EVENT_PIN_CEC_HIGH ||
-			    ev.event == CEC_EVENT_PIN_HPD_LOW ||
-			    ev.event == CEC_EVENT_PIN_HPD_HIGH ||
-			    ev.event == CEC_EVENT_PIN_5V_LOW ||
-			    ev.event == CEC_EVENT_PIN_5V_HIGH)
-				pin_event = true;
-			if (ev.event == CEC_EVENT_PIN_CEC_LOW ||
-			    ev.event == CEC_EVENT_PIN_CEC_HIGH)
-				generate_eob_event(ev.ts, fstore);
-			if (pin_event && fstore) {
-				unsigned int v = ev.event - CEC_EVENT_PIN_CEC_LOW;
-
-				if (ev.flags & CEC_EVENT_FL_DROPPED_EVENTS)
-					v |= MONITOR_FL_DROPPED_EVENTS;
-				fprintf(fstore, "%llu.%09llu %d\n",
-					ev.ts / 1000000000, ev.ts % 1000000000, v);
-				fflush(fstore);
+		while (tail != head) {
+			struct mon_entry entry = mon_ring[tail & (MON_RING_SIZE - 1)];
+			bool pin_event = false;
+
+			if (fbin)
+				monitor_bin_write(fbin, entry);
+			if (entry.is_msg) {
+				if (!fbin && fstore != stdout)
+					show_msg(entry.msg);
+			} else {
+				const struct cec_event &ev = entry.ev;
+
+				if (ev.event == CEC_EVENT_PIN_CEC_LOW ||
+				    ev.event == CEC_EVENT_PIN_CEC_HIGH ||
+				    ev.event == CEC_EVENT_PIN_HPD_LOW ||
+				    ev.event == CEC_EVENT_PIN_HPD_HIGH ||
+				    ev.event == CEC_EVENT_PIN_5V_LOW ||
+				    ev.event == CEC_EVENT_PIN_5V_HIGH)
+					pin_event = true;
+				if (ev.event == CEC_EVENT_PIN_CEC_LOW ||
+				    ev.event == CEC_EVENT_PIN_CEC_HIGH)
+					generate_eob_event(ev.ts, fstore);
+				if (pin_event && fstore) {
+					unsigned int v = ev.event - CEC_EVENT_PIN_CEC_LOW;
+
+					if (ev.flags & CEC_EVENT_FL_DROPPED_EVENTS)
+						v |= MONITOR_FL_DROPPED_EVENTS;
+					fprintf(fstore, "%llu.%09llu %d\n",
+						ev.ts / 1000000000, ev.ts % 1000000000, v);
+					fflush(fstore);
+				}
+				if (!fbin && (!pin_event || options[OptMonitorPin]))
+					log_event(entry.ev, fstore != stdout);
 			}
-			if (!pin_event || options[OptMonitorPin])
-				log_event(ev, fstore != stdout);
-		}
-		if (!res && eob_ts) {
-			struct timespec ts;
-			__u64 ts64;
-
-			clock_gettime(CLOCK_MONOTONIC, &ts);
-			ts64 = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
-			generate_eob_event(ts64, fstore);
+			tail++;
+			__atomic_store_n(&mon_tail, tail, __ATOMIC_RELEASE);
 		}
 	}
+	__atomic_store_n(&mon_stop, true, __ATOMIC_RELEASE);
+	pthread_join(drain, nullptr);
+	if (mon_overflows)
+		fprintf(stderr, "Dropped %llu entries due to ring overflow\n",
+			mon_overflows);
+	if (fbin)
+		fclose(fbin);
 	if (fstore && fstore != stdout)
 		fclose(fstore);
 }
@@ -1225,6 +1376,130 @@ static int transmit_msg_retry(const struct node &node, struct cec_msg &msg)
 	return ret;
 }
 
+/*
+ * Transmit all prepared messages in one go instead of waiting for each
+ * transmit to finish before queueing the next. The messages are queued
+ * with non-blocking CEC_TRANSMIT calls (the CEC core supports multiple
+ * pending transmits per device) and the sequence-numbered completions
+ * are reaped from CEC_RECEIVE, so scripted command sequences run at
+ * bus speed instead of at round-trip speed.
+ */
+static void batch_transmit(const struct node &node, msg_vec &msgs, __u32 timeout)
+{
+	struct batch_slot {
+		__u64 queued_ts;
+		__u64 done_ts;
+		int ret;
+	};
+	std::vector<batch_slot> slots(msgs.size());
+	unsigned next_idx = 0;
+	unsigned num_done = 0;
+	__u64 start_ts, end_ts;
+	int fd = node.fd;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	start_ts = current_ts();
+
+	while (num_done < msgs.size()) {
+		fd_set rd_fds;
+		struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+		int res;
+
+		while (next_idx < msgs.size()) {
+			struct cec_msg &msg = msgs[next_idx];
+			int ret = doioctl(&node, CEC_TRANSMIT, &msg);
+
+			if (ret == EBUSY)
+				/* TX queue is full, reap completions first */
+				break;
+			slots[next_idx].queued_ts = current_ts();
+			slots[next_idx].ret = ret;
+			if (ret) {
+				slots[next_idx].done_ts = slots[next_idx].queued_ts;
+				num_done++;
+			}
+			next_idx++;
+		}
+		if (num_done == msgs.size())
+			break;
+
+		FD_ZERO(&rd_fds);
+		FD_SET(fd, &rd_fds);
+		res = select(fd + 1, &rd_fds, nullptr, nullptr, &tv);
+		if (res < 0)
+			break;
+		if (res == 0) {
+			fprintf(stderr, "Timed out waiting for %zu transmit(s) to complete\n",
+				msgs.size() - num_done);
+			break;
+		}
+		for (;;) {
+			struct cec_msg rcv = { };
+
+			if (doioctl(&node, CEC_RECEIVE, &rcv))
+				break;
+			if (!rcv.sequence)
+				continue;
+			for (unsigned i = 0; i < next_idx; i++) {
+				if (slots[i].done_ts || slots[i].ret ||
+				    msgs[i].sequence != rcv.sequence)
+					continue;
+				msgs[i] = rcv;
+				slots[i].done_ts = current_ts();
+				num_done++;
+				break;
+			}
+		}
+	}
+	end_ts = current_ts();
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+	for (unsigned i = 0; i < msgs.size(); i++) {
+		struct cec_msg &msg = msgs[i];
+		__u8 to = msg.msg[0] & 0xf;
+
+		printf("\nTransmit from %s to %s (%d to %d):\n",
+		       cec_la2s(cec_msg_initiator(&msg)),
+		       to == 0xf ? "all" : cec_la2s(to),
+		       cec_msg_initiator(&msg), to);
+		cec_log_msg(&msg);
+		if (i >= next_idx) {
+			printf("\tNot transmitted\n");
+			continue;
+		}
+		if (slots[i].ret) {
+			printf("\tTransmit failed: %s\n", strerror(slots[i].ret));
+			continue;
+		}
+		if (msg.rx_status & (CEC_RX_STATUS_OK | CEC_RX_STATUS_FEATURE_ABORT)) {
+			printf("    Received from %s (%d):\n    ",
+			       cec_la2s(cec_msg_initiator(&msg)),
+			       cec_msg_initiator(&msg));
+			cec_log_msg(&msg);
+			if (options[OptShowRaw])
+				log_raw_msg(&msg);
+		}
+		printf("\tSequence: %u Tx Timestamp: %s",
+		       msg.sequence, ts2s(msg.tx_ts).c_str());
+		if (msg.rx_ts)
+			printf(" Rx Timestamp: %s\n\tApproximate response time: %u ms",
+			       ts2s(msg.rx_ts).c_str(),
+			       response_time_ms(msg));
+		printf("\n");
+		if (slots[i].done_ts)
+			printf("\tQueue-to-completion latency: %llu.%03llu ms\n",
+			       (slots[i].done_ts - slots[i].queued_ts) / 1000000,
+			       ((slots[i].done_ts - slots[i].queued_ts) / 1000) % 1000);
+		else
+			printf("\tNo completion seen\n");
+		if (!cec_msg_status_is_ok(&msg) || verbose)
+			printf("\t%s\n", cec_status2s(msg).c_str());
+	}
+	printf("\nTransmitted %u message(s) in %llu.%03llu ms\n",
+	       next_idx, (end_ts - start_ts) / 1000000,
+	       ((end_ts - start_ts) / 1000) % 1000);
+}
+
 static int init_power_cycle_test(const struct node &node, unsigned repeats, unsigned max_tries)
 {
 	struct cec_msg msg;
@@ -2157,6 +2432,9 @@ int main(int argc, char **argv)
 		case OptStorePin:
 			store_pin = optarg;
 			break;
+		case OptMonitorToFile:
+			monitor_to_file = optarg;
+			break;
 		case OptAnalyzePin:
 			analyze_pin = optarg;
 			break;
@@ -2822,7 +3100,6 @@ int main(int argc, char **argv)
 		fcntl(node.fd, F_SETFL, fcntl(node.fd, F_GETFL) | O_NONBLOCK);
 
 	for (auto &msg : msgs) {
-			fflush(stdout);
 		if (!cec_msg_is_broadcast(&msg) && !options[OptTo]) {
 			fprintf(stderr, "attempting to send message without --to\n");
 			std::exit(EXIT_FAILURE);
@@ -2831,12 +3108,21 @@ int main(int argc, char **argv)
 			msg.msg[0] = first_to;
 		msg.msg[0] &= 0x0f;
 		msg.msg[0] |= from << 4;
-		to = msg.msg[0] & 0xf;
-		printf("\nTransmit from %s to %s (%d to %d):\n",
-		       cec_la2s(from), to == 0xf ? "all" : cec_la2s(to), from, to);
 		msg.flags = options[OptReplyToFollowers] ? CEC_MSG_FL_REPLY_TO_FOLLOWERS : 0;
 		msg.flags |= options[OptRawMsg] ? CEC_MSG_FL_RAW : 0;
 		msg.timeout = msg.reply ? timeout : 0;
+	}
+
+	if (options[OptBatch] && !msgs.empty())
+		batch_transmit(node, msgs, timeout);
+
+	for (auto &msg : msgs) {
+		if (options[OptBatch])
+			break;
+		fflush(stdout);
+		to = msg.msg[0] & 0xf;
+		printf("\nTransmit from %s to %s (%d to %d):\n",
+		       cec_la2s(from), to == 0xf ? "all" : cec_la2s(to), from, to);
 		cec_log_msg(&msg);
 		if (doioctl(&node, CEC_TRANSMIT, &msg))
 			continue;
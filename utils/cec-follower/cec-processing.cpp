@@ -7,8 +7,11 @@
 #include <ctime>
 #include <string>
 
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
 #include "cec-follower.h"
 #include "compiler.h"
@@ -1078,11 +1081,81 @@ static void update_programmed_timers(struct node *node)
 	}
 }
 
+static __u64 min_deadline(__u64 deadline, __u64 ts)
+{
+	if (!deadline || ts < deadline)
+		return ts;
+	return deadline;
+}
+
+/* Convert a wallclock second to a monotonic timestamp in ns */
+static __u64 wall_to_ts(__u64 ts_now, time_t t_now, time_t t)
+{
+	if (t <= t_now)
+		return ts_now;
+	return ts_now + (t - t_now) * 1000000000ULL;
+}
+
+/*
+ * Compute the next monotonic deadline (in ns, 0 if there is none) at
+ * which one of the emulated state machines needs servicing. The main
+ * loop arms a timerfd with this value instead of waking up every
+ * second, so an idle follower sleeps until a message arrives and timed
+ * transitions happen when they are due rather than at the next poll.
+ */
+static __u64 next_event_deadline(struct node *node, unsigned me,
+				 time_t last_pwr_status_toggle)
+{
+	__u64 ts_now = get_ts();
+	time_t t_now = time(nullptr);
+	time_t changed = node->state.power_status_changed_time;
+	__u64 deadline = 0;
+
+	/* A power status transition is still in progress */
+	if (t_now - changed < time_to_stable) {
+		time_t next = changed + time_to_transient + 1;
+
+		if (next <= t_now)
+			next = changed + time_to_stable;
+		deadline = min_deadline(deadline, wall_to_ts(ts_now, t_now, next));
+	}
+
+	if (node->state.toggle_power_status && cec_has_tv(1 << me))
+		deadline = min_deadline(deadline, wall_to_ts(ts_now, t_now,
+			last_pwr_status_toggle + node->state.toggle_power_status + 1));
+
+	/* While remote devices are known, keep the 1 Hz polling cadence */
+	for (unsigned i = 0; i < 15; i++) {
+		if (i == me || !la_info[i].ts)
+			continue;
+		deadline = min_deadline(deadline,
+			(ts_now / 1000000000ULL + 1) * 1000000000ULL);
+		break;
+	}
+
+	if (node->state.rc_state != NOPRESS)
+		deadline = min_deadline(deadline, node->state.rc_press_rx_ts +
+			(FOLLOWER_SAFETY_TIMEOUT + 1) * 1000000ULL);
+
+	if (node->has_aud_rate && node->state.last_aud_rate_rx_ts)
+		deadline = min_deadline(deadline, node->state.last_aud_rate_rx_ts +
+			MAX_AUD_RATE_MSG_INTERVAL_NS + 1);
+
+	if (node->state.deck_skip_start)
+		deadline = min_deadline(deadline, node->state.deck_skip_start +
+			MAX_DECK_SKIP_NS + 1);
+
+	/* Programmed timers have minute granularity */
+	if (!programmed_timers.empty())
+		deadline = min_deadline(deadline,
+			wall_to_ts(ts_now, t_now, (t_now / 60 + 1) * 60));
+
+	return deadline;
+}
+
 void testProcessing(struct node *node, bool wallclock)
 {
 	struct cec_log_addrs laddrs;
-	fd_set rd_fds;
-	fd_set ex_fds;
 	int fd = node->fd;
 	__u32 mode = CEC_MODE_INITIATOR | CEC_MODE_FOLLOWER;
 	unsigned me;
@@ -1100,20 +1173,55 @@ void testProcessing(struct node *node, bool wallclock)
 
 	poll_remote_devs(node, me);
 
+	int epoll_fd = epoll_create1(0);
+	int timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	struct epoll_event ep_ev = {};
+
+	if (epoll_fd < 0 || timer_fd < 0) {
+		fprintf(stderr, "Failed to create epoll/timerfd: %s\n",
+			strerror(errno));
+		std::exit(EXIT_FAILURE);
+	}
+	ep_ev.events = EPOLLIN | EPOLLPRI;
+	ep_ev.data.fd = fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ep_ev);
+	ep_ev.events = EPOLLIN;
+	ep_ev.data.fd = timer_fd;
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &ep_ev);
+
 	while (true) {
 		int res;
-		struct timeval timeval = {};
+		struct epoll_event ep_evs[2];
+		struct itimerspec its = {};
+		__u64 deadline = next_event_deadline(node, me, last_pwr_status_toggle);
+		bool have_msg = false;
+		bool have_event = false;
 
 		fflush(stdout);
-		timeval.tv_sec = 1;
-		FD_ZERO(&rd_fds);
-		FD_ZERO(&ex_fds);
-		FD_SET(fd, &rd_fds);
-		FD_SET(fd, &ex_fds);
-		res = select(fd + 1, &rd_fds, nullptr, &ex_fds, &timeval);
-		if (res < 0)
+		if (deadline) {
+			its.it_value.tv_sec = deadline / 1000000000ULL;
+			its.it_value.tv_nsec = deadline % 1000000000ULL;
+		}
+		/* A zero it_value disarms the timer: nothing is pending */
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, nullptr);
+		res = epoll_wait(epoll_fd, ep_evs, 2, -1);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
 			break;
-		if (FD_ISSET(fd, &ex_fds)) {
+		}
+		for (int i = 0; i < res; i++) {
+			if (ep_evs[i].data.fd == timer_fd) {
+				__u64 expirations;
+
+				if (read(timer_fd, &expirations, sizeof(expirations)) < 0)
+					continue;
+			} else {
+				have_msg = ep_evs[i].events & EPOLLIN;
+				have_event = ep_evs[i].events & EPOLLPRI;
+			}
+		}
+		if (have_event) {
 			struct cec_event ev;
 
 			res = doioctl(node, CEC_DQEVENT, &ev);
@@ -1138,7 +1246,7 @@ void testProcessing(struct node *node, bool wallclock)
 				memset(la_info, 0, sizeof(la_info));
 			}
 		}
-		if (FD_ISSET(fd, &rd_fds)) {
+		if (have_msg) {
 			struct cec_msg msg = { };
 
 			res = doioctl(node, CEC_RECEIVE, &msg);
@@ -1241,6 +1349,8 @@ void testProcessing(struct node *node, bool wallclock)
 		if (!programmed_timers.empty())
 			update_programmed_timers(node);
 	}
+	close(timer_fd);
+	close(epoll_fd);
 	mode = CEC_MODE_INITIATOR;
 	doioctl(node, CEC_S_MODE, &mode);
 }
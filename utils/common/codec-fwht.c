@@ -14,6 +14,24 @@
 #include <linux/videodev2.h>
 #include "codec-fwht.h"
 
+/*
+ * The SSE2/NEON paths below (zero-run scanning in the run-length coder
+ * and the column pass of the transforms) are userspace-only; building
+ * with -DFWHT_SIMD_SELFTEST compares every vector result against the
+ * scalar reference.
+ */
+#if defined(__SSE2__)
+#define FWHT_HAVE_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+#define FWHT_HAVE_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#ifdef FWHT_SIMD_SELFTEST
+#include <assert.h>
+#endif
+
 #define OVERFLOW_BIT BIT(14)
 
 /*
@@ -47,12 +65,8 @@ static const uint8_t zigzag[64] = {
 	63,
 };
 
-/*
- * noinline_for_stack to work around
- * https://bugs.llvm.org/show_bug.cgi?id=38809
- */
-static int noinline_for_stack
-rlc(const s16 *in, __be16 *output, int blocktype)
+#if !defined(FWHT_HAVE_SIMD) || defined(FWHT_SIMD_SELFTEST)
+static int rlc_scalar(const s16 *in, __be16 *output, int blocktype)
 {
 	s16 block[8 * 8];
 	s16 *wp = block;
@@ -106,6 +120,127 @@ rlc(const s16 *in, __be16 *output, int blocktype)
 
 	return ret;
 }
+#endif
+
+#ifdef FWHT_HAVE_SIMD
+/*
+ * Build a bitmask of the zigzag-ordered block, one bit per coefficient,
+ * set when the coefficient is non-zero. The zero runs the run-length
+ * coder has to find then become trailing-zero counts on the mask instead
+ * of a coefficient-by-coefficient dependent load/compare chain.
+ */
+static u64 rlc_nonzero_mask(const s16 *block)
+{
+	u64 mask = 0;
+	int i;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+
+	for (i = 0; i < 4; i++) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(block + i * 16));
+		__m128i b = _mm_loadu_si128((const __m128i *)(block + i * 16 + 8));
+		__m128i eq = _mm_packs_epi16(_mm_cmpeq_epi16(a, zero),
+					     _mm_cmpeq_epi16(b, zero));
+
+		mask |= (u64)(u16)~_mm_movemask_epi8(eq) << (i * 16);
+	}
+#else
+	static const u16 lane_bit[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+	const uint16x8_t bits = vld1q_u16(lane_bit);
+	const int16x8_t zero = vdupq_n_s16(0);
+
+	for (i = 0; i < 8; i++) {
+		uint16x8_t nz = vmvnq_u16(vceqq_s16(vld1q_s16(block + i * 8),
+						    zero));
+		uint16x4_t sum;
+
+		nz = vandq_u16(nz, bits);
+		sum = vpadd_u16(vget_low_u16(nz), vget_high_u16(nz));
+		sum = vpadd_u16(sum, sum);
+		sum = vpadd_u16(sum, sum);
+		mask |= (u64)vget_lane_u16(sum, 0) << (i * 8);
+	}
+#endif
+	return mask;
+}
+
+static int rlc_mask(const s16 *in, __be16 *output, int blocktype)
+{
+	s16 block[8 * 8];
+	u64 mask;
+	int lastzero_run;
+	int to_encode;
+	int i;
+	int ret = 0;
+
+	/* gather the block in zigzag order so the runs are linear scans */
+	for (i = 0; i < 8 * 8; i++)
+		block[i] = in[zigzag[i]];
+
+	mask = rlc_nonzero_mask(block);
+	lastzero_run = mask ? __builtin_clzll(mask) : 8 * 8;
+
+	*output++ = (blocktype == PBLOCK ? htons(PFRAME_BIT) : 0);
+	ret++;
+
+	to_encode = 8 * 8 - (lastzero_run > 14 ? lastzero_run : 0);
+
+	i = 0;
+	while (i < to_encode) {
+		u64 rem = mask >> i;
+		int gap = rem ? __builtin_ctzll(rem) : to_encode - i;
+
+		if (i + gap >= to_encode) {
+			/* the block ends in a zero run of at most 14 */
+			*output++ = htons(to_encode - i - 1);
+			ret++;
+			break;
+		}
+		if (gap > 14) {
+			/* a zero run longer than the 4-bit run field */
+			*output++ = htons(14);
+			ret++;
+			i += 15;
+			continue;
+		}
+		/* 4 bits for run, 12 for coefficient (quantization by 4) */
+		*output++ = htons(gap | block[i + gap] << 4);
+		ret++;
+		i += gap + 1;
+	}
+	if (lastzero_run > 14) {
+		*output = htons(ALL_ZEROS | 0);
+		ret++;
+	}
+
+	return ret;
+}
+#endif
+
+/*
+ * noinline_for_stack to work around
+ * https://bugs.llvm.org/show_bug.cgi?id=38809
+ */
+static int noinline_for_stack
+rlc(const s16 *in, __be16 *output, int blocktype)
+{
+#ifdef FWHT_HAVE_SIMD
+#ifdef FWHT_SIMD_SELFTEST
+	__be16 ref[8 * 8 + 1];
+	int ref_ret = rlc_scalar(in, ref, blocktype);
+	int ret = rlc_mask(in, output, blocktype);
+
+	assert(ret == ref_ret);
+	assert(!memcmp(output, ref, ret * sizeof(*output)));
+	return ret;
+#else
+	return rlc_mask(in, output, blocktype);
+#endif
+#else
+	return rlc_scalar(in, output, blocktype);
+#endif
+}
 
 /*
  * This function will worst-case increase rlc_in by 65*2 bytes:
@@ -147,13 +282,13 @@ derlc(const __be16 **rlc_in, s16 *dwht_out, const __be16 *end_of_input)
 
 		/* fill remainder with zeros */
 		if (length == 15) {
-			for (i = 0; i < 64 - dec_count; i++)
-				*wp++ = 0;
+			memset(wp, 0, (64 - dec_count) * sizeof(*wp));
+			wp += 64 - dec_count;
 			break;
 		}
 
-		for (i = 0; i < length; i++)
-			*wp++ = 0;
+		memset(wp, 0, length * sizeof(*wp));
+		wp += length;
 		*wp++ = coeff;
 		dec_count += length + 1;
 	}
@@ -245,6 +380,229 @@ static void dequantize_inter(s16 *coeff)
 			*coeff <<= *quant;
 }
 
+/*
+ * The second (column) pass of all three transforms runs the same butterfly
+ * network over whole 8-element rows with unit stride, optionally followed
+ * by the inverse rescaling. It is split out so that the SSE2/NEON versions
+ * below can execute each butterfly stage as one vector add/sub per row
+ * instead of eight scalar operations. All intermediates of a stream that
+ * was produced by the forward transform stay within +/-16320, so 16-bit
+ * lanes do not overflow. Building with -DFWHT_SIMD_SELFTEST compares every
+ * vector result against this scalar reference.
+ */
+enum fwht_col_mode {
+	FWHT_COL_PLAIN,		/* forward transforms */
+	FWHT_COL_INTER,		/* inverse, scale back */
+	FWHT_COL_INTRA,		/* inverse, scale back and re-center */
+};
+
+#if !defined(FWHT_HAVE_SIMD) || defined(FWHT_SIMD_SELFTEST)
+static void fwht_col_pass_scalar(s16 *block, enum fwht_col_mode mode)
+{
+	s32 workspace1[8], workspace2[8];
+	s16 *out = block;
+	int i, d;
+
+	for (i = 0; i < 8; i++, out++) {
+		/* stage 1 */
+		workspace1[0]  = out[0] + out[1 * 8];
+		workspace1[1]  = out[0] - out[1 * 8];
+
+		workspace1[2]  = out[2 * 8] + out[3 * 8];
+		workspace1[3]  = out[2 * 8] - out[3 * 8];
+
+		workspace1[4]  = out[4 * 8] + out[5 * 8];
+		workspace1[5]  = out[4 * 8] - out[5 * 8];
+
+		workspace1[6]  = out[6 * 8] + out[7 * 8];
+		workspace1[7]  = out[6 * 8] - out[7 * 8];
+
+		/* stage 2 */
+		workspace2[0] = workspace1[0] + workspace1[2];
+		workspace2[1] = workspace1[0] - workspace1[2];
+		workspace2[2] = workspace1[1] - workspace1[3];
+		workspace2[3] = workspace1[1] + workspace1[3];
+
+		workspace2[4] = workspace1[4] + workspace1[6];
+		workspace2[5] = workspace1[4] - workspace1[6];
+		workspace2[6] = workspace1[5] - workspace1[7];
+		workspace2[7] = workspace1[5] + workspace1[7];
+
+		/* stage 3 */
+		out[0 * 8] = workspace2[0] + workspace2[4];
+		out[1 * 8] = workspace2[0] - workspace2[4];
+		out[2 * 8] = workspace2[1] - workspace2[5];
+		out[3 * 8] = workspace2[1] + workspace2[5];
+		out[4 * 8] = workspace2[2] + workspace2[6];
+		out[5 * 8] = workspace2[2] - workspace2[6];
+		out[6 * 8] = workspace2[3] - workspace2[7];
+		out[7 * 8] = workspace2[3] + workspace2[7];
+
+		if (mode == FWHT_COL_PLAIN)
+			continue;
+		for (d = 0; d < 8; d++) {
+			out[8 * d] >>= 6;
+			if (mode == FWHT_COL_INTRA)
+				out[8 * d] += 128;
+		}
+	}
+}
+#endif
+
+#if defined(__SSE2__)
+
+static void fwht_col_pass_simd(s16 *block, enum fwht_col_mode mode)
+{
+	__m128i r0 = _mm_loadu_si128((const __m128i *)(block + 0 * 8));
+	__m128i r1 = _mm_loadu_si128((const __m128i *)(block + 1 * 8));
+	__m128i r2 = _mm_loadu_si128((const __m128i *)(block + 2 * 8));
+	__m128i r3 = _mm_loadu_si128((const __m128i *)(block + 3 * 8));
+	__m128i r4 = _mm_loadu_si128((const __m128i *)(block + 4 * 8));
+	__m128i r5 = _mm_loadu_si128((const __m128i *)(block + 5 * 8));
+	__m128i r6 = _mm_loadu_si128((const __m128i *)(block + 6 * 8));
+	__m128i r7 = _mm_loadu_si128((const __m128i *)(block + 7 * 8));
+
+	/* stage 1 */
+	__m128i w10 = _mm_add_epi16(r0, r1);
+	__m128i w11 = _mm_sub_epi16(r0, r1);
+	__m128i w12 = _mm_add_epi16(r2, r3);
+	__m128i w13 = _mm_sub_epi16(r2, r3);
+	__m128i w14 = _mm_add_epi16(r4, r5);
+	__m128i w15 = _mm_sub_epi16(r4, r5);
+	__m128i w16 = _mm_add_epi16(r6, r7);
+	__m128i w17 = _mm_sub_epi16(r6, r7);
+
+	/* stage 2 */
+	__m128i w20 = _mm_add_epi16(w10, w12);
+	__m128i w21 = _mm_sub_epi16(w10, w12);
+	__m128i w22 = _mm_sub_epi16(w11, w13);
+	__m128i w23 = _mm_add_epi16(w11, w13);
+	__m128i w24 = _mm_add_epi16(w14, w16);
+	__m128i w25 = _mm_sub_epi16(w14, w16);
+	__m128i w26 = _mm_sub_epi16(w15, w17);
+	__m128i w27 = _mm_add_epi16(w15, w17);
+
+	/* stage 3 */
+	r0 = _mm_add_epi16(w20, w24);
+	r1 = _mm_sub_epi16(w20, w24);
+	r2 = _mm_sub_epi16(w21, w25);
+	r3 = _mm_add_epi16(w21, w25);
+	r4 = _mm_add_epi16(w22, w26);
+	r5 = _mm_sub_epi16(w22, w26);
+	r6 = _mm_sub_epi16(w23, w27);
+	r7 = _mm_add_epi16(w23, w27);
+
+	if (mode != FWHT_COL_PLAIN) {
+		const __m128i c =
+			_mm_set1_epi16(mode == FWHT_COL_INTRA ? 128 : 0);
+
+		r0 = _mm_add_epi16(_mm_srai_epi16(r0, 6), c);
+		r1 = _mm_add_epi16(_mm_srai_epi16(r1, 6), c);
+		r2 = _mm_add_epi16(_mm_srai_epi16(r2, 6), c);
+		r3 = _mm_add_epi16(_mm_srai_epi16(r3, 6), c);
+		r4 = _mm_add_epi16(_mm_srai_epi16(r4, 6), c);
+		r5 = _mm_add_epi16(_mm_srai_epi16(r5, 6), c);
+		r6 = _mm_add_epi16(_mm_srai_epi16(r6, 6), c);
+		r7 = _mm_add_epi16(_mm_srai_epi16(r7, 6), c);
+	}
+
+	_mm_storeu_si128((__m128i *)(block + 0 * 8), r0);
+	_mm_storeu_si128((__m128i *)(block + 1 * 8), r1);
+	_mm_storeu_si128((__m128i *)(block + 2 * 8), r2);
+	_mm_storeu_si128((__m128i *)(block + 3 * 8), r3);
+	_mm_storeu_si128((__m128i *)(block + 4 * 8), r4);
+	_mm_storeu_si128((__m128i *)(block + 5 * 8), r5);
+	_mm_storeu_si128((__m128i *)(block + 6 * 8), r6);
+	_mm_storeu_si128((__m128i *)(block + 7 * 8), r7);
+}
+
+#elif defined(__ARM_NEON__) || defined(__aarch64__)
+
+static void fwht_col_pass_simd(s16 *block, enum fwht_col_mode mode)
+{
+	int16x8_t r0 = vld1q_s16(block + 0 * 8);
+	int16x8_t r1 = vld1q_s16(block + 1 * 8);
+	int16x8_t r2 = vld1q_s16(block + 2 * 8);
+	int16x8_t r3 = vld1q_s16(block + 3 * 8);
+	int16x8_t r4 = vld1q_s16(block + 4 * 8);
+	int16x8_t r5 = vld1q_s16(block + 5 * 8);
+	int16x8_t r6 = vld1q_s16(block + 6 * 8);
+	int16x8_t r7 = vld1q_s16(block + 7 * 8);
+
+	/* stage 1 */
+	int16x8_t w10 = vaddq_s16(r0, r1);
+	int16x8_t w11 = vsubq_s16(r0, r1);
+	int16x8_t w12 = vaddq_s16(r2, r3);
+	int16x8_t w13 = vsubq_s16(r2, r3);
+	int16x8_t w14 = vaddq_s16(r4, r5);
+	int16x8_t w15 = vsubq_s16(r4, r5);
+	int16x8_t w16 = vaddq_s16(r6, r7);
+	int16x8_t w17 = vsubq_s16(r6, r7);
+
+	/* stage 2 */
+	int16x8_t w20 = vaddq_s16(w10, w12);
+	int16x8_t w21 = vsubq_s16(w10, w12);
+	int16x8_t w22 = vsubq_s16(w11, w13);
+	int16x8_t w23 = vaddq_s16(w11, w13);
+	int16x8_t w24 = vaddq_s16(w14, w16);
+	int16x8_t w25 = vsubq_s16(w14, w16);
+	int16x8_t w26 = vsubq_s16(w15, w17);
+	int16x8_t w27 = vaddq_s16(w15, w17);
+
+	/* stage 3 */
+	r0 = vaddq_s16(w20, w24);
+	r1 = vsubq_s16(w20, w24);
+	r2 = vsubq_s16(w21, w25);
+	r3 = vaddq_s16(w21, w25);
+	r4 = vaddq_s16(w22, w26);
+	r5 = vsubq_s16(w22, w26);
+	r6 = vsubq_s16(w23, w27);
+	r7 = vaddq_s16(w23, w27);
+
+	if (mode != FWHT_COL_PLAIN) {
+		const int16x8_t c =
+			vdupq_n_s16(mode == FWHT_COL_INTRA ? 128 : 0);
+
+		r0 = vaddq_s16(vshrq_n_s16(r0, 6), c);
+		r1 = vaddq_s16(vshrq_n_s16(r1, 6), c);
+		r2 = vaddq_s16(vshrq_n_s16(r2, 6), c);
+		r3 = vaddq_s16(vshrq_n_s16(r3, 6), c);
+		r4 = vaddq_s16(vshrq_n_s16(r4, 6), c);
+		r5 = vaddq_s16(vshrq_n_s16(r5, 6), c);
+		r6 = vaddq_s16(vshrq_n_s16(r6, 6), c);
+		r7 = vaddq_s16(vshrq_n_s16(r7, 6), c);
+	}
+
+	vst1q_s16(block + 0 * 8, r0);
+	vst1q_s16(block + 1 * 8, r1);
+	vst1q_s16(block + 2 * 8, r2);
+	vst1q_s16(block + 3 * 8, r3);
+	vst1q_s16(block + 4 * 8, r4);
+	vst1q_s16(block + 5 * 8, r5);
+	vst1q_s16(block + 6 * 8, r6);
+	vst1q_s16(block + 7 * 8, r7);
+}
+
+#endif
+
+static void fwht_col_pass(s16 *block, enum fwht_col_mode mode)
+{
+#ifdef FWHT_HAVE_SIMD
+#ifdef FWHT_SIMD_SELFTEST
+	s16 ref[8 * 8];
+
+	memcpy(ref, block, sizeof(ref));
+	fwht_col_pass_scalar(ref, mode);
+	fwht_col_pass_simd(block, mode);
+	assert(!memcmp(ref, block, sizeof(ref)));
+#else
+	fwht_col_pass_simd(block, mode);
+#endif
+#else
+	fwht_col_pass_scalar(block, mode);
+#endif
+}
+
 static void noinline_for_stack fwht(const u8 *block, s16 *output_block,
 				    unsigned int stride,
 				    unsigned int input_step, bool intra)
@@ -335,42 +693,7 @@ static void noinline_for_stack fwht(const u8 *block, s16 *output_block,
 		out[7] = workspace2[3] + workspace2[7];
 	}
 
-	out = output_block;
-
-	for (i = 0; i < 8; i++, out++) {
-		/* stage 1 */
-		workspace1[0]  = out[0] + out[1 * 8];
-		workspace1[1]  = out[0] - out[1 * 8];
-
-		workspace1[2]  = out[2 * 8] + out[3 * 8];
-		workspace1[3]  = out[2 * 8] - out[3 * 8];
-
-		workspace1[4]  = out[4 * 8] + out[5 * 8];
-		workspace1[5]  = out[4 * 8] - out[5 * 8];
-
-		workspace1[6]  = out[6 * 8] + out[7 * 8];
-		workspace1[7]  = out[6 * 8] - out[7 * 8];
-
-		/* stage 2 */
-		workspace2[0] = workspace1[0] + workspace1[2];
-		workspace2[1] = workspace1[0] - workspace1[2];
-		workspace2[2] = workspace1[1] - workspace1[3];
-		workspace2[3] = workspace1[1] + workspace1[3];
-
-		workspace2[4] = workspace1[4] + workspace1[6];
-		workspace2[5] = workspace1[4] - workspace1[6];
-		workspace2[6] = workspace1[5] - workspace1[7];
-		workspace2[7] = workspace1[5] + workspace1[7];
-		/* stage 3 */
-		out[0 * 8] = workspace2[0] + workspace2[4];
-		out[1 * 8] = workspace2[0] - workspace2[4];
-		out[2 * 8] = workspace2[1] - workspace2[5];
-		out[3 * 8] = workspace2[1] + workspace2[5];
-		out[4 * 8] = workspace2[2] + workspace2[6];
-		out[5 * 8] = workspace2[2] - workspace2[6];
-		out[6 * 8] = workspace2[3] - workspace2[7];
-		out[7 * 8] = workspace2[3] + workspace2[7];
-	}
+	fwht_col_pass(output_block, FWHT_COL_PLAIN);
 }
 
 /*
@@ -424,43 +747,7 @@ fwht16(const s16 *block, s16 *output_block, int stride, int intra)
 		out[7] = workspace2[3] + workspace2[7];
 	}
 
-	out = output_block;
-
-	for (i = 0; i < 8; i++, out++) {
-		/* stage 1 */
-		workspace1[0]  = out[0] + out[1*8];
-		workspace1[1]  = out[0] - out[1*8];
-
-		workspace1[2]  = out[2*8] + out[3*8];
-		workspace1[3]  = out[2*8] - out[3*8];
-
-		workspace1[4]  = out[4*8] + out[5*8];
-		workspace1[5]  = out[4*8] - out[5*8];
-
-		workspace1[6]  = out[6*8] + out[7*8];
-		workspace1[7]  = out[6*8] - out[7*8];
-
-		/* stage 2 */
-		workspace2[0] = workspace1[0] + workspace1[2];
-		workspace2[1] = workspace1[0] - workspace1[2];
-		workspace2[2] = workspace1[1] - workspace1[3];
-		workspace2[3] = workspace1[1] + workspace1[3];
-
-		workspace2[4] = workspace1[4] + workspace1[6];
-		workspace2[5] = workspace1[4] - workspace1[6];
-		workspace2[6] = workspace1[5] - workspace1[7];
-		workspace2[7] = workspace1[5] + workspace1[7];
-
-		/* stage 3 */
-		out[0*8] = workspace2[0] + workspace2[4];
-		out[1*8] = workspace2[0] - workspace2[4];
-		out[2*8] = workspace2[1] - workspace2[5];
-		out[3*8] = workspace2[1] + workspace2[5];
-		out[4*8] = workspace2[2] + workspace2[6];
-		out[5*8] = workspace2[2] - workspace2[6];
-		out[6*8] = workspace2[3] - workspace2[7];
-		out[7*8] = workspace2[3] + workspace2[7];
-	}
+	fwht_col_pass(output_block, FWHT_COL_PLAIN);
 }
 
 static noinline_for_stack void
@@ -512,66 +799,7 @@ ifwht(const s16 *block, s16 *output_block, int intra)
 		out[7] = workspace2[3] + workspace2[7];
 	}
 
-	out = output_block;
-
-	for (i = 0; i < 8; i++, out++) {
-		/* stage 1 */
-		workspace1[0]  = out[0] + out[1 * 8];
-		workspace1[1]  = out[0] - out[1 * 8];
-
-		workspace1[2]  = out[2 * 8] + out[3 * 8];
-		workspace1[3]  = out[2 * 8] - out[3 * 8];
-
-		workspace1[4]  = out[4 * 8] + out[5 * 8];
-		workspace1[5]  = out[4 * 8] - out[5 * 8];
-
-		workspace1[6]  = out[6 * 8] + out[7 * 8];
-		workspace1[7]  = out[6 * 8] - out[7 * 8];
-
-		/* stage 2 */
-		workspace2[0] = workspace1[0] + workspace1[2];
-		workspace2[1] = workspace1[0] - workspace1[2];
-		workspace2[2] = workspace1[1] - workspace1[3];
-		workspace2[3] = workspace1[1] + workspace1[3];
-
-		workspace2[4] = workspace1[4] + workspace1[6];
-		workspace2[5] = workspace1[4] - workspace1[6];
-		workspace2[6] = workspace1[5] - workspace1[7];
-		workspace2[7] = workspace1[5] + workspace1[7];
-
-		/* stage 3 */
-		if (inter) {
-			int d;
-
-			out[0 * 8] = workspace2[0] + workspace2[4];
-			out[1 * 8] = workspace2[0] - workspace2[4];
-			out[2 * 8] = workspace2[1] - workspace2[5];
-			out[3 * 8] = workspace2[1] + workspace2[5];
-			out[4 * 8] = workspace2[2] + workspace2[6];
-			out[5 * 8] = workspace2[2] - workspace2[6];
-			out[6 * 8] = workspace2[3] - workspace2[7];
-			out[7 * 8] = workspace2[3] + workspace2[7];
-
-			for (d = 0; d < 8; d++)
-				out[8 * d] >>= 6;
-		} else {
-			int d;
-
-			out[0 * 8] = workspace2[0] + workspace2[4];
-			out[1 * 8] = workspace2[0] - workspace2[4];
-			out[2 * 8] = workspace2[1] - workspace2[5];
-			out[3 * 8] = workspace2[1] + workspace2[5];
-			out[4 * 8] = workspace2[2] + workspace2[6];
-			out[5 * 8] = workspace2[2] - workspace2[6];
-			out[6 * 8] = workspace2[3] - workspace2[7];
-			out[7 * 8] = workspace2[3] + workspace2[7];
-
-			for (d = 0; d < 8; d++) {
-				out[8 * d] >>= 6;
-				out[8 * d] += 128;
-			}
-		}
-	}
+	fwht_col_pass(output_block, inter ? FWHT_COL_INTER : FWHT_COL_INTRA);
 }
 
 static void fill_encoder_block(const u8 *input, s16 *dst,
@@ -612,6 +840,162 @@ static int var_inter(const s16 *old, const s16 *new)
 	return ret;
 }
 
+#ifdef FWHT_BENCH_TIMING
+/*
+ * Per-stage timing for bench-fwht: the transform, quantizer and
+ * run-length coder entry points are wrapped so the encode/decode loops
+ * themselves stay untouched. The clock_gettime() per block costs a few
+ * percent, so the benchmark only sets fwht_bench_enable for its stage
+ * breakdown pass, not when measuring throughput.
+ */
+#include <time.h>
+
+int fwht_bench_enable;
+u64 fwht_bench_ns[FWHT_BENCH_NSTAGES];
+
+static inline u64 fwht_bench_now(void)
+{
+	struct timespec ts;
+
+	if (!fwht_bench_enable)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline void fwht_bench_add(enum fwht_bench_stage stage, u64 since)
+{
+	if (fwht_bench_enable)
+		fwht_bench_ns[stage] += fwht_bench_now() - since;
+}
+
+static void bench_fwht(const u8 *block, s16 *output_block, unsigned int stride,
+		       unsigned int input_step, bool intra)
+{
+	u64 t0 = fwht_bench_now();
+
+	fwht(block, output_block, stride, input_step, intra);
+	fwht_bench_add(FWHT_BENCH_TRANSFORM, t0);
+}
+
+static void bench_fwht16(const s16 *block, s16 *output_block, int stride,
+			 int intra)
+{
+	u64 t0 = fwht_bench_now();
+
+	fwht16(block, output_block, stride, intra);
+	fwht_bench_add(FWHT_BENCH_TRANSFORM, t0);
+}
+
+static void bench_ifwht(const s16 *block, s16 *output_block, int intra)
+{
+	u64 t0 = fwht_bench_now();
+
+	ifwht(block, output_block, intra);
+	fwht_bench_add(FWHT_BENCH_TRANSFORM, t0);
+}
+
+static void bench_quantize_intra(s16 *coeff, s16 *de_coeff, u16 qp)
+{
+	u64 t0 = fwht_bench_now();
+
+	quantize_intra(coeff, de_coeff, qp);
+	fwht_bench_add(FWHT_BENCH_QUANTIZE, t0);
+}
+
+static void bench_quantize_inter(s16 *coeff, s16 *de_coeff, u16 qp)
+{
+	u64 t0 = fwht_bench_now();
+
+	quantize_inter(coeff, de_coeff, qp);
+	fwht_bench_add(FWHT_BENCH_QUANTIZE, t0);
+}
+
+static void bench_dequantize_intra(s16 *coeff)
+{
+	u64 t0 = fwht_bench_now();
+
+	dequantize_intra(coeff);
+	fwht_bench_add(FWHT_BENCH_QUANTIZE, t0);
+}
+
+static void bench_dequantize_inter(s16 *coeff)
+{
+	u64 t0 = fwht_bench_now();
+
+	dequantize_inter(coeff);
+	fwht_bench_add(FWHT_BENCH_QUANTIZE, t0);
+}
+
+static int bench_rlc(const s16 *in, __be16 *output, int blocktype)
+{
+	u64 t0 = fwht_bench_now();
+	int ret = rlc(in, output, blocktype);
+
+	fwht_bench_add(FWHT_BENCH_RLC, t0);
+	return ret;
+}
+
+static u16 bench_derlc(const __be16 **rlc_in, s16 *dwht_out,
+		       const __be16 *end_of_input)
+{
+	u64 t0 = fwht_bench_now();
+	u16 ret = derlc(rlc_in, dwht_out, end_of_input);
+
+	fwht_bench_add(FWHT_BENCH_RLC, t0);
+	return ret;
+}
+
+#define fwht		bench_fwht
+#define fwht16		bench_fwht16
+#define ifwht		bench_ifwht
+#define quantize_intra	bench_quantize_intra
+#define quantize_inter	bench_quantize_inter
+#define dequantize_intra bench_dequantize_intra
+#define dequantize_inter bench_dequantize_inter
+#define rlc		bench_rlc
+#define derlc		bench_derlc
+#endif /* FWHT_BENCH_TIMING */
+
+/*
+ * Change-detection prepass: decide whether a block is guaranteed to
+ * quantize to an all-zero P block before transforming it. The inter
+ * transform has no rescaling stage, so every coefficient is bounded by
+ * the sum of the absolute deltas, and the smallest shift in
+ * quant_table_p is 3: once that sum is at most 8 * p_frame_qp the dead
+ * zone swallows all 64 coefficients. Rows of unchanged pixels are
+ * recognized with a single 64-bit compare against the densely packed
+ * reference block and the sum is checked per row, so a static block
+ * costs eight word compares instead of the transform chain.
+ */
+static int block_unchanged(const u8 *cur, const u8 *ref,
+			   unsigned int stride, unsigned int input_step,
+			   u16 p_frame_qp)
+{
+	unsigned int thresh = 8 * p_frame_qp;
+	unsigned int sum = 0;
+	unsigned int k, l;
+
+	for (k = 0; k < 8; k++, cur += stride, ref += 8) {
+		if (input_step == 1) {
+			u64 a, b;
+
+			memcpy(&a, cur, sizeof(a));
+			memcpy(&b, ref, sizeof(b));
+			if (a == b)
+				continue;
+		}
+		for (l = 0; l < 8; l++) {
+			int d = cur[l * input_step] - ref[l];
+
+			sum += d < 0 ? -d : d;
+		}
+		if (sum > thresh)
+			return 0;
+	}
+	return 1;
+}
+
 static noinline_for_stack int
 decide_blocktype(const u8 *cur, const u8 *reference, s16 *deltablock,
 		 unsigned int stride, unsigned int input_step)
@@ -700,14 +1084,33 @@ static u32 encode_plane(u8 *input, u8 *refp, __be16 **rlco, __be16 *rlco_max,
 	for (j = 0; j < height / 8; j++) {
 		input = input_start + j * 8 * stride;
 		for (i = 0; i < width / 8; i++) {
+			static const s16 zero_coeffs[8 * 8];
 			/* intra code, first frame is always intra coded. */
 			int blocktype = IBLOCK;
+			bool unchanged = false;
 			unsigned int size;
 
-			if (!is_intra)
-				blocktype = decide_blocktype(input, refp,
-					deltablock, stride, input_step);
-			if (blocktype == IBLOCK) {
+			if (!is_intra) {
+				unchanged = block_unchanged(input, refp,
+							    stride, input_step,
+							    cf->p_frame_qp);
+				if (!unchanged)
+					blocktype = decide_blocktype(input, refp,
+						deltablock, stride, input_step);
+			}
+			if (unchanged) {
+				/*
+				 * The delta is guaranteed to quantize to all
+				 * zeroes, which also means the reference
+				 * update would write back the very same
+				 * pixels, so skip the transforms and emit the
+				 * all-zero P block directly. The encode cost
+				 * of a static region is then just the compare
+				 * pass.
+				 */
+				blocktype = PBLOCK;
+				encoding |= FWHT_FRAME_PCODED;
+			} else if (blocktype == IBLOCK) {
 				fwht(input, cf->coeffs, stride, input_step, 1);
 				quantize_intra(cf->coeffs, cf->de_coeffs,
 					       cf->i_frame_qp);
@@ -718,7 +1121,7 @@ static u32 encode_plane(u8 *input, u8 *refp, __be16 **rlco, __be16 *rlco_max,
 				quantize_inter(cf->coeffs, cf->de_coeffs,
 					       cf->p_frame_qp);
 			}
-			if (!next_is_intra) {
+			if (!unchanged && !next_is_intra) {
 				ifwht(cf->de_coeffs, cf->de_fwht, blocktype);
 
 				if (blocktype == PBLOCK)
@@ -729,7 +1132,8 @@ static u32 encode_plane(u8 *input, u8 *refp, __be16 **rlco, __be16 *rlco_max,
 			input += 8 * input_step;
 			refp += 8 * 8;
 
-			size = rlc(cf->coeffs, *rlco, blocktype);
+			size = rlc(unchanged ? zero_coeffs : cf->coeffs,
+				   *rlco, blocktype);
 			if (last_size == size &&
 			    !memcmp(*rlco + 1, *rlco - size + 1, 2 * size - 2)) {
 				__be16 *last_rlco = *rlco - size;
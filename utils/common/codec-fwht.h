@@ -123,6 +123,24 @@ struct fwht_raw_frame {
 #define FWHT_CR_UNENCODED	BIT(4)
 #define FWHT_ALPHA_UNENCODED	BIT(5)
 
+#ifdef FWHT_BENCH_TIMING
+/*
+ * Per-stage timing hooks for bench-fwht. When enabled, the transform,
+ * quantizer and run-length coder calls accumulate wall-clock time into
+ * fwht_bench_ns[]. Only compiled into the benchmark, the tools build
+ * the codec without this.
+ */
+enum fwht_bench_stage {
+	FWHT_BENCH_TRANSFORM,
+	FWHT_BENCH_QUANTIZE,
+	FWHT_BENCH_RLC,
+	FWHT_BENCH_NSTAGES
+};
+
+extern int fwht_bench_enable;
+extern u64 fwht_bench_ns[FWHT_BENCH_NSTAGES];
+#endif
+
 u32 fwht_encode_frame(struct fwht_raw_frame *frm,
 		      struct fwht_raw_frame *ref_frm,
 		      struct fwht_cframe *cf,
@@ -8,6 +8,8 @@
 #include <linux/errno.h>
 #include <linux/string.h>
 #include <linux/videodev2.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include "codec-v4l2-fwht.h"
 
 static const struct v4l2_fwht_pixfmt_info v4l2_fwht_pixfmts[] = {
@@ -279,6 +281,221 @@ int v4l2_fwht_encode(struct v4l2_fwht_state *state, u8 *p_in, u8 *p_out)
 	return cf.size + sizeof(*p_hdr);
 }
 
+/*
+ * Userspace-only extension: encode each component of a frame on its own
+ * thread. The RLC output of a component depends only on that component's
+ * data, and the overflow budget in fwht_encode_frame() is relative to the
+ * write position at the start of the component. So encoding every
+ * component through a single-component raw frame into a private buffer
+ * and concatenating the results in component order produces a bitstream
+ * that is bit-identical to v4l2_fwht_encode().
+ */
+struct v4l2_fwht_comp_job {
+	struct fwht_raw_frame rf;
+	struct fwht_raw_frame ref;
+	struct fwht_cframe cf;
+	unsigned int width;
+	unsigned int height;
+	unsigned int stride;
+	bool is_intra;
+	bool next_is_intra;
+	u32 unencoded_flag;
+	u32 encoding;
+};
+
+struct v4l2_fwht_comp_work {
+	struct v4l2_fwht_comp_job *jobs;
+	unsigned int njobs;
+};
+
+static void *v4l2_fwht_encode_comp(void *arg)
+{
+	const struct v4l2_fwht_comp_work *work = arg;
+	unsigned int i;
+
+	for (i = 0; i < work->njobs; i++) {
+		struct v4l2_fwht_comp_job *job = &work->jobs[i];
+
+		job->encoding = fwht_encode_frame(&job->rf, &job->ref,
+						  &job->cf,
+						  job->is_intra,
+						  job->next_is_intra,
+						  job->width, job->height,
+						  job->stride, job->stride);
+	}
+	return NULL;
+}
+
+int v4l2_fwht_encode_parallel(struct v4l2_fwht_state *state, u8 *p_in, u8 *p_out)
+{
+	unsigned int size = state->stride * state->coded_height;
+	unsigned int chroma_stride = state->stride;
+	const struct v4l2_fwht_pixfmt_info *info = state->info;
+	unsigned int luma_size;
+	struct v4l2_fwht_comp_job jobs[4];
+	struct v4l2_fwht_comp_work works[4];
+	unsigned int nworks;
+	pthread_t threads[4];
+	bool started[4] = { false, false, false, false };
+	struct fwht_cframe_hdr *p_hdr;
+	struct fwht_raw_frame rf;
+	unsigned int comps, i;
+	u32 total_size = 0;
+	u32 encoding = 0;
+	u32 flags = 0;
+	u8 *scratch, *buf, *out;
+
+	if (!info)
+		return -EINVAL;
+
+	/* Only three- and four-component formats have work to spread out */
+	if (info->components_num < 3)
+		return v4l2_fwht_encode(state, p_in, p_out);
+
+	if (prepare_raw_frame(&rf, info, p_in, size))
+		return -EINVAL;
+
+	if (info->planes_num == 3)
+		chroma_stride /= 2;
+
+	if (info->id == V4L2_PIX_FMT_NV24 ||
+	    info->id == V4L2_PIX_FMT_NV42)
+		chroma_stride *= 2;
+
+	comps = info->components_num;
+	/*
+	 * A component can end up as a raw dump of the plane with its
+	 * dimensions rounded up to multiples of 8, so each scratch buffer
+	 * needs room for the rounded-up plane plus the RLC overshoot of the
+	 * block that trips the overflow check.
+	 */
+	luma_size = ((state->visible_width + 7) & ~7U) *
+		    ((state->visible_height + 7) & ~7U);
+	scratch = malloc((size_t)comps * (luma_size + 1024));
+	if (!scratch)
+		return v4l2_fwht_encode(state, p_in, p_out);
+
+	buf = scratch;
+	for (i = 0; i < comps; i++) {
+		struct v4l2_fwht_comp_job *job = &jobs[i];
+
+		memset(job, 0, sizeof(*job));
+		job->rf.components_num = 1;
+		job->rf.width_div = 1;
+		job->rf.height_div = 1;
+		job->rf.luma_alpha_step = info->luma_alpha_step;
+		job->width = state->visible_width;
+		job->height = state->visible_height;
+		job->stride = state->stride;
+		job->is_intra = !state->gop_cnt;
+		job->next_is_intra = state->gop_cnt == state->gop_size - 1;
+		job->cf.i_frame_qp = state->i_frame_qp;
+		job->cf.p_frame_qp = state->p_frame_qp;
+		job->cf.rlc_data = (__be16 *)buf;
+		buf += luma_size + 1024;
+	}
+	jobs[0].rf.luma = rf.luma;
+	jobs[0].ref.luma = state->ref_frame.luma;
+	jobs[0].unencoded_flag = FWHT_LUMA_UNENCODED;
+	for (i = 1; i < 3; i++) {
+		jobs[i].rf.luma_alpha_step = info->chroma_step;
+		jobs[i].width = state->visible_width / rf.width_div;
+		jobs[i].height = state->visible_height / rf.height_div;
+		jobs[i].stride = chroma_stride;
+	}
+	jobs[1].rf.luma = rf.cb;
+	jobs[1].ref.luma = state->ref_frame.cb;
+	jobs[1].unencoded_flag = FWHT_CB_UNENCODED;
+	jobs[2].rf.luma = rf.cr;
+	jobs[2].ref.luma = state->ref_frame.cr;
+	jobs[2].unencoded_flag = FWHT_CR_UNENCODED;
+	if (comps == 4) {
+		jobs[3].rf.luma = rf.alpha;
+		jobs[3].ref.luma = state->ref_frame.alpha;
+		jobs[3].unencoded_flag = FWHT_ALPHA_UNENCODED;
+	}
+
+	/*
+	 * encode_plane() rounds the plane dimensions up to multiples of 8,
+	 * so the reference update of a chroma plane can spill into the next
+	 * plane's reference area. Sequential encoding overwrites the spill
+	 * in plane order; when it can happen, keep the chroma (and alpha)
+	 * planes in order on a single worker instead of racing them. The
+	 * luma reference area never spills since the coded dimensions are
+	 * already multiples of 8.
+	 */
+	if ((jobs[1].width | jobs[1].height) & 7) {
+		works[0].jobs = &jobs[0];
+		works[0].njobs = 1;
+		works[1].jobs = &jobs[1];
+		works[1].njobs = comps - 1;
+		nworks = 2;
+	} else {
+		for (i = 0; i < comps; i++) {
+			works[i].jobs = &jobs[i];
+			works[i].njobs = 1;
+		}
+		nworks = comps;
+	}
+
+	for (i = 1; i < nworks; i++) {
+		started[i] = !pthread_create(&threads[i], NULL,
+					     v4l2_fwht_encode_comp, &works[i]);
+		if (!started[i])
+			v4l2_fwht_encode_comp(&works[i]);
+	}
+	v4l2_fwht_encode_comp(&works[0]);
+	for (i = 1; i < nworks; i++)
+		if (started[i])
+			pthread_join(threads[i], NULL);
+
+	p_hdr = (struct fwht_cframe_hdr *)p_out;
+	out = p_out + sizeof(*p_hdr);
+	for (i = 0; i < comps; i++) {
+		if (jobs[i].encoding & FWHT_LUMA_UNENCODED)
+			encoding |= jobs[i].unencoded_flag;
+		encoding |= jobs[i].encoding & FWHT_FRAME_PCODED;
+		memcpy(out, jobs[i].cf.rlc_data, jobs[i].cf.size);
+		out += jobs[i].cf.size;
+		total_size += jobs[i].cf.size;
+	}
+	free(scratch);
+
+	if (!(encoding & FWHT_FRAME_PCODED))
+		state->gop_cnt = 0;
+	if (++state->gop_cnt >= state->gop_size)
+		state->gop_cnt = 0;
+
+	p_hdr->magic1 = FWHT_MAGIC1;
+	p_hdr->magic2 = FWHT_MAGIC2;
+	p_hdr->version = htonl(V4L2_FWHT_VERSION);
+	p_hdr->width = htonl(state->visible_width);
+	p_hdr->height = htonl(state->visible_height);
+	flags |= (info->components_num - 1) << V4L2_FWHT_FL_COMPONENTS_NUM_OFFSET;
+	flags |= info->pixenc;
+	if (encoding & FWHT_LUMA_UNENCODED)
+		flags |= V4L2_FWHT_FL_LUMA_IS_UNCOMPRESSED;
+	if (encoding & FWHT_CB_UNENCODED)
+		flags |= V4L2_FWHT_FL_CB_IS_UNCOMPRESSED;
+	if (encoding & FWHT_CR_UNENCODED)
+		flags |= V4L2_FWHT_FL_CR_IS_UNCOMPRESSED;
+	if (encoding & FWHT_ALPHA_UNENCODED)
+		flags |= V4L2_FWHT_FL_ALPHA_IS_UNCOMPRESSED;
+	if (!(encoding & FWHT_FRAME_PCODED))
+		flags |= V4L2_FWHT_FL_I_FRAME;
+	if (rf.height_div == 1)
+		flags |= V4L2_FWHT_FL_CHROMA_FULL_HEIGHT;
+	if (rf.width_div == 1)
+		flags |= V4L2_FWHT_FL_CHROMA_FULL_WIDTH;
+	p_hdr->flags = htonl(flags);
+	p_hdr->colorspace = htonl(state->colorspace);
+	p_hdr->xfer_func = htonl(state->xfer_func);
+	p_hdr->ycbcr_enc = htonl(state->ycbcr_enc);
+	p_hdr->quantization = htonl(state->quantization);
+	p_hdr->size = htonl(total_size);
+	return total_size + sizeof(*p_hdr);
+}
+
 int v4l2_fwht_decode(struct v4l2_fwht_state *state, u8 *p_in, u8 *p_out)
 {
 	u32 flags;
@@ -0,0 +1,120 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * CRC32C (Castagnoli) helper
+ *
+ * Copyright 2026 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ */
+
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <linux/types.h>
+#include <string.h>
+
+/*
+ * Single-pass CRC32C over a buffer, using the SSE4.2/ARMv8 CRC
+ * instructions when the machine has them, with a table-driven fallback.
+ * The crc argument and the result are the raw (uninverted) state, so
+ * calls can be chained; start with ~0 and invert the final result to
+ * get the usual CRC32C value.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+
+static __attribute__((target("sse4.2"), unused)) __u32
+crc32c_hw(__u32 crc, const __u8 *buf, unsigned size)
+{
+#ifdef __x86_64__
+	while (size >= 8) {
+		__u64 v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc = _mm_crc32_u64(crc, v);
+		buf += 8;
+		size -= 8;
+	}
+#endif
+	while (size >= 4) {
+		__u32 v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc = _mm_crc32_u32(crc, v);
+		buf += 4;
+		size -= 4;
+	}
+	while (size--)
+		crc = _mm_crc32_u8(crc, *buf++);
+	return crc;
+}
+
+#define CRC32C_HW_RUNTIME 1
+
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+
+static __attribute__((unused)) __u32
+crc32c_hw(__u32 crc, const __u8 *buf, unsigned size)
+{
+	while (size >= 8) {
+		__u64 v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc = __crc32cd(crc, v);
+		buf += 8;
+		size -= 8;
+	}
+	while (size >= 4) {
+		__u32 v;
+
+		memcpy(&v, buf, sizeof(v));
+		crc = __crc32cw(crc, v);
+		buf += 4;
+		size -= 4;
+	}
+	while (size--)
+		crc = __crc32cb(crc, *buf++);
+	return crc;
+}
+
+#define CRC32C_HW 1
+#endif
+
+#ifndef CRC32C_HW
+static __attribute__((unused)) __u32
+crc32c_sw(__u32 crc, const __u8 *buf, unsigned size)
+{
+	static __u32 table[256];
+	unsigned i, j;
+
+	/* racing initializations compute the same values, so both are fine */
+	if (!table[1]) {
+		for (i = 0; i < 256; i++) {
+			__u32 c = i;
+
+			for (j = 0; j < 8; j++)
+				c = (c >> 1) ^ ((c & 1) ? 0x82f63b78 : 0);
+			table[i] = c;
+		}
+	}
+	while (size--)
+		crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+#endif
+
+static __attribute__((unused)) __u32
+crc32c(__u32 crc, const __u8 *buf, unsigned size)
+{
+#if defined(CRC32C_HW_RUNTIME)
+	if (__builtin_cpu_supports("sse4.2"))
+		return crc32c_hw(crc, buf, size);
+	return crc32c_sw(crc, buf, size);
+#elif defined(CRC32C_HW)
+	return crc32c_hw(crc, buf, size);
+#else
+	return crc32c_sw(crc, buf, size);
+#endif
+}
+
+#endif
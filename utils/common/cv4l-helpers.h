@@ -10,6 +10,7 @@
 #define _CV4L_HELPERS_H_
 
 #include <limits.h>
+#include <sys/epoll.h>
 #include <v4l-helpers.h>
 
 #define cv4l_ioctl(cmd, arg) v4l_named_ioctl(g_v4l_fd(), #cmd, cmd, arg)
@@ -815,6 +816,8 @@ public:
 		v4l_queue_buffer_update(this, &buf, index);
 	}
 	int queue_all(cv4l_fd *fd);
+	int dqbuf_ready(cv4l_fd *fd, cv4l_buffer *bufs, unsigned max, unsigned &ready);
+	int qbuf_all(cv4l_fd *fd, cv4l_buffer *bufs, unsigned count);
 };
 
 class cv4l_buffer : public v4l_buffer {
@@ -831,11 +834,10 @@ public:
 	{
 		init(b);
 	}
-	cv4l_buffer operator= (const cv4l_buffer &b)
+	cv4l_buffer &operator= (const cv4l_buffer &b)
 	{
-		v4l_buffer *dst = this;
-		const v4l_buffer *src = &b;
-		memcpy(dst, src, sizeof(*src));
+		if (this != &b)
+			init(b);
 		return *this;
 	}
 	virtual ~cv4l_buffer() {}
@@ -850,9 +852,22 @@ public:
 	}
 	void init(const cv4l_buffer &b)
 	{
-		memcpy((v4l2_buffer *)this, (v4l2_buffer *)&b, sizeof(b));
-		if (v4l_type_is_planar(g_type()))
+		/*
+		 * Only copy the planes that are actually in use: copying the
+		 * full VIDEO_MAX_PLANES array for every frame adds up in
+		 * high-rate loops. For planar buffers the m.planes pointer
+		 * must be repointed at our own array or it would keep
+		 * referencing the copied-from buffer.
+		 */
+		buf = b.buf;
+		if (v4l_type_is_planar(g_type())) {
+			unsigned num = g_num_planes();
+
+			if (num > VIDEO_MAX_PLANES)
+				num = VIDEO_MAX_PLANES;
+			memcpy(planes, b.planes, num * sizeof(planes[0]));
 			buf.m.planes = planes;
+		}
 	}
 	void update(const cv4l_queue &q, unsigned index = 0)
 	{
@@ -911,4 +926,107 @@ inline int cv4l_queue::queue_all(cv4l_fd *fd)
 	return 0;
 }
 
+/*
+ * Dequeue every buffer that is ready right now into the caller-provided
+ * descriptors (at most max), without blocking: the fd must be in
+ * non-blocking mode. On success <ready> holds the number of dequeued
+ * buffers and 0 is returned; EAGAIN just terminates the drain and is
+ * not treated as an error.
+ */
+inline int cv4l_queue::dqbuf_ready(cv4l_fd *fd, cv4l_buffer *bufs,
+				   unsigned max, unsigned &ready)
+{
+	ready = 0;
+	while (ready < max) {
+		bufs[ready].init(*this);
+		int ret = fd->dqbuf(bufs[ready]);
+
+		if (ret == EAGAIN)
+			break;
+		if (ret)
+			return ret;
+		ready++;
+	}
+	return 0;
+}
+
+/*
+ * Queue the given descriptors back, typically after a dqbuf_ready()
+ * drain. Stops at the first failure.
+ */
+inline int cv4l_queue::qbuf_all(cv4l_fd *fd, cv4l_buffer *bufs, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++) {
+		int ret = fd->qbuf(bufs[i]);
+
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+/*
+ * Thin wrapper around an epoll instance so streaming loops can sleep in
+ * a single syscall for buffer readiness (EPOLLIN/EPOLLOUT) and
+ * exception events (EPOLLPRI) on any number of video fds, instead of
+ * rebuilding select() sets every frame.
+ */
+class cv4l_epoll {
+public:
+	cv4l_epoll() : m_epollfd(-1) {}
+	~cv4l_epoll()
+	{
+		if (m_epollfd >= 0)
+			::close(m_epollfd);
+	}
+
+	bool is_open() const { return m_epollfd >= 0; }
+	int open()
+	{
+		m_epollfd = epoll_create1(EPOLL_CLOEXEC);
+		return m_epollfd < 0 ? errno : 0;
+	}
+	void close()
+	{
+		if (m_epollfd >= 0)
+			::close(m_epollfd);
+		m_epollfd = -1;
+	}
+	int add(cv4l_fd *fd, __u32 events)
+	{
+		return ctl(EPOLL_CTL_ADD, fd->g_fd(), events);
+	}
+	int modify(cv4l_fd *fd, __u32 events)
+	{
+		return ctl(EPOLL_CTL_MOD, fd->g_fd(), events);
+	}
+	int del(cv4l_fd *fd)
+	{
+		return ctl(EPOLL_CTL_DEL, fd->g_fd(), 0);
+	}
+
+	/*
+	 * Wait for at most timeout_ms (-1 waits forever). Returns the
+	 * number of ready fds (0 on timeout) or -errno.
+	 */
+	int wait(epoll_event *events, unsigned max_events, int timeout_ms)
+	{
+		int ret = epoll_wait(m_epollfd, events, max_events, timeout_ms);
+
+		return ret < 0 ? -errno : ret;
+	}
+
+private:
+	int ctl(int op, int fd, __u32 events)
+	{
+		epoll_event ev = {};
+
+		ev.events = events;
+		ev.data.fd = fd;
+		return epoll_ctl(m_epollfd, op, fd, &ev) ? errno : 0;
+	}
+
+	int m_epollfd;
+};
+
 #endif
@@ -9,6 +9,10 @@
 #include <string.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <argp.h>
 
@@ -456,6 +460,200 @@ static error_t parse_toml_protocol(const char *fname, struct toml_table_t *proot
 	return 0;
 }
 
+/*
+ * Streaming fast path for the regular keymap schema.
+ *
+ * Nearly all keymaps are the highly regular output of gen_keytables.pl:
+ * a [[protocols]] table with simple key = value lines and a
+ * [protocols.scancodes] section. For those the full toml parser (which
+ * builds a heap DOM per key that keymap.c immediately flattens again)
+ * is overkill. This scanner goes over the file once, line by line, and
+ * emits the keymap structures directly with no intermediate
+ * allocations. Anything it does not recognize - raw entries, arrays,
+ * multi-line values, escapes - makes it bail out so the caller can fall
+ * back to the full toml parser, which also produces the proper error
+ * messages for genuinely malformed files.
+ */
+static char *fast_trim(char *p)
+{
+	char *end;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+	end = p + strlen(p);
+	while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		*--end = 0;
+	return p;
+}
+
+// Unquote a simple "string" value in place, NULL if it is not one
+static char *fast_string(char *value)
+{
+	size_t len = strlen(value);
+
+	if (len < 2 || value[0] != '"' || value[len - 1] != '"')
+		return NULL;
+	value[len - 1] = 0;
+	value++;
+	if (strchr(value, '"') || strchr(value, '\\'))
+		return NULL;
+	return value;
+}
+
+static error_t parse_toml_keymap_fast(const char *fname, struct keymap **keymap, bool verbose)
+{
+	enum { SEC_NONE, SEC_PROTOCOL, SEC_SCANCODES } section = SEC_NONE;
+	struct scancode_entry **snext = NULL;
+	struct keymap *map = NULL, *cur = NULL;
+	char *buf, *line, *next;
+	long size;
+	FILE *fin;
+
+	fin = fopen(fname, "r");
+	if (!fin)
+		return EINVAL;
+	if (fseek(fin, 0, SEEK_END) || (size = ftell(fin)) < 0) {
+		fclose(fin);
+		return EINVAL;
+	}
+	rewind(fin);
+	buf = malloc(size + 1);
+	if (!buf || fread(buf, 1, size, fin) != (size_t)size) {
+		free(buf);
+		fclose(fin);
+		return EINVAL;
+	}
+	fclose(fin);
+	buf[size] = 0;
+	if (memchr(buf, 0, size))
+		goto bail;
+
+	for (line = buf; line; line = next) {
+		char *p, *eq, *key, *value;
+
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = 0;
+		p = fast_trim(line);
+		if (!*p || *p == '#')
+			continue;
+
+		if (!strcmp(p, "[[protocols]]")) {
+			cur = calloc(1, sizeof(*cur));
+			if (!cur)
+				goto bail;
+			// Same list order as parse_toml_keymap()
+			if (!map) {
+				map = cur;
+			} else {
+				cur->next = map->next;
+				map->next = cur;
+			}
+			snext = &cur->scancode;
+			section = SEC_PROTOCOL;
+			continue;
+		}
+		if (!strcmp(p, "[protocols.scancodes]")) {
+			if (!cur)
+				goto bail;
+			section = SEC_SCANCODES;
+			continue;
+		}
+		if (*p == '[')
+			goto bail;
+
+		eq = strchr(p, '=');
+		if (!eq || section == SEC_NONE)
+			goto bail;
+		*eq = 0;
+		key = fast_trim(p);
+		value = fast_trim(eq + 1);
+		if (!*key || !*value)
+			goto bail;
+
+		if (section == SEC_SCANCODES) {
+			struct scancode_entry *se;
+			char *keycode, *e;
+			uint64_t scancode;
+
+			if (key[0] == '"') {
+				key = fast_string(key);
+				if (!key)
+					goto bail;
+			}
+			scancode = strtoull(key, &e, 0);
+			if (*e)
+				goto bail;
+			keycode = fast_string(value);
+			if (!keycode)
+				goto bail;
+			se = calloc(1, sizeof(*se));
+			if (!se)
+				goto bail;
+			se->scancode = scancode;
+			se->keycode = strdup(keycode);
+			*snext = se;
+			snext = &se->next;
+			continue;
+		}
+
+		if (value[0] == '[')
+			goto bail;
+		if (value[0] == '"') {
+			value = fast_string(value);
+			if (!value)
+				goto bail;
+			if (!strcmp(key, "protocol")) {
+				// Raw keymaps need the full parser
+				if (!strcmp(value, "raw"))
+					goto bail;
+				cur->protocol = strdup(value);
+			} else if (!strcmp(key, "variant")) {
+				cur->variant = strdup(value);
+			} else if (!strcmp(key, "name")) {
+				cur->name = strdup(value);
+			}
+			// Other string values are ignored, as in the full parser
+		} else {
+			struct protocol_param *param;
+			long int v;
+			char *e;
+
+			v = strtol(value, &e, 0);
+			if (*e)
+				// Not an integer: ignored, as in the full parser
+				continue;
+			param = malloc(sizeof(*param));
+			if (!param)
+				goto bail;
+			param->name = strdup(key);
+			param->value = v;
+			param->next = cur->param;
+			cur->param = param;
+			if (verbose)
+				fprintf(stderr, _("%s: protocol parameter %s=%ld\n"),
+					fname, param->name, param->value);
+		}
+	}
+
+	if (!map)
+		goto bail;
+	for (cur = map; cur; cur = cur->next)
+		if (!cur->protocol)
+			goto bail;
+
+	free(buf);
+	if (verbose)
+		fprintf(stderr, _("Parsed %s keycode file with the fast path\n"), fname);
+	*keymap = map;
+	return 0;
+
+bail:
+	free_keymap(map);
+	free(buf);
+	return EINVAL;
+}
+
 static error_t parse_toml_keymap(char *fname, struct keymap **keymap, bool verbose)
 {
 	struct toml_table_t *root, *proot;
@@ -464,6 +662,9 @@ static error_t parse_toml_keymap(char *fname, struct keymap **keymap, bool verbo
 	char buf[200];
 	FILE *fin;
 
+	if (!parse_toml_keymap_fast(fname, keymap, verbose))
+		return 0;
+
 	if (verbose)
 		fprintf(stderr, _("Parsing %s keycode file as toml\n"), fname);
 
@@ -521,14 +722,344 @@ out:
 	return EINVAL;
 }
 
+/*
+ * Compiled keymap cache.
+ *
+ * Parsing the toml keymaps is by far the most expensive part of loading
+ * a keymap. After a successful parse the result is stored in a compact
+ * binary file in KEYMAP_CACHE_DIR, keyed on the keymap path and
+ * invalidated by the size and mtime of the source file, so repeat loads
+ * (e.g. ir-keytable -a at boot) skip the parser entirely. The cache is
+ * strictly best-effort: any failure to read or write it falls back to
+ * parsing the keymap as before.
+ */
+#define KEYMAP_CACHE_DIR "/var/cache/ir-keytable"
+#define KEYMAP_CACHE_MAGIC 0x50594b52
+#define KEYMAP_CACHE_VERSION 1
+
+struct keymap_cache_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t src_size;
+	int64_t src_mtime_sec;
+	uint32_t src_mtime_nsec;
+	uint32_t num_maps;
+};
+
+static void keymap_cache_path(const char *fname, char *path, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const char *p;
+
+	for (p = fname; *p; p++) {
+		hash ^= (uint8_t)*p;
+		hash *= 0x100000001b3ULL;
+	}
+	snprintf(path, size, KEYMAP_CACHE_DIR "/%016llx.keymap",
+		 (unsigned long long)hash);
+}
+
+static void cache_put(FILE *f, const void *data, size_t size)
+{
+	fwrite(data, 1, size, f);
+}
+
+static void cache_put_u32(FILE *f, uint32_t v)
+{
+	cache_put(f, &v, sizeof(v));
+}
+
+static void cache_put_u64(FILE *f, uint64_t v)
+{
+	cache_put(f, &v, sizeof(v));
+}
+
+// Strings are stored with a length prefix including the terminating NUL,
+// a zero length encodes a NULL pointer.
+static void cache_put_str(FILE *f, const char *s)
+{
+	uint32_t n = s ? strlen(s) + 1 : 0;
+
+	cache_put_u32(f, n);
+	if (n)
+		cache_put(f, s, n);
+}
+
+static void keymap_cache_store(const char *fname, struct keymap *map, bool verbose)
+{
+	struct keymap_cache_hdr hdr = {};
+	char path[PATH_MAX], tmp[PATH_MAX + 16];
+	struct stat src_st;
+	struct keymap *m;
+	FILE *f;
+	int err;
+
+	if (stat(fname, &src_st))
+		return;
+
+	mkdir(KEYMAP_CACHE_DIR, 0755);
+	keymap_cache_path(fname, path, sizeof(path));
+	snprintf(tmp, sizeof(tmp), "%s.%d", path, getpid());
+	f = fopen(tmp, "we");
+	if (!f)
+		return;
+
+	hdr.magic = KEYMAP_CACHE_MAGIC;
+	hdr.version = KEYMAP_CACHE_VERSION;
+	hdr.src_size = src_st.st_size;
+	hdr.src_mtime_sec = src_st.st_mtim.tv_sec;
+	hdr.src_mtime_nsec = src_st.st_mtim.tv_nsec;
+	for (m = map; m; m = m->next)
+		hdr.num_maps++;
+	cache_put(f, &hdr, sizeof(hdr));
+
+	for (m = map; m; m = m->next) {
+		struct protocol_param *param;
+		struct scancode_entry *se;
+		struct raw_entry *re;
+		uint32_t count;
+
+		cache_put_str(f, m->name);
+		cache_put_str(f, m->protocol);
+		cache_put_str(f, m->variant);
+
+		count = 0;
+		for (param = m->param; param; param = param->next)
+			count++;
+		cache_put_u32(f, count);
+		for (param = m->param; param; param = param->next) {
+			cache_put_str(f, param->name);
+			cache_put_u64(f, param->value);
+		}
+
+		count = 0;
+		for (se = m->scancode; se; se = se->next)
+			count++;
+		cache_put_u32(f, count);
+		for (se = m->scancode; se; se = se->next) {
+			cache_put_u64(f, se->scancode);
+			cache_put_str(f, se->keycode);
+		}
+
+		count = 0;
+		for (re = m->raw; re; re = re->next)
+			count++;
+		cache_put_u32(f, count);
+		for (re = m->raw; re; re = re->next) {
+			cache_put_u64(f, re->scancode);
+			cache_put_u32(f, re->raw_length);
+			cache_put_str(f, re->keycode);
+			cache_put(f, re->raw, re->raw_length * sizeof(re->raw[0]));
+		}
+	}
+
+	err = ferror(f);
+	err |= fclose(f);
+	if (err || rename(tmp, path)) {
+		unlink(tmp);
+		return;
+	}
+	if (verbose)
+		fprintf(stderr, _("%s: wrote compiled keymap %s\n"), fname, path);
+}
+
+struct cache_buf {
+	const uint8_t *data;
+	size_t size;
+	size_t pos;
+	bool error;
+};
+
+static bool cache_get(struct cache_buf *b, void *dst, size_t size)
+{
+	if (b->error || size > b->size - b->pos) {
+		b->error = true;
+		return false;
+	}
+	memcpy(dst, b->data + b->pos, size);
+	b->pos += size;
+	return true;
+}
+
+static uint32_t cache_get_u32(struct cache_buf *b)
+{
+	uint32_t v = 0;
+
+	cache_get(b, &v, sizeof(v));
+	return v;
+}
+
+static uint64_t cache_get_u64(struct cache_buf *b)
+{
+	uint64_t v = 0;
+
+	cache_get(b, &v, sizeof(v));
+	return v;
+}
+
+static char *cache_get_str(struct cache_buf *b)
+{
+	uint32_t n = cache_get_u32(b);
+	char *s;
+
+	if (b->error || !n)
+		return NULL;
+	if (n > b->size - b->pos || b->data[b->pos + n - 1] != 0) {
+		b->error = true;
+		return NULL;
+	}
+	s = strdup((const char *)b->data + b->pos);
+	if (!s)
+		b->error = true;
+	b->pos += n;
+	return s;
+}
+
+static struct keymap *cache_get_map(struct cache_buf *b)
+{
+	struct protocol_param **pnext;
+	struct scancode_entry **snext;
+	struct raw_entry **rnext;
+	struct keymap *map;
+	uint32_t count, i;
+
+	map = calloc(1, sizeof(*map));
+	if (!map)
+		return NULL;
+
+	map->name = cache_get_str(b);
+	map->protocol = cache_get_str(b);
+	map->variant = cache_get_str(b);
+
+	count = cache_get_u32(b);
+	pnext = &map->param;
+	for (i = 0; i < count && !b->error; i++) {
+		struct protocol_param *param = calloc(1, sizeof(*param));
+
+		if (!param)
+			break;
+		param->name = cache_get_str(b);
+		param->value = cache_get_u64(b);
+		*pnext = param;
+		pnext = &param->next;
+	}
+
+	count = cache_get_u32(b);
+	snext = &map->scancode;
+	for (i = 0; i < count && !b->error; i++) {
+		struct scancode_entry *se = calloc(1, sizeof(*se));
+
+		if (!se)
+			break;
+		se->scancode = cache_get_u64(b);
+		se->keycode = cache_get_str(b);
+		*snext = se;
+		snext = &se->next;
+	}
+
+	count = cache_get_u32(b);
+	rnext = &map->raw;
+	for (i = 0; i < count && !b->error; i++) {
+		uint64_t scancode = cache_get_u64(b);
+		uint32_t raw_length = cache_get_u32(b);
+		struct raw_entry *re;
+
+		if (b->error || raw_length > b->size - b->pos)
+			break;
+		re = calloc(1, sizeof(*re) + sizeof(re->raw[0]) * raw_length);
+		if (!re)
+			break;
+		re->scancode = scancode;
+		re->raw_length = raw_length;
+		re->keycode = cache_get_str(b);
+		cache_get(b, re->raw, raw_length * sizeof(re->raw[0]));
+		*rnext = re;
+		rnext = &re->next;
+	}
+
+	if (b->error || i < count || !map->protocol) {
+		free_keymap(map);
+		return NULL;
+	}
+	return map;
+}
+
+static error_t keymap_cache_load(const char *fname, struct keymap **keymap, bool verbose)
+{
+	struct keymap *map = NULL, **next = &map;
+	struct keymap_cache_hdr hdr;
+	struct cache_buf b = {};
+	struct stat src_st, st;
+	char path[PATH_MAX];
+	uint32_t i;
+	void *data;
+	int fd;
+
+	if (stat(fname, &src_st))
+		return EINVAL;
+
+	keymap_cache_path(fname, path, sizeof(path));
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return ENOENT;
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(hdr)) {
+		close(fd);
+		return EINVAL;
+	}
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return EINVAL;
+
+	b.data = data;
+	b.size = st.st_size;
+	if (!cache_get(&b, &hdr, sizeof(hdr)) ||
+	    hdr.magic != KEYMAP_CACHE_MAGIC ||
+	    hdr.version != KEYMAP_CACHE_VERSION ||
+	    hdr.src_size != (uint64_t)src_st.st_size ||
+	    hdr.src_mtime_sec != (int64_t)src_st.st_mtim.tv_sec ||
+	    hdr.src_mtime_nsec != (uint32_t)src_st.st_mtim.tv_nsec ||
+	    !hdr.num_maps) {
+		munmap(data, st.st_size);
+		return EINVAL;
+	}
+
+	for (i = 0; i < hdr.num_maps; i++) {
+		struct keymap *cur = cache_get_map(&b);
+
+		if (!cur) {
+			free_keymap(map);
+			munmap(data, st.st_size);
+			return EINVAL;
+		}
+		*next = cur;
+		next = &cur->next;
+	}
+	munmap(data, st.st_size);
+
+	if (verbose)
+		fprintf(stderr, _("%s: loaded compiled keymap %s\n"), fname, path);
+	*keymap = map;
+	return 0;
+}
+
 error_t parse_keymap(char *fname, struct keymap **keymap, bool verbose)
 {
 	size_t len = strlen(fname);
+	error_t err;
+
+	if (!keymap_cache_load(fname, keymap, verbose))
+		return 0;
 
 	if (len >= 5 && strcasecmp(fname + len - 5, ".toml") == 0)
-		return parse_toml_keymap(fname, keymap, verbose);
+		err = parse_toml_keymap(fname, keymap, verbose);
+	else
+		err = parse_plain_keymap(fname, keymap, verbose);
+
+	if (!err)
+		keymap_cache_store(fname, *keymap, verbose);
 
-	return parse_plain_keymap(fname, keymap, verbose);
+	return err;
 }
 
 int keymap_param(struct keymap *map, const char *name, int fallback)
@@ -52,6 +52,72 @@ static constexpr struct {
 	{ nullptr, MEDIA_TYPE_UNKNOWN }
 };
 
+static media_type mi_devname2type(const char *name)
+{
+	for (size_t i = 0; media_types[i].devname; i++) {
+		const char *devname = media_types[i].devname;
+		size_t len = strlen(devname);
+
+		if (!memcmp(name, devname, len) && isdigit(name[len]))
+			return media_types[i].type;
+	}
+	return MEDIA_TYPE_UNKNOWN;
+}
+
+static void mi_scan_dir(const char *path, media_devnode_map &devices)
+{
+	DIR *dp = opendir(path);
+	struct dirent *ep;
+
+	if (dp == nullptr)
+		return;
+	while ((ep = readdir(dp))) {
+		media_type type = mi_devname2type(ep->d_name);
+
+		if (type == MEDIA_TYPE_UNKNOWN)
+			continue;
+
+		std::string devpath = std::string(path) + "/" + ep->d_name;
+		struct stat sb;
+
+		if (stat(devpath.c_str(), &sb) || !S_ISCHR(sb.st_mode))
+			continue;
+		devices[sb.st_rdev] = { devpath, type };
+	}
+	closedir(dp);
+}
+
+const media_devnode_map &mi_media_scan_devices(bool rescan)
+{
+	static media_devnode_map devices;
+	static bool scanned;
+
+	if (scanned && !rescan)
+		return devices;
+	devices.clear();
+	mi_scan_dir("/dev", devices);
+
+	/* The DVB nodes live one level down in /dev/dvb/adapterN */
+	DIR *dp = opendir("/dev/dvb");
+
+	if (dp) {
+		struct dirent *ep;
+
+		while ((ep = readdir(dp))) {
+			if (memcmp(ep->d_name, "adapter", 7) ||
+			    !isdigit(ep->d_name[7]))
+				continue;
+
+			std::string adapter = std::string("/dev/dvb/") + ep->d_name;
+
+			mi_scan_dir(adapter.c_str(), devices);
+		}
+		closedir(dp);
+	}
+	scanned = true;
+	return devices;
+}
+
 media_type mi_media_detect_type(const char *device)
 {
 	struct stat sb;
@@ -59,6 +125,18 @@ media_type mi_media_detect_type(const char *device)
 	if (stat(device, &sb) == -1)
 		return MEDIA_TYPE_CANT_STAT;
 #ifdef __linux__
+	/*
+	 * The scan table is keyed on dev_t, so this also resolves symlinks
+	 * like /dev/v4l/by-id/... without touching sysfs. Fall back to the
+	 * uevent parse for nodes that appeared after the scan or that live
+	 * outside the standard /dev locations.
+	 */
+	const media_devnode_map &devices = mi_media_scan_devices();
+	media_devnode_map::const_iterator iter = devices.find(sb.st_rdev);
+
+	if (iter != devices.end())
+		return iter->second.type;
+
 	std::string uevent_path("/sys/dev/char/");
 
 	uevent_path += num2s(major(sb.st_rdev), false) + ":" +
@@ -82,14 +160,11 @@ media_type mi_media_detect_type(const char *device)
 				len++;
 			line.erase(0, len + 1);
 		}
-		for (size_t i = 0; media_types[i].devname; i++) {
-			const char *devname = media_types[i].devname;
-			size_t len = strlen(devname);
+		media_type type = mi_devname2type(line.c_str());
 
-			if (!line.compare(0, len, devname) && isdigit(line[0+len])) {
-				uevent_file.close();
-				return media_types[i].type;
-			}
+		if (type != MEDIA_TYPE_UNKNOWN) {
+			uevent_file.close();
+			return type;
 		}
 	}
 
@@ -116,6 +191,12 @@ media_type mi_media_detect_type(const char *device)
 
 std::string mi_media_get_device(__u32 major, __u32 minor)
 {
+	const media_devnode_map &devices = mi_media_scan_devices();
+	media_devnode_map::const_iterator iter = devices.find(makedev(major, minor));
+
+	if (iter != devices.end())
+		return iter->second.devpath;
+
 	char fmt[32];
 	std::string uevent_path("/sys/dev/char/");
 
@@ -6,6 +6,9 @@
 #ifndef _MEDIA_INFO_H
 #define _MEDIA_INFO_H
 
+#include <map>
+#include <string>
+
 enum media_type {
 	MEDIA_TYPE_CANT_STAT,
 	MEDIA_TYPE_UNKNOWN,
@@ -28,6 +31,22 @@ enum media_type {
  */
 media_type mi_media_detect_type(const char *device);
 
+/* One scanned device node: canonical path and detected type */
+struct media_devnode {
+	std::string devpath;
+	media_type type;
+};
+
+typedef std::map<dev_t, media_devnode> media_devnode_map;
+
+/*
+ * Scan /dev (including /dev/dvb/adapterN) in a single readdir pass and
+ * return a map from dev_t to device path and type. The result is cached
+ * process-wide so tools that inspect many nodes pay for the scan only
+ * once; pass rescan = true to pick up hotplugged nodes.
+ */
+const media_devnode_map &mi_media_scan_devices(bool rescan = false);
+
 /*
  * Return the device name given the major and minor numbers.
  */
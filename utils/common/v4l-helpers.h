@@ -75,6 +75,11 @@ static inline ssize_t v4l_wrap_write(struct v4l_fd *f, const void *buffer, size_
 	return f->direct ? write(f->fd, buffer, n) : v4l2_write(f->fd, buffer, n);
 }
 
+static inline int v4l_ioctl_raw(struct v4l_fd *f, unsigned long cmd, void *arg)
+{
+	return f->direct ? ioctl(f->fd, cmd, arg) : v4l2_ioctl(f->fd, cmd, arg);
+}
+
 static inline int v4l_wrap_ioctl(struct v4l_fd *f, unsigned long cmd, ...)
 {
 	void *arg;
@@ -83,7 +88,7 @@ static inline int v4l_wrap_ioctl(struct v4l_fd *f, unsigned long cmd, ...)
 	va_start(ap, cmd);
 	arg = va_arg(ap, void *);
 	va_end(ap);
-	return f->direct ? ioctl(f->fd, cmd, arg) : v4l2_ioctl(f->fd, cmd, arg);
+	return v4l_ioctl_raw(f, cmd, arg);
 }
 
 static inline void *v4l_wrap_mmap(void *start, size_t length, int prot, int flags,
@@ -134,6 +139,11 @@ static inline ssize_t v4l_wrap_write(struct v4l_fd *f, const void *buffer, size_
 	return write(f->fd, buffer, n);
 }
 
+static inline int v4l_ioctl_raw(struct v4l_fd *f, unsigned long cmd, void *arg)
+{
+	return ioctl(f->fd, cmd, arg);
+}
+
 static inline int v4l_wrap_ioctl(struct v4l_fd *f, unsigned long cmd, ...)
 {
 	void *arg;
@@ -142,7 +152,7 @@ static inline int v4l_wrap_ioctl(struct v4l_fd *f, unsigned long cmd, ...)
 	va_start(ap, cmd);
 	arg = va_arg(ap, void *);
 	va_end(ap);
-	return ioctl(f->fd, cmd, arg);
+	return v4l_ioctl_raw(f, cmd, arg);
 }
 
 static inline void *v4l_wrap_mmap(void *start, size_t length, int prot, int flags,
@@ -207,12 +217,31 @@ static inline void v4l_fd_s_trace(struct v4l_fd *f, unsigned int trace)
 	f->trace = trace;
 }
 
+static inline int v4l_untraced_ioctl(struct v4l_fd *f, unsigned long cmd, void *arg)
+{
+	int retval = f->ioctl == v4l_wrap_ioctl ?
+		v4l_ioctl_raw(f, cmd, arg) : f->ioctl(f, cmd, arg);
+
+	return retval == -1 ? errno : (retval ? -1 : 0);
+}
+
 static inline int v4l_named_ioctl(struct v4l_fd *f,
 		const char *cmd_name, unsigned long cmd, void *arg)
 {
 	int retval;
 	int e;
 
+	/*
+	 * Fast path for tight QBUF/DQBUF loops: when tracing is off and the
+	 * ioctl op was not replaced by the application, skip the variadic
+	 * wrapper and the trace bookkeeping. The op comparison can fail for
+	 * an fd initialized in another translation unit (each gets its own
+	 * copy of the static inline wrappers), in which case we just fall
+	 * through to the instrumented path.
+	 */
+	if (!f->trace && f->ioctl == v4l_wrap_ioctl)
+		return v4l_untraced_ioctl(f, cmd, arg);
+
 	retval = f->ioctl(f, cmd, arg);
 	e = retval == 0 ? 0 : errno;
 	if (f->trace >= (e ? 1 : 2))
@@ -221,7 +250,17 @@ static inline int v4l_named_ioctl(struct v4l_fd *f,
 	return retval == -1 ? e : (retval ? -1 : 0);
 }
 
+/*
+ * Tools that never enable ioctl tracing can define V4L_NO_TRACE before
+ * including this header: v4l_ioctl() then compiles down to a bare
+ * ioctl()/v4l2_ioctl() call without the per-command name strings and
+ * trace checks.
+ */
+#ifdef V4L_NO_TRACE
+#define v4l_ioctl(f, cmd, arg) v4l_untraced_ioctl(f, cmd, arg)
+#else
 #define v4l_ioctl(f, cmd, arg) v4l_named_ioctl(f, #cmd, cmd, arg)
+#endif
 
 static inline void *v4l_mmap(struct v4l_fd *f, size_t length, off_t offset)
 {
@@ -0,0 +1,279 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * Rate-limited logging through preallocated per-thread ring buffers.
+ *
+ * Per-frame verbose printing used to go to stderr directly; at high
+ * frame rates the per-line stdio locking and terminal flushes perturb
+ * the very timing being measured. Here the streaming thread only
+ * formats into its own ring and a background thread drains all rings
+ * to the output stream at a fixed pace, so a logging call costs one
+ * vsnprintf and two memcpys. Lines that do not fit (ring full) or
+ * exceed the line rate budget are dropped and counted, never blocked
+ * on.
+ *
+ * Copyright 2026 The linuxtv project.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "v4l-ringlog.h"
+
+#define RINGLOG_DEF_SIZE	(256 * 1024)
+#define RINGLOG_MAX_LINE	1024
+#define RINGLOG_FLUSH_US	20000
+
+/* each committed line is a header followed by the unterminated text */
+struct rl_rec {
+	unsigned len;
+	unsigned long long ts_ns;
+};
+
+struct rl_thread {
+	struct rl_thread *next;
+	unsigned char *buf;
+	unsigned size;		/* power of two, offsets are masked */
+	/*
+	 * Free-running byte counters: the owning thread advances head,
+	 * only the flush thread advances tail. Acquire/release pairs on
+	 * them are the only synchronization of the ring contents.
+	 */
+	unsigned head, tail;
+	unsigned long long dropped;
+	char line[RINGLOG_MAX_LINE];
+	unsigned line_len;
+};
+
+static struct {
+	FILE *out;
+	unsigned buf_size;
+	unsigned max_lps;
+	struct rl_thread *threads;
+	pthread_mutex_t lock;
+	pthread_t flusher;
+	int running;
+	int exiting;
+	unsigned long long rate_dropped;
+} rl = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static __thread struct rl_thread *rl_self;
+
+static unsigned long long rl_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void rl_copy_in(struct rl_thread *t, unsigned pos,
+		       const void *src, unsigned len)
+{
+	unsigned off = pos & (t->size - 1);
+	unsigned chunk = t->size - off;
+
+	if (chunk > len)
+		chunk = len;
+	memcpy(t->buf + off, src, chunk);
+	memcpy(t->buf, (const char *)src + chunk, len - chunk);
+}
+
+static void rl_copy_out(struct rl_thread *t, unsigned pos,
+			void *dst, unsigned len)
+{
+	unsigned off = pos & (t->size - 1);
+	unsigned chunk = t->size - off;
+
+	if (chunk > len)
+		chunk = len;
+	memcpy(dst, t->buf + off, chunk);
+	memcpy((char *)dst + chunk, t->buf, len - chunk);
+}
+
+/* called by the owning thread only */
+static void rl_commit(struct rl_thread *t, const char *text, unsigned len)
+{
+	struct rl_rec rec = { len, rl_now_ns() };
+	unsigned tail = __atomic_load_n(&t->tail, __ATOMIC_ACQUIRE);
+	unsigned need = sizeof(rec) + len;
+
+	if (need > t->size - (t->head - tail)) {
+		t->dropped++;
+		return;
+	}
+	rl_copy_in(t, t->head, &rec, sizeof(rec));
+	rl_copy_in(t, t->head + sizeof(rec), text, len);
+	__atomic_store_n(&t->head, t->head + need, __ATOMIC_RELEASE);
+}
+
+static struct rl_thread *rl_register(void)
+{
+	struct rl_thread *t = calloc(1, sizeof(*t));
+
+	if (t == NULL)
+		return NULL;
+	t->size = rl.buf_size;
+	t->buf = malloc(t->size);
+	if (t->buf == NULL) {
+		free(t);
+		return NULL;
+	}
+	pthread_mutex_lock(&rl.lock);
+	t->next = rl.threads;
+	rl.threads = t;
+	pthread_mutex_unlock(&rl.lock);
+	return t;
+}
+
+/* drain one ring to the output stream, honoring the line rate budget */
+static void rl_drain(struct rl_thread *t, unsigned *lines_this_sec)
+{
+	unsigned head = __atomic_load_n(&t->head, __ATOMIC_ACQUIRE);
+	unsigned tail = t->tail;
+	char text[RINGLOG_MAX_LINE];
+	struct rl_rec rec;
+
+	while (tail != head) {
+		rl_copy_out(t, tail, &rec, sizeof(rec));
+		rl_copy_out(t, tail + sizeof(rec), text, rec.len);
+		tail += sizeof(rec) + rec.len;
+
+		if (rl.max_lps && *lines_this_sec >= rl.max_lps) {
+			rl.rate_dropped++;
+			continue;
+		}
+		(*lines_this_sec)++;
+		fprintf(rl.out, "%llu.%06llu: %.*s\n",
+			rec.ts_ns / 1000000000ULL,
+			(rec.ts_ns % 1000000000ULL) / 1000,
+			rec.len, text);
+	}
+	__atomic_store_n(&t->tail, tail, __ATOMIC_RELEASE);
+}
+
+static void rl_drain_all(unsigned *lines_this_sec)
+{
+	struct rl_thread *t;
+
+	pthread_mutex_lock(&rl.lock);
+	t = rl.threads;
+	pthread_mutex_unlock(&rl.lock);
+	/* nodes are only ever prepended, so walking without the lock is fine */
+	for (; t; t = t->next)
+		rl_drain(t, lines_this_sec);
+	fflush(rl.out);
+}
+
+static void *rl_flusher(void *arg __attribute__((unused)))
+{
+	unsigned lines_this_sec = 0;
+	unsigned long long sec_start = rl_now_ns();
+
+	while (!__atomic_load_n(&rl.exiting, __ATOMIC_ACQUIRE)) {
+		unsigned long long now = rl_now_ns();
+
+		if (now - sec_start >= 1000000000ULL) {
+			sec_start = now;
+			lines_this_sec = 0;
+		}
+		rl_drain_all(&lines_this_sec);
+		usleep(RINGLOG_FLUSH_US);
+	}
+	return NULL;
+}
+
+int v4l_ringlog_start(FILE *out, unsigned buf_size, unsigned max_lines_per_sec)
+{
+	if (rl.running)
+		return 0;
+	if (!buf_size)
+		buf_size = RINGLOG_DEF_SIZE;
+	/* round up to a power of two so ring offsets can be masked */
+	while (buf_size & (buf_size - 1))
+		buf_size += buf_size & -buf_size;
+	rl.out = out;
+	rl.buf_size = buf_size;
+	rl.max_lps = max_lines_per_sec;
+	rl.exiting = 0;
+	if (pthread_create(&rl.flusher, NULL, rl_flusher, NULL))
+		return -1;
+	rl.running = 1;
+	return 0;
+}
+
+void v4l_ringlog_stop(void)
+{
+	struct rl_thread *t;
+	unsigned long long dropped = 0;
+	unsigned lines = 0;
+
+	if (!rl.running)
+		return;
+	__atomic_store_n(&rl.exiting, 1, __ATOMIC_RELEASE);
+	pthread_join(rl.flusher, NULL);
+	rl.running = 0;
+
+	/* final drain without a rate budget */
+	rl.max_lps = 0;
+	rl_drain_all(&lines);
+
+	for (t = rl.threads; t; t = t->next)
+		dropped += t->dropped;
+	if (dropped || rl.rate_dropped)
+		fprintf(rl.out, "ringlog: %llu lines dropped (ring full), "
+			"%llu rate-limited\n", dropped, rl.rate_dropped);
+	fflush(rl.out);
+}
+
+int v4l_ringlog_active(void)
+{
+	return rl.running;
+}
+
+int v4l_ringlog_print(const char *fmt, ...)
+{
+	struct rl_thread *t = rl_self;
+	va_list ap;
+	int len;
+
+	va_start(ap, fmt);
+	if (!rl.running) {
+		len = vfprintf(stderr, fmt, ap);
+		va_end(ap);
+		return len;
+	}
+	if (t == NULL) {
+		t = rl_register();
+		if (t == NULL) {
+			va_end(ap);
+			return -1;
+		}
+		rl_self = t;
+	}
+
+	len = vsnprintf(t->line + t->line_len, sizeof(t->line) - t->line_len,
+			fmt, ap);
+	va_end(ap);
+	if (len < 0)
+		return len;
+	t->line_len += len;
+	if (t->line_len >= sizeof(t->line))
+		t->line_len = sizeof(t->line) - 1;
+
+	/* commit every completed line, keep the partial remainder */
+	for (;;) {
+		char *nl = memchr(t->line, '\n', t->line_len);
+
+		if (nl == NULL)
+			break;
+		rl_commit(t, t->line, nl - t->line);
+		t->line_len -= nl + 1 - t->line;
+		memmove(t->line, nl + 1, t->line_len);
+	}
+	return len;
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * Rate-limited logging through preallocated per-thread ring buffers.
+ *
+ * Copyright 2026 The linuxtv project.
+ */
+
+#ifndef _V4L_RINGLOG_H_
+#define _V4L_RINGLOG_H_
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/*
+ * Start the background flush thread writing to out. buf_size is the
+ * per-thread ring size in bytes (0 selects the default of 256 KiB,
+ * other values are rounded up to a power of two), max_lines_per_sec
+ * caps the output rate (0 = unlimited, excess lines are dropped and
+ * counted). Returns 0 on success.
+ */
+int v4l_ringlog_start(FILE *out, unsigned buf_size, unsigned max_lines_per_sec);
+
+/*
+ * Drain all rings, stop the flush thread and report drop counts to the
+ * output stream if any line was lost. Safe to call when never started.
+ */
+void v4l_ringlog_stop(void);
+
+/* Whether the flush thread is running. */
+int v4l_ringlog_active(void);
+
+/*
+ * Append to the calling thread's pending line; the line is stamped
+ * with CLOCK_MONOTONIC and committed to the ring on '\n'. This never
+ * blocks and never takes a lock: when the ring is full the line is
+ * dropped and counted. Falls back to stderr when the logger is not
+ * running.
+ */
+int v4l_ringlog_print(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -5,9 +5,14 @@
  * Copyright 2016 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
  */
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/sockios.h>
 
 #include "v4l-stream.h"
 #include "codec-fwht.h"
@@ -108,6 +113,91 @@ void rle_decompress(__u8 *b, unsigned size, unsigned rle_size, unsigned bpl)
 	}
 }
 
+void rle_decompress_stream_init(struct rle_dec_stream *s, __u8 *dst,
+				unsigned size, unsigned bpl)
+{
+	memset(s, 0, sizeof(*s));
+	s->dst = dst;
+	s->dst_end = dst + size;
+	s->bpl = (bpl & 3) ? 0 : bpl;
+	s->magic_x = ntohl(V4L_STREAM_PACKET_FRAME_VIDEO_X_RLE);
+	s->magic_y = s->bpl ? ntohl(V4L_STREAM_PACKET_FRAME_VIDEO_Y_RLE) :
+			      s->magic_x;
+	s->need = 4;
+}
+
+static void rle_stream_emit(struct rle_dec_stream *s, __u32 v, __u32 n)
+{
+	while (n-- && s->dst + 4 <= s->dst_end) {
+		memcpy(s->dst, &v, 4);
+		s->dst += 4;
+	}
+	if (s->dst == s->next_line) {
+		unsigned l = s->dup_lines;
+
+		while (l-- && s->dst + s->bpl <= s->dst_end) {
+			memcpy(s->dst, s->dst - s->bpl, s->bpl);
+			s->dst += s->bpl;
+		}
+		s->next_line = NULL;
+		s->dup_lines = 0;
+	}
+}
+
+void rle_decompress_stream(struct rle_dec_stream *s, const __u8 *in, unsigned len)
+{
+	while (len) {
+		unsigned take = s->need - s->have;
+
+		if (take > len)
+			take = len;
+		memcpy((__u8 *)s->code + s->have, in, take);
+		s->have += take;
+		in += take;
+		len -= take;
+		if (s->have < s->need)
+			return;
+		if (s->bpl && s->code[0] == s->magic_y) {
+			/* line duplication: the count word follows */
+			if (s->need == 4) {
+				s->need = 8;
+				continue;
+			}
+			s->dup_lines = ntohl(s->code[1]);
+			s->next_line = s->dst + s->bpl;
+		} else if (s->code[0] == s->magic_x) {
+			/* value duplication: value and count words follow */
+			if (s->need < 12) {
+				s->need = 12;
+				continue;
+			}
+			rle_stream_emit(s, s->code[1], ntohl(s->code[2]));
+		} else {
+			rle_stream_emit(s, s->code[0], 1);
+		}
+		s->have = 0;
+		s->need = 4;
+	}
+}
+
+/*
+ * CRC32C (Castagnoli) over the compressed plane data of FRAME_VIDEO
+ * packets, so a receiver can drop a corrupt frame before paying the
+ * decompression cost. The implementation lives in crc32c.h so other
+ * tools can share it.
+ */
+#include "crc32c.h"
+
+__u32 v4l_stream_crc32c_raw(__u32 crc, const __u8 *buf, unsigned size)
+{
+	return crc32c(crc, buf, size);
+}
+
+__u32 v4l_stream_crc32c(const __u8 *buf, unsigned size)
+{
+	return v4l_stream_crc32c_raw(0xffffffff, buf, size) ^ 0xffffffff;
+}
+
 unsigned rle_compress(__u8 *b, unsigned size, unsigned bpl)
 {
 	__u32 magic_x = ntohl(V4L_STREAM_PACKET_FRAME_VIDEO_X_RLE);
@@ -172,6 +262,14 @@ unsigned rle_compress(__u8 *b, unsigned size, unsigned bpl)
 	return (__u8 *)dst - b;
 }
 
+/* Quantization of the network stream; raised under backpressure */
+#define FWHT_QP_DEFAULT 20
+#define FWHT_QP_MAX 31
+/* Send-queue backlog, in frames, that makes the quality coarser */
+#define FWHT_RATE_COARSER_BACKLOG 1
+/* Send-queue backlog, in frames, that makes frames get dropped */
+#define FWHT_RATE_DROP_BACKLOG 4
+
 struct codec_ctx *fwht_alloc(unsigned pixfmt, unsigned visible_width, unsigned visible_height,
 			     unsigned coded_width, unsigned coded_height,
 			     unsigned field, unsigned colorspace, unsigned xfer_func,
@@ -213,8 +311,8 @@ struct codec_ctx *fwht_alloc(unsigned pixfmt, unsigned visible_width, unsigned v
 	ctx->state.ref_frame.luma = ctx->state.ref_frame.buf;
 	ctx->comp_max_size = ctx->size + sizeof(struct fwht_cframe_hdr);
 	ctx->state.compressed_frame = malloc(ctx->comp_max_size);
-	if (!ctx->state.ref_frame.luma || !ctx->state.compressed_frame) {
-		free(ctx->state.ref_frame.luma);
+	if (!ctx->state.ref_frame.buf || !ctx->state.compressed_frame) {
+		free(ctx->state.ref_frame.buf);
 		free(ctx->state.compressed_frame);
 		free(ctx);
 		return NULL;
@@ -234,23 +332,90 @@ struct codec_ctx *fwht_alloc(unsigned pixfmt, unsigned visible_width, unsigned v
 		ctx->state.ref_frame.alpha = NULL;
 	ctx->state.gop_size = 10;
 	ctx->state.gop_cnt = 0;
+	/*
+	 * Encoding the components on separate threads only pays off when
+	 * there is real per-frame work and idle cores to give it to; small
+	 * frames are dominated by the thread start/join cost.
+	 */
+	ctx->encode_parallel = info->components_num >= 3 &&
+		size >= 1280 * 720 &&
+		sysconf(_SC_NPROCESSORS_ONLN) >= 4;
+	ctx->rate_fd = -1;
+	ctx->rate_qp = FWHT_QP_DEFAULT;
+	ctx->rate_avg = 0;
 	return ctx;
 }
 
 void fwht_free(struct codec_ctx *ctx)
 {
-	free(ctx->state.ref_frame.luma);
+	/*
+	 * Decoding repoints ref_frame.luma into the buffer (packed formats
+	 * have a non-zero luma offset), so free the buffer base instead.
+	 */
+	free(ctx->state.ref_frame.buf);
 	free(ctx->state.compressed_frame);
 	free(ctx);
 }
 
 __u8 *fwht_compress(struct codec_ctx *ctx, __u8 *buf, unsigned uncomp_size, unsigned *comp_size)
 {
-	ctx->state.i_frame_qp = ctx->state.p_frame_qp = 20;
-	*comp_size = v4l2_fwht_encode(&ctx->state, buf, ctx->state.compressed_frame);
+	ctx->state.i_frame_qp = ctx->state.p_frame_qp = ctx->rate_qp;
+	if (ctx->encode_parallel)
+		*comp_size = v4l2_fwht_encode_parallel(&ctx->state, buf,
+						       ctx->state.compressed_frame);
+	else
+		*comp_size = v4l2_fwht_encode(&ctx->state, buf,
+					      ctx->state.compressed_frame);
 	return ctx->state.compressed_frame;
 }
 
+/*
+ * Adaptive quality for network streaming. fwht_rate_control() attaches
+ * the sending socket to the context; from then on fwht_rate_begin(),
+ * called before a frame is compressed, reads the unsent bytes in the
+ * socket queue (SIOCOUTQ) and trades quality for size when the link
+ * cannot keep up: a backlog of one average frame raises the
+ * quantization one step per frame, a backlog of four frames tells the
+ * caller to drop the frame (return false). When the queue drains the
+ * quantization steps back down to the default. fwht_rate_done() feeds
+ * the compressed frame size back to track the average.
+ */
+void fwht_rate_control(struct codec_ctx *ctx, int sock_fd)
+{
+	ctx->rate_fd = sock_fd;
+}
+
+bool fwht_rate_begin(struct codec_ctx *ctx)
+{
+	unsigned backlog;
+	int outq = 0;
+
+	if (ctx->rate_fd < 0 || !ctx->rate_avg)
+		return true;
+	if (ioctl(ctx->rate_fd, SIOCOUTQ, &outq) || outq < 0)
+		return true;
+	backlog = outq / ctx->rate_avg;
+	if (backlog >= FWHT_RATE_DROP_BACKLOG)
+		return false;
+	if (backlog >= FWHT_RATE_COARSER_BACKLOG) {
+		if (ctx->rate_qp < FWHT_QP_MAX)
+			ctx->rate_qp++;
+	} else if (!outq && ctx->rate_qp > FWHT_QP_DEFAULT) {
+		ctx->rate_qp--;
+	}
+	return true;
+}
+
+void fwht_rate_done(struct codec_ctx *ctx, unsigned comp_size)
+{
+	if (ctx->rate_fd < 0)
+		return;
+	if (!ctx->rate_avg)
+		ctx->rate_avg = comp_size;
+	else
+		ctx->rate_avg = (7 * ctx->rate_avg + comp_size) / 8;
+}
+
 static void copy_cap_to_ref(const u8 *cap, const struct v4l2_fwht_pixfmt_info *info,
 			    struct v4l2_fwht_state *state)
 {
@@ -298,3 +463,190 @@ bool fwht_decompress(struct codec_ctx *ctx, __u8 *p_in, unsigned comp_size,
 	copy_cap_to_ref(p_out, ctx->state.info, &ctx->state);
 	return true;
 }
+
+/*
+ * Slice the concatenated iov into datagrams, each prefixed with the
+ * chunk header described in v4l-stream.h. Chunks never span an iov
+ * entry, so the header entries just become short datagrams.
+ */
+bool v4l_stream_udp_send(int fd, __u32 seq, const struct iovec *iov, unsigned niov)
+{
+	__u32 size = 0;
+	__u32 offset = 0;
+	unsigned i;
+
+	for (i = 0; i < niov; i++)
+		size += iov[i].iov_len;
+
+	for (i = 0; i < niov; i++) {
+		const __u8 *p = iov[i].iov_base;
+		unsigned left = iov[i].iov_len;
+
+		while (left) {
+			unsigned chunk = left < V4L_STREAM_UDP_PAYLOAD ?
+					 left : V4L_STREAM_UDP_PAYLOAD;
+			__u32 hdr[4] = {
+				htonl(V4L_STREAM_UDP_ID),
+				htonl(seq),
+				htonl(size),
+				htonl(offset),
+			};
+			struct iovec out[2] = {
+				{ hdr, sizeof(hdr) },
+				{ (void *)p, chunk },
+			};
+			struct msghdr msg;
+
+			memset(&msg, 0, sizeof(msg));
+			msg.msg_iov = out;
+			msg.msg_iovlen = 2;
+			if (sendmsg(fd, &msg, 0) < 0) {
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+			p += chunk;
+			offset += chunk;
+			left -= chunk;
+		}
+	}
+	return true;
+}
+
+/*
+ * Read one datagram and add its chunk to the frame under reassembly.
+ * A chunk belonging to a different frame discards whatever was
+ * incomplete and starts over: frames with lost chunks are dropped, not
+ * waited for. Returns the frame size once a frame is complete, 0 if
+ * more datagrams are needed and -1 on errors.
+ */
+int v4l_stream_udp_recv(int fd, struct v4l_stream_udp_reasm *r)
+{
+	__u8 pkt[V4L_STREAM_UDP_HDR_SIZE + V4L_STREAM_UDP_PAYLOAD];
+	__u32 hdr[4];
+	__u32 seq, size, offset;
+	ssize_t n;
+
+	n = recv(fd, pkt, sizeof(pkt), 0);
+	if (n < 0)
+		return errno == EINTR ? 0 : -1;
+	if (n < V4L_STREAM_UDP_HDR_SIZE)
+		return 0;
+	memcpy(hdr, pkt, sizeof(hdr));
+	if (ntohl(hdr[0]) != V4L_STREAM_UDP_ID)
+		return 0;
+	seq = ntohl(hdr[1]);
+	size = ntohl(hdr[2]);
+	offset = ntohl(hdr[3]);
+	n -= V4L_STREAM_UDP_HDR_SIZE;
+	if (!size || offset + n > size)
+		return 0;
+	if (seq != r->seq || size != r->size) {
+		if (size > r->buf_size) {
+			free(r->buf);
+			r->buf = malloc(size);
+			if (!r->buf) {
+				r->buf_size = 0;
+				return -1;
+			}
+			r->buf_size = size;
+		}
+		r->seq = seq;
+		r->size = size;
+		r->filled = 0;
+	}
+	memcpy(r->buf + offset, pkt + V4L_STREAM_UDP_HDR_SIZE, n);
+	r->filled += n;
+	if (r->filled < r->size)
+		return 0;
+	/*
+	 * Bump the expected sequence so a late duplicate of this frame
+	 * starts a fresh (never completing) reassembly instead of being
+	 * delivered twice.
+	 */
+	r->seq++;
+	r->filled = 0;
+	return r->size;
+}
+
+struct udp_stream {
+	int fd;
+	struct v4l_stream_udp_reasm reasm;
+	__u32 preamble[2];
+	unsigned pre_off;
+	unsigned frame_size;
+	unsigned frame_off;
+};
+
+static ssize_t udp_stream_read(void *cookie, char *buf, size_t len)
+{
+	struct udp_stream *s = cookie;
+	size_t done = 0;
+
+	while (done < len) {
+		const __u8 *src;
+		unsigned avail;
+
+		if (s->pre_off < sizeof(s->preamble)) {
+			src = (const __u8 *)s->preamble + s->pre_off;
+			avail = sizeof(s->preamble) - s->pre_off;
+		} else {
+			if (s->frame_off == s->frame_size) {
+				int sz;
+
+				/* never block for a new frame mid-read */
+				if (done)
+					break;
+				do {
+					sz = v4l_stream_udp_recv(s->fd, &s->reasm);
+					if (sz < 0)
+						return -1;
+				} while (!sz);
+				s->frame_size = sz;
+				s->frame_off = 0;
+			}
+			src = s->reasm.buf + s->frame_off;
+			avail = s->frame_size - s->frame_off;
+		}
+		if (avail > len - done)
+			avail = len - done;
+		memcpy(buf + done, src, avail);
+		if (s->pre_off < sizeof(s->preamble))
+			s->pre_off += avail;
+		else
+			s->frame_off += avail;
+		done += avail;
+	}
+	return done;
+}
+
+static int udp_stream_close(void *cookie)
+{
+	struct udp_stream *s = cookie;
+
+	close(s->fd);
+	free(s->reasm.buf);
+	free(s);
+	return 0;
+}
+
+/*
+ * Wrap a bound datagram socket in a stdio stream that delivers only
+ * completely reassembled frames, prefixed by the usual stream ID and
+ * version handshake. The result parses exactly like a TCP stream.
+ */
+FILE *v4l_stream_udp_fopen(int fd)
+{
+	cookie_io_functions_t io = {
+		.read = udp_stream_read,
+		.close = udp_stream_close,
+	};
+	struct udp_stream *s = calloc(1, sizeof(*s));
+
+	if (!s)
+		return NULL;
+	s->fd = fd;
+	s->preamble[0] = htonl(V4L_STREAM_ID);
+	s->preamble[1] = htonl(V4L_STREAM_VERSION);
+	return fopencookie(s, "r", io);
+}
@@ -8,6 +8,8 @@
 #ifndef _V4L_STREAM_H_
 #define _V4L_STREAM_H_
 
+#include <stdio.h>
+#include <sys/uio.h>
 #include <linux/videodev2.h>
 
 #ifdef __cplusplus
@@ -32,7 +34,8 @@ extern "C" {
  * All values (IDs, sizes, etc) are all uint32_t in network order.
  */
 #define V4L_STREAM_ID			v4l2_fourcc('V', '4', 'L', '2')
-#define V4L_STREAM_VERSION		2
+/* Version 3 added the crc32c word to the frame video plane header */
+#define V4L_STREAM_VERSION		3
 
 /*
  * Each packet is followed by the size of the packet (not including
@@ -74,7 +77,9 @@ extern "C" {
 #define V4L_STREAM_PACKET_FRAME_VIDEO_FWHT		v4l2_fourcc('f', 'r', 'm', 'V')
 
 #define V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR		(8 * 4)
-#define V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR	(8 * 4)
+/* Plane header of version 2 streams, without the crc32c word */
+#define V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR_V2	(8 * 4)
+#define V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR	(9 * 4)
 #define V4L_STREAM_PACKET_FRAME_VIDEO_SIZE(planes) 	(V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR + 4 + \
 							 (planes) * (V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR + 4))
 
@@ -88,6 +93,8 @@ extern "C" {
  * 	uint32_t size_plane_hdr; // size in bytes of data after size_plane_hdr until data[]
  * 	uint32_t bytesused;
  * 	uint32_t data_size;
+ * 	uint32_t crc32c;	 // CRC32C of data[], lets the receiver drop a
+ * 				 // corrupt frame before decompressing it
  * 	uint8_t data[data_size];
  * } planes[num_planes];
  */
@@ -136,16 +143,82 @@ extern "C" {
  */
 #define V4L_STREAM_PACKET_END				v4l2_fourcc('e', 'n', 'd', ' ')
 
+/*
+ * Datagram (UDP) transport.
+ *
+ * TCP retransmits lost segments, so a single loss stalls every frame
+ * queued behind it. For live monitoring a fresh frame beats a complete
+ * one, so the datagram transport slices each frame into independent
+ * chunks and lets the receiver drop any frame with a missing chunk.
+ *
+ * Every datagram starts with this header (all fields in network order):
+ *
+ * uint32_t id;		// V4L_STREAM_UDP_ID
+ * uint32_t seq;	// frame sequence number
+ * uint32_t size;	// total size in bytes of the sliced frame
+ * uint32_t offset;	// offset of this chunk within the frame
+ *
+ * followed by the chunk payload. The sliced bytes are exactly what the
+ * TCP transport would write for that frame, except that the FMT_VIDEO
+ * packet precedes the FRAME_VIDEO packet of every frame: any datagram,
+ * including the one carrying the format, can get lost.
+ *
+ * There is no handshake: v4l_stream_udp_fopen() synthesizes the stream
+ * ID and version words so the reassembled stream parses exactly like a
+ * TCP stream.
+ */
+#define V4L_STREAM_UDP_ID		v4l2_fourcc('V', '4', 'L', 'u')
+#define V4L_STREAM_UDP_HDR_SIZE		(4 * 4)
+/* chunk payload size, keeps each datagram below the common 1500 MTU */
+#define V4L_STREAM_UDP_PAYLOAD		1408
+
+struct v4l_stream_udp_reasm {
+	__u32		seq;
+	__u32		size;
+	__u32		filled;
+	__u8		*buf;
+	unsigned	buf_size;
+};
+
 struct codec_ctx {
 	struct v4l2_fwht_state	state;
 	unsigned int		flags;
 	unsigned int		size;
 	u32			field;
 	u32			comp_max_size;
+	unsigned int		encode_parallel;
+	/* adaptive quality, see fwht_rate_control() */
+	int			rate_fd;
+	unsigned int		rate_qp;
+	unsigned int		rate_avg;
+};
+
+/*
+ * Streaming RLE decompressor: rle_decompress() needs the whole
+ * compressed plane in memory before it can start. The streaming form
+ * keeps at most one pending code in the state struct, so the receiver
+ * can feed socket reads of any size as they arrive and decompression
+ * overlaps the network transfer in cache-sized chunks. Writes are
+ * clamped to the plane, a corrupt stream cannot run past dst.
+ */
+struct rle_dec_stream {
+	__u8		*dst;
+	__u8		*dst_end;
+	__u8		*next_line;
+	unsigned	bpl;
+	unsigned	dup_lines;
+	__u32		magic_x;
+	__u32		magic_y;
+	__u32		code[3];
+	unsigned	have;
+	unsigned	need;
 };
 
 unsigned rle_compress(__u8 *buf, unsigned size, unsigned bytesperline);
 void rle_decompress(__u8 *buf, unsigned size, unsigned rle_size, unsigned bytesperline);
+void rle_decompress_stream_init(struct rle_dec_stream *s, __u8 *dst,
+				unsigned size, unsigned bytesperline);
+void rle_decompress_stream(struct rle_dec_stream *s, const __u8 *in, unsigned len);
 struct codec_ctx *fwht_alloc(unsigned pixfmt, unsigned visible_width, unsigned visible_height,
 			     unsigned coded_width, unsigned coded_height, unsigned field,
 			     unsigned colorspace, unsigned xfer_func, unsigned ycbcr_enc,
@@ -154,6 +227,15 @@ void fwht_free(struct codec_ctx *ctx);
 __u8 *fwht_compress(struct codec_ctx *ctx, __u8 *buf, unsigned size, unsigned *comp_size);
 bool fwht_decompress(struct codec_ctx *ctx, __u8 *read_buf, unsigned comp_size,
 		     __u8 *buf, unsigned size);
+void fwht_rate_control(struct codec_ctx *ctx, int sock_fd);
+bool fwht_rate_begin(struct codec_ctx *ctx);
+void fwht_rate_done(struct codec_ctx *ctx, unsigned comp_size);
+__u32 v4l_stream_crc32c(const __u8 *buf, unsigned size);
+/* incremental form: start from ~0, invert the result when done */
+__u32 v4l_stream_crc32c_raw(__u32 crc, const __u8 *buf, unsigned size);
+bool v4l_stream_udp_send(int fd, __u32 seq, const struct iovec *iov, unsigned niov);
+int v4l_stream_udp_recv(int fd, struct v4l_stream_udp_reasm *r);
+FILE *v4l_stream_udp_fopen(int fd);
 unsigned rle_calc_bpl(unsigned bpl, __u32 pixelformat);
 
 #ifdef __cplusplus
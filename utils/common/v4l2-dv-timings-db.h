@@ -0,0 +1,137 @@
+/* SPDX-License-Identifier: LGPL-2.1-only */
+/*
+ * Canonical CEA-861/DMT DV timings table
+ *
+ * Copyright 2026 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
+ */
+
+#ifndef _V4L2_DV_TIMINGS_DB_H_
+#define _V4L2_DV_TIMINGS_DB_H_
+
+#include <linux/videodev2.h>
+
+/*
+ * Precomputed table of the canonical CEA-861 and VESA DMT timings,
+ * matching the timing definitions the kernel uses, so validating or
+ * naming a timing is a table lookup instead of redoing the CVT/GTF
+ * math. Shared between v4l2-compliance and v4l2-ctl.
+ */
+struct v4l2_dv_canonical_timing {
+	const char *name;
+	__u32 standards;
+	__u16 width, height;
+	__u8 interlaced;
+	__u8 polarities;
+	__u64 pixelclock;
+	__u16 hfrontporch, hsync, hbackporch;
+	__u16 vfrontporch, vsync, vbackporch;
+	__u16 il_vfrontporch, il_vsync, il_vbackporch;
+};
+
+#define V4L2_DV_POL_PP (V4L2_DV_VSYNC_POS_POL | V4L2_DV_HSYNC_POS_POL)
+
+static constexpr v4l2_dv_canonical_timing v4l2_dv_canonical_timings[] = {
+	{ "CEA-861/DMT 640x480p59.94", V4L2_DV_BT_STD_CEA861 | V4L2_DV_BT_STD_DMT,
+	  640, 480, 0, 0, 25175000, 16, 96, 48, 10, 2, 33, 0, 0, 0 },
+	{ "CEA-861 720x480i59.94", V4L2_DV_BT_STD_CEA861,
+	  720, 480, 1, 0, 13500000, 19, 62, 57, 4, 3, 15, 4, 3, 16 },
+	{ "CEA-861 720x480p59.94", V4L2_DV_BT_STD_CEA861,
+	  720, 480, 0, 0, 27000000, 16, 62, 60, 9, 6, 30, 0, 0, 0 },
+	{ "CEA-861 720x576i50", V4L2_DV_BT_STD_CEA861,
+	  720, 576, 1, 0, 13500000, 12, 63, 69, 2, 3, 19, 2, 3, 20 },
+	{ "CEA-861 720x576p50", V4L2_DV_BT_STD_CEA861,
+	  720, 576, 0, 0, 27000000, 12, 64, 68, 5, 5, 39, 0, 0, 0 },
+	{ "CEA-861 1280x720p24", V4L2_DV_BT_STD_CEA861,
+	  1280, 720, 0, V4L2_DV_POL_PP, 59400000, 1760, 40, 220, 5, 5, 20, 0, 0, 0 },
+	{ "CEA-861 1280x720p25", V4L2_DV_BT_STD_CEA861,
+	  1280, 720, 0, V4L2_DV_POL_PP, 74250000, 2420, 40, 220, 5, 5, 20, 0, 0, 0 },
+	{ "CEA-861 1280x720p30", V4L2_DV_BT_STD_CEA861,
+	  1280, 720, 0, V4L2_DV_POL_PP, 74250000, 1760, 40, 220, 5, 5, 20, 0, 0, 0 },
+	{ "CEA-861 1280x720p50", V4L2_DV_BT_STD_CEA861,
+	  1280, 720, 0, V4L2_DV_POL_PP, 74250000, 440, 40, 220, 5, 5, 20, 0, 0, 0 },
+	{ "CEA-861/DMT 1280x720p60", V4L2_DV_BT_STD_CEA861 | V4L2_DV_BT_STD_DMT,
+	  1280, 720, 0, V4L2_DV_POL_PP, 74250000, 110, 40, 220, 5, 5, 20, 0, 0, 0 },
+	{ "CEA-861 1920x1080p24", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 0, V4L2_DV_POL_PP, 74250000, 638, 44, 148, 4, 5, 36, 0, 0, 0 },
+	{ "CEA-861 1920x1080p25", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 0, V4L2_DV_POL_PP, 74250000, 528, 44, 148, 4, 5, 36, 0, 0, 0 },
+	{ "CEA-861 1920x1080p30", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 0, V4L2_DV_POL_PP, 74250000, 88, 44, 148, 4, 5, 36, 0, 0, 0 },
+	{ "CEA-861 1920x1080i50", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 1, V4L2_DV_POL_PP, 74250000, 528, 44, 148, 2, 5, 15, 2, 5, 16 },
+	{ "CEA-861 1920x1080i59.94/60", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 1, V4L2_DV_POL_PP, 74250000, 88, 44, 148, 2, 5, 15, 2, 5, 16 },
+	{ "CEA-861 1920x1080p50", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 0, V4L2_DV_POL_PP, 148500000, 528, 44, 148, 4, 5, 36, 0, 0, 0 },
+	{ "CEA-861 1920x1080p59.94/60", V4L2_DV_BT_STD_CEA861,
+	  1920, 1080, 0, V4L2_DV_POL_PP, 148500000, 88, 44, 148, 4, 5, 36, 0, 0, 0 },
+	{ "CEA-861 3840x2160p24", V4L2_DV_BT_STD_CEA861,
+	  3840, 2160, 0, V4L2_DV_POL_PP, 297000000, 1276, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "CEA-861 3840x2160p25", V4L2_DV_BT_STD_CEA861,
+	  3840, 2160, 0, V4L2_DV_POL_PP, 297000000, 1056, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "CEA-861 3840x2160p30", V4L2_DV_BT_STD_CEA861,
+	  3840, 2160, 0, V4L2_DV_POL_PP, 297000000, 176, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "CEA-861 3840x2160p50", V4L2_DV_BT_STD_CEA861,
+	  3840, 2160, 0, V4L2_DV_POL_PP, 594000000, 1056, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "CEA-861 3840x2160p60", V4L2_DV_BT_STD_CEA861,
+	  3840, 2160, 0, V4L2_DV_POL_PP, 594000000, 176, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "CEA-861 4096x2160p24", V4L2_DV_BT_STD_CEA861,
+	  4096, 2160, 0, V4L2_DV_POL_PP, 297000000, 1020, 88, 296, 8, 10, 72, 0, 0, 0 },
+	{ "DMT 800x600p60", V4L2_DV_BT_STD_DMT,
+	  800, 600, 0, V4L2_DV_POL_PP, 40000000, 40, 128, 88, 1, 4, 23, 0, 0, 0 },
+	{ "DMT 1024x768p60", V4L2_DV_BT_STD_DMT,
+	  1024, 768, 0, 0, 65000000, 24, 136, 160, 3, 6, 29, 0, 0, 0 },
+	{ "DMT 1280x1024p60", V4L2_DV_BT_STD_DMT,
+	  1280, 1024, 0, V4L2_DV_POL_PP, 108000000, 48, 112, 248, 1, 3, 38, 0, 0, 0 },
+	{ "DMT 1366x768p60", V4L2_DV_BT_STD_DMT,
+	  1366, 768, 0, V4L2_DV_POL_PP, 85500000, 70, 143, 213, 3, 3, 24, 0, 0, 0 },
+	{ "DMT 1600x1200p60", V4L2_DV_BT_STD_DMT,
+	  1600, 1200, 0, V4L2_DV_POL_PP, 162000000, 64, 192, 304, 1, 3, 46, 0, 0, 0 },
+	{ "DMT 1920x1200p60 RB", V4L2_DV_BT_STD_DMT,
+	  1920, 1200, 0, V4L2_DV_HSYNC_POS_POL, 154000000, 48, 32, 80, 3, 6, 26, 0, 0, 0 },
+};
+
+#undef V4L2_DV_POL_PP
+
+/*
+ * Find the canonical timing with the same active size, scan type and
+ * pixelclock (within 1%, so the 1000/1001 NTSC variants match too).
+ * The blanking is deliberately not part of the key: the caller can
+ * compare it against the returned entry to detect drivers that report
+ * non-standard blanking for a standard mode.
+ */
+static __attribute__((unused)) const v4l2_dv_canonical_timing *
+v4l2_dv_timing_find(const struct v4l2_bt_timings *bt)
+{
+	for (const auto &t : v4l2_dv_canonical_timings) {
+		__u64 delta = t.pixelclock > bt->pixelclock ?
+			t.pixelclock - bt->pixelclock :
+			bt->pixelclock - t.pixelclock;
+
+		if (t.width == bt->width && t.height == bt->height &&
+		    t.interlaced == bt->interlaced &&
+		    delta <= t.pixelclock / 100)
+			return &t;
+	}
+	return nullptr;
+}
+
+/* Does the timing match the canonical entry exactly, except for the
+   1000/1001 pixelclock tolerance applied by v4l2_dv_timing_find()? */
+static __attribute__((unused)) bool
+v4l2_dv_timing_matches(const struct v4l2_bt_timings *bt,
+		       const v4l2_dv_canonical_timing *t)
+{
+	return bt->hfrontporch == t->hfrontporch &&
+	       bt->hsync == t->hsync &&
+	       bt->hbackporch == t->hbackporch &&
+	       bt->vfrontporch == t->vfrontporch &&
+	       bt->vsync == t->vsync &&
+	       bt->vbackporch == t->vbackporch &&
+	       bt->il_vfrontporch == t->il_vfrontporch &&
+	       bt->il_vsync == t->il_vsync &&
+	       bt->il_vbackporch == t->il_vbackporch &&
+	       bt->polarities == t->polarities;
+}
+
+#endif
@@ -3,6 +3,8 @@
  * Copyright 2018 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
  */
 
+#include <string.h>
+
 #include <v4l2-info.h>
 
 static std::string num2s(unsigned num, bool is_hex = true)
@@ -35,6 +37,29 @@ std::string flags2s(unsigned val, const flag_def *def)
 	return s;
 }
 
+char *flags2s(char *buf, size_t len, unsigned val, const flag_def *def)
+{
+	size_t off = 0;
+
+	if (!len)
+		return buf;
+	buf[0] = 0;
+	for (; def->flag; def++) {
+		if (!(val & def->flag))
+			continue;
+		val &= ~def->flag;
+		if (off < len)
+			off += snprintf(buf + off, len - off, "%s%s",
+					off ? ", " : "", def->str);
+		if (off >= len)
+			off = len - 1;
+	}
+	if (val && off < len)
+		snprintf(buf + off, len - off, "%s0x%08x",
+			 off ? ", " : "", val);
+	return buf;
+}
+
 static std::string cap2s(unsigned cap)
 {
 	std::string s;
@@ -149,6 +174,20 @@ std::string fcc2s(__u32 val)
 	return s;
 }
 
+char *fcc2s(char *buf, size_t len, __u32 val)
+{
+	size_t off = 0;
+
+	if (!len)
+		return buf;
+	for (unsigned i = 0; i < 4 && off + 1 < len; i++)
+		buf[off++] = (val >> (8 * i)) & 0x7f;
+	buf[off] = 0;
+	if (val & (1U << 31))
+		snprintf(buf + off, len - off, "-BE");
+	return buf;
+}
+
 std::string pixfmt2s(__u32 format)
 {
 	switch (format) {
@@ -158,7 +197,7 @@ std::string pixfmt2s(__u32 format)
 	}
 }
 
-std::string buftype2s(int type)
+static const char *buftype2name(int type)
 {
 	switch (type) {
 	case V4L2_BUF_TYPE_VIDEO_CAPTURE:
@@ -192,10 +231,29 @@ std::string buftype2s(int type)
 	case V4L2_BUF_TYPE_PRIVATE:
 		return "Private";
 	default:
-		return std::string("Unknown (") + num2s(type) + ")";
+		return nullptr;
 	}
 }
 
+std::string buftype2s(int type)
+{
+	const char *name = buftype2name(type);
+
+	if (name)
+		return name;
+	return std::string("Unknown (") + num2s(type) + ")";
+}
+
+const char *buftype2s(char *buf, size_t len, int type)
+{
+	const char *name = buftype2name(type);
+
+	if (name)
+		return name;
+	snprintf(buf, len, "Unknown (0x%08x)", type);
+	return buf;
+}
+
 static constexpr flag_def bufcap_def[] = {
 	{ V4L2_BUF_CAP_SUPPORTS_MMAP, "mmap" },
 	{ V4L2_BUF_CAP_SUPPORTS_USERPTR, "userptr" },
@@ -212,7 +270,7 @@ std::string bufcap2s(__u32 caps)
 	return flags2s(caps, bufcap_def);
 }
 
-std::string field2s(int val)
+static const char *field2name(int val)
 {
 	switch (val) {
 	case V4L2_FIELD_ANY:
@@ -236,10 +294,29 @@ std::string field2s(int val)
 	case V4L2_FIELD_INTERLACED_BT:
 		return "Interlaced Bottom-Top";
 	default:
-		return "Unknown (" + num2s(val) + ")";
+		return nullptr;
 	}
 }
 
+std::string field2s(int val)
+{
+	const char *name = field2name(val);
+
+	if (name)
+		return name;
+	return "Unknown (" + num2s(val) + ")";
+}
+
+const char *field2s(char *buf, size_t len, int val)
+{
+	const char *name = field2name(val);
+
+	if (name)
+		return name;
+	snprintf(buf, len, "Unknown (0x%08x)", val);
+	return buf;
+}
+
 std::string colorspace2s(int val)
 {
 	switch (val) {
@@ -699,6 +776,11 @@ std::string tc_flags2s(__u32 flags)
 	return flags2s(flags, tc_flags_def);
 }
 
+char *tc_flags2s(char *buf, size_t len, __u32 flags)
+{
+	return flags2s(buf, len, flags, tc_flags_def);
+}
+
 static constexpr flag_def buffer_flags_def[] = {
 	{ V4L2_BUF_FLAG_MAPPED, "mapped" },
 	{ V4L2_BUF_FLAG_QUEUED, "queued" },
@@ -754,6 +836,45 @@ std::string bufferflags2s(__u32 flags)
 	return s;
 }
 
+char *bufferflags2s(char *buf, size_t len, __u32 flags)
+{
+	const unsigned ts_mask = V4L2_BUF_FLAG_TIMESTAMP_MASK | V4L2_BUF_FLAG_TSTAMP_SRC_MASK;
+	const char *ts;
+	const char *src;
+	size_t off;
+
+	switch (flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) {
+	case V4L2_BUF_FLAG_TIMESTAMP_UNKNOWN:
+		ts = "ts-unknown";
+		break;
+	case V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC:
+		ts = "ts-monotonic";
+		break;
+	case V4L2_BUF_FLAG_TIMESTAMP_COPY:
+		ts = "ts-copy";
+		break;
+	default:
+		ts = "ts-invalid";
+		break;
+	}
+	switch (flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) {
+	case V4L2_BUF_FLAG_TSTAMP_SRC_EOF:
+		src = "ts-src-eof";
+		break;
+	case V4L2_BUF_FLAG_TSTAMP_SRC_SOE:
+		src = "ts-src-soe";
+		break;
+	default:
+		src = "ts-src-invalid";
+		break;
+	}
+	off = strlen(flags2s(buf, len, flags & ~ts_mask, buffer_flags_def));
+	if (off < len)
+		snprintf(buf + off, len - off, "%s%s, %s",
+			 off ? ", " : "", ts, src);
+	return buf;
+}
+
 static const flag_def vbi_def[] = {
 	{ V4L2_VBI_UNSYNC,     "unsynchronized" },
 	{ V4L2_VBI_INTERLACED, "interlaced" },
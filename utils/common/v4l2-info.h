@@ -19,6 +19,18 @@ struct flag_def {
 /* Return a comma-separated string of flags or hex value if unknown */
 std::string flags2s(unsigned val, const flag_def *def);
 
+/*
+ * Allocation-free variants for per-frame print paths: they format into
+ * the caller's buffer and return it, so verbose streaming does not
+ * construct std::strings for every dequeued buffer.
+ */
+char *flags2s(char *buf, size_t len, unsigned val, const flag_def *def);
+char *fcc2s(char *buf, size_t len, __u32 val);
+const char *buftype2s(char *buf, size_t len, int type);
+const char *field2s(char *buf, size_t len, int val);
+char *bufferflags2s(char *buf, size_t len, __u32 flags);
+char *tc_flags2s(char *buf, size_t len, __u32 flags);
+
 /* Print capability information */
 void v4l2_info_capability(const v4l2_capability &cap);
 void v4l2_info_subdev_capability(const v4l2_subdev_capability &subdevcap);
@@ -11,6 +11,9 @@
 #include "compiler.h"
 #include "v4l2-tpg-colors.h"
 
+#include <pthread.h>
+#include <unistd.h>
+
 /* Must remain in sync with enum tpg_pattern */
 const char * const tpg_pattern_strings[] = {
 	"75% Colorbar",
@@ -142,6 +145,13 @@ int tpg_alloc(struct tpg_data *tpg, unsigned max_w)
 			vzalloc(array3_size(max_w, 2, pixelsz));
 		if (!tpg->random_line[plane])
 			return -ENOMEM;
+		/* 256 glyphs of 16 rows, at most 8 pixels of 4 bytes each */
+		tpg->glyphs[plane] = vzalloc(array3_size(256 * 16, 8, 4));
+		if (!tpg->glyphs[plane])
+			return -ENOMEM;
+		tpg->glyph_cached[plane] = vzalloc(256 / 8);
+		if (!tpg->glyph_cached[plane])
+			return -ENOMEM;
 	}
 	return 0;
 }
@@ -164,9 +174,13 @@ void tpg_free(struct tpg_data *tpg)
 		vfree(tpg->contrast_line[plane]);
 		vfree(tpg->black_line[plane]);
 		vfree(tpg->random_line[plane]);
+		vfree(tpg->glyphs[plane]);
+		vfree(tpg->glyph_cached[plane]);
 		tpg->contrast_line[plane] = NULL;
 		tpg->black_line[plane] = NULL;
 		tpg->random_line[plane] = NULL;
+		tpg->glyphs[plane] = NULL;
+		tpg->glyph_cached[plane] = NULL;
 	}
 }
 
@@ -1745,6 +1759,29 @@ static void tpg_calculate_square_border(struct tpg_data *tpg)
 	}
 }
 
+/*
+ * Fill a line with copies of a single two-pixel value by repeatedly
+ * doubling the already filled part with memcpy. This runs at memory
+ * bandwidth, unlike copying the two-pixel value one pair at a time,
+ * which matters when the templates are rebuilt for 4K widths.
+ */
+static void tpg_fill_line(u8 *line, const u8 *pix, unsigned twopixsize,
+			  unsigned length)
+{
+	unsigned filled = twopixsize;
+
+	if (length < twopixsize)
+		return;
+	memcpy(line, pix, twopixsize);
+	while (filled < length) {
+		unsigned chunk = filled < length - filled ?
+			filled : length - filled;
+
+		memcpy(line + filled, line, chunk);
+		filled += chunk;
+	}
+}
+
 static void tpg_precalculate_line(struct tpg_data *tpg)
 {
 	enum tpg_color contrast;
@@ -1771,6 +1808,8 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 		unsigned fract_part = tpg->src_width % tpg->scaled_width;
 		unsigned src_x = 0;
 		unsigned error = 0;
+		int last_color1 = -1;
+		int last_color2 = -1;
 
 		for (x = 0; x < tpg->scaled_width * 2; x += 2) {
 			unsigned real_x = src_x;
@@ -1797,8 +1836,20 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 				src_x++;
 			}
 
-			gen_twopix(tpg, pix, tpg->hflip ? color2 : color1, 0);
-			gen_twopix(tpg, pix, tpg->hflip ? color1 : color2, 1);
+			/*
+			 * Patterns consist of long runs of identical colors
+			 * (color bars, checkers, ramps), so only regenerate
+			 * the two-pixel value when the colors change. Note
+			 * that tpg_get_color() never returns TPG_COLOR_RANDOM,
+			 * so reusing the previous value is always safe.
+			 */
+			if ((int)color1 != last_color1 ||
+			    (int)color2 != last_color2) {
+				gen_twopix(tpg, pix, tpg->hflip ? color2 : color1, 0);
+				gen_twopix(tpg, pix, tpg->hflip ? color1 : color2, 1);
+				last_color1 = color1;
+				last_color2 = color2;
+			}
 			for (p = 0; p < tpg->planes; p++) {
 				unsigned twopixsize = tpg->twopixelsize[p];
 				unsigned hdiv = tpg->hdownsampling[p];
@@ -1821,7 +1872,23 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 				u8 *pos2 = tpg->lines[next_pat][p];
 				u8 *dest = tpg->downsampled_lines[pat][p];
 
-				for (x = 0; x < w; x++, pos1++, pos2++, dest++)
+				/*
+				 * Average word-at-a-time: (a & b) + carry-free
+				 * ((a ^ b) >> 1) gives the same rounded-down
+				 * per-byte result as the scalar expression in
+				 * the tail loop below.
+				 */
+				for (x = 0; x + sizeof(u32) <= w; x += sizeof(u32),
+				     pos1 += sizeof(u32), pos2 += sizeof(u32),
+				     dest += sizeof(u32)) {
+					u32 a, b, avg;
+
+					memcpy(&a, pos1, sizeof(a));
+					memcpy(&b, pos2, sizeof(b));
+					avg = (a & b) + (((a ^ b) & 0xfefefefeU) >> 1);
+					memcpy(dest, &avg, sizeof(avg));
+				}
+				for (; x < w; x++, pos1++, pos2++, dest++)
 					*dest = ((u16)*pos1 + (u16)*pos2) / 2;
 			}
 		}
@@ -1829,23 +1896,17 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 
 	gen_twopix(tpg, pix, contrast, 0);
 	gen_twopix(tpg, pix, contrast, 1);
-	for (p = 0; p < tpg->planes; p++) {
-		unsigned twopixsize = tpg->twopixelsize[p];
-		u8 *pos = tpg->contrast_line[p];
-
-		for (x = 0; x < tpg->scaled_width; x += 2, pos += twopixsize)
-			memcpy(pos, pix[p], twopixsize);
-	}
+	for (p = 0; p < tpg->planes; p++)
+		tpg_fill_line(tpg->contrast_line[p], pix[p],
+			      tpg->twopixelsize[p],
+			      (tpg->scaled_width / 2) * tpg->twopixelsize[p]);
 
 	gen_twopix(tpg, pix, TPG_COLOR_100_BLACK, 0);
 	gen_twopix(tpg, pix, TPG_COLOR_100_BLACK, 1);
-	for (p = 0; p < tpg->planes; p++) {
-		unsigned twopixsize = tpg->twopixelsize[p];
-		u8 *pos = tpg->black_line[p];
-
-		for (x = 0; x < tpg->scaled_width; x += 2, pos += twopixsize)
-			memcpy(pos, pix[p], twopixsize);
-	}
+	for (p = 0; p < tpg->planes; p++)
+		tpg_fill_line(tpg->black_line[p], pix[p],
+			      tpg->twopixelsize[p],
+			      (tpg->scaled_width / 2) * tpg->twopixelsize[p]);
 
 	for (x = 0; x < tpg->scaled_width * 2; x += 2) {
 		gen_twopix(tpg, pix, TPG_COLOR_RANDOM, 0);
@@ -1862,61 +1923,91 @@ static void tpg_precalculate_line(struct tpg_data *tpg)
 	gen_twopix(tpg, tpg->textbg, TPG_COLOR_TEXTBG, 1);
 	gen_twopix(tpg, tpg->textfg, TPG_COLOR_TEXTFG, 0);
 	gen_twopix(tpg, tpg->textfg, TPG_COLOR_TEXTFG, 1);
+
+	/*
+	 * The text colors, pixel format or flipping changed, so any
+	 * pre-rasterized glyphs are stale now.
+	 */
+	for (p = 0; p < TPG_MAX_PLANES; p++)
+		if (tpg->glyph_cached[p])
+			memset(tpg->glyph_cached[p], 0, 256 / 8);
 }
 
 /* need this to do rgb24 rendering */
 typedef struct { u16 __; u8 _; } __packed x24;
 
+/*
+ * Glyphs are rasterized once into tpg->glyphs[] in the native pixel
+ * format of the plane (including horizontal flipping/downsampling) and
+ * blitted with a row-wide memcpy afterwards. The cache is invalidated
+ * by tpg_precalculate_line() whenever the text colors, the pixel format
+ * or the flip setting change, so a frame counter overlay only ever
+ * rasterizes the digits that have not been seen before.
+ */
 #define PRINTSTR(PIXTYPE) do {	\
 	unsigned vdiv = tpg->vdownsampling[p]; \
 	unsigned hdiv = tpg->hdownsampling[p]; \
+	unsigned rowpix = 8 / hdiv; \
+	unsigned rowbytes = rowpix * sizeof(PIXTYPE); \
 	int line;	\
+	unsigned s;	\
 	PIXTYPE fg;	\
 	PIXTYPE bg;	\
 	memcpy(&fg, tpg->textfg[p], sizeof(PIXTYPE));	\
 	memcpy(&bg, tpg->textbg[p], sizeof(PIXTYPE));	\
 	\
-	for (line = first; line < 16; line += vdiv * step) {	\
-		int l = tpg->vflip ? 15 - line : line; \
-		PIXTYPE *pos = (PIXTYPE *)(basep[p][(line / vdiv) & 1] + \
-			       ((y * step + l) / (vdiv * div)) * tpg->bytesperline[p] + \
-			       (x / hdiv) * sizeof(PIXTYPE));	\
-		unsigned s;	\
+	for (s = 0; s < len; s++) {	\
+		u8 c = text[s];	\
+		PIXTYPE *row = (PIXTYPE *)(tpg->glyphs[p] + c * 16 * rowbytes); \
 	\
-		for (s = 0; s < len; s++) {	\
-			u8 chr = font8x16[(u8)text[s] * 16 + line];	\
+		if (tpg->glyph_cached[p][c >> 3] & (1 << (c & 7)))	\
+			continue;	\
+		for (line = 0; line < 16; line++, row += rowpix) {	\
+			u8 chr = font8x16[c * 16 + line];	\
 	\
 			if (hdiv == 2 && tpg->hflip) { \
-				pos[3] = (chr & (0x01 << 6) ? fg : bg);	\
-				pos[2] = (chr & (0x01 << 4) ? fg : bg);	\
-				pos[1] = (chr & (0x01 << 2) ? fg : bg);	\
-				pos[0] = (chr & (0x01 << 0) ? fg : bg);	\
+				row[3] = (chr & (0x01 << 6) ? fg : bg);	\
+				row[2] = (chr & (0x01 << 4) ? fg : bg);	\
+				row[1] = (chr & (0x01 << 2) ? fg : bg);	\
+				row[0] = (chr & (0x01 << 0) ? fg : bg);	\
 			} else if (hdiv == 2) { \
-				pos[0] = (chr & (0x01 << 7) ? fg : bg);	\
-				pos[1] = (chr & (0x01 << 5) ? fg : bg);	\
-				pos[2] = (chr & (0x01 << 3) ? fg : bg);	\
-				pos[3] = (chr & (0x01 << 1) ? fg : bg);	\
+				row[0] = (chr & (0x01 << 7) ? fg : bg);	\
+				row[1] = (chr & (0x01 << 5) ? fg : bg);	\
+				row[2] = (chr & (0x01 << 3) ? fg : bg);	\
+				row[3] = (chr & (0x01 << 1) ? fg : bg);	\
 			} else if (tpg->hflip) { \
-				pos[7] = (chr & (0x01 << 7) ? fg : bg);	\
-				pos[6] = (chr & (0x01 << 6) ? fg : bg);	\
-				pos[5] = (chr & (0x01 << 5) ? fg : bg);	\
-				pos[4] = (chr & (0x01 << 4) ? fg : bg);	\
-				pos[3] = (chr & (0x01 << 3) ? fg : bg);	\
-				pos[2] = (chr & (0x01 << 2) ? fg : bg);	\
-				pos[1] = (chr & (0x01 << 1) ? fg : bg);	\
-				pos[0] = (chr & (0x01 << 0) ? fg : bg);	\
+				row[7] = (chr & (0x01 << 7) ? fg : bg);	\
+				row[6] = (chr & (0x01 << 6) ? fg : bg);	\
+				row[5] = (chr & (0x01 << 5) ? fg : bg);	\
+				row[4] = (chr & (0x01 << 4) ? fg : bg);	\
+				row[3] = (chr & (0x01 << 3) ? fg : bg);	\
+				row[2] = (chr & (0x01 << 2) ? fg : bg);	\
+				row[1] = (chr & (0x01 << 1) ? fg : bg);	\
+				row[0] = (chr & (0x01 << 0) ? fg : bg);	\
 			} else { \
-				pos[0] = (chr & (0x01 << 7) ? fg : bg);	\
-				pos[1] = (chr & (0x01 << 6) ? fg : bg);	\
-				pos[2] = (chr & (0x01 << 5) ? fg : bg);	\
-				pos[3] = (chr & (0x01 << 4) ? fg : bg);	\
-				pos[4] = (chr & (0x01 << 3) ? fg : bg);	\
-				pos[5] = (chr & (0x01 << 2) ? fg : bg);	\
-				pos[6] = (chr & (0x01 << 1) ? fg : bg);	\
-				pos[7] = (chr & (0x01 << 0) ? fg : bg);	\
+				row[0] = (chr & (0x01 << 7) ? fg : bg);	\
+				row[1] = (chr & (0x01 << 6) ? fg : bg);	\
+				row[2] = (chr & (0x01 << 5) ? fg : bg);	\
+				row[3] = (chr & (0x01 << 4) ? fg : bg);	\
+				row[4] = (chr & (0x01 << 3) ? fg : bg);	\
+				row[5] = (chr & (0x01 << 2) ? fg : bg);	\
+				row[6] = (chr & (0x01 << 1) ? fg : bg);	\
+				row[7] = (chr & (0x01 << 0) ? fg : bg);	\
 			} \
+		}	\
+		tpg->glyph_cached[p][c >> 3] |= 1 << (c & 7);	\
+	}	\
 	\
-			pos += (tpg->hflip ? -8 : 8) / (int)hdiv;	\
+	for (line = first; line < 16; line += vdiv * step) {	\
+		int l = tpg->vflip ? 15 - line : line; \
+		u8 *pos = basep[p][(line / vdiv) & 1] + \
+			  ((y * step + l) / (vdiv * div)) * tpg->bytesperline[p] + \
+			  (x / hdiv) * sizeof(PIXTYPE);	\
+	\
+		for (s = 0; s < len; s++) {	\
+			memcpy(pos, tpg->glyphs[p] + \
+			       ((u8)text[s] * 16 + line) * rowbytes, rowbytes); \
+			pos += tpg->hflip ? -(int)rowbytes : (int)rowbytes; \
 		}	\
 	}	\
 } while (0)
@@ -2576,38 +2667,30 @@ static void tpg_fill_plane_pattern(const struct tpg_data *tpg,
 	}
 }
 
-void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
-			   unsigned p, u8 *vbuf)
+static void tpg_fill_plane_lines(struct tpg_data *tpg,
+				 struct tpg_draw_params *params,
+				 unsigned p, u8 *vbuf,
+				 unsigned h_start, unsigned h_end)
 {
-	struct tpg_draw_params params;
 	unsigned factor = V4L2_FIELD_HAS_T_OR_B(tpg->field) ? 2 : 1;
 
-	/* Coarse scaling with Bresenham */
+	/*
+	 * Coarse scaling with Bresenham, seeded so a band can start at any
+	 * line: after <h> steps src_y has advanced by h * int_part plus one
+	 * for every time the error accumulator wrapped.
+	 */
 	unsigned int_part = (tpg->crop.height / factor) / tpg->compose.height;
 	unsigned fract_part = (tpg->crop.height / factor) % tpg->compose.height;
-	unsigned src_y = 0;
-	unsigned error = 0;
+	__u64 turns = (__u64)h_start * fract_part;
+	unsigned src_y = h_start * int_part + turns / tpg->compose.height;
+	unsigned error = turns % tpg->compose.height;
 	unsigned h;
 
-	tpg_recalc(tpg);
-
-	params.is_tv = std;
-	params.is_60hz = std & V4L2_STD_525_60;
-	params.twopixsize = tpg->twopixelsize[p];
-	params.img_width = tpg_hdiv(tpg, p, tpg->compose.width);
-	params.stride = tpg->bytesperline[p];
-	params.hmax = (tpg->compose.height * tpg->perc_fill) / 100;
-
-	tpg_fill_params_pattern(tpg, p, &params);
-	tpg_fill_params_extras(tpg, p, &params);
-
-	vbuf += tpg_hdiv(tpg, p, tpg->compose.left);
-
-	for (h = 0; h < tpg->compose.height; h++) {
+	for (h = h_start; h < h_end; h++) {
 		unsigned buf_line;
 
-		params.frame_line = tpg_calc_frameline(tpg, src_y, tpg->field);
-		params.frame_line_next = params.frame_line;
+		params->frame_line = tpg_calc_frameline(tpg, src_y, tpg->field);
+		params->frame_line_next = params->frame_line;
 		buf_line = tpg_calc_buffer_line(tpg, h, tpg->field);
 		src_y += int_part;
 		error += fract_part;
@@ -2641,22 +2724,137 @@ void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
 				next_src_y += int_part;
 				if (error + fract_part >= tpg->compose.height)
 					next_src_y++;
-				params.frame_line_next =
+				params->frame_line_next =
 					tpg_calc_frameline(tpg, next_src_y, tpg->field);
 			} else {
 				if (h & 1)
 					continue;
-				params.frame_line_next =
+				params->frame_line_next =
 					tpg_calc_frameline(tpg, src_y, tpg->field);
 			}
 
 			buf_line /= tpg->vdownsampling[p];
 		}
-		tpg_fill_plane_pattern(tpg, &params, p, h,
-				vbuf + buf_line * params.stride);
-		tpg_fill_plane_extras(tpg, &params, p, h,
-				vbuf + buf_line * params.stride);
+		tpg_fill_plane_pattern(tpg, params, p, h,
+				vbuf + buf_line * params->stride);
+		tpg_fill_plane_extras(tpg, params, p, h,
+				vbuf + buf_line * params->stride);
+	}
+}
+
+/*
+ * Band-parallel rendering: every line is drawn independently from the
+ * precalculated templates, so the plane can be split into horizontal
+ * bands that are filled by worker threads. This is userspace-only and
+ * brings a 4K pattern switch, which has to redraw every queued buffer,
+ * back within a frame period.
+ */
+struct tpg_band {
+	struct tpg_data *tpg;
+	/* Per-band copy: frame_line/frame_line_next are scratch fields */
+	struct tpg_draw_params params;
+	unsigned p;
+	u8 *vbuf;
+	unsigned h_start;
+	unsigned h_end;
+};
+
+static void *tpg_fill_band_thread(void *arg)
+{
+	struct tpg_band *band = arg;
+
+	tpg_fill_plane_lines(band->tpg, &band->params, band->p, band->vbuf,
+			     band->h_start, band->h_end);
+	return NULL;
+}
+
+#define TPG_MAX_BANDS 4
+
+static unsigned tpg_num_bands(void)
+{
+	static unsigned bands;
+
+	if (!bands) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+		bands = cpus < 1 ? 1 : (cpus > TPG_MAX_BANDS ? TPG_MAX_BANDS : cpus);
 	}
+	return bands;
+}
+
+static bool tpg_fill_plane_bands(struct tpg_data *tpg,
+				 const struct tpg_draw_params *params,
+				 unsigned p, u8 *vbuf)
+{
+	struct tpg_band band[TPG_MAX_BANDS];
+	pthread_t thread[TPG_MAX_BANDS];
+	bool started[TPG_MAX_BANDS];
+	unsigned bands = tpg_num_bands();
+	unsigned h = 0;
+	unsigned i;
+
+	/* Not worth spinning up threads for small frames */
+	if (bands < 2 || tpg->compose.height < 512)
+		return false;
+	/*
+	 * The noise pattern and quality pull from the random generator per
+	 * line, which is neither thread-safe nor reproducible when raced,
+	 * so those stay single threaded.
+	 */
+	if (tpg->pattern == TPG_PAT_NOISE || tpg->qual == TPG_QUAL_NOISE)
+		return false;
+
+	for (i = 0; i < bands; i++) {
+		band[i].tpg = tpg;
+		band[i].params = *params;
+		band[i].p = p;
+		band[i].vbuf = vbuf;
+		/*
+		 * Band boundaries must be a multiple of 4 lines so the
+		 * h & 1 / h & 3 skip logic for vertically downsampled
+		 * planes never straddles two bands.
+		 */
+		band[i].h_start = h;
+		h = (i == bands - 1) ? tpg->compose.height :
+			(tpg->compose.height * (i + 1) / bands) & ~3;
+		band[i].h_end = h;
+	}
+	for (i = 1; i < bands; i++) {
+		started[i] = pthread_create(&thread[i], NULL,
+					    tpg_fill_band_thread, &band[i]) == 0;
+		/* Fall back to filling the band inline */
+		if (!started[i])
+			tpg_fill_band_thread(&band[i]);
+	}
+	tpg_fill_band_thread(&band[0]);
+	for (i = 1; i < bands; i++)
+		if (started[i])
+			pthread_join(thread[i], NULL);
+	return true;
+}
+
+void tpg_fill_plane_buffer(struct tpg_data *tpg, v4l2_std_id std,
+			   unsigned p, u8 *vbuf)
+{
+	struct tpg_draw_params params;
+
+	tpg_recalc(tpg);
+
+	params.is_tv = std;
+	params.is_60hz = std & V4L2_STD_525_60;
+	params.twopixsize = tpg->twopixelsize[p];
+	params.img_width = tpg_hdiv(tpg, p, tpg->compose.width);
+	params.stride = tpg->bytesperline[p];
+	params.hmax = (tpg->compose.height * tpg->perc_fill) / 100;
+
+	tpg_fill_params_pattern(tpg, p, &params);
+	tpg_fill_params_extras(tpg, p, &params);
+
+	vbuf += tpg_hdiv(tpg, p, tpg->compose.left);
+
+	if (!tpg_fill_plane_bands(tpg, &params, p, vbuf))
+		tpg_fill_plane_lines(tpg, &params, p, vbuf,
+				     0, tpg->compose.height);
 }
 
 void tpg_fillbuffer(struct tpg_data *tpg, v4l2_std_id std, unsigned p, u8 *vbuf)
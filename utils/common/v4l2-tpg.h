@@ -283,6 +283,14 @@ struct tpg_data {
 	u8				*random_line[TPG_MAX_PLANES];
 	u8				*contrast_line[TPG_MAX_PLANES];
 	u8				*black_line[TPG_MAX_PLANES];
+	/*
+	 * Glyph cache for tpg_gen_text(): pre-rasterized 8x16 characters in
+	 * the native pixel format of each plane, plus a bitmap tracking
+	 * which glyphs are valid. Both are heap allocated so the cache can
+	 * be filled lazily from the const tpg pointer in tpg_gen_text().
+	 */
+	u8				*glyphs[TPG_MAX_PLANES];
+	u8				*glyph_cached[TPG_MAX_PLANES];
 };
 
 void tpg_init(struct tpg_data *tpg, unsigned w, unsigned h);
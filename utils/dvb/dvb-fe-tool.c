@@ -25,6 +25,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
 #ifdef ENABLE_NLS
@@ -58,6 +59,8 @@ static const struct argp_option options[] = {
 	{"frontend",	'f',	N_("FRONTEND"),	0,	N_("dvb frontend"), 0},
 	{"set-delsys",	'd',	N_("PARAMS"),	0,	N_("set delivery system"), 0},
 	{"femon",	'm',	0,		0,	N_("monitors frontend stats on an streaming frontend"), 0},
+	{"interval",	'i',	N_("MS"),	0,	N_("femon sampling period, in ms (default 1000)"), 0},
+	{"csv",		'C',	0,		0,	N_("femon: emit one CSV snapshot per sample instead of status lines on changes"), 0},
 	{"acoustical",	'A',	0,		0,	N_("beeps if signal quality is good. Also enables femon mode. Please notice that console beep should be enabled on your wm."), 0},
 #if 0 /* Currently not implemented */
 	{"set",		's',	N_("PARAMS"),	0,	N_("set frontend"), 0},
@@ -86,6 +89,8 @@ static int acoustical = 0;
 static int timeout_flag = 0;
 static int device_mon = 0;
 static int count = 0;
+static int interval = 1000;
+static int csv = 0;
 
 static void do_timeout(int x)
 {
@@ -153,6 +158,14 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 	case 'c':
 		count = atoi(arg);
 		break;
+	case 'i':
+		interval = atoi(arg);
+		if (interval <= 0)
+			return ARGP_ERR_UNKNOWN;
+		break;
+	case 'C':
+		csv++;
+		break;
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -181,13 +194,7 @@ static int print_frontend_stats(FILE *fd,
 				struct dvb_v5_fe_parms *parms)
 {
 	char buf[512], *p;
-	int rc, i, len, show, n_status_lines = 0;
-
-	rc = dvb_fe_get_stats(parms);
-	if (rc) {
-		ERROR(_("dvb_fe_get_stats failed"));
-		return -1;
-	}
+	int i, len, show, n_status_lines = 0;
 
 	p = buf;
 	len = sizeof(buf);
@@ -274,22 +281,119 @@ static int print_frontend_stats(FILE *fd,
 	return 0;
 }
 
-static void get_show_stats(struct dvb_v5_fe_parms *parms)
+/*
+ * Binary sample history kept by the femon monitor. Samples are cheap to
+ * store (no formatting), so the ring can be filled at a high rate and
+ * only the interesting parts are ever printed: on a lock loss, the
+ * samples leading up to it are dumped for post-mortem inspection.
+ */
+struct fe_hist_sample {
+	struct timespec ts;
+	fe_status_t status;
+	enum dvb_quality quality;
+	uint32_t strength;
+	uint32_t cnr;
+	uint32_t ucb;
+	float ber;
+	float per;
+};
+
+#define FE_HIST_SIZE 4096
+
+static struct fe_hist_sample fe_hist[FE_HIST_SIZE];
+static unsigned fe_hist_next, fe_hist_len;
+static struct timespec fe_hist_start;
+
+static void femon_print_csv(FILE *fd, const struct fe_hist_sample *s)
 {
-	int rc;
+	long long ms = (s->ts.tv_sec - fe_hist_start.tv_sec) * 1000ll +
+		       (s->ts.tv_nsec - fe_hist_start.tv_nsec) / 1000000;
+
+	fprintf(fd, "%lld.%03lld,0x%02x,%d,%u,%u,%u,%.2e,%.2e\n",
+		ms / 1000, ms % 1000, s->status, s->quality,
+		s->strength, s->cnr, s->ucb, s->ber, s->per);
+}
+
+static void femon_dump_hist(FILE *fd, unsigned n_samples)
+{
+	unsigned i, pos;
+
+	if (n_samples > fe_hist_len)
+		n_samples = fe_hist_len;
 
+	fprintf(fd, _("time,status,quality,signal,cnr,ucb,ber,per\n"));
+	pos = (fe_hist_next + FE_HIST_SIZE - n_samples) % FE_HIST_SIZE;
+	for (i = 0; i < n_samples; i++) {
+		femon_print_csv(fd, &fe_hist[pos]);
+		pos = (pos + 1) % FE_HIST_SIZE;
+	}
+}
+
+static int femon_cb(struct dvb_v5_fe_parms *parms, fe_status_t status,
+		    void *user_priv)
+{
+	struct fe_hist_sample *s = &fe_hist[fe_hist_next];
+	const struct fe_hist_sample *prev = NULL;
+	enum fecap_scale_params scale;
+
+	if (timeout_flag)
+		return 1;
+
+	if (fe_hist_len)
+		prev = &fe_hist[(fe_hist_next + FE_HIST_SIZE - 1) % FE_HIST_SIZE];
+	else
+		clock_gettime(CLOCK_MONOTONIC, &fe_hist_start);
+
+	clock_gettime(CLOCK_MONOTONIC, &s->ts);
+	s->status = status;
+	s->quality = dvb_fe_retrieve_quality(parms, 0);
+	if (dvb_fe_retrieve_stats(parms, DTV_STAT_SIGNAL_STRENGTH, &s->strength))
+		s->strength = 0;
+	if (dvb_fe_retrieve_stats(parms, DTV_STAT_CNR, &s->cnr))
+		s->cnr = 0;
+	if (dvb_fe_retrieve_stats(parms, DTV_STAT_ERROR_BLOCK_COUNT, &s->ucb))
+		s->ucb = 0;
+	s->ber = dvb_fe_retrieve_ber(parms, 0, &scale);
+	if (scale == FE_SCALE_NOT_AVAILABLE)
+		s->ber = 0;
+	s->per = dvb_fe_retrieve_per(parms, 0);
+	if (s->per < 0)
+		s->per = 0;
+
+	fe_hist_next = (fe_hist_next + 1) % FE_HIST_SIZE;
+	if (fe_hist_len < FE_HIST_SIZE)
+		fe_hist_len++;
+
+	if (csv) {
+		femon_print_csv(stdout, s);
+	} else if (!prev || prev->status != status ||
+		   prev->quality != s->quality) {
+		/*
+		 * A lock just dropped: dump the last couple of seconds
+		 * of history, so the decay can be inspected even when
+		 * sampling much faster than it could be printed.
+		 */
+		if (prev && (prev->status & FE_HAS_LOCK) &&
+		    !(status & FE_HAS_LOCK))
+			femon_dump_hist(stderr, 2000 / interval + 1);
+		print_frontend_stats(stderr, parms);
+	}
+
+	if (count > 0 && !--count)
+		return 1;
+
+	return 0;
+}
+
+static void get_show_stats(struct dvb_v5_fe_parms *parms)
+{
 	signal(SIGTERM, do_timeout);
 	signal(SIGINT, do_timeout);
 
-	do {
-		rc = dvb_fe_get_stats(parms);
-		if (!rc)
-			print_frontend_stats(stderr, parms);
-		if (count > 0 && !--count)
-			break;
-		if (!timeout_flag)
-			usleep(1000000);
-	} while (!timeout_flag);
+	if (csv)
+		fprintf(stdout, _("time,status,quality,signal,cnr,ucb,ber,per\n"));
+
+	dvb_fe_monitor(parms, femon_cb, NULL, interval);
 }
 
 static const char * const event_type[] = {
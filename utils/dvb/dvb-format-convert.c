@@ -101,22 +101,18 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 
 static int convert_file(struct arguments *args)
 {
-	struct dvb_file *dvb_file = NULL;
 	int ret;
 
-	printf(_("Reading file %s\n"), args->input_file);
+	printf(_("Converting %s into %s\n"), args->input_file,
+	       args->output_file);
 
-	dvb_file = dvb_read_file_format(args->input_file, args->delsys,
-				    args->input_format);
-	if (!dvb_file) {
-		fprintf(stderr, _("Error reading file %s\n"), args->input_file);
-		return -1;
-	}
-
-	printf(_("Writing file %s\n"), args->output_file);
-	ret = dvb_write_file_format(args->output_file, dvb_file,
-				    args->delsys, args->output_format);
-	dvb_file_free(dvb_file);
+	ret = dvb_convert_file_format(args->input_file, args->delsys,
+				      args->input_format,
+				      args->output_file, args->delsys,
+				      args->output_format);
+	if (ret)
+		fprintf(stderr, _("Error converting file %s\n"),
+			args->input_file);
 
 	return ret;
 }
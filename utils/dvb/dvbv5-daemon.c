@@ -36,6 +36,8 @@
 #include <netinet/in.h>
 #include <poll.h>
 #include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
 #include <search.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -54,6 +56,7 @@
 #include "../../lib/libdvbv5/dvb-dev-priv.h"
 #include "libdvbv5/dvb-file.h"
 #include "libdvbv5/dvb-dev.h"
+#include "libdvbv5/dvb-demux.h"
 
 #ifdef ENABLE_NLS
 # define _(string) gettext(string)
@@ -204,13 +207,14 @@ static pthread_t read_id = 0;
 struct dvb_descriptors {
 	int uid;
 	struct dvb_open_descriptor *open_dev;
+	struct dvb_dmx_ring *ring;
 };
 
 static struct dvb_device *dvb = NULL;
 static void *desc_root = NULL;
 static int dvb_fd = -1;
 
-static struct pollfd fds[NUM_FOPEN];
+static int epoll_fd = -1;
 static nfds_t numfds = 0;
 
 static char output_charset[256] = "utf-8";
@@ -248,7 +252,7 @@ static int dvb_desc_compare(const void *__a, const void *__b)
 	return (b->uid - a->uid);
 }
 
-static struct dvb_open_descriptor *get_open_dev(int uid)
+static struct dvb_descriptors *get_desc(int uid)
 {
 	struct dvb_descriptors desc, **p;
 
@@ -263,7 +267,14 @@ static struct dvb_open_descriptor *get_open_dev(int uid)
 		return NULL;
 	}
 
-	return (*p)->open_dev;
+	return *p;
+}
+
+static struct dvb_open_descriptor *get_open_dev(int uid)
+{
+	struct dvb_descriptors *desc = get_desc(uid);
+
+	return desc ? desc->open_dev : NULL;
 }
 
 static void destroy_open_dev(int uid)
@@ -283,6 +294,7 @@ static void free_opendevs(void *node)
 	if (verbose)
 		dbg("closing dev %p", desc, desc->open_dev);
 
+	dvb_dmx_ring_close(desc->ring);
 	dvb_dev_close(desc->open_dev);
 	free (desc);
 }
@@ -291,6 +303,10 @@ static void close_all_devs(void)
 {
 	dvb_fd = -1;
 	numfds = 0;
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
 	tdestroy(desc_root, free_opendevs);
 
 	desc_root = NULL;
@@ -457,6 +473,68 @@ static int send_buf(int fd, const char *buf, size_t size)
 	return ret;
 }
 
+/*
+ * Like send_buf(), but gathers the message from several buffers, so the
+ * demux payload can be sent straight from the borrowed kernel ring
+ * buffer instead of being copied behind a prepared header first.
+ */
+static int send_buf_iov(int fd, const struct iovec *iov, int n)
+{
+	struct iovec msg_iov[3];
+	struct msghdr msg = {};
+	size_t left = 0;
+	int ret, i;
+	int32_t i32;
+
+	if (fd < 0)
+		return ECONNRESET;
+	if (n + 1 > (int)(sizeof(msg_iov) / sizeof(msg_iov[0])))
+		return EINVAL;
+
+	for (i = 0; i < n; i++)
+		left += iov[i].iov_len;
+	i32 = htobe32(left);
+	left += 4;
+
+	msg_iov[0].iov_base = &i32;
+	msg_iov[0].iov_len = 4;
+	memcpy(&msg_iov[1], iov, n * sizeof(*iov));
+	msg.msg_iov = msg_iov;
+	msg.msg_iovlen = n + 1;
+
+	pthread_mutex_lock(&msg_mutex);
+	while (left) {
+		ret = sendmsg(fd, &msg, 0);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		left -= ret;
+		while (ret) {
+			if ((size_t)ret < msg.msg_iov->iov_len) {
+				msg.msg_iov->iov_base =
+					(char *)msg.msg_iov->iov_base + ret;
+				msg.msg_iov->iov_len -= ret;
+				break;
+			}
+			ret -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+	}
+	pthread_mutex_unlock(&msg_mutex);
+	if (left) {
+		local_perror("write");
+		if (errno == ECONNRESET)
+			close_all_devs();
+
+		return errno;
+	}
+
+	return 0;
+}
+
 static ssize_t send_data(int fd, const char *fmt, ...)
 	__attribute__ (( format( printf, 2, 3 )));
 
@@ -673,104 +751,100 @@ error:
 
 static void *read_data(void *privdata)
 {
-	struct dvb_open_descriptor *open_dev;
-	int timeout;
-	int ret, read_ret = -1, fd, i;
+	struct epoll_event events[NUM_FOPEN];
+	struct dvb_descriptors *desc;
 	char databuf[REMOTE_BUF_SIZE];
-	char buf[REMOTE_BUF_SIZE + 32], *p;
-	size_t size;
-	size_t count;
-	struct pollfd __fds[NUM_FOPEN];
-	nfds_t __numfds;
+	char hdr[64];
+	int ret, nev, i, efd;
 
-	timeout = 10; /* ms */
 	while (1) {
 		pthread_mutex_lock(&dvb_read_mutex);
-		if (!numfds) {
+		if (!numfds || epoll_fd < 0) {
 			pthread_mutex_unlock(&dvb_read_mutex);
 			break;
 		}
-		__numfds = numfds;
-		memcpy(__fds, fds, sizeof(fds));
+		efd = epoll_fd;
 		pthread_mutex_unlock(&dvb_read_mutex);
 
-		ret = poll(__fds, __numfds, timeout);
-		if (!ret)
-			continue;
-		if (ret < 0) {
-			err("poll");
+		/* Finite timeout only to notice when numfds drops to 0 */
+		nev = epoll_wait(efd, events, NUM_FOPEN, 100);
+		if (nev < 0) {
+			if (errno != EINTR && errno != EBADF)
+				err("epoll_wait");
 			continue;
 		}
 
-		for (i = 0; i < __numfds; i++) {
-			if (__fds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
-				continue;
-			if (__fds[i].revents)
-				break;
-		}
-
-		/*
-		 * it means that one error condition happened.
-		 * Likely the file was closed.
-		 */
-		if (i == __numfds)
-			continue;
+		for (i = 0; i < nev; i++) {
+			struct dvb_dmx_buf dbuf = {};
+			struct iovec iov[2];
+			int fd = events[i].data.fd, read_ret, n;
 
-		fd = __fds[i].fd;
-
-		if (!desc_root)
-			break;
-
-		open_dev = get_open_dev(fd);
-		if (!open_dev) {
-			err("Couldn't find opened file %d", fd);
-			continue;
-		}
+			if (events[i].events & (EPOLLERR | EPOLLHUP))
+				continue;
 
-		count = REMOTE_BUF_SIZE;
-		read_ret = dvb_dev_read(open_dev, databuf, count);
-		if (verbose) {
-			if (read_ret < 0)
-				dbg("#%d: read error: %d on %p", fd, read_ret, open_dev);
-			else
-				dbg("#%d: read %ul bytes (count %d)", fd, read_ret, count);
-		}
+			if (!desc_root)
+				break;
 
-		/* Initialize to the start of the buffer */
-		p = buf;
-		size = sizeof(buf);
+			desc = get_desc(fd);
+			if (!desc) {
+				err("Couldn't find opened file %d", fd);
+				continue;
+			}
 
-		ret = prepare_data(p, size, "%i%s%i%i", 0, "data_read",
-				   read_ret, fd);
-		if (ret < 0) {
-			err("Failed to prepare answer to dvb_read()");
-			break;
-		}
+			/*
+			 * Borrow the data straight from the kernel demux
+			 * ring; it is only given back after it was sent,
+			 * so it never goes through a local copy.
+			 */
+			if (desc->ring) {
+				if (!dvb_dmx_ring_get(desc->ring, &dbuf)) {
+					read_ret = dbuf.size;
+				} else {
+					read_ret = -errno;
+					dbuf.data = NULL;
+				}
+			} else {
+				read_ret = dvb_dev_read(desc->open_dev,
+						databuf, REMOTE_BUF_SIZE);
+			}
+			if (verbose) {
+				if (read_ret < 0)
+					dbg("#%d: read error: %d on %p", fd,
+					    read_ret, desc->open_dev);
+				else
+					dbg("#%d: read %d bytes", fd, read_ret);
+			}
 
-		p += ret;
-		size -= ret;
+			ret = prepare_data(hdr, sizeof(hdr), "%i%s%i%i", 0,
+					   "data_read", read_ret, fd);
+			if (ret < 0) {
+				err("Failed to prepare answer to dvb_read()");
+				if (dbuf.data && desc->ring)
+					dvb_dmx_ring_put(desc->ring, &dbuf);
+				goto leave;
+			}
 
-		if (read_ret > 0) {
-			if (read_ret > size) {
-				dbg("buffer to short to store read data!");
-				read_ret = -EOVERFLOW;
-			} else {
-				memcpy(p, databuf, read_ret);
-				p += read_ret;
+			iov[0].iov_base = hdr;
+			iov[0].iov_len = ret;
+			n = 1;
+			if (read_ret > 0) {
+				iov[1].iov_base = desc->ring ?
+					(void *)dbuf.data : databuf;
+				iov[1].iov_len = read_ret;
+				n = 2;
 			}
-		}
 
-		ret = send_buf(dvb_fd, buf, p - buf);
-		if (ret < 0) {
-			err("Error %d sending buffer\n", ret);
-			if (ret == ECONNRESET) {
-				close_all_devs();
-				break;
+			ret = send_buf_iov(dvb_fd, iov, n);
+			if (dbuf.data && desc->ring)
+				dvb_dmx_ring_put(desc->ring, &dbuf);
+			if (ret) {
+				err("Error %d sending buffer\n", ret);
+				if (ret == ECONNRESET)
+					goto leave;
 			}
-			continue;
 		}
 	}
-
+leave:
 	dbg("Finishing kthread");
 	read_id = 0;
 	return NULL;
@@ -817,10 +891,23 @@ static int dev_open(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 	dev = open_dev->dev;
 	if (dev->dvb_type == DVB_DEVICE_DEMUX ||
 	    dev->dvb_type == DVB_DEVICE_DVR) {
+		struct epoll_event ev = {
+			.events = EPOLLIN | EPOLLPRI,
+		};
+
+		/* Zero-copy kernel ring; falls back to read() internally */
+		desc->ring = dvb_dmx_ring_open(open_dev->fd, 8,
+					       REMOTE_BUF_SIZE);
+
+		ev.data.fd = open_dev->fd;
 		pthread_mutex_lock(&dvb_read_mutex);
-		fds[numfds].fd = open_dev->fd;
-		fds[numfds].events = POLLIN | POLLPRI;
-		numfds++;
+		if (epoll_fd < 0)
+			epoll_fd = epoll_create1(0);
+		if (epoll_fd < 0 ||
+		    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, open_dev->fd, &ev))
+			local_perror("epoll_ctl");
+		else
+			numfds++;
 		pthread_mutex_unlock(&dvb_read_mutex);
 	}
 
@@ -859,36 +946,33 @@ error:
 static int dev_close(uint32_t seq, char *cmd, int fd, char *buf, ssize_t size)
 {
 	struct dvb_open_descriptor *open_dev;
-	int uid, ret, i;
+	struct dvb_descriptors *desc;
+	int uid, ret;
 
 	ret = scan_data(buf, size, "%i",  &uid);
 	if (ret < 0)
 		goto error;
 
-	open_dev = get_open_dev(uid);
-	if (!open_dev) {
+	desc = get_desc(uid);
+	if (!desc) {
 		err("Can't find uid to close");
 		ret = -1;
 		goto error;
 	}
+	open_dev = desc->open_dev;
 
-	/* Delete fd from the opened array */
+	/* Stop watching the fd before anything is torn down */
 	pthread_mutex_lock(&dvb_read_mutex);
-	for (i = 0; i < numfds; i++) {
-		if (fds[i].fd != open_dev->fd)
-		    continue;
-		if (i < numfds - 1)
-			memmove(&fds[i], &fds[i + 1],
-				sizeof(*fds)*(numfds - i - 1));
+	if (epoll_fd >= 0 &&
+	    !epoll_ctl(epoll_fd, EPOLL_CTL_DEL, open_dev->fd, NULL))
 		numfds--;
-		break;
-	}
 	pthread_mutex_unlock(&dvb_read_mutex);
 	if (read_id && !numfds) {
 		pthread_cancel(read_id);
 		read_id = 0;
 	}
 
+	dvb_dmx_ring_close(desc->ring);
 	dvb_dev_close(open_dev);
 	destroy_open_dev(uid);
 
@@ -28,6 +28,7 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/time.h>
+#include <time.h>
 #include <argp.h>
 
 #include <config.h>
@@ -51,6 +52,8 @@
 #include "libdvbv5/dvb-v5-std.h"
 #include "libdvbv5/dvb-scan.h"
 #include "libdvbv5/countries.h"
+#include "libdvbv5/pat.h"
+#include "libdvbv5/crc32.h"
 
 #define PROGRAM_NAME	"dvbv5-scan"
 #define DEFAULT_OUTPUT  "dvb_channel.conf"
@@ -66,6 +69,8 @@ struct arguments {
 	unsigned other_nit;
 	enum dvb_file_formats input_format, output_format;
 	const char *cc;
+	char *store_name;
+	unsigned resume, store_freshness;
 
 	/* Used by status print */
 	unsigned n_status_lines;
@@ -90,6 +95,9 @@ static const struct argp_option options[] = {
 	{"input-format", 'I',	N_("format"),		0, N_("Input format: CHANNEL, DVBV5 (default: DVBV5)"), 0},
 	{"output-format", 'O',	N_("format"),		0, N_("Output format: VDR, CHANNEL, ZAP, DVBV5 (default: DVBV5)"), 0},
 	{"cc",		'C',	N_("country_code"),	0, N_("Set the default country to be used (in ISO 3166-1 two letter code)"), 0},
+	{"store",	's',	N_("file"),		0, N_("append per-transponder scan results to 'file'"), 0},
+	{"resume",	'r',	NULL,			0, N_("skip transponders recently confirmed in the store (see --store and --freshness)"), 0},
+	{"freshness",	'A',	N_("seconds"),		0, N_("maximum age of a store entry for --resume to skip its transponder (default: 86400)"), 0},
 	{"help",        '?',	0,		0,	N_("Give this help list"), -1},
 	{"usage",	-3,	0,		0,	N_("Give a short usage message")},
 	{"version",	'V',	0,		0,	N_("Print program version"), -1},
@@ -182,6 +190,105 @@ static int print_frontend_stats(struct arguments *args,
 	return 0;
 }
 
+/*
+ * Append-only store with one line per scanned transponder, so that an
+ * interrupted or routinely repeated scan (drive tests) can skip the
+ * transponders it recently confirmed and only redo the delta. A
+ * transponder is keyed by delivery system, frequency, polarization and
+ * stream id; re-scans append a fresh line and the newest line wins, so
+ * the file is never rewritten. The tables crc covers the PAT program
+ * list, enough to tell whether the mux changed its service lineup
+ * between two confirmed scans.
+ *
+ * Format, one line each: "v1 delsys freq pol stream_id lock crc time"
+ */
+struct scan_store_entry {
+	uint32_t delsys, freq, pol, stream_id;
+	int lock;
+	uint32_t tables_crc;
+	long long when;
+	struct scan_store_entry *next;
+};
+
+static struct scan_store_entry *scan_store_load(const char *fname)
+{
+	struct scan_store_entry e, *list = NULL, *new;
+	FILE *f;
+
+	f = fopen(fname, "r");
+	if (!f)		/* First run: no store yet */
+		return NULL;
+
+	/* Prepend each line, so the head is always the newest result */
+	while (fscanf(f, "v1 %u %u %u %u %d %x %lld ",
+		      &e.delsys, &e.freq, &e.pol, &e.stream_id,
+		      &e.lock, &e.tables_crc, &e.when) == 7) {
+		new = malloc(sizeof(*new));
+		if (!new)
+			break;
+		*new = e;
+		new->next = list;
+		list = new;
+	}
+	fclose(f);
+	return list;
+}
+
+static void scan_store_free(struct scan_store_entry *list)
+{
+	struct scan_store_entry *next;
+
+	for (; list; list = next) {
+		next = list->next;
+		free(list);
+	}
+}
+
+static struct scan_store_entry *scan_store_get(struct scan_store_entry *list,
+					       uint32_t delsys, uint32_t freq,
+					       uint32_t pol, uint32_t stream_id)
+{
+	for (; list; list = list->next)
+		if (list->delsys == delsys && list->freq == freq &&
+		    list->pol == pol && list->stream_id == stream_id)
+			return list;
+	return NULL;
+}
+
+static void scan_store_append(const char *fname, uint32_t delsys,
+			      uint32_t freq, uint32_t pol, uint32_t stream_id,
+			      int lock, uint32_t tables_crc)
+{
+	FILE *f;
+
+	f = fopen(fname, "a");
+	if (!f) {
+		PERROR(_("can't append to scan store '%s'"), fname);
+		return;
+	}
+	fprintf(f, "v1 %u %u %u %u %d %x %lld\n", delsys, freq, pol,
+		stream_id, lock, tables_crc, (long long)time(NULL));
+	fclose(f);
+}
+
+static uint32_t scan_tables_crc(struct dvb_v5_descriptors *dvb_scan_handler)
+{
+	uint32_t crc = 0xffffffff;
+
+	if (!dvb_scan_handler || !dvb_scan_handler->pat)
+		return 0;
+
+	dvb_pat_program_foreach(pgm, dvb_scan_handler->pat) {
+		uint8_t buf[4] = {
+			pgm->service_id >> 8, pgm->service_id & 0xff,
+			pgm->pid >> 8, pgm->pid & 0xff,
+		};
+
+		crc = dvb_crc32(buf, sizeof(buf), crc);
+	}
+	return crc;
+}
+
 static int check_frontend(void *__args,
 			  struct dvb_v5_fe_parms *parms)
 {
@@ -219,10 +326,14 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 	struct dvb_file *dvb_file = NULL, *dvb_file_new = NULL;
 	struct dvb_entry *entry;
 	struct dvb_open_descriptor *dmx_fd;
+	struct scan_store_entry *store = NULL;
 	int count = 0, shift;
 	uint32_t freq, sys;
 	enum dvb_sat_polarization pol;
 
+	if (args->store_name && args->resume)
+		store = scan_store_load(args->store_name);
+
 	/* This is used only when reading old formats */
 	switch (parms->current_sys) {
 	case SYS_DVBT:
@@ -259,7 +370,7 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 
 	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
 		struct dvb_v5_descriptors *dvb_scan_handler = NULL;
-		uint32_t stream_id;
+		uint32_t stream_id, delsys;
 
 		/*
 		 * If the channel file has duplicated frequencies, or some
@@ -279,7 +390,26 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 						  freq, shift, pol, stream_id))
 			continue;
 
+		if (dvb_retrieve_entry_prop(entry, DTV_DELIVERY_SYSTEM, &delsys))
+			delsys = parms->current_sys;
+
 		count++;
+
+		/* Skip transponders the store confirmed recently enough */
+		if (store) {
+			struct scan_store_entry *prev;
+
+			prev = scan_store_get(store, delsys, freq, pol,
+					      stream_id);
+			if (prev && prev->lock && prev->when +
+			    args->store_freshness >= (long long)time(NULL)) {
+				dvb_log(_("Skipping frequency #%d %d, confirmed %lld minutes ago"),
+					count, freq,
+					((long long)time(NULL) - prev->when) / 60);
+				continue;
+			}
+		}
+
 		dvb_log(_("Scanning frequency #%d %d"), count, freq);
 
 		/*
@@ -304,6 +434,13 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 			dvb_scan_free_handler_table(dvb_scan_handler);
 			break;
 		}
+
+		/* Record the result, locked or not, newest line last */
+		if (args->store_name)
+			scan_store_append(args->store_name, delsys, freq, pol,
+					  stream_id, dvb_scan_handler != NULL,
+					  scan_tables_crc(dvb_scan_handler));
+
 		if (!dvb_scan_handler)
 			continue;
 
@@ -335,6 +472,7 @@ static int run_scan(struct arguments *args, struct dvb_device *dvb)
 	if (dvb_file_new)
 		dvb_file_free(dvb_file_new);
 
+	scan_store_free(store);
 	dvb_dev_close(dmx_fd);
 	return 0;
 }
@@ -414,6 +552,15 @@ static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 	case 'C':
 		args->cc = strndup(optarg, 2);
 		break;
+	case 's':
+		args->store_name = optarg;
+		break;
+	case 'r':
+		args->resume++;
+		break;
+	case 'A':
+		args->store_freshness = strtoul(optarg, NULL, 0);
+		break;
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -476,6 +623,7 @@ int main(int argc, char **argv)
 	args.timeout_multiply = 1;
 	args.adapter = (unsigned)-1;
 	args.lna = LNA_AUTO;
+	args.store_freshness = 86400;
 
 	if (argp_parse(&argp, argc, argv, ARGP_NO_HELP | ARGP_NO_EXIT, &idx, &args)) {
 		argp_help(&argp, stderr, ARGP_HELP_SHORT_USAGE, PROGRAM_NAME);
@@ -509,6 +657,11 @@ int main(int argc, char **argv)
 		argp_help(&argp, stderr, ARGP_HELP_STD_HELP, PROGRAM_NAME);
 		return -1;
 	}
+	if (args.resume && !args.store_name) {
+		fprintf(stderr, _("ERROR: --resume requires --store\n"));
+		argp_help(&argp, stderr, ARGP_HELP_STD_HELP, PROGRAM_NAME);
+		return -1;
+	}
 	if ((args.input_format == FILE_ZAP) ||
 		   (args.input_format == FILE_UNKNOWN) ||
 		   (args.output_format == FILE_UNKNOWN)) {
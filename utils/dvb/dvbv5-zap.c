@@ -38,6 +38,16 @@
  */
 #define BUFLEN (188 * 512)
 
+/*
+ * Size of the record ring buffer between the dvr reader and the disk
+ * writer thread. Needs to absorb multi-second disk stalls at high
+ * bitrates without overflowing the (much smaller) in-kernel DVR
+ * buffer, so make it several seconds worth of a fat DVB-S2 mux.
+ * Kept a multiple of BUFLEN so whole reads are dropped when full,
+ * which keeps the output aligned to TS packets.
+ */
+#define DVB_RING_SIZE (348 * BUFLEN)	/* ~32 MB */
+
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -48,6 +58,7 @@
 #include <argp.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <config.h>
 
@@ -551,13 +562,155 @@ static struct timespec *elapsed_time(struct timespec *start)
 	return &elapsed;
 }
 
+/*
+ * Record ring between the dvr reader and the writer thread. The reader
+ * never blocks on disk: when the ring is full the freshly read chunk is
+ * dropped and accounted, so a stalled disk costs those packets instead
+ * of overflowing the kernel DVR buffer and corrupting the whole stream.
+ */
+struct record_ring {
+	unsigned char *buf;
+	size_t size;
+
+	/* Guarded by lock */
+	size_t head, tail, used;
+	unsigned long long dropped;	/* bytes dropped on ring full */
+	unsigned int stalls;		/* reads dropped on ring full */
+	int eof;
+	int error;			/* errno from a failed write */
+
+	int out_fd;
+	pthread_mutex_t lock;
+	pthread_cond_t data;
+	pthread_t thread;
+};
+
+static void *record_writer_thread(void *arg)
+{
+	struct record_ring *ring = arg;
+
+	pthread_mutex_lock(&ring->lock);
+	while (1) {
+		unsigned char *p;
+		size_t chunk;
+		ssize_t r;
+
+		if (!ring->used) {
+			if (ring->eof)
+				break;
+			pthread_cond_wait(&ring->data, &ring->lock);
+			continue;
+		}
+
+		/* Largest contiguous chunk, drained outside the lock */
+		chunk = ring->size - ring->tail;
+		if (chunk > ring->used)
+			chunk = ring->used;
+		p = ring->buf + ring->tail;
+		pthread_mutex_unlock(&ring->lock);
+
+		while (chunk) {
+			r = write(ring->out_fd, p, chunk);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				pthread_mutex_lock(&ring->lock);
+				ring->error = errno;
+				goto leave;
+			}
+			p += r;
+			chunk -= r;
+		}
+
+		pthread_mutex_lock(&ring->lock);
+		chunk = p - (ring->buf + ring->tail);
+		ring->tail = (ring->tail + chunk) % ring->size;
+		ring->used -= chunk;
+	}
+leave:
+	pthread_mutex_unlock(&ring->lock);
+	return NULL;
+}
+
+static int record_ring_start(struct record_ring *ring, int out_fd)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->size = DVB_RING_SIZE;
+	ring->buf = malloc(ring->size);
+	if (!ring->buf)
+		return -1;
+	ring->out_fd = out_fd;
+	pthread_mutex_init(&ring->lock, NULL);
+	pthread_cond_init(&ring->data, NULL);
+	if (pthread_create(&ring->thread, NULL, record_writer_thread, ring)) {
+		free(ring->buf);
+		ring->buf = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+/* Returns the writer's errno if a write failed, 0 otherwise */
+static int record_ring_put(struct record_ring *ring, const unsigned char *buf,
+			   size_t len)
+{
+	int error;
+
+	pthread_mutex_lock(&ring->lock);
+	error = ring->error;
+	if (!error) {
+		if (ring->used + len > ring->size) {
+			ring->dropped += len;
+			ring->stalls++;
+		} else {
+			size_t chunk = ring->size - ring->head;
+
+			if (chunk > len)
+				chunk = len;
+			memcpy(ring->buf + ring->head, buf, chunk);
+			if (len > chunk)
+				memcpy(ring->buf, buf + chunk, len - chunk);
+			ring->head = (ring->head + len) % ring->size;
+			ring->used += len;
+			pthread_cond_signal(&ring->data);
+		}
+	}
+	pthread_mutex_unlock(&ring->lock);
+	return error;
+}
+
+/* Flushes whatever the writer managed to take, reports drops */
+static void record_ring_stop(struct record_ring *ring, int silent)
+{
+	pthread_mutex_lock(&ring->lock);
+	ring->eof = 1;
+	pthread_cond_signal(&ring->data);
+	pthread_mutex_unlock(&ring->lock);
+	pthread_join(ring->thread, NULL);
+
+	if (silent < 2 && ring->dropped)
+		fprintf(stderr, _("dropped %llu bytes (%llu packets) in %u disk stalls\n"),
+			ring->dropped, ring->dropped / 188, ring->stalls);
+
+	pthread_cond_destroy(&ring->data);
+	pthread_mutex_destroy(&ring->lock);
+	free(ring->buf);
+	ring->buf = NULL;
+}
+
 static void copy_to_file(struct dvb_open_descriptor *in_fd, int out_fd,
 			 int timeout, int silent)
 {
 	char buf[BUFLEN];
-	int r, first = 1;
+	int r, err, first = 1;
 	long long int rc = 0LL;
 	struct timespec start, *elapsed;
+	struct record_ring ring;
+
+	if (record_ring_start(&ring, out_fd)) {
+		ERROR("Cannot start the record writer thread");
+		return;
+	}
 
 	/* Initialize start time, due to -EOVERFLOW with first == 1 */
 	clock_gettime(CLOCK_MONOTONIC, &start);
@@ -596,13 +749,16 @@ static void copy_to_file(struct dvb_open_descriptor *in_fd, int out_fd,
 			first = 0;
 		}
 
-		if (write(out_fd, buf, r) < 0) {
+		err = record_ring_put(&ring, (unsigned char *)buf, r);
+		if (err) {
+			errno = err;
 			PERROR(_("Write failed"));
 			break;
 		}
 
 		rc += r;
 	}
+	record_ring_stop(&ring, silent);
 	if (silent < 2) {
 		if (timeout)
 			fprintf(stderr, _("received %lld bytes (%lld Kbytes/sec)\n"), rc,
@@ -612,6 +768,247 @@ static void copy_to_file(struct dvb_open_descriptor *in_fd, int out_fd,
 	}
 }
 
+/*
+ * Multi-service recording: several services of the same transponder
+ * share one frontend tune, one demux and one dvr read loop, and get
+ * demultiplexed by PID into one output file per service, instead of
+ * running one dvbv5-zap with a full duplicated DVR stream per service.
+ */
+#define ZAP_MAX_SERVICES	8
+#define ZAP_MAX_FILTERS		64
+
+struct service_rec {
+	const char *channel;
+	const struct dvb_entry *entry;
+	unsigned char pidmap[0x2000 / 8];
+	int fd;
+	struct record_ring ring;
+	long long int rc;
+};
+
+static void service_set_pid(struct service_rec *svc, int pid)
+{
+	svc->pidmap[pid >> 3] |= 1 << (pid & 7);
+}
+
+static int service_has_pid(struct service_rec *svc, int pid)
+{
+	return svc->pidmap[pid >> 3] & (1 << (pid & 7));
+}
+
+/* Same seek logic as parse(), for the 2nd..nth channel of a recording */
+static const struct dvb_entry *find_channel_entry(struct dvb_file *dvb_file,
+						  const char *channel)
+{
+	struct dvb_entry *entry;
+
+	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next) {
+		if (entry->channel && !strcmp(entry->channel, channel))
+			return entry;
+		if (entry->vchannel && !strcmp(entry->vchannel, channel))
+			return entry;
+	}
+	for (entry = dvb_file->first_entry; entry != NULL; entry = entry->next)
+		if (entry->channel && !strcasecmp(entry->channel, channel))
+			return entry;
+	return NULL;
+}
+
+static int setup_multi_services(struct arguments *args, struct dvb_device *dvb,
+				struct service_rec *svcs, int n_svcs,
+				struct dvb_open_descriptor **dmx_fds,
+				int *n_dmx)
+{
+	unsigned char all_pids[0x2000 / 8] = {};
+	int i, j;
+
+	for (i = 0; i < n_svcs; i++) {
+		struct service_rec *svc = &svcs[i];
+		const struct dvb_entry *entry = svc->entry;
+
+		/* Record every elementary stream of the service */
+		for (j = 0; j < entry->video_pid_len; j++)
+			service_set_pid(svc, entry->video_pid[j]);
+		for (j = 0; j < entry->audio_pid_len; j++)
+			service_set_pid(svc, entry->audio_pid[j]);
+		for (j = 0; j < entry->other_el_pid_len; j++)
+			service_set_pid(svc, entry->other_el_pid[j].pid);
+
+		if (args->rec_psi) {
+			struct dvb_open_descriptor *sid_fd;
+			int pmtpid;
+
+			sid_fd = dvb_dev_open(dvb, args->demux_dev, O_RDWR);
+			if (!sid_fd) {
+				ERROR("opening sid demux failed");
+				return -1;
+			}
+			pmtpid = dvb_dev_dmx_get_pmt_pid(sid_fd,
+							 entry->service_id);
+			dvb_dev_close(sid_fd);
+			if (pmtpid <= 0) {
+				fprintf(stderr, _("couldn't find pmt-pid for sid %04x\n"),
+					entry->service_id);
+				return -1;
+			}
+			service_set_pid(svc, pmtpid);
+			/* PAT and SDT go into every file */
+			service_set_pid(svc, 0);
+			service_set_pid(svc, 0x0011);
+		}
+	}
+
+	/* One TS_TAP filter per distinct pid on the shared demux */
+	for (i = 0; i < n_svcs; i++) {
+		for (j = 0; j < 0x2000; j++) {
+			struct dvb_open_descriptor *fd;
+
+			if (!service_has_pid(&svcs[i], j) ||
+			    (all_pids[j >> 3] & (1 << (j & 7))))
+				continue;
+			all_pids[j >> 3] |= 1 << (j & 7);
+
+			if (*n_dmx >= ZAP_MAX_FILTERS) {
+				ERROR("too many pids to filter");
+				return -1;
+			}
+			fd = dvb_dev_open(dvb, args->demux_dev, O_RDWR);
+			if (!fd) {
+				ERROR("failed opening '%s'", args->demux_dev);
+				return -1;
+			}
+			dmx_fds[(*n_dmx)++] = fd;
+			if (*n_dmx == 1) {
+				fprintf(stderr, _("dvb_dev_set_bufsize: buffer set to %d\n"), DVB_BUF_SIZE);
+				dvb_dev_set_bufsize(fd, DVB_BUF_SIZE);
+			}
+			if (args->silent < 2)
+				fprintf(stderr, _("  dvb_set_pesfilter %d\n"), j);
+			if (dvb_dev_dmx_set_pesfilter(fd, j, DMX_PES_OTHER,
+					DMX_OUT_TS_TAP, 64 * 1024) < 0)
+				return -1;
+		}
+	}
+
+	return 0;
+}
+
+static void copy_to_files(struct dvb_open_descriptor *in_fd,
+			  struct service_rec *svcs, int n_svcs,
+			  int timeout, int silent)
+{
+	/* Room for one read plus a carried partial packet */
+	unsigned char buf[BUFLEN + 188];
+	unsigned char *stage;
+	int stage_len[ZAP_MAX_SERVICES];
+	int r, i, err, first = 1, buffered = 0;
+	long long int rc = 0LL;
+	struct timespec start, *elapsed;
+
+	stage = malloc((size_t)n_svcs * (BUFLEN + 188));
+	if (!stage) {
+		ERROR("Out of memory");
+		return;
+	}
+
+	for (i = 0; i < n_svcs; i++) {
+		if (record_ring_start(&svcs[i].ring, svcs[i].fd)) {
+			ERROR("Cannot start the record writer threads");
+			while (--i >= 0)
+				record_ring_stop(&svcs[i].ring, 2);
+			free(stage);
+			return;
+		}
+	}
+
+	/* Initialize start time, due to -EOVERFLOW with first == 1 */
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (timeout_flag == 0) {
+		int len, pos = 0;
+
+		r = dvb_dev_read(in_fd, buf + buffered, BUFLEN);
+		if (r < 0) {
+			if (r == -EOVERFLOW) {
+				elapsed = elapsed_time(&start);
+				if (!elapsed)
+					fprintf(stderr, _("buffer overrun at %lld\n"), rc);
+				else
+					fprintf(stderr, _("buffer overrun after %lld.%02ld seconds\n"),
+						(long long)elapsed->tv_sec,
+						elapsed->tv_nsec / 10000000);
+				continue;
+			}
+			ERROR("Read failed");
+			break;
+		}
+
+		/* See the comment in copy_to_file() */
+		if (first) {
+			if (timeout > 0)
+				alarm(timeout);
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			first = 0;
+		}
+
+		len = buffered + r;
+		memset(stage_len, 0, sizeof(stage_len));
+		while (len - pos >= 188) {
+			int pid;
+
+			if (buf[pos] != 0x47) {
+				/* Lost sync, hunt for the next sync byte */
+				pos++;
+				continue;
+			}
+			pid = ((buf[pos + 1] << 8) | buf[pos + 2]) & 0x1fff;
+			for (i = 0; i < n_svcs; i++) {
+				if (!service_has_pid(&svcs[i], pid))
+					continue;
+				memcpy(stage + i * (BUFLEN + 188) + stage_len[i],
+				       buf + pos, 188);
+				stage_len[i] += 188;
+			}
+			pos += 188;
+		}
+
+		for (i = 0; i < n_svcs; i++) {
+			if (!stage_len[i])
+				continue;
+			err = record_ring_put(&svcs[i].ring,
+					      stage + i * (BUFLEN + 188),
+					      stage_len[i]);
+			if (err) {
+				errno = err;
+				PERROR(_("Write failed"));
+				goto done;
+			}
+			svcs[i].rc += stage_len[i];
+		}
+
+		rc += r;
+		buffered = len - pos;
+		if (buffered)
+			memmove(buf, buf + pos, buffered);
+	}
+done:
+	for (i = 0; i < n_svcs; i++)
+		record_ring_stop(&svcs[i].ring, silent);
+	free(stage);
+
+	if (silent < 2) {
+		if (timeout)
+			fprintf(stderr, _("received %lld bytes (%lld Kbytes/sec)\n"), rc,
+				rc / (1024 * timeout));
+		else
+			fprintf(stderr, _("received %lld bytes\n"), rc);
+		for (i = 0; i < n_svcs; i++)
+			fprintf(stderr, _("  %s: %lld bytes\n"),
+				svcs[i].channel, svcs[i].rc);
+	}
+}
+
 static error_t parse_opt(int k, char *optarg, struct argp_state *state)
 {
 	struct arguments *args = state->input;
@@ -762,6 +1159,70 @@ static char *print_bytes(float val)
 	return buf;
 }
 
+/*
+ * Per-PID totals of a monitor run, sorted for the exit report.
+ */
+struct pid_traffic_sum {
+	int pid;
+	unsigned long long packets;
+	unsigned long long err_cnt;
+};
+
+static int cmp_pid_traffic(const void *a, const void *b)
+{
+	const struct pid_traffic_sum *pa = a, *pb = b;
+
+	if (pa->packets != pb->packets)
+		return pa->packets > pb->packets ? -1 : 1;
+	return pa->pid - pb->pid;
+}
+
+/*
+ * Prints the whole-run per-PID totals, biggest consumers first, so the
+ * bitrate hogs show up at the top without a second pass over the TS.
+ */
+static void print_traffic_summary(unsigned long long *pidt,
+				  unsigned long long *err_cnt,
+				  unsigned long long diff)
+{
+	struct pid_traffic_sum *sum;
+	int i, n = 0;
+
+	if (!diff || !pidt[0x2000])
+		return;
+
+	sum = malloc(0x2000 * sizeof(*sum));
+	if (!sum)
+		return;
+
+	for (i = 0; i < 0x2000; i++) {
+		if (!pidt[i])
+			continue;
+		sum[n].pid = i;
+		sum[n].packets = pidt[i];
+		sum[n].err_cnt = err_cnt[i];
+		n++;
+	}
+	qsort(sum, n, sizeof(*sum), cmp_pid_traffic);
+
+	printf(_("\nTraffic summary, %.2f seconds, sorted by traffic:\n"),
+	       diff / 1000.);
+	printf(_("  PID        PACKETS  SHARE    AVG RATE\n"));
+	for (i = 0; i < n; i++) {
+		printf("%5d %14llu %5.1f%% %sbps",
+		       sum[i].pid, sum[i].packets,
+		       sum[i].packets * 100. / pidt[0x2000],
+		       print_bytes(sum[i].packets * 1000. * 8 * 188 / diff));
+		if (sum[i].err_cnt)
+			printf(_(" %8llu continuity errors"),
+			       sum[i].err_cnt);
+		printf("\n");
+	}
+	printf(_("TOT %16llu        %sbps\n"), pidt[0x2000],
+	       print_bytes(pidt[0x2000] * 1000. * 8 * 188 / diff));
+	free(sum);
+}
+
 int do_traffic_monitor(struct arguments *args, struct dvb_device *dvb,
 		       int out_fd, int timeout)
 {
@@ -1009,6 +1470,16 @@ int do_traffic_monitor(struct arguments *args, struct dvb_device *dvb,
 		}
 	}
 	monitor_log(_("%.2fs: Stopping capture\n"));
+
+	{
+		struct timespec *elapsed = elapsed_time(&startt);
+
+		if (elapsed)
+			print_traffic_summary(pidt, err_cnt,
+					      (unsigned long long)elapsed->tv_sec * 1000
+					      + elapsed->tv_nsec * 1000 / NANO_SECONDS_IN_SEC);
+	}
+
 	dvb_dev_close(dvr_fd);
 	dvb_dev_close(fd);
 	return 0;
@@ -1031,7 +1502,7 @@ int main(int argc, char **argv)
 	struct arguments args = {};
 	char *homedir = getenv("HOME");
 	char *channel = NULL;
-	int lnb = -1, idx = -1;
+	int lnb = -1, idx = -1, n_extra = 0;
 	int pmtpid = 0;
 	struct dvb_file *dvb_file = NULL;
 	const struct dvb_entry *dvb_entry = NULL;
@@ -1048,7 +1519,7 @@ int main(int argc, char **argv)
 		.options = options,
 		.parser = parse_opt,
 		.doc = N_("DVB zap utility"),
-		.args_doc = N_("<channel name> [or <frequency> if in monitor mode]"),
+		.args_doc = N_("<channel name> [<same-mux channel name> ...] [or <frequency> if in monitor mode]"),
 	};
 
 #ifdef ENABLE_NLS
@@ -1068,14 +1539,35 @@ int main(int argc, char **argv)
 		return -1;
 	}
 
-	if (idx < argc)
+	if (idx < argc) {
 		channel = argv[idx];
+		n_extra = argc - idx - 1;
+	}
 
 	if (!channel) {
 		argp_help(&argp, stderr, ARGP_HELP_STD_HELP, PROGRAM_NAME);
 		return -1;
 	}
 
+	if (n_extra > 0) {
+		/* Extra channels: record several services of the same mux
+		   sharing one tune, one demux and one dvr read loop */
+		if (n_extra + 1 > ZAP_MAX_SERVICES) {
+			ERROR("at most %d channels can be recorded at once",
+			      ZAP_MAX_SERVICES);
+			return -1;
+		}
+		if (args.traffic_monitor || args.all_pids || args.search) {
+			ERROR("recording multiple channels can't be combined with -m, -P or -L");
+			return -1;
+		}
+		if (!args.filename || !strcmp(args.filename, "-")) {
+			ERROR("recording multiple channels requires -o with a file name");
+			return -1;
+		}
+		args.dvr = 1;
+	}
+
 	if (args.input_format == FILE_UNKNOWN) {
 		ERROR("Please specify a valid format\n");
 		argp_help(&argp, stderr, ARGP_HELP_STD_HELP, PROGRAM_NAME);
@@ -1196,6 +1688,86 @@ int main(int argc, char **argv)
 		goto err;
 	}
 
+	if (n_extra > 0) {
+		struct service_rec svcs[ZAP_MAX_SERVICES] = {};
+		struct dvb_open_descriptor *dmx_fds[ZAP_MAX_FILTERS];
+		int n_dmx = 0, n_svcs = n_extra + 1;
+		uint32_t freq0 = 0, freq = 0;
+
+		svcs[0].channel = channel;
+		svcs[0].entry = dvb_entry;
+		dvb_retrieve_entry_prop((struct dvb_entry *)dvb_entry,
+					DTV_FREQUENCY, &freq0);
+
+		for (r = 1; r < n_svcs; r++) {
+			svcs[r].channel = argv[idx + r];
+			svcs[r].entry = find_channel_entry(dvb_file,
+							   svcs[r].channel);
+			if (!svcs[r].entry) {
+				ERROR("Can't find channel '%s'",
+				      svcs[r].channel);
+				goto err;
+			}
+			dvb_retrieve_entry_prop((struct dvb_entry *)svcs[r].entry,
+						DTV_FREQUENCY, &freq);
+			if (freq != freq0) {
+				ERROR("channel '%s' is not on the same transponder as '%s'",
+				      svcs[r].channel, channel);
+				goto err;
+			}
+		}
+
+		/* One output file per service */
+		for (r = 0; r < n_svcs; r++) {
+			char *fname;
+
+			if (asprintf(&fname, "%s.%s", args.filename,
+				     svcs[r].channel) < 0)
+				goto err;
+			svcs[r].fd = open(fname, O_LARGEFILE | O_WRONLY |
+					  O_CREAT | O_TRUNC, 0644);
+			if (svcs[r].fd < 0) {
+				PERROR(_("open of '%s' failed"), fname);
+				free(fname);
+				goto multi_err;
+			}
+			if (args.silent < 2)
+				fprintf(stderr, _("recording '%s' to '%s'\n"),
+					svcs[r].channel, fname);
+			free(fname);
+		}
+
+		if (setup_multi_services(&args, dvb, svcs, n_svcs,
+					 dmx_fds, &n_dmx))
+			goto multi_err;
+
+		set_signals(&args);
+
+		if (!check_frontend(&args, parms)) {
+			err = 1;
+			fprintf(stderr, _("frontend doesn't lock\n"));
+			goto multi_err;
+		}
+
+		dvr_fd = dvb_dev_open(dvb, args.dvr_dev, O_RDONLY);
+		if (!dvr_fd) {
+			ERROR("failed opening '%s'", args.dvr_dev);
+			goto multi_err;
+		}
+		if (!timeout_flag)
+			fprintf(stderr, _("Record of %d services started\n"),
+				n_svcs);
+		copy_to_files(dvr_fd, svcs, n_svcs, args.timeout, args.silent);
+		err = 0;
+multi_err:
+		for (r = 0; r < n_dmx; r++)
+			dvb_dev_close(dmx_fds[r]);
+		for (r = 0; r < n_svcs; r++)
+			if (svcs[r].fd > 0)
+				close(svcs[r].fd);
+		goto err;
+	}
+
 	if (args.rec_psi) {
 		sid_fd = dvb_dev_open(dvb, args.demux_dev, O_RDWR);
 		if (!sid_fd) {
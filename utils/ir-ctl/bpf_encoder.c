@@ -8,77 +8,122 @@
 #include <argp.h>
 
 #include "keymap.h"
+#include "bpf_encoder.h"
 
 // Some keymaps use BPF decoders, so the kernel has no idea how to encode
 // them. We need user-space encoders for these.
 //
 // This encoders should match what the BPF decoders in
 // utils/keytable/bpf_protocols/*.c decode.
+//
+// The parameters are resolved into a template once, so that encoding a
+// batch of scancodes only pays the parameter lookups a single time.
 
-static void encode_pulse_distance(struct keymap *map, uint32_t scancode, int *buf, int *length)
+bool bpf_encoder_prepare(struct keymap *map, struct bpf_encoder_template *temp)
 {
-	int len = 0, bits, i;
+	if (!strcmp(map->protocol, "pulse_distance")) {
+		temp->proto = BPF_ENCODER_PULSE_DISTANCE;
+		temp->bits = keymap_param(map, "bits", 4);
+	} else if (!strcmp(map->protocol, "pulse_length")) {
+		temp->proto = BPF_ENCODER_PULSE_LENGTH;
+		temp->bits = keymap_param(map, "bits", 4);
+	} else if (!strcmp(map->protocol, "manchester")) {
+		temp->proto = BPF_ENCODER_MANCHESTER;
+		temp->bits = keymap_param(map, "bits", 14);
+	} else {
+		return false;
+	}
 
-	buf[len++] = keymap_param(map, "header_pulse", 2125);
-	buf[len++] = keymap_param(map, "header_space", 1875);
+	temp->reverse = keymap_param(map, "reverse", 0);
+	temp->carrier = keymap_param(map, "carrier", 0);
+	temp->header_pulse = keymap_param(map, "header_pulse", 2125);
+	temp->header_space = keymap_param(map, "header_space", 1875);
+	temp->bit_pulse = keymap_param(map, "bit_pulse", 625);
+	temp->bit_0_space = keymap_param(map, "bit_0_space", 375);
+	temp->bit_1_space = keymap_param(map, "bit_1_space", 1625);
+	temp->trailer_pulse = keymap_param(map, "trailer_pulse", 625);
+	temp->one_pulse = keymap_param(map, "one_pulse", 888);
+	temp->one_space = keymap_param(map, "one_space", 888);
+	temp->zero_pulse = keymap_param(map, "zero_pulse", 888);
+	temp->zero_space = keymap_param(map, "zero_space", 888);
+
+	return true;
+}
 
-	bits = keymap_param(map, "bits", 4);
+// Worst-case number of edges one scancode can encode to
+int bpf_encoder_max_length(const struct bpf_encoder_template *temp)
+{
+	switch (temp->proto) {
+	case BPF_ENCODER_PULSE_DISTANCE:
+		return temp->bits * 2 + 3;
+	case BPF_ENCODER_PULSE_LENGTH:
+		return temp->bits * 2 + 2;
+	case BPF_ENCODER_MANCHESTER:
+	default:
+		return temp->bits * 2 + 1;
+	}
+}
+
+static int encode_pulse_distance(const struct bpf_encoder_template *temp, uint32_t scancode, int *buf)
+{
+	int len = 0, i;
 
-	if (keymap_param(map, "reverse", 0)) {
-		for (i = 0; i < bits; i++) {
-			buf[len++] = keymap_param(map, "bit_pulse", 625);
+	buf[len++] = temp->header_pulse;
+	buf[len++] = temp->header_space;
+
+	if (temp->reverse) {
+		for (i = 0; i < temp->bits; i++) {
+			buf[len++] = temp->bit_pulse;
 
 			if (scancode & (1 << i))
-				buf[len++] = keymap_param(map, "bit_1_space", 1625);
+				buf[len++] = temp->bit_1_space;
 			else
-				buf[len++] = keymap_param(map, "bit_0_space", 375);
+				buf[len++] = temp->bit_0_space;
 		}
 	} else {
-		for (i = bits - 1; i >= 0; i--) {
-			buf[len++] = keymap_param(map, "bit_pulse", 625);
+		for (i = temp->bits - 1; i >= 0; i--) {
+			buf[len++] = temp->bit_pulse;
 
 			if (scancode & (1 << i))
-				buf[len++] = keymap_param(map, "bit_1_space", 1625);
+				buf[len++] = temp->bit_1_space;
 			else
-				buf[len++] = keymap_param(map, "bit_0_space", 375);
+				buf[len++] = temp->bit_0_space;
 		}
 	}
 
-	buf[len++] = keymap_param(map, "trailer_pulse", 625);
+	buf[len++] = temp->trailer_pulse;
 
-	*length = len;
+	return len;
 }
 
-static void encode_pulse_length(struct keymap *map, uint32_t scancode, int *buf, int *length)
+static int encode_pulse_length(const struct bpf_encoder_template *temp, uint32_t scancode, int *buf)
 {
-	int len = 0, bits, i;
-
-	buf[len++] = keymap_param(map, "header_pulse", 2125);
-	buf[len++] = keymap_param(map, "header_space", 1875);
+	int len = 0, i;
 
-	bits = keymap_param(map, "bits", 4);
+	buf[len++] = temp->header_pulse;
+	buf[len++] = temp->header_space;
 
-	if (keymap_param(map, "reverse", 0)) {
-		for (i = 0; i < bits; i++) {
+	if (temp->reverse) {
+		for (i = 0; i < temp->bits; i++) {
 			if (scancode & (1 << i))
-				buf[len++] = keymap_param(map, "bit_1_space", 1625);
+				buf[len++] = temp->bit_1_space;
 			else
-				buf[len++] = keymap_param(map, "bit_0_space", 375);
+				buf[len++] = temp->bit_0_space;
 
-			buf[len++] = keymap_param(map, "bit_pulse", 625);
+			buf[len++] = temp->bit_pulse;
 		}
 	} else {
-		for (i = bits - 1; i >= 0; i--) {
+		for (i = temp->bits - 1; i >= 0; i--) {
 			if (scancode & (1 << i))
-				buf[len++] = keymap_param(map, "bit_1_space", 1625);
+				buf[len++] = temp->bit_1_space;
 			else
-				buf[len++] = keymap_param(map, "bit_0_space", 375);
+				buf[len++] = temp->bit_0_space;
 
-			buf[len++] = keymap_param(map, "bit_pulse", 625);
+			buf[len++] = temp->bit_pulse;
 		}
 	}
 
-	*length = len;
+	return len;
 }
 
 static void manchester_advance_space(int *buf, int *len, unsigned length)
@@ -97,42 +142,66 @@ static void manchester_advance_pulse(int *buf, int *len, unsigned length)
 		buf[*len] += length;
 }
 
-static void encode_manchester(struct keymap *map, uint32_t scancode, int *buf, int *length)
+static int encode_manchester(const struct bpf_encoder_template *temp, uint32_t scancode, int *buf)
 {
-	int len = 0, bits, i;
-
-	bits = keymap_param(map, "bits", 14);
+	int len = 0, i;
 
-	for (i = bits - 1; i >= 0; i--) {
+	for (i = temp->bits - 1; i >= 0; i--) {
 		if (scancode & (1 << i)) {
-			manchester_advance_pulse(buf, &len, keymap_param(map, "one_pulse", 888));
-			manchester_advance_space(buf, &len, keymap_param(map, "one_space", 888));
+			manchester_advance_pulse(buf, &len, temp->one_pulse);
+			manchester_advance_space(buf, &len, temp->one_space);
 		} else {
-			manchester_advance_space(buf, &len, keymap_param(map, "zero_space", 888));
-			manchester_advance_pulse(buf, &len, keymap_param(map, "zero_pulse", 888));
+			manchester_advance_space(buf, &len, temp->zero_space);
+			manchester_advance_pulse(buf, &len, temp->zero_pulse);
 		}
 	}
 
 	/* drop any trailing pulse */
-        *length = (len % 2) ? len : len + 1;
+	return (len % 2) ? len : len + 1;
 }
 
-bool encode_bpf_protocol(struct keymap *map, uint32_t scancode, int *buf, int *length)
+int bpf_encoder_encode(const struct bpf_encoder_template *temp, uint32_t scancode, int *buf)
 {
-	if (!strcmp(map->protocol, "pulse_distance")) {
-		encode_pulse_distance(map, scancode, buf, length);
-		return true;
+	switch (temp->proto) {
+	case BPF_ENCODER_PULSE_DISTANCE:
+		return encode_pulse_distance(temp, scancode, buf);
+	case BPF_ENCODER_PULSE_LENGTH:
+		return encode_pulse_length(temp, scancode, buf);
+	case BPF_ENCODER_MANCHESTER:
+	default:
+		return encode_manchester(temp, scancode, buf);
 	}
+}
 
-	if (!strcmp(map->protocol, "pulse_length")) {
-		encode_pulse_length(map, scancode, buf, length);
-		return true;
-	}
+/*
+ * Encode an array of scancodes back-to-back into a caller-provided
+ * arena. The arena must have room for count * bpf_encoder_max_length()
+ * edges; the per-code lengths are returned in lengths[]. Returns the
+ * total number of edges written.
+ */
+int bpf_encoder_encode_batch(const struct bpf_encoder_template *temp,
+			     const uint32_t *scancodes, unsigned count,
+			     int *arena, int *lengths)
+{
+	int total = 0;
+	unsigned i;
 
-	if (!strcmp(map->protocol, "manchester")) {
-		encode_manchester(map, scancode, buf, length);
-		return true;
+	for (i = 0; i < count; i++) {
+		lengths[i] = bpf_encoder_encode(temp, scancodes[i], arena + total);
+		total += lengths[i];
 	}
 
-	return false;
+	return total;
+}
+
+bool encode_bpf_protocol(struct keymap *map, uint32_t scancode, int *buf, int *length)
+{
+	struct bpf_encoder_template temp;
+
+	if (!bpf_encoder_prepare(map, &temp))
+		return false;
+
+	*length = bpf_encoder_encode(&temp, scancode, buf);
+
+	return true;
 }
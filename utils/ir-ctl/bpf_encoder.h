@@ -2,6 +2,31 @@
 #ifndef __BPF_ENCODER_H
 #define __BPF_ENCODER_H
 
+enum bpf_encoder_proto {
+	BPF_ENCODER_PULSE_DISTANCE,
+	BPF_ENCODER_PULSE_LENGTH,
+	BPF_ENCODER_MANCHESTER,
+};
+
+// All decoder parameters resolved up front, so that encoding many
+// scancodes does not walk the keymap parameter list for every bit.
+struct bpf_encoder_template {
+	enum bpf_encoder_proto proto;
+	int bits;
+	bool reverse;
+	int carrier;
+	int header_pulse, header_space;
+	int bit_pulse, bit_0_space, bit_1_space;
+	int trailer_pulse;
+	int one_pulse, one_space, zero_pulse, zero_space;
+};
+
+bool bpf_encoder_prepare(struct keymap *map, struct bpf_encoder_template *temp);
+int bpf_encoder_max_length(const struct bpf_encoder_template *temp);
+int bpf_encoder_encode(const struct bpf_encoder_template *temp, uint32_t scancode, int *buf);
+int bpf_encoder_encode_batch(const struct bpf_encoder_template *temp,
+			     const uint32_t *scancodes, unsigned count,
+			     int *arena, int *lengths);
 bool encode_bpf_protocol(struct keymap *map, uint32_t scancode, int *buf, int *length);
 
 #endif
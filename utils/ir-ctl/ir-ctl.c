@@ -25,6 +25,8 @@
 #include <fcntl.h>
 #include <argp.h>
 #include <sysexits.h>
+#include <time.h>
+#include <poll.h>
 
 #include <config.h>
 
@@ -103,6 +105,10 @@ struct arguments {
 	bool mode2;
 	struct keymap *keymap;
 	struct send *send;
+	struct send *batch;
+	unsigned batch_count;
+	char *loopback;
+	unsigned trials;
 	bool oneshot;
 	char *savetofile;
 	int wideband;
@@ -122,7 +128,10 @@ static const struct argp_option options[] = {
 	{ "receive",	'r',	N_("FILE"),	OPTION_ARG_OPTIONAL,	N_("receive IR to stdout or file") },
 	{ "send",	's',	N_("FILE"),	0,	N_("send IR pulse and space file") },
 	{ "scancode",	'S',	N_("SCANCODE"),	0,	N_("send IR scancode in protocol specified") },
+	{ "batch",	'B',	N_("FILE"),	0,	N_("send list of IR scancodes with precise gaps") },
 	{ "keycode",	'K',	N_("KEYCODE"),	0,	N_("send IR keycode from keymap") },
+	{ "loopback",	3,	N_("RECVDEV"),	0,	N_("measure receive latency: send on the lirc device, receive on RECVDEV") },
+	{ "trials",	4,	N_("TRIALS"),	0,	N_("number of loopback trials, default 100") },
 	{ "verbose",	'v',	0,		0,	N_("verbose output") },
 		{ .doc = N_("Receiving options:") },
 	{ "one-shot",	'1',	0,		0,	N_("end receiving after first message") },
@@ -147,6 +156,7 @@ static const char args_doc[] = N_(
 	"--receive [save to file]\n"
 	"--send [file to send]\n"
 	"--scancode [scancode to send]\n"
+	"--batch [file with scancodes to send]\n"
 	"--keycode [keycode to send]\n"
 	"[to set lirc option]");
 
@@ -165,6 +175,12 @@ static const char doc[] = N_(
 	"  KEYCODE  - key code in keymap\n"
 	"  SCANCODE - protocol:scancode, e.g. nec:0xa814\n"
 	"  KEYMAP   - a rc keymap file from which to send keys\n\n"
+	"The --batch file contains one protocol:scancode per line; all scancodes\n"
+	"are encoded up front and sent back-to-back with the configured gap\n"
+	"between them, reporting the achieved timing afterwards.\n\n"
+	"With --loopback, the IR specified with --scancode or --send is\n"
+	"transmitted repeatedly on the lirc device and received on RECVDEV,\n"
+	"reporting edge-to-edge and edge-to-scancode latency histograms.\n\n"
 	"Note that most lirc setting have global state, i.e. the device will remain\n"
 	"in this state until set otherwise.");
 
@@ -561,6 +577,135 @@ static struct send *read_scancode(const char *name)
 	return f;
 }
 
+/*
+ * Read a file with one protocol:scancode per line and pre-render every
+ * entry into its raw pulse/space buffer, so that the send loop only has
+ * to write() the buffers. Blank lines and # comments are allowed.
+ */
+static struct send *read_batch_file(struct arguments *args, const char *fname)
+{
+	struct send *head = NULL, **tail = &head;
+	struct bpf_encoder_template temp;
+	struct keymap *temp_map = NULL;
+	char line[LINE_SIZE];
+	int lineno = 0;
+	FILE *input;
+
+	input = fopen(fname, "r");
+	if (!input) {
+		fprintf(stderr, _("%s: could not open: %m\n"), fname);
+		return NULL;
+	}
+
+	args->batch_count = 0;
+
+	while (fgets(line, sizeof(line), input)) {
+		static const char whitespace[] = " \n\r\t";
+		char *p, *scancodestr, *saveptr;
+		enum rc_proto proto;
+		unsigned scancode;
+		struct send *f;
+
+		lineno++;
+		p = strtok_r(line, whitespace, &saveptr);
+		if (p == NULL || *p == 0 || *p == '#' ||
+		    (p[0] == '/' && p[1] == '/'))
+			continue;
+
+		scancodestr = strchr(p, ':');
+		if (!scancodestr) {
+			fprintf(stderr, _("error: %s:%d: scancode '%s' must be in protocol:scancode format\n"), fname, lineno, p);
+			goto err;
+		}
+		*scancodestr++ = 0;
+
+		if (!strtoscancode(scancodestr, &scancode)) {
+			fprintf(stderr, _("error: %s:%d: invalid scancode '%s'\n"), fname, lineno, scancodestr);
+			goto err;
+		}
+
+		if (!protocol_match(p, &proto)) {
+			// not a kernel protocol; try the BPF protocols of
+			// the keymap, reusing the resolved template
+			struct keymap *map;
+
+			for (map = args->keymap; map; map = map->next)
+				if (!strcmp(p, map->variant ?: map->protocol))
+					break;
+
+			if (!map || (map != temp_map &&
+				     !bpf_encoder_prepare(map, &temp))) {
+				fprintf(stderr, _("error: %s:%d: protocol '%s' not found\n"), fname, lineno, p);
+				goto err;
+			}
+			temp_map = map;
+
+			int buf[LIRCBUF_SIZE], length;
+
+			length = bpf_encoder_encode(&temp, scancode, buf);
+
+			f = malloc(sizeof(*f));
+			if (f == NULL) {
+				fprintf(stderr, _("Failed to allocate memory\n"));
+				goto err;
+			}
+
+			f->ty = SEND_RAW;
+			f->fname = fname;
+			f->next = NULL;
+			f->carrier = temp.carrier;
+			f->len = length;
+			memcpy(f->buf, buf, length * sizeof(int));
+
+			*tail = f;
+			tail = &f->next;
+			args->batch_count++;
+			continue;
+		}
+
+		if (!protocol_encoder_available(proto)) {
+			fprintf(stderr, _("error: %s:%d: no encoder available for `%s'\n"), fname, lineno, protocol_name(proto));
+			goto err;
+		}
+
+		protocol_scancode_valid(&proto, &scancode);
+
+		f = malloc(sizeof(*f));
+		if (f == NULL) {
+			fprintf(stderr, _("Failed to allocate memory\n"));
+			goto err;
+		}
+
+		f->ty = SEND_RAW;
+		f->fname = fname;
+		f->next = NULL;
+		f->carrier = protocol_carrier(proto);
+		f->len = protocol_encode(proto, scancode, f->buf);
+
+		*tail = f;
+		tail = &f->next;
+		args->batch_count++;
+	}
+
+	fclose(input);
+
+	if (args->batch_count == 0) {
+		fprintf(stderr, _("%s: no scancodes found\n"), fname);
+		return NULL;
+	}
+
+	return head;
+
+err:
+	fclose(input);
+	while (head) {
+		struct send *next = head->next;
+		free(head);
+		head = next;
+	}
+	return NULL;
+}
+
 static void add_to_send_list(struct arguments *arguments, struct send *send)
 {
 	send->next = NULL;
@@ -699,6 +844,25 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 
 		add_to_send_list(arguments, s);
 		break;
+	case 'B':
+		if (arguments->receive || arguments->features)
+			argp_error(state, _("send can not be combined with receive or features option"));
+		if (arguments->batch)
+			argp_error(state, _("batch file already set"));
+		arguments->batch = read_batch_file(arguments, arg);
+		if (arguments->batch == NULL)
+			exit(EX_DATAERR);
+		break;
+	case 3:
+		if (arguments->receive || arguments->features)
+			argp_error(state, _("loopback can not be combined with receive or features option"));
+		arguments->loopback = arg;
+		break;
+	case 4:
+		if (!strtoint(arg, "", &arguments->trials) ||
+		    arguments->trials == 0)
+			argp_error(state, _("cannot parse trials `%s'"), arg);
+		break;
 
 	case 'K':
 		if (arguments->receive || arguments->features)
@@ -734,7 +898,7 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 		return ARGP_ERR_UNKNOWN;
 	}
 
-	if (k != '1' && k != 'd' && k != 'v' && k != 'k' && k != 2)
+	if (k != '1' && k != 'd' && k != 'v' && k != 'k' && k != 2 && k != 4)
 		arguments->work_to_do = true;
 
 	return 0;
@@ -1120,6 +1284,334 @@ static int lirc_send(struct arguments *args, int fd, unsigned features, struct s
 	return 0;
 }
 
+static uint64_t timespec_to_us(const struct timespec *ts)
+{
+	return ts->tv_sec * 1000000ull + ts->tv_nsec / 1000;
+}
+
+/*
+ * Stream all pre-rendered batch buffers back-to-back. The inter-code
+ * gap is scheduled against absolute deadlines so that scheduling and
+ * write() overhead does not accumulate as drift over a long batch.
+ */
+static int lirc_send_batch(struct arguments *args, int fd, unsigned features)
+{
+	const char *dev = args->device;
+	unsigned carrier = UNSET;
+	struct timespec start, deadline, now;
+	uint64_t late_max = 0, late_sum = 0, elapsed;
+	unsigned sent = 0;
+	int mode = LIRC_MODE_PULSE;
+	struct send *f;
+	int rc;
+
+	if (!(features & LIRC_CAN_SEND_PULSE)) {
+		fprintf(stderr, _("%s: device cannot send\n"), dev);
+		return EX_UNAVAILABLE;
+	}
+
+	rc = ioctl(fd, LIRC_SET_SEND_MODE, &mode);
+	if (rc) {
+		fprintf(stderr, _("%s: cannot set send mode\n"), dev);
+		return EX_UNAVAILABLE;
+	}
+
+	if (args->carrier != UNSET) {
+		lirc_set_send_carrier(fd, dev, features, args->carrier);
+		carrier = args->carrier;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	deadline = start;
+
+	for (f = args->batch; f; f = f->next) {
+		uint64_t duration = 0;
+		ssize_t ret;
+		size_t size;
+		int i;
+
+		if (args->carrier == UNSET && f->carrier != UNSET &&
+		    f->carrier != carrier) {
+			lirc_set_send_carrier(fd, dev, features, f->carrier);
+			carrier = f->carrier;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (timespec_to_us(&now) > timespec_to_us(&deadline)) {
+			uint64_t late = timespec_to_us(&now) -
+					timespec_to_us(&deadline);
+
+			late_sum += late;
+			if (late > late_max)
+				late_max = late;
+		}
+
+		size = f->len * sizeof(unsigned);
+		ret = TEMP_FAILURE_RETRY(write(fd, f->buf, size));
+		if (ret < 0) {
+			fprintf(stderr, _("%s: failed to send: %m\n"), dev);
+			return EX_IOERR;
+		}
+
+		sent++;
+
+		for (i = 0; i < f->len; i++)
+			duration += f->buf[i];
+
+		// next code starts after the IR itself plus the gap
+		duration += args->gap;
+		deadline.tv_sec += duration / 1000000;
+		deadline.tv_nsec += (duration % 1000000) * 1000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		if (f->next)
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &deadline, NULL) == EINTR)
+				;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = timespec_to_us(&now) - timespec_to_us(&start);
+
+	printf(_("Sent %u scancodes in %llu.%03llu seconds (%.1f codes/sec)\n"),
+	       sent, (unsigned long long)(elapsed / 1000000),
+	       (unsigned long long)((elapsed % 1000000) / 1000),
+	       sent * 1000000.0 / elapsed);
+	printf(_("Gap deadline overrun: mean %llu microseconds, worst %llu microseconds\n"),
+	       (unsigned long long)(sent ? late_sum / sent : 0),
+	       (unsigned long long)late_max);
+
+	return 0;
+}
+
+static const unsigned latency_bucket_us[] = {
+	100, 250, 500, 1000, 2500, 5000, 10000, 25000
+};
+#define LATENCY_BUCKETS (sizeof(latency_bucket_us) / sizeof(latency_bucket_us[0]))
+
+struct latency_stats {
+	unsigned count, missed;
+	uint64_t min, max, sum;
+	unsigned buckets[LATENCY_BUCKETS + 1];
+};
+
+static void latency_record(struct latency_stats *s, uint64_t us)
+{
+	int i;
+
+	if (!s->count || us < s->min)
+		s->min = us;
+	if (us > s->max)
+		s->max = us;
+	s->sum += us;
+	s->count++;
+
+	for (i = 0; i < LATENCY_BUCKETS; i++)
+		if (us <= latency_bucket_us[i])
+			break;
+	s->buckets[i]++;
+}
+
+static void latency_report(const char *what, const struct latency_stats *s)
+{
+	int i;
+
+	if (!s->count) {
+		printf(_("%s: no IR received in %u trials\n"), what, s->missed);
+		return;
+	}
+
+	printf(_("%s latency over %u trials (%u missed): min %llu us, mean %llu us, max %llu us\n"),
+	       what, s->count, s->missed,
+	       (unsigned long long)s->min,
+	       (unsigned long long)(s->sum / s->count),
+	       (unsigned long long)s->max);
+
+	for (i = 0; i <= LATENCY_BUCKETS; i++) {
+		if (!s->buckets[i])
+			continue;
+		if (i < LATENCY_BUCKETS)
+			printf(_("  <= %u us: %u\n"),
+			       latency_bucket_us[i], s->buckets[i]);
+		else
+			printf(_("   > %u us: %u\n"),
+			       latency_bucket_us[LATENCY_BUCKETS - 1],
+			       s->buckets[i]);
+	}
+}
+
+// Throw away anything buffered on the lirc device before a trial
+static void lirc_drain(int fd)
+{
+	unsigned buf[LIRCBUF_SIZE];
+	int flags = fcntl(fd, F_GETFL);
+
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	fcntl(fd, F_SETFL, flags);
+}
+
+/*
+ * One loopback trial: transmit the pattern and wait for the receiver to
+ * see it. In mode2 the trial completes on the first pulse sample, in
+ * scancode mode on the first decoded scancode. Returns the latency from
+ * the start of the write in microseconds, or -1 on timeout.
+ */
+static int loopback_trial(int send_fd, int recv_fd, struct send *f,
+			  bool scancode_mode, uint64_t *latency)
+{
+	struct timespec t0, t1;
+	struct pollfd pfd = { .fd = recv_fd, .events = POLLIN };
+
+	lirc_drain(recv_fd);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (TEMP_FAILURE_RETRY(write(send_fd, f->buf,
+				     f->len * sizeof(unsigned))) < 0)
+		return -1;
+
+	for (;;) {
+		int rc = TEMP_FAILURE_RETRY(poll(&pfd, 1, 500));
+
+		if (rc <= 0)
+			return -1;
+
+		if (scancode_mode) {
+			struct lirc_scancode sc;
+
+			if (TEMP_FAILURE_RETRY(read(recv_fd, &sc, sizeof(sc))) != sizeof(sc))
+				return -1;
+			break;
+		} else {
+			unsigned buf[LIRCBUF_SIZE];
+			ssize_t ret;
+			int i;
+			bool pulse = false;
+
+			ret = TEMP_FAILURE_RETRY(read(recv_fd, buf, sizeof(buf)));
+			if (ret <= 0)
+				return -1;
+			for (i = 0; i < ret / sizeof(unsigned); i++)
+				if ((buf[i] & LIRC_MODE2_MASK) == LIRC_MODE2_PULSE) {
+					pulse = true;
+					break;
+				}
+			if (pulse)
+				break;
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*latency = timespec_to_us(&t1) - timespec_to_us(&t0);
+
+	return 0;
+}
+
+static int lirc_loopback(struct arguments *args, int fd, unsigned features)
+{
+	struct latency_stats edge = {}, key = {};
+	unsigned recv_features, trial;
+	bool have_scancodes;
+	struct send *f;
+	int recv_fd, mode;
+
+	f = args->send;
+	while (f && f->ty == SEND_GAP)
+		f = f->next;
+	if (!f || f->ty == SEND_KEYCODE) {
+		fprintf(stderr, _("error: loopback needs a --scancode or --send pattern\n"));
+		return EX_USAGE;
+	}
+
+	if (!(features & LIRC_CAN_SEND_PULSE)) {
+		fprintf(stderr, _("%s: device cannot send\n"), args->device);
+		return EX_UNAVAILABLE;
+	}
+
+	mode = LIRC_MODE_PULSE;
+	if (ioctl(fd, LIRC_SET_SEND_MODE, &mode)) {
+		fprintf(stderr, _("%s: cannot set send mode\n"), args->device);
+		return EX_UNAVAILABLE;
+	}
+
+	if (f->ty == SEND_SCANCODE) {
+		if (!protocol_encoder_available(f->protocol)) {
+			fprintf(stderr, _("%s: no encoder available for `%s'\n"),
+				args->device, protocol_name(f->protocol));
+			return EX_UNAVAILABLE;
+		}
+		enum rc_proto proto = f->protocol;
+		f->len = protocol_encode(proto, f->scancode, f->buf);
+		f->carrier = protocol_carrier(proto);
+	}
+
+	if (args->carrier != UNSET)
+		lirc_set_send_carrier(fd, args->device, features, args->carrier);
+	else if (f->carrier != UNSET)
+		lirc_set_send_carrier(fd, args->device, features, f->carrier);
+
+	recv_fd = open_lirc(args->loopback, &recv_features);
+	if (recv_fd < 0)
+		return EX_NOINPUT;
+
+	if (!(recv_features & LIRC_CAN_REC_MODE2)) {
+		fprintf(stderr, _("%s: device cannot receive raw ir\n"),
+			args->loopback);
+		close(recv_fd);
+		return EX_UNAVAILABLE;
+	}
+
+	mode = LIRC_MODE_MODE2;
+	if (ioctl(recv_fd, LIRC_SET_REC_MODE, &mode) && errno != ENOTTY) {
+		fprintf(stderr, _("%s: failed to set receive mode: %m\n"),
+			args->loopback);
+		close(recv_fd);
+		return EX_IOERR;
+	}
+
+	for (trial = 0; trial < args->trials; trial++) {
+		uint64_t latency;
+
+		if (loopback_trial(fd, recv_fd, f, false, &latency))
+			edge.missed++;
+		else
+			latency_record(&edge, latency);
+
+		usleep(args->gap);
+	}
+
+	// decoded scancodes are only reported in scancode receive mode
+	mode = LIRC_MODE_SCANCODE;
+	have_scancodes = ioctl(recv_fd, LIRC_SET_REC_MODE, &mode) == 0;
+	if (have_scancodes) {
+		for (trial = 0; trial < args->trials; trial++) {
+			uint64_t latency;
+
+			if (loopback_trial(fd, recv_fd, f, true, &latency))
+				key.missed++;
+			else
+				latency_record(&key, latency);
+
+			usleep(args->gap);
+		}
+	} else {
+		fprintf(stderr, _("%s: cannot report decoded scancodes, skipping edge-to-scancode measurement\n"),
+			args->loopback);
+	}
+
+	close(recv_fd);
+
+	latency_report(_("Edge-to-edge"), &edge);
+	if (have_scancodes)
+		latency_report(_("Edge-to-scancode"), &key);
+
+	return 0;
+}
+
 int lirc_receive(struct arguments *args, int fd, unsigned features)
 {
 	char *dev = args->device;
@@ -1250,6 +1742,7 @@ int main(int argc, char *argv[])
 		.gap = IR_DEFAULT_TIMEOUT,
 		.carrier = UNSET,
 		.timeout = UNSET,
+		.trials = 100,
 	};
 
 #ifdef ENABLE_NLS
@@ -1274,6 +1767,26 @@ int main(int argc, char *argv[])
 	if (rc)
 		exit(EX_IOERR);
 
+	if (args.loopback) {
+		rc = lirc_loopback(&args, fd, features);
+		free_keymap(args.keymap);
+		close(fd);
+		exit(rc);
+	}
+
+	if (args.batch) {
+		rc = lirc_send_batch(&args, fd, features);
+		if (rc) {
+			close(fd);
+			exit(rc);
+		}
+		while (args.batch) {
+			struct send *next = args.batch->next;
+			free(args.batch);
+			args.batch = next;
+		}
+	}
+
 	struct send *s = args.send;
 	while (s) {
 		struct send *next = s->next;
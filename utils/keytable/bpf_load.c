@@ -9,6 +9,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <linux/bpf.h>
@@ -30,6 +31,16 @@
 
 #define LOG_BUF_SIZE (256 * 1024)
 
+/*
+ * Verified programs are pinned in bpffs, keyed by a hash of the object
+ * file and everything that gets patched into it (parameters and raw
+ * patterns). Later invocations in the same boot then reattach the
+ * pinned program directly, skipping the ELF parsing, relocation and
+ * verifier passes. Everything here is best-effort: without a mounted
+ * bpffs or the needed privileges we simply load from scratch as before.
+ */
+#define BPF_PIN_DIR "/sys/fs/bpf/ir-keytable"
+
 // This should match the struct in the raw BPF decoder
 struct raw_pattern {
 	unsigned int scancode;
@@ -58,9 +69,60 @@ struct bpf_file {
 	int strtabidx;
 	Elf_Data *symbols;
 	struct protocol_param *param;
+	const char *pin;
 	char name[128];
 };
 
+static uint64_t pin_hash_bytes(uint64_t hash, const void *buf, size_t size)
+{
+	const uint8_t *p = buf;
+
+	while (size--) {
+		hash ^= *p++;
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+
+// Hash the object file plus everything patched into it; empty path on failure
+static void bpf_pin_path(char *path, size_t size, const char *obj,
+			 struct protocol_param *param, struct raw_entry *raw)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	struct protocol_param *p;
+	struct raw_entry *e;
+	char buf[4096];
+	ssize_t rc;
+	int fd;
+
+	path[0] = 0;
+
+	fd = open(obj, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	while ((rc = read(fd, buf, sizeof(buf))) > 0)
+		hash = pin_hash_bytes(hash, buf, rc);
+	close(fd);
+	if (rc < 0)
+		return;
+
+	for (p = param; p; p = p->next) {
+		hash = pin_hash_bytes(hash, p->name, strlen(p->name));
+		hash = pin_hash_bytes(hash, &p->value, sizeof(p->value));
+	}
+
+	for (e = raw; e; e = e->next) {
+		hash = pin_hash_bytes(hash, &e->scancode, sizeof(e->scancode));
+		hash = pin_hash_bytes(hash, e->raw,
+				      e->raw_length * sizeof(e->raw[0]));
+	}
+
+	snprintf(path, size, BPF_PIN_DIR "/%016llx",
+		 (unsigned long long)hash);
+}
+
 static int load_and_attach(int lirc_fd, struct bpf_file *bpf_file, struct bpf_insn *prog, int size)
 {
 	LIBBPF_OPTS(bpf_prog_load_opts, opts);
@@ -85,6 +147,17 @@ static int load_and_attach(int lirc_fd, struct bpf_file *bpf_file, struct bpf_in
 		return -1;
 	}
 
+	if (bpf_file->pin && bpf_file->pin[0]) {
+		mkdir(BPF_PIN_DIR, 0700);
+		if (bpf_obj_pin(fd, bpf_file->pin)) {
+			if (debug)
+				printf(_("failed to pin program as %s: %m\n"),
+				       bpf_file->pin);
+		} else if (debug) {
+			printf(_("pinned program as %s\n"), bpf_file->pin);
+		}
+	}
+
 	return 0;
 }
 
@@ -452,8 +525,25 @@ int load_bpf_file(const char *path, int lirc_fd, struct protocol_param *param,
 	GElf_Shdr shdr, shdr_prog;
 	Elf_Data *data, *data_prog, *data_map = NULL;
 	char *shname, *shname_prog;
+	char pin_path[256];
 	int nr_maps = 0;
 
+	bpf_pin_path(pin_path, sizeof(pin_path), path, param, raw);
+	if (pin_path[0]) {
+		fd = bpf_obj_get(pin_path);
+		if (fd >= 0) {
+			if (!bpf_prog_attach(fd, lirc_fd, BPF_LIRC_MODE2, 0)) {
+				if (debug)
+					printf(_("attached pinned program %s\n"),
+					       pin_path);
+				close(fd);
+				return 0;
+			}
+			close(fd);
+		}
+	}
+	bpf_file.pin = pin_path;
+
 	if (elf_version(EV_CURRENT) == EV_NONE)
 		return 1;
 
@@ -76,6 +76,13 @@ for my $e (@key) {
 }
 print "\t{ NULL, 0}\n};\n";
 
+# Index into key_events sorted case-insensitively by name, so that
+# parse_code() can resolve key names with a binary search.
+print "static const unsigned short key_events_by_name[] = {\n";
+my @order = sort { lc(${$key[$a]}[0]) cmp lc(${$key[$b]}[0]) } 0 .. $#key;
+print "\t$_,\n" for @order;
+print "};\n";
+
 print "struct parse_event rel_events[] = {\n";
 for my $e (@rel) {
 	my $name = @$e[0];
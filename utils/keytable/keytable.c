@@ -27,6 +27,9 @@
 #include <sys/types.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
 #include <dirent.h>
 #include <argp.h>
 #include <time.h>
@@ -228,11 +231,21 @@ static void write_sysfs_protocols(enum sysfs_protocols protocols, FILE *fp, cons
 
 static int parse_code(const char *string)
 {
-	struct parse_event *p;
+	int low = 0;
+	int high = sizeof(key_events_by_name) / sizeof(key_events_by_name[0]);
 
-	for (p = key_events; p->name != NULL; p++) {
-		if (!strcasecmp(p->name, string))
+	/* key_events_by_name is sorted case-insensitively by gen_input_events.pl */
+	while (low < high) {
+		int mid = (low + high) / 2;
+		const struct parse_event *p = &key_events[key_events_by_name[mid]];
+		int cmp = strcasecmp(string, p->name);
+
+		if (!cmp)
 			return p->value;
+		if (cmp > 0)
+			low = mid + 1;
+		else
+			high = mid;
 	}
 	return -1;
 }
@@ -264,7 +277,7 @@ static const char doc[] = N_(
 static const struct argp_option options[] = {
 	{"verbose",	'v',	0,		0,	N_("enables debug messages"), 0},
 	{"clear",	'c',	0,		0,	N_("Clears the scancode to keycode mappings"), 0},
-	{"sysdev",	's',	N_("SYSDEV"),	0,	N_("rc device to control, defaults to rc0 if not specified"), 0},
+	{"sysdev",	's',	N_("SYSDEV"),	0,	N_("rc device(s) to control, comma separated, defaults to rc0 if not specified"), 0},
 	{"test",	't',	0,		0,	N_("test if IR is generating events"), 0},
 	{"read",	'r',	0,		0,	N_("reads the current scancode/keycode mapping"), 0},
 	{"write",	'w',	N_("KEYMAP"),	0,	N_("write (adds) the keymap from the specified file"), 0},
@@ -274,6 +287,8 @@ static const struct argp_option options[] = {
 	{"delay",	'D',	N_("DELAY"),	0,	N_("Sets the delay before repeating a keystroke"), 0},
 	{"period",	'P',	N_("PERIOD"),	0,	N_("Sets the period to repeat a keystroke"), 0},
 	{"auto-load",	'a',	N_("CFGFILE"),	0,	N_("Auto-load keymaps, based on a configuration file. Only works with --sysdev."), 0},
+	{"daemon",	2,	0,		0,	N_("Run as a daemon and configure rc devices as they appear. Requires --auto-load."), 0},
+	{"stats",	3,	0,		0,	N_("Show decode statistics: enabled protocols, input event rate and BPF program run counts/CPU time"), 0},
 	{"test-keymap",	1,	N_("KEYMAP"),	0,	N_("Test if keymap is valid"), 0},
 	{"help",        '?',	0,		0,	N_("Give this help list"), -1},
 	{"usage",	-3,	0,		0,	N_("Give a short usage message")},
@@ -292,6 +307,8 @@ static int test = 0;
 static int delay = -1;
 static int period = -1;
 static int test_keymap = 0;
+static int daemon_mode = 0;
+static int stats = 0;
 static enum sysfs_protocols ch_proto = 0;
 
 struct bpf_protocol {
@@ -703,6 +720,12 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 		add_keymap(map, arg);
 		free_keymap(map);
 		break;
+	case 2:
+		daemon_mode++;
+		break;
+	case 3:
+		stats++;
+		break;
 	case '?':
 		argp_state_help(state, state->out_stream,
 				ARGP_HELP_SHORT_USAGE | ARGP_HELP_LONG
@@ -1898,6 +1921,173 @@ static void show_bpf(const char *lirc_name) {}
 static void clear_bpf(const char *lirc_name) {}
 #endif
 
+#define STATS_MAX_PROGS 64
+#define STATS_NAME_LEN 16
+
+struct bpf_stat_sample {
+	unsigned int id;
+	char name[STATS_NAME_LEN];
+	unsigned long long run_cnt;
+	unsigned long long run_time_ns;
+};
+
+#ifdef HAVE_BPF
+/*
+ * Snapshot run count and run time of every BPF program attached to the
+ * lirc device in one pass. Run time is only non-zero with
+ * kernel.bpf_stats_enabled=1. Returns the number of programs or -1.
+ */
+static int sample_bpf_stats(const char *lirc_name,
+			    struct bpf_stat_sample *sample, unsigned max)
+{
+	unsigned int prog_ids[MAX_PROGS], count = MAX_PROGS;
+	unsigned int features, i, n = 0;
+	int ret, fd, prog_fd;
+
+	fd = open(lirc_name, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	if (ioctl(fd, LIRC_GET_FEATURES, &features) ||
+	    !(features & LIRC_CAN_REC_MODE2)) {
+		close(fd);
+		return -1;
+	}
+
+	ret = bpf_prog_query(fd, BPF_LIRC_MODE2, 0, NULL, prog_ids, &count);
+	close(fd);
+	if (ret)
+		return -1;
+
+	for (i = 0; i < count && n < max; i++) {
+		struct bpf_prog_info info = {};
+		__u32 info_len = sizeof(info);
+
+		prog_fd = bpf_prog_get_fd_by_id(prog_ids[i]);
+		if (prog_fd == -1)
+			continue;
+
+		if (!bpf_obj_get_info_by_fd(prog_fd, &info, &info_len)) {
+			sample[n].id = prog_ids[i];
+			strncpy(sample[n].name, info.name,
+				STATS_NAME_LEN - 1);
+			sample[n].name[STATS_NAME_LEN - 1] = 0;
+			sample[n].run_cnt = info.run_cnt;
+			sample[n].run_time_ns = info.run_time_ns;
+			n++;
+		}
+		close(prog_fd);
+	}
+
+	return n;
+}
+#else
+static int sample_bpf_stats(const char *lirc_name,
+			    struct bpf_stat_sample *sample, unsigned max)
+{
+	return -1;
+}
+#endif
+
+/*
+ * Show where the decode load of a device goes: the enabled kernel
+ * decoders, the input event rate, and the run counts and CPU time of
+ * the attached BPF programs, sampled over a one second window.
+ */
+static void show_stats(struct rc_device *rc_dev)
+{
+	struct bpf_stat_sample before[STATS_MAX_PROGS];
+	struct bpf_stat_sample after[STATS_MAX_PROGS];
+	int n_before = -1, n_after = -1;
+	unsigned long long total_time = 0, interval_ms;
+	struct timespec t0, t1;
+	int input_fd, events = 0;
+	int i, j;
+
+	printf(_("%s:\n"), rc_dev->sysfs_name);
+	printf(_("\tEnabled kernel protocols: "));
+	write_sysfs_protocols(rc_dev->current, stdout, "%s ");
+	printf("\n");
+
+	if (rc_dev->lirc_name)
+		n_before = sample_bpf_stats(rc_dev->lirc_name, before,
+					    STATS_MAX_PROGS);
+
+	input_fd = open(rc_dev->input_name, O_RDONLY | O_NONBLOCK);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	// count input events over the sample window
+	for (;;) {
+		struct pollfd pfd = { .fd = input_fd, .events = POLLIN };
+		struct input_event ev[64];
+		int timeout;
+		ssize_t rc;
+
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		timeout = 1000 - ((t1.tv_sec - t0.tv_sec) * 1000 +
+				  (t1.tv_nsec - t0.tv_nsec) / 1000000);
+		if (timeout <= 0)
+			break;
+
+		if (input_fd < 0 || poll(&pfd, 1, timeout) <= 0)
+			continue;
+
+		rc = read(input_fd, ev, sizeof(ev));
+		for (i = 0; i < rc / (int)sizeof(ev[0]); i++)
+			if (ev[i].type != EV_SYN)
+				events++;
+	}
+
+	if (input_fd >= 0)
+		close(input_fd);
+
+	if (n_before >= 0)
+		n_after = sample_bpf_stats(rc_dev->lirc_name, after,
+					   STATS_MAX_PROGS);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	interval_ms = (t1.tv_sec - t0.tv_sec) * 1000 +
+		      (t1.tv_nsec - t0.tv_nsec) / 1000000;
+	if (!interval_ms)
+		interval_ms = 1;
+
+	printf(_("\tInput events: %d (%.1f events/sec)\n"),
+	       events, events * 1000.0 / interval_ms);
+
+	if (n_after <= 0) {
+		printf(_("\tNo BPF programs attached\n"));
+		return;
+	}
+
+	for (i = 0; i < n_after; i++) {
+		unsigned long long delta_cnt = after[i].run_cnt;
+		unsigned long long delta_time = after[i].run_time_ns;
+
+		for (j = 0; j < n_before; j++) {
+			if (before[j].id != after[i].id)
+				continue;
+			delta_cnt -= before[j].run_cnt;
+			delta_time -= before[j].run_time_ns;
+			break;
+		}
+
+		total_time += after[i].run_time_ns;
+
+		printf(_("\tBPF %s: %llu runs (%.1f/sec), %llu us CPU"),
+		       after[i].name[0] ? after[i].name : _("(unnamed)"),
+		       delta_cnt, delta_cnt * 1000.0 / interval_ms,
+		       delta_time / 1000);
+		if (delta_cnt)
+			printf(_(" (mean %llu ns/run)"),
+			       delta_time / delta_cnt);
+		printf("\n");
+	}
+
+	if (!total_time)
+		printf(_("\tBPF run time is all zero; enable accounting with: sysctl kernel.bpf_stats_enabled=1\n"));
+}
+
 static int show_sysfs_attribs(struct rc_device *rc_dev, char *name)
 {
 	static struct sysfs_names *names, *cur;
@@ -2030,9 +2220,253 @@ char* keymap_to_filename(const char *fname)
 	return NULL;
 }
 
+// Drop all per-device state built up by add_keymap()
+static void free_keytable_state(void)
+{
+	struct keytable_entry *ke;
+	struct raw_entry *re;
+
+	while ((ke = keytable)) {
+		keytable = ke->next;
+		free(ke);
+	}
+
+	while ((re = rawtable)) {
+		rawtable = re->next;
+		free(re->keycode);
+		free(re);
+	}
+
+	while (bpf_protocol) {
+		struct bpf_protocol *b = bpf_protocol;
+
+		bpf_protocol = b->next;
+		while (b->param) {
+			struct protocol_param *param = b->param;
+
+			b->param = param->next;
+			free(param->name);
+			free(param);
+		}
+		free(b->name);
+		free(b);
+	}
+
+	ch_proto = 0;
+}
+
+/*
+ * Configure one rc device from the in-memory rc_maps config. This is
+ * the daemon-mode equivalent of the --auto-load flow in main(): match
+ * the device against the config, load the matching keymaps and write
+ * them to the driver, then change protocols and attach BPF decoders
+ * where the keymaps ask for it.
+ */
+static int configure_device(char *sysfs_name)
+{
+	struct timespec load_start, load_end;
+	struct rc_device rc_dev;
+	struct cfgfile *cur;
+	struct keymap *map;
+	int matches = 0;
+	int fd, rc, write_cnt;
+	char *fname;
+
+	if (get_attribs(&rc_dev, sysfs_name))
+		return -1;
+
+	for (cur = &cfg; cur->next; cur = cur->next) {
+		if ((!rc_dev.drv_name || strcasecmp(cur->driver, rc_dev.drv_name)) && strcasecmp(cur->driver, "*"))
+			continue;
+		if ((!rc_dev.keytable_name || strcasecmp(cur->table, rc_dev.keytable_name)) && strcasecmp(cur->table, "*"))
+			continue;
+
+		if (debug)
+			fprintf(stderr, _("Keymap for %s, %s is on %s file.\n"),
+				rc_dev.drv_name, rc_dev.keytable_name,
+				cur->fname);
+
+		fname = keymap_to_filename(cur->fname);
+		if (!fname)
+			continue;
+
+		rc = parse_keymap(fname, &map, debug);
+		if (rc < 0) {
+			fprintf(stderr, _("Can't load %s keymap\n"), fname);
+			free(fname);
+			continue;
+		}
+		add_keymap(map, fname);
+		free_keymap(map);
+		free(fname);
+		matches++;
+	}
+
+	if (!matches) {
+		if (debug)
+			fprintf(stderr, _("Keymap for %s, %s not found. Keep as-is\n"),
+				rc_dev.drv_name, rc_dev.keytable_name);
+		return 0;
+	}
+
+	fd = open(rc_dev.input_name, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		perror(rc_dev.input_name);
+		free_keytable_state();
+		return -1;
+	}
+
+	if (get_input_protocol_version(fd)) {
+		close(fd);
+		free_keytable_state();
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &load_start);
+	clear_table(fd);
+	write_cnt = add_keys(fd);
+	clock_gettime(CLOCK_MONOTONIC, &load_end);
+	if (write_cnt)
+		fprintf(stderr, _("%s: wrote %d keycode(s) to driver in %.1f ms\n"),
+			sysfs_name, write_cnt,
+			(load_end.tv_sec - load_start.tv_sec) * 1000.0 +
+			(load_end.tv_nsec - load_start.tv_nsec) / 1e6);
+
+	if (ch_proto || bpf_protocol) {
+		if (rc_dev.lirc_name)
+			clear_bpf(rc_dev.lirc_name);
+
+		rc_dev.current = load_bpf_for_unsupported(ch_proto, rc_dev.supported);
+
+		if (!set_proto(&rc_dev)) {
+			fprintf(stderr, _("Protocols changed to "));
+			write_sysfs_protocols(rc_dev.current, stderr, "%s ");
+			fprintf(stderr, "\n");
+		}
+	}
+
+	if (bpf_protocol) {
+		struct bpf_protocol *b;
+
+		if (!rc_dev.lirc_name)
+			fprintf(stderr, _("Error: unable to attach bpf program, lirc device name was not found\n"));
+
+		for (b = bpf_protocol; b && rc_dev.lirc_name; b = b->next) {
+			fname = find_bpf_file(b->name);
+
+			if (fname) {
+				if (attach_bpf(rc_dev.lirc_name, fname, b->param))
+					fprintf(stderr, _("Loaded BPF protocol %s\n"), b->name);
+				free(fname);
+			}
+		}
+	}
+
+	close(fd);
+	free_keytable_state();
+	free(rc_dev.input_name);
+	free(rc_dev.lirc_name);
+	free(rc_dev.drv_name);
+	free(rc_dev.dev_name);
+	free(rc_dev.keytable_name);
+
+	return 0;
+}
+
+/*
+ * Daemon mode: parse the config once, then configure rc devices as
+ * their add events arrive over the kernel uevent netlink socket. This
+ * avoids the process storm of one ir-keytable invocation per device
+ * that a udev RUN rule causes on a hub reconnect.
+ */
+static int daemon_loop(void)
+{
+	struct sockaddr_nl addr = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = 1,
+	};
+	struct sysfs_names *names, *cur;
+	char buf[8192];
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+		    NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		perror("netlink socket");
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		perror("netlink bind");
+		close(fd);
+		return -1;
+	}
+
+	// configure the devices that already exist, after subscribing so
+	// that a device appearing right now is not missed
+	names = find_device(NULL);
+	if (names) {
+		for (cur = names; cur->next; cur = cur->next)
+			if (cur->name)
+				configure_device(cur->name);
+		free_names(names);
+	}
+
+	fprintf(stderr, _("ir-keytable: waiting for rc devices to appear\n"));
+
+	for (;;) {
+		const char *action = NULL, *subsystem = NULL, *kernel = NULL;
+		char dname[256];
+		ssize_t len;
+		int i;
+
+		len = recv(fd, buf, sizeof(buf) - 1, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("netlink recv");
+			break;
+		}
+		buf[len] = 0;
+
+		// skip the "action@devpath" header, then the properties
+		for (i = 0; i < len; i += strlen(buf + i) + 1) {
+			if (!strncmp(buf + i, "ACTION=", 7))
+				action = buf + i + 7;
+			else if (!strncmp(buf + i, "SUBSYSTEM=", 10))
+				subsystem = buf + i + 10;
+			else if (!strncmp(buf + i, "KERNEL=", 7))
+				kernel = buf + i + 7;
+		}
+
+		if (!action || !subsystem || !kernel ||
+		    strcmp(action, "add") || strcmp(subsystem, "rc"))
+			continue;
+
+		if (debug)
+			fprintf(stderr, _("Device %s appeared\n"), kernel);
+
+		snprintf(dname, sizeof(dname), "/sys/class/rc/%s/", kernel);
+
+		// The input and lirc child devices may arrive a little
+		// after the rc device itself; retry while they show up.
+		for (i = 0; i < 20; i++) {
+			if (!configure_device(dname))
+				break;
+			usleep(100000);
+		}
+		if (i == 20)
+			fprintf(stderr, _("%s: could not configure device\n"),
+				kernel);
+	}
+
+	close(fd);
+	return -1;
+}
+
 int main(int argc, char *argv[])
 {
 	int dev_from_class = 0, write_cnt;
+	struct timespec load_start, load_end;
 	int fd;
 	static struct sysfs_names *names;
 	struct rc_device	  rc_dev;
@@ -2048,8 +2482,20 @@ int main(int argc, char *argv[])
 	if (test_keymap)
 		return 0;
 
+	if (daemon_mode) {
+		if (!cfg.next) {
+			fprintf(stderr, _("Daemon mode requires a config file, use --auto-load\n"));
+			return -1;
+		}
+		if (clear || keytable || ch_proto || test || readtable) {
+			fprintf(stderr, _("Daemon mode can only be used with --auto-load and --verbose\n"));
+			return -1;
+		}
+		return daemon_loop();
+	}
+
 	/* Just list all devices */
-	if (!clear && !readtable && !keytable && !ch_proto && !cfg.next && !test && delay < 0 && period < 0 && !bpf_protocol) {
+	if (!clear && !readtable && !keytable && !ch_proto && !cfg.next && !test && delay < 0 && period < 0 && !bpf_protocol && !stats) {
 		if (show_sysfs_attribs(&rc_dev, devclass))
 			return -1;
 
@@ -2059,6 +2505,41 @@ int main(int argc, char *argv[])
 	if (!devclass)
 		devclass = "rc0";
 
+	/*
+	 * Configuring a device is dominated by waiting on driver ioctls,
+	 * so a comma-separated --sysdev list is handled by one child
+	 * process per device, configuring them in parallel.
+	 */
+	if (strchr(devclass, ',')) {
+		char *devlist = strdup(devclass);
+		char *saveptr = NULL;
+		bool is_child = false;
+		char *p;
+
+		for (p = strtok_r(devlist, ",", &saveptr); p;
+		     p = strtok_r(NULL, ",", &saveptr)) {
+			pid_t pid = fork();
+
+			if (pid < 0) {
+				perror("fork");
+				return -1;
+			}
+			if (pid == 0) {
+				devclass = p;
+				is_child = true;
+				break;
+			}
+		}
+		if (!is_child) {
+			int ret = 0, wstatus;
+
+			while (wait(&wstatus) > 0)
+				if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+					ret = -1;
+			return ret;
+		}
+	}
+
 	if (cfg.next && (clear || keytable || ch_proto)) {
 		fprintf (stderr, _("Auto-mode can be used only with --read, --verbose and --sysdev options\n"));
 		return -1;
@@ -2077,6 +2558,11 @@ int main(int argc, char *argv[])
 
 	dev_from_class++;
 
+	if (stats) {
+		show_stats(&rc_dev);
+		return 0;
+	}
+
 	if (cfg.next) {
 		struct cfgfile *cur;
 		struct keymap *map;
@@ -2135,6 +2621,7 @@ int main(int argc, char *argv[])
 	/*
 	 * First step: clear, if --clear is specified
 	 */
+	clock_gettime(CLOCK_MONOTONIC, &load_start);
 	if (clear) {
 		clear_table(fd);
 		fprintf(stderr, _("Old keytable cleared\n"));
@@ -2144,8 +2631,12 @@ int main(int argc, char *argv[])
 	 * Second step: stores key tables from file or from commandline
 	 */
 	write_cnt = add_keys(fd);
+	clock_gettime(CLOCK_MONOTONIC, &load_end);
 	if (write_cnt)
-		fprintf(stderr, _("Wrote %d keycode(s) to driver\n"), write_cnt);
+		fprintf(stderr, _("%s: wrote %d keycode(s) to driver in %.1f ms\n"),
+			devclass, write_cnt,
+			(load_end.tv_sec - load_start.tv_sec) * 1000.0 +
+			(load_end.tv_nsec - load_start.tv_nsec) / 1e6);
 
 	/*
 	 * Third step: change protocol
@@ -657,6 +657,634 @@ struct parse_event key_events[] = {
 	{"BTN_TRIGGER_HAPPY40", 0x2e7},
 	{ NULL, 0}
 };
+static const unsigned short key_events_by_name[] = {
+	250,
+	251,
+	252,
+	253,
+	254,
+	255,
+	256,
+	257,
+	258,
+	259,
+	267,
+	276,
+	277,
+	278,
+	279,
+	280,
+	281,
+	286,
+	282,
+	299,
+	484,
+	485,
+	486,
+	483,
+	285,
+	265,
+	266,
+	283,
+	317,
+	318,
+	269,
+	261,
+	263,
+	249,
+	296,
+	260,
+	287,
+	275,
+	262,
+	294,
+	264,
+	284,
+	295,
+	311,
+	312,
+	309,
+	268,
+	271,
+	272,
+	297,
+	298,
+	290,
+	292,
+	304,
+	302,
+	313,
+	305,
+	307,
+	306,
+	300,
+	303,
+	315,
+	308,
+	301,
+	314,
+	273,
+	274,
+	310,
+	291,
+	293,
+	270,
+	585,
+	586,
+	595,
+	596,
+	597,
+	598,
+	599,
+	600,
+	601,
+	602,
+	603,
+	604,
+	587,
+	605,
+	606,
+	607,
+	608,
+	609,
+	610,
+	611,
+	612,
+	613,
+	614,
+	588,
+	615,
+	616,
+	617,
+	618,
+	619,
+	620,
+	621,
+	622,
+	623,
+	624,
+	589,
+	625,
+	590,
+	591,
+	592,
+	593,
+	594,
+	288,
+	316,
+	289,
+	11,
+	2,
+	85,
+	411,
+	410,
+	3,
+	4,
+	517,
+	5,
+	6,
+	7,
+	8,
+	9,
+	10,
+	30,
+	375,
+	398,
+	129,
+	201,
+	487,
+	220,
+	338,
+	40,
+	493,
+	328,
+	343,
+	496,
+	480,
+	479,
+	481,
+	361,
+	516,
+	531,
+	359,
+	48,
+	160,
+	43,
+	14,
+	207,
+	234,
+	370,
+	235,
+	158,
+	380,
+	242,
+	241,
+	501,
+	543,
+	500,
+	401,
+	243,
+	222,
+	223,
+	442,
+	451,
+	443,
+	444,
+	445,
+	446,
+	447,
+	448,
+	449,
+	450,
+	489,
+	46,
+	140,
+	366,
+	210,
+	476,
+	468,
+	477,
+	478,
+	475,
+	473,
+	474,
+	221,
+	58,
+	352,
+	330,
+	372,
+	371,
+	214,
+	322,
+	540,
+	204,
+	162,
+	152,
+	51,
+	127,
+	159,
+	173,
+	216,
+	408,
+	492,
+	133,
+	137,
+	156,
+	32,
+	202,
+	525,
+	395,
+	416,
+	417,
+	419,
+	110,
+	146,
+	499,
+	382,
+	155,
+	363,
+	244,
+	400,
+	233,
+	404,
+	52,
+	107,
+	537,
+	358,
+	18,
+	178,
+	391,
+	163,
+	164,
+	213,
+	498,
+	106,
+	28,
+	332,
+	13,
+	1,
+	405,
+	176,
+	33,
+	59,
+	68,
+	86,
+	87,
+	185,
+	186,
+	187,
+	188,
+	189,
+	190,
+	191,
+	60,
+	192,
+	193,
+	194,
+	195,
+	196,
+	61,
+	62,
+	63,
+	64,
+	65,
+	66,
+	67,
+	206,
+	523,
+	331,
+	144,
+	217,
+	136,
+	373,
+	535,
+	420,
+	434,
+	435,
+	440,
+	436,
+	437,
+	421,
+	438,
+	422,
+	431,
+	432,
+	433,
+	423,
+	424,
+	425,
+	426,
+	427,
+	428,
+	429,
+	430,
+	441,
+	439,
+	161,
+	231,
+	406,
+	407,
+	132,
+	339,
+	34,
+	386,
+	321,
+	393,
+	41,
+	368,
+	35,
+	121,
+	122,
+	415,
+	123,
+	138,
+	91,
+	90,
+	101,
+	174,
+	209,
+	23,
+	412,
+	325,
+	418,
+	109,
+	172,
+	36,
+	491,
+	37,
+	89,
+	92,
+	497,
+	580,
+	581,
+	582,
+	583,
+	584,
+	227,
+	226,
+	228,
+	506,
+	507,
+	503,
+	505,
+	502,
+	504,
+	342,
+	82,
+	79,
+	80,
+	81,
+	75,
+	76,
+	77,
+	71,
+	72,
+	73,
+	55,
+	120,
+	83,
+	95,
+	116,
+	94,
+	181,
+	74,
+	78,
+	117,
+	182,
+	97,
+	38,
+	335,
+	374,
+	104,
+	511,
+	510,
+	56,
+	26,
+	29,
+	125,
+	42,
+	482,
+	100,
+	364,
+	403,
+	50,
+	111,
+	544,
+	553,
+	554,
+	555,
+	556,
+	557,
+	558,
+	559,
+	560,
+	561,
+	562,
+	545,
+	563,
+	564,
+	565,
+	566,
+	567,
+	568,
+	569,
+	570,
+	571,
+	572,
+	546,
+	573,
+	547,
+	548,
+	549,
+	550,
+	551,
+	552,
+	577,
+	578,
+	579,
+	576,
+	574,
+	575,
+	157,
+	532,
+	224,
+	409,
+	513,
+	365,
+	139,
+	399,
+	334,
+	248,
+	12,
+	341,
+	177,
+	360,
+	151,
+	93,
+	112,
+	49,
+	534,
+	542,
+	183,
+	396,
+	376,
+	529,
+	518,
+	165,
+	413,
+	452,
+	453,
+	514,
+	515,
+	454,
+	455,
+	456,
+	457,
+	458,
+	459,
+	460,
+	461,
+	464,
+	465,
+	466,
+	467,
+	463,
+	462,
+	69,
+	24,
+	319,
+	526,
+	134,
+	324,
+	25,
+	108,
+	103,
+	135,
+	118,
+	520,
+	198,
+	345,
+	171,
+	414,
+	205,
+	197,
+	356,
+	166,
+	115,
+	323,
+	394,
+	381,
+	530,
+	167,
+	208,
+	527,
+	148,
+	149,
+	199,
+	200,
+	329,
+	130,
+	333,
+	16,
+	212,
+	19,
+	538,
+	354,
+	169,
+	367,
+	184,
+	175,
+	230,
+	0,
+	377,
+	170,
+	247,
+	105,
+	509,
+	508,
+	99,
+	27,
+	96,
+	126,
+	54,
+	88,
+	512,
+	154,
+	488,
+	31,
+	350,
+	351,
+	232,
+	119,
+	344,
+	153,
+	494,
+	180,
+	70,
+	179,
+	215,
+	320,
+	528,
+	39,
+	229,
+	145,
+	141,
+	219,
+	379,
+	541,
+	536,
+	53,
+	142,
+	378,
+	524,
+	533,
+	211,
+	57,
+	402,
+	218,
+	392,
+	128,
+	519,
+	168,
+	337,
+	203,
+	225,
+	98,
+	20,
+	15,
+	353,
+	490,
+	383,
+	357,
+	326,
+	336,
+	472,
+	471,
+	470,
+	539,
+	355,
+	346,
+	347,
+	384,
+	22,
+	131,
+	238,
+	522,
+	102,
+	237,
+	47,
+	348,
+	349,
+	327,
+	362,
+	239,
+	240,
+	385,
+	521,
+	495,
+	397,
+	113,
+	114,
+	17,
+	143,
+	246,
+	236,
+	390,
+	469,
+	245,
+	150,
+	45,
+	147,
+	21,
+	369,
+	124,
+	44,
+	84,
+	340,
+	387,
+	388,
+	389,
+};
 struct parse_event rel_events[] = {
 	{"REL_X", 0x00},
 	{"REL_Y", 0x01},
@@ -81,11 +81,11 @@ sub process_func
 			$logswitch = "";
 		}
 		if ($cdc_case) {
-			$cdcmsgtable .= "\t{ $cec_msg, \"$msg_name\" },\n";
+			$cdcmsgtable{$cec_msg} = $msg_name;
 		} elsif ($htng_case) {
-			$htngmsgtable .= "\t{ $cec_msg, \"$msg_name\" },\n";
+			$htngmsgtable{$cec_msg} = $msg_name;
 		} else {
-			$msgtable .= "\t{ $cec_msg, \"$msg_name\" },\n";
+			$msgtable{$cec_msg} = $msg_name;
 		}
 		if (@args == 0) {
 			$logswitch .= "\tcase $cec_msg:\n";
@@ -267,14 +267,19 @@ sub process_func
 
 			if ($size && !defined($created_enum{$name})) {
 				$created_enum{$name} = 1;
+				# Sorted by type_name so parse_enum() can use binary search
 				$enums .= "static const struct cec_arg_enum_values type_$name\[\] = {\n";
 				my $common_prefix = maxprefix(@enum);
+				my @pairs;
 				foreach (@enum) {
 					$val = $_;
 					s/^$common_prefix//;
 					s/([A-Z])/\l\1/g;
 					s/_/-/g;
-					$enums .= "\t{ \"$_\", $val },\n";
+					push @pairs, [$_, $val];
+				}
+				foreach (sort { $a->[0] cmp $b->[0] } @pairs) {
+					$enums .= "\t{ \"$$_[0]\", $$_[1] },\n";
 				}
 				$enums .= "};\n\n";
 			}
@@ -355,6 +360,7 @@ while (<>) {
 		($name, $val) = /define (\S+)\s+(\S+)/;
 		if ($name =~ /^CEC_MSG/) {
 			$msgs{$name} = 1;
+			$msgval{$name} = $val =~ /^0[xX]/ ? hex($val) : $val + 0;
 		} elsif ($operand_name ne "" && $name =~ /^CEC_OP/) {
 			push @ops, $name;
 		}
@@ -524,22 +530,28 @@ print $fh <<'EOF';
 EOF
 close $fh;
 
+# Emitted sorted by opcode so the lookups can use binary search
+sub print_msgtable {
+	my ($fh, $var, %table) = @_;
+
+	printf $fh "static const struct msgtable $var\[\] = {\n";
+	foreach (sort { $msgval{$a} <=> $msgval{$b} } keys %table) {
+		printf $fh "\t{ %s, \"%s\" },\n", $_, $table{$_};
+	}
+	printf $fh "};\n\n";
+}
+
+$msgtable{"CEC_MSG_VENDOR_COMMAND"} = "VENDOR_COMMAND";
+$msgtable{"CEC_MSG_VENDOR_COMMAND_WITH_ID"} = "VENDOR_COMMAND_WITH_ID";
+$msgtable{"CEC_MSG_VENDOR_REMOTE_BUTTON_DOWN"} = "VENDOR_REMOTE_BUTTON_DOWN";
+$msgtable{"CEC_MSG_CDC_MESSAGE"} = "CDC_MESSAGE";
+
 open(my $fh, '>', 'cec-msgs-gen.h') or die "Could not open cec-msgs-gen.h for writing";
 printf $fh "struct msgtable {\n";
 printf $fh "\t__u8 opcode;\n";
 printf $fh "\tconst char *name;\n";
 printf $fh "};\n\n";
-printf $fh "static const struct msgtable msgtable[] = {\n";
-printf $fh "%s", $msgtable;
-printf $fh "\t{ CEC_MSG_VENDOR_COMMAND, \"VENDOR_COMMAND\" },\n";
-printf $fh "\t{ CEC_MSG_VENDOR_COMMAND_WITH_ID, \"VENDOR_COMMAND_WITH_ID\" },\n";
-printf $fh "\t{ CEC_MSG_VENDOR_REMOTE_BUTTON_DOWN, \"VENDOR_REMOTE_BUTTON_DOWN\" },\n";
-printf $fh "\t{ CEC_MSG_CDC_MESSAGE, \"CDC_MESSAGE\" },\n";
-printf $fh "};\n\n";
-printf $fh "static const struct msgtable cdcmsgtable[] = {\n";
-printf $fh "%s", $cdcmsgtable;
-printf $fh "};\n\n";
-printf $fh "static const struct msgtable htngmsgtable[] = {\n";
-printf $fh "%s", $htngmsgtable;
-printf $fh "};\n";
+print_msgtable($fh, "msgtable", %msgtable);
+print_msgtable($fh, "cdcmsgtable", %cdcmsgtable);
+print_msgtable($fh, "htngmsgtable", %htngmsgtable);
 close $fh;
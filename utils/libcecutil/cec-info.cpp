@@ -18,28 +18,42 @@
 
 #include "cec-msgs-gen.h"
 
-const char *cec_opcode2s(unsigned opcode)
+/* The msgtables are emitted sorted by opcode by cec-gen.pl */
+static const char *opcode_lookup(const struct msgtable *table, unsigned count,
+				 unsigned opcode)
 {
-	for (auto i : msgtable)
-		if (i.opcode == opcode)
-			return i.name;
+	unsigned low = 0;
+	unsigned high = count;
+
+	while (low < high) {
+		unsigned mid = (low + high) / 2;
+
+		if (table[mid].opcode < opcode)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low < count && table[low].opcode == opcode)
+		return table[low].name;
 	return nullptr;
 }
 
+const char *cec_opcode2s(unsigned opcode)
+{
+	return opcode_lookup(msgtable, sizeof(msgtable) / sizeof(msgtable[0]),
+			     opcode);
+}
+
 const char *cec_cdc_opcode2s(unsigned cdc_opcode)
 {
-	for (auto i : cdcmsgtable)
-		if (i.opcode == cdc_opcode)
-			return i.name;
-	return nullptr;
+	return opcode_lookup(cdcmsgtable, sizeof(cdcmsgtable) / sizeof(cdcmsgtable[0]),
+			     cdc_opcode);
 }
 
 const char *cec_htng_opcode2s(unsigned htng_opcode)
 {
-	for (auto i : htngmsgtable)
-		if (i.opcode == htng_opcode)
-			return i.name;
-	return nullptr;
+	return opcode_lookup(htngmsgtable, sizeof(htngmsgtable) / sizeof(htngmsgtable[0]),
+			     htng_opcode);
 }
 
 static std::string caps2s(unsigned caps)
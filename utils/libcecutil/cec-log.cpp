@@ -3,6 +3,8 @@
  * Copyright 2016 Cisco Systems, Inc. and/or its affiliates. All rights reserved.
  */
 
+#include <cstdarg>
+#include <cstdio>
 #include <string>
 
 #include <unistd.h>
@@ -14,6 +16,48 @@
 #include "cec-log.h"
 #include "compiler.h"
 
+/*
+ * All the formatting in this file (and in the generated cec-log-gen.h,
+ * which is compiled into this translation unit) goes through plain
+ * printf() calls. The macro below reroutes them: normally the output
+ * still goes to stdout, but while cec_log_msg_buf() is active the text
+ * is appended to the caller-provided buffer instead, without touching
+ * the heap. That keeps the cost of logging a message at pin-monitoring
+ * rates down to the vsnprintf() calls themselves.
+ */
+static char *log_buf;
+static size_t log_buf_size;
+static size_t log_buf_pos;
+
+__attribute__((format(printf, 1, 2)))
+static int cec_log_printf(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	if (!log_buf) {
+		n = vprintf(fmt, ap);
+	} else {
+		n = vsnprintf(log_buf + log_buf_pos,
+			      log_buf_size - log_buf_pos, fmt, ap);
+		if (n > 0) {
+			log_buf_pos += n;
+			/* on truncation, keep the position at the NUL */
+			if (log_buf_pos >= log_buf_size)
+				log_buf_pos = log_buf_size - 1;
+		}
+	}
+	va_end(ap);
+	return n;
+}
+
+#define printf cec_log_printf
+
+/* binary logging: when enabled, cec_log_msg() appends the raw struct
+ * cec_msg to the file instead of formatting it */
+static FILE *log_bin_file;
+
 static const struct cec_arg arg_u8 = {
 	CEC_ARG_TYPE_U8,
 };
@@ -110,7 +154,62 @@ static void log_u8_array(const char *arg_name, unsigned num, const __u8 *vals);
 static void log_unknown_msg(const struct cec_msg *msg);
 static void log_htng_unknown_msg(const struct cec_msg *msg);
 
+/* compile the generated formatter under a private name, so the public
+ * cec_log_msg() below can divert messages to the binary log instead */
+#define cec_log_msg cec_log_msg_fmt
 #include "cec-log-gen.h"
+#undef cec_log_msg
+
+void cec_log_msg(const struct cec_msg *msg)
+{
+	if (log_bin_file) {
+		fwrite(msg, sizeof(*msg), 1, log_bin_file);
+		return;
+	}
+	cec_log_msg_fmt(msg);
+}
+
+size_t cec_log_msg_buf(char *buf, size_t size, const struct cec_msg *msg)
+{
+	size_t len;
+
+	if (buf == nullptr || size == 0)
+		return 0;
+
+	buf[0] = '\0';
+	log_buf = buf;
+	log_buf_size = size;
+	log_buf_pos = 0;
+	cec_log_msg_fmt(msg);
+	len = log_buf_pos;
+	log_buf = nullptr;
+	return len;
+}
+
+bool cec_log_bin_open(const char *fname)
+{
+	__u32 msg_size = sizeof(struct cec_msg);
+
+	log_bin_file = fopen(fname, "wb");
+	if (log_bin_file == nullptr)
+		return false;
+	/* record the struct size, so readers can detect layout changes */
+	if (fwrite(CEC_LOG_BIN_MAGIC, CEC_LOG_BIN_MAGIC_LEN, 1, log_bin_file) != 1 ||
+	    fwrite(&msg_size, sizeof(msg_size), 1, log_bin_file) != 1) {
+		fclose(log_bin_file);
+		log_bin_file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void cec_log_bin_close(void)
+{
+	if (log_bin_file == nullptr)
+		return;
+	fclose(log_bin_file);
+	log_bin_file = nullptr;
+}
 
 const struct cec_msg_args *cec_log_msg_args(unsigned int index)
 {
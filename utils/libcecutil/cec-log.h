@@ -40,4 +40,24 @@ void cec_log_msg(const struct cec_msg *msg);
 void cec_log_htng_msg(const struct cec_msg *msg);
 const char *cec_log_ui_cmd_string(__u8 ui_cmd);
 
+/*
+ * Format the description of a message into a caller-provided buffer
+ * instead of writing it to stdout. No heap allocation is done; output
+ * that doesn't fit is truncated. Returns the length of the (always
+ * NUL-terminated) result.
+ */
+size_t cec_log_msg_buf(char *buf, size_t size, const struct cec_msg *msg);
+
+/*
+ * Quiet binary logging: while a binary log is open, cec_log_msg()
+ * appends the raw struct cec_msg to the file instead of formatting it,
+ * for post-processing. The file starts with the magic below, followed
+ * by the __u32 size of struct cec_msg.
+ */
+#define CEC_LOG_BIN_MAGIC "CECBIN01"
+#define CEC_LOG_BIN_MAGIC_LEN 8
+
+bool cec_log_bin_open(const char *fname);
+void cec_log_bin_close(void);
+
 #endif
@@ -164,11 +164,22 @@ int cec_parse_subopt(char **subs, const char * const *subopts, char **value)
 
 static unsigned parse_enum(const char *value, const struct cec_arg *a)
 {
+	int low = 0;
+	int high = a->num_enum_values;
+
 	if (isdigit(*value))
 		return strtoul(value, nullptr, 0);
-	for (int i = 0; i < a->num_enum_values; i++) {
-		if (!strcmp(value, a->values[i].type_name))
-			return a->values[i].value;
+	/* The type_name tables are emitted sorted by cec-gen.pl */
+	while (low < high) {
+		int mid = (low + high) / 2;
+		int cmp = strcmp(value, a->values[mid].type_name);
+
+		if (!cmp)
+			return a->values[mid].value;
+		if (cmp > 0)
+			low = mid + 1;
+		else
+			high = mid;
 	}
 	return 0;
 }
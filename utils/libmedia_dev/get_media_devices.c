@@ -601,3 +601,22 @@ const char *get_not_associated_device(void *opaque,
 
 	return result;
 }
+
+void for_each_media_device(void *opaque,
+			   void (*fn)(const char *device,
+				      const char *node,
+				      const enum device_type type,
+				      const enum bus_type bus,
+				      const unsigned major,
+				      const unsigned minor,
+				      void *priv),
+			   void *priv)
+{
+	struct media_devices *md = opaque;
+	struct media_device_entry *md_ptr = md->md_entry;
+	int i;
+
+	for (i = 0; i < md->md_size; i++, md_ptr++)
+		fn(md_ptr->device, md_ptr->node, md_ptr->type, md_ptr->bus,
+		   md_ptr->major, md_ptr->minor, priv);
+}
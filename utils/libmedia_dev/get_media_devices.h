@@ -168,3 +168,25 @@ const char *get_not_associated_device(void *opaque,
 				      const char *last_seek,
 				      const enum device_type desired_type,
 				      const enum device_type not_desired_type);
+
+/**
+ * for_each_media_device() - Calls a function for every media device
+ *
+ * @opaque:	media devices opaque descriptor
+ * @fn:		function to be called for each device entry
+ * @priv:	private data, passed unchanged to @fn
+ *
+ * Walks the in-memory device array once, in (device, type, node) order.
+ * As all the nodes of a physical device are adjacent in that order, a
+ * caller can rebuild the complete association map in a single pass,
+ * instead of issuing one query (and one array scan) per device.
+ */
+void for_each_media_device(void *opaque,
+			   void (*fn)(const char *device,
+				      const char *node,
+				      const enum device_type type,
+				      const enum bus_type bus,
+				      const unsigned major,
+				      const unsigned minor,
+				      void *priv),
+			   void *priv);
@@ -207,12 +207,46 @@ static void media_device_close(struct media_device *media)
  * Link setup
  */
 
+/* Issue the MEDIA_IOC_SETUP_LINK ioctl for a single link. The device must
+ * already be open.
+ */
+static int media_do_setup_link(struct media_device *media,
+			       struct media_link *link, __u32 flags)
+{
+	struct media_link_desc ulink = { { 0 } };
+	int ret;
+
+	/* source pad */
+	ulink.source.entity = link->source->entity->info.id;
+	ulink.source.index = link->source->index;
+	ulink.source.flags = MEDIA_PAD_FL_SOURCE;
+
+	/* sink pad */
+	ulink.sink.entity = link->sink->entity->info.id;
+	ulink.sink.index = link->sink->index;
+	ulink.sink.flags = MEDIA_PAD_FL_SINK;
+
+	ulink.flags = flags | (link->flags & MEDIA_LNK_FL_IMMUTABLE);
+
+	ret = ioctl(media->fd, MEDIA_IOC_SETUP_LINK, &ulink);
+	if (ret == -1) {
+		ret = -errno;
+		media_dbg(media, "%s: Unable to setup link (%s)\n",
+			  __func__, strerror(errno));
+		return ret;
+	}
+
+	link->flags = ulink.flags;
+	link->twin->flags = ulink.flags;
+
+	return 0;
+}
+
 int media_setup_link(struct media_device *media,
 		     struct media_pad *source,
 		     struct media_pad *sink,
 		     __u32 flags)
 {
-	struct media_link_desc ulink = { { 0 } };
 	struct media_link *link;
 	unsigned int i;
 	int ret;
@@ -237,30 +271,7 @@ int media_setup_link(struct media_device *media,
 		goto done;
 	}
 
-	/* source pad */
-	ulink.source.entity = source->entity->info.id;
-	ulink.source.index = source->index;
-	ulink.source.flags = MEDIA_PAD_FL_SOURCE;
-
-	/* sink pad */
-	ulink.sink.entity = sink->entity->info.id;
-	ulink.sink.index = sink->index;
-	ulink.sink.flags = MEDIA_PAD_FL_SINK;
-
-	ulink.flags = flags | (link->flags & MEDIA_LNK_FL_IMMUTABLE);
-
-	ret = ioctl(media->fd, MEDIA_IOC_SETUP_LINK, &ulink);
-	if (ret == -1) {
-		ret = -errno;
-		media_dbg(media, "%s: Unable to setup link (%s)\n",
-			  __func__, strerror(errno));
-		goto done;
-	}
-
-	link->flags = ulink.flags;
-	link->twin->flags = ulink.flags;
-
-	ret = 0;
+	ret = media_do_setup_link(media, link, flags);
 
 done:
 	media_device_close(media);
@@ -501,6 +512,30 @@ static int media_get_devname_sysfs(struct media_entity *entity)
 	return 0;
 }
 
+/* Copy the device name over from the previous snapshot if the entity still
+ * refers to the same device node, so that a refresh only pays for udev
+ * lookups on entities that actually changed.
+ */
+static bool media_get_devname_cached(struct media_device *media,
+				     struct media_entity *entity)
+{
+	unsigned int i;
+
+	for (i = 0; i < media->old_entities_count; ++i) {
+		struct media_entity *old = &media->old_entities[i];
+
+		if (old->info.id == entity->info.id &&
+		    old->info.dev.major == entity->info.dev.major &&
+		    old->info.dev.minor == entity->info.dev.minor &&
+		    old->devname[0] != '\0') {
+			strcpy(entity->devname, old->devname);
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static int media_enum_entities(struct media_device *media)
 {
 	struct media_entity *entity;
@@ -570,6 +605,10 @@ static int media_enum_entities(struct media_device *media)
 		if (!entity->info.dev.major && !entity->info.dev.minor)
 			continue;
 
+		/* Reuse the device name from the previous snapshot */
+		if (media_get_devname_cached(media, entity))
+			continue;
+
 		/* Try to get the device name via udev */
 		if (!media_get_devname_udev(udev, entity))
 			continue;
@@ -582,6 +621,24 @@ static int media_enum_entities(struct media_device *media)
 	return ret;
 }
 
+/* Query the graph generation counter with MEDIA_IOC_G_TOPOLOGY. With all
+ * array pointers left at zero the kernel only fills in the counts and the
+ * topology version, so this is a single cheap ioctl.
+ */
+static int media_get_topology_version(struct media_device *media,
+				      __u64 *version)
+{
+	struct media_v2_topology topology = { 0 };
+	int ret;
+
+	ret = ioctl(media->fd, MEDIA_IOC_G_TOPOLOGY, &topology);
+	if (ret < 0)
+		return -errno;
+
+	*version = topology.topology_version;
+	return 0;
+}
+
 int media_device_enumerate(struct media_device *media)
 {
 	int ret;
@@ -625,6 +682,14 @@ int media_device_enumerate(struct media_device *media)
 		goto done;
 	}
 
+	/* Record the topology version of the snapshot we just built, so
+	 * that media_device_refresh() can skip re-enumeration when the
+	 * graph hasn't changed. Old kernels don't support the ioctl; the
+	 * snapshot is then treated as always stale on refresh.
+	 */
+	media->topology_valid =
+		!media_get_topology_version(media, &media->topology_version);
+
 	ret = 0;
 
 done:
@@ -632,6 +697,66 @@ done:
 	return ret;
 }
 
+static void media_free_entities(struct media_entity *entities,
+				unsigned int entities_count)
+{
+	unsigned int i;
+
+	for (i = 0; i < entities_count; ++i) {
+		struct media_entity *entity = &entities[i];
+
+		free(entity->pads);
+		free(entity->links);
+		if (entity->fd != -1)
+			close(entity->fd);
+	}
+
+	free(entities);
+}
+
+int media_device_refresh(struct media_device *media)
+{
+	__u64 version = 0;
+	int ret;
+
+	if (!media->entities)
+		return media_device_enumerate(media);
+
+	ret = media_device_open(media);
+	if (ret < 0)
+		return ret;
+
+	ret = media_get_topology_version(media, &version);
+	media_device_close(media);
+
+	if (!ret && media->topology_valid &&
+	    version == media->topology_version) {
+		media_dbg(media, "Topology unchanged (version %llu)\n",
+			  (unsigned long long)version);
+		return 0;
+	}
+
+	/* The topology changed (or the kernel can't report a version):
+	 * drop the cached graph and enumerate it again. The old entities
+	 * are kept around until the enumeration is done so that their
+	 * resolved device names can be copied over instead of being looked
+	 * up through udev again.
+	 */
+	media->old_entities = media->entities;
+	media->old_entities_count = media->entities_count;
+	media->entities = NULL;
+	media->entities_count = 0;
+	memset(&media->def, 0, sizeof(media->def));
+
+	ret = media_device_enumerate(media);
+
+	media_free_entities(media->old_entities, media->old_entities_count);
+	media->old_entities = NULL;
+	media->old_entities_count = 0;
+
+	return ret;
+}
+
 /* -----------------------------------------------------------------------------
  * Create/destroy
  */
@@ -707,22 +832,11 @@ struct media_device *media_device_ref(struct media_device *media)
 
 void media_device_unref(struct media_device *media)
 {
-	unsigned int i;
-
 	media->refcount--;
 	if (media->refcount > 0)
 		return;
 
-	for (i = 0; i < media->entities_count; ++i) {
-		struct media_entity *entity = &media->entities[i];
-
-		free(entity->pads);
-		free(entity->links);
-		if (entity->fd != -1)
-			close(entity->fd);
-	}
-
-	free(media->entities);
+	media_free_entities(media->entities, media->entities_count);
 	free(media->devnode);
 	free(media);
 }
@@ -920,11 +1034,11 @@ struct media_link *media_parse_link(struct media_device *media,
 	return NULL;
 }
 
-int media_parse_setup_link(struct media_device *media,
-			   const char *p, char **endp)
+static int media_parse_link_flags(struct media_device *media,
+				  const char *p, char **endp,
+				  struct media_link **linkp, __u32 *flagsp)
 {
 	struct media_link *link;
-	__u32 flags;
 	char *end;
 
 	link = media_parse_link(media, p, &end);
@@ -942,7 +1056,7 @@ int media_parse_setup_link(struct media_device *media,
 		return -EINVAL;
 	}
 
-	flags = strtoul(p, &end, 10);
+	*flagsp = strtoul(p, &end, 10);
 	for (p = end; isspace(*p); p++);
 	if (*p++ != ']') {
 		media_dbg(media, "Unable to parse link flags: expected ']'.\n");
@@ -952,6 +1066,21 @@ int media_parse_setup_link(struct media_device *media,
 
 	for (; isspace(*p); p++);
 	*endp = (char *)p;
+	*linkp = link;
+
+	return 0;
+}
+
+int media_parse_setup_link(struct media_device *media,
+			   const char *p, char **endp)
+{
+	struct media_link *link;
+	__u32 flags;
+	int ret;
+
+	ret = media_parse_link_flags(media, p, endp, &link, &flags);
+	if (ret < 0)
+		return ret;
 
 	media_dbg(media,
 		  "Setting up link %u:%u -> %u:%u [%u]\n",
@@ -996,3 +1125,115 @@ int media_parse_setup_links(struct media_device *media, const char *p)
 
 	return *end ? -EINVAL : 0;
 }
+
+struct media_link_plan *media_parse_link_plan(struct media_device *media,
+					      const char *p)
+{
+	struct media_link_plan *plan;
+	char *end;
+	int ret;
+
+	plan = calloc(1, sizeof(*plan));
+	if (plan == NULL)
+		return NULL;
+
+	plan->media = media;
+
+	do {
+		struct media_link_plan_entry *entries;
+		struct media_link *link;
+		__u32 flags;
+
+		ret = media_parse_link_flags(media, p, &end, &link, &flags);
+		if (ret < 0) {
+			media_print_streampos(media, p, end);
+			goto error;
+		}
+
+		entries = realloc(plan->entries,
+				  (plan->count + 1) * sizeof(*entries));
+		if (entries == NULL)
+			goto error;
+
+		plan->entries = entries;
+		entries[plan->count].link = link;
+		entries[plan->count].flags = flags;
+		plan->count++;
+
+		p = end + 1;
+	} while (*end == ',');
+
+	if (*end)
+		goto error;
+
+	media_dbg(media, "Compiled link plan with %u entries\n", plan->count);
+
+	return plan;
+
+error:
+	media_link_plan_destroy(plan);
+	return NULL;
+}
+
+int media_apply_link_plan(struct media_link_plan *plan)
+{
+	struct media_device *media = plan->media;
+	unsigned int changed = 0;
+	unsigned int pass, i;
+	int ret;
+
+	ret = media_device_open(media);
+	if (ret < 0)
+		return ret;
+
+	/* Apply the disabled links in a first pass, so that sink pads that
+	 * only accept a single enabled link are released before their new
+	 * source link is enabled.
+	 */
+	for (pass = 0; pass < 2; ++pass) {
+		for (i = 0; i < plan->count; ++i) {
+			struct media_link_plan_entry *entry = &plan->entries[i];
+			struct media_link *link = entry->link;
+			__u32 flags = entry->flags |
+				      (link->flags & MEDIA_LNK_FL_IMMUTABLE);
+
+			if (!!(flags & MEDIA_LNK_FL_ENABLED) != pass)
+				continue;
+
+			/* Only issue links that differ from the cached state */
+			if (link->flags == flags)
+				continue;
+
+			media_dbg(media,
+				  "Setting up link %u:%u -> %u:%u [%u]\n",
+				  link->source->entity->info.id,
+				  link->source->index,
+				  link->sink->entity->info.id,
+				  link->sink->index, entry->flags);
+
+			ret = media_do_setup_link(media, link, entry->flags);
+			if (ret < 0)
+				goto done;
+
+			changed++;
+		}
+	}
+
+	media_dbg(media, "Link plan applied, %u of %u links changed\n",
+		  changed, plan->count);
+
+	ret = 0;
+
+done:
+	media_device_close(media);
+	return ret;
+}
+
+void media_link_plan_destroy(struct media_link_plan *plan)
+{
+	if (plan == NULL)
+		return;
+
+	free(plan->entries);
+	free(plan);
+}
@@ -762,26 +762,34 @@ static int set_frame_interval(struct media_pad *pad,
 }
 
 
-static int v4l2_subdev_parse_setup_format(struct media_device *media,
-					  const char *p, char **endp)
-{
-	struct v4l2_mbus_framefmt format = { 0, 0, 0 };
+/* One parsed pad format description, ready to be applied. The settings are
+ * copied to the stack before being issued, as the drivers adjust them in
+ * place and the same setup can be applied multiple times.
+ */
+struct v4l2_subdev_setup {
 	struct media_pad *pad;
-	struct v4l2_rect crop = { -1, -1, -1, -1 };
-	struct v4l2_rect compose = crop;
-	struct v4l2_fract interval = { 0, 0 };
+	struct v4l2_mbus_framefmt format;
+	struct v4l2_rect crop;
+	struct v4l2_rect compose;
+	struct v4l2_fract interval;
+};
+
+struct v4l2_subdev_setup_plan {
+	struct media_device *media;
+	struct v4l2_subdev_setup *setups;
+	unsigned int count;
+};
+
+static int v4l2_subdev_apply_setup(const struct v4l2_subdev_setup *setup)
+{
+	struct v4l2_mbus_framefmt format = setup->format;
+	struct v4l2_rect crop = setup->crop;
+	struct v4l2_rect compose = setup->compose;
+	struct v4l2_fract interval = setup->interval;
+	struct media_pad *pad = setup->pad;
 	unsigned int i;
-	char *end;
 	int ret;
 
-	pad = v4l2_subdev_parse_pad_format(media, &format, &crop, &compose,
-					   &interval, p, &end);
-	if (pad == NULL) {
-		media_print_streampos(media, p, end);
-		media_dbg(media, "Unable to parse format\n");
-		return -EINVAL;
-	}
-
 	if (pad->flags & MEDIA_PAD_FL_SINK) {
 		ret = set_format(pad, &format);
 		if (ret < 0)
@@ -830,10 +838,49 @@ static int v4l2_subdev_parse_setup_format(struct media_device *media,
 		}
 	}
 
+	return 0;
+}
+
+static int v4l2_subdev_parse_one_setup(struct media_device *media,
+				       struct v4l2_subdev_setup *setup,
+				       const char *p, char **endp)
+{
+	char *end;
+
+	memset(setup, 0, sizeof(*setup));
+	setup->crop.left = -1;
+	setup->crop.top = -1;
+	setup->crop.width = -1;
+	setup->crop.height = -1;
+	setup->compose = setup->crop;
+
+	setup->pad = v4l2_subdev_parse_pad_format(media, &setup->format,
+						  &setup->crop, &setup->compose,
+						  &setup->interval, p, &end);
+	if (setup->pad == NULL) {
+		media_print_streampos(media, p, end);
+		media_dbg(media, "Unable to parse format\n");
+		*endp = end;
+		return -EINVAL;
+	}
+
 	*endp = end;
 	return 0;
 }
 
+static int v4l2_subdev_parse_setup_format(struct media_device *media,
+					  const char *p, char **endp)
+{
+	struct v4l2_subdev_setup setup;
+	int ret;
+
+	ret = v4l2_subdev_parse_one_setup(media, &setup, p, endp);
+	if (ret < 0)
+		return ret;
+
+	return v4l2_subdev_apply_setup(&setup);
+}
+
 int v4l2_subdev_parse_setup_formats(struct media_device *media, const char *p)
 {
 	char *end;
@@ -851,6 +898,83 @@ int v4l2_subdev_parse_setup_formats(struct media_device *media, const char *p)
 	return *end ? -EINVAL : 0;
 }
 
+struct v4l2_subdev_setup_plan *
+v4l2_subdev_parse_setup_plan(struct media_device *media, const char *p)
+{
+	struct v4l2_subdev_setup_plan *plan;
+	char *end;
+	int ret;
+
+	plan = calloc(1, sizeof(*plan));
+	if (plan == NULL)
+		return NULL;
+
+	plan->media = media;
+
+	do {
+		struct v4l2_subdev_setup *setups;
+		struct v4l2_subdev_setup setup;
+
+		ret = v4l2_subdev_parse_one_setup(media, &setup, p, &end);
+		if (ret < 0)
+			goto error;
+
+		/* Open the subdev now so that applying the plan doesn't pay
+		 * for the open. The cached fd lives in the entity and is
+		 * closed when the media device is destroyed.
+		 */
+		ret = v4l2_subdev_open(setup.pad->entity);
+		if (ret < 0)
+			goto error;
+
+		setups = realloc(plan->setups,
+				 (plan->count + 1) * sizeof(*setups));
+		if (setups == NULL)
+			goto error;
+
+		plan->setups = setups;
+		setups[plan->count++] = setup;
+
+		for (; isspace(*end); end++);
+		p = end + 1;
+	} while (*end == ',');
+
+	if (*end)
+		goto error;
+
+	media_dbg(media, "Compiled subdev setup plan with %u entries\n",
+		  plan->count);
+
+	return plan;
+
+error:
+	v4l2_subdev_setup_plan_destroy(plan);
+	return NULL;
+}
+
+int v4l2_subdev_apply_setup_plan(struct v4l2_subdev_setup_plan *plan)
+{
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < plan->count; ++i) {
+		ret = v4l2_subdev_apply_setup(&plan->setups[i]);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+void v4l2_subdev_setup_plan_destroy(struct v4l2_subdev_setup_plan *plan)
+{
+	if (plan == NULL)
+		return;
+
+	free(plan->setups);
+	free(plan);
+}
+
 static const struct {
 	const char *name;
 	enum v4l2_mbus_pixelcode code;
@@ -22,6 +22,8 @@
 #ifndef __MEDIA_PRIV_H__
 #define __MEDIA_PRIV_H__
 
+#include <stdbool.h>
+
 #include <linux/media.h>
 
 #include "mediactl.h"
@@ -47,6 +49,19 @@ struct media_device {
 	struct media_entity *entities;
 	unsigned int entities_count;
 
+	/* Topology version of the cached snapshot, as reported by
+	 * MEDIA_IOC_G_TOPOLOGY. Valid only when topology_valid is set;
+	 * older kernels don't implement the ioctl.
+	 */
+	__u64 topology_version;
+	bool topology_valid;
+
+	/* Previous snapshot, kept alive while re-enumerating so that
+	 * already resolved device names can be reused.
+	 */
+	struct media_entity *old_entities;
+	unsigned int old_entities_count;
+
 	void (*debug_handler)(void *, ...);
 	void *debug_priv;
 
@@ -58,6 +73,17 @@ struct media_device {
 	} def;
 };
 
+struct media_link_plan_entry {
+	struct media_link *link;
+	__u32 flags;
+};
+
+struct media_link_plan {
+	struct media_device *media;
+	struct media_link_plan_entry *entries;
+	unsigned int count;
+};
+
 #define media_dbg(media, ...) \
 	(media)->debug_handler((media)->debug_priv, __VA_ARGS__)
 
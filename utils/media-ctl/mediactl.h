@@ -41,6 +41,7 @@ struct media_pad {
 
 struct media_device;
 struct media_entity;
+struct media_link_plan;
 
 /**
  * @brief Create a new media device.
@@ -157,6 +158,27 @@ void media_debug_set_handler(
  */
 int media_device_enumerate(struct media_device *media);
 
+/**
+ * @brief Refresh the cached device topology
+ * @param media - device instance.
+ *
+ * Check whether the media graph has changed since it was enumerated, using
+ * the topology version reported by the kernel, and re-enumerate the entities,
+ * pads and links only if it has. When the graph is unchanged this costs a
+ * single ioctl, making the function suitable for polling from long-running
+ * processes. Device names that were already resolved are carried over to the
+ * new snapshot, so only entities that changed pay for a udev lookup.
+ *
+ * All entity, pad and link pointers previously obtained from @a media are
+ * invalidated if the graph is re-enumerated.
+ *
+ * On kernels without MEDIA_IOC_G_TOPOLOGY support the graph version cannot
+ * be checked and every call re-enumerates the device.
+ *
+ * @return Zero on success or a negative error code on failure.
+ */
+int media_device_refresh(struct media_device *media);
+
 /**
  * @brief Locate the pad at the other end of a link.
  * @param pad - sink pad at one end of the link.
@@ -433,4 +455,47 @@ int media_parse_setup_link(struct media_device *media,
  */
 int media_parse_setup_links(struct media_device *media, const char *p);
 
+/**
+ * @brief Compile a link setup string into a reusable plan.
+ * @param media - media device.
+ * @param p - input string
+ *
+ * Parse NULL terminated string p describing link(s) separated by commas (,),
+ * in the same format as media_parse_setup_links(), and return a compiled plan
+ * that can be applied repeatedly with media_apply_link_plan(). Parsing and
+ * entity lookup are done once here; applying the plan only diffs the desired
+ * flags against the cached link state.
+ *
+ * The plan references the entities and links of @a media and is invalidated
+ * when the device topology is re-enumerated.
+ *
+ * @return Pointer to the compiled plan on success, NULL on failure.
+ */
+struct media_link_plan *media_parse_link_plan(struct media_device *media,
+					      const char *p);
+
+/**
+ * @brief Apply a compiled link plan.
+ * @param plan - plan returned by media_parse_link_plan().
+ *
+ * Configure all links described by the plan on the media device. Links whose
+ * cached flags already match the desired flags are skipped, so repeated mode
+ * switches only issue ioctls for the links that actually change. Links being
+ * disabled are applied before links being enabled, so that sink pads that
+ * accept a single enabled link are released first. The device is opened once
+ * for the whole plan.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int media_apply_link_plan(struct media_link_plan *plan);
+
+/**
+ * @brief Destroy a compiled link plan.
+ * @param plan - plan returned by media_parse_link_plan().
+ *
+ * Free the memory associated with the plan. The media device itself is not
+ * affected.
+ */
+void media_link_plan_destroy(struct media_link_plan *plan);
+
 #endif
@@ -235,6 +235,49 @@ int v4l2_subdev_set_frame_interval(struct media_entity *entity,
  */
 int v4l2_subdev_parse_setup_formats(struct media_device *media, const char *p);
 
+struct v4l2_subdev_setup_plan;
+
+/**
+ * @brief Compile a format setup string into a reusable plan.
+ * @param media - media device.
+ * @param p - input string
+ *
+ * Parse string @a p, in the same format as v4l2_subdev_parse_setup_formats(),
+ * into a plan that can be applied repeatedly with
+ * v4l2_subdev_apply_setup_plan(). The string is tokenized and the pads are
+ * resolved once here, and the subdev device nodes are opened so that applying
+ * the plan only issues the ioctls.
+ *
+ * The plan references the entities and pads of @a media and is invalidated
+ * when the device topology is re-enumerated.
+ *
+ * @return Pointer to the compiled plan on success, NULL on failure.
+ */
+struct v4l2_subdev_setup_plan *
+v4l2_subdev_parse_setup_plan(struct media_device *media, const char *p);
+
+/**
+ * @brief Apply a compiled format setup plan.
+ * @param plan - plan returned by v4l2_subdev_parse_setup_plan().
+ *
+ * Apply the format, selection and frame interval settings described by the
+ * plan, in order, including the propagation of formats over enabled links to
+ * remote subdev sink pads. The plan itself is not modified and can be applied
+ * again, for instance on the next switch back to the same mode.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int v4l2_subdev_apply_setup_plan(struct v4l2_subdev_setup_plan *plan);
+
+/**
+ * @brief Destroy a compiled format setup plan.
+ * @param plan - plan returned by v4l2_subdev_parse_setup_plan().
+ *
+ * Free the memory associated with the plan. The media device and the cached
+ * subdev file descriptors are not affected.
+ */
+void v4l2_subdev_setup_plan_destroy(struct v4l2_subdev_setup_plan *plan);
+
 /**
  * @brief Convert media bus pixel code to string.
  * @param code - input string
@@ -23,6 +23,7 @@ CaptureWinQt::CaptureWinQt(ApplicationWindow *aw) :
 	CaptureWin(aw),
 	m_image(new QImage(0, 0, QImage::Format_Invalid)),
 	m_data(NULL),
+	m_linearFilter(false),
 	m_supportedFormat(false),
 	m_filled(false),
 	m_cropBytes(0),
@@ -30,6 +31,11 @@ CaptureWinQt::CaptureWinQt(ApplicationWindow *aw) :
 {
 	m_videoSurface = new QLabel(this);
 	CaptureWin::buildWindow(m_videoSurface);
+	m_scaler = new FrameScaler(this);
+	// The scaler thread emits this, so the connection is queued and
+	// only the final blit runs on the GUI thread.
+	connect(m_scaler, SIGNAL(frameScaled(QImage)),
+		this, SLOT(setScaledPixmap(QImage)));
 }
 
 CaptureWinQt::~CaptureWinQt()
@@ -101,6 +107,17 @@ void CaptureWinQt::paintFrame()
 
 	unsigned char *data = (m_data == NULL) ? m_image->bits() : m_data;
 
+	// Resize on the scaler thread; the GUI thread only blits the
+	// result once setScaledPixmap() is delivered.
+	if (m_scaledSize != m_crop.size &&
+	    FrameScaler::canScale(m_image->format())) {
+		m_scaler->scaleFrame(&data[m_cropOffset],
+				     m_image->width() * (m_image->depth() / 8),
+				     m_crop.size, m_scaledSize,
+				     m_image->format(), m_linearFilter);
+		return;
+	}
+
 	QImage displayFrame(&data[m_cropOffset],
 			    m_crop.size.width(), m_crop.size.height(),
 			    m_image->width() * (m_image->depth() / 8),
@@ -114,6 +131,11 @@ void CaptureWinQt::paintFrame()
 	m_videoSurface->setPixmap(img);
 }
 
+void CaptureWinQt::setScaledPixmap(const QImage &image)
+{
+	m_videoSurface->setPixmap(QPixmap::fromImage(image));
+}
+
 void CaptureWinQt::stop()
 {
 	if (m_data != NULL)
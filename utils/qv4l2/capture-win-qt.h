@@ -22,6 +22,7 @@
 
 #include "qv4l2.h"
 #include "capture-win.h"
+#include "frame-scaler.h"
 
 #include <QLabel>
 #include <QImage>
@@ -29,6 +30,8 @@
 
 class CaptureWinQt : public CaptureWin
 {
+	Q_OBJECT
+
 public:
 	CaptureWinQt(ApplicationWindow *aw);
 	~CaptureWinQt();
@@ -40,12 +43,15 @@ public:
 			unsigned ycbcr_enc, unsigned quantization, bool is_sdtv) {}
 	void setField(unsigned field) {}
 	void setBlending(bool enable) {}
-	void setLinearFilter(bool enable) {}
+	void setLinearFilter(bool enable) { m_linearFilter = enable; }
 
 protected:
 	void resizeEvent(QResizeEvent *event);
 	void setRenderFrame();
 
+private slots:
+	void setScaledPixmap(const QImage &image);
+
 private:
 	bool findNativeFormat(__u32 format, QImage::Format &dstFmt);
 	void paintFrame();
@@ -53,6 +59,8 @@ private:
 	QImage *m_image;
 	unsigned char *m_data;
 	QLabel *m_videoSurface;
+	FrameScaler *m_scaler;
+	bool m_linearFilter;
 	bool m_supportedFormat;
 	bool m_filled;
 	int m_cropBytes;
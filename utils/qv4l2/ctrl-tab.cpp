@@ -142,6 +142,7 @@ void ApplicationWindow::addTabs(int m_winWidth)
 			m_row++;
 		}
 		m_tabs->addTab(t, tabName);
+		m_ctrlTabMap[t] = which;
 		for (i = 0; i < iter->second.size(); i++) {
 			if (i & 1)
 				id = iter->second[(1+iter->second.size()) / 2 + i / 2];
@@ -237,7 +238,11 @@ void ApplicationWindow::finishGrid(QGridLayout *grid, unsigned which)
 	grid->addWidget(m_w, m_row, 3, Qt::AlignRight);
 	cbox->setChecked(true);
 
-	refresh(which);
+	// Don't query the control values yet: ctrlTabChanged() does that the
+	// first time this tab becomes visible. That way opening a device only
+	// costs the queries for the visible tab instead of for every control
+	// the driver exposes.
+	m_ctrlStale[which] = true;
 }
 
 void ApplicationWindow::addCtrl(QGridLayout *grid, const v4l2_query_ext_ctrl &qec)
@@ -689,12 +694,29 @@ void ApplicationWindow::refresh(unsigned which)
 		}
 	}
 	delete [] c;
+	m_ctrlStale[which] = false;
 }
 
 void ApplicationWindow::refresh()
 {
+	// Only the visible control tab is refreshed immediately, the others
+	// are marked stale and refreshed when the user switches to them.
 	for (ClassMap::iterator iter = m_classMap.begin(); iter != m_classMap.end(); ++iter)
-		refresh(iter->first);
+		m_ctrlStale[iter->first] = true;
+	ctrlTabChanged(m_tabs->currentIndex());
+}
+
+void ApplicationWindow::ctrlTabChanged(int index)
+{
+	QWidget *page = m_tabs->widget(index);
+
+	if (page == NULL)
+		return;
+
+	std::map<QWidget *, unsigned>::iterator iter = m_ctrlTabMap.find(page);
+
+	if (iter != m_ctrlTabMap.end() && m_ctrlStale[iter->second])
+		refresh(iter->second);
 }
 
 void ApplicationWindow::setWhat(QWidget *w, unsigned id, const QString &v)
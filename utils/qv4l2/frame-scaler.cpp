@@ -0,0 +1,328 @@
+/* qv4l2: a control panel controlling v4l2 devices.
+ *
+ * Copyright (C) 2006 Hans Verkuil <hverkuil@xs4all.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "frame-scaler.h"
+
+#include <vector>
+
+/*
+ * The kernels work in 7-bit fixed point: a weight and its complement
+ * always sum to 128, so two weighted 8-bit channels fit a 16-bit lane
+ * and the SIMD vertical blend needs no widening beyond that.  Sampling
+ * is center aligned, like QImage's own smooth scaling.
+ */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ < 5
+/* too old for reliable target attributes / __builtin_cpu_supports */
+#elif defined(__i386__) || defined(__x86_64__)
+#define QV4L2_X86_SIMD 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define QV4L2_NEON_SIMD 1
+#include <arm_neon.h>
+#endif
+
+#ifdef QV4L2_X86_SIMD
+
+static bool cpuHasSSE2()
+{
+	static int has = -1;
+
+	if (has < 0) {
+		__builtin_cpu_init();
+		has = __builtin_cpu_supports("sse2");
+	}
+	return has;
+}
+
+__attribute__((target("sse2")))
+static void blendRowsSSE2(const unsigned char *r0, const unsigned char *r1,
+			  unsigned char *out, unsigned bytes, unsigned fy)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w0 = _mm_set1_epi16(128 - fy);
+	const __m128i w1 = _mm_set1_epi16(fy);
+	unsigned x = 0;
+
+	for (; x + 16 <= bytes; x += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(r0 + x));
+		__m128i b = _mm_loadu_si128((const __m128i *)(r1 + x));
+		__m128i lo = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0),
+			_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+		__m128i hi = _mm_add_epi16(
+			_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0),
+			_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+
+		lo = _mm_srli_epi16(lo, 7);
+		hi = _mm_srli_epi16(hi, 7);
+		_mm_storeu_si128((__m128i *)(out + x),
+				 _mm_packus_epi16(lo, hi));
+	}
+	for (; x < bytes; x++)
+		out[x] = (r0[x] * (128 - fy) + r1[x] * fy) >> 7;
+}
+
+#endif
+
+#ifdef QV4L2_NEON_SIMD
+
+static void blendRowsNEON(const unsigned char *r0, const unsigned char *r1,
+			  unsigned char *out, unsigned bytes, unsigned fy)
+{
+	const uint8x8_t w0 = vdup_n_u8(128 - fy);
+	const uint8x8_t w1 = vdup_n_u8(fy);
+	unsigned x = 0;
+
+	for (; x + 16 <= bytes; x += 16) {
+		uint8x16_t a = vld1q_u8(r0 + x);
+		uint8x16_t b = vld1q_u8(r1 + x);
+		uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(a), w0),
+					 vget_low_u8(b), w1);
+		uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(a), w0),
+					 vget_high_u8(b), w1);
+
+		vst1q_u8(out + x, vcombine_u8(vshrn_n_u16(lo, 7),
+					      vshrn_n_u16(hi, 7)));
+	}
+	for (; x < bytes; x++)
+		out[x] = (r0[x] * (128 - fy) + r1[x] * fy) >> 7;
+}
+
+#endif
+
+/* out = r0 + fy/128 * (r1 - r0), per byte */
+static void blendRows(const unsigned char *r0, const unsigned char *r1,
+		      unsigned char *out, unsigned bytes, unsigned fy)
+{
+#ifdef QV4L2_X86_SIMD
+	if (cpuHasSSE2()) {
+		blendRowsSSE2(r0, r1, out, bytes, fy);
+		return;
+	}
+#elif defined(QV4L2_NEON_SIMD)
+	blendRowsNEON(r0, r1, out, bytes, fy);
+	return;
+#endif
+	for (unsigned x = 0; x < bytes; x++)
+		out[x] = (r0[x] * (128 - fy) + r1[x] * fy) >> 7;
+}
+
+/*
+ * Horizontal mapping for one output row: the left source pixel and the
+ * 7-bit fraction per output pixel.  For nearest the fraction is rounded
+ * into the pixel index and stays 0.
+ */
+static void buildXMap(std::vector<unsigned> &xmap, std::vector<unsigned> &xfrac,
+		      unsigned sw, unsigned dw, bool bilinear)
+{
+	xmap.resize(dw);
+	xfrac.resize(dw);
+	for (unsigned x = 0; x < dw; x++) {
+		if (!bilinear) {
+			xmap[x] = ((2 * x + 1) * (unsigned long long)sw) /
+				(2 * dw);
+			xfrac[x] = 0;
+			continue;
+		}
+
+		long long num = ((2 * x + 1) *
+				 (unsigned long long)sw * 64) / dw - 64;
+
+		if (num < 0)
+			num = 0;
+		xmap[x] = num >> 7;
+		xfrac[x] = num & 127;
+		if (xmap[x] >= sw - 1) {
+			xmap[x] = sw - 1;
+			xfrac[x] = 0;
+		}
+	}
+}
+
+/* Both 0x00ff00ff halves of a pixel are weighted in one multiply */
+static void scaleRow32(const unsigned char *row, unsigned char *dst,
+		       const unsigned *xmap, const unsigned *xfrac,
+		       unsigned dw)
+{
+	const quint32 *s = (const quint32 *)row;
+	quint32 *d = (quint32 *)dst;
+
+	for (unsigned x = 0; x < dw; x++) {
+		unsigned x0 = xmap[x];
+		unsigned f = xfrac[x];
+
+		if (!f) {
+			d[x] = s[x0];
+			continue;
+		}
+
+		quint32 a = s[x0];
+		quint32 b = s[x0 + 1];
+		quint32 rb = ((a & 0x00ff00ff) * (128 - f) +
+			      (b & 0x00ff00ff) * f) >> 7 & 0x00ff00ff;
+		quint32 ag = (((a >> 8) & 0x00ff00ff) * (128 - f) +
+			      ((b >> 8) & 0x00ff00ff) * f) >> 7 & 0x00ff00ff;
+
+		d[x] = rb | (ag << 8);
+	}
+}
+
+static void scaleRow24(const unsigned char *row, unsigned char *dst,
+		       const unsigned *xmap, const unsigned *xfrac,
+		       unsigned dw)
+{
+	for (unsigned x = 0; x < dw; x++) {
+		const unsigned char *s = row + 3 * xmap[x];
+		unsigned f = xfrac[x];
+		unsigned char *d = dst + 3 * x;
+
+		if (!f) {
+			d[0] = s[0];
+			d[1] = s[1];
+			d[2] = s[2];
+			continue;
+		}
+		d[0] = (s[0] * (128 - f) + s[3] * f) >> 7;
+		d[1] = (s[1] * (128 - f) + s[4] * f) >> 7;
+		d[2] = (s[2] * (128 - f) + s[5] * f) >> 7;
+	}
+}
+
+static void scaleImage(const QImage &src, QImage &dst, bool bilinear)
+{
+	unsigned bpp = src.depth() / 8;
+	unsigned sw = src.width();
+	unsigned sh = src.height();
+	unsigned dw = dst.width();
+	unsigned dh = dst.height();
+	const unsigned char *sbits = src.constBits();
+	unsigned sstride = src.bytesPerLine();
+	unsigned char *dbits = dst.bits();
+	unsigned dstride = dst.bytesPerLine();
+	std::vector<unsigned> xmap, xfrac;
+	std::vector<unsigned char> vtmp;
+
+	buildXMap(xmap, xfrac, sw, dw, bilinear);
+	if (bilinear)
+		vtmp.resize(sw * bpp);
+
+	for (unsigned y = 0; y < dh; y++) {
+		unsigned char *d = dbits + (size_t)y * dstride;
+		const unsigned char *row;
+
+		if (!bilinear) {
+			unsigned sy = ((2 * y + 1) * (unsigned long long)sh) /
+				(2 * dh);
+
+			row = sbits + (size_t)sy * sstride;
+		} else {
+			long long num = ((2 * y + 1) *
+					 (unsigned long long)sh * 64) / dh - 64;
+
+			if (num < 0)
+				num = 0;
+
+			unsigned y0 = num >> 7;
+			unsigned fy = num & 127;
+
+			if (y0 >= sh - 1) {
+				y0 = sh - 1;
+				fy = 0;
+			}
+			row = sbits + (size_t)y0 * sstride;
+			if (fy) {
+				blendRows(row, row + sstride, &vtmp[0],
+					  sw * bpp, fy);
+				row = &vtmp[0];
+			}
+		}
+		if (bpp == 4)
+			scaleRow32(row, d, &xmap[0], &xfrac[0], dw);
+		else
+			scaleRow24(row, d, &xmap[0], &xfrac[0], dw);
+	}
+}
+
+FrameScaler::FrameScaler(QObject *parent) :
+	QThread(parent),
+	m_bilinear(false),
+	m_pending(false),
+	m_exit(false)
+{
+	start();
+}
+
+FrameScaler::~FrameScaler()
+{
+	m_mutex.lock();
+	m_exit = true;
+	m_cond.wakeOne();
+	m_mutex.unlock();
+	wait();
+}
+
+void FrameScaler::scaleFrame(const unsigned char *src, unsigned stride,
+			     const QSize &srcSize, const QSize &dstSize,
+			     QImage::Format format, bool bilinear)
+{
+	/* deep copy: the capture buffer is reused as soon as we return */
+	QImage copy = QImage(src, srcSize.width(), srcSize.height(),
+			     stride, format).copy();
+
+	QMutexLocker lock(&m_mutex);
+
+	m_queued = copy;
+	m_dstSize = dstSize;
+	m_bilinear = bilinear;
+	m_pending = true;
+	m_cond.wakeOne();
+}
+
+void FrameScaler::run()
+{
+	m_mutex.lock();
+	while (!m_exit) {
+		if (!m_pending) {
+			m_cond.wait(&m_mutex);
+			continue;
+		}
+
+		QImage src = m_queued;
+		QSize dstSize = m_dstSize;
+		bool bilinear = m_bilinear;
+
+		m_queued = QImage();
+		m_pending = false;
+		m_mutex.unlock();
+
+		/*
+		 * bits() detaches when the GUI thread still references
+		 * the previously emitted image, so the blit always sees
+		 * a consistent frame.
+		 */
+		if (m_scaled.size() != dstSize ||
+		    m_scaled.format() != src.format())
+			m_scaled = QImage(dstSize, src.format());
+		scaleImage(src, m_scaled, bilinear);
+		emit frameScaled(m_scaled);
+
+		m_mutex.lock();
+	}
+	m_mutex.unlock();
+}
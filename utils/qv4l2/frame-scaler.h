@@ -0,0 +1,81 @@
+/* qv4l2: a control panel controlling v4l2 devices.
+ *
+ * Copyright (C) 2006 Hans Verkuil <hverkuil@xs4all.nl>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef FRAME_SCALER_H
+#define FRAME_SCALER_H
+
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QThread>
+#include <QWaitCondition>
+
+/*
+ * Scales frames for the non-GL capture window off the GUI thread.
+ * CaptureWinQt used to let QPixmap::scaled() resize every frame on the
+ * GUI thread, which drops well below frame rate at 1080p on machines
+ * without OpenGL.  This thread resizes with fixed-point nearest or
+ * bilinear kernels, vectorized the same way as the libv4lconvert
+ * conversion kernels, and hands the GUI thread a ready-to-blit image.
+ * A newly queued frame replaces a not yet started one, so a machine
+ * that can't keep up drops frames instead of building a backlog.
+ */
+class FrameScaler : public QThread
+{
+	Q_OBJECT
+
+public:
+	explicit FrameScaler(QObject *parent = NULL);
+	~FrameScaler();
+
+	/*
+	 * Queue one frame.  The source rectangle is copied before this
+	 * returns, so the caller may reuse its buffer immediately.  Only
+	 * formats for which canScale() returns true (32 and 24 bits per
+	 * pixel) are supported.
+	 */
+	void scaleFrame(const unsigned char *src, unsigned stride,
+			const QSize &srcSize, const QSize &dstSize,
+			QImage::Format format, bool bilinear);
+
+	static bool canScale(QImage::Format format)
+	{
+		return format == QImage::Format_RGB32 ||
+		       format == QImage::Format_ARGB32 ||
+		       format == QImage::Format_RGB888;
+	}
+
+signals:
+	void frameScaled(const QImage &image);
+
+protected:
+	void run();
+
+private:
+	QMutex m_mutex;
+	QWaitCondition m_cond;
+	QImage m_queued;
+	QSize m_dstSize;
+	bool m_bilinear;
+	bool m_pending;
+	bool m_exit;
+	QImage m_scaled;
+};
+
+#endif
@@ -43,6 +43,9 @@ extern "C" {
 #include <QImage>
 #include <QWhatsThis>
 #include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
 #include <QCloseEvent>
 #include <QInputDialog>
 
@@ -120,6 +123,7 @@ ApplicationWindow::ApplicationWindow() :
 	setAttribute(Qt::WA_DeleteOnClose, true);
 
 	m_capNotifier = NULL;
+	m_capThread = NULL;
 	m_outNotifier = NULL;
 	m_ctrlNotifier = NULL;
 	m_capImage = NULL;
@@ -338,6 +342,7 @@ ApplicationWindow::ApplicationWindow() :
 	statusBar()->showMessage("Ready", 2000);
 
 	m_tabs = new QTabWidget;
+	connect(m_tabs, SIGNAL(currentChanged(int)), this, SLOT(ctrlTabChanged(int)));
 	setCentralWidget(m_tabs);
 }
 
@@ -1017,75 +1022,236 @@ void ApplicationWindow::outFrame()
 		refresh();
 }
 
-void ApplicationWindow::capFrame()
-{
-	cv4l_buffer buf(m_queue);
-	unsigned char *plane[3];
+/*
+ * The video capture path runs in a dedicated thread: it dequeues
+ * buffers, runs the libv4lconvert conversion and requeues the buffer
+ * straight away, then hands a copy of the frame to the GUI thread
+ * through a small latest-frame-wins slot ring. The driver always has
+ * its buffers back quickly, so control-panel redraws that keep the GUI
+ * thread busy no longer make the driver drop frames; the GUI simply
+ * uploads the most recent converted frame whenever it gets around
+ * to it.
+ */
+
+// Converted frames: one being shown, one ready, one being written
+#define CAP_FRAME_SLOTS 3
+
+enum CapSlotState {
+	CAP_SLOT_FREE,		// nobody uses the slot
+	CAP_SLOT_FILLING,	// the capture thread writes into it
+	CAP_SLOT_READY,		// complete, waiting for the GUI thread
+	CAP_SLOT_IN_USE,	// the GUI thread displays it
+};
+
+struct CapFrame {
+	enum CapSlotState state;
+	unsigned seq;
+	bool hasSeq;
+	bool convertErr;
+	__u8 *buf[3];
+	__u8 *plane[3];		// buf[p] when the plane is present, else NULL
 	unsigned bytesused[3];
-	int s = 0;
-	int err = 0;
+	struct timeval ts;
 #ifdef HAVE_ALSA
 	struct timeval tv_alsa;
 #endif
+};
 
-	if (m_singleStep)
-		m_capNotifier->setEnabled(false);
+class CaptureThread : public QThread {
+public:
+	CaptureThread(ApplicationWindow *win);
+	~CaptureThread();
+
+	void stop();
+	void resume();
+	const CapFrame *takeFrame();
+
+private:
+	void run();
+	bool capOne();
+	CapFrame *writeSlot();
+	void postError(const QString &msg);
+
+	ApplicationWindow *m_win;
+	volatile bool m_stop;
+	bool m_paused;
+	QMutex m_mutex;
+	QWaitCondition m_resume;
+	CapFrame m_slots[CAP_FRAME_SLOTS];
+	CapFrame *m_display;
+};
+
+CaptureThread::CaptureThread(ApplicationWindow *win) :
+	m_win(win),
+	m_stop(false),
+	m_paused(false),
+	m_display(NULL)
+{
+	// The first plane also has to hold the raw frame when the
+	// conversion fails, so that the GUI can still show it.
+	unsigned size0 = win->m_capDestFormat.g_sizeimage(0);
+
+	if (win->m_capSrcFormat.g_sizeimage(0) > size0)
+		size0 = win->m_capSrcFormat.g_sizeimage(0);
+
+	memset(m_slots, 0, sizeof(m_slots));
+	for (unsigned i = 0; i < CAP_FRAME_SLOTS; i++) {
+		m_slots[i].buf[0] = new __u8[size0];
+		for (unsigned p = 1; p < 3; p++)
+			if (p < win->m_capSrcFormat.g_num_planes())
+				m_slots[i].buf[p] =
+					new __u8[win->m_capSrcFormat.g_sizeimage(p)];
+	}
+}
+
+CaptureThread::~CaptureThread()
+{
+	stop();
+	for (unsigned i = 0; i < CAP_FRAME_SLOTS; i++)
+		for (unsigned p = 0; p < 3; p++)
+			delete [] m_slots[i].buf[p];
+}
+
+void CaptureThread::stop()
+{
+	m_mutex.lock();
+	m_stop = true;
+	m_resume.wakeAll();
+	m_mutex.unlock();
+	wait();
+}
+
+void CaptureThread::resume()
+{
+	QMutexLocker lock(&m_mutex);
+
+	m_paused = false;
+	m_resume.wakeAll();
+}
+
+void CaptureThread::run()
+{
+	while (!m_stop) {
+		// single-stepping: wait until the GUI asks for the next frame
+		m_mutex.lock();
+		while (m_paused && !m_stop)
+			m_resume.wait(&m_mutex);
+		m_mutex.unlock();
+		if (m_stop)
+			break;
+		if (!capOne())
+			break;
+	}
+}
+
+CapFrame *CaptureThread::writeSlot()
+{
+	QMutexLocker lock(&m_mutex);
+	CapFrame *slot = NULL;
+
+	/*
+	 * Prefer a free slot, steal the pending one if the GUI is
+	 * falling behind: latest-frame-wins.
+	 */
+	for (unsigned i = 0; i < CAP_FRAME_SLOTS; i++) {
+		CapFrame *f = &m_slots[i];
+
+		if (f->state == CAP_SLOT_FREE) {
+			slot = f;
+			break;
+		}
+		if (f->state == CAP_SLOT_READY)
+			slot = f;
+	}
+	slot->state = CAP_SLOT_FILLING;
+	return slot;
+}
+
+void CaptureThread::postError(const QString &msg)
+{
+	QMetaObject::invokeMethod(m_win, "capError", Qt::QueuedConnection,
+				  Q_ARG(QString, msg));
+}
+
+bool CaptureThread::capOne()
+{
+	ApplicationWindow *win = m_win;
+	cv4l_buffer buf(win->m_queue);
+	unsigned char *plane[3];
+	unsigned bytesused[3] = { 0, 0, 0 };
+	int s = 0;
+	fd_set fds;
+	struct timeval tv = { 0, 100000 };
+
+	// wait for a frame, but wake up regularly to check for stop()
+	FD_ZERO(&fds);
+	FD_SET(win->g_fd(), &fds);
+	s = select(win->g_fd() + 1, &fds, NULL, NULL, &tv);
+	if (s < 0 && errno != EINTR) {
+		postError("select");
+		return false;
+	}
+	if (s <= 0)
+		return true;
+
+	CapFrame *f = writeSlot();
+
+	f->hasSeq = win->m_capMethod != methodRead;
+	f->convertErr = false;
+#ifdef HAVE_ALSA
+	f->tv_alsa.tv_sec = f->tv_alsa.tv_usec = 0;
+#endif
 
 	plane[0] = plane[1] = plane[2] = NULL;
-	switch (m_capMethod) {
+	switch (win->m_capMethod) {
 	case methodRead:
-		s = read(m_frameData, m_capSrcFormat.g_sizeimage(0));
+		s = win->read(win->m_frameData, win->m_capSrcFormat.g_sizeimage(0));
 #ifdef HAVE_ALSA
-		alsa_thread_timestamp(&tv_alsa);
+		alsa_thread_timestamp(&f->tv_alsa);
 #endif
 
 		if (s < 0) {
 			if (errno != EAGAIN) {
-				error("read");
-				m_capStartAct->setChecked(false);
+				postError("read");
+				f->state = CAP_SLOT_FREE;
+				return false;
 			}
-			return;
-		}
-		if (m_makeSnapshot)
-			makeSnapshot((unsigned char *)m_frameData, s);
-		if (m_saveRaw.openMode())
-			m_saveRaw.write((const char *)m_frameData, s);
-
-		plane[0] = m_frameData;
-		if (showFrames() && m_mustConvert) {
-			err = v4lconvert_convert(m_convertData, &m_capSrcFormat, &m_capDestFormat,
-						 m_frameData, s,
-						 m_capImage->bits(), m_capDestFormat.fmt.pix.sizeimage);
-			if (err != -1)
-				plane[0] = m_capImage->bits();
+			f->state = CAP_SLOT_FREE;
+			return true;
 		}
+		if (win->m_saveRaw.openMode())
+			win->m_saveRaw.write((const char *)win->m_frameData, s);
+
+		plane[0] = win->m_frameData;
+		bytesused[0] = s;
 		break;
 
 	case methodMmap:
 	case methodUser:
-		if (dqbuf(buf)) {
+		if (win->dqbuf(buf)) {
+			f->state = CAP_SLOT_FREE;
 			if (errno == EAGAIN)
-				return;
-			error("dqbuf");
-			m_capStartAct->setChecked(false);
-			return;
+				return true;
+			postError("dqbuf");
+			return false;
 		}
 		if (buf.g_flags() & V4L2_BUF_FLAG_ERROR) {
 			printf("error\n");
-			if (qbuf(buf)) {
-				error("Couldn't queue buffer\n");
-				m_capStartAct->setChecked(false);
+			f->state = CAP_SLOT_FREE;
+			if (win->qbuf(buf)) {
+				postError("Couldn't queue buffer\n");
+				return false;
 			}
-			return;
+			return true;
 		}
 
 #ifdef HAVE_ALSA
-		alsa_thread_timestamp(&tv_alsa);
+		alsa_thread_timestamp(&f->tv_alsa);
 #endif
 
-		plane[0] = (__u8 *)m_queue.g_dataptr(buf.g_index(), 0);
-		plane[1] = (__u8 *)m_queue.g_dataptr(buf.g_index(), 1);
-		plane[2] = (__u8 *)m_queue.g_dataptr(buf.g_index(), 2);
+		plane[0] = (__u8 *)win->m_queue.g_dataptr(buf.g_index(), 0);
+		plane[1] = (__u8 *)win->m_queue.g_dataptr(buf.g_index(), 1);
+		plane[2] = (__u8 *)win->m_queue.g_dataptr(buf.g_index(), 2);
 		plane[0] += buf.g_data_offset(0);
 		bytesused[0] = buf.g_bytesused(0) - buf.g_data_offset(0);
 		if (plane[1]) {
@@ -1096,23 +1262,105 @@ void ApplicationWindow::capFrame()
 			plane[2] += buf.g_data_offset(2);
 			bytesused[2] = buf.g_bytesused(2) - buf.g_data_offset(2);
 		}
-		if (showFrames() && m_mustConvert) {
-			err = v4lconvert_convert(m_convertData, &m_capSrcFormat, &m_capDestFormat,
-						 plane[0], bytesused[0], m_capImage->bits(),
-						 m_capDestFormat.fmt.pix.sizeimage);
-			if (err != -1) {
-				plane[0] = m_capImage->bits();
-				bytesused[0] = m_capDestFormat.fmt.pix.sizeimage;
+		break;
+	}
+
+	if (win->showFrames() && win->m_mustConvert) {
+		int err = v4lconvert_convert(win->m_convertData,
+					     &win->m_capSrcFormat, &win->m_capDestFormat,
+					     plane[0], bytesused[0], f->buf[0],
+					     win->m_capDestFormat.fmt.pix.sizeimage);
+
+		if (err != -1) {
+			f->plane[0] = f->buf[0];
+			f->bytesused[0] = win->m_capDestFormat.fmt.pix.sizeimage;
+		} else {
+			f->convertErr = true;
+			memcpy(f->buf[0], plane[0], bytesused[0]);
+			f->plane[0] = f->buf[0];
+			f->bytesused[0] = bytesused[0];
+		}
+		f->plane[1] = f->plane[2] = NULL;
+	} else {
+		for (unsigned p = 0; p < 3; p++) {
+			f->plane[p] = NULL;
+			if (!plane[p] || !f->buf[p])
+				continue;
+			memcpy(f->buf[p], plane[p], bytesused[p]);
+			f->plane[p] = f->buf[p];
+			f->bytesused[p] = bytesused[p];
+		}
+	}
+	if (win->m_capMethod != methodRead &&
+	    !f->convertErr && win->m_saveRaw.openMode())
+		win->m_saveRaw.write((const char *)f->plane[0], f->bytesused[0]);
+
+	f->seq = buf.g_sequence();
+	f->ts = buf.g_timestamp();
+
+	if (win->m_capMethod == methodMmap || win->m_capMethod == methodUser) {
+		if (win->m_clear[buf.g_index()]) {
+			memset(win->m_queue.g_dataptr(buf.g_index(), 0), 0, buf.g_length());
+			if (V4L2_TYPE_IS_MULTIPLANAR(buf.g_type())) {
+				memset(win->m_queue.g_dataptr(buf.g_index(), 1), 0, buf.g_length(1));
+				if (win->m_queue.g_dataptr(buf.g_index(), 2))
+					memset(win->m_queue.g_dataptr(buf.g_index(), 2), 0, buf.g_length(2));
 			}
+			win->m_clear[buf.g_index()] = false;
 		}
-		if (m_makeSnapshot)
-			makeSnapshot(plane[0], bytesused[0]);
-		if (m_saveRaw.openMode())
-			m_saveRaw.write((const char *)plane[0], bytesused[0]);
 
-		break;
+		if (win->qbuf(buf)) {
+			postError("Couldn't queue buffer\n");
+			f->state = CAP_SLOT_FREE;
+			return false;
+		}
+	}
+
+	m_mutex.lock();
+	// drop a frame the GUI never consumed: latest-frame-wins
+	for (unsigned i = 0; i < CAP_FRAME_SLOTS; i++)
+		if (m_slots[i].state == CAP_SLOT_READY)
+			m_slots[i].state = CAP_SLOT_FREE;
+	f->state = CAP_SLOT_READY;
+	if (win->m_singleStep)
+		m_paused = true;
+	m_mutex.unlock();
+
+	QMetaObject::invokeMethod(win, "capFrameReady", Qt::QueuedConnection);
+	return true;
+}
+
+const CapFrame *CaptureThread::takeFrame()
+{
+	QMutexLocker lock(&m_mutex);
+	CapFrame *f = NULL;
+
+	for (unsigned i = 0; i < CAP_FRAME_SLOTS; i++) {
+		if (m_slots[i].state == CAP_SLOT_READY) {
+			f = &m_slots[i];
+			break;
+		}
 	}
-	if (err == -1 && m_frame == 0)
+	if (!f)
+		return NULL;
+	if (m_display)
+		m_display->state = CAP_SLOT_FREE;
+	f->state = CAP_SLOT_IN_USE;
+	m_display = f;
+	return f;
+}
+
+void ApplicationWindow::capFrameReady()
+{
+	if (!m_capThread)
+		return;
+
+	const CapFrame *f = m_capThread->takeFrame();
+
+	if (!f)
+		return;
+
+	if (f->convertErr && m_frame == 0)
 		error(v4lconvert_get_error_message(m_convertData));
 
 	QString status, curStatus;
@@ -1123,43 +1371,28 @@ void ApplicationWindow::capFrame()
 	float hscale = m_capture->getVertScaleFactor();
 	status = QString("Frame: %1 Fps: %2 Scale Factors: %3x%4").arg(++m_frame)
 			 .arg(m_fps, 0, 'f', 2, '0').arg(wscale).arg(hscale);
-	if (m_capMethod != methodRead)
-		status.append(QString(" SeqNr: %1").arg(buf.g_sequence()));
+	if (f->hasSeq)
+		status.append(QString(" SeqNr: %1").arg(f->seq));
 #ifdef HAVE_ALSA
-	if (m_capMethod != methodRead && alsa_thread_is_running()) {
-		if (tv_alsa.tv_sec || tv_alsa.tv_usec) {
-			m_totalAudioLatency.tv_sec += buf.g_timestamp().tv_sec - tv_alsa.tv_sec;
-			m_totalAudioLatency.tv_usec += buf.g_timestamp().tv_usec - tv_alsa.tv_usec;
+	if (f->hasSeq && alsa_thread_is_running()) {
+		if (f->tv_alsa.tv_sec || f->tv_alsa.tv_usec) {
+			m_totalAudioLatency.tv_sec += f->ts.tv_sec - f->tv_alsa.tv_sec;
+			m_totalAudioLatency.tv_usec += f->ts.tv_usec - f->tv_alsa.tv_usec;
 		}
 		status.append(QString(" Average A-V: %1 ms")
 			      .arg((m_totalAudioLatency.tv_sec * 1000 + m_totalAudioLatency.tv_usec / 1000) / m_frame));
 	}
 #endif
-	if (plane[0] == NULL && showFrames())
+	if (f->convertErr && showFrames())
 		status.append(" Error: Unsupported format.");
 
+	if (m_makeSnapshot)
+		makeSnapshot(f->plane[0], f->bytesused[0]);
+
 	if (showFrames())
 		m_capture->setFrame(m_capImage->width(), m_capImage->height(),
 				    m_capDestFormat.g_pixelformat(),
-				    plane[0], plane[1], plane[2]);
-
-	if (m_capMethod == methodMmap || m_capMethod == methodUser) {
-		if (m_clear[buf.g_index()]) {
-			memset(m_queue.g_dataptr(buf.g_index(), 0), 0, buf.g_length());
-			if (V4L2_TYPE_IS_MULTIPLANAR(buf.g_type())) {
-				memset(m_queue.g_dataptr(buf.g_index(), 1), 0, buf.g_length(1));
-				if (m_queue.g_dataptr(buf.g_index(), 2))
-					memset(m_queue.g_dataptr(buf.g_index(), 2), 0, buf.g_length(2));
-			}
-			m_clear[buf.g_index()] = false;
-		}
-			
-		if (qbuf(buf)) {
-			error("Couldn't queue buffer\n");
-			m_capStartAct->setChecked(false);
-			return;
-		}
-	}
+				    f->plane[0], f->plane[1], f->plane[2]);
 
 	curStatus = statusBar()->currentMessage();
 	if (curStatus.isEmpty() || curStatus.startsWith("Frame: ") || curStatus.startsWith("No frame"))
@@ -1168,12 +1401,25 @@ void ApplicationWindow::capFrame()
 		refresh();
 }
 
+void ApplicationWindow::capError(const QString &msg)
+{
+	error(msg);
+	m_capStartAct->setChecked(false);
+}
+
 void ApplicationWindow::stopStreaming()
 {
 	bool canStream = g_fd() >= 0 && (v4l_type_is_capture(g_type()) || has_vid_out()) &&
 					 !has_radio_tx();
 	v4l2_encoder_cmd cmd;
 
+	// stop the capture thread before the buffers go away
+	if (m_capThread) {
+		m_capThread->stop();
+		delete m_capThread;
+		m_capThread = NULL;
+	}
+
 	m_singleStep = false;
 	m_capStepAct->setEnabled(canStream && v4l_type_is_capture(g_type()));
 	stopAudio();
@@ -1372,7 +1618,10 @@ void ApplicationWindow::capStep(bool checked)
 		m_singleStep = true;
 		m_capStartAct->setChecked(true);
 	} else if (m_singleStep) {
-		m_capNotifier->setEnabled(true);
+		if (m_capThread)
+			m_capThread->resume();
+		if (m_capNotifier)
+			m_capNotifier->setEnabled(true);
 	}
 }
 
@@ -1597,8 +1846,8 @@ void ApplicationWindow::capStart(bool start)
 
 	statusBar()->showMessage("No frame");
 	if (startStreaming()) {
-		m_capNotifier = new QSocketNotifier(g_fd(), QSocketNotifier::Read, m_tabs);
-		connect(m_capNotifier, SIGNAL(activated(int)), this, SLOT(capFrame()));
+		m_capThread = new CaptureThread(this);
+		m_capThread->start();
 	}
 }
 
@@ -1650,6 +1899,8 @@ void ApplicationWindow::closeDevice()
 	m_widgetMap.clear();
 	m_sliderMap.clear();
 	m_classMap.clear();
+	m_ctrlTabMap.clear();
+	m_ctrlStale.clear();
 	m_tpgLimRGBRange = NULL;
 }
 
@@ -86,12 +86,16 @@ struct buffer {
 				 V4L2_CTRL_FLAG_GRABBED)
 
 class CaptureWin;
+class CaptureThread;
 
 class ApplicationWindow: public QMainWindow, cv4l_fd
 {
 	Q_OBJECT
 
 	friend class CaptureWin;
+	// The capture thread dequeues, converts and requeues buffers on
+	// the ApplicationWindow's behalf.
+	friend class CaptureThread;
 public:
 	ApplicationWindow();
 	virtual ~ApplicationWindow();
@@ -136,7 +140,8 @@ private slots:
 	void capStep(bool);
 	void outStart(bool);
 	void makeFullScreen(bool);
-	void capFrame();
+	void capFrameReady();
+	void capError(const QString &msg);
 	void outFrame();
 	void ctrlEvent();
 	void snapshot();
@@ -166,6 +171,7 @@ private slots:
 	void overrideXferFuncChanged(QAction *a);
 	void overrideYCbCrEncChanged(QAction *a);
 	void overrideQuantChanged(QAction *a);
+	void ctrlTabChanged(int index);
 
 	// tpg
 private slots:
@@ -276,6 +282,7 @@ private:
 	QSignalMapper *m_sigMapper;
 	QTabWidget *m_tabs;
 	QSocketNotifier *m_capNotifier;
+	CaptureThread *m_capThread;
 	QSocketNotifier *m_outNotifier;
 	QSocketNotifier *m_ctrlNotifier;
 	QImage *m_capImage;
@@ -284,6 +291,11 @@ private:
 	WidgetMap m_widgetMap;
 	WidgetMap m_sliderMap;
 	ClassMap m_classMap;
+	// Maps each control tab page to its control class, and tracks which
+	// classes still need a refresh. Control values are only queried when
+	// their tab is actually visible, see ctrlTabChanged().
+	std::map<QWidget *, unsigned> m_ctrlTabMap;
+	std::map<unsigned, bool> m_ctrlStale;
 	int m_vbiSize;
 	unsigned m_vbiWidth;
 	unsigned m_vbiHeight;
@@ -22,6 +22,7 @@ HEADERS += alsa_stream.h
 HEADERS += capture-win-gl.h
 HEADERS += capture-win.h
 HEADERS += capture-win-qt.h
+HEADERS += frame-scaler.h
 HEADERS += general-tab.h
 HEADERS += qv4l2.h
 HEADERS += raw2sliced.h
@@ -34,6 +35,7 @@ SOURCES += capture-win.cpp
 SOURCES += capture-win-gl.cpp
 SOURCES += capture-win-qt.cpp
 SOURCES += ctrl-tab.cpp
+SOURCES += frame-scaler.cpp
 SOURCES += general-tab.cpp
 SOURCES += qv4l2.cpp
 SOURCES += raw2sliced.cpp
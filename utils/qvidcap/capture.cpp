@@ -18,10 +18,17 @@
 #include <QtGui/QKeyEvent>
 #include <QtGui/QPainter>
 #include <QtCore/QSocketNotifier>
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QElapsedTimer>
 #include <QtMath>
 #include <QTimer>
 #include <QApplication>
 
+#include <sys/socket.h>
+
 #include <netinet/in.h>
 #include "v4l2-info.h"
 
@@ -213,6 +220,9 @@ CaptureWin::CaptureWin(QScrollArea *sa, QWidget *parent) :
 	QOpenGLWidget(parent),
 	m_fd(0),
 	m_sock(0),
+	m_sockPipeline(0),
+	m_curDataMapped(false),
+	m_playbackReverse(false),
 	m_v4l_queue(0),
 	m_frame(0),
 	m_ctx(0),
@@ -222,6 +232,15 @@ CaptureWin::CaptureWin(QScrollArea *sa, QWidget *parent) :
 	m_singleStepStart(0),
 	m_singleStepNext(false),
 	m_screenTextureCount(0),
+	m_dmabufAllowed(true),
+	m_useDmabuf(false),
+	m_eglDisplay(0),
+	m_usePbo(false),
+	m_pboSlot(0),
+	m_pboSize(0),
+	m_analysisReadback(NULL),
+	m_analysisReadbackSize(0),
+	m_analysisPrev(NULL),
 	m_program(0),
 	m_curIndex(-1),
 	m_nextIndex(-1),
@@ -229,6 +248,10 @@ CaptureWin::CaptureWin(QScrollArea *sa, QWidget *parent) :
 {
 	m_curSize[0] = 0;
 	m_curData[0] = 0;
+	memset(m_eglImages, 0, sizeof(m_eglImages));
+	memset(m_pboRing, 0, sizeof(m_pboRing));
+	memset(m_pboMap, 0, sizeof(m_pboMap));
+	memset(m_pboFence, 0, sizeof(m_pboFence));
 	m_canOverrideResolution = false;
 	m_pixelaspect.numerator = 1;
 	m_pixelaspect.denominator = 1;
@@ -304,6 +327,11 @@ CaptureWin::CaptureWin(QScrollArea *sa, QWidget *parent) :
 	addSubMenuItem(grp, menu, "Window Scrollbars", CAPTURE_GL_WIN_SCROLLBAR)->setChecked(false);
 	connect(grp, SIGNAL(triggered(QAction *)), this, SLOT(windowScalingChanged(QAction *)));
 
+	m_analysisOverlay = new QAction("Analysis overlay (A)", this);
+	m_analysisOverlay->setCheckable(true);
+	connect(m_analysisOverlay, SIGNAL(triggered(bool)),
+		this, SLOT(update()));
+
 	m_resolutionOverride = new QAction("Override resolution", this);
 	m_resolutionOverride->setCheckable(true);
 	connect(m_resolutionOverride, SIGNAL(triggered(bool)),
@@ -320,7 +348,12 @@ CaptureWin::CaptureWin(QScrollArea *sa, QWidget *parent) :
 
 CaptureWin::~CaptureWin()
 {
+	stopSockPipeline();
 	makeCurrent();
+	destroyDmabuf();
+	destroyPbo();
+	delete [] m_analysisReadback;
+	delete [] m_analysisPrev;
 	delete m_program;
 }
 
@@ -532,6 +565,7 @@ void CaptureWin::contextMenuEvent(QContextMenuEvent *event)
 	else if (!m_is_rgb)
 		menu.addMenu(m_ycbcrEncMenu);
 	menu.addMenu(m_quantMenu);
+	menu.addAction(m_analysisOverlay);
 	menu.addMenu(m_displayMenu);
 
 	menu.exec(event->globalPos());
@@ -617,6 +651,42 @@ void CaptureWin::keyPressEvent(QKeyEvent *event)
 			h += 2;
 		break;
 
+	case Qt::Key_Comma:
+	case Qt::Key_Period:
+		if (m_mode != AppModeFile || !m_playback.numFrames())
+			return;
+		/* scrubbing pauses playback, Space then steps a frame at a time */
+		m_singleStep = true;
+		if (m_playback.frame(event->key() == Qt::Key_Period ?
+				     m_playback.next() : m_playback.prev(),
+				     m_curData)) {
+			m_frame++;
+			update();
+		}
+		return;
+	case Qt::Key_Home:
+	case Qt::Key_End:
+		if (m_mode != AppModeFile || !m_playback.numFrames())
+			return;
+		m_singleStep = true;
+		m_playback.seek(event->key() == Qt::Key_Home ?
+				0 : m_playback.numFrames() - 1);
+		if (m_playback.frame(m_playback.curFrame(), m_curData)) {
+			m_frame++;
+			update();
+		}
+		return;
+	case Qt::Key_A:
+		m_analysisOverlay->setChecked(!m_analysisOverlay->isChecked());
+		update();
+		return;
+	case Qt::Key_B:
+		if (m_mode != AppModeFile)
+			return;
+		m_playbackReverse = !m_playbackReverse;
+		printf("Playing %s\n",
+		       m_playbackReverse ? "backwards" : "forwards");
+		return;
 	case Qt::Key_C:
 		cycleMenu(m_overrideColorspace, m_origColorspace,
 			  colorspaces, hasShift, hasCtrl);
@@ -795,6 +865,459 @@ void CaptureWin::setModeV4L2(cv4l_fd *fd)
 		printf("using libv4l2\n");
 }
 
+/*
+ * In socket mode the network receive, the RLE/FWHT decompression and the
+ * OpenGL rendering form a three stage pipeline: a receive thread reads
+ * packets from the socket, a decompress thread expands them and the GUI
+ * thread only renders. A render stall then no longer backs up the TCP
+ * connection: every hand-over between the stages is latest-frame-wins,
+ * so when a stage falls behind the oldest pending frame is dropped and
+ * the viewer keeps showing the most recent frame the sender produced.
+ */
+
+// Compressed frames in flight between the receive and decompress threads
+#define PIPE_COMP_SLOTS 2
+// Decompressed frames: one being shown, one ready, one being written
+#define PIPE_DEC_SLOTS 3
+
+enum SlotState {
+	SLOT_FREE,	// nobody uses the slot
+	SLOT_FILLING,	// the producing thread writes into it
+	SLOT_READY,	// complete, waiting for the consuming thread
+	SLOT_IN_USE,	// the consuming thread reads from it
+};
+
+struct SockCompFrame {
+	enum SlotState state;
+	unsigned seq;
+	bool is_fwht;
+	bool dropped[MAX_TEXTURES_NEEDED];	// crc mismatch, plane not updated
+	__u32 size[MAX_TEXTURES_NEEDED];
+	__u32 data_size[MAX_TEXTURES_NEEDED];
+	__u8 *buf[MAX_TEXTURES_NEEDED];
+	qint64 recv_ns;
+};
+
+struct SockDecFrame {
+	enum SlotState state;
+	unsigned seq;
+	__u8 *buf[MAX_TEXTURES_NEEDED];
+	qint64 recv_ns;
+	qint64 decomp_ns;
+};
+
+class SockPipeline {
+public:
+	SockPipeline(CaptureWin *win);
+	~SockPipeline();
+
+	void stop();
+	bool takeFrame(__u8 *data[], unsigned size[], qint64 &recv_ns,
+		       qint64 &decomp_ns, unsigned &seq, unsigned &drops);
+	bool failed() const { return m_failed; }
+
+private:
+	friend class SockPipelineThread;
+
+	void recvLoop();
+	void decompLoop();
+	SockCompFrame *compWriteSlot();
+	SockCompFrame *compReadySlot();
+
+	CaptureWin *m_win;
+	unsigned m_planes;
+	unsigned m_planeSize[MAX_TEXTURES_NEEDED];
+	volatile bool m_stop;
+	volatile bool m_failed;
+
+	QMutex m_compMutex;
+	QWaitCondition m_compAvail;
+	SockCompFrame m_comp[PIPE_COMP_SLOTS];
+
+	QMutex m_decMutex;
+	SockDecFrame m_dec[PIPE_DEC_SLOTS];
+	SockDecFrame *m_display;
+	QAtomicInt m_drops;
+
+	QThread *m_recvThread;
+	QThread *m_decThread;
+};
+
+class SockPipelineThread : public QThread {
+public:
+	SockPipelineThread(SockPipeline *pipe, bool is_recv) :
+		m_pipe(pipe), m_isRecv(is_recv) {}
+
+private:
+	void run()
+	{
+		if (m_isRecv)
+			m_pipe->recvLoop();
+		else
+			m_pipe->decompLoop();
+	}
+
+	SockPipeline *m_pipe;
+	bool m_isRecv;
+};
+
+SockPipeline::SockPipeline(CaptureWin *win) :
+	m_win(win),
+	m_stop(false),
+	m_failed(false),
+	m_display(NULL)
+{
+	unsigned comp_max = win->m_ctx ? win->m_ctx->comp_max_size : 0;
+
+	memset(m_comp, 0, sizeof(m_comp));
+	memset(m_dec, 0, sizeof(m_dec));
+	m_planes = win->m_v4l_fmt.g_num_planes();
+	for (unsigned p = 0; p < m_planes; p++) {
+		unsigned size = win->m_v4l_fmt.g_sizeimage(p);
+		unsigned comp_size = comp_max > size ? comp_max : size;
+
+		m_planeSize[p] = size;
+		for (unsigned i = 0; i < PIPE_COMP_SLOTS; i++)
+			m_comp[i].buf[p] = new __u8[comp_size];
+		for (unsigned i = 0; i < PIPE_DEC_SLOTS; i++)
+			m_dec[i].buf[p] = new __u8[size];
+	}
+	m_recvThread = new SockPipelineThread(this, true);
+	m_decThread = new SockPipelineThread(this, false);
+	m_recvThread->start();
+	m_decThread->start();
+}
+
+SockPipeline::~SockPipeline()
+{
+	stop();
+	delete m_recvThread;
+	delete m_decThread;
+	for (unsigned p = 0; p < m_planes; p++) {
+		for (unsigned i = 0; i < PIPE_COMP_SLOTS; i++)
+			delete [] m_comp[i].buf[p];
+		for (unsigned i = 0; i < PIPE_DEC_SLOTS; i++)
+			delete [] m_dec[i].buf[p];
+	}
+}
+
+void SockPipeline::stop()
+{
+	m_stop = true;
+	// unblock the receive thread if it sits in read()
+	shutdown(m_win->m_sock, SHUT_RD);
+	m_compMutex.lock();
+	m_compAvail.wakeAll();
+	m_compMutex.unlock();
+	m_recvThread->wait();
+	m_decThread->wait();
+}
+
+SockCompFrame *SockPipeline::compWriteSlot()
+{
+	QMutexLocker lock(&m_compMutex);
+	SockCompFrame *slot = NULL;
+
+	/*
+	 * Prefer a free slot. If the decompressor is falling behind, steal
+	 * the oldest pending frame instead: latest-frame-wins. With a single
+	 * producer and a single consumer one of the two slots is always
+	 * free or ready.
+	 */
+	for (unsigned i = 0; i < PIPE_COMP_SLOTS; i++) {
+		SockCompFrame *f = &m_comp[i];
+
+		if (f->state == SLOT_FREE) {
+			slot = f;
+			break;
+		}
+		if (f->state == SLOT_READY && (!slot || f->seq < slot->seq))
+			slot = f;
+	}
+	if (slot->state == SLOT_READY)
+		m_drops.fetchAndAddRelaxed(1);
+	slot->state = SLOT_FILLING;
+	return slot;
+}
+
+// call with m_compMutex held
+SockCompFrame *SockPipeline::compReadySlot()
+{
+	SockCompFrame *slot = NULL;
+
+	for (unsigned i = 0; i < PIPE_COMP_SLOTS; i++) {
+		SockCompFrame *f = &m_comp[i];
+
+		if (f->state == SLOT_READY && (!slot || f->seq < slot->seq))
+			slot = f;
+	}
+	return slot;
+}
+
+void SockPipeline::recvLoop()
+{
+	QElapsedTimer timer;
+	unsigned seq = 0;
+
+	timer.start();
+	while (!m_stop) {
+		unsigned packet, sz;
+		int n;
+
+		if (m_win->read_u32(packet))
+			break;
+
+		if (packet == V4L_STREAM_PACKET_END) {
+			fprintf(stderr, "END packet read\n");
+			break;
+		}
+
+		if (m_win->read_u32(sz))
+			break;
+
+		if (packet != V4L_STREAM_PACKET_FRAME_VIDEO_RLE &&
+		    packet != V4L_STREAM_PACKET_FRAME_VIDEO_FWHT) {
+			char buf[1024];
+			bool err = false;
+
+			fprintf(stderr, "expected FRAME_VIDEO, got 0x%08x\n", packet);
+			while (sz) {
+				unsigned rdsize = sz > sizeof(buf) ? sizeof(buf) : sz;
+
+				n = read(m_win->m_sock, buf, rdsize);
+				if (n <= 0) {
+					fprintf(stderr, "error reading %d bytes\n", sz);
+					err = true;
+					break;
+				}
+				sz -= n;
+			}
+			if (err)
+				break;
+			continue;
+		}
+
+		bool is_fwht = m_win->m_ctx &&
+			packet == V4L_STREAM_PACKET_FRAME_VIDEO_FWHT;
+
+		if (m_win->read_u32(sz))
+			break;
+
+		if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR) {
+			fprintf(stderr, "unsupported FRAME_VIDEO size\n");
+			break;
+		}
+		if (m_win->read_u32(sz) ||  // ignore field
+		    m_win->read_u32(sz))    // ignore flags
+			break;
+
+		qint64 start_ns = timer.nsecsElapsed();
+		SockCompFrame *f = compWriteSlot();
+		bool err = false;
+
+		f->is_fwht = is_fwht;
+		for (unsigned p = 0; !err && p < m_planes; p++) {
+			__u32 max_size = is_fwht ? m_win->m_ctx->comp_max_size :
+				m_planeSize[p];
+			__u8 *dst = f->buf[p];
+			bool has_crc = false;
+			__u32 data_size;
+			__u32 offset;
+			__u32 size;
+			__u32 crc = 0;
+
+			f->dropped[p] = false;
+			if (m_win->read_u32(sz)) {
+				err = true;
+				break;
+			}
+			if (sz == V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR)
+				has_crc = true;
+			else if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR_V2) {
+				fprintf(stderr, "unsupported FRAME_VIDEO plane size\n");
+				err = true;
+				break;
+			}
+			if (m_win->read_u32(size) || m_win->read_u32(data_size)) {
+				err = true;
+				break;
+			}
+			if (has_crc && m_win->read_u32(crc)) {
+				err = true;
+				break;
+			}
+			offset = is_fwht ? 0 : size - data_size;
+			sz = data_size;
+
+			if (data_size > max_size ||
+			    (!is_fwht && size > m_planeSize[p])) {
+				fprintf(stderr, "data size is too large (%u > %u)\n",
+					data_size, max_size);
+				err = true;
+				break;
+			}
+
+			__u8 *comp_data = dst + offset;
+
+			f->size[p] = size;
+			f->data_size[p] = data_size;
+			while (sz) {
+				n = read(m_win->m_sock, dst + offset, sz);
+				if (n <= 0) {
+					fprintf(stderr, "error reading %d bytes\n", sz);
+					err = true;
+					break;
+				}
+				if ((__u32)n == sz)
+					break;
+				offset += n;
+				sz -= n;
+			}
+			if (!err && has_crc &&
+			    v4l_stream_crc32c(comp_data, data_size) != crc) {
+				fprintf(stderr, "crc mismatch, plane dropped\n");
+				f->dropped[p] = true;
+			}
+		}
+
+		QMutexLocker lock(&m_compMutex);
+
+		if (err) {
+			f->state = SLOT_FREE;
+			break;
+		}
+		f->recv_ns = timer.nsecsElapsed() - start_ns;
+		f->seq = seq++;
+		f->state = SLOT_READY;
+		m_compAvail.wakeOne();
+	}
+
+	m_failed = true;
+	// wake the decompress thread so it notices m_failed
+	m_compMutex.lock();
+	m_compAvail.wakeAll();
+	m_compMutex.unlock();
+	// tell the GUI thread, it tears the pipeline down and listens for
+	// a new connection
+	QMetaObject::invokeMethod(m_win, "sockFrameReady", Qt::QueuedConnection);
+}
+
+void SockPipeline::decompLoop()
+{
+	QElapsedTimer timer;
+
+	timer.start();
+	for (;;) {
+		SockCompFrame *f;
+		SockDecFrame *d = NULL;
+
+		m_compMutex.lock();
+		while (!(f = compReadySlot()) && !m_stop && !m_failed)
+			m_compAvail.wait(&m_compMutex);
+		if (!f) {
+			m_compMutex.unlock();
+			break;
+		}
+		f->state = SLOT_IN_USE;
+		m_compMutex.unlock();
+
+		/*
+		 * One of the three slots is always free: the GUI thread
+		 * holds at most one and at most one is pending.
+		 */
+		m_decMutex.lock();
+		for (unsigned i = 0; i < PIPE_DEC_SLOTS; i++) {
+			if (m_dec[i].state == SLOT_FREE) {
+				d = &m_dec[i];
+				break;
+			}
+		}
+		d->state = SLOT_FILLING;
+		m_decMutex.unlock();
+
+		qint64 start_ns = timer.nsecsElapsed();
+
+		for (unsigned p = 0; p < m_planes; p++) {
+			if (f->dropped[p])
+				continue;
+			if (f->is_fwht) {
+				fwht_decompress(m_win->m_ctx, f->buf[p],
+						f->data_size[p],
+						d->buf[p], m_planeSize[p]);
+			} else {
+				rle_decompress(f->buf[p], f->size[p], f->data_size[p],
+					       rle_calc_bpl(m_win->m_v4l_fmt.g_bytesperline(p),
+							    m_win->m_v4l_fmt.g_pixelformat()));
+				memcpy(d->buf[p], f->buf[p], f->size[p]);
+			}
+		}
+
+		d->seq = f->seq;
+		d->recv_ns = f->recv_ns;
+		d->decomp_ns = timer.nsecsElapsed() - start_ns;
+
+		m_compMutex.lock();
+		f->state = SLOT_FREE;
+		m_compMutex.unlock();
+
+		m_decMutex.lock();
+		// drop a decoded frame the GUI never consumed: latest-frame-wins
+		for (unsigned i = 0; i < PIPE_DEC_SLOTS; i++) {
+			if (m_dec[i].state == SLOT_READY) {
+				m_dec[i].state = SLOT_FREE;
+				m_drops.fetchAndAddRelaxed(1);
+			}
+		}
+		d->state = SLOT_READY;
+		m_decMutex.unlock();
+
+		QMetaObject::invokeMethod(m_win, "sockFrameReady",
+					  Qt::QueuedConnection);
+	}
+}
+
+bool SockPipeline::takeFrame(__u8 *data[], unsigned size[], qint64 &recv_ns,
+			     qint64 &decomp_ns, unsigned &seq, unsigned &drops)
+{
+	QMutexLocker lock(&m_decMutex);
+	SockDecFrame *d = NULL;
+
+	for (unsigned i = 0; i < PIPE_DEC_SLOTS; i++) {
+		if (m_dec[i].state == SLOT_READY) {
+			d = &m_dec[i];
+			break;
+		}
+	}
+	if (!d)
+		return false;
+	if (m_display)
+		m_display->state = SLOT_FREE;
+	d->state = SLOT_IN_USE;
+	m_display = d;
+	for (unsigned p = 0; p < m_planes; p++) {
+		data[p] = d->buf[p];
+		size[p] = m_planeSize[p];
+	}
+	recv_ns = d->recv_ns;
+	decomp_ns = d->decomp_ns;
+	seq = d->seq;
+	drops = (unsigned)m_drops.fetchAndStoreRelaxed(0);
+	return true;
+}
+
+void CaptureWin::stopSockPipeline()
+{
+	if (!m_sockPipeline)
+		return;
+	delete m_sockPipeline;
+	m_sockPipeline = NULL;
+	// the frame pointers referenced pipeline-owned buffers
+	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
+		m_curData[p] = NULL;
+		m_curSize[p] = 0;
+	}
+}
+
 void CaptureWin::setModeSocket(int socket, int port)
 {
 	m_mode = AppModeSocket;
@@ -807,17 +1330,14 @@ void CaptureWin::setModeSocket(int socket, int port)
 			   m_v4l_fmt.g_field(), m_v4l_fmt.g_colorspace(), m_v4l_fmt.g_xfer_func(),
 			   m_v4l_fmt.g_ycbcr_enc(), m_v4l_fmt.g_quantization());
 
-	QSocketNotifier *readSock = new QSocketNotifier(m_sock,
-		QSocketNotifier::Read, this);
-
-	connect(readSock, SIGNAL(activated(int)), this, SLOT(sockReadEvent()));
+	stopSockPipeline();
+	m_sockPipeline = new SockPipeline(this);
 }
 
 void CaptureWin::setModeFile(const QString &filename)
 {
 	m_mode = AppModeFile;
-	m_file.setFileName(filename);
-	if (!m_file.open(QIODevice::ReadOnly)) {
+	if (!m_playback.open(filename.toUtf8().data())) {
 		fprintf(stderr, "could not open %s\n", filename.toUtf8().data());
 		std::exit(EXIT_FAILURE);
 	}
@@ -1171,14 +1691,9 @@ void CaptureWin::listenForNewConnection()
 	cv4l_fmt fmt;
 	v4l2_fract pixelaspect = { 1, 1 };
 
+	stopSockPipeline();
 	::close(m_sock);
 
-	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
-		m_curSize[p] = 0;
-		delete [] m_curData[p];
-		m_curData[p] = NULL;
-	}
-
 	int sock_fd;
 
 	for (;;) {
@@ -1216,9 +1731,18 @@ int CaptureWin::read_u32(__u32 &v)
 	return 0;
 }
 
-void CaptureWin::sockReadEvent()
+void CaptureWin::sockFrameReady()
 {
-	int n;
+	qint64 recv_ns, decomp_ns;
+	unsigned seq, drops;
+
+	if (!m_sockPipeline)
+		return;
+
+	if (m_sockPipeline->failed()) {
+		listenForNewConnection();
+		return;
+	}
 
 	if (m_singleStep && m_frame > m_singleStepStart && !m_singleStepNext)
 		return;
@@ -1227,108 +1751,20 @@ void CaptureWin::sockReadEvent()
 	if (m_origPixelFormat == 0)
 		updateOrigValues();
 
-	if (m_curSize[0] == 0) {
-		for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
-			m_curSize[p] = m_v4l_fmt.g_sizeimage(p);
-			m_curData[p] = new __u8[m_curSize[p]];
-		}
-	}
-
-	unsigned packet, sz;
-	bool is_fwht;
-
-	if (read_u32(packet))
-		goto new_conn;
-
-	if (packet == V4L_STREAM_PACKET_END) {
-		fprintf(stderr, "END packet read\n");
-		goto new_conn;
-	}
-
-	if (read_u32(sz))
-		goto new_conn;
-
-	if (packet != V4L_STREAM_PACKET_FRAME_VIDEO_RLE &&
-	    packet != V4L_STREAM_PACKET_FRAME_VIDEO_FWHT) {
-		char buf[1024];
-
-		fprintf(stderr, "expected FRAME_VIDEO, got 0x%08x\n", packet);
-		while (sz) {
-			unsigned rdsize = sz > sizeof(buf) ? sizeof(buf) : sz;
-
-			n = read(m_sock, buf, rdsize);
-			if (n < 0) {
-				fprintf(stderr, "error reading %d bytes\n", sz);
-				goto new_conn;
-			}
-			sz -= n;
-		}
+	if (!m_sockPipeline->takeFrame(m_curData, m_curSize, recv_ns,
+				       decomp_ns, seq, drops))
 		return;
-	}
-
-	is_fwht = m_ctx && packet == V4L_STREAM_PACKET_FRAME_VIDEO_FWHT;
 
-	if (read_u32(sz))
-		goto new_conn;
+	if (m_reportTimings)
+		printf("Frame %u: receive time: %09lld ns, decompress time: %09lld ns, dropped %u frame(s)\n",
+		       seq, (long long)recv_ns, (long long)decomp_ns, drops);
 
-	if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR) {
-		fprintf(stderr, "unsupported FRAME_VIDEO size\n");
-		goto new_conn;
-	}
-	if (read_u32(sz) ||  // ignore field
-	    read_u32(sz))    // ignore flags
-		goto new_conn;
-
-	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
-		__u32 max_size = is_fwht ? m_ctx->comp_max_size : m_curSize[p];
-		__u8 *dst = is_fwht ? m_ctx->state.compressed_frame : m_curData[p];
-		__u32 data_size;
-		__u32 offset;
-		__u32 size;
-
-		if (read_u32(sz))
-			goto new_conn;
-		if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR) {
-			fprintf(stderr, "unsupported FRAME_VIDEO plane size\n");
-			goto new_conn;
-		}
-		if (read_u32(size) || read_u32(data_size))
-			goto new_conn;
-		offset = is_fwht ? 0 : size - data_size;
-		sz = data_size;
-
-		if (data_size > max_size) {
-			fprintf(stderr, "data size is too large (%u > %u)\n",
-				data_size, max_size);
-			goto new_conn;
-		}
-		while (sz) {
-			n = read(m_sock, dst + offset, sz);
-			if (n < 0) {
-				fprintf(stderr, "error reading %d bytes\n", sz);
-				goto new_conn;
-			}
-			if ((__u32)n == sz)
-				break;
-			offset += n;
-			sz -= n;
-		}
-		if (is_fwht)
-			fwht_decompress(m_ctx, dst, data_size, m_curData[p], m_curSize[p]);
-		else
-			rle_decompress(dst, size, data_size,
-				       rle_calc_bpl(m_v4l_fmt.g_bytesperline(p), m_v4l_fmt.g_pixelformat()));
-	}
 	m_frame++;
 	update();
 	if (m_cnt == 0)
 		return;
 	if (--m_cnt == 0)
 		std::exit(EXIT_SUCCESS);
-	return;
-
-new_conn:
-	listenForNewConnection();
 }
 
 void CaptureWin::resizeGL(int w, int h)
@@ -1409,29 +1845,35 @@ void CaptureWin::startTimer()
 	connect(m_timer, SIGNAL(timeout()), this, SLOT(tpgUpdateFrame()));
 
 	m_imageSize = 0;
-	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++)
-		m_imageSize += m_v4l_fmt.g_sizeimage(p);
-
-	if (m_file.isOpen())
-		m_file.seek(0);
-
-	if (m_file.isOpen() && m_imageSize > m_file.size()) {
-		fprintf(stderr, "the file size is too small (expect at least %u, got %llu)\n",
-			m_imageSize, m_file.size());
+	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
+		m_curSize[p] = m_v4l_fmt.g_sizeimage(p);
+		m_imageSize += m_curSize[p];
 	}
 
+	bool mapped = m_playback.isOpen() &&
+		      m_playback.setFrameSize(m_v4l_fmt.g_num_planes(),
+					      m_curSize, m_imageSize);
+
 	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
-		m_curSize[p] = m_v4l_fmt.g_sizeimage(p);
-		delete [] m_curData[p];
+		if (!m_curDataMapped)
+			delete [] m_curData[p];
+		m_curData[p] = NULL;
+		if (mapped)
+			continue;
 		if (m_canOverrideResolution)
 			m_curData[p] = new __u8[4096 * 2160 * (p ? 2 : 4)];
 		else
 			m_curData[p] = new __u8[m_curSize[p]];
-		if (m_file.isOpen())
-			m_file.read((char *)m_curData[p], m_curSize[p]);
+		if (m_mode == AppModeFile)
+			memset(m_curData[p], 0, m_curSize[p]);
 		else
 			tpg_fillbuffer(&m_tpg, 0, p, m_curData[p]);
 	}
+	m_curDataMapped = mapped;
+	if (mapped) {
+		m_playback.seek(0);
+		m_playback.frame(0, m_curData);
+	}
 	bool is_alt = m_v4l_fmt.g_field() == V4L2_FIELD_ALTERNATE;
 	tpg_update_mv_count(&m_tpg, is_alt);
 	m_timer->setTimerType(Qt::PreciseTimer);
@@ -1470,9 +1912,6 @@ void CaptureWin::tpgUpdateFrame()
 		return;
 	m_singleStepNext = false;
 
-	if (m_mode == AppModeFile && m_file.pos() + m_imageSize > m_file.size())
-		m_file.seek(0);
-
 	if (m_mode != AppModeFile && is_alt) {
 		if (m_tpg.field == V4L2_FIELD_TOP)
 			tpg_s_field(&m_tpg, V4L2_FIELD_BOTTOM, true);
@@ -1480,10 +1919,12 @@ void CaptureWin::tpgUpdateFrame()
 			tpg_s_field(&m_tpg, V4L2_FIELD_TOP, true);
 	}
 
-	for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++) {
-		if (m_mode == AppModeFile)
-			m_file.read((char *)m_curData[p], m_curSize[p]);
-		else
+	if (m_mode == AppModeFile) {
+		if (m_playback.numFrames())
+			m_playback.frame(m_playbackReverse ? m_playback.prev() :
+					 m_playback.next(), m_curData);
+	} else {
+		for (unsigned p = 0; p < m_v4l_fmt.g_num_planes(); p++)
 			tpg_fillbuffer(&m_tpg, 0, p, m_curData[p]);
 	}
 	m_frame++;
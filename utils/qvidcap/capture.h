@@ -11,7 +11,7 @@
 
 #include <QOpenGLWidget>
 #include <QOpenGLFunctions>
-#include <QFile>
+#include <QImage>
 #include <QMenu>
 #include <QAction>
 #include <QActionGroup>
@@ -19,6 +19,7 @@
 #include <QtGui/QOpenGLShaderProgram>
 
 #include "qvidcap.h"
+#include "playback.h"
 
 extern "C" {
 #include "v4l2-tpg.h"
@@ -34,6 +35,7 @@ extern const __u32 hsv_encs[];
 extern const __u32 quantizations[];
 
 class QOpenGLPaintDevice;
+class SockPipeline;
 
 enum AppMode {
 	AppModeV4L2,
@@ -64,6 +66,9 @@ struct TestState {
 // This must be equal to the max number of textures that any shader uses
 #define MAX_TEXTURES_NEEDED 3
 
+// Number of slots in the persistent-mapped upload PBO ring
+#define PBO_RING_SIZE 3
+
 class CaptureWin : public QOpenGLWidget, protected QOpenGLFunctions
 {
 	Q_OBJECT
@@ -86,6 +91,7 @@ public:
 	void setCount(unsigned cnt) { m_cnt = cnt; }
 	void setReportTimings(bool report) { m_reportTimings = report; }
 	void setVerbose(bool verbose) { m_verbose = verbose; }
+	void setDmabufAllowed(bool b) { m_dmabufAllowed = b; }
 	void setOverridePixelFormat(__u32 fmt) { m_overridePixelFormat = fmt; }
 	void setOverrideField(__u32 field) { m_overrideField = field; }
 	void setOverrideColorspace(__u32 colsp) { m_overrideColorspace = colsp; }
@@ -103,7 +109,7 @@ public:
 private slots:
 	void v4l2ReadEvent();
 	void v4l2ExceptionEvent();
-	void sockReadEvent();
+	void sockFrameReady();
 	void tpgUpdateFrame();
 
 	void restoreAll(bool checked);
@@ -128,6 +134,7 @@ private:
 	void keyPressEvent(QKeyEvent *event);
 	void mouseDoubleClickEvent(QMouseEvent * e);
 	void listenForNewConnection();
+	void stopSockPipeline();
 	int read_u32(__u32 &v);
 	void showCurrentOverrides();
 	void cycleMenu(__u32 &overrideVal, __u32 origVal,
@@ -136,6 +143,12 @@ private:
 	bool supportedFmt(__u32 fmt);
 	void checkError(const char *msg);
 	void configureTexture(size_t idx);
+	bool initDmabuf();
+	void destroyDmabuf();
+	bool initPbo(size_t size);
+	void destroyPbo();
+	bool pboUploadBegin(__u8 **savedData);
+	void pboUploadEnd(__u8 **savedData);
 	void initImageFormat();
 	void updateOrigValues();
 	void updateShader();
@@ -151,6 +164,9 @@ private:
 	void shader_YUV_packed();
 	void shader_YUY2();
 
+	// Analysis overlay (per-channel histogram + frame-diff heatmap)
+	void renderAnalysis();
+
 	// Colorspace conversion render
 	void render_RGB(__u32 format);
 	void render_Bayer(__u32 format);
@@ -161,11 +177,21 @@ private:
 	void render_NV16(__u32 format);
 	void render_NV24(__u32 format);
 
+	// The socket pipeline threads parse packets and fill frame buffers
+	// on CaptureWin's behalf.
+	friend class SockPipeline;
+
 	enum AppMode m_mode;
 	cv4l_fd *m_fd;
 	int m_sock;
 	int m_port;
-	QFile m_file;
+	SockPipeline *m_sockPipeline;
+	// File mode playback state: the mapped recording, whether m_curData
+	// points into the mapping (and so must not be delete[]d or written),
+	// and the playback direction.
+	FilePlayback m_playback;
+	bool m_curDataMapped;
+	bool m_playbackReverse;
 	bool m_v4l2;
 	cv4l_fmt m_v4l_fmt;
 	v4l2_fract m_pixelaspect;
@@ -217,6 +243,30 @@ private:
 	QTimer *m_timer;
 	int m_screenTextureCount;
 	GLuint m_screenTexture[MAX_TEXTURES_NEEDED];
+	// EGL dmabuf import state. The images are EGLImageKHR handles and the
+	// display an EGLDisplay, stored as void * to keep the EGL headers out
+	// of this header (moc processes it).
+	bool m_dmabufAllowed;
+	bool m_useDmabuf;
+	void *m_eglDisplay;
+	void *m_eglImages[VIDEO_MAX_FRAME];
+	// Persistent-mapped PBO ring used to stage texture uploads when
+	// dmabuf import isn't available. The fences are GLsync objects,
+	// stored as void * for the same reason as the EGL handles above.
+	bool m_usePbo;
+	GLuint m_pboRing[PBO_RING_SIZE];
+	__u8 *m_pboMap[PBO_RING_SIZE];
+	void *m_pboFence[PBO_RING_SIZE];
+	unsigned m_pboSlot;
+	size_t m_pboSize;
+	// Analysis overlay state: the rendered frame read back from the
+	// framebuffer, the previous downscaled luma grid the frame-diff
+	// is computed against, and the resulting histogram and heatmap.
+	__u8 *m_analysisReadback;
+	unsigned m_analysisReadbackSize;
+	__u8 *m_analysisPrev;
+	unsigned m_analysisHist[3][256];
+	QImage m_analysisHeat;
 	QOpenGLShaderProgram *m_program;
 	__u8 *m_curData[MAX_TEXTURES_NEEDED];
 	unsigned m_curSize[MAX_TEXTURES_NEEDED];
@@ -227,6 +277,7 @@ private:
 	struct tpg_data m_tpg;
 
 	QScrollArea *m_scrollArea;
+	QAction *m_analysisOverlay;
 	QAction *m_resolutionOverride;
 	QAction *m_exitFullScreen;
 	QAction *m_enterFullScreen;
@@ -17,6 +17,7 @@
 #include <QtGui/QContextMenuEvent>
 #include <QtGui/QKeyEvent>
 #include <QtGui/QPainter>
+#include <QtGui/QPolygon>
 #include <QtCore/QSocketNotifier>
 #include <QtMath>
 #include <QTimer>
@@ -24,6 +25,362 @@
 
 #include "v4l2-info.h"
 
+#ifdef HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#if defined(HAVE_EGL) && defined(EGL_EXT_image_dma_buf_import)
+#define CAN_IMPORT_DMABUF
+
+// Minimal DRM fourcc definitions so we don't depend on libdrm headers.
+// DRM formats describe little-endian packed pixels, so e.g. the byte
+// order R, G, B, X in memory is DRM_FORMAT_XBGR8888.
+#define DRM_FOURCC(a, b, c, d) \
+	((__u32)(a) | ((__u32)(b) << 8) | ((__u32)(c) << 16) | ((__u32)(d) << 24))
+#define DRM_FORMAT_RGB565	DRM_FOURCC('R', 'G', '1', '6')
+#define DRM_FORMAT_RGB888	DRM_FOURCC('R', 'G', '2', '4')
+#define DRM_FORMAT_BGR888	DRM_FOURCC('B', 'G', '2', '4')
+#define DRM_FORMAT_XRGB8888	DRM_FOURCC('X', 'R', '2', '4')
+#define DRM_FORMAT_ARGB8888	DRM_FOURCC('A', 'R', '2', '4')
+#define DRM_FORMAT_XBGR8888	DRM_FOURCC('X', 'B', '2', '4')
+#define DRM_FORMAT_ABGR8888	DRM_FOURCC('A', 'B', '2', '4')
+#define DRM_FORMAT_MOD_LINEAR	0ULL
+
+// glEGLImageTargetTexture2DOES is a GLES extension header typedef, define
+// our own so this builds against desktop GL headers as well.
+typedef void (*imageTargetTexture2DFn)(GLenum target, void *image);
+
+static PFNEGLCREATEIMAGEKHRPROC createImageKHR;
+static PFNEGLDESTROYIMAGEKHRPROC destroyImageKHR;
+static imageTargetTexture2DFn imageTargetTexture2D;
+#ifdef EGL_EXT_image_dma_buf_import_modifiers
+static PFNEGLQUERYDMABUFMODIFIERSEXTPROC queryDmaBufModifiers;
+#endif
+
+// Map a V4L2 pixelformat to the DRM fourcc with the exact same memory
+// layout. Only formats whose imported texels match what the conversion
+// shader expects to sample can be listed here.
+static __u32 v4l2_fourcc_to_drm(__u32 pixelformat)
+{
+	switch (pixelformat) {
+	case V4L2_PIX_FMT_RGB565:
+		return DRM_FORMAT_RGB565;
+	case V4L2_PIX_FMT_RGB24:
+		return DRM_FORMAT_BGR888;
+	case V4L2_PIX_FMT_BGR24:
+		return DRM_FORMAT_RGB888;
+	case V4L2_PIX_FMT_XBGR32:
+		return DRM_FORMAT_XRGB8888;
+	case V4L2_PIX_FMT_ABGR32:
+		return DRM_FORMAT_ARGB8888;
+	case V4L2_PIX_FMT_RGBX32:
+		return DRM_FORMAT_XBGR8888;
+	case V4L2_PIX_FMT_RGBA32:
+		return DRM_FORMAT_ABGR8888;
+	default:
+		return 0;
+	}
+}
+#endif
+
+#ifdef CAN_IMPORT_DMABUF
+
+bool CaptureWin::initDmabuf()
+{
+	unsigned b;
+
+	if (m_mode != AppModeV4L2 || m_v4l_queue == NULL)
+		return false;
+	if (m_v4l_queue->g_memory() != V4L2_MEMORY_MMAP ||
+	    m_v4l_queue->g_num_planes() != 1)
+		return false;
+
+	__u32 fourcc = v4l2_fourcc_to_drm(m_v4l_fmt.g_pixelformat());
+
+	if (fourcc == 0) {
+		if (m_verbose)
+			printf("dmabuf import: no DRM equivalent for format '%s'\n",
+			       fcc2s(m_v4l_fmt.g_pixelformat()).c_str());
+		return false;
+	}
+
+	EGLDisplay dpy = eglGetCurrentDisplay();
+
+	if (dpy == EGL_NO_DISPLAY) {
+		if (m_verbose)
+			printf("dmabuf import: not running on EGL\n");
+		return false;
+	}
+
+	const char *exts = eglQueryString(dpy, EGL_EXTENSIONS);
+
+	if (exts == NULL ||
+	    strstr(exts, "EGL_KHR_image_base") == NULL ||
+	    strstr(exts, "EGL_EXT_image_dma_buf_import") == NULL ||
+	    !context()->hasExtension("GL_OES_EGL_image")) {
+		if (m_verbose)
+			printf("dmabuf import: missing EGL/GL extensions\n");
+		return false;
+	}
+
+	createImageKHR = (PFNEGLCREATEIMAGEKHRPROC)
+		eglGetProcAddress("eglCreateImageKHR");
+	destroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC)
+		eglGetProcAddress("eglDestroyImageKHR");
+	imageTargetTexture2D = (imageTargetTexture2DFn)
+		eglGetProcAddress("glEGLImageTargetTexture2DOES");
+	if (!createImageKHR || !destroyImageKHR || !imageTargetTexture2D)
+		return false;
+
+	// The buffers exported by VIDIOC_EXPBUF are linear. If the EGL
+	// implementation can enumerate the modifiers it supports for this
+	// format, check that the linear modifier is among them and pass it
+	// explicitly, otherwise rely on the implicit default.
+	bool explicit_modifier = false;
+
+#ifdef EGL_EXT_image_dma_buf_import_modifiers
+	if (strstr(exts, "EGL_EXT_image_dma_buf_import_modifiers")) {
+		queryDmaBufModifiers = (PFNEGLQUERYDMABUFMODIFIERSEXTPROC)
+			eglGetProcAddress("eglQueryDmaBufModifiersEXT");
+
+		EGLuint64KHR modifiers[64];
+		EGLBoolean external_only[64];
+		EGLint num_modifiers = 0;
+
+		if (queryDmaBufModifiers &&
+		    queryDmaBufModifiers(dpy, fourcc, 64, modifiers,
+					 external_only, &num_modifiers)) {
+			EGLint i;
+
+			for (i = 0; i < num_modifiers; i++)
+				if (modifiers[i] == DRM_FORMAT_MOD_LINEAR &&
+				    !external_only[i])
+					break;
+			if (num_modifiers && i == num_modifiers) {
+				if (m_verbose)
+					printf("dmabuf import: linear modifier not supported for '%s'\n",
+					       fcc2s(m_v4l_fmt.g_pixelformat()).c_str());
+				return false;
+			}
+			explicit_modifier = num_modifiers > 0;
+		}
+	}
+#endif
+
+	if (m_v4l_queue->export_bufs(m_fd, m_fd->g_type())) {
+		if (m_verbose)
+			printf("dmabuf import: VIDIOC_EXPBUF failed\n");
+		return false;
+	}
+
+	for (b = 0; b < m_v4l_queue->g_buffers(); b++) {
+		EGLint attrs[] = {
+			EGL_WIDTH, (EGLint)m_v4l_fmt.g_width(),
+			EGL_HEIGHT, (EGLint)m_v4l_fmt.g_height(),
+			EGL_LINUX_DRM_FOURCC_EXT, (EGLint)fourcc,
+			EGL_DMA_BUF_PLANE0_FD_EXT, m_v4l_queue->g_fd(b, 0),
+			EGL_DMA_BUF_PLANE0_OFFSET_EXT, 0,
+			EGL_DMA_BUF_PLANE0_PITCH_EXT, (EGLint)m_v4l_fmt.g_bytesperline(),
+			EGL_NONE, EGL_NONE,
+			EGL_NONE, EGL_NONE,
+			EGL_NONE,
+		};
+
+#ifdef EGL_EXT_image_dma_buf_import_modifiers
+		if (explicit_modifier) {
+			attrs[12] = EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT;
+			attrs[13] = (EGLint)(DRM_FORMAT_MOD_LINEAR & 0xffffffff);
+			attrs[14] = EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT;
+			attrs[15] = (EGLint)(DRM_FORMAT_MOD_LINEAR >> 32);
+		}
+#else
+		(void)explicit_modifier;
+#endif
+
+		m_eglImages[b] = createImageKHR(dpy, EGL_NO_CONTEXT,
+						EGL_LINUX_DMA_BUF_EXT, NULL,
+						attrs);
+		if (m_eglImages[b] == EGL_NO_IMAGE_KHR) {
+			if (m_verbose)
+				printf("dmabuf import: eglCreateImageKHR failed for buffer %u\n", b);
+			m_eglDisplay = dpy;
+			destroyDmabuf();
+			return false;
+		}
+	}
+
+	m_eglDisplay = dpy;
+	if (m_verbose)
+		printf("dmabuf import: sampling capture buffers directly as '%s'\n",
+		       fcc2s(fourcc).c_str());
+	return true;
+}
+
+void CaptureWin::destroyDmabuf()
+{
+	unsigned b;
+
+	if (m_eglDisplay == NULL)
+		return;
+
+	for (b = 0; b < VIDEO_MAX_FRAME; b++) {
+		if (m_eglImages[b])
+			destroyImageKHR((EGLDisplay)m_eglDisplay,
+					(EGLImageKHR)m_eglImages[b]);
+		m_eglImages[b] = NULL;
+	}
+	if (m_v4l_queue)
+		m_v4l_queue->close_exported_fds();
+	m_eglDisplay = NULL;
+	m_useDmabuf = false;
+}
+
+#else
+
+bool CaptureWin::initDmabuf()
+{
+	return false;
+}
+
+void CaptureWin::destroyDmabuf()
+{
+}
+
+#endif /* CAN_IMPORT_DMABUF */
+
+#ifdef GL_ARB_buffer_storage
+#define CAN_USE_PBO_RING
+
+// Each plane is staged at a 64 byte aligned offset in the PBO
+#define PBO_ALIGN(x) (((x) + 63) & ~(size_t)63)
+
+bool CaptureWin::initPbo(size_t size)
+{
+	unsigned i;
+
+	destroyPbo();
+
+	glGenBuffers(PBO_RING_SIZE, m_pboRing);
+	for (i = 0; i < PBO_RING_SIZE; i++) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pboRing[i]);
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL,
+				GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+				GL_MAP_COHERENT_BIT);
+		m_pboMap[i] = (__u8 *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+				0, size,
+				GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+				GL_MAP_COHERENT_BIT);
+		if (glGetError() != GL_NO_ERROR || m_pboMap[i] == NULL) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			destroyPbo();
+			return false;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_pboSize = size;
+	m_pboSlot = 0;
+	if (m_verbose)
+		printf("using a persistent-mapped PBO ring of %u x %zu bytes for uploads\n",
+		       PBO_RING_SIZE, size);
+	return true;
+}
+
+void CaptureWin::destroyPbo()
+{
+	unsigned i;
+
+	for (i = 0; i < PBO_RING_SIZE; i++) {
+		if (m_pboFence[i]) {
+			glDeleteSync((GLsync)m_pboFence[i]);
+			m_pboFence[i] = NULL;
+		}
+		if (m_pboMap[i]) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pboRing[i]);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			m_pboMap[i] = NULL;
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	if (m_pboRing[0])
+		glDeleteBuffers(PBO_RING_SIZE, m_pboRing);
+	memset(m_pboRing, 0, sizeof(m_pboRing));
+	m_pboSize = 0;
+}
+
+bool CaptureWin::pboUploadBegin(__u8 **savedData)
+{
+	unsigned slot = m_pboSlot;
+	size_t total = 0;
+	size_t offset;
+	unsigned i;
+
+	for (i = 0; i < MAX_TEXTURES_NEEDED; i++)
+		if (m_curData[i] && m_curSize[i])
+			total += PBO_ALIGN(m_curSize[i]);
+	if (total == 0)
+		return false;
+	if (total > m_pboSize && !initPbo(total))
+		return false;
+
+	// Wait until the upload from this slot, issued PBO_RING_SIZE frames
+	// ago, has been consumed by the GPU before overwriting it.
+	if (m_pboFence[slot]) {
+		glClientWaitSync((GLsync)m_pboFence[slot],
+				 GL_SYNC_FLUSH_COMMANDS_BIT, 100000000ULL);
+		glDeleteSync((GLsync)m_pboFence[slot]);
+		m_pboFence[slot] = NULL;
+	}
+
+	// While the PBO is bound as GL_PIXEL_UNPACK_BUFFER the data pointers
+	// passed to glTexSubImage2D are interpreted as byte offsets into it,
+	// so the render functions can be used unmodified.
+	offset = 0;
+	for (i = 0; i < MAX_TEXTURES_NEEDED; i++) {
+		savedData[i] = m_curData[i];
+		if (m_curData[i] == NULL || m_curSize[i] == 0)
+			continue;
+		memcpy(m_pboMap[slot] + offset, m_curData[i], m_curSize[i]);
+		m_curData[i] = (__u8 *)(size_t)offset;
+		offset += PBO_ALIGN(m_curSize[i]);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pboRing[slot]);
+	return true;
+}
+
+void CaptureWin::pboUploadEnd(__u8 **savedData)
+{
+	unsigned i;
+
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	m_pboFence[m_pboSlot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	m_pboSlot = (m_pboSlot + 1) % PBO_RING_SIZE;
+	for (i = 0; i < MAX_TEXTURES_NEEDED; i++)
+		m_curData[i] = savedData[i];
+}
+
+#else
+
+bool CaptureWin::initPbo(size_t)
+{
+	return false;
+}
+
+void CaptureWin::destroyPbo()
+{
+}
+
+bool CaptureWin::pboUploadBegin(__u8 **)
+{
+	return false;
+}
+
+void CaptureWin::pboUploadEnd(__u8 **)
+{
+}
+
+#endif /* GL_ARB_buffer_storage */
+
 void CaptureWin::initializeGL()
 {
 	initializeOpenGLFunctions();
@@ -112,6 +469,12 @@ void CaptureWin::paintGL()
 	if (!supportedFmt(m_v4l_fmt.g_pixelformat()))
 		return;
 
+	// Stage the frame in a persistent-mapped PBO so the glTexSubImage2D
+	// calls in the render functions source from it asynchronously
+	// instead of stalling on a client-memory copy.
+	__u8 *savedData[MAX_TEXTURES_NEEDED] = {};
+	bool pboActive = !m_useDmabuf && m_usePbo && pboUploadBegin(savedData);
+
 	switch (m_v4l_fmt.g_pixelformat()) {
 	case V4L2_PIX_FMT_YUYV:
 	case V4L2_PIX_FMT_YVYU:
@@ -233,6 +596,9 @@ void CaptureWin::paintGL()
 		break;
 	}
 
+	if (pboActive)
+		pboUploadEnd(savedData);
+
 	static unsigned long long tot_t;
 	static unsigned cnt;
 	GLuint query;
@@ -312,6 +678,128 @@ void CaptureWin::paintGL()
 		printf("Average render time: %09u ns, frame %d render time: %09u ns\n",
 		       ave, cnt, t);
 	}
+
+	if (m_analysisOverlay->isChecked())
+		renderAnalysis();
+}
+
+/*
+ * Analysis overlay: per-channel histogram and a running frame-diff
+ * heatmap. Both are computed from the rendered output read back from
+ * the framebuffer, so every pixel format the shaders can display is
+ * analyzed without format specific code and after all colorspace
+ * conversions were applied.
+ */
+#define ANALYSIS_GRID_W 80
+#define ANALYSIS_GRID_H 45
+#define ANALYSIS_HIST_H 100
+
+void CaptureWin::renderAnalysis()
+{
+	QSize s = correctAspect(m_viewSize);
+	bool scale = m_scrollArea->widgetResizable();
+	int vx = scale ? (size().width() - s.width()) / 2 : 0;
+	int vy = scale ? (size().height() - s.height()) / 2 : 0;
+	int vw = s.width();
+	int vh = s.height();
+
+	if (vw < ANALYSIS_GRID_W || vh < ANALYSIS_GRID_H)
+		return;
+
+	unsigned rbsize = (unsigned)vw * vh * 4;
+
+	if (rbsize > m_analysisReadbackSize) {
+		delete [] m_analysisReadback;
+		m_analysisReadback = new __u8[rbsize];
+		m_analysisReadbackSize = rbsize;
+	}
+	if (!m_analysisPrev) {
+		m_analysisPrev = new __u8[ANALYSIS_GRID_W * ANALYSIS_GRID_H];
+		memset(m_analysisPrev, 0, ANALYSIS_GRID_W * ANALYSIS_GRID_H);
+	}
+	if (m_analysisHeat.isNull())
+		m_analysisHeat = QImage(ANALYSIS_GRID_W, ANALYSIS_GRID_H,
+					QImage::Format_RGB32);
+
+	glReadPixels(vx, vy, vw, vh, GL_RGBA, GL_UNSIGNED_BYTE,
+		     m_analysisReadback);
+	checkError("renderAnalysis");
+
+	unsigned cellSum[ANALYSIS_GRID_H][ANALYSIS_GRID_W] = {};
+	unsigned cellCnt[ANALYSIS_GRID_H][ANALYSIS_GRID_W] = {};
+
+	memset(m_analysisHist, 0, sizeof(m_analysisHist));
+
+	/*
+	 * One sweep over the frame gathers the three histograms and the
+	 * downscaled luma grid. The per-bin increments cannot be turned
+	 * into SIMD, so the loop is kept branchless per pixel and walks
+	 * the buffer linearly: the pass is memory bound either way.
+	 */
+	for (int y = 0; y < vh; y++) {
+		const __u8 *p = m_analysisReadback + (unsigned)y * vw * 4;
+		unsigned *sumRow = cellSum[y * ANALYSIS_GRID_H / vh];
+		unsigned *cntRow = cellCnt[y * ANALYSIS_GRID_H / vh];
+
+		for (int x = 0; x < vw; x++, p += 4) {
+			unsigned cx = (unsigned)x * ANALYSIS_GRID_W / vw;
+
+			m_analysisHist[0][p[0]]++;
+			m_analysisHist[1][p[1]]++;
+			m_analysisHist[2][p[2]]++;
+			sumRow[cx] += (p[0] + 2 * p[1] + p[2]) >> 2;
+			cntRow[cx]++;
+		}
+	}
+
+	for (unsigned cy = 0; cy < ANALYSIS_GRID_H; cy++) {
+		// glReadPixels returns bottom-up lines, flip the heatmap
+		QRgb *row = (QRgb *)m_analysisHeat.scanLine(ANALYSIS_GRID_H - 1 - cy);
+
+		for (unsigned cx = 0; cx < ANALYSIS_GRID_W; cx++) {
+			__u8 *prev = &m_analysisPrev[cy * ANALYSIS_GRID_W + cx];
+			unsigned mean = cellCnt[cy][cx] ?
+				cellSum[cy][cx] / cellCnt[cy][cx] : 0;
+			unsigned diff = mean > *prev ? mean - *prev : *prev - mean;
+
+			*prev = mean;
+			diff = diff * 4 > 255 ? 255 : diff * 4;
+			row[cx] = qRgb(diff, diff >= 128 ? 2 * (diff - 128) : 0,
+				       255 - diff);
+		}
+	}
+
+	unsigned histMax = 1;
+
+	for (unsigned c = 0; c < 3; c++)
+		for (unsigned i = 0; i < 256; i++)
+			if (m_analysisHist[c][i] > histMax)
+				histMax = m_analysisHist[c][i];
+
+	QPainter painter(this);
+	const QColor colors[3] = {
+		QColor(255, 64, 64), QColor(64, 255, 64), QColor(96, 160, 255)
+	};
+	QRect histRect(16, 20, 256, ANALYSIS_HIST_H);
+	QRect heatRect(16, histRect.bottom() + 28,
+		       3 * ANALYSIS_GRID_W, 3 * ANALYSIS_GRID_H);
+
+	painter.fillRect(histRect.adjusted(-4, -4, 4, 4), QColor(0, 0, 0, 160));
+	for (unsigned c = 0; c < 3; c++) {
+		QPolygon poly;
+
+		for (unsigned i = 0; i < 256; i++)
+			poly << QPoint(histRect.left() + i,
+				       histRect.bottom() -
+				       (int)((__u64)m_analysisHist[c][i] *
+					     (ANALYSIS_HIST_H - 1) / histMax));
+		painter.setPen(colors[c]);
+		painter.drawPolyline(poly);
+	}
+	painter.setPen(Qt::white);
+	painter.drawText(histRect.left(), histRect.top() - 6, "RGB histogram");
+	painter.drawImage(heatRect, m_analysisHeat);
+	painter.drawText(heatRect.left(), heatRect.top() - 6, "Frame diff");
 }
 
 static const char *prog =
@@ -477,6 +965,23 @@ void CaptureWin::changeShader()
 	m_program->removeAllShaders();
 	checkError("Render settings.\n");
 
+	// Try to import the capture buffers as dmabufs so the GPU samples
+	// them directly instead of paying for a glTexSubImage2D upload per
+	// frame. Falls back to the upload path when that's not possible.
+	destroyDmabuf();
+	m_useDmabuf = m_dmabufAllowed && initDmabuf();
+
+	// Where dmabuf import isn't available, fall back to staging uploads
+	// through a persistent-mapped PBO ring. The PBOs are (re)created
+	// lazily once the frame size is known.
+	destroyPbo();
+#ifdef CAN_USE_PBO_RING
+	m_usePbo = !m_useDmabuf && !context()->isOpenGLES() &&
+		   context()->hasExtension("GL_ARB_buffer_storage");
+#else
+	m_usePbo = false;
+#endif
+
 	QString code;
 
 	if (context()->isOpenGLES())
@@ -1134,6 +1639,16 @@ void CaptureWin::render_RGB(__u32 format)
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, m_screenTexture[0]);
 
+#ifdef CAN_IMPORT_DMABUF
+	if (m_useDmabuf && m_curIndex >= 0 && m_eglImages[m_curIndex]) {
+		// The texture storage is the capture buffer itself, no
+		// upload needed.
+		imageTargetTexture2D(GL_TEXTURE_2D, m_eglImages[m_curIndex]);
+		checkError("RGB dmabuf paint");
+		return;
+	}
+#endif
+
 	switch (format) {
 	case V4L2_PIX_FMT_RGB332:
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, m_v4l_fmt.g_bytesperline());
@@ -0,0 +1,362 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Memory-mapped playback engine for qvidcap --file mode.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "playback.h"
+
+/*
+ * Markers of the v4l2-ctl --stream-to-hdr container, matching
+ * utils/v4l2-ctl/v4l2-ctl-streaming.cpp.
+ */
+#define FILE_HDR_ID		v4l2_fourcc('V', 'h', 'd', 'r')
+#define FILE_HDR_V2_ID		v4l2_fourcc('V', 'h', 'd', '2')
+#define FILE_IDX_ID		v4l2_fourcc('V', 'i', 'd', 'x')
+#define FILE_IDX_ENTRY_WORDS	6
+
+/* Prefetch this many frames ahead of the playback direction */
+#define READAHEAD_FRAMES	8
+
+/* The container stores everything in network order at arbitrary alignment */
+static __u32 u32_at(const __u8 *p)
+{
+	__u32 v;
+
+	memcpy(&v, p, sizeof(v));
+	return ntohl(v);
+}
+
+FilePlayback::FilePlayback() :
+	m_fd(-1),
+	m_map(NULL),
+	m_size(0),
+	m_dataStart(0),
+	m_hdr(false),
+	m_planes(0),
+	m_imageSize(0),
+	m_frames(0),
+	m_cur(0),
+	m_dir(1),
+	m_threadRunning(false),
+	m_raFrame(0),
+	m_raPending(false),
+	m_exit(false)
+{
+	pthread_mutex_init(&m_lock, NULL);
+	pthread_cond_init(&m_cond, NULL);
+}
+
+FilePlayback::~FilePlayback()
+{
+	close();
+	pthread_cond_destroy(&m_cond);
+	pthread_mutex_destroy(&m_lock);
+}
+
+bool FilePlayback::open(const char *filename)
+{
+	struct stat st;
+
+	close();
+	m_fd = ::open(filename, O_RDONLY);
+	if (m_fd < 0)
+		return false;
+	if (fstat(m_fd, &st) || !st.st_size) {
+		::close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+	m_size = st.st_size;
+	m_map = (__u8 *)mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (m_map == MAP_FAILED) {
+		m_map = NULL;
+		m_size = 0;
+		::close(m_fd);
+		m_fd = -1;
+		return false;
+	}
+
+	if (m_size >= (off_t)sizeof(__u32)) {
+		__u32 magic = u32_at(m_map);
+
+		if (magic == FILE_HDR_V2_ID) {
+			m_hdr = true;
+			m_dataStart = sizeof(__u32);
+		} else if (magic == FILE_HDR_ID) {
+			m_hdr = true;
+			m_dataStart = 0;
+		}
+	}
+	return true;
+}
+
+void FilePlayback::close()
+{
+	stopReadahead();
+	if (m_map)
+		munmap(m_map, m_size);
+	if (m_fd >= 0)
+		::close(m_fd);
+	m_fd = -1;
+	m_map = NULL;
+	m_size = 0;
+	m_dataStart = 0;
+	m_hdr = false;
+	m_frames = 0;
+	m_cur = 0;
+	m_dir = 1;
+	m_offsets.clear();
+}
+
+bool FilePlayback::setFrameSize(unsigned planes, const unsigned sizes[],
+				unsigned imageSize)
+{
+	stopReadahead();
+	m_planes = planes;
+	m_planeSizes.assign(sizes, sizes + planes);
+	m_imageSize = imageSize;
+	m_frames = 0;
+	m_cur = 0;
+	m_dir = 1;
+	m_offsets.clear();
+
+	if (!m_map || !imageSize)
+		return false;
+
+	if (!m_hdr) {
+		m_frames = m_size / imageSize;
+		if (!m_frames) {
+			fprintf(stderr, "the file size is too small (expect at least %u, got %llu)\n",
+				imageSize, (unsigned long long)m_size);
+			return false;
+		}
+	} else {
+		if (!indexFromFooter() && !indexFromScan()) {
+			fprintf(stderr, "no usable frames found in the file\n");
+			m_offsets.clear();
+			return false;
+		}
+		if (!checkRecord(m_offsets[0])) {
+			m_offsets.clear();
+			return false;
+		}
+		m_frames = m_offsets.size();
+	}
+	startReadahead();
+	return true;
+}
+
+/*
+ * Indexed recordings end in per-frame entries of FILE_IDX_ENTRY_WORDS
+ * words followed by [entry count, FILE_IDX_ID].  Falls back to scanning
+ * when the recording was cut short before the index was appended.
+ */
+bool FilePlayback::indexFromFooter()
+{
+	off_t trailer = m_size - 2 * sizeof(__u32);
+
+	if (trailer <= m_dataStart ||
+	    u32_at(m_map + trailer + sizeof(__u32)) != FILE_IDX_ID)
+		return false;
+
+	__u32 count = u32_at(m_map + trailer);
+	off_t idx = trailer -
+		(off_t)count * FILE_IDX_ENTRY_WORDS * sizeof(__u32);
+
+	if (!count || idx < m_dataStart)
+		return false;
+	for (__u32 i = 0; i < count; i++) {
+		const __u8 *e = m_map + idx +
+			(off_t)i * FILE_IDX_ENTRY_WORDS * sizeof(__u32);
+		off_t off = ((off_t)u32_at(e) << 32) | u32_at(e + sizeof(__u32));
+
+		if (off + (off_t)sizeof(__u32) > idx ||
+		    u32_at(m_map + off) != FILE_HDR_ID) {
+			m_offsets.clear();
+			return false;
+		}
+		m_offsets.push_back(off);
+	}
+	return true;
+}
+
+bool FilePlayback::indexFromScan()
+{
+	off_t off = m_dataStart;
+
+	m_offsets.clear();
+	while (off + (off_t)sizeof(__u32) <= m_size &&
+	       u32_at(m_map + off) == FILE_HDR_ID) {
+		off_t rec = off;
+		unsigned p;
+
+		off += sizeof(__u32);
+		for (p = 0; p < m_planes; p++) {
+			if (off + (off_t)sizeof(__u32) > m_size)
+				break;
+			off += sizeof(__u32) + u32_at(m_map + off);
+			if (off > m_size)
+				break;
+		}
+		/* a truncated trailing record is silently dropped */
+		if (p < m_planes)
+			break;
+		m_offsets.push_back(rec);
+	}
+	return !m_offsets.empty();
+}
+
+/*
+ * The zero-copy path needs the stored planes to match the current format
+ * exactly, which rules out compressed recordings.
+ */
+bool FilePlayback::checkRecord(off_t off)
+{
+	off += sizeof(__u32);
+	for (unsigned p = 0; p < m_planes; p++) {
+		if (off + (off_t)sizeof(__u32) > m_size)
+			return false;
+
+		__u32 sz = u32_at(m_map + off);
+
+		if (sz != m_planeSizes[p]) {
+			fprintf(stderr, "file holds %u byte planes, expected %u (compressed recording?)\n",
+				sz, m_planeSizes[p]);
+			return false;
+		}
+		off += sizeof(__u32) + sz;
+	}
+	return true;
+}
+
+off_t FilePlayback::frameOffset(unsigned frame) const
+{
+	if (m_hdr)
+		return m_offsets[frame];
+	return (off_t)frame * m_imageSize;
+}
+
+unsigned FilePlayback::recordSize() const
+{
+	if (m_hdr)
+		return m_imageSize + (m_planes + 1) * sizeof(__u32);
+	return m_imageSize;
+}
+
+unsigned FilePlayback::next()
+{
+	m_dir = 1;
+	return m_frames ? (m_cur + 1) % m_frames : 0;
+}
+
+unsigned FilePlayback::prev()
+{
+	m_dir = -1;
+	if (!m_frames)
+		return 0;
+	return m_cur ? m_cur - 1 : m_frames - 1;
+}
+
+void FilePlayback::seek(unsigned frame)
+{
+	if (m_frames)
+		m_cur = frame % m_frames;
+}
+
+bool FilePlayback::frame(unsigned frame, __u8 *data[])
+{
+	if (frame >= m_frames)
+		return false;
+
+	__u8 *p = m_map + frameOffset(frame);
+
+	if (m_hdr)
+		p += sizeof(__u32);
+	for (unsigned i = 0; i < m_planes; i++) {
+		if (m_hdr)
+			p += sizeof(__u32);
+		data[i] = p;
+		p += m_planeSizes[i];
+	}
+	m_cur = frame;
+
+	pthread_mutex_lock(&m_lock);
+	m_raFrame = frame;
+	m_raPending = true;
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_lock);
+	return true;
+}
+
+void FilePlayback::startReadahead()
+{
+	if (m_threadRunning)
+		return;
+	m_exit = false;
+	m_raPending = false;
+	m_threadRunning = !pthread_create(&m_thread, NULL,
+					  readaheadThread, this);
+}
+
+void FilePlayback::stopReadahead()
+{
+	if (!m_threadRunning)
+		return;
+	pthread_mutex_lock(&m_lock);
+	m_exit = true;
+	pthread_cond_signal(&m_cond);
+	pthread_mutex_unlock(&m_lock);
+	pthread_join(m_thread, NULL);
+	m_threadRunning = false;
+}
+
+void *FilePlayback::readaheadThread(void *arg)
+{
+	((FilePlayback *)arg)->readahead();
+	return NULL;
+}
+
+/*
+ * Waits for a frame access, then asks the kernel to fault in the frames
+ * the render thread is about to need.  The index is only rebuilt while
+ * this thread is stopped, so it can be read here without the lock.
+ */
+void FilePlayback::readahead()
+{
+	long pagemask = sysconf(_SC_PAGESIZE) - 1;
+
+	pthread_mutex_lock(&m_lock);
+	while (!m_exit) {
+		if (!m_raPending) {
+			pthread_cond_wait(&m_cond, &m_lock);
+			continue;
+		}
+
+		unsigned frame = m_raFrame;
+		int dir = m_dir;
+
+		m_raPending = false;
+		pthread_mutex_unlock(&m_lock);
+
+		for (unsigned i = 1; i <= READAHEAD_FRAMES && i < m_frames; i++) {
+			unsigned f = dir > 0 ?
+				(frame + i) % m_frames :
+				(frame + m_frames - i) % m_frames;
+			off_t off = frameOffset(f);
+			off_t end = off + recordSize();
+
+			off &= ~(off_t)pagemask;
+			madvise(m_map + off, end - off, MADV_WILLNEED);
+		}
+		pthread_mutex_lock(&m_lock);
+	}
+	pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,97 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Memory-mapped playback engine for qvidcap --file mode.
+ */
+
+#ifndef PLAYBACK_H
+#define PLAYBACK_H
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <linux/videodev2.h>
+
+#include <vector>
+
+/*
+ * Maps a recording once and hands out pointers straight into the mapping,
+ * so stepping and scrubbing never copy frame data.  Both raw frame dumps
+ * and v4l2-ctl --stream-to-hdr recordings (with or without the 'Vidx'
+ * footer index) are supported.  A helper thread prefetches a few frames
+ * ahead of the playback direction with madvise(MADV_WILLNEED), which
+ * keeps multi-GB recordings on slow storage smooth without ever blocking
+ * the render thread on disk I/O.
+ */
+class FilePlayback {
+public:
+	FilePlayback();
+	~FilePlayback();
+
+	bool open(const char *filename);
+	void close();
+	bool isOpen() const { return m_map != NULL; }
+	off_t fileSize() const { return m_size; }
+
+	/*
+	 * (Re)build the frame index once the frame layout is known.  Raw
+	 * files are cut into fixed imageSize records, hdr recordings are
+	 * indexed from the footer when present and by walking the 'Vhdr'
+	 * records otherwise.  Returns false, leaving no frames, when the
+	 * file doesn't hold a single frame of this layout.
+	 */
+	bool setFrameSize(unsigned planes, const unsigned sizes[],
+			  unsigned imageSize);
+
+	unsigned numFrames() const { return m_frames; }
+	unsigned curFrame() const { return m_cur; }
+
+	/*
+	 * The frame adjacent to the current one, wrapping around at both
+	 * ends.  These also set the direction the readahead thread
+	 * prefetches in.
+	 */
+	unsigned next();
+	unsigned prev();
+	void seek(unsigned frame);
+
+	/*
+	 * Point data[] at the planes of the given frame inside the
+	 * mapping and kick the readahead thread.  The mapping is
+	 * read-only: the pointers stay valid until close(), but must
+	 * never be written through.
+	 */
+	bool frame(unsigned frame, __u8 *data[]);
+
+private:
+	bool indexFromFooter();
+	bool indexFromScan();
+	bool checkRecord(off_t off);
+	off_t frameOffset(unsigned frame) const;
+	unsigned recordSize() const;
+	void startReadahead();
+	void stopReadahead();
+	void readahead();
+	static void *readaheadThread(void *arg);
+
+	int m_fd;
+	__u8 *m_map;
+	off_t m_size;
+	off_t m_dataStart;
+	bool m_hdr;		/* a --stream-to-hdr recording, not raw frames */
+	unsigned m_planes;
+	std::vector<unsigned> m_planeSizes;
+	unsigned m_imageSize;
+	unsigned m_frames;
+	unsigned m_cur;
+	int m_dir;
+	std::vector<off_t> m_offsets;	/* hdr frame record offsets */
+
+	pthread_t m_thread;
+	bool m_threadRunning;
+	pthread_mutex_t m_lock;
+	pthread_cond_t m_cond;
+	unsigned m_raFrame;
+	bool m_raPending;
+	bool m_exit;
+};
+
+#endif
@@ -26,7 +26,12 @@ static void usage()
 	       "Options:\n\n"
 	       "  -d, --device=<dev>       use device <dev> as the video device\n"
 	       "                           if <dev> is a number, then /dev/video<dev> is used\n"
-	       "  -f, --file=<file>        read from the file <file> for the raw frame data\n"
+	       "  -f, --file=<file>        read from the file <file> for the frame data. The file\n"
+	       "                           holds either raw frames or a v4l2-ctl --stream-to-hdr\n"
+	       "                           recording of uncompressed frames. The file is mapped\n"
+	       "                           into memory: use B to reverse the playback direction,\n"
+	       "                           , and . to step a frame back/forward and Home/End to\n"
+	       "                           jump to the first/last frame.\n"
 	       "  -p, --port[=<port>]      listen for a network connection on the given port\n"
 	       "                           The default port is %d\n"
 	       "  -T, --tpg                use the test pattern generator\n"
@@ -67,6 +72,8 @@ static void usage()
 	       "\n"
 	       "  --opengl                 force openGL to display the video\n"
 	       "  --opengles               force openGL ES to display the video\n"
+	       "  --no-dmabuf              never import capture buffers as dmabufs, always\n"
+	       "                           upload the frames to the GPU\n"
 	       "\n"
 	       "  The following options are ignored when capturing from a video device:\n"
 	       "\n"
@@ -444,6 +451,7 @@ int main(int argc, char **argv)
 	bool info_option = false;
 	bool report_timings = false;
 	bool verbose = false;
+	bool no_dmabuf = false;
 	__u32 overridePixelFormat = 0;
 	__u32 overrideWidth = 0;
 	__u32 overrideHeight = 0;
@@ -647,6 +655,8 @@ int main(int argc, char **argv)
 			force_opengl = true;
 		} else if (isOption(args[i], "--verbose", "-v")) {
 			verbose = true;
+		} else if (isOption(args[i], "--no-dmabuf")) {
+			no_dmabuf = true;
 		} else if (isOption(args[i], "--raw", "-R")) {
 			fd.s_direct(true);
 		} else if (isOptArg(args[i], "--count", "-c")) {
@@ -743,6 +753,7 @@ int main(int argc, char **argv)
 	QSurfaceFormat::setDefaultFormat(format);
 	CaptureWin win(sa);
 	win.setVerbose(verbose);
+	win.setDmabufAllowed(!no_dmabuf);
 	if (mode == AppModeFile) {
 		win.setModeFile(filename);
 		if (single_step_start)
@@ -18,10 +18,12 @@ INCLUDEPATH += $$PWD/../v4l2-compliance
 
 # Input
 HEADERS += capture.h
+HEADERS += playback.h
 HEADERS += qvidcap.h
 HEADERS += ../../config.h
 
 SOURCES += capture.cpp paint.cpp
+SOURCES += playback.cpp
 SOURCES += qvidcap.cpp
 SOURCES += ../common/v4l-stream.c
 SOURCES += ../common/codec-fwht.c
@@ -113,31 +113,68 @@ void main()
 
 #if IS_RGB
 
-// Bayer pixel formats
+// Bayer pixel formats, demosaiced with bilinear interpolation: the
+// missing green is the average of the 4 edge neighbours, the missing
+// opposite colour the average of the 4 diagonal neighbours, and at
+// green sites red and blue come from the 2 neighbours in their row or
+// column. Samples outside the image clamp to the edge.
+#if PIXFMT == V4L2_PIX_FMT_SBGGR8 || PIXFMT == V4L2_PIX_FMT_SBGGR10 || PIXFMT == V4L2_PIX_FMT_SBGGR12 || PIXFMT == V4L2_PIX_FMT_SBGGR16 || \
+    PIXFMT == V4L2_PIX_FMT_SGBRG8 || PIXFMT == V4L2_PIX_FMT_SGBRG10 || PIXFMT == V4L2_PIX_FMT_SGBRG12 || PIXFMT == V4L2_PIX_FMT_SGBRG16 || \
+    PIXFMT == V4L2_PIX_FMT_SGRBG8 || PIXFMT == V4L2_PIX_FMT_SGRBG10 || PIXFMT == V4L2_PIX_FMT_SGRBG12 || PIXFMT == V4L2_PIX_FMT_SGRBG16 || \
+    PIXFMT == V4L2_PIX_FMT_SRGGB8 || PIXFMT == V4L2_PIX_FMT_SRGGB10 || PIXFMT == V4L2_PIX_FMT_SRGGB12 || PIXFMT == V4L2_PIX_FMT_SRGGB16
+	float c00 = float(texture(tex, xy).r);
+	float cxm = float(texture(tex, vec2(xy.x - texl_w, xy.y)).r);
+	float cxp = float(texture(tex, vec2(xy.x + texl_w, xy.y)).r);
+	float cym = float(texture(tex, vec2(xy.x, xy.y - texl_h)).r);
+	float cyp = float(texture(tex, vec2(xy.x, xy.y + texl_h)).r);
+	float cmm = float(texture(tex, vec2(xy.x - texl_w, xy.y - texl_h)).r);
+	float cpm = float(texture(tex, vec2(xy.x + texl_w, xy.y - texl_h)).r);
+	float cmp = float(texture(tex, vec2(xy.x - texl_w, xy.y + texl_h)).r);
+	float cpp = float(texture(tex, vec2(xy.x + texl_w, xy.y + texl_h)).r);
+	float hor = (cxm + cxp) / 2.0;
+	float ver = (cym + cyp) / 2.0;
+	float edge = (cxm + cxp + cym + cyp) / 4.0;
+	float diag = (cmm + cpm + cmp + cpp) / 4.0;
+	vec3 brgb;
+
 #if PIXFMT == V4L2_PIX_FMT_SBGGR8 || PIXFMT == V4L2_PIX_FMT_SBGGR10 || PIXFMT == V4L2_PIX_FMT_SBGGR12 || PIXFMT == V4L2_PIX_FMT_SBGGR16
-	uvec4 urgb;
-	vec2 cell = vec2(xeven ? xy.x : xy.x - texl_w, yeven ? xy.y : xy.y - texl_h);
-	urgb.r = texture(tex, vec2(cell.x + texl_w, cell.y + texl_h)).r;
-	urgb.g = texture(tex, vec2((cell.y == xy.y) ? cell.x + texl_w : cell.x, xy.y)).r;
-	urgb.b = texture(tex, cell).r;
+	if (xeven && yeven)
+		brgb = vec3(diag, edge, c00);	// blue site
+	else if (!xeven && !yeven)
+		brgb = vec3(c00, edge, diag);	// red site
+	else if (yeven)
+		brgb = vec3(ver, c00, hor);	// green site, blue row
+	else
+		brgb = vec3(hor, c00, ver);	// green site, red row
 #elif PIXFMT == V4L2_PIX_FMT_SGBRG8 || PIXFMT == V4L2_PIX_FMT_SGBRG10 || PIXFMT == V4L2_PIX_FMT_SGBRG12 || PIXFMT == V4L2_PIX_FMT_SGBRG16
-	uvec4 urgb;
-	vec2 cell = vec2(xeven ? xy.x : xy.x - texl_w, yeven ? xy.y : xy.y - texl_h);
-	urgb.r = texture(tex, vec2(cell.x, cell.y + texl_h)).r;
-	urgb.g = texture(tex, vec2((cell.y == xy.y) ? cell.x : cell.x + texl_w, xy.y)).r;
-	urgb.b = texture(tex, vec2(cell.x + texl_w, cell.y)).r;
+	if (xeven && yeven)
+		brgb = vec3(ver, c00, hor);	// green site, blue row
+	else if (!xeven && !yeven)
+		brgb = vec3(hor, c00, ver);	// green site, red row
+	else if (yeven)
+		brgb = vec3(diag, edge, c00);	// blue site
+	else
+		brgb = vec3(c00, edge, diag);	// red site
 #elif PIXFMT == V4L2_PIX_FMT_SGRBG8 || PIXFMT == V4L2_PIX_FMT_SGRBG10 || PIXFMT == V4L2_PIX_FMT_SGRBG12 || PIXFMT == V4L2_PIX_FMT_SGRBG16
-	uvec4 urgb;
-	vec2 cell = vec2(xeven ? xy.x : xy.x - texl_w, yeven ? xy.y : xy.y - texl_h);
-	urgb.r = texture(tex, vec2(cell.x + texl_w, cell.y)).r;
-	urgb.g = texture(tex, vec2((cell.y == xy.y) ? cell.x : cell.x + texl_w, xy.y)).r;
-	urgb.b = texture(tex, vec2(cell.x, cell.y + texl_h)).r;
-#elif PIXFMT == V4L2_PIX_FMT_SRGGB8 || PIXFMT == V4L2_PIX_FMT_SRGGB10 || PIXFMT == V4L2_PIX_FMT_SRGGB12 || PIXFMT == V4L2_PIX_FMT_SRGGB16
-	uvec4 urgb;
-	vec2 cell = vec2(xeven ? xy.x : xy.x - texl_w, yeven ? xy.y : xy.y - texl_h);
-	urgb.b = texture(tex, vec2(cell.x + texl_w, cell.y + texl_h)).r;
-	urgb.g = texture(tex, vec2((cell.y == xy.y) ? cell.x + texl_w : cell.x, xy.y)).r;
-	urgb.r = texture(tex, cell).r;
+	if (xeven && yeven)
+		brgb = vec3(hor, c00, ver);	// green site, red row
+	else if (!xeven && !yeven)
+		brgb = vec3(ver, c00, hor);	// green site, blue row
+	else if (yeven)
+		brgb = vec3(c00, edge, diag);	// red site
+	else
+		brgb = vec3(diag, edge, c00);	// blue site
+#else
+	if (xeven && yeven)
+		brgb = vec3(c00, edge, diag);	// red site
+	else if (!xeven && !yeven)
+		brgb = vec3(diag, edge, c00);	// blue site
+	else if (yeven)
+		brgb = vec3(hor, c00, ver);	// green site, red row
+	else
+		brgb = vec3(ver, c00, hor);	// green site, blue row
+#endif
+
 #elif PIXFMT == V4L2_PIX_FMT_RGB32 || PIXFMT == V4L2_PIX_FMT_XRGB32 || PIXFMT == V4L2_PIX_FMT_ARGB32 || \
       PIXFMT == V4L2_PIX_FMT_RGB444 || PIXFMT == V4L2_PIX_FMT_XRGB444 || PIXFMT == V4L2_PIX_FMT_ARGB444
 	vec4 cell = texture(tex, xy);
@@ -208,16 +245,16 @@ void main()
 
 #if PIXFMT == V4L2_PIX_FMT_SBGGR8 || PIXFMT == V4L2_PIX_FMT_SGBRG8 || \
     PIXFMT == V4L2_PIX_FMT_SGRBG8 || PIXFMT == V4L2_PIX_FMT_SRGGB8
-	rgb = vec3(urgb) / 255.0;
+	rgb = brgb / 255.0;
 #elif PIXFMT == V4L2_PIX_FMT_SBGGR10 || PIXFMT == V4L2_PIX_FMT_SGBRG10 || \
       PIXFMT == V4L2_PIX_FMT_SGRBG10 || PIXFMT == V4L2_PIX_FMT_SRGGB10
-	rgb = vec3(urgb) / 1023.0;
+	rgb = brgb / 1023.0;
 #elif PIXFMT == V4L2_PIX_FMT_SBGGR12 || PIXFMT == V4L2_PIX_FMT_SGBRG12 || \
       PIXFMT == V4L2_PIX_FMT_SGRBG12 || PIXFMT == V4L2_PIX_FMT_SRGGB12
-	rgb = vec3(urgb) / 4095.0;
+	rgb = brgb / 4095.0;
 #elif PIXFMT == V4L2_PIX_FMT_SBGGR16 || PIXFMT == V4L2_PIX_FMT_SGBRG16 || \
       PIXFMT == V4L2_PIX_FMT_SGRBG16 || PIXFMT == V4L2_PIX_FMT_SRGGB16
-	rgb = vec3(urgb) / 65535.0;
+	rgb = brgb / 65535.0;
 #endif
 
 #if QUANT == V4L2_QUANTIZATION_LIM_RANGE
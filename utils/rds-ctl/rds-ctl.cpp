@@ -21,6 +21,7 @@
 #include <dirent.h>
 #include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
@@ -49,11 +50,14 @@ enum Option {
 	OptReadRds = 'R',
 	OptGetTuner = 'T',
 	OptAll = 128,
+	OptCapture,
 	OptFreqSeek,
 	OptListDevices,
 	OptListFreqBands,
 	OptOpenFile,
 	OptPrintBlock,
+	OptReplay,
+	OptReplaySpeed,
 	OptSilent,
 	OptTMC,
 	OptTunerIndex,
@@ -67,6 +71,9 @@ struct ctl_parameters {
 	char options[OptLast];
 	char fd_name[80];
 	bool filemode_active;
+	char capture_name[80];
+	char replay_name[80];
+	double replay_speed;
 	double freq;
 	uint32_t wait_limit;
 	uint8_t tuner_index;
@@ -78,6 +85,7 @@ static int app_result;
 
 static struct option long_options[] = {
 	{"all", no_argument, nullptr, OptAll},
+	{"capture", required_argument, nullptr, OptCapture},
 	{"rbds", no_argument, nullptr, OptRBDS},
 	{"device", required_argument, nullptr, OptSetDevice},
 	{"file", required_argument, nullptr, OptOpenFile},
@@ -90,6 +98,8 @@ static struct option long_options[] = {
 	{"list-freq-bands", no_argument, nullptr, OptListFreqBands},
 	{"print-block", no_argument, nullptr, OptPrintBlock},
 	{"read-rds", no_argument, nullptr, OptReadRds},
+	{"replay", required_argument, nullptr, OptReplay},
+	{"replay-speed", required_argument, nullptr, OptReplaySpeed},
 	{"set-freq", required_argument, nullptr, OptSetFreq},
 	{"tmc", no_argument, nullptr, OptTMC},
 	{"tuner-index", required_argument, nullptr, OptTunerIndex},
@@ -143,6 +153,16 @@ static void usage_rds()
 	       "  -R, --read-rds     enable reading of RDS data from device\n"
 	       "  --file <path>      open a RDS stream file dump instead of a device\n"
 	       "                     all General and Tuner Options are disabled in this mode\n"
+	       "  --capture <path>   write all received raw blocks with timestamps to <path>\n"
+	       "                     the file I/O runs in a separate thread, so the read\n"
+	       "                     loop is not stalled by disk writes\n"
+	       "  --replay <path>    feed a capture recorded with --capture back through the\n"
+	       "                     decoder, pacing the blocks by their recorded timestamps\n"
+	       "                     all General and Tuner Options are disabled in this mode\n"
+	       "  --replay-speed <factor>\n"
+	       "                     replay <factor> times faster than recorded\n"
+	       "                     use 0 to replay as fast as possible\n"
+	       "                     <default>: 1.0\n"
 	       "  --wait-limit <ms>  defines the maximum wait duration for avaibility of new\n"
 	       "                     RDS data\n"
 	       "                     <default>: 5000 ms\n"
@@ -570,6 +590,202 @@ static void print_rds_data(const struct v4l2_rds *handle, uint32_t updated_field
 		print_rds_tmc(handle, updated_fields);
 }
 
+/* raw block capture: each received block is stored with a monotonic
+ * timestamp, so captures can be replayed with the original pacing */
+#define RDS_CAP_MAGIC "RDSCAP01"
+#define RDS_CAP_MAGIC_LEN 8
+#define RDS_CAP_BUF_RECORDS 4096
+
+/* on-disk record layout: 16 bytes, little-endian timestamp */
+struct rds_cap_record {
+	uint64_t ts_ns;			/* monotonic time of reception */
+	uint8_t lsb;
+	uint8_t msb;
+	uint8_t block;
+	uint8_t pad[5];
+};
+
+/* double-buffered capture writer: the read loop appends records to the
+ * active buffer and only ever takes the lock to hand a full buffer over
+ * to the writer thread, so block reception is never stalled by disk I/O */
+struct rds_capture {
+	int fd;
+	struct rds_cap_record buf[2][RDS_CAP_BUF_RECORDS];
+	unsigned count;			/* records in the active buffer */
+	int active;			/* buffer the read loop fills */
+	int full;			/* buffer owned by the writer, or -1 */
+	unsigned full_count;
+	bool stop;
+	uint64_t total;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;		/* wakes the writer thread */
+	pthread_cond_t drained;		/* full buffer was written out */
+	pthread_t writer;
+};
+
+static struct rds_capture capture;
+static bool capture_active;
+
+static void *capture_writer(void *arg)
+{
+	struct rds_capture *cap = static_cast<struct rds_capture *>(arg);
+
+	pthread_mutex_lock(&cap->lock);
+	while (true) {
+		while (cap->full < 0 && !cap->stop)
+			pthread_cond_wait(&cap->wake, &cap->lock);
+		if (cap->full < 0)
+			break;
+
+		int buf = cap->full;
+		unsigned count = cap->full_count;
+
+		pthread_mutex_unlock(&cap->lock);
+		if (write(cap->fd, cap->buf[buf],
+			  count * sizeof(struct rds_cap_record)) < 0)
+			fprintf(stderr, "Error writing capture file: %s\n",
+				strerror(errno));
+		pthread_mutex_lock(&cap->lock);
+
+		cap->full = -1;
+		pthread_cond_signal(&cap->drained);
+	}
+	pthread_mutex_unlock(&cap->lock);
+	return nullptr;
+}
+
+static bool capture_start(const char *fname)
+{
+	capture.fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (capture.fd < 0) {
+		fprintf(stderr, "Failed to open capture file %s: %s\n",
+			fname, strerror(errno));
+		return false;
+	}
+	if (write(capture.fd, RDS_CAP_MAGIC, RDS_CAP_MAGIC_LEN) !=
+	    RDS_CAP_MAGIC_LEN) {
+		fprintf(stderr, "Error writing capture file: %s\n",
+			strerror(errno));
+		close(capture.fd);
+		return false;
+	}
+	capture.full = -1;
+	pthread_mutex_init(&capture.lock, nullptr);
+	pthread_cond_init(&capture.wake, nullptr);
+	pthread_cond_init(&capture.drained, nullptr);
+	if (pthread_create(&capture.writer, nullptr, capture_writer, &capture)) {
+		fprintf(stderr, "Failed to start capture writer thread\n");
+		close(capture.fd);
+		return false;
+	}
+	capture_active = true;
+	return true;
+}
+
+static void capture_add(const struct v4l2_rds_data *rds_data)
+{
+	struct rds_cap_record *rec = &capture.buf[capture.active][capture.count];
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	rec->ts_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->lsb = rds_data->lsb;
+	rec->msb = rds_data->msb;
+	rec->block = rds_data->block;
+	memset(rec->pad, 0, sizeof(rec->pad));
+	capture.total++;
+	if (++capture.count < RDS_CAP_BUF_RECORDS)
+		return;
+
+	/* buffer full: hand it over to the writer and switch to the other
+	 * one. Only waits if the writer still owns the previous buffer */
+	pthread_mutex_lock(&capture.lock);
+	while (capture.full >= 0)
+		pthread_cond_wait(&capture.drained, &capture.lock);
+	capture.full = capture.active;
+	capture.full_count = capture.count;
+	capture.active = !capture.active;
+	capture.count = 0;
+	pthread_cond_signal(&capture.wake);
+	pthread_mutex_unlock(&capture.lock);
+}
+
+static void capture_stop()
+{
+	if (!capture_active)
+		return;
+
+	/* flush the partially filled active buffer, then stop the writer */
+	pthread_mutex_lock(&capture.lock);
+	while (capture.full >= 0)
+		pthread_cond_wait(&capture.drained, &capture.lock);
+	if (capture.count) {
+		capture.full = capture.active;
+		capture.full_count = capture.count;
+		capture.active = !capture.active;
+		capture.count = 0;
+	}
+	capture.stop = true;
+	pthread_cond_signal(&capture.wake);
+	pthread_mutex_unlock(&capture.lock);
+	pthread_join(capture.writer, nullptr);
+
+	close(capture.fd);
+	capture_active = false;
+	printf("\nCaptured %llu RDS blocks to %s\n",
+	       static_cast<unsigned long long>(capture.total),
+	       params.capture_name);
+}
+
+/* feeds a capture file back through the decoder. The blocks are paced by
+ * the recorded timestamps divided by the speed factor; a factor of 0
+ * replays as fast as possible */
+static void replay_rds(struct v4l2_rds *handle, const int fd, double speed)
+{
+	struct rds_cap_record rec;
+	struct v4l2_rds_data rds_data;
+	char magic[RDS_CAP_MAGIC_LEN];
+	uint64_t first_ts = 0, start_ns = 0;
+	uint32_t updated_fields;
+	struct timespec ts;
+
+	if (read(fd, magic, sizeof(magic)) != sizeof(magic) ||
+	    memcmp(magic, RDS_CAP_MAGIC, sizeof(magic))) {
+		fprintf(stderr, "Not an rds-ctl capture file\n");
+		return;
+	}
+
+	while (!params.terminate_decoding &&
+	       read(fd, &rec, sizeof(rec)) == sizeof(rec)) {
+		if (speed > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			uint64_t now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+
+			if (!start_ns) {
+				start_ns = now;
+				first_ts = rec.ts_ns;
+			}
+			uint64_t due = start_ns +
+				(rec.ts_ns - first_ts) / speed;
+			if (due > now)
+				usleep((due - now) / 1000);
+		}
+
+		memset(&rds_data, 0, sizeof(rds_data));
+		rds_data.lsb = rec.lsb;
+		rds_data.msb = rec.msb;
+		rds_data.block = rec.block;
+		if ((updated_fields = v4l2_rds_add(handle, &rds_data))) {
+			print_rds_data(handle, updated_fields);
+			if (params.options[OptVerbose])
+				print_rds_group(v4l2_rds_get_group(handle));
+		}
+	}
+	/* print a summary of all valid RDS-fields before exiting */
+	printf("\nSummary of valid RDS-fields:");
+	print_rds_data(handle, 0xFFFFFFFF);
+}
+
 static void read_rds(struct v4l2_rds *handle, const int fd, const int wait_limit)
 {
 	int byte_cnt = 0;
@@ -595,6 +811,8 @@ static void read_rds(struct v4l2_rds *handle, const int fd, const int wait_limit
 		}
 		else if (byte_cnt == 3) {
 			error_cnt = 0;
+			if (capture_active)
+				capture_add(&rds_data);
 			/* true if a new group was decoded */
 			if ((updated_fields = v4l2_rds_add(handle, &rds_data))) {
 				print_rds_data(handle, updated_fields);
@@ -618,8 +836,15 @@ static void read_rds_from_fd(const int fd)
 		std::exit(EXIT_FAILURE);
 	}
 
+	if (params.options[OptCapture] && !capture_start(params.capture_name))
+		std::exit(EXIT_FAILURE);
+
 	/* try to receive and decode RDS data */
-	read_rds(rds_handle, fd, params.wait_limit);
+	if (params.options[OptReplay])
+		replay_rds(rds_handle, fd, params.replay_speed);
+	else
+		read_rds(rds_handle, fd, params.wait_limit);
+	capture_stop();
 	if (rds_handle->valid_fields & V4L2_RDS_EON)
 		print_rds_eon(&rds_handle->rds_eon);
 	print_rds_statistics(&rds_handle->rds_statistics);
@@ -692,6 +917,29 @@ static int parse_cl(int argc, char **argv)
 			params.options[OptReadRds] = 1;
 			break;
 		}
+		case OptCapture:
+			strncpy(params.capture_name, optarg,
+				sizeof(params.capture_name) - 1);
+			params.capture_name[sizeof(params.capture_name) - 1] = '\0';
+			break;
+		case OptReplay:
+		{
+			if (access(optarg, F_OK) == -1) {
+				fprintf(stderr, "Unable to open file: %s\n", optarg);
+				return -1;
+			}
+			strncpy(params.replay_name, optarg,
+				sizeof(params.replay_name) - 1);
+			params.replay_name[sizeof(params.replay_name) - 1] = '\0';
+			break;
+		}
+		case OptReplaySpeed:
+			params.replay_speed = strtod(optarg, nullptr);
+			if (params.replay_speed < 0) {
+				fprintf(stderr, "Invalid replay speed: %s\n", optarg);
+				return -1;
+			}
+			break;
 		case OptWaitLimit:
 			params.wait_limit = strtoul(optarg, nullptr, 0);
 			break;
@@ -724,6 +972,9 @@ static int parse_cl(int argc, char **argv)
 	/* set default value for wait limit, if not specified by user */
 	if (!params.options[OptWaitLimit])
 		params.wait_limit = 5000;
+	/* replay at the recorded pace, if no speed factor was given */
+	if (!params.options[OptReplaySpeed])
+		params.replay_speed = 1.0;
 
 	return 0;
 }
@@ -851,6 +1102,17 @@ int main(int argc, char **argv)
 		std::exit(EXIT_SUCCESS);
 	}
 
+	/* Replay Mode: feed a recorded capture back through the decoder */
+	if (params.options[OptReplay]) {
+		if ((fd = open(params.replay_name, O_RDONLY)) < 0) {
+			perror("error opening capture file");
+			std::exit(EXIT_FAILURE);
+		}
+		read_rds_from_fd(fd);
+		close(fd);
+		std::exit(EXIT_SUCCESS);
+	}
+
 	/* File Mode: disables all other features, except for RDS decoding */
 	if (params.filemode_active) {
 		if ((fd = open(params.fd_name, O_RDONLY|O_NONBLOCK)) < 0){
@@ -1 +0,0 @@
-../common/media-info.cpp
\ No newline at end of file
@@ -18,16 +18,26 @@
     Foundation, Inc., 51 Franklin Street, Suite 500, Boston, MA  02110-1335  USA
  */
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <csignal>
+#include <cstdarg>
 #include <cstring>
+#include <ctime>
+#include <deque>
 #include <map>
 #include <set>
 #include <vector>
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "v4l2-compliance.h"
@@ -67,6 +77,15 @@ enum Option {
 	OptMediaBusInfo = 'z',
 	OptStreamFrom = 128,
 	OptStreamFromHdr,
+	OptParallel,
+	OptCache,
+	OptNoCache,
+	OptTimings,
+	OptTestTimeout,
+	OptStressRequests,
+	OptStressOpens,
+	OptLogFile,
+	OptLogSummary,
 	OptVersion,
 	OptLast = 256
 };
@@ -94,6 +113,9 @@ static unsigned color_component;
 static unsigned color_skip;
 static unsigned color_perc = 90;
 
+static unsigned stress_req_depth = 16;
+static unsigned stress_open_count = 8;
+
 struct dev_state {
 	struct node *node;
 	std::vector<v4l2_ext_control> control_vec;
@@ -144,6 +166,15 @@ static struct option long_options[] = {
 	{"stream-all-formats", optional_argument, nullptr, OptStreamAllFormats},
 	{"stream-all-io", no_argument, nullptr, OptStreamAllIO},
 	{"stream-all-color", required_argument, nullptr, OptStreamAllColorTest},
+	{"parallel", optional_argument, nullptr, OptParallel},
+	{"cache", no_argument, nullptr, OptCache},
+	{"no-cache", no_argument, nullptr, OptNoCache},
+	{"timings", no_argument, nullptr, OptTimings},
+	{"test-timeout", required_argument, nullptr, OptTestTimeout},
+	{"stress-requests", optional_argument, nullptr, OptStressRequests},
+	{"stress-opens", optional_argument, nullptr, OptStressOpens},
+	{"log-file", required_argument, nullptr, OptLogFile},
+	{"log-summary", required_argument, nullptr, OptLogSummary},
 	{"version", no_argument, nullptr, OptVersion},
 	{nullptr, 0, nullptr, 0}
 };
@@ -253,6 +284,48 @@ static void usage()
 	printf("                     signal is present on the input(s). If <skip> is not specified,\n");
 	printf("                     then just capture the first frame. If <perc> is not specified,\n");
 	printf("                     then this defaults to 90%%.\n");
+	printf("  --stress-requests [<depth>]\n");
+	printf("                     Stress the Request API by keeping <depth> requests in\n");
+	printf("                     flight, verifying that they complete in order, and\n");
+	printf("                     reporting the sustained request rate. <depth> defaults\n");
+	printf("                     to 16 and is capped by the number of buffers the driver\n");
+	printf("                     allocates.\n");
+	printf("  --stress-opens [<n>]\n");
+	printf("                     Open the device <n> times (default 8) and hammer\n");
+	printf("                     QUERYCAP/G_FMT from <n> threads at once, reporting the\n");
+	printf("                     per-thread throughput and the mean/p99/max latency.\n");
+	printf("                     Fails if the latency collapses superlinearly compared\n");
+	printf("                     to a single-fd baseline.\n");
+	printf("  --log-file <file>\n");
+	printf("                     Append one JSON record per test to <file>: timestamp,\n");
+	printf("                     device, test name, result, duration and failure reason.\n");
+	printf("                     Records are written incrementally, so the log survives\n");
+	printf("                     a crash and can be shared by many runs and processes.\n");
+	printf("  --log-summary <file>\n");
+	printf("                     Do not test anything, just aggregate a log written by\n");
+	printf("                     --log-file and print result totals and the failing\n");
+	printf("                     tests sorted by failure count.\n");
+	printf("  --cache            Cache the result per device, keyed on a fingerprint of the\n");
+	printf("                     driver info, the format list, the media topology and the\n");
+	printf("                     selected options. If a device fingerprint is unchanged since\n");
+	printf("                     the last fully passing run, its tests are skipped and the\n");
+	printf("                     cached totals are reported. Runs with failures are never\n");
+	printf("                     cached. The cache lives in $XDG_CACHE_HOME/v4l2-compliance.\n");
+	printf("  --no-cache         Ignore cached results, test everything. The last of\n");
+	printf("                     --cache/--no-cache on the command line wins.\n");
+	printf("  --timings          Report the wall and CPU time spent per test, sorted by\n");
+	printf("                     wall time, after the totals of each device.\n");
+	printf("  --test-timeout <secs>\n");
+	printf("                     Exit reporting the name of the running test if a single\n");
+	printf("                     test takes longer than <secs> seconds, so a driver-side\n");
+	printf("                     stall does not hang the whole suite.\n");
+	printf("  --parallel [<workers>]\n");
+	printf("                     When walking over all interfaces of a media device (-m),\n");
+	printf("                     test up to <workers> devices concurrently, each in its own\n");
+	printf("                     process. The output of each device is buffered and printed\n");
+	printf("                     in the usual order once its tests finish, so the report is\n");
+	printf("                     identical to a serial run. <workers> defaults to the number\n");
+	printf("                     of CPUs. The tests of a single device still run serially.\n");
 	printf("  -E, --exit-on-fail Exit on the first fail.\n");
 	printf("  -h, --help         Display this help message.\n");
 	printf("  -C, --color <when> Highlight OK/warn/fail/FAIL strings with colors\n");
@@ -268,7 +341,268 @@ static void usage()
 	printf("  -W, --exit-on-warn Exit on the first warning.\n");
 }
 
-const char *ok(int res)
+/*
+ * Structured result logging, fed by the ok() macro just like the
+ * timings above. Each test appends one JSON record on a single line to
+ * the --log-file, so the log can be processed line by line, shared by
+ * concurrent --parallel workers (single O_APPEND writes) and appended
+ * to across many runs. --log-summary aggregates such a log.
+ */
+static int log_fd = -1;
+static const char *log_device = "";
+static char log_fail_reason[256];
+
+void logFailure(const char *fmt, ...)
+{
+	va_list ap;
+	size_t len;
+
+	// Only the first failure of a test is recorded: that is the
+	// root cause, later failures are usually fallout.
+	if (log_fd < 0 || log_fail_reason[0])
+		return;
+	va_start(ap, fmt);
+	vsnprintf(log_fail_reason, sizeof(log_fail_reason), fmt, ap);
+	va_end(ap);
+	len = strlen(log_fail_reason);
+	if (len && log_fail_reason[len - 1] == '\n')
+		log_fail_reason[len - 1] = 0;
+}
+
+static std::string jsonEscape(const char *s)
+{
+	std::string out;
+
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\') {
+			out += '\\';
+			out += *s;
+		} else if ((unsigned char)*s < 0x20) {
+			char esc[8];
+
+			sprintf(esc, "\\u%04x", *s);
+			out += esc;
+		} else {
+			out += *s;
+		}
+	}
+	return out;
+}
+
+static void logRecord(const char *name, int res, double wall)
+{
+	const char *result = res == 0 ? "ok" :
+		res == ENOTTY ? "notsup" : "fail";
+	char rec[640];
+	int len;
+
+	len = snprintf(rec, sizeof(rec),
+		       "{\"ts\":%llu,\"device\":\"%s\",\"test\":\"%s\","
+		       "\"result\":\"%s\",\"duration_ms\":%.3f,\"reason\":\"%s\"}\n",
+		       (unsigned long long)time(nullptr),
+		       jsonEscape(log_device).c_str(), name, result, wall * 1e3,
+		       res && res != ENOTTY ?
+		       jsonEscape(log_fail_reason).c_str() : "");
+	if (len >= (int)sizeof(rec))
+		len = sizeof(rec) - 1;
+	if (len > 0 && write(log_fd, rec, len) < 0)
+		/* a failing log write must not fail the tests */;
+}
+
+// Crude field extraction, but all we ever parse are our own records
+static std::string logField(const char *line, const char *key)
+{
+	std::string k = std::string("\"") + key + "\":\"";
+	const char *p = strstr(line, k.c_str());
+	std::string out;
+
+	if (!p)
+		return out;
+	for (p += k.size(); *p && *p != '"'; p++) {
+		if (*p == '\\' && p[1])
+			p++;
+		out += *p;
+	}
+	return out;
+}
+
+static int logSummary(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char *line = nullptr;
+	size_t line_size = 0;
+	unsigned records = 0, passed = 0, notsup = 0, failed = 0;
+	double total_ms = 0;
+	std::set<std::string> devices;
+	std::map<std::string, unsigned> fail_counts;
+	std::map<std::string, std::string> fail_reasons;
+
+	if (f == nullptr) {
+		fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+	while (getline(&line, &line_size, f) > 0) {
+		std::string result = logField(line, "result");
+
+		if (result.empty())
+			continue;
+		records++;
+		devices.insert(logField(line, "device"));
+		const char *dur = strstr(line, "\"duration_ms\":");
+		if (dur)
+			total_ms += atof(dur + strlen("\"duration_ms\":"));
+		if (result == "ok") {
+			passed++;
+		} else if (result == "notsup") {
+			notsup++;
+		} else {
+			std::string test = logField(line, "test");
+
+			failed++;
+			fail_counts[test]++;
+			fail_reasons[test] = logField(line, "reason");
+		}
+	}
+	free(line);
+	fclose(f);
+
+	printf("%s: %u records from %zu device(s), %.1fs of test time\n",
+	       path, records, devices.size(), total_ms / 1e3);
+	printf("\tSucceeded: %u, Not Supported: %u, Failed: %u\n",
+	       passed, notsup, failed);
+	if (failed) {
+		std::vector<std::pair<unsigned, std::string>> v;
+
+		for (const auto &e : fail_counts)
+			v.emplace_back(e.second, e.first);
+		std::sort(v.begin(), v.end(),
+			  std::greater<std::pair<unsigned, std::string>>());
+		printf("Failing tests:\n");
+		for (const auto &e : v)
+			printf("\t%5ux %s (last: %s)\n", e.first,
+			       e.second.c_str(),
+			       fail_reasons[e.second].c_str());
+	}
+	return failed ? 1 : 0;
+}
+
+/*
+ * Per-test timing and stall watchdog, fed by the ok() macro in
+ * v4l2-compliance.h. Nested tests (a test that runs subtests through
+ * ok()) are timed individually, so with --timings an outer entry
+ * includes the time of its inner entries.
+ */
+bool show_timings;
+unsigned test_timeout;
+
+struct test_timing {
+	double wall;
+	double cpu;
+	unsigned count;
+};
+
+static std::map<std::string, test_timing> test_timings;
+
+#define TEST_DEPTH_MAX 8
+static struct {
+	char name[64];
+	timespec wall;
+	timespec cpu;
+} test_stack[TEST_DEPTH_MAX];
+static unsigned test_depth;
+
+static void signal_handler_test_timeout(int signum)
+{
+	static const char msg[] = "\ntest timed out, exiting: ";
+	const char *name = test_depth && test_depth <= TEST_DEPTH_MAX ?
+		test_stack[test_depth - 1].name : "?";
+
+	if (write(STDERR_FILENO, msg, sizeof(msg) - 1) < 0 ||
+	    write(STDERR_FILENO, name, strlen(name)) < 0 ||
+	    write(STDERR_FILENO, "\n", 1) < 0)
+		/* there is nothing left to report to */;
+	_exit(ETIMEDOUT);
+}
+
+void testStart(const char *name)
+{
+	if (test_depth < TEST_DEPTH_MAX) {
+		auto &t = test_stack[test_depth];
+		/* strip the argument list from the stringified call */
+		size_t len = strcspn(name, "(");
+
+		if (len >= sizeof(t.name))
+			len = sizeof(t.name) - 1;
+		memcpy(t.name, name, len);
+		t.name[len] = 0;
+		clock_gettime(CLOCK_MONOTONIC, &t.wall);
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t.cpu);
+	}
+	log_fail_reason[0] = 0;
+	test_depth++;
+	if (test_timeout) {
+		signal(SIGALRM, signal_handler_test_timeout);
+		alarm(test_timeout);
+	}
+}
+
+static double time_since(const timespec &then, clockid_t clk)
+{
+	timespec now;
+
+	clock_gettime(clk, &now);
+	return now.tv_sec - then.tv_sec + (now.tv_nsec - then.tv_nsec) / 1e9;
+}
+
+void testEnd(int res)
+{
+	if (test_timeout)
+		alarm(test_depth > 1 ? test_timeout : 0);
+	if (!test_depth)
+		return;
+	test_depth--;
+	if (test_depth >= TEST_DEPTH_MAX)
+		return;
+
+	auto &t = test_stack[test_depth];
+
+	if (log_fd >= 0)
+		logRecord(t.name, res, time_since(t.wall, CLOCK_MONOTONIC));
+	if (!show_timings)
+		return;
+
+	auto &agg = test_timings[t.name];
+
+	agg.wall += time_since(t.wall, CLOCK_MONOTONIC);
+	agg.cpu += time_since(t.cpu, CLOCK_PROCESS_CPUTIME_ID);
+	agg.count++;
+}
+
+static void printTimings()
+{
+	std::vector<std::pair<std::string, test_timing>> v(test_timings.begin(),
+							   test_timings.end());
+
+	test_timings.clear();
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end(),
+		  [](const std::pair<std::string, test_timing> &a,
+		     const std::pair<std::string, test_timing> &b) {
+			return a.second.wall > b.second.wall;
+		  });
+	printf("Test durations (>= 1 ms):\n");
+	for (const auto &e : v) {
+		if (e.second.wall < 0.001)
+			break;
+		printf("\t%10.3f ms wall %10.3f ms cpu %4ux %s\n",
+		       e.second.wall * 1e3, e.second.cpu * 1e3,
+		       e.second.count, e.first.c_str());
+	}
+	printf("\n");
+}
+
+const char *ok_result(int res)
 {
 	static char buf[100];
 
@@ -316,6 +650,277 @@ int check_0(const void *p, int len)
 	return 0;
 }
 
+/*
+ * Parallel test scheduler, used by walkTopology() to test the interfaces
+ * of a media device concurrently.
+ *
+ * Almost all test state (the test counters, the dev_state backup, the
+ * node globals) lives in globals, so the unit of parallelism is a
+ * process, not a thread: each device is tested in a forked child with
+ * stdout and stderr redirected to a temporary file. The parent reaps the
+ * children in submission order and replays their buffered output, so the
+ * report is byte-for-byte what a serial run would print. Each child
+ * reports its test counters over a pipe; within a child all tests,
+ * including the stateful streaming tests, run serially as before.
+ */
+unsigned parallel_workers;
+
+struct parallel_job {
+	pid_t pid;
+	FILE *out;
+	int res_fd;
+};
+
+struct parallel_result {
+	int total;
+	int ok;
+	int warnings;
+	int result;
+};
+
+static std::deque<parallel_job> parallel_jobs;
+static int parallel_res_fd = -1;
+
+/*
+ * Start a worker for the next device. Returns 0 in the new child, 1 in
+ * the parent once the child is queued, or -1 if workers are disabled or
+ * cannot be created, in which case the caller tests the device itself.
+ */
+int parallelFork()
+{
+	parallel_job job;
+	int pfd[2];
+
+	if (!parallel_workers)
+		return -1;
+	while (parallel_jobs.size() >= parallel_workers)
+		parallelCollect(false);
+
+	job.out = tmpfile();
+	if (!job.out)
+		return -1;
+	if (pipe(pfd)) {
+		fclose(job.out);
+		return -1;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	job.pid = fork();
+	if (job.pid < 0) {
+		fclose(job.out);
+		close(pfd[0]);
+		close(pfd[1]);
+		return -1;
+	}
+	if (job.pid == 0) {
+		close(pfd[0]);
+		parallel_res_fd = pfd[1];
+		dup2(fileno(job.out), STDOUT_FILENO);
+		dup2(fileno(job.out), STDERR_FILENO);
+		fclose(job.out);
+		/* report only what this child tests */
+		grand_total = grand_ok = grand_warnings = 0;
+		app_result = 0;
+		return 0;
+	}
+	close(pfd[1]);
+	job.res_fd = pfd[0];
+	parallel_jobs.push_back(job);
+	return 1;
+}
+
+void parallelChildExit()
+{
+	struct parallel_result res = {
+		grand_total, grand_ok, grand_warnings, app_result
+	};
+
+	fflush(stdout);
+	fflush(stderr);
+	if (write(parallel_res_fd, &res, sizeof(res)) < (int)sizeof(res))
+		app_result = errno;
+	std::exit(app_result);
+}
+
+/*
+ * Reap the oldest worker (or, if all is set, every worker), merge its
+ * counters into the grand totals and replay its output.
+ */
+void parallelCollect(bool all)
+{
+	while (!parallel_jobs.empty()) {
+		parallel_job job = parallel_jobs.front();
+		struct parallel_result res;
+		char buf[65536];
+		size_t n;
+		int status;
+
+		parallel_jobs.pop_front();
+		while (waitpid(job.pid, &status, 0) < 0 && errno == EINTR)
+			;
+		if (read(job.res_fd, &res, sizeof(res)) == sizeof(res)) {
+			grand_total += res.total;
+			grand_ok += res.ok;
+			grand_warnings += res.warnings;
+			if (res.result && !app_result)
+				app_result = res.result;
+		} else if (!app_result) {
+			/* the child died before it could report */
+			app_result = WIFEXITED(status) ? WEXITSTATUS(status) : EINTR;
+		}
+		close(job.res_fd);
+		rewind(job.out);
+		while ((n = fread(buf, 1, sizeof(buf), job.out)) > 0)
+			fwrite(buf, 1, n, stdout);
+		fclose(job.out);
+		if (!all)
+			break;
+	}
+}
+
+/*
+ * Result cache (see --cache): skip the tests of a device whose inputs
+ * are unchanged since the last fully passing run.
+ *
+ * The cache key is a fingerprint of everything that determines the test
+ * outcome: the driver info (QUERYCAP includes the driver version), the
+ * enumerated formats, the media topology, the device name, the selected
+ * options and the version of v4l2-compliance itself. Any change - a new
+ * kernel, a different driver, other options - changes the fingerprint
+ * and the device is retested. Only the totals of a run without failures
+ * are ever stored: failing devices are always retested. The granularity
+ * is a device node, not an individual test, since the tests build on
+ * each other's state and must run in order.
+ */
+static bool use_cache;
+
+static __u64 cacheHash(__u64 h, const void *p, size_t len)
+{
+	const __u8 *q = static_cast<const __u8 *>(p);
+
+	while (len--) {
+		h ^= *q++;
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static __u64 cacheFingerprint(struct node &node,
+			      const v4l2_capability &vcap,
+			      const v4l2_subdev_capability &subdevcap,
+			      unsigned frame_count, unsigned all_fmt_frame_count)
+{
+	static const __u32 buf_types[] = {
+		V4L2_BUF_TYPE_VIDEO_CAPTURE,
+		V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE,
+		V4L2_BUF_TYPE_VIDEO_OUTPUT,
+		V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE,
+		V4L2_BUF_TYPE_VIDEO_OVERLAY,
+		V4L2_BUF_TYPE_SDR_CAPTURE,
+		V4L2_BUF_TYPE_SDR_OUTPUT,
+		V4L2_BUF_TYPE_META_CAPTURE,
+		V4L2_BUF_TYPE_META_OUTPUT,
+	};
+	__u64 h = 0xcbf29ce484222325ULL;
+	bool direct = node.g_direct();
+
+	h = cacheHash(h, PACKAGE_VERSION, strlen(PACKAGE_VERSION));
+	h = cacheHash(h, STRING(GIT_SHA), strlen(STRING(GIT_SHA)));
+	h = cacheHash(h, node.device, strlen(node.device));
+	h = cacheHash(h, &vcap, sizeof(vcap));
+	h = cacheHash(h, &subdevcap, sizeof(subdevcap));
+	h = cacheHash(h, &frame_count, sizeof(frame_count));
+	h = cacheHash(h, &all_fmt_frame_count, sizeof(all_fmt_frame_count));
+	h = cacheHash(h, options, sizeof(options));
+	h = cacheHash(h, &direct, sizeof(direct));
+
+	for (__u32 type : buf_types) {
+		struct v4l2_fmtdesc fmt;
+
+		for (unsigned i = 0; ; i++) {
+			memset(&fmt, 0, sizeof(fmt));
+			fmt.index = i;
+			fmt.type = type;
+			if (ioctl(node.g_fd(), VIDIOC_ENUM_FMT, &fmt))
+				break;
+			h = cacheHash(h, &fmt, sizeof(fmt));
+		}
+	}
+
+	int fd = node.is_media() ? node.g_fd() : media_fd;
+
+	if (fd >= 0) {
+		media_v2_topology topology;
+
+		memset(&topology, 0, sizeof(topology));
+		if (!ioctl(fd, MEDIA_IOC_G_TOPOLOGY, &topology)) {
+			std::vector<media_v2_entity> ents(topology.num_entities);
+			std::vector<media_v2_interface> ifaces(topology.num_interfaces);
+			std::vector<media_v2_pad> pads(topology.num_pads);
+			std::vector<media_v2_link> links(topology.num_links);
+
+			topology.ptr_entities = (uintptr_t)ents.data();
+			topology.ptr_interfaces = (uintptr_t)ifaces.data();
+			topology.ptr_pads = (uintptr_t)pads.data();
+			topology.ptr_links = (uintptr_t)links.data();
+			if (!ioctl(fd, MEDIA_IOC_G_TOPOLOGY, &topology)) {
+				h = cacheHash(h, ents.data(),
+					      ents.size() * sizeof(ents[0]));
+				h = cacheHash(h, ifaces.data(),
+					      ifaces.size() * sizeof(ifaces[0]));
+				h = cacheHash(h, pads.data(),
+					      pads.size() * sizeof(pads[0]));
+				h = cacheHash(h, links.data(),
+					      links.size() * sizeof(links[0]));
+			}
+		}
+	}
+	return h;
+}
+
+static std::string cachePath(__u64 h)
+{
+	const char *xdg = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	std::string dir;
+	char name[32];
+
+	if (xdg && xdg[0])
+		dir = xdg;
+	else if (home && home[0])
+		dir = std::string(home) + "/.cache";
+	else
+		dir = "/tmp";
+	mkdir(dir.c_str(), 0777);
+	dir += "/v4l2-compliance";
+	mkdir(dir.c_str(), 0777);
+	sprintf(name, "/%016llx", static_cast<unsigned long long>(h));
+	return dir + name;
+}
+
+static bool cacheLookup(__u64 h, int &total, int &ok, int &warn)
+{
+	FILE *f = fopen(cachePath(h).c_str(), "r");
+	bool valid;
+
+	if (!f)
+		return false;
+	valid = fscanf(f, "v4l2-compliance-cache v1 %d %d %d",
+		       &total, &ok, &warn) == 3 && total == ok && total > 0;
+	fclose(f);
+	return valid;
+}
+
+static void cacheStore(__u64 h, int total, int ok, int warn)
+{
+	FILE *f = fopen(cachePath(h).c_str(), "w");
+
+	if (!f)
+		return;
+	fprintf(f, "v4l2-compliance-cache v1 %d %d %d\n", total, ok, warn);
+	fclose(f);
+}
+
 static std::map<std::string, std::string> stream_from_map;
 static std::map<std::string, bool> stream_hdr_map;
 
@@ -754,6 +1359,170 @@ static int testUnlimitedOpens(struct node *node)
 	return 0;
 }
 
+/*
+ * Multi-open ioctl scalability stress (--stress-opens): open N fds and
+ * hammer QUERYCAP/G_FMT from N threads at once. Per-fd ioctl latency
+ * should degrade at most about linearly with the number of concurrent
+ * openers, since the ioctls serialize on the driver locks; a driver
+ * where latency collapses superlinearly under concurrent opens fails
+ * the test. qbuf/dqbuf cannot be part of the loop: only one fd can own
+ * the buffer queue, so those paths cannot be exercised concurrently.
+ */
+struct stress_open_ctx {
+	int fd;
+	unsigned type;
+	bool do_fmt;
+	const std::atomic<bool> *stop;
+	unsigned long ops;
+	double sum;
+	double max;
+	unsigned hist[64];
+};
+
+static void *stressOpenWorker(void *arg)
+{
+	auto ctx = static_cast<stress_open_ctx *>(arg);
+	struct v4l2_capability vcap;
+	struct v4l2_format fmt;
+	struct timespec t0, t1;
+
+	while (!ctx->stop->load()) {
+		for (unsigned i = 0; i < 1U + ctx->do_fmt; i++) {
+			int ret;
+
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			if (i == 0) {
+				ret = ioctl(ctx->fd, VIDIOC_QUERYCAP, &vcap);
+			} else {
+				memset(&fmt, 0, sizeof(fmt));
+				fmt.type = ctx->type;
+				ret = ioctl(ctx->fd, VIDIOC_G_FMT, &fmt);
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if (ret)
+				return reinterpret_cast<void *>(1);
+
+			double lat = t1.tv_sec - t0.tv_sec +
+				(t1.tv_nsec - t0.tv_nsec) / 1e9;
+			unsigned long ns = lat * 1e9;
+
+			ctx->ops++;
+			ctx->sum += lat;
+			if (lat > ctx->max)
+				ctx->max = lat;
+			ctx->hist[ns ? 64 - __builtin_clzl(ns) : 0]++;
+		}
+	}
+	return nullptr;
+}
+
+static int stressOpenRun(struct node *node, stress_open_ctx *ctxs,
+			 unsigned nthreads, double duration,
+			 double &mean, double &p99, double &max,
+			 double &ops_per_sec)
+{
+	pthread_t threads[VIDEO_MAX_FRAME];
+	std::atomic<bool> stop{};
+	unsigned hist[64] = {};
+	unsigned long total_ops = 0;
+	double sum = 0;
+
+	max = 0;
+	for (unsigned i = 0; i < nthreads; i++) {
+		ctxs[i].stop = &stop;
+		ctxs[i].ops = 0;
+		ctxs[i].sum = ctxs[i].max = 0;
+		memset(ctxs[i].hist, 0, sizeof(ctxs[i].hist));
+		fail_on_test(pthread_create(&threads[i], nullptr,
+					    stressOpenWorker, &ctxs[i]));
+	}
+	usleep(duration * 1e6);
+	stop = true;
+
+	bool ioctl_failed = false;
+
+	for (unsigned i = 0; i < nthreads; i++) {
+		void *res = nullptr;
+
+		pthread_join(threads[i], &res);
+		ioctl_failed |= res != nullptr;
+		total_ops += ctxs[i].ops;
+		sum += ctxs[i].sum;
+		if (ctxs[i].max > max)
+			max = ctxs[i].max;
+		for (unsigned b = 0; b < 64; b++)
+			hist[b] += ctxs[i].hist[b];
+	}
+	fail_on_test(ioctl_failed);
+	fail_on_test(total_ops == 0);
+	mean = sum / total_ops;
+	ops_per_sec = total_ops / duration;
+
+	unsigned long seen = 0;
+
+	p99 = max;
+	for (unsigned b = 0; b < 64; b++) {
+		seen += hist[b];
+		if (seen >= total_ops - total_ops / 100) {
+			p99 = (1ULL << b) / 1e9;
+			break;
+		}
+	}
+	return 0;
+}
+
+static int testMultiOpenStress(struct node *node, unsigned nthreads)
+{
+	stress_open_ctx ctxs[VIDEO_MAX_FRAME];
+	double mean1, mean, p99, max, ops;
+	unsigned i;
+	int ret = 0;
+
+	if (!node->is_v4l2())
+		return ENOTTY;
+	if (nthreads > VIDEO_MAX_FRAME)
+		nthreads = VIDEO_MAX_FRAME;
+
+	for (i = 0; i < nthreads; i++) {
+		ctxs[i].fd = open(node->device, O_RDWR);
+		if (ctxs[i].fd < 0)
+			break;
+		ctxs[i].type = node->g_type();
+		ctxs[i].do_fmt = node->valid_buftypes & (1 << node->g_type());
+	}
+	if (i < nthreads) {
+		while (i--)
+			close(ctxs[i].fd);
+		return fail("could not open %s %u times\n", node->device, nthreads);
+	}
+
+	// Single-thread baseline first, then all threads at once
+	ret = stressOpenRun(node, ctxs, 1, 0.25, mean1, p99, max, ops);
+	if (!ret) {
+		info("baseline: %.0f ioctls/s, mean %.2f us\n", ops, mean1 * 1e6);
+		ret = stressOpenRun(node, ctxs, nthreads, 1.0,
+				    mean, p99, max, ops);
+	}
+	for (i = 0; i < nthreads; i++)
+		close(ctxs[i].fd);
+	if (ret)
+		return ret;
+
+	printf("\t\t%u fds: %.0f ioctls/s/thread, mean %.2f us, p99 %.2f us, max %.2f us\n",
+	       nthreads, ops / nthreads, mean * 1e6, p99 * 1e6, max * 1e6);
+
+	/*
+	 * Serialized ioctls make the mean scale linearly with the thread
+	 * count; allow a generous factor on top of that before declaring
+	 * the scalability broken, so a loaded test machine does not make
+	 * this flaky. Sub-10us means are always fine.
+	 */
+	if (mean > 1e-5 && mean > 8 * nthreads * mean1)
+		return fail("ioctl latency collapsed: mean %.2f us vs %.2f us for one fd\n",
+			    mean * 1e6, mean1 * 1e6);
+	return 0;
+}
+
 static int check_prio(struct node *node, struct node *node2, enum v4l2_priority match)
 {
 	enum v4l2_priority prio;
@@ -851,32 +1620,21 @@ static int parse_subopt(char **subs, const char * const *subopts, char **value)
 
 static int open_media_bus_info(const std::string &bus_info, std::string &media_devname)
 {
-	DIR *dp;
-	struct dirent *ep;
-
-	dp = opendir("/dev");
-	if (dp == nullptr)
-		return -1;
-
-	while ((ep = readdir(dp))) {
-		const char *name = ep->d_name;
+	for (const auto &node : mi_media_scan_devices()) {
+		if (node.second.type != MEDIA_TYPE_MEDIA)
+			continue;
 
-		if (!memcmp(name, "media", 5) && isdigit(name[5])) {
-			struct media_device_info mdi;
-			media_devname = std::string("/dev/") + name;
+		struct media_device_info mdi;
+		media_devname = node.second.devpath;
 
-			int fd = open(media_devname.c_str(), O_RDWR);
-			if (fd < 0)
-				continue;
-			if (!ioctl(fd, MEDIA_IOC_DEVICE_INFO, &mdi) &&
-			    bus_info == mdi.bus_info) {
-				closedir(dp);
-				return fd;
-			}
-			close(fd);
-		}
+		int fd = open(media_devname.c_str(), O_RDWR);
+		if (fd < 0)
+			continue;
+		if (!ioctl(fd, MEDIA_IOC_DEVICE_INFO, &mdi) &&
+		    bus_info == mdi.bus_info)
+			return fd;
+		close(fd);
 	}
-	closedir(dp);
 	return -1;
 }
 
@@ -966,6 +1724,7 @@ void testNode(struct node &node, struct node &node_m2m_cap, struct node &expbuf_
 	std::string driver;
 
 	tests_total = tests_ok = warnings = 0;
+	log_device = node.device;
 
 	node.is_video = type == MEDIA_TYPE_VIDEO;
 	node.is_vbi = type == MEDIA_TYPE_VBI;
@@ -1150,6 +1909,10 @@ void testNode(struct node &node, struct node &node_m2m_cap, struct node &expbuf_
 	printf("\ttest for unlimited opens: %s\n",
 		ok(testUnlimitedOpens(&node)));
 
+	if (options[OptStressOpens])
+		printf("\ttest multi-open ioctl stress: %s\n",
+		       ok(testMultiOpenStress(&node, stress_open_count)));
+
 	printf("\n");
 	storeState(&node);
 
@@ -1159,6 +1922,24 @@ void testNode(struct node &node, struct node &node_m2m_cap, struct node &expbuf_
 	unsigned cur_io = 0;
 	unsigned min_io = 0;
 	unsigned max_io = 0;
+	__u64 cache_hash = 0;
+	bool cache_hit = false;
+
+	if (use_cache) {
+		int ctotal, cok, cwarn;
+
+		cache_hash = cacheFingerprint(node, vcap, subdevcap,
+					      frame_count, all_fmt_frame_count);
+		if (cacheLookup(cache_hash, ctotal, cok, cwarn)) {
+			printf("Skipping tests: device unchanged since the last fully passing run\n");
+			printf("(use --no-cache to retest)\n\n");
+			tests_total = ctotal;
+			tests_ok = cok;
+			warnings = cwarn;
+			cache_hit = true;
+			goto show_total;
+		}
+	}
 
 	/* Media ioctls */
 
@@ -1364,6 +2145,9 @@ void testNode(struct node &node, struct node &node_m2m_cap, struct node &expbuf_
 		if (node.can_capture)
 			node.set_interval(min_period);
 		printf("\ttest Requests: %s\n", ok(testRequests(&node, options[OptStreaming])));
+		if (options[OptStressRequests])
+			printf("\ttest Requests stress: %s\n",
+			       ok(testRequestsDeep(&node, stress_req_depth)));
 		if (sizeof(void *) == 4)
 			printf("\ttest TIME32/64: %s\n", ok(testTime32_64(&node)));
 		// Reopen after each streaming test to reset the streaming state
@@ -1488,6 +2272,9 @@ void testNode(struct node &node, struct node &node_m2m_cap, struct node &expbuf_
 	restoreState();
 
 show_total:
+	if (show_timings)
+		printTimings();
+
 	/* Final test report */
 	if (driver.empty())
 		printf("Total for device %s%s: %d, Succeeded: %d, Failed: %d, Warnings: %d\n",
@@ -1501,6 +2288,9 @@ show_total:
 	grand_ok += tests_ok;
 	grand_warnings += warnings;
 
+	if (use_cache && !cache_hit && tests_total && tests_ok == tests_total)
+		cacheStore(cache_hash, tests_total, tests_ok, warnings);
+
 	if (node.is_media() && options[OptSetMediaDevice]) {
 		walkTopology(node, expbuf_node,
 			     frame_count, all_fmt_frame_count);
@@ -1530,6 +2320,8 @@ int main(int argc, char **argv)
 	std::string expbuf_device;	/* --expbuf-device device */
 	unsigned frame_count = 60;
 	unsigned all_fmt_frame_count = 0;
+	std::string log_file;		/* --log-file file */
+	std::string log_summary_file;	/* --log-summary file */
 	char short_options[26 * 2 * 3 + 1];
 	char *value, *subs;
 	int idx = 0;
@@ -1687,6 +2479,40 @@ int main(int argc, char **argv)
 				std::exit(EXIT_FAILURE);
 			}
 			break;
+		case OptParallel:
+			parallel_workers = optarg ? strtoul(optarg, nullptr, 0) :
+				sysconf(_SC_NPROCESSORS_ONLN);
+			break;
+		case OptCache:
+			use_cache = true;
+			break;
+		case OptNoCache:
+			use_cache = false;
+			break;
+		case OptTimings:
+			show_timings = true;
+			break;
+		case OptStressRequests:
+			if (optarg)
+				stress_req_depth = strtoul(optarg, nullptr, 0);
+			if (stress_req_depth == 0)
+				stress_req_depth = 16;
+			break;
+		case OptTestTimeout:
+			test_timeout = strtoul(optarg, nullptr, 0);
+			break;
+		case OptStressOpens:
+			if (optarg)
+				stress_open_count = strtoul(optarg, nullptr, 0);
+			if (stress_open_count == 0)
+				stress_open_count = 8;
+			break;
+		case OptLogFile:
+			log_file = optarg;
+			break;
+		case OptLogSummary:
+			log_summary_file = optarg;
+			break;
 		case OptNoWarnings:
 			show_warnings = false;
 			break;
@@ -1727,6 +2553,19 @@ int main(int argc, char **argv)
 		std::exit(EXIT_FAILURE);
 	}
 
+	if (!log_summary_file.empty())
+		std::exit(logSummary(log_summary_file.c_str()));
+
+	if (!log_file.empty()) {
+		log_fd = open(log_file.c_str(),
+			      O_WRONLY | O_CREAT | O_APPEND, 0644);
+		if (log_fd < 0) {
+			fprintf(stderr, "Failed to open %s: %s\n",
+				log_file.c_str(), strerror(errno));
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
 	print_sha();
 	printf("\n");
 
@@ -22,6 +22,7 @@
 #define _V4L2_COMPLIANCE_H_
 
 #include <map>
+#include <vector>
 #include <set>
 #include <string>
 
@@ -175,6 +176,50 @@ struct node : public base_node, public cv4l_fd {
 	qctrl_map controls;
 	pixfmt_map buftype_pixfmts[V4L2_BUF_TYPE_LAST + 1];
 
+	/*
+	 * The VIDIOC_ENUM_FMT/ENUM_FRAMESIZES results cached by
+	 * testEnumFormats(), refreshed whenever that test runs (i.e. per
+	 * input/output). Later test phases iterate these tables through
+	 * cached_enum_fmt()/cached_enum_framesizes() instead of
+	 * re-enumerating, which is slow on USB devices; only tests that
+	 * validate the enumeration behavior itself keep issuing the
+	 * ioctls. If the cache is empty the call falls through to the
+	 * device.
+	 */
+	std::vector<v4l2_fmtdesc> fmtdesc_cache[V4L2_BUF_TYPE_LAST + 1];
+	std::map<__u32, std::vector<v4l2_frmsizeenum>> frmsize_cache;
+
+	int cached_enum_fmt(v4l2_fmtdesc &fmt, bool init = false, int index = 0, unsigned type = 0)
+	{
+		unsigned t = init ? (type ? type : g_type()) : fmt.type;
+
+		if (t > V4L2_BUF_TYPE_LAST || fmtdesc_cache[t].empty())
+			return enum_fmt(fmt, init, index, type);
+
+		unsigned idx = init ? index : fmt.index + 1;
+
+		if (idx >= fmtdesc_cache[t].size())
+			return EINVAL;
+		fmt = fmtdesc_cache[t][idx];
+		return 0;
+	}
+
+	int cached_enum_framesizes(v4l2_frmsizeenum &frm, __u32 init_pixfmt = 0, int index = 0)
+	{
+		__u32 pixfmt = init_pixfmt ? init_pixfmt : frm.pixel_format;
+		const auto it = frmsize_cache.find(pixfmt);
+
+		if (it == frmsize_cache.end() || it->second.empty())
+			return enum_framesizes(frm, init_pixfmt, index);
+
+		unsigned idx = init_pixfmt ? index : frm.index + 1;
+
+		if (idx >= it->second.size())
+			return EINVAL;
+		frm = it->second[idx];
+		return 0;
+	}
+
 	bool inject_error(__u32 id)
 	{
 		v4l2_control ctrl = {
@@ -265,10 +310,15 @@ private:
 			warn(fmt, ##args);		\
 	} while (0)
 
+// Record the reason of the first failure of the current test for the
+// structured log (--log-file). A no-op if logging is disabled.
+void logFailure(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 #define fail(fmt, args...) 						\
 ({ 									\
 	printf("\t\t%s: %s(%d): " fmt, show_colors ?			\
 	       COLOR_RED("fail") : "fail", __FILE__, __LINE__, ##args);	\
+	logFailure("%s(%d): " fmt, __FILE__, __LINE__, ##args);		\
 	if (exit_on_fail)						\
 		std::exit(EXIT_FAILURE);				\
 	1;								\
@@ -300,8 +350,37 @@ static inline double fract2f(const struct v4l2_fract *f)
 
 #define doioctl(n, r, p) v4l_named_ioctl((n)->g_v4l_fd(), #r, r, p)
 
-const char *ok(int res);
+const char *ok_result(int res);
+void testStart(const char *name);
+void testEnd(int res);
+
+/*
+ * Every test runs through ok(): the macro stringifies the test
+ * expression so testStart()/testEnd() can record wall and CPU time per
+ * test (reported with --timings), arm the per-test watchdog
+ * (--test-timeout) that exits with the name of a stalled test instead
+ * of hanging the whole suite, and append the per-test result record
+ * to the structured log (--log-file).
+ */
+template <typename F>
+inline const char *ok_timed(const char *name, F &&f)
+{
+	testStart(name);
+	int res = f();
+	testEnd(res);
+	return ok_result(res);
+}
+#define ok(...) ok_timed(#__VA_ARGS__, [&] { return (__VA_ARGS__); })
+
 int check_string(const char *s, size_t len);
+
+// Parallel test scheduler (see --parallel): forks one worker process per
+// device node and replays the buffered output in submission order.
+extern unsigned parallel_workers;
+int parallelFork();
+void parallelChildExit() __attribute__((noreturn));
+void parallelCollect(bool all);
+
 int check_ustring(const __u8 *s, int len);
 int check_0(const void *p, int len);
 int restoreFormat(struct node *node);
@@ -403,6 +482,7 @@ int testDmaBuf(struct node *expbuf_node, struct node *node,
 	       struct node *node_m2m_cap, unsigned frame_count,
 	       enum poll_mode pollmode);
 int testRequests(struct node *node, bool test_streaming);
+int testRequestsDeep(struct node *node, unsigned depth);
 void streamAllFormats(struct node *node, unsigned frame_count);
 void streamM2MAllFormats(struct node *node, unsigned frame_count);
 
@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <atomic>
 #include <csignal>
+#include <ctime>
 #include <map>
 #include <set>
 #include <vector>
@@ -30,6 +31,7 @@
 #include <pthread.h>
 #include <sys/epoll.h>
 
+#include "crc32c.h"
 #include "v4l2-compliance.h"
 
 static cv4l_fmt cur_fmt;
@@ -86,6 +88,55 @@ enum QueryBufMode {
 using buf_info_map = std::map<struct timeval, struct v4l2_buffer>;
 static buf_info_map buffer_info;
 
+/*
+ * Detect drivers that hand back the same frame content twice in a row,
+ * e.g. a stalled DMA engine returning stale buffers. Each dequeued
+ * capture buffer is digested plane by plane in a single CRC32C pass
+ * (hardware-accelerated where available, see crc32c.h) and compared
+ * against the digests of the previous frame; the frames themselves are
+ * never compared byte by byte. For vivid this is reported as a warning
+ * since the moving test pattern never repeats; for real capture
+ * hardware a static source can legitimately produce identical frames,
+ * so it is informational only.
+ */
+static __u32 last_plane_crc[VIDEO_MAX_PLANES];
+static bool have_last_plane_crc;
+static bool reported_stale_frame;
+
+static void staleFrameCheckReset()
+{
+	have_last_plane_crc = false;
+	reported_stale_frame = false;
+}
+
+static void staleFrameCheck(const cv4l_queue &q, const cv4l_buffer &buf)
+{
+	__u32 crc[VIDEO_MAX_PLANES];
+	bool all_equal = have_last_plane_crc;
+
+	if (!v4l_type_is_capture(buf.g_type()))
+		return;
+	for (unsigned p = 0; p < buf.g_num_planes(); p++) {
+		const __u8 *data = static_cast<const __u8 *>(q.g_dataptr(buf.g_index(), p));
+		unsigned offset = buf.g_data_offset(p);
+		unsigned size = buf.g_bytesused(p);
+
+		if (!data || size <= offset)
+			return;
+		crc[p] = crc32c(~0U, data + offset, size - offset) ^ ~0U;
+		if (all_equal && crc[p] != last_plane_crc[p])
+			all_equal = false;
+		last_plane_crc[p] = crc[p];
+	}
+	have_last_plane_crc = true;
+	if (all_equal && !reported_stale_frame) {
+		warn_or_info(!is_vivid,
+			     "identical content in consecutive capture frames (sequence %u)\n",
+			     buf.g_sequence());
+		reported_stale_frame = true;
+	}
+}
+
 #define FILE_HDR_ID			v4l2_fourcc('V', 'h', 'd', 'r')
 
 static void stream_close()
@@ -909,6 +960,7 @@ static int captureBufs(struct node *node, struct node *node_m2m_cap, const cv4l_
 	}
 
 	capture_count = 0;
+	staleFrameCheckReset();
 
 	if (show_info) {
 		printf("\t    %s%s:\n",
@@ -1044,6 +1096,8 @@ static int captureBufs(struct node *node, struct node *node_m2m_cap, const cv4l_
 			}
 
 			fail_on_test(buf.check(q, last_seq));
+			if (!node->is_m2m)
+				staleFrameCheck(q, buf);
 			if (!show_info && !no_progress) {
 				printf("\r\t%s: Frame #%03d%s",
 				       buftype2s(q.g_type()).c_str(),
@@ -2644,6 +2698,188 @@ int testRequests(struct node *node, bool test_streaming)
 	return 0;
 }
 
+/*
+ * Stress variant of testRequests(): keep a deep pipeline of requests in
+ * flight and verify that they complete in the order in which they were
+ * queued. testRequests() only ever has a handful of requests outstanding,
+ * so driver queue-management bugs that need sustained back-pressure to
+ * trigger are never seen there. Reports the sustained request rate when
+ * done. Enabled with --stress-requests.
+ */
+int testRequestsDeep(struct node *node, unsigned depth)
+{
+	filehandles fhs;
+	int media_fd = fhs.add(mi_get_media_fd(node->g_fd(), node->bus_info));
+	int req_fds[VIDEO_MAX_FRAME];
+	int ret;
+
+	if (!(node->buf_caps & V4L2_BUF_CAP_SUPPORTS_REQUESTS))
+		return ENOTTY;
+	fail_on_test(media_fd < 0);
+
+	// Clear any pending state from earlier request tests
+	node->reopen();
+
+	int type = node->g_type();
+	// For m2m devices only the output queue can use requests,
+	// see testRequests().
+	if (node->is_m2m)
+		type = v4l_type_invert(type);
+	fail_on_test(!(node->valid_buftypes & (1 << type)));
+
+	buffer_info.clear();
+
+	cv4l_queue q(type, V4L2_MEMORY_MMAP);
+	cv4l_queue m2m_q(v4l_type_invert(type));
+
+	/*
+	 * Each in-flight request holds one buffer, so the pipeline depth
+	 * is really the number of buffers the driver gives us: use all of
+	 * them, since vb2 may round the count up to the queue minimum and
+	 * not start streaming until they are all queued.
+	 */
+	fail_on_test(q.reqbufs(node, depth));
+	if (q.g_buffers() != depth)
+		info("driver adjusted the request depth from %u to %u buffers\n",
+		     depth, q.g_buffers());
+	depth = q.g_buffers();
+
+	media_fd = fhs.add(mi_get_media_fd(node->g_fd(), node->bus_info));
+	for (unsigned i = 0; i < depth; i++) {
+		fail_on_test(doioctl_fd(media_fd, MEDIA_IOC_REQUEST_ALLOC, &req_fds[i]));
+		fail_on_test(req_fds[i] < 0);
+		fhs.add(req_fds[i]);
+	}
+	fhs.del(media_fd);
+
+	if (node->is_m2m)
+		fail_on_test(setupM2M(node, m2m_q));
+
+	// Prime the pipeline: one queued request per buffer
+	for (unsigned i = 0; i < depth; i++) {
+		buffer buf(q);
+
+		fail_on_test(buf.querybuf(node, i));
+		buf.s_flags(V4L2_BUF_FLAG_REQUEST_FD);
+		buf.s_request_fd(req_fds[i]);
+		if (v4l_type_is_video(type))
+			buf.s_field(V4L2_FIELD_ANY);
+		fail_on_test(buf.qbuf(node));
+		ret = doioctl_fd(req_fds[i], MEDIA_REQUEST_IOC_QUEUE, nullptr);
+		if (ret == ENOENT && (node->codec_mask & STATELESS_DECODER)) {
+			// Stateless decoders may require specific controls
+			// in every request, and we don't know what those are.
+			info("stateless decoder requires request controls, cannot stress\n");
+			node->reopen();
+			return ENOTTY;
+		}
+		fail_on_test_val(ret, ret);
+	}
+	fail_on_test(node->streamon(q.g_type()));
+
+	/*
+	 * Recycle completed requests at the tail of the pipeline until we
+	 * have both streamed for a while and completed several times the
+	 * pipeline depth, so sustained operation at depth is measured and
+	 * not just the initial burst.
+	 */
+	struct timespec start, now;
+	unsigned head = 0;
+	unsigned completed = 0;
+	double elapsed = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (;;) {
+		struct pollfd pfd[1 + VIDEO_MAX_FRAME];
+		unsigned first_req = node->is_m2m ? 1 : 0;
+		unsigned nfds = first_req;
+
+		if (node->is_m2m) {
+			pfd[0].fd = node->g_fd();
+			pfd[0].events = POLLIN;
+		}
+		// Poll the in-flight requests in submission order
+		for (unsigned i = 0; i < depth; i++) {
+			pfd[nfds].fd = req_fds[(head + i) % depth];
+			pfd[nfds].events = POLLPRI;
+			nfds++;
+		}
+		ret = poll(pfd, nfds, 10000);
+		fail_on_test_val(ret < 0, errno);
+		// A stalled pipeline is exactly the regression we are after
+		fail_on_test(ret == 0);
+
+		// Keep the m2m capture queue turning over
+		if (node->is_m2m && (pfd[0].revents & POLLIN)) {
+			buffer cap_buf(m2m_q);
+
+			fail_on_test(cap_buf.dqbuf(node));
+			cap_buf.s_flags(cap_buf.g_flags() & ~V4L2_BUF_FLAG_REQUEST_FD);
+			fail_on_test(cap_buf.qbuf(node));
+		}
+
+		/*
+		 * Requests of one queue must complete in the order in which
+		 * they were queued, so the completed requests must form a
+		 * prefix of the submission order.
+		 */
+		bool gap = false;
+		unsigned ready = 0;
+
+		for (unsigned i = first_req; i < nfds; i++) {
+			if (!(pfd[i].revents & POLLPRI)) {
+				gap = true;
+				continue;
+			}
+			fail_on_test(gap);
+			ready++;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		elapsed = now.tv_sec - start.tv_sec +
+			  (now.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+		bool done = completed + ready >= 4 * depth && elapsed >= 2.0;
+
+		while (ready--) {
+			buffer buf(q);
+			int fd = req_fds[head];
+
+			fail_on_test(buf.dqbuf(node));
+			completed++;
+			head = (head + 1) % depth;
+			if (done)
+				continue;
+			// Reuse the request: the recycled buffer goes to
+			// the back of the pipeline.
+			fail_on_test(doioctl_fd(fd, MEDIA_REQUEST_IOC_REINIT, nullptr));
+			buf.s_flags(V4L2_BUF_FLAG_REQUEST_FD);
+			buf.s_request_fd(fd);
+			if (v4l_type_is_video(type))
+				buf.s_field(V4L2_FIELD_ANY);
+			fail_on_test(buf.qbuf(node));
+			fail_on_test(doioctl_fd(fd, MEDIA_REQUEST_IOC_QUEUE, nullptr));
+		}
+		if (done)
+			break;
+	}
+
+	if (elapsed > 0)
+		printf("\t\tsustained %.1f requests/sec at depth %u (%u requests in %.1fs)\n",
+		       completed / elapsed, depth, completed, elapsed);
+
+	// Cleanup
+	fail_on_test(node->streamoff(q.g_type()));
+	fail_on_test(q.reqbufs(node, 0));
+	if (node->is_m2m) {
+		fail_on_test(node->streamoff(m2m_q.g_type()));
+		m2m_q.munmap_bufs(node);
+		fail_on_test(m2m_q.reqbufs(node, 0));
+	}
+
+	return 0;
+}
+
 
 /*
  * This class wraps a pthread in such a way that it simplifies passing
@@ -2905,6 +3141,36 @@ int restoreFormat(struct node *node)
 	return 0;
 }
 
+/*
+ * Scratch buffer for the read()/write() streaming path. The all-formats
+ * phase (-f) calls testStreaming() for every format/size/interval/field
+ * combination, so the buffer is kept across runs and only grown, and is
+ * freed once at the end of the phase.
+ *
+ * The MMAP buffer queue cannot be treated the same way: S_FMT fails
+ * with EBUSY as long as buffers are allocated, so the queue must be
+ * freed before every format switch.
+ */
+static void *rw_scratch_buf;
+static unsigned rw_scratch_size;
+
+static void *rwScratchBuf(unsigned size)
+{
+	if (size > rw_scratch_size) {
+		free(rw_scratch_buf);
+		rw_scratch_buf = malloc(size);
+		rw_scratch_size = rw_scratch_buf ? size : 0;
+	}
+	return rw_scratch_buf;
+}
+
+static void rwScratchFree()
+{
+	free(rw_scratch_buf);
+	rw_scratch_buf = nullptr;
+	rw_scratch_size = 0;
+}
+
 static int testStreaming(struct node *node, unsigned frame_count)
 {
 	int type = node->g_type();
@@ -2975,8 +3241,9 @@ static int testStreaming(struct node *node, unsigned frame_count)
 	fail_on_test(!(node->g_caps() & V4L2_CAP_READWRITE));
 
 	int size = cur_fmt.g_sizeimage();
-	void *tmp = malloc(size);
+	void *tmp = rwScratchBuf(size);
 
+	fail_on_test(tmp == nullptr);
 	for (unsigned i = 0; i < frame_count; i++) {
 		int ret;
 
@@ -3328,14 +3595,14 @@ void streamAllFormats(struct node *node, unsigned frame_count)
 {
 	v4l2_fmtdesc fmtdesc;
 
-	if (node->enum_fmt(fmtdesc, true))
+	if (node->cached_enum_fmt(fmtdesc, true))
 		return;
 	selTests.clear();
 	do {
 		v4l2_frmsizeenum frmsize;
 		cv4l_fmt fmt;
 
-		if (node->enum_framesizes(frmsize, fmtdesc.pixelformat)) {
+		if (node->cached_enum_framesizes(frmsize, fmtdesc.pixelformat)) {
 			cv4l_fmt min, max;
 
 			restoreFormat(node);
@@ -3377,7 +3644,7 @@ void streamAllFormats(struct node *node, unsigned frame_count)
 						frmsize.discrete.width,
 						frmsize.discrete.height,
 						frame_count);
-			} while (!node->enum_framesizes(frmsize));
+			} while (!node->cached_enum_framesizes(frmsize));
 			break;
 		default:
 			restoreFormat(node);
@@ -3402,7 +3669,8 @@ void streamAllFormats(struct node *node, unsigned frame_count)
 			}
 			break;
 		}
-	} while (!node->enum_fmt(fmtdesc));
+	} while (!node->cached_enum_fmt(fmtdesc));
+	rwScratchFree();
 }
 
 static void streamM2MRun(struct node *node, unsigned frame_count)
@@ -3437,7 +3705,7 @@ static int streamM2MOutFormat(struct node *node, __u32 pixelformat, __u32 w, __u
 	out_fmt.s_height(h);
 	fail_on_test(node->s_fmt(out_fmt));
 
-	if (node->enum_fmt(fmtdesc, true, 0))
+	if (node->cached_enum_fmt(fmtdesc, true, 0))
 		return 0;
 	do {
 		cv4l_fmt fmt;
@@ -3448,7 +3716,7 @@ static int streamM2MOutFormat(struct node *node, __u32 pixelformat, __u32 w, __u
 		fmt.s_height(h);
 		fail_on_test(node->s_fmt(fmt));
 		streamM2MRun(node, frame_count);
-	} while (!node->enum_fmt(fmtdesc));
+	} while (!node->cached_enum_fmt(fmtdesc));
 	return 0;
 }
 
@@ -3460,14 +3728,14 @@ void streamM2MAllFormats(struct node *node, unsigned frame_count)
 	if (!frame_count)
 		frame_count = 10;
 
-	if (node->enum_fmt(fmtdesc, true, 0, out_type))
+	if (node->cached_enum_fmt(fmtdesc, true, 0, out_type))
 		return;
 	selTests.clear();
 	do {
 		v4l2_frmsizeenum frmsize;
 		cv4l_fmt fmt;
 
-		if (node->enum_framesizes(frmsize, fmtdesc.pixelformat)) {
+		if (node->cached_enum_framesizes(frmsize, fmtdesc.pixelformat)) {
 			cv4l_fmt min, max;
 
 			restoreFormat(node);
@@ -3509,7 +3777,7 @@ void streamM2MAllFormats(struct node *node, unsigned frame_count)
 						   frmsize.discrete.width,
 						   frmsize.discrete.height,
 						   frame_count);
-			} while (!node->enum_framesizes(frmsize));
+			} while (!node->cached_enum_framesizes(frmsize));
 			break;
 		default:
 			node->g_fmt(fmt, out_type);
@@ -3534,5 +3802,5 @@ void streamM2MAllFormats(struct node *node, unsigned frame_count)
 			restoreFormat(node);
 			break;
 		}
-	} while (!node->enum_fmt(fmtdesc));
+	} while (!node->cached_enum_fmt(fmtdesc));
 }
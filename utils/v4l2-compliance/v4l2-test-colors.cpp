@@ -588,7 +588,7 @@ int testColorsAllFormats(struct node *node, unsigned component,
 {
 	v4l2_fmtdesc fmtdesc;
 
-	if (node->enum_fmt(fmtdesc, true))
+	if (node->cached_enum_fmt(fmtdesc, true))
 		return 0;
 	do {
 		if (fmtdesc.flags & V4L2_FMT_FLAG_COMPRESSED)
@@ -617,7 +617,7 @@ int testColorsAllFormats(struct node *node, unsigned component,
 				perc, colors[component],
 				fcc2s(fmt.g_pixelformat()).c_str(),
 				ok(testColorsFmt(node, component, skip, perc)));
-	} while (!node->enum_fmt(fmtdesc));
+	} while (!node->cached_enum_fmt(fmtdesc));
 	printf("\n");
 	return 0;
 }
@@ -130,6 +130,7 @@ static int testEnumFrameSizes(struct node *node, __u32 pixfmt)
 {
 	struct v4l2_frmsizeenum frmsize;
 	struct v4l2_frmsize_stepwise *sw = &frmsize.stepwise;
+	std::vector<v4l2_frmsizeenum> cache;
 	bool found_stepwise = false;
 	__u64 cookie;
 	unsigned f = 0;
@@ -213,8 +214,10 @@ static int testEnumFrameSizes(struct node *node, __u32 pixfmt)
 			return fail("frmsize.type is invalid\n");
 		}
 
+		cache.push_back(frmsize);
 		f++;
 	}
+	node->frmsize_cache[pixfmt] = cache;
 	node->frmsizes_count[pixfmt] = count;
 	info("found %d framesizes for pixel format %08x (%s)\n",
 	     f, pixfmt, fcc2s(pixfmt).c_str());
@@ -224,6 +227,7 @@ static int testEnumFrameSizes(struct node *node, __u32 pixfmt)
 static int testEnumFormatsType(struct node *node, unsigned type)
 {
 	pixfmt_map &map = node->buftype_pixfmts[type];
+	std::vector<v4l2_fmtdesc> cache;
 	struct v4l2_fmtdesc fmtdesc;
 	unsigned f = 0;
 	int ret;
@@ -305,7 +309,10 @@ static int testEnumFormatsType(struct node *node, unsigned type)
 			return fail("duplicate format %08x (%s)\n",
 				    fmtdesc.pixelformat, fcc2s(fmtdesc.pixelformat).c_str());
 		map[fmtdesc.pixelformat] = fmtdesc.flags;
+		cache.push_back(fmtdesc);
 	}
+	if (type <= V4L2_BUF_TYPE_LAST)
+		node->fmtdesc_cache[type] = cache;
 	info("found %d formats for buftype %d\n", f, type);
 	return 0;
 }
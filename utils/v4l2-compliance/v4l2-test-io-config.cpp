@@ -23,8 +23,29 @@
 
 #include <sys/types.h>
 
+#include "v4l2-dv-timings-db.h"
 #include "v4l2-compliance.h"
 
+/*
+ * Check an enumerated timing against the canonical CEA-861/DMT table:
+ * a driver that reports a standard mode should report the standard
+ * blanking and polarities for it, and should set the standards field.
+ */
+static void checkCanonicalTiming(const struct v4l2_bt_timings *bt, unsigned index)
+{
+	const v4l2_dv_canonical_timing *canon = v4l2_dv_timing_find(bt);
+
+	if (!canon)
+		return;
+	if ((bt->standards & canon->standards) &&
+	    !v4l2_dv_timing_matches(bt, canon))
+		warn("timing %u claims %s, but the blanking or polarities deviate from it\n",
+		     index, canon->name);
+	else if (!bt->standards && v4l2_dv_timing_matches(bt, canon))
+		warn("timing %u matches %s, but the standards field is not set\n",
+		     index, canon->name);
+}
+
 static int checkStd(struct node *node, bool has_std, v4l2_std_id mask, bool is_input)
 {
 	v4l2_std_id std_mask = 0;
@@ -188,6 +209,7 @@ static int checkTimings(struct node *node, bool has_timings, bool is_input)
 				     sizeof(enumtimings.timings.bt.reserved)));
 		if (enumtimings.index != i)
 			return fail("index changed!\n");
+		checkCanonicalTiming(&enumtimings.timings.bt, i);
 		memset(enumtimings.timings.bt.reserved, 0xff,
 		       sizeof(enumtimings.timings.bt.reserved));
 		fail_on_test(doioctl(node, VIDIOC_S_DV_TIMINGS, &enumtimings.timings));
@@ -290,6 +312,7 @@ static int checkSubDevEnumTimings(struct node *node, __u32 pad)
 				     sizeof(enumtimings.timings.bt.reserved)));
 		fail_on_test(enumtimings.index != i);
 		fail_on_test(enumtimings.pad != pad);
+		checkCanonicalTiming(&enumtimings.timings.bt, i);
 		memset(enumtimings.timings.bt.reserved, 0xff,
 		       sizeof(enumtimings.timings.bt.reserved));
 		fail_on_test(doioctl(node, VIDIOC_S_DV_TIMINGS, &enumtimings.timings));
@@ -535,6 +535,69 @@ int testMediaSetupLink(struct node *node)
 	return 0;
 }
 
+static void walkInterface(struct node &node, struct node &expbuf_node,
+			  const std::string &dev,
+			  unsigned frame_count, unsigned all_fmt_frame_count)
+{
+	printf("--------------------------------------------------------------------------------\n");
+
+	media_type type = mi_media_detect_type(dev.c_str());
+	if (type == MEDIA_TYPE_CANT_STAT) {
+		fprintf(stderr, "\nCannot open device %s, skipping.\n\n",
+			dev.c_str());
+		return;
+	}
+
+	switch (type) {
+	// For now we can only handle V4L2 devices
+	case MEDIA_TYPE_VIDEO:
+	case MEDIA_TYPE_VBI:
+	case MEDIA_TYPE_RADIO:
+	case MEDIA_TYPE_SDR:
+	case MEDIA_TYPE_TOUCH:
+	case MEDIA_TYPE_SUBDEV:
+		break;
+	default:
+		type = MEDIA_TYPE_UNKNOWN;
+		break;
+	}
+
+	if (type == MEDIA_TYPE_UNKNOWN) {
+		fprintf(stderr, "\nUnable to detect what device %s is, skipping.\n\n",
+			dev.c_str());
+		return;
+	}
+
+	struct node test_node;
+	int fd = -1;
+
+	test_node.device = dev.c_str();
+	test_node.s_trace(node.g_trace());
+	switch (type) {
+	case MEDIA_TYPE_MEDIA:
+		test_node.s_direct(true);
+		fd = test_node.media_open(dev.c_str(), false);
+		break;
+	case MEDIA_TYPE_SUBDEV:
+		test_node.s_direct(true);
+		fd = test_node.subdev_open(dev.c_str(), false);
+		break;
+	default:
+		test_node.s_direct(node.g_direct());
+		fd = test_node.open(dev.c_str(), false);
+		break;
+	}
+	if (fd < 0) {
+		fprintf(stderr, "\nFailed to open device %s, skipping\n\n",
+			dev.c_str());
+		return;
+	}
+
+	testNode(test_node, test_node, expbuf_node, type,
+		 frame_count, all_fmt_frame_count);
+	test_node.close();
+}
+
 void walkTopology(struct node &node, struct node &expbuf_node,
 		  unsigned frame_count, unsigned all_fmt_frame_count)
 {
@@ -557,62 +620,19 @@ void walkTopology(struct node &node, struct node &expbuf_node,
 		if (dev.empty())
 			continue;
 
-		printf("--------------------------------------------------------------------------------\n");
-
-		media_type type = mi_media_detect_type(dev.c_str());
-		if (type == MEDIA_TYPE_CANT_STAT) {
-			fprintf(stderr, "\nCannot open device %s, skipping.\n\n",
-				dev.c_str());
-			continue;
-		}
-
-		switch (type) {
-		// For now we can only handle V4L2 devices
-		case MEDIA_TYPE_VIDEO:
-		case MEDIA_TYPE_VBI:
-		case MEDIA_TYPE_RADIO:
-		case MEDIA_TYPE_SDR:
-		case MEDIA_TYPE_TOUCH:
-		case MEDIA_TYPE_SUBDEV:
-			break;
-		default:
-			type = MEDIA_TYPE_UNKNOWN;
-			break;
-		}
-
-		if (type == MEDIA_TYPE_UNKNOWN) {
-			fprintf(stderr, "\nUnable to detect what device %s is, skipping.\n\n",
-				dev.c_str());
-			continue;
-		}
-
-		struct node test_node;
-		int fd = -1;
+		/*
+		 * With --parallel each interface is tested in a worker
+		 * process; parallelCollect() below merges the buffered
+		 * output in interface order.
+		 */
+		int is_child = parallelFork();
 
-		test_node.device = dev.c_str();
-		test_node.s_trace(node.g_trace());
-		switch (type) {
-		case MEDIA_TYPE_MEDIA:
-			test_node.s_direct(true);
-			fd = test_node.media_open(dev.c_str(), false);
-			break;
-		case MEDIA_TYPE_SUBDEV:
-			test_node.s_direct(true);
-			fd = test_node.subdev_open(dev.c_str(), false);
-			break;
-		default:
-			test_node.s_direct(node.g_direct());
-			fd = test_node.open(dev.c_str(), false);
-			break;
-		}
-		if (fd < 0) {
-			fprintf(stderr, "\nFailed to open device %s, skipping\n\n",
-				dev.c_str());
+		if (is_child > 0)
 			continue;
-		}
-
-		testNode(test_node, test_node, expbuf_node, type,
-			 frame_count, all_fmt_frame_count);
-		test_node.close();
+		walkInterface(node, expbuf_node, dev,
+			      frame_count, all_fmt_frame_count);
+		if (is_child == 0)
+			parallelChildExit();
 	}
+	parallelCollect(true);
 }
@@ -0,0 +1 @@
+../common/v4l-ringlog.c
\ No newline at end of file
@@ -5,12 +5,17 @@
 #include <map>
 #include <vector>
 
-#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 
 #include <linux/media.h>
 
+#include <media-info.h>
+
 #include "v4l2-ctl.h"
 
 #ifdef HAVE_SYS_KLOG_H
@@ -54,6 +59,10 @@ void common_usage()
 	       "                     get the value of the controls [VIDIOC_G_EXT_CTRLS]\n"
 	       "  -c, --set-ctrl <ctrl>=<val>[,<ctrl>=<val>...]\n"
 	       "                     set the value of the controls [VIDIOC_S_EXT_CTRLS]\n"
+	       "  --set-ctrl-from-file <file>\n"
+	       "                     set the controls listed in <file>, one <ctrl>=<val> per\n"
+	       "                     line, blank lines and '#' comments are skipped\n"
+	       "                     [VIDIOC_S_EXT_CTRLS]\n"
 	       "  -D, --info         show driver info [VIDIOC_QUERYCAP]\n"
 	       "  -d, --device <dev> use device <dev> instead of /dev/video0\n"
 	       "                     if <dev> starts with a digit, then /dev/video<dev> is used\n"
@@ -127,17 +136,19 @@ static const char *prefixes[] = {
 	nullptr
 };
 
-static bool is_v4l_dev(const char *name)
+static bool is_v4l_type(media_type type)
 {
-	for (unsigned i = 0; prefixes[i]; i++) {
-		unsigned l = strlen(prefixes[i]);
-
-		if (!memcmp(name, prefixes[i], l)) {
-			if (isdigit(name[l]))
-				return true;
-		}
+	switch (type) {
+	case MEDIA_TYPE_VIDEO:
+	case MEDIA_TYPE_VBI:
+	case MEDIA_TYPE_RADIO:
+	case MEDIA_TYPE_SDR:
+	case MEDIA_TYPE_TOUCH:
+	case MEDIA_TYPE_SUBDEV:
+		return true;
+	default:
+		return false;
 	}
-	return false;
 }
 
 static int calc_node_val(const char *s)
@@ -168,27 +179,15 @@ static bool sort_on_device_name(const std::string &s1, const std::string &s2)
 
 static void list_media_devices(const std::string &media_bus_info)
 {
-	DIR *dp;
-	struct dirent *ep;
 	int media_fd = -1;
 	std::map<dev_t, std::string> devices;
 
-	dp = opendir("/dev");
-	if (dp == nullptr) {
-		perror ("Couldn't open the directory");
-		return;
-	}
-	while ((ep = readdir(dp))) {
-		std::string s("/dev/");
+	for (const auto &node : mi_media_scan_devices()) {
+		const std::string &s = node.second.devpath;
 
-		s += ep->d_name;
-		if (memcmp(ep->d_name, "media", 5)) {
-			if (!is_v4l_dev(ep->d_name))
-				continue;
-			struct stat st;
-			if (stat(s.c_str(), &st))
-				continue;
-			devices[st.st_rdev] = s;
+		if (node.second.type != MEDIA_TYPE_MEDIA) {
+			if (is_v4l_type(node.second.type))
+				devices[node.first] = s;
 			continue;
 		}
 		int fd = open(s.c_str(), O_RDWR);
@@ -205,7 +204,6 @@ static void list_media_devices(const std::string &media_bus_info)
 			close(fd);
 		}
 	}
-	closedir(dp);
 	if (media_fd < 0)
 		return;
 
@@ -232,22 +230,15 @@ static void list_media_devices(const std::string &media_bus_info)
 
 static void list_devices()
 {
-	DIR *dp;
-	struct dirent *ep;
 	dev_vec files;
 	dev_map links;
 	dev_map cards;
 	struct v4l2_capability vcap;
 
-	dp = opendir("/dev");
-	if (dp == nullptr) {
-		perror ("Couldn't open the directory");
-		return;
-	}
-	while ((ep = readdir(dp)))
-		if (is_v4l_dev(ep->d_name))
-			files.push_back(std::string("/dev/") + ep->d_name);
-	closedir(dp);
+	for (const auto &node : mi_media_scan_devices())
+		if (is_v4l_type(node.second.type) ||
+		    node.second.type == MEDIA_TYPE_MEDIA)
+			files.push_back(node.second.devpath);
 
 	/* Find device nodes which are links to other device nodes */
 	for (auto iter = files.begin();
@@ -859,6 +850,176 @@ static void find_controls(cv4l_fd &_fd)
 	}
 }
 
+/*
+ * Persistent control cache
+ *
+ * Scripts often invoke v4l2-ctl thousands of times, and enumerating all
+ * controls on e.g. a UVC device costs many USB round trips on every
+ * invocation. The parsed control table is therefore cached on disk, keyed
+ * on the driver name, bus_info and driver version from VIDIOC_QUERYCAP.
+ * As long as those match, the cached table is used and a set/get goes
+ * straight to the target control. When a requested control is not found
+ * in a cached table the device is re-enumerated before giving up, so a
+ * stale cache can only cost time, never correctness.
+ *
+ * Set V4L2_CTL_CTRL_CACHE=0 in the environment to disable the cache.
+ */
+#define CTRL_CACHE_MAGIC 0x76346363	/* 'v4cc' */
+#define CTRL_CACHE_VERSION 1
+
+struct ctrl_cache_hdr {
+	__u32 magic;
+	__u32 version;		/* CTRL_CACHE_VERSION, bump on layout changes */
+	__u32 n_ctrls;
+	__u32 kernel_version;	/* v4l2_capability.version */
+	__u8 driver[16];
+	__u8 bus_info[32];
+};
+
+static bool ctrl_cache_enabled()
+{
+	const char *e = getenv("V4L2_CTL_CTRL_CACHE");
+
+	return !e || strcmp(e, "0");
+}
+
+static std::string ctrl_cache_path(const struct v4l2_capability &vcap)
+{
+	const char *dir = getenv("XDG_CACHE_HOME");
+	std::string path;
+
+	if (dir && dir[0]) {
+		path = dir;
+	} else {
+		dir = getenv("HOME");
+		if (!dir || !dir[0])
+			return "";
+		path = std::string(dir) + "/.cache";
+	}
+	path += "/v4l2-ctl/";
+
+	std::string name = std::string(reinterpret_cast<const char *>(vcap.driver)) +
+		"-" + reinterpret_cast<const char *>(vcap.bus_info);
+	for (auto &c : name)
+		if (!isalnum(c) && c != '-' && c != '.' && c != '_')
+			c = '_';
+	return path + name + ".ctrls";
+}
+
+static bool ctrl_cache_load(const struct v4l2_capability &vcap)
+{
+	std::string path = ctrl_cache_path(vcap);
+	const struct ctrl_cache_hdr *hdr;
+	struct stat st;
+	void *map;
+	int cfd;
+
+	if (path.empty())
+		return false;
+	cfd = open(path.c_str(), O_RDONLY);
+	if (cfd < 0)
+		return false;
+	if (fstat(cfd, &st) || static_cast<size_t>(st.st_size) < sizeof(*hdr)) {
+		close(cfd);
+		return false;
+	}
+	map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+	close(cfd);
+	if (map == MAP_FAILED)
+		return false;
+
+	hdr = static_cast<const struct ctrl_cache_hdr *>(map);
+	bool ok = hdr->magic == CTRL_CACHE_MAGIC &&
+		hdr->version == CTRL_CACHE_VERSION &&
+		hdr->kernel_version == vcap.version &&
+		!memcmp(hdr->driver, vcap.driver, sizeof(hdr->driver)) &&
+		!memcmp(hdr->bus_info, vcap.bus_info, sizeof(hdr->bus_info)) &&
+		static_cast<size_t>(st.st_size) == sizeof(*hdr) +
+			hdr->n_ctrls * sizeof(struct v4l2_query_ext_ctrl);
+
+	if (ok) {
+		auto qs = reinterpret_cast<const struct v4l2_query_ext_ctrl *>(hdr + 1);
+
+		for (__u32 i = 0; i < hdr->n_ctrls; i++) {
+			ctrl_str2q[name2var(qs[i].name)] = qs[i];
+			ctrl_id2str[qs[i].id] = name2var(qs[i].name);
+		}
+	}
+	munmap(map, st.st_size);
+	return ok;
+}
+
+static void ctrl_cache_store(const struct v4l2_capability &vcap)
+{
+	std::string path = ctrl_cache_path(vcap);
+
+	if (path.empty() || !vcap.driver[0] || !ctrl_cache_enabled())
+		return;
+
+	/* Create the directory components, errors show up in the open below */
+	for (size_t pos = path.find('/', 1); pos != std::string::npos;
+	     pos = path.find('/', pos + 1))
+		mkdir(path.substr(0, pos).c_str(), 0700);
+
+	/* Write to a temporary file and rename so that concurrent
+	   invocations never see a partial cache */
+	std::string tmp = path + "." + std::to_string(getpid());
+	int cfd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+
+	if (cfd < 0)
+		return;
+
+	struct ctrl_cache_hdr hdr = {};
+
+	hdr.magic = CTRL_CACHE_MAGIC;
+	hdr.version = CTRL_CACHE_VERSION;
+	hdr.n_ctrls = ctrl_str2q.size();
+	hdr.kernel_version = vcap.version;
+	memcpy(hdr.driver, vcap.driver, sizeof(hdr.driver));
+	memcpy(hdr.bus_info, vcap.bus_info, sizeof(hdr.bus_info));
+
+	bool ok = write(cfd, &hdr, sizeof(hdr)) == static_cast<ssize_t>(sizeof(hdr));
+
+	for (const auto &c : ctrl_str2q)
+		ok = ok && write(cfd, &c.second, sizeof(c.second)) ==
+			static_cast<ssize_t>(sizeof(c.second));
+	if (close(cfd) || !ok || rename(tmp.c_str(), path.c_str()))
+		unlink(tmp.c_str());
+}
+
+/* Map a control name or numeric id to the ctrl_str2q key, returns false
+   if the control is unknown */
+static bool resolve_ctrl_name(std::string &s)
+{
+	if (isdigit(s[0])) {
+		__u32 id = strtoul(s.c_str(), nullptr, 0);
+
+		if (ctrl_id2str.find(id) != ctrl_id2str.end())
+			s = ctrl_id2str[id];
+	}
+	return ctrl_str2q.find(s) != ctrl_str2q.end();
+}
+
+static bool resolve_ctrl(cv4l_fd &fd, const struct v4l2_capability &vcap,
+		bool &from_cache, const std::string &name, std::string &s)
+{
+	s = name;
+	if (resolve_ctrl_name(s))
+		return true;
+	if (!from_cache)
+		return false;
+
+	/* The driver may have grown controls since the cache was written:
+	   re-enumerate before giving up */
+	from_cache = false;
+	ctrl_str2q.clear();
+	ctrl_id2str.clear();
+	find_controls(fd);
+	ctrl_cache_store(vcap);
+	s = name;
+	return resolve_ctrl_name(s);
+}
+
 int common_find_ctrl_id(const char *name)
 {
 	if (ctrl_str2q.find(name) == ctrl_str2q.end())
@@ -871,32 +1032,32 @@ void common_process_controls(cv4l_fd &fd)
 	struct v4l2_query_ext_ctrl qc = {
 		V4L2_CTRL_FLAG_NEXT_CTRL | V4L2_CTRL_FLAG_NEXT_COMPOUND
 	};
+	struct v4l2_capability vcap = {};
+	bool from_cache = false;
 	int rc;
 
 	rc = test_ioctl(fd.g_fd(), VIDIOC_QUERY_EXT_CTRL, &qc);
 	have_query_ext_ctrl = rc == 0;
 
-	find_controls(fd);
+	if (ctrl_cache_enabled() &&
+	    test_ioctl(fd.g_fd(), VIDIOC_QUERYCAP, &vcap) == 0)
+		from_cache = ctrl_cache_load(vcap);
+	if (!from_cache) {
+		find_controls(fd);
+		ctrl_cache_store(vcap);
+	}
 	for (const auto &get_ctrl : get_ctrls) {
-		std::string s = get_ctrl;
-		if (isdigit(s[0])) {
-			__u32 id = strtoul(s.c_str(), nullptr, 0);
-			if (ctrl_id2str.find(id) != ctrl_id2str.end())
-				s = ctrl_id2str[id];
-		}
-		if (ctrl_str2q.find(s) == ctrl_str2q.end()) {
+		std::string s;
+
+		if (!resolve_ctrl(fd, vcap, from_cache, get_ctrl, s)) {
 			fprintf(stderr, "unknown control '%s'\n", s.c_str());
 			std::exit(EXIT_FAILURE);
 		}
 	}
 	for (const auto &set_ctrl : set_ctrls) {
-		std::string s = set_ctrl.first;
-		if (isdigit(s[0])) {
-			__u32 id = strtoul(s.c_str(), nullptr, 0);
-			if (ctrl_id2str.find(id) != ctrl_id2str.end())
-				s = ctrl_id2str[id];
-		}
-		if (ctrl_str2q.find(s) == ctrl_str2q.end()) {
+		std::string s;
+
+		if (!resolve_ctrl(fd, vcap, from_cache, set_ctrl.first, s)) {
 			fprintf(stderr, "unknown control '%s'\n", s.c_str());
 			std::exit(EXIT_FAILURE);
 		}
@@ -1043,6 +1204,49 @@ void common_cmd(const std::string &media_bus_info, int ch, char *optarg)
 			}
 		}
 		break;
+	case OptSetCtrlFromFile: {
+		FILE *f = fopen(optarg, "r");
+		char line[1024];
+
+		if (f == nullptr) {
+			fprintf(stderr, "Failed to open %s: %s\n", optarg,
+					strerror(errno));
+			std::exit(EXIT_FAILURE);
+		}
+		while (fgets(line, sizeof(line), f)) {
+			char *p = line;
+			size_t len;
+
+			if (char *hash = std::strchr(p, '#'))
+				*hash = 0;
+			while (isspace(*p))
+				p++;
+			len = strlen(p);
+			while (len && isspace(p[len - 1]))
+				p[--len] = 0;
+			if (!*p)
+				continue;
+			char *equal = std::strchr(p, '=');
+
+			if (!equal) {
+				fprintf(stderr, "control '%s' without '='\n", p);
+				std::exit(EXIT_FAILURE);
+			}
+			/* Allow whitespace around the '=' */
+			const char *val = equal + 1;
+
+			while (isspace(*val))
+				val++;
+			while (equal > p && isspace(equal[-1]))
+				equal--;
+			set_ctrls.emplace_back(std::string(p, equal - p),
+					       std::string(val));
+		}
+		fclose(f);
+		/* From here on these behave exactly like --set-ctrl controls */
+		options[OptSetCtrl] = 1;
+		break;
+	}
 	case OptSubset:
 		if (parse_subset(optarg)) {
 			common_usage();
@@ -1172,6 +1376,24 @@ void common_set(cv4l_fd &_fd)
 			}
 			class2ctrls[V4L2_CTRL_ID2WHICH(ctrl.id)].push_back(ctrl);
 		}
+
+		/* When the request spans control classes, first try to apply
+		   it as a single VIDIOC_S_EXT_CTRLS transaction: with
+		   V4L2_CTRL_WHICH_CUR_VAL a batch may mix classes. Old
+		   kernels reject that, so on any error fall through to the
+		   per-class path below which also reports the error. */
+		if (class2ctrls.size() > 1) {
+			std::vector<v4l2_ext_control> all;
+
+			for (const auto &class2ctrl : class2ctrls)
+				all.insert(all.end(), class2ctrl.second.begin(),
+					   class2ctrl.second.end());
+			ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+			ctrls.count = all.size();
+			ctrls.controls = all.data();
+			if (test_ioctl(fd, VIDIOC_S_EXT_CTRLS, &ctrls) == 0)
+				return;
+		}
 		for (auto &class2ctrl : class2ctrls) {
 			if (!use_ext_ctrls &&
 			    (class2ctrl.first == V4L2_CTRL_CLASS_USER ||
@@ -1242,6 +1464,36 @@ void common_get(cv4l_fd &_fd)
 				use_ext_ctrls = true;
 			class2ctrls[V4L2_CTRL_ID2WHICH(ctrl.id)].push_back(ctrl);
 		}
+
+		/* As in common_set(): a cross-class request is first tried as
+		   one VIDIOC_G_EXT_CTRLS transaction, falling back to the
+		   per-class path on older kernels. */
+		if (class2ctrls.size() > 1) {
+			std::vector<v4l2_ext_control> all;
+
+			for (const auto &class2ctrl : class2ctrls)
+				all.insert(all.end(), class2ctrl.second.begin(),
+					   class2ctrl.second.end());
+			ctrls.which = V4L2_CTRL_WHICH_CUR_VAL;
+			ctrls.count = all.size();
+			ctrls.controls = all.data();
+			if (test_ioctl(fd, VIDIOC_G_EXT_CTRLS, &ctrls) == 0) {
+				for (auto ctrl : all) {
+					std::string &name = ctrl_id2str[ctrl.id];
+					struct v4l2_query_ext_ctrl &qc = ctrl_str2q[name];
+
+					if (qc.nr_of_dims) {
+						print_value(fd, qc, ctrl, true, true);
+						continue;
+					}
+
+					printf("%s: ", name.c_str());
+					print_value(fd, qc, ctrl, true, false);
+					printf("\n");
+				}
+				class2ctrls.clear();
+			}
+		}
 		for (auto &class2ctrl : class2ctrls) {
 			if (!use_ext_ctrls &&
 			    (class2ctrl.first == V4L2_CTRL_CLASS_USER ||
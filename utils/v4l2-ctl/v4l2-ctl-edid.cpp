@@ -1,5 +1,6 @@
 #include <cctype>
 #include <cstring>
+#include <vector>
 
 #include <linux/v4l2-subdev.h>
 
@@ -32,6 +33,8 @@ enum format {
 };
 
 static struct v4l2_edid sedid;
+static std::vector<unsigned> sedid_pads;
+static bool sedid_dry_run;
 static char *file_in;
 
 static struct v4l2_edid gedid;
@@ -119,8 +122,12 @@ static __u8 toggle_hdr_md_flags;
 void edid_usage()
 {
 	printf("\nEDID options:\n"
-	       "  --set-edid pad=<pad>[,type=<type>|file=<file>][,format=<fmt>][modifiers]\n"
-	       "                     <pad> is the input index for which to set the EDID.\n"
+	       "  --set-edid pad=<pad>[,type=<type>|file=<file>][,format=<fmt>][,dry-run][modifiers]\n"
+	       "                     <pad> is the input index for which to set the EDID. A range\n"
+	       "                     <pad>-<pad> is allowed, and the pad suboption can be given more\n"
+	       "                     than once, to apply the same EDID to multiple pads in a single\n"
+	       "                     invocation. Pads whose current EDID already matches are skipped,\n"
+	       "                     so no hotplug cycle is triggered for them.\n"
 	       "                     <type> can be one of:\n"
 	       "                     list: list all EDID types\n"
 	       "                     vga: Base Block supporting VGA interface (1920x1200p60)\n"
@@ -137,11 +144,15 @@ void edid_usage()
 	       "\n"
 	       "                     If <file> is '-', then the data is read from stdin, otherwise it is\n"
 	       "                     read from the given file. The file format must be in hex as in get-edid.\n"
-	       "                     The 'type' or 'file' arguments are mutually exclusive. One of the two\n"
-	       "                     must be specified.\n"
+	       "                     The 'type' or 'file' arguments are mutually exclusive. If neither is\n"
+	       "                     specified, but one or more modifiers are, then the current EDID of\n"
+	       "                     each pad is read back, patched in place and the checksums of the\n"
+	       "                     modified blocks are recomputed.\n"
 	       "                     <fmt> is one of:\n"
 	       "                     hex:    hex numbers in ascii text (default)\n"
 	       "                     raw:    raw binary EDID content\n"
+	       "                     If dry-run is given, then report for each pad whether its EDID\n"
+	       "                     would change, without actually setting anything.\n"
 	       "\n"
 	       "                     [modifiers] is a comma-separate list of EDID modifiers:\n"
 	       "\n"
@@ -1101,6 +1112,8 @@ void edid_cmd(int ch, char *optarg)
 	case OptSetEdid:
 	case OptShowEdid:
 		memset(&sedid, 0, sizeof(sedid));
+		sedid_pads.clear();
+		sedid_dry_run = false;
 		file_in = nullptr;
 		if (!optarg)
 			break;
@@ -1164,6 +1177,7 @@ void edid_cmd(int ch, char *optarg)
 				"btfc",
 				"btfl-btbr",
 				"tpls-tprs",
+				"dry-run",
 				nullptr
 			};
 
@@ -1313,9 +1327,22 @@ void edid_cmd(int ch, char *optarg)
 			case 54: toggle_speaker3_flags |= SPEAKER3_BTFC; break;
 			case 55: toggle_speaker3_flags |= SPEAKER3_BTFL_BTFR; break;
 			case 56: toggle_speaker3_flags |= SPEAKER3_TPLS_TPRS; break;
+			case 57: sedid_dry_run = true; break;
 			case 0:
 				 if (ch == OptSetEdid) {
-					 sedid.pad = strtoul(value, nullptr, 0);
+					 char *end;
+					 unsigned first = strtoul(value, &end, 0);
+					 unsigned last = first;
+
+					 if (*end == '-')
+						 last = strtoul(end + 1, nullptr, 0);
+					 if (last < first) {
+						 fprintf(stderr, "Invalid pad range %s\n", value);
+						 std::exit(EXIT_FAILURE);
+					 }
+					 for (unsigned pad = first; pad <= last; pad++)
+						 sedid_pads.push_back(pad);
+					 sedid.pad = sedid_pads[0];
 					 break;
 				 }
 				 fallthrough;
@@ -1396,10 +1423,158 @@ void edid_cmd(int ch, char *optarg)
 	}
 }
 
+static bool have_edid_mods()
+{
+	return toggle_cta861_hdr_flags || phys_addr >= 0 ||
+	       toggle_speaker1_flags || toggle_speaker2_flags ||
+	       toggle_speaker3_flags ||
+	       toggle_hdmi_vsdb_dc_flags || toggle_hdmi_vsdb_cnc_flags ||
+	       toggle_hf_vsdb_flags ||
+	       toggle_vid_cap_flags || mod_s_pt >= 0 || mod_s_it >= 0 ||
+	       mod_s_ce >= 0 ||
+	       toggle_colorimetry_flags1 || toggle_colorimetry_flags2 ||
+	       toggle_hdr_md_flags;
+}
+
+/*
+ * Apply the requested modifiers to the EDID. Returns true if anything
+ * was patched, in which case the checksums of the affected blocks have
+ * to be recomputed.
+ */
+static bool apply_edid_mods(struct v4l2_edid *e)
+{
+	bool modified = false;
+	int loc;
+
+	if (toggle_cta861_hdr_flags || phys_addr >= 0) {
+		loc = get_edid_cta861_hdr_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc] ^= toggle_cta861_hdr_flags;
+			if (phys_addr >= 0)
+				set_edid_phys_addr(e->edid, e->blocks * 128, phys_addr);
+			modified = true;
+		}
+	}
+	if (toggle_speaker1_flags || toggle_speaker2_flags || toggle_speaker3_flags) {
+		loc = get_edid_speaker_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc] ^= toggle_speaker1_flags;
+			e->edid[loc + 1] ^= toggle_speaker2_flags;
+			e->edid[loc + 2] ^= toggle_speaker3_flags;
+			modified = true;
+		}
+	}
+	if (toggle_hdmi_vsdb_dc_flags || toggle_hdmi_vsdb_cnc_flags) {
+		loc = get_edid_hdmi_vsdb_location(e->edid, e->blocks * 128);
+
+		if (loc >= 0) {
+			__u8 len = e->edid[loc] & 0x1f;
+
+			if (len >= 6) {
+				e->edid[loc + 6] ^= toggle_hdmi_vsdb_dc_flags;
+				modified = true;
+			}
+			if (len >= 8) {
+				e->edid[loc + 8] ^= toggle_hdmi_vsdb_cnc_flags;
+				modified = true;
+			}
+		}
+	}
+	if (toggle_hf_vsdb_flags) {
+		loc = get_edid_hf_vsdb_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc + 1] ^= toggle_hf_vsdb_flags;
+			modified = true;
+		}
+	}
+	if (toggle_vid_cap_flags || mod_s_pt >= 0 ||
+	    mod_s_ce >= 0 || mod_s_it >= 0) {
+		loc = get_edid_vid_cap_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc] ^= toggle_vid_cap_flags;
+			if (mod_s_ce >= 0) {
+				e->edid[loc] &= 0xfc;
+				e->edid[loc] |= mod_s_ce << 0;
+			}
+			if (mod_s_it >= 0) {
+				e->edid[loc] &= 0xf3;
+				e->edid[loc] |= mod_s_it << 2;
+			}
+			if (mod_s_pt >= 0) {
+				e->edid[loc] &= 0xcf;
+				e->edid[loc] |= mod_s_pt << 4;
+			}
+			modified = true;
+		}
+	}
+	if (toggle_colorimetry_flags1 || toggle_colorimetry_flags2) {
+		loc = get_edid_colorimetry_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc] ^= toggle_colorimetry_flags1;
+			e->edid[loc + 1] ^= toggle_colorimetry_flags2;
+			modified = true;
+		}
+	}
+	if (toggle_hdr_md_flags) {
+		loc = get_edid_hdr_md_location(e->edid, e->blocks * 128);
+		if (loc >= 0) {
+			e->edid[loc] ^= toggle_hdr_md_flags;
+			modified = true;
+		}
+	}
+	return modified;
+}
+
+/* Read the full EDID of the given pad. Returns false if the pad has none. */
+static bool get_pad_edid(int fd, unsigned pad, struct v4l2_edid *e)
+{
+	memset(e, 0, sizeof(*e));
+	e->pad = pad;
+	if (test_ioctl(fd, VIDIOC_G_EDID, e) || e->blocks == 0)
+		return false;
+	e->edid = static_cast<unsigned char *>(malloc(e->blocks * 128));
+	if (test_ioctl(fd, VIDIOC_G_EDID, e)) {
+		free(e->edid);
+		e->edid = nullptr;
+		return false;
+	}
+	return true;
+}
+
+static bool pad_edid_unchanged(int fd, const struct v4l2_edid *e)
+{
+	struct v4l2_edid cur;
+	bool same;
+
+	if (!get_pad_edid(fd, e->pad, &cur))
+		return false;
+	same = cur.blocks == e->blocks &&
+	       !memcmp(cur.edid, e->edid, e->blocks * 128);
+	free(cur.edid);
+	return same;
+}
+
+/*
+ * Setting an EDID triggers a hotplug cycle and link retraining on the
+ * connected source, so skip pads that already have this exact EDID.
+ */
+static void set_pad_edid(int fd, struct v4l2_edid *e)
+{
+	if (pad_edid_unchanged(fd, e)) {
+		if (verbose || sedid_dry_run)
+			printf("pad %u: EDID unchanged\n", e->pad);
+		return;
+	}
+	if (sedid_dry_run) {
+		printf("pad %u: EDID differs, would be set\n", e->pad);
+		return;
+	}
+	doioctl(fd, VIDIOC_S_EDID, e);
+}
+
 void edid_set(cv4l_fd &_fd)
 {
 	int fd = _fd.g_fd();
-	int loc;
 
 	if (options[OptClearEdid]) {
 		struct v4l2_edid edid;
@@ -1412,6 +1587,7 @@ void edid_set(cv4l_fd &_fd)
 	if (options[OptSetEdid] || options[OptShowEdid]) {
 		FILE *fin = nullptr;
 		bool must_fix_edid = options[OptFixEdidChecksums];
+		bool from_device;
 
 		if (file_in) {
 			if (!strcmp(file_in, "-"))
@@ -1432,103 +1608,61 @@ void edid_set(cv4l_fd &_fd)
 				std::exit(EXIT_FAILURE);
 			}
 		}
-		if (toggle_cta861_hdr_flags || phys_addr >= 0) {
-			loc = get_edid_cta861_hdr_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc] ^= toggle_cta861_hdr_flags;
-				if (phys_addr >= 0)
-					set_edid_phys_addr(sedid.edid, sedid.blocks * 128, phys_addr);
-				must_fix_edid = true;
-			}
-		}
-		if (toggle_speaker1_flags || toggle_speaker2_flags || toggle_speaker3_flags) {
-			loc = get_edid_speaker_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc] ^= toggle_speaker1_flags;
-				sedid.edid[loc + 1] ^= toggle_speaker2_flags;
-				sedid.edid[loc + 2] ^= toggle_speaker3_flags;
-				must_fix_edid = true;
-			}
-		}
-		if (toggle_hdmi_vsdb_dc_flags || toggle_hdmi_vsdb_cnc_flags) {
-			loc = get_edid_hdmi_vsdb_location(sedid.edid, sedid.blocks * 128);
-
-			if (loc >= 0) {
-				__u8 len = sedid.edid[loc] & 0x1f;
-
-				if (len >= 6) {
-					sedid.edid[loc + 6] ^= toggle_hdmi_vsdb_dc_flags;
-					must_fix_edid = true;
-				}
-				if (len >= 8) {
-					sedid.edid[loc + 8] ^= toggle_hdmi_vsdb_cnc_flags;
-					must_fix_edid = true;
-				}
-			}
-		}
-		if (toggle_hf_vsdb_flags) {
-			loc = get_edid_hf_vsdb_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc + 1] ^= toggle_hf_vsdb_flags;
-				must_fix_edid = true;
-			}
-		}
-		if (toggle_vid_cap_flags || mod_s_pt >= 0 ||
-		    mod_s_ce >= 0 || mod_s_it >= 0) {
-			loc = get_edid_vid_cap_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc] ^= toggle_vid_cap_flags;
-				if (mod_s_ce >= 0) {
-					sedid.edid[loc] &= 0xfc;
-					sedid.edid[loc] |= mod_s_ce << 0;
-				}
-				if (mod_s_it >= 0) {
-					sedid.edid[loc] &= 0xf3;
-					sedid.edid[loc] |= mod_s_it << 2;
-				}
-				if (mod_s_pt >= 0) {
-					sedid.edid[loc] &= 0xcf;
-					sedid.edid[loc] |= mod_s_pt << 4;
+		/*
+		 * If neither a type nor a file was given, then the modifiers
+		 * patch the EDID each pad currently has, block by block, instead
+		 * of requiring a full replacement EDID.
+		 */
+		from_device = !sedid.edid && !fin && have_edid_mods() &&
+			options[OptSetEdid] && !options[OptShowEdid];
+		if (sedid_pads.empty())
+			sedid_pads.push_back(sedid.pad);
+		if (from_device) {
+			for (unsigned pad : sedid_pads) {
+				struct v4l2_edid e;
+
+				if (!get_pad_edid(fd, pad, &e)) {
+					fprintf(stderr, "pad %u: failed to read the current EDID\n", pad);
+					continue;
 				}
-				must_fix_edid = true;
+				if (apply_edid_mods(&e) || must_fix_edid)
+					fix_edid(&e);
+				if (verbose)
+					print_edid_mods(&e);
+				if (verify_edid(&e))
+					set_pad_edid(fd, &e);
+				else
+					fprintf(stderr, "pad %u: EDID not set due to checksum errors\n", pad);
+				free(e.edid);
 			}
-		}
-		if (toggle_colorimetry_flags1 || toggle_colorimetry_flags2) {
-			loc = get_edid_colorimetry_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc] ^= toggle_colorimetry_flags1;
-				sedid.edid[loc + 1] ^= toggle_colorimetry_flags2;
-				must_fix_edid = true;
-			}
-		}
-		if (toggle_hdr_md_flags) {
-			loc = get_edid_hdr_md_location(sedid.edid, sedid.blocks * 128);
-			if (loc >= 0) {
-				sedid.edid[loc] ^= toggle_hdr_md_flags;
+		} else {
+			if (apply_edid_mods(&sedid))
 				must_fix_edid = true;
-			}
-		}
-		if (must_fix_edid)
-			fix_edid(&sedid);
-		if (verbose && options[OptSetEdid])
-			print_edid_mods(&sedid);
-		if (options[OptShowEdid]) {
-			for (unsigned b = 0; b < sedid.blocks; b++) {
-				if (b)
-					printf("\n");
-				for (unsigned i = 0; i < 128; i += 16) {
-					for (unsigned j = i; j < i + 16; j++) {
-						if (j > i)
-							printf(" ");
-						printf("%02x", sedid.edid[b * 128 + j]);
+			if (must_fix_edid)
+				fix_edid(&sedid);
+			if (verbose && options[OptSetEdid])
+				print_edid_mods(&sedid);
+			if (options[OptShowEdid]) {
+				for (unsigned b = 0; b < sedid.blocks; b++) {
+					if (b)
+						printf("\n");
+					for (unsigned i = 0; i < 128; i += 16) {
+						for (unsigned j = i; j < i + 16; j++) {
+							if (j > i)
+								printf(" ");
+							printf("%02x", sedid.edid[b * 128 + j]);
+						}
+						printf("\n");
 					}
-					printf("\n");
 				}
+			} else if (verify_edid(&sedid)) {
+				for (unsigned pad : sedid_pads) {
+					sedid.pad = pad;
+					set_pad_edid(fd, &sedid);
+				}
+			} else {
+				fprintf(stderr, "EDID not set due to checksum errors\n");
 			}
-		} else if (verify_edid(&sedid)) {
-			doioctl(fd, VIDIOC_S_EDID, &sedid);
-		} else {
-			fprintf(stderr, "EDID not set due to checksum errors\n");
 		}
 		if (fin) {
 			if (sedid.edid) {
@@ -1,4 +1,8 @@
 #include <endian.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "v4l2-ctl.h"
 
@@ -6,6 +10,50 @@ static struct v4l2_format vfmt;	/* set_format/get_format */
 static unsigned mbus_code;
 static unsigned mbus_code_out;
 
+/*
+ * Binary metadata log (--meta-log-to): the line-by-line printf path is
+ * slower than a high-rate metadata stream and perturbs timing-sensitive
+ * UVC clock analysis. Instead a fixed-size record per buffer is appended
+ * to a mmap'd ring file, so logging is a few stores per buffer and
+ * loss-free. The header's record counter is only bumped after the record
+ * is complete, and once the ring wraps the oldest records are
+ * overwritten. --meta-log-print parses the file offline.
+ */
+#define META_LOG_MAGIC		0x76346d6c	/* 'v4ml' */
+#define META_LOG_VERSION	1
+#define META_LOG_DEF_RECS	65536
+
+struct meta_log_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 rec_size;
+	__u32 n_recs;
+	__u64 next;		/* total records logged, slot = next % n_recs */
+};
+
+#define META_LOG_HAS_NS		(1 << 0)
+#define META_LOG_HAS_PTS	(1 << 1)
+#define META_LOG_HAS_SCR	(1 << 2)
+
+struct meta_log_rec {
+	__u64 ns;		/* hardware timestamp from the metadata */
+	__u64 ts;		/* buffer timestamp in ns */
+	__u32 sequence;
+	__u32 pts;
+	__u32 stc;
+	__u16 sof;
+	__u16 sof_counter;
+	__u8 flags;		/* UVC header flags */
+	__u8 valid;		/* META_LOG_HAS_* */
+	__u16 reserved1;
+	__u32 reserved2;
+};
+
+static char *meta_log_file;
+static unsigned meta_log_n_recs = META_LOG_DEF_RECS;
+static struct meta_log_hdr *meta_log_hdr;
+static struct meta_log_rec *meta_log_recs;
+
 void meta_usage()
 {
 	printf("\nMetadata Formats options:\n"
@@ -31,12 +79,57 @@ void meta_usage()
 	       "  --try-fmt-meta-out <f>  try the metadata output format [VIDIOC_TRY_FMT]\n"
 	       "                          parameter is either the format index as reported by\n"
 	       "                          --list-formats-meta-out, or the fourcc value as a string\n"
+	       "  --meta-log-to file=<file>[,records=<records>]\n"
+	       "                     when streaming metadata, append one fixed-size binary record\n"
+	       "                     per buffer (timestamps, SOF, PTS/SCR fields) to a mmap'd ring\n"
+	       "                     file instead of printing, so capture is loss-free\n"
+	       "                     <records> is the ring capacity, default %d\n"
+	       "  --meta-log-print <file>\n"
+	       "                     pretty-print a ring file recorded with --meta-log-to\n",
+	       META_LOG_DEF_RECS
 	       );
 }
 
+static void meta_log_print(const char *fname);
+
 void meta_cmd(int ch, char *optarg)
 {
+	char *value, *subs;
+
 	switch (ch) {
+	case OptMetaLogTo:
+		subs = optarg;
+		while (*subs != '\0') {
+			static constexpr const char *subopts[] = {
+				"file",
+				"records",
+				nullptr
+			};
+
+			switch (parse_subopt(&subs, subopts, &value)) {
+			case 0:
+				meta_log_file = value;
+				break;
+			case 1:
+				meta_log_n_recs = strtoul(value, nullptr, 0);
+				if (!meta_log_n_recs) {
+					fprintf(stderr, "records must be non-zero\n");
+					std::exit(EXIT_FAILURE);
+				}
+				break;
+			default:
+				meta_usage();
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if (!meta_log_file) {
+			fprintf(stderr, "No file given to --meta-log-to\n");
+			std::exit(EXIT_FAILURE);
+		}
+		break;
+	case OptMetaLogPrint:
+		meta_log_print(optarg);
+		std::exit(EXIT_SUCCESS);
 	case OptSetMetaFormat:
 	case OptTryMetaFormat:
 	case OptSetMetaOutFormat:
@@ -185,6 +278,126 @@ void print_meta_buffer(FILE *f, cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q)
 	}
 }
 
+static bool meta_log_open()
+{
+	size_t size = sizeof(*meta_log_hdr) +
+		meta_log_n_recs * sizeof(*meta_log_recs);
+	void *map;
+	int fd;
+
+	fd = open(meta_log_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || ftruncate(fd, size)) {
+		fprintf(stderr, "Failed to create %s: %s\n", meta_log_file,
+			strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return false;
+	}
+	map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Failed to mmap %s: %s\n", meta_log_file,
+			strerror(errno));
+		return false;
+	}
+	meta_log_hdr = static_cast<struct meta_log_hdr *>(map);
+	meta_log_recs = reinterpret_cast<struct meta_log_rec *>(meta_log_hdr + 1);
+	meta_log_hdr->magic = META_LOG_MAGIC;
+	meta_log_hdr->version = META_LOG_VERSION;
+	meta_log_hdr->rec_size = sizeof(*meta_log_recs);
+	meta_log_hdr->n_recs = meta_log_n_recs;
+	meta_log_hdr->next = 0;
+	return true;
+}
+
+void meta_log_buffer(cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q)
+{
+	struct meta_log_rec rec = {};
+	const struct uvc_meta_buf *vbuf;
+	int buf_off = 0;
+
+	if (!meta_log_hdr && !meta_log_open()) {
+		/* Opening the log failed, don't retry for every buffer */
+		options[OptMetaLogTo] = 0;
+		return;
+	}
+
+	rec.ts = buf.g_timestamp().tv_sec * 1000000000ULL +
+		buf.g_timestamp().tv_usec * 1000ULL;
+	rec.sequence = buf.g_sequence();
+
+	switch (fmt.g_pixelformat()) {
+	case V4L2_META_FMT_UVC:
+		vbuf = static_cast<uvc_meta_buf *>(q.g_dataptr(buf.g_index(), 0));
+		rec.ns = vbuf->ns;
+		rec.sof = vbuf->sof;
+		rec.flags = vbuf->flags;
+		rec.valid = META_LOG_HAS_NS;
+		if (vbuf->flags & UVC_STREAM_PTS) {
+			rec.pts = le32toh(*(__u32 *)(vbuf->buf));
+			rec.valid |= META_LOG_HAS_PTS;
+			buf_off = 4;
+		}
+		if (vbuf->flags & UVC_STREAM_SCR) {
+			rec.stc = le32toh(*(__u32 *)(vbuf->buf + buf_off));
+			rec.sof_counter = le16toh(*(__u16 *)(vbuf->buf + buf_off + 4));
+			rec.valid |= META_LOG_HAS_SCR;
+		}
+		break;
+	default:
+		/* Other formats still get the buffer timestamp and sequence */
+		break;
+	}
+
+	meta_log_recs[meta_log_hdr->next % meta_log_hdr->n_recs] = rec;
+	/* Bump the counter only once the record is complete */
+	meta_log_hdr->next++;
+}
+
+static void meta_log_print(const char *fname)
+{
+	struct meta_log_hdr hdr;
+	FILE *f = fopen(fname, "r");
+	__u64 first, i;
+
+	if (!f) {
+		fprintf(stderr, "Failed to open %s: %s\n", fname,
+			strerror(errno));
+		std::exit(EXIT_FAILURE);
+	}
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    hdr.magic != META_LOG_MAGIC || hdr.version != META_LOG_VERSION ||
+	    hdr.rec_size != sizeof(struct meta_log_rec) || !hdr.n_recs) {
+		fprintf(stderr, "%s is not a metadata log file\n", fname);
+		std::exit(EXIT_FAILURE);
+	}
+
+	first = hdr.next > hdr.n_recs ? hdr.next - hdr.n_recs : 0;
+	if (hdr.next > hdr.n_recs)
+		printf("Ring wrapped, the oldest %llu records were overwritten\n",
+		       static_cast<unsigned long long>(hdr.next - hdr.n_recs));
+	for (i = first; i < hdr.next; i++) {
+		struct meta_log_rec rec;
+
+		if (fseek(f, sizeof(hdr) + (i % hdr.n_recs) * sizeof(rec),
+			  SEEK_SET) ||
+		    fread(&rec, sizeof(rec), 1, f) != 1)
+			break;
+		printf("seq: %8u ts: %.6fs", rec.sequence,
+		       rec.ts / 1000000000.0);
+		if (rec.valid & META_LOG_HAS_NS)
+			printf(" hw: %.6fs sof: %4u flags: 0x%02x",
+			       rec.ns / 1000000000.0, rec.sof, rec.flags);
+		if (rec.valid & META_LOG_HAS_PTS)
+			printf(" PTS: %u", rec.pts);
+		if (rec.valid & META_LOG_HAS_SCR)
+			printf(" STC: %u SOF counter: %u",
+			       rec.stc, rec.sof_counter);
+		printf("\n");
+	}
+	fclose(f);
+}
+
 void meta_fillbuffer(cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q)
 {
 	struct vivid_meta_out_buf *vbuf;
@@ -70,7 +70,32 @@ static bool valid_params(int width, int height, int refresh_rate)
 #define CVT_RB_V2_MIN_V_FPORCH 1       /* lines  */
 #define CVT_RB_V_BPORCH        6       /* lines  */
 
-static int v_sync_from_aspect_ratio(int width, int height)
+/* Warnings collected by the constexpr cores below: they cannot print
+   themselves since that would bar compile-time evaluation, so the public
+   wrappers replay them via print_mode_warnings() */
+enum {
+	MODE_WARN_REFRESH = 1 << 0,
+	MODE_WARN_VLINES  = 1 << 1,
+	MODE_WARN_HPIXELS = 1 << 2,
+	MODE_WARN_ASPECT  = 1 << 3,
+};
+
+static void print_mode_warnings(unsigned warnings)
+{
+	if (warnings & MODE_WARN_REFRESH)
+		fprintf(stderr, "Warning!  Refresh rate is not CVT standard\n");
+	if (warnings & MODE_WARN_VLINES)
+		fprintf(stderr,
+		"Warning!  Vertical lines rounded to nearest integer\n");
+	if (warnings & MODE_WARN_HPIXELS)
+		fprintf(stderr,
+		"Warning!  Horizontal pixels rounded to nearest character cell\n");
+	if (warnings & MODE_WARN_ASPECT)
+		fprintf(stderr, "Warning!  Aspect ratio is not CVT Standard\n");
+}
+
+static constexpr int v_sync_from_aspect_ratio(int width, int height,
+					      unsigned &warnings)
 {
 	if (((height * 4 / 3) / CVT_CELL_GRAN) * CVT_CELL_GRAN == width)
 		return 4;
@@ -88,70 +113,52 @@ static int v_sync_from_aspect_ratio(int width, int height)
 		return 7;
 
 	/* custom aspect ratio */
-	fprintf(stderr, "Warning!  Aspect ratio is not CVT Standard\n");
+	warnings |= MODE_WARN_ASPECT;
 	return 10;
 }
 
-/**
- * calc_cvt_modeline - calculate modeline based on CVT algorithm
- *
- * This function is called to generate the timings according to CVT
- * algorithm. Timing calculation is based on VESA(TM) Coordinated
- * Video Timing Generator Rev 1.2 by  Graham Loveridge May 28, 2013
- * which can be downloaded from -
+/*
+ * The actual CVT computation, shared between the compile-time standard
+ * mode tables below and runtime custom requests. Timing calculation is
+ * based on VESA(TM) Coordinated Video Timing Generator Rev 1.2 by
+ * Graham Loveridge May 28, 2013 which can be downloaded from -
  * http://www.vesa.org/vesa-standards/free-standards/
  *
- * Input Parameters:
- * @image_width
- * @image_height
- * @refresh_rate
- * @reduced_blanking: This value, if greater than 0, indicates that
- * reduced blanking is to be used and value indicates the version.
- * @interlaced: whether to compute an interlaced mode
- * @reduced_fps: set the V4L2_DV_FL_REDUCED_FPS flag indicating that
- * the fps should be reduced by a factor of 1000 / 1001
- * @cvt: stores results of cvt timing calculation
- *
- * Returns:
- * true, if cvt timings are calculated and filled in cvt modeline.
- * false, for any error
+ * Returns the MODE_WARN_* warnings raised during the calculation.
  */
-
-bool calc_cvt_modeline(int image_width, int image_height,
-		       int refresh_rate, int reduced_blanking,
-		       bool interlaced, bool reduced_fps,
-		       struct v4l2_bt_timings *cvt)
+static constexpr unsigned cvt_modeline(int image_width, int image_height,
+				       int refresh_rate, int reduced_blanking,
+				       bool interlaced, bool reduced_fps,
+				       struct v4l2_bt_timings &cvt)
 {
-	int h_sync;
-	int v_sync;
-	int h_fp;
-	int h_bp;
-	int v_fp;
-	int v_bp;
-
-	int h_pixel;
-	int v_lines;
-	int h_pixel_rnd;
-	int v_lines_rnd;
-	int active_h_pixel;
-	int active_v_lines;
-	int total_h_pixel;
-	int total_v_lines;
-
-	int h_blank;
-	int v_blank;
-
-	int h_period;
-
-	int interlace;
-	int v_refresh;
-	int pixel_clock;
-	int clk_gran;
-	bool use_rb;
-	bool rb_v2;
-
-	if (!valid_params(image_width, image_height, refresh_rate))
-		return false;
+	unsigned warnings = 0;
+	int h_sync = 0;
+	int v_sync = 0;
+	int h_fp = 0;
+	int h_bp = 0;
+	int v_fp = 0;
+	int v_bp = 0;
+
+	int h_pixel = 0;
+	int v_lines = 0;
+	int h_pixel_rnd = 0;
+	int v_lines_rnd = 0;
+	int active_h_pixel = 0;
+	int active_v_lines = 0;
+	int total_h_pixel = 0;
+	int total_v_lines = 0;
+
+	int h_blank = 0;
+	int v_blank = 0;
+
+	int h_period = 0;
+
+	int interlace = 0;
+	int v_refresh = 0;
+	int pixel_clock = 0;
+	int clk_gran = 0;
+	bool use_rb = false;
+	bool rb_v2 = false;
 
 	use_rb = reduced_blanking > 0;
 	rb_v2 = reduced_blanking == 2;
@@ -168,7 +175,7 @@ bool calc_cvt_modeline(int image_width, int image_height,
 
 	if (v_refresh != 50 && v_refresh != 60 &&
 		v_refresh != 75 && v_refresh != 85)
-		fprintf(stderr, "Warning!  Refresh rate is not CVT standard\n");
+		warnings |= MODE_WARN_REFRESH;
 
 	if (interlaced) {
 		interlace = 1;
@@ -176,8 +183,7 @@ bool calc_cvt_modeline(int image_width, int image_height,
 		v_refresh = v_refresh * 2;
 
 		if ((v_lines_rnd * 2) != v_lines)
-			fprintf(stderr,
-			"Warning!  Vertical lines rounded to nearest integer\n");
+			warnings |= MODE_WARN_VLINES;
 	} else {
 		interlace = 0;
 		v_lines_rnd = v_lines;
@@ -186,18 +192,17 @@ bool calc_cvt_modeline(int image_width, int image_height,
 	h_pixel_rnd = h_pixel - (h_pixel % CVT_CELL_GRAN);
 
 	if (h_pixel_rnd != h_pixel)
-		fprintf(stderr,
-		"Warning!  Horizontal pixels rounded to nearest character cell\n");
+		warnings |= MODE_WARN_HPIXELS;
 
 	active_h_pixel = h_pixel_rnd;
 	active_v_lines = v_lines_rnd;
 
-	v_sync = rb_v2 ? 8 : v_sync_from_aspect_ratio(h_pixel, v_lines);
+	v_sync = rb_v2 ? 8 : v_sync_from_aspect_ratio(h_pixel, v_lines, warnings);
 
 	if (!use_rb) {
-		int tmp1, tmp2;
-		int ideal_blank_duty_cycle;
-		int v_sync_bp;
+		int tmp1 = 0, tmp2 = 0;
+		int ideal_blank_duty_cycle = 0;
+		int v_sync_bp = 0;
 
 		/* estimate the horizontal period */
 		tmp1 = HV_FACTOR * 1000000  -
@@ -242,9 +247,9 @@ bool calc_cvt_modeline(int image_width, int image_height,
 	} else {
 		/* Reduced blanking */
 
-		int vbi_lines;
-		int tmp1, tmp2;
-		int min_vbi_lines;
+		int vbi_lines = 0;
+		int tmp1 = 0, tmp2 = 0;
+		int min_vbi_lines = 0;
 
 		/* estimate horizontal period. */
 		tmp1 = HV_FACTOR * 1000000 -
@@ -287,45 +292,45 @@ bool calc_cvt_modeline(int image_width, int image_height,
 		pixel_clock -= pixel_clock  % clk_gran;
 	}
 
-	cvt->standards 	 = V4L2_DV_BT_STD_CVT;
+	cvt.standards 	 = V4L2_DV_BT_STD_CVT;
 
-	cvt->width       = h_pixel;
-	cvt->hfrontporch = h_fp;
-	cvt->hsync       = h_sync;
-	cvt->hbackporch  = h_bp;
+	cvt.width       = h_pixel;
+	cvt.hfrontporch = h_fp;
+	cvt.hsync       = h_sync;
+	cvt.hbackporch  = h_bp;
 
-	cvt->height      = v_lines;
-	cvt->vfrontporch = v_fp;
-	cvt->vsync       = v_sync;
-	cvt->vbackporch  = v_bp;
+	cvt.height      = v_lines;
+	cvt.vfrontporch = v_fp;
+	cvt.vsync       = v_sync;
+	cvt.vbackporch  = v_bp;
 
-	cvt->pixelclock = pixel_clock;
-	cvt->interlaced = interlaced == 1 ?
+	cvt.pixelclock = pixel_clock;
+	cvt.interlaced = interlaced == 1 ?
 			V4L2_DV_INTERLACED : V4L2_DV_PROGRESSIVE;
 
-	if (cvt->interlaced == V4L2_DV_INTERLACED) {
-		cvt->il_vfrontporch = v_fp;
-		cvt->il_vsync = v_sync;
-		cvt->il_vbackporch = v_bp;
+	if (cvt.interlaced == V4L2_DV_INTERLACED) {
+		cvt.il_vfrontporch = v_fp;
+		cvt.il_vsync = v_sync;
+		cvt.il_vbackporch = v_bp;
 		/* Add 1 to vbackporch of even field and set the half line
 		 * flag (V4L2_DV_FL_HALF_LINE)
 		 * For interlaced format, the half line flag indicates to the
 		 * driver to add a half-line to the vfrontporch of the odd
 		 * field and subtract a half-line from the vbackporch of the
 		 * even field */
-		cvt->flags |= V4L2_DV_FL_HALF_LINE;
-		cvt->il_vbackporch += 1;
+		cvt.flags |= V4L2_DV_FL_HALF_LINE;
+		cvt.il_vbackporch += 1;
 	}
 	if (use_rb) {
-		cvt->polarities = V4L2_DV_HSYNC_POS_POL;
-		cvt->flags |= V4L2_DV_FL_REDUCED_BLANKING;
+		cvt.polarities = V4L2_DV_HSYNC_POS_POL;
+		cvt.flags |= V4L2_DV_FL_REDUCED_BLANKING;
 	} else {
-		cvt->polarities = V4L2_DV_VSYNC_POS_POL;
+		cvt.polarities = V4L2_DV_VSYNC_POS_POL;
 	}
 	if (rb_v2 && reduced_fps && v_refresh % 6 == 0)
-		cvt->flags |= V4L2_DV_FL_REDUCED_FPS;
+		cvt.flags |= V4L2_DV_FL_REDUCED_FPS;
 
-	return true;
+	return warnings;
 }
 
 
@@ -360,71 +365,51 @@ bool calc_cvt_modeline(int image_width, int image_height,
 #define GTF_S_C_PRIME ((((GTF_S_C - GTF_S_J) * GTF_S_K) / 256) + GTF_S_J)
 #define GTF_S_M_PRIME ((GTF_S_K * GTF_S_M) / 256)
 
-/**
- * calc_gtf_modeline - calculate modeline based on GTF algorithm
- *
- * This function is called to generate the timings according to GTF
- * algorithm. Timing calculation is based on VESA(TM) Generalized
- * Timing Formula Standard Version 1.1 September 2, 1999
- * which can be downloaded from -
+/*
+ * The actual GTF computation, shared between the compile-time standard
+ * mode tables below and runtime custom requests. Timing calculation is
+ * based on VESA(TM) Generalized Timing Formula Standard Version 1.1
+ * September 2, 1999 which can be downloaded from -
  * http://www.vesa.org/vesa-standards/free-standards/
  *
- * Input Parameters:
- * @image_width
- * @image_height
- * @refresh_rate
- * @reduced_blanking: This value, if greater than 0, indicates that
- * reduced blanking is to be used.
- * @interlaced: whether to compute an interlaced mode
- * @gtf: stores results of gtf timing calculation
- *
- * Returns:
- * true, if gtf timings are calculated and filled in gtf modeline.
- * false, for any error.
+ * Returns the MODE_WARN_* warnings raised during the calculation
+ * (currently always 0, kept symmetric with cvt_modeline()).
  */
-
-bool calc_gtf_modeline(int image_width, int image_height,
-		       int refresh_rate, bool reduced_blanking,
-		       bool interlaced, struct v4l2_bt_timings *gtf)
+static constexpr unsigned gtf_modeline(int image_width, int image_height,
+				       int refresh_rate, bool reduced_blanking,
+				       bool interlaced,
+				       struct v4l2_bt_timings &gtf)
 {
-	int h_sync;
-	int v_sync;
-	int h_fp;
-	int h_bp;
-	int v_fp;
-	int v_bp;
-
-	int h_pixel;
-	int v_lines;
-	int h_pixel_rnd;
-	int v_lines_rnd;
-	int active_h_pixel;
-	int active_v_lines;
-	int total_h_pixel;
-	int total_v_lines;
-
-	int h_blank;
-	int v_blank;
-
-	int h_period;
-	int h_period_est;
-
-	int interlace;
-	int v_refresh;
-	int v_refresh_est;
-	int pixel_clock;
-
-	int v_sync_bp;
-	int tmp1, tmp2;
-	int ideal_blank_duty_cycle;
-
-	if (!gtf) {
-		fprintf(stderr, "Null pointer to gtf modeline structure\n");
-		return false;
-	}
-
-	if (!valid_params(image_width, image_height, refresh_rate))
-		return false;
+	int h_sync = 0;
+	int v_sync = 0;
+	int h_fp = 0;
+	int h_bp = 0;
+	int v_fp = 0;
+	int v_bp = 0;
+
+	int h_pixel = 0;
+	int v_lines = 0;
+	int h_pixel_rnd = 0;
+	int v_lines_rnd = 0;
+	int active_h_pixel = 0;
+	int active_v_lines = 0;
+	int total_h_pixel = 0;
+	int total_v_lines = 0;
+
+	int h_blank = 0;
+	int v_blank = 0;
+
+	int h_period = 0;
+	int h_period_est = 0;
+
+	int interlace = 0;
+	int v_refresh = 0;
+	int v_refresh_est = 0;
+	int pixel_clock = 0;
+
+	int v_sync_bp = 0;
+	int tmp1 = 0, tmp2 = 0;
+	int ideal_blank_duty_cycle = 0;
 
 	h_pixel = image_width;
 	v_lines = image_height;
@@ -498,40 +483,274 @@ bool calc_gtf_modeline(int image_width, int image_height,
 	 * truncation
 	 * */
 	/*pixel_clock -= pixel_clock  % GTF_PXL_CLK_GRAN;*/
-	gtf->standards 	 = V4L2_DV_BT_STD_GTF;
+	gtf.standards 	 = V4L2_DV_BT_STD_GTF;
 
-	gtf->width       = h_pixel;
-	gtf->hfrontporch = h_fp;
-	gtf->hsync       = h_sync;
-	gtf->hbackporch  = h_bp;
+	gtf.width       = h_pixel;
+	gtf.hfrontporch = h_fp;
+	gtf.hsync       = h_sync;
+	gtf.hbackporch  = h_bp;
 
-	gtf->height      = v_lines;
-	gtf->vfrontporch = v_fp;
-	gtf->vsync       = v_sync;
-	gtf->vbackporch  = v_bp;
+	gtf.height      = v_lines;
+	gtf.vfrontporch = v_fp;
+	gtf.vsync       = v_sync;
+	gtf.vbackporch  = v_bp;
 
-	gtf->pixelclock = pixel_clock;
-	gtf->interlaced = interlaced == 1 ?
+	gtf.pixelclock = pixel_clock;
+	gtf.interlaced = interlaced == 1 ?
 			V4L2_DV_INTERLACED : V4L2_DV_PROGRESSIVE;
 
-	if (gtf->interlaced == V4L2_DV_INTERLACED) {
-		gtf->il_vfrontporch = v_fp;
-		gtf->il_vsync = v_sync;
-		gtf->il_vbackporch = v_bp;
+	if (gtf.interlaced == V4L2_DV_INTERLACED) {
+		gtf.il_vfrontporch = v_fp;
+		gtf.il_vsync = v_sync;
+		gtf.il_vbackporch = v_bp;
 		/* Add 1 to vbackporch of even field and set the half line
 		 * flag (V4L2_DV_FL_HALF_LINE)
 		 * For interlaced format, the half line flag indicates to the
 		 * driver to add a half-line to the vfrontporch of the odd
 		 * field and subtract a half-line from the vbackporch of the
 		 * even field */
-		gtf->flags |= V4L2_DV_FL_HALF_LINE;
-		gtf->il_vbackporch += 1;
+		gtf.flags |= V4L2_DV_FL_HALF_LINE;
+		gtf.il_vbackporch += 1;
 	}
 	if (reduced_blanking) {
-		gtf->polarities = V4L2_DV_HSYNC_POS_POL;
-		gtf->flags |= V4L2_DV_FL_REDUCED_BLANKING;
+		gtf.polarities = V4L2_DV_HSYNC_POS_POL;
+		gtf.flags |= V4L2_DV_FL_REDUCED_BLANKING;
 	} else
-		gtf->polarities = V4L2_DV_VSYNC_POS_POL;
+		gtf.polarities = V4L2_DV_VSYNC_POS_POL;
+
+	return 0;
+}
+
+/*
+ * Standard mode set, computed at compile time by the very same cores
+ * that handle custom requests, so a table hit and a fresh calculation
+ * can never disagree. calc_cvt_modeline()/calc_gtf_modeline() serve
+ * these by lookup and only run the calculators for everything else
+ * (interlaced and other custom modes).
+ */
+struct cvt_gtf_mode {
+	__u16 width;
+	__u16 height;
+	__u16 refresh;
+	__u8 rbv;	/* reduced blanking version, 0 = normal blanking */
+	unsigned warnings;
+	struct v4l2_bt_timings bt;
+};
+
+static constexpr cvt_gtf_mode make_cvt(int w, int h, int r, int rb)
+{
+	cvt_gtf_mode m = {};
+
+	m.width = w;
+	m.height = h;
+	m.refresh = r;
+	m.rbv = rb;
+	m.warnings = cvt_modeline(w, h, r, rb, false, false, m.bt);
+	return m;
+}
+
+static constexpr cvt_gtf_mode make_gtf(int w, int h, int r, int rb)
+{
+	cvt_gtf_mode m = {};
+
+	m.width = w;
+	m.height = h;
+	m.refresh = r;
+	m.rbv = rb;
+	m.warnings = gtf_modeline(w, h, r, rb, false, m.bt);
+	return m;
+}
 
+/* The CVT standard refresh rates plus the reduced blanking variants */
+#define CVT_STD_MODES(w, h) \
+	make_cvt(w, h, 50, 0), make_cvt(w, h, 60, 0), \
+	make_cvt(w, h, 75, 0), make_cvt(w, h, 85, 0), \
+	make_cvt(w, h, 60, 1), make_cvt(w, h, 60, 2)
+
+#define GTF_STD_MODES(w, h) \
+	make_gtf(w, h, 50, 0), make_gtf(w, h, 60, 0), \
+	make_gtf(w, h, 75, 0), make_gtf(w, h, 85, 0), \
+	make_gtf(w, h, 60, 1)
+
+static constexpr cvt_gtf_mode standard_cvt_modes[] = {
+	CVT_STD_MODES(640, 480),
+	CVT_STD_MODES(800, 600),
+	CVT_STD_MODES(1024, 768),
+	CVT_STD_MODES(1280, 720),
+	CVT_STD_MODES(1280, 800),
+	CVT_STD_MODES(1280, 1024),
+	CVT_STD_MODES(1440, 900),
+	CVT_STD_MODES(1600, 900),
+	CVT_STD_MODES(1600, 1200),
+	CVT_STD_MODES(1920, 1080),
+	CVT_STD_MODES(1920, 1200),
+	CVT_STD_MODES(2560, 1440),
+	CVT_STD_MODES(3840, 2160),
+};
+
+static constexpr cvt_gtf_mode standard_gtf_modes[] = {
+	GTF_STD_MODES(640, 480),
+	GTF_STD_MODES(800, 600),
+	GTF_STD_MODES(1024, 768),
+	GTF_STD_MODES(1280, 720),
+	GTF_STD_MODES(1280, 800),
+	GTF_STD_MODES(1280, 1024),
+	GTF_STD_MODES(1440, 900),
+	GTF_STD_MODES(1600, 900),
+	GTF_STD_MODES(1600, 1200),
+	GTF_STD_MODES(1920, 1080),
+	GTF_STD_MODES(1920, 1200),
+	GTF_STD_MODES(2560, 1440),
+	GTF_STD_MODES(3840, 2160),
+};
+
+static const cvt_gtf_mode *find_standard_mode(const cvt_gtf_mode *modes,
+					      unsigned n_modes, int width,
+					      int height, int refresh_rate,
+					      int reduced_blanking)
+{
+	for (unsigned i = 0; i < n_modes; i++)
+		if (modes[i].width == width && modes[i].height == height &&
+		    modes[i].refresh == refresh_rate &&
+		    modes[i].rbv == reduced_blanking)
+			return &modes[i];
+	return nullptr;
+}
+
+/* Copy a precomputed mode, preserving the OR-into-flags behavior of the
+   calculators so pre-set caller flags survive */
+static void copy_standard_mode(const cvt_gtf_mode &m,
+			       struct v4l2_bt_timings *bt)
+{
+	__u32 flags = bt->flags;
+
+	print_mode_warnings(m.warnings);
+	*bt = m.bt;
+	bt->flags |= flags;
+}
+
+/**
+ * calc_cvt_modeline - calculate modeline based on CVT algorithm
+ *
+ * This function is called to generate the timings according to CVT
+ * algorithm. The standard progressive modes come from the precomputed
+ * tables above, everything else is calculated by cvt_modeline().
+ *
+ * Input Parameters:
+ * @image_width
+ * @image_height
+ * @refresh_rate
+ * @reduced_blanking: This value, if greater than 0, indicates that
+ * reduced blanking is to be used and value indicates the version.
+ * @interlaced: whether to compute an interlaced mode
+ * @reduced_fps: set the V4L2_DV_FL_REDUCED_FPS flag indicating that
+ * the fps should be reduced by a factor of 1000 / 1001
+ * @cvt: stores results of cvt timing calculation
+ *
+ * Returns:
+ * true, if cvt timings are calculated and filled in cvt modeline.
+ * false, for any error
+ */
+
+bool calc_cvt_modeline(int image_width, int image_height,
+		       int refresh_rate, int reduced_blanking,
+		       bool interlaced, bool reduced_fps,
+		       struct v4l2_bt_timings *cvt)
+{
+	if (!valid_params(image_width, image_height, refresh_rate))
+		return false;
+
+	if (!interlaced) {
+		const cvt_gtf_mode *m = find_standard_mode(standard_cvt_modes,
+				sizeof(standard_cvt_modes) /
+				sizeof(standard_cvt_modes[0]), image_width,
+				image_height, refresh_rate, reduced_blanking);
+
+		if (m) {
+			copy_standard_mode(*m, cvt);
+			/* The tables are computed without reduced_fps */
+			if (reduced_blanking == 2 && reduced_fps &&
+			    refresh_rate % 6 == 0)
+				cvt->flags |= V4L2_DV_FL_REDUCED_FPS;
+			return true;
+		}
+	}
+
+	print_mode_warnings(cvt_modeline(image_width, image_height,
+					 refresh_rate, reduced_blanking,
+					 interlaced, reduced_fps, *cvt));
+	return true;
+}
+
+/**
+ * calc_gtf_modeline - calculate modeline based on GTF algorithm
+ *
+ * This function is called to generate the timings according to GTF
+ * algorithm. The standard progressive modes come from the precomputed
+ * tables above, everything else is calculated by gtf_modeline().
+ *
+ * Input Parameters:
+ * @image_width
+ * @image_height
+ * @refresh_rate
+ * @reduced_blanking: This value, if greater than 0, indicates that
+ * reduced blanking is to be used.
+ * @interlaced: whether to compute an interlaced mode
+ * @gtf: stores results of gtf timing calculation
+ *
+ * Returns:
+ * true, if gtf timings are calculated and filled in gtf modeline.
+ * false, for any error.
+ */
+
+bool calc_gtf_modeline(int image_width, int image_height,
+		       int refresh_rate, bool reduced_blanking,
+		       bool interlaced, struct v4l2_bt_timings *gtf)
+{
+	if (!gtf) {
+		fprintf(stderr, "Null pointer to gtf modeline structure\n");
+		return false;
+	}
+
+	if (!valid_params(image_width, image_height, refresh_rate))
+		return false;
+
+	if (!interlaced) {
+		const cvt_gtf_mode *m = find_standard_mode(standard_gtf_modes,
+				sizeof(standard_gtf_modes) /
+				sizeof(standard_gtf_modes[0]), image_width,
+				image_height, refresh_rate,
+				reduced_blanking ? 1 : 0);
+
+		if (m) {
+			copy_standard_mode(*m, gtf);
+			return true;
+		}
+	}
+
+	print_mode_warnings(gtf_modeline(image_width, image_height,
+					 refresh_rate, reduced_blanking,
+					 interlaced, *gtf));
 	return true;
 }
+
+static void print_modeline(const char *algo, const cvt_gtf_mode &m)
+{
+	const struct v4l2_bt_timings &bt = m.bt;
+
+	printf("\t%s %ux%up%u rb=%u: pixelclock %llu Hz, "
+	       "hfp %u hs %u hbp %u, vfp %u vs %u vbp %u\n",
+	       algo, m.width, m.height, m.refresh, m.rbv, bt.pixelclock,
+	       bt.hfrontporch, bt.hsync, bt.hbackporch,
+	       bt.vfrontporch, bt.vsync, bt.vbackporch);
+}
+
+/* Bulk query: print every precomputed standard modeline in one go */
+void list_modelines()
+{
+	printf("Standard CVT/GTF modelines:\n");
+	for (const auto &m : standard_cvt_modes)
+		print_modeline("cvt", m);
+	for (const auto &m : standard_gtf_modes)
+		print_modeline("gtf", m);
+}
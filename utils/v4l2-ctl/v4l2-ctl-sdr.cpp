@@ -1,7 +1,21 @@
+#include <atomic>
+
+#include <csignal>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <unistd.h>
+#include <sys/select.h>
+
 #include "v4l2-ctl.h"
 
 static struct v4l2_format vfmt;	/* set_format/get_format */
 
+/* --stream-sdr-to state */
+static char *sdr_to_file;
+static unsigned sdr_to_count;
+static unsigned sdr_to_bufs = VIDEO_MAX_FRAME;
+
 void sdr_usage()
 {
 	printf("\nSDR Formats options:\n"
@@ -24,12 +38,59 @@ void sdr_usage()
 	       "                     try the SDR output format [VIDIOC_TRY_FMT]\n"
 	       "                     parameter is either the format index as reported by\n"
 	       "                     --list-formats-sdr-out, or the fourcc value as a string\n"
+	       "  --stream-sdr-to file=<file>[,count=<count>][,bufs=<bufs>]\n"
+	       "                     capture SDR samples to <file> ('-' is stdout) using a deep\n"
+	       "                     mmap queue and a separate writer thread, so a slow disk\n"
+	       "                     stalls the writer instead of VIDIOC_DQBUF\n"
+	       "                     <count> is the number of buffers to capture, default is\n"
+	       "                     to capture until interrupted\n"
+	       "                     <bufs> is the queue depth, default %d\n"
+	       "                     sample drops are detected via the buffer sequence numbers\n"
+	       "                     and reported in a final statistics block\n",
+	       VIDEO_MAX_FRAME
 	       );
 }
 
 void sdr_cmd(int ch, char *optarg)
 {
+	char *value, *subs;
+
 	switch (ch) {
+	case OptStreamSdrTo:
+		subs = optarg;
+		while (*subs != '\0') {
+			static constexpr const char *subopts[] = {
+				"file",
+				"count",
+				"bufs",
+				nullptr
+			};
+
+			switch (parse_subopt(&subs, subopts, &value)) {
+			case 0:
+				sdr_to_file = value;
+				break;
+			case 1:
+				sdr_to_count = strtoul(value, nullptr, 0);
+				break;
+			case 2:
+				sdr_to_bufs = strtoul(value, nullptr, 0);
+				if (sdr_to_bufs < 2 || sdr_to_bufs > VIDEO_MAX_FRAME) {
+					fprintf(stderr, "bufs must be between 2 and %d\n",
+						VIDEO_MAX_FRAME);
+					std::exit(EXIT_FAILURE);
+				}
+				break;
+			default:
+				sdr_usage();
+				std::exit(EXIT_FAILURE);
+			}
+		}
+		if (!sdr_to_file) {
+			fprintf(stderr, "No file given to --stream-sdr-to\n");
+			std::exit(EXIT_FAILURE);
+		}
+		break;
 	case OptSetSdrFormat:
 	case OptTrySdrFormat:
 	case OptSetSdrOutFormat:
@@ -129,3 +190,232 @@ void sdr_list(cv4l_fd &fd)
 		print_video_formats(fd, V4L2_BUF_TYPE_SDR_OUTPUT, 0);
 	}
 }
+
+/*
+ * SDR capture engine (--stream-sdr-to): at high sample rates the generic
+ * streaming loop drops samples because every buffer goes through a
+ * dequeue+write+requeue cycle on one thread. Here dequeued buffers are
+ * handed to a writer thread through a bounded ring, which writes the
+ * samples straight from the mmap'd buffers with unbuffered write() and
+ * only then requeues them, so disk latency never stalls VIDIOC_DQBUF.
+ * The ring holds VIDEO_MAX_FRAME entries and each queued buffer can
+ * occupy at most one slot, so pushing to the ring cannot fail. Drops
+ * happen only when the driver itself runs out of free buffers; those
+ * show up as buffer sequence gaps and are reported in the final
+ * statistics block.
+ */
+struct sdr_writer_ctx {
+	cv4l_fd *fd;
+	cv4l_queue *q;
+	int out_fd;
+	pthread_t thread;
+	bool running;
+	bool write_error;
+	sem_t avail;
+	std::atomic<bool> stop;
+	std::atomic<unsigned> head; /* next slot filled by the capture loop */
+	std::atomic<unsigned> tail; /* next slot consumed by the writer */
+	std::atomic<unsigned long long> bytes;
+	cv4l_buffer ring[VIDEO_MAX_FRAME];
+};
+
+static sdr_writer_ctx sdr_writer;
+
+static volatile sig_atomic_t sdr_stream_stop;
+
+static void sdr_stream_sighandler(int signum)
+{
+	sdr_stream_stop = 1;
+}
+
+static bool write_all(int fd, const unsigned char *p, size_t size)
+{
+	while (size) {
+		ssize_t written = write(fd, p, size);
+
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+static void *sdr_writer_thread(void *arg)
+{
+	sdr_writer_ctx *ctx = static_cast<sdr_writer_ctx *>(arg);
+
+	for (;;) {
+		sem_wait(&ctx->avail);
+
+		unsigned tail = ctx->tail.load(std::memory_order_relaxed);
+
+		if (tail == ctx->head.load(std::memory_order_acquire)) {
+			if (ctx->stop.load(std::memory_order_acquire))
+				break;
+			continue;
+		}
+
+		cv4l_buffer buf(ctx->ring[tail % VIDEO_MAX_FRAME]);
+
+		ctx->tail.store(tail + 1, std::memory_order_release);
+
+		if (!ctx->write_error) {
+			const unsigned char *p = static_cast<const unsigned char *>(
+				ctx->q->g_dataptr(buf.g_index(), 0));
+
+			if (!write_all(ctx->out_fd, p, buf.g_bytesused(0))) {
+				fprintf(stderr, "%s: write error: %s\n",
+					__func__, strerror(errno));
+				ctx->write_error = true;
+			}
+			ctx->bytes += buf.g_bytesused(0);
+		}
+
+		if (ctx->fd->qbuf(buf)) {
+			fprintf(stderr, "%s: qbuf error\n", __func__);
+			break;
+		}
+	}
+	return nullptr;
+}
+
+void sdr_stream(cv4l_fd &_fd)
+{
+	cv4l_queue q(V4L2_BUF_TYPE_SDR_CAPTURE, V4L2_MEMORY_MMAP);
+	unsigned long long expected_seq = 0;
+	unsigned captured = 0;
+	unsigned gaps = 0;
+	unsigned lost = 0;
+	struct timespec start_ts, end_ts;
+	int out_fd;
+
+	if (!options[OptStreamSdrTo])
+		return;
+
+	if (!strcmp(sdr_to_file, "-")) {
+		out_fd = STDOUT_FILENO;
+	} else {
+		out_fd = open(sdr_to_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out_fd < 0) {
+			fprintf(stderr, "Failed to open %s: %s\n", sdr_to_file,
+				strerror(errno));
+			return;
+		}
+	}
+
+	if (q.reqbufs(&_fd, sdr_to_bufs) || q.obtain_bufs(&_fd) ||
+	    q.queue_all(&_fd)) {
+		fprintf(stderr, "Failed to set up the SDR capture queue\n");
+		goto done_fd;
+	}
+
+	sdr_writer.fd = &_fd;
+	sdr_writer.q = &q;
+	sdr_writer.out_fd = out_fd;
+	sdr_writer.stop = false;
+	sdr_writer.write_error = false;
+	sdr_writer.head = 0;
+	sdr_writer.tail = 0;
+	sdr_writer.bytes = 0;
+	sem_init(&sdr_writer.avail, 0, 0);
+	if (pthread_create(&sdr_writer.thread, nullptr, sdr_writer_thread,
+			   &sdr_writer)) {
+		fprintf(stderr, "Failed to start the SDR writer thread\n");
+		sem_destroy(&sdr_writer.avail);
+		goto done_bufs;
+	}
+	sdr_writer.running = true;
+
+	signal(SIGINT, sdr_stream_sighandler);
+
+	if (_fd.streamon(q.g_type())) {
+		fprintf(stderr, "VIDIOC_STREAMON failed\n");
+		goto done_writer;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start_ts);
+
+	while (!sdr_stream_stop && !sdr_writer.write_error) {
+		cv4l_buffer buf(q);
+		fd_set fds;
+		struct timeval tv = { 2, 0 };
+		int res;
+
+		FD_ZERO(&fds);
+		FD_SET(_fd.g_fd(), &fds);
+		res = select(_fd.g_fd() + 1, &fds, nullptr, nullptr, &tv);
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "select error: %s\n", strerror(errno));
+			break;
+		}
+		if (res == 0) {
+			fprintf(stderr, "select timeout\n");
+			break;
+		}
+		if (_fd.dqbuf(buf)) {
+			if (errno == EAGAIN)
+				continue;
+			fprintf(stderr, "VIDIOC_DQBUF failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		if (buf.g_sequence() != expected_seq && captured) {
+			gaps++;
+			lost += buf.g_sequence() - expected_seq;
+		}
+		expected_seq = buf.g_sequence() + 1;
+
+		unsigned head = sdr_writer.head.load(std::memory_order_relaxed);
+
+		sdr_writer.ring[head % VIDEO_MAX_FRAME] = buf;
+		sdr_writer.head.store(head + 1, std::memory_order_release);
+		sem_post(&sdr_writer.avail);
+
+		captured++;
+		if (sdr_to_count && captured >= sdr_to_count)
+			break;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end_ts);
+
+	_fd.streamoff(q.g_type());
+
+done_writer:
+	signal(SIGINT, SIG_DFL);
+	if (sdr_writer.running) {
+		/* The pending ring entries are drained before the stop
+		   flag is acted upon */
+		sdr_writer.stop.store(true, std::memory_order_release);
+		sem_post(&sdr_writer.avail);
+		pthread_join(sdr_writer.thread, nullptr);
+		sem_destroy(&sdr_writer.avail);
+		sdr_writer.running = false;
+	}
+
+	if (captured) {
+		double elapsed = end_ts.tv_sec - start_ts.tv_sec +
+			(end_ts.tv_nsec - start_ts.tv_nsec) / 1000000000.0;
+		unsigned long long bytes = sdr_writer.bytes;
+
+		fprintf(stderr, "\nSDR capture statistics:\n");
+		fprintf(stderr, "\tBuffers captured: %u (%llu bytes)\n",
+			captured, bytes);
+		fprintf(stderr, "\tSequence gaps: %u (%u buffers lost)\n",
+			gaps, lost);
+		if (elapsed > 0)
+			fprintf(stderr, "\tElapsed: %.2f s, %.2f MB/s\n",
+				elapsed, bytes / elapsed / 1000000.0);
+	}
+
+done_bufs:
+	q.free(&_fd);
+done_fd:
+	if (out_fd != STDOUT_FILENO)
+		close(out_fd);
+}
@@ -1,5 +1,6 @@
 #include <cctype>
 
+#include "v4l2-dv-timings-db.h"
 #include "v4l2-ctl.h"
 
 static v4l2_std_id standard;		/* get_std/set_std */
@@ -28,6 +29,8 @@ void stds_usage()
 	       "  --list-dv-timings [<pad>]\n"
 	       "                     list supp. standard dv timings [VIDIOC_ENUM_DV_TIMINGS]\n"
 	       "                     for subdevs the pad can be specified (default is 0)\n"
+	       "  --list-modelines   list the precomputed standard CVT and GTF modelines,\n"
+	       "                     no device access is needed\n"
 	       "  --set-dv-bt-timings\n"
 	       "                     query: use the output of VIDIOC_QUERY_DV_TIMINGS\n"
 	       "                     index=<index>: use the index as provided by --list-dv-timings\n"
@@ -378,6 +381,9 @@ static void print_dv_timings(const struct v4l2_dv_timings *t)
 				bt->vfrontporch + bt->vsync + bt->vbackporch +
 				bt->il_vfrontporch + bt->il_vsync + bt->il_vbackporch);
 
+		if (const v4l2_dv_canonical_timing *canon = v4l2_dv_timing_find(bt))
+			if (v4l2_dv_timing_matches(bt, canon))
+				printf("\tCanonical timing: %s\n", canon->name);
 		printf("\tFrame format: %s\n", bt->interlaced ? "interlaced" : "progressive");
 		printf("\tPolarities: %cvsync %chsync\n",
 				(bt->polarities & V4L2_DV_VSYNC_POS_POL) ? '+' : '-',
@@ -460,6 +466,9 @@ void stds_cmd(int ch, char *optarg)
 		if (optarg)
 			list_dv_timings_pad = strtoul(optarg, nullptr, 0);
 		break;
+	case OptListModelines:
+		list_modelines();
+		break;
 	case OptGetDvTimingsCap:
 		if (optarg)
 			dv_timings_cap_pad = strtoul(optarg, nullptr, 0);
@@ -1,12 +1,22 @@
+#include <atomic>
 #include <cstring>
+#include <vector>
 
 #include <netdb.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <linux/media.h>
 
 #include "compiler.h"
 #include "v4l2-ctl.h"
+#include "v4l-ringlog.h"
 #include "v4l-stream.h"
 #include <media-info.h>
 
@@ -40,17 +50,34 @@ static unsigned reqbufs_count_cap = 4;
 static unsigned reqbufs_count_out = 4;
 static char *file_to;
 static bool to_with_hdr;
+static bool to_with_hdr_v2;
+static std::vector<__u32> hdr_v2_idx;
+static bool to_direct;
+static int to_direct_fd = -1;
+static bool direct_failed;
 static char *host_to;
 #ifndef NO_STREAM_TO
 static unsigned host_port_to = V4L_STREAM_PORT;
 static unsigned bpl_cap[VIDEO_MAX_PLANES];
+/* the datagram transport resends the FMT_VIDEO packet with every frame */
+static __u32 host_fmt_pkt[15 + 3 * VIDEO_MAX_PLANES];
+static unsigned host_fmt_words;
+static __u32 host_udp_seq;
 #endif
+static bool host_udp_to;
 static bool host_lossless;
 static int host_fd_to = -1;
 static unsigned comp_perc;
 static unsigned comp_perc_count;
 static char *file_from;
 static bool from_with_hdr;
+static bool from_with_hdr_v2;
+static unsigned stream_from_frame;
+static off_t from_hdr_data_start;
+static void *from_idx_map;
+static size_t from_idx_map_len;
+static const __u32 *from_idx;
+static unsigned from_idx_frames;
 static char *host_from;
 static unsigned host_port_from = V4L_STREAM_PORT;
 static int host_fd_from = -1;
@@ -82,6 +109,18 @@ static request_fwht fwht_reqs[VIDEO_MAX_FRAME];
 
 #define TS_WINDOW 241
 #define FILE_HDR_ID			v4l2_fourcc('V', 'h', 'd', 'r')
+/*
+ * The v2 variant of the --stream-to-hdr format (--stream-to-hdr2): the file
+ * starts with FILE_HDR_V2_ID, the frames follow in the v1 layout, and a
+ * footer index is appended when the file is closed: one entry per frame
+ * followed by the entry count and FILE_IDX_ID, so the index can be located
+ * from the end of the file. Each entry is FILE_IDX_ENTRY_WORDS u32s in
+ * network order: file offset (high and low word), record size, sequence
+ * number, timestamp seconds and microseconds.
+ */
+#define FILE_HDR_V2_ID			v4l2_fourcc('V', 'h', 'd', '2')
+#define FILE_IDX_ID			v4l2_fourcc('V', 'i', 'd', 'x')
+#define FILE_IDX_ENTRY_WORDS		6
 
 enum codec_type {
 	NOT_CODEC,
@@ -103,6 +142,7 @@ private:
 	double ts[TS_WINDOW];
 	unsigned seq[TS_WINDOW];
 	unsigned dropped_buffers;
+	unsigned dropped_total;
 	bool alternate_fields;
 	unsigned field_cnt;
 	unsigned last_field;
@@ -118,6 +158,7 @@ public:
 		full = false;
 		first = sum = 0;
 		dropped_buffers = 0;
+		dropped_total = 0;
 		last_field = 0;
 		field_cnt = 0;
 		alternate_fields = false;
@@ -128,8 +169,218 @@ public:
 	bool has_fps(bool continuous);
 	double fps();
 	unsigned dropped();
+	void add_dropped(unsigned buffers)
+	{
+		dropped_buffers += buffers;
+		dropped_total += buffers;
+	}
+	/* Unlike dropped() this is cumulative and does not reset */
+	unsigned total_dropped() const { return dropped_total; }
+};
+
+/*
+ * Benchmark mode (--stream-bench): per-frame latencies are recorded in
+ * preallocated fixed-step histograms so the capture path never allocates
+ * and adding a sample is a single increment. At the end of streaming the
+ * p50/p95/p99/max percentiles and a CSV dump of the histograms are
+ * printed, which is enough to compare kernel or driver upgrades without
+ * instrumenting the applications themselves.
+ */
+#define BENCH_BUCKET_SECS 0.00001	/* 10 us per bucket */
+#define BENCH_BUCKETS 10000		/* 100 ms histogram range */
+
+class bench_histogram {
+private:
+	unsigned buckets[BENCH_BUCKETS + 1];	/* last bucket = overflow */
+	unsigned long samples;
+	double max;
+
+public:
+	bench_histogram() { reset(); }
+
+	void reset()
+	{
+		memset(buckets, 0, sizeof(buckets));
+		samples = 0;
+		max = 0;
+	}
+
+	void add(double secs)
+	{
+		unsigned b = secs / BENCH_BUCKET_SECS;
+
+		if (b > BENCH_BUCKETS)
+			b = BENCH_BUCKETS;
+		buckets[b]++;
+		samples++;
+		if (secs > max)
+			max = secs;
+	}
+
+	double percentile(double p) const
+	{
+		unsigned long needed = samples * p;
+		unsigned long seen = 0;
+
+		for (unsigned b = 0; b <= BENCH_BUCKETS; b++) {
+			seen += buckets[b];
+			if (seen >= needed)
+				return (b + 1) * BENCH_BUCKET_SECS;
+		}
+		return max;
+	}
+
+	void print(const char *name) const
+	{
+		if (!samples) {
+			fprintf(stderr, "bench: %s: no samples\n", name);
+			return;
+		}
+		fprintf(stderr, "bench: %s: p50 %.3f ms, p95 %.3f ms, p99 %.3f ms, max %.3f ms (%lu samples)\n",
+			name, percentile(0.5) * 1000.0,
+			percentile(0.95) * 1000.0,
+			percentile(0.99) * 1000.0, max * 1000.0, samples);
+	}
+
+	void csv(const char *name) const
+	{
+		for (unsigned b = 0; b <= BENCH_BUCKETS; b++)
+			if (buckets[b])
+				fprintf(stderr, "%s,%.3f,%u\n", name,
+					b * BENCH_BUCKET_SECS * 1000.0,
+					buckets[b]);
+	}
+};
+
+static bench_histogram bench_latency;
+static bench_histogram bench_ts_delta;
+static bench_histogram bench_jitter;
+static double bench_dq_time;
+static double bench_prev_interval = -1;
+static double bench_prev_dq = -1;
+
+static double bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+/* Called right after a successful capture DQBUF */
+static void bench_add_dequeue(const cv4l_buffer &buf)
+{
+	double now = bench_now();
+
+	bench_dq_time = now;
+	if ((buf.g_flags() & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
+	    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+		double buf_ts = buf.g_timestamp().tv_sec +
+			buf.g_timestamp().tv_usec / 1000000.0;
+
+		if (now >= buf_ts)
+			bench_ts_delta.add(now - buf_ts);
+	}
+	if (bench_prev_dq >= 0) {
+		double interval = now - bench_prev_dq;
+
+		if (bench_prev_interval >= 0)
+			bench_jitter.add(interval > bench_prev_interval ?
+					 interval - bench_prev_interval :
+					 bench_prev_interval - interval);
+		bench_prev_interval = interval;
+	}
+	bench_prev_dq = now;
+}
+
+/* Called once the buffer was requeued (or handed to the writer thread) */
+static void bench_add_requeue()
+{
+	bench_latency.add(bench_now() - bench_dq_time);
+}
+
+static void bench_report()
+{
+	bench_latency.print("dequeue-to-requeue latency");
+	bench_ts_delta.print("hw-to-userspace delta");
+	bench_jitter.print("inter-frame jitter");
+	fprintf(stderr, "metric,bucket_ms,count\n");
+	bench_latency.csv("latency");
+	bench_ts_delta.csv("ts_delta");
+	bench_jitter.csv("jitter");
+}
+
+/*
+ * Queue depth tuning (--stream-tune): the capture loop samples the interval
+ * between successive dequeues. The queued buffers are what absorb scheduling
+ * jitter, so the depth that is actually needed is the worst observed stall
+ * expressed in frame periods, plus one buffer that is always owned by
+ * userspace. Together with the drop count this gives a recommendation that
+ * replaces the per-device guessing of --stream-mmap <count>.
+ */
+static double tune_prev_dq = -1;
+static double tune_sum_interval;
+static double tune_max_interval;
+static unsigned tune_samples;
+
+static void tune_reset()
+{
+	tune_prev_dq = -1;
+	tune_sum_interval = 0;
+	tune_max_interval = 0;
+	tune_samples = 0;
+}
+
+static void tune_add_dequeue()
+{
+	double now = bench_now();
+
+	if (tune_prev_dq >= 0) {
+		double interval = now - tune_prev_dq;
+
+		tune_sum_interval += interval;
+		if (interval > tune_max_interval)
+			tune_max_interval = interval;
+		tune_samples++;
+	}
+	tune_prev_dq = now;
+}
+
+static unsigned tune_recommend(unsigned cur_bufs, unsigned dropped)
+{
+	double avg = tune_sum_interval / tune_samples;
+	unsigned needed = static_cast<unsigned>(tune_max_interval / avg) + 2;
+
+	if (needed < 3)
+		needed = 3;
+	if (needed > VIDEO_MAX_FRAME)
+		needed = VIDEO_MAX_FRAME;
+	/* Drops mean the queue ran dry, so never recommend going lower
+	   than what already proved insufficient */
+	if (dropped && needed <= cur_bufs)
+		needed = cur_bufs < VIDEO_MAX_FRAME ? cur_bufs + 1 : cur_bufs;
+	fprintf(stderr, "stream-tune: avg dequeue interval %.2f ms, worst %.2f ms, %u dropped, queue depth %u, recommended %u\n",
+		avg * 1000.0, tune_max_interval * 1000.0, dropped,
+		cur_bufs, needed);
+	return needed;
+}
+
+/* Additional capture devices driven from the same streaming loop as the
+   main device (--stream-cap-device) */
+#define MAX_EXTRA_CAP_DEVICES 8
+
+struct extra_cap_dev {
+	const char *devname;
+	cv4l_fd fd;
+	cv4l_queue q;
+	cv4l_fmt fmt;
+	fps_timestamps fps_ts;
+	unsigned count;
 };
 
+static extra_cap_dev extra_cap_devs[MAX_EXTRA_CAP_DEVICES];
+static unsigned num_extra_cap_devs;
+
 void fps_timestamps::determine_field(int fd, unsigned type)
 {
 	struct v4l2_format fmt = { };
@@ -180,12 +431,14 @@ bool fps_timestamps::add_ts(double ts_secs, unsigned sequence, unsigned field)
 		if (alternate_fields) {
 			if (field_cnt == 1) {
 				dropped_buffers++;
+				dropped_total++;
 				last_field = last_field == V4L2_FIELD_TOP ?
 					V4L2_FIELD_BOTTOM : V4L2_FIELD_TOP;
 			}
 			field_cnt = 1;
 			if (field == last_field) {
 				dropped_buffers++;
+				dropped_total++;
 				field_cnt++;
 			}
 			last_field = field;
@@ -196,6 +449,7 @@ bool fps_timestamps::add_ts(double ts_secs, unsigned sequence, unsigned field)
 			if (alternate_fields)
 				dropped *= 2;
 			dropped_buffers += dropped;
+			dropped_total += dropped;
 		}
 	}
 
@@ -265,11 +519,52 @@ void streaming_usage()
 	       "                     and the --silent option is turned on automatically.\n"
 	       "  --stream-to-hdr <file> stream to this file. Same as --stream-to, but each\n"
 	       "                     frame is prefixed by a header. Use for compressed data.\n"
-	       "  --stream-to-host <hostname[:port]>\n"
+	       "  --stream-to-hdr2 <file> stream to this file. Same as --stream-to-hdr, but a\n"
+	       "                     footer index with the offset, size, sequence number and\n"
+	       "                     timestamp of every frame is appended when the file is\n"
+	       "                     closed, so frames can be looked up without scanning the\n"
+	       "                     recording (see --stream-from-frame).\n"
+	       "  --stream-to-direct <file> stream to this file. Same as --stream-to, but the\n"
+	       "                     frames are written with O_DIRECT straight from the capture\n"
+	       "                     buffers, bypassing the stdio copy and the page cache. Falls\n"
+	       "                     back to plain writes when the device or frame size does not\n"
+	       "                     meet the O_DIRECT alignment requirements.\n"
+	       "  --stream-to-host <[udp://]hostname[:port]>\n"
                "                     stream to this host. The default port is %d.\n"
+	       "                     With the udp:// prefix the frames are sent as\n"
+	       "                     datagrams: a lost datagram drops that frame instead of\n"
+	       "                     stalling all later frames behind a TCP retransmit.\n"
 	       "  --stream-lossless  always use lossless video compression.\n"
+	       "  --stream-rate-control\n"
+	       "                     adapt the compression quality of --stream-to-host to the\n"
+	       "                     link: a backed-up socket raises the quantization step by\n"
+	       "                     step and badly backlogged frames are dropped instead of\n"
+	       "                     stalling the capture loop behind the send queue.\n"
 #endif
 	       "  --stream-poll      use non-blocking mode and select() to stream.\n"
+	       "  --stream-cap-device <device>\n"
+	       "                     capture from this additional video device in the same\n"
+	       "                     streaming loop as the main device, so N cameras can be\n"
+	       "                     captured by one process with an aligned stream start.\n"
+	       "                     May be given multiple times. The frame data of the extra\n"
+	       "                     devices is discarded, only timing/drop statistics are\n"
+	       "                     kept. Implies --stream-poll.\n"
+	       "  --stream-bench     record per-frame dequeue-to-requeue latency, the delta\n"
+	       "                     between the buffer hardware timestamp and its arrival in\n"
+	       "                     userspace, and inter-frame jitter. Prints p50/p95/p99/max\n"
+	       "                     and a CSV histogram dump when streaming ends.\n"
+	       "  --stream-tune      monitor dequeue intervals and dropped buffers while\n"
+	       "                     streaming and print the recommended buffer count when the\n"
+	       "                     stream ends. Unless the frames are written somewhere the\n"
+	       "                     buffers are renegotiated to that count and the stream is\n"
+	       "                     restarted once to verify the recommendation.\n"
+	       "  --stream-write-thread\n"
+	       "                     hand buffers from --stream-to or --stream-to-host to a\n"
+	       "                     separate writer thread, so a slow disk or the FWHT\n"
+	       "                     compression of the network stream does not stall\n"
+	       "                     VIDIOC_DQBUF. Frames arriving while all ring slots are\n"
+	       "                     taken by the writer are dropped and counted as dropped\n"
+	       "                     buffers.\n"
 	       "  --stream-buf-caps  show capture buffer capabilities\n"
 	       "  --stream-show-delta-now\n"
 	       "                     output the difference between the buffer timestamp and current\n"
@@ -288,8 +583,15 @@ void streaming_usage()
 	       "                     If <file> is '-', then the data is read from stdin.\n"
 	       "  --stream-from-hdr <file> stream from this file. Same as --stream-from, but each\n"
 	       "                     frame is prefixed by a header. Use for compressed data.\n"
-	       "  --stream-from-host <hostname[:port]>\n"
+	       "                     Recordings made with --stream-to-hdr2 are detected\n"
+	       "                     automatically and their footer index is mmapped.\n"
+	       "  --stream-from-frame <frame>\n"
+	       "                     start streaming from this frame of a --stream-to-hdr2\n"
+	       "                     recording, looked up through the footer index.\n"
+	       "  --stream-from-host <[udp://]hostname[:port]>\n"
 	       "                     stream from this host. The default port is %d.\n"
+	       "                     With the udp:// prefix datagrams are received on the\n"
+	       "                     port and incompletely received frames are dropped.\n"
 	       "  --stream-no-query  Do not query and set the DV timings or standard before streaming.\n"
 	       "  --stream-loop      loop when the end of the file we are streaming from is reached.\n"
 	       "                     The default is to stop.\n"
@@ -457,10 +759,8 @@ static void write_u32(FILE *f, __u32 v)
 	fwrite(&v, 1, sizeof(v), f);
 }
 
-static std::string timestamp_type2s(__u32 flags)
+static const char *timestamp_type2s(__u32 flags, char *buf, size_t len)
 {
-	char buf[20];
-
 	switch (flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) {
 	case V4L2_BUF_FLAG_TIMESTAMP_UNKNOWN:
 		return "Unknown";
@@ -469,40 +769,42 @@ static std::string timestamp_type2s(__u32 flags)
 	case V4L2_BUF_FLAG_TIMESTAMP_COPY:
 		return "Copy";
 	default:
-		sprintf(buf, "Type %d", (flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) >> 13);
-		return std::string(buf);
+		snprintf(buf, len, "Type %d", (flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) >> 13);
+		return buf;
 	}
 }
 
-static std::string timestamp_src2s(__u32 flags)
+static const char *timestamp_src2s(__u32 flags, char *buf, size_t len)
 {
-	char buf[20];
-
 	switch (flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) {
 	case V4L2_BUF_FLAG_TSTAMP_SRC_EOF:
 		return "End-of-Frame";
 	case V4L2_BUF_FLAG_TSTAMP_SRC_SOE:
 		return "Start-of-Exposure";
 	default:
-		sprintf(buf, "Source %d", (flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) >> 16);
-		return std::string(buf);
+		snprintf(buf, len, "Source %d", (flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) >> 16);
+		return buf;
 	}
 }
 
 static void print_buffer(FILE *f, struct v4l2_buffer &buf)
 {
 	const unsigned ts_flags = V4L2_BUF_FLAG_TIMESTAMP_MASK | V4L2_BUF_FLAG_TSTAMP_SRC_MASK;
+	char b1[256];
+	char b2[32];
+	char b3[32];
 
 	fprintf(f, "\tIndex    : %d\n", buf.index);
-	fprintf(f, "\tType     : %s\n", buftype2s(buf.type).c_str());
-	fprintf(f, "\tFlags    : %s\n", bufferflags2s(buf.flags & ~ts_flags).c_str());
-	fprintf(f, "\tField    : %s\n", field2s(buf.field).c_str());
+	fprintf(f, "\tType     : %s\n", buftype2s(b1, sizeof(b1), buf.type));
+	fprintf(f, "\tFlags    : %s\n", bufferflags2s(b1, sizeof(b1), buf.flags & ~ts_flags));
+	fprintf(f, "\tField    : %s\n", field2s(b1, sizeof(b1), buf.field));
 	fprintf(f, "\tSequence : %u\n", buf.sequence);
 	fprintf(f, "\tLength   : %u\n", buf.length);
 	fprintf(f, "\tBytesused: %u\n", buf.bytesused);
 	fprintf(f, "\tTimestamp: %llu.%06llus (%s, %s)\n",
 		static_cast<__u64>(buf.timestamp.tv_sec), static_cast<__u64>(buf.timestamp.tv_usec),
-		timestamp_type2s(buf.flags).c_str(), timestamp_src2s(buf.flags).c_str());
+		timestamp_type2s(buf.flags, b2, sizeof(b2)),
+		timestamp_src2s(buf.flags, b3, sizeof(b3)));
 	if (buf.flags & V4L2_BUF_FLAG_TIMECODE) {
 		static constexpr int fps_types[] = { 0, 24, 25, 30, 50, 60 };
 		int fps = buf.timecode.type;
@@ -511,7 +813,7 @@ static void print_buffer(FILE *f, struct v4l2_buffer &buf)
 			fps = 0;
 		fprintf(f, "\tTimecode : %dfps %s %dh %dm %ds %df (0x%02x 0x%02x 0x%02x 0x%02x)\n",
 			fps_types[fps],
-			tc_flags2s(buf.timecode.flags).c_str(),
+			tc_flags2s(b1, sizeof(b1), buf.timecode.flags),
 			buf.timecode.hours, buf.timecode.minutes,
 			buf.timecode.seconds, buf.timecode.frames,
 			buf.timecode.userbits[0], buf.timecode.userbits[1],
@@ -538,48 +840,56 @@ static void print_concise_buffer(FILE *f, cv4l_buffer &buf, cv4l_fmt &fmt,
 {
 	static double last_ts;
 
-	fprintf(f, "%s dqbuf: %*u seq: %6u bytesused: ",
+	/*
+	 * Per-frame lines go through the ring buffer logger so that at
+	 * high frame rates the stdio locking and terminal flushes do
+	 * not perturb the timing being measured.
+	 */
+	if (!v4l_ringlog_active() && !v4l_ringlog_start(f, 0, 0))
+		atexit(v4l_ringlog_stop);
+
+	v4l_ringlog_print("%s dqbuf: %*u seq: %6u bytesused: ",
 		v4l_type_is_output(buf.g_type()) ? "out" : "cap",
 		reqbufs_count_cap > 10 ? 2 : 1, buf.g_index(), buf.g_sequence());
 
 	bool have_data_offset = false;
 
 	for (unsigned i = 0; i < buf.g_num_planes(); i++) {
-		fprintf(f, "%s%u", i ? "/" : "", buf.g_bytesused(i));
+		v4l_ringlog_print("%s%u", i ? "/" : "", buf.g_bytesused(i));
 		if (buf.g_data_offset(i))
 			have_data_offset = true;
 	}
 	if (have_data_offset) {
-		fprintf(f, " offset: ");
+		v4l_ringlog_print(" offset: ");
 		for (unsigned i = 0; i < buf.g_num_planes(); i++)
-			fprintf(f, "%s%u", i ? "/" : "", buf.g_data_offset(i));
+			v4l_ringlog_print("%s%u", i ? "/" : "", buf.g_data_offset(i));
 	}
 	if (comp_perc >= 0)
-		fprintf(f, " compression: %d%%", comp_perc);
+		v4l_ringlog_print(" compression: %d%%", comp_perc);
 
 	if (!skip_ts && (buf.g_flags() & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_COPY) {
 		double ts = buf.g_timestamp().tv_sec + buf.g_timestamp().tv_usec / 1000000.0;
-		fprintf(f, " ts: %.06f", ts);
+		v4l_ringlog_print(" ts: %.06f", ts);
 		if (last_ts != 0.0)
-			fprintf(f, " delta: %.03f ms", (ts - last_ts) * 1000.0);
+			v4l_ringlog_print(" delta: %.03f ms", (ts - last_ts) * 1000.0);
 		if (options[OptStreamShowDeltaNow] &&
 		    (buf.g_flags() & V4L2_BUF_FLAG_TIMESTAMP_MASK) ==
 		    V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
 			timespec ts_clock;
 
 			clock_gettime(CLOCK_MONOTONIC, &ts_clock);
-			fprintf(f, " delta now: %+.03f ms",
+			v4l_ringlog_print(" delta now: %+.03f ms",
 				((ts_clock.tv_sec + ts_clock.tv_nsec / 1000000000.0) - ts) * 1000.0);
 		}
 		last_ts = ts;
 
 		if (fps_ts.has_fps(true))
-			fprintf(stderr, " fps: %.02f", fps_ts.fps());
+			v4l_ringlog_print(" fps: %.02f", fps_ts.fps());
 
 		unsigned dropped = fps_ts.dropped();
 
 		if (dropped)
-			fprintf(stderr, " dropped: %u", dropped);
+			v4l_ringlog_print(" dropped: %u", dropped);
 	}
 
 	__u32 fl = buf.g_flags() & (V4L2_BUF_FLAG_ERROR |
@@ -590,9 +900,12 @@ static void print_concise_buffer(FILE *f, cv4l_buffer &buf, cv4l_fmt &fmt,
 				    V4L2_BUF_FLAG_TIMESTAMP_MASK |
 				    V4L2_BUF_FLAG_TSTAMP_SRC_MASK |
 				    V4L2_BUF_FLAG_TIMECODE);
-	if (fl)
-		fprintf(f, " (%s)", bufferflags2s(fl).c_str());
-	fprintf(f, "\n");
+	if (fl) {
+		char flagsbuf[256];
+
+		v4l_ringlog_print(" (%s)", bufferflags2s(flagsbuf, sizeof(flagsbuf), fl));
+	}
+	v4l_ringlog_print("\n");
 	if (v4l_type_is_meta(buf.g_type()) && buf.g_bytesused(0) &&
 	    !(buf.g_flags() & V4L2_BUF_FLAG_ERROR))
 		print_meta_buffer(f, buf, fmt, q);
@@ -747,6 +1060,32 @@ void streaming_cmd(int ch, char *optarg)
 		if (!strcmp(file_to, "-"))
 			options[OptSilent] = true;
 		break;
+	case OptStreamToHdr2:
+		file_to = optarg;
+		to_with_hdr = true;
+		to_with_hdr_v2 = true;
+		if (!strcmp(file_to, "-")) {
+			fprintf(stderr, "--stream-to-hdr2 cannot write to stdout\n");
+			std::exit(EXIT_FAILURE);
+		}
+		break;
+	case OptStreamCapDevice:
+		if (num_extra_cap_devs == MAX_EXTRA_CAP_DEVICES) {
+			fprintf(stderr, "too many --stream-cap-device options, max %d\n",
+				MAX_EXTRA_CAP_DEVICES);
+			std::exit(EXIT_FAILURE);
+		}
+		extra_cap_devs[num_extra_cap_devs++].devname = optarg;
+		break;
+	case OptStreamToDirect:
+		file_to = optarg;
+		to_with_hdr = false;
+		to_direct = true;
+		if (!strcmp(file_to, "-")) {
+			fprintf(stderr, "--stream-to-direct cannot write to stdout\n");
+			std::exit(EXIT_FAILURE);
+		}
+		break;
 	case OptStreamToHost:
 		host_to = optarg;
 		break;
@@ -761,6 +1100,9 @@ void streaming_cmd(int ch, char *optarg)
 		file_from = optarg;
 		from_with_hdr = true;
 		break;
+	case OptStreamFromFrame:
+		stream_from_frame = strtoul(optarg, nullptr, 0);
+		break;
 	case OptStreamFromHost:
 		host_from = optarg;
 		break;
@@ -1005,7 +1347,10 @@ static bool fill_buffer_from_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &b,
 				break;
 			}
 
-			fprintf(stderr, "expected FRAME_VIDEO, got 0x%08x\n", packet);
+			/* the datagram transport sends the format every frame */
+			if (packet != V4L_STREAM_PACKET_FMT_VIDEO)
+				fprintf(stderr, "expected FRAME_VIDEO, got 0x%08x\n",
+					packet);
 			while (sz) {
 				unsigned rdsize = sz > sizeof(buf) ? sizeof(buf) : sz;
 
@@ -1028,9 +1373,13 @@ static bool fill_buffer_from_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &b,
 		read_u32(fin);  // ignore flags
 		for (unsigned j = 0; j < q.g_num_planes(); j++) {
 			__u8 *buf = static_cast<__u8 *>(q.g_dataptr(b.g_index(), j));
+			bool has_crc = false;
+			__u32 crc = 0;
 
 			sz = read_u32(fin);
-			if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR) {
+			if (sz == V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR)
+				has_crc = true;
+			else if (sz != V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR_V2) {
 				fprintf(stderr, "unsupported FRAME_VIDEO plane size\n");
 				return false;
 			}
@@ -1040,6 +1389,8 @@ static bool fill_buffer_from_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &b,
 			unsigned sz = comp_size;
 			__u8 *read_buf = buf;
 
+			if (has_crc)
+				crc = read_u32(fin);
 			if (is_fwht) {
 				read_buf = new __u8[comp_size];
 				offset = 0;
@@ -1050,6 +1401,43 @@ static bool fill_buffer_from_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &b,
 					size, q.g_length(j));
 				return false;
 			}
+
+			if (!is_fwht && comp_size != size) {
+				/*
+				 * Feed the RLE decompressor straight from the
+				 * socket, so decompression overlaps the
+				 * network transfer and works in cache-sized
+				 * chunks instead of a second full pass over
+				 * the plane.
+				 */
+				struct rle_dec_stream rds;
+				__u8 chunk[16384];
+				__u32 c = ~0U;
+
+				rle_decompress_stream_init(&rds, buf, size,
+							   bpl_out[j]);
+				while (sz) {
+					unsigned rd = sz > sizeof(chunk) ?
+						      sizeof(chunk) : sz;
+					int n = fread(chunk, 1, rd, fin);
+
+					if (n <= 0) {
+						fprintf(stderr, "error reading %d bytes\n",
+							sz);
+						return false;
+					}
+					if (has_crc)
+						c = v4l_stream_crc32c_raw(c, chunk, n);
+					rle_decompress_stream(&rds, chunk, n);
+					sz -= n;
+				}
+				if (has_crc && (c ^ 0xffffffff) != crc)
+					fprintf(stderr, "crc mismatch\n");
+				continue;
+			}
+
+			__u8 *comp_data = read_buf + offset;
+
 			while (sz) {
 				int n = fread(read_buf + offset, 1, sz, fin);
 				if (n < 0) {
@@ -1061,6 +1449,13 @@ static bool fill_buffer_from_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &b,
 				offset += n;
 				sz -= n;
 			}
+			if (has_crc && v4l_stream_crc32c(comp_data, comp_size) != crc) {
+				/* drop the plane rather than decode corrupt data */
+				fprintf(stderr, "crc mismatch, plane dropped\n");
+				if (is_fwht)
+					delete [] read_buf;
+				continue;
+			}
 			if (is_fwht) {
 				fwht_decompress(ctx, read_buf, comp_size, buf, size);
 				delete [] read_buf;
@@ -1081,13 +1476,23 @@ restart:
 				return false;
 			}
 			if (stream_loop) {
-				fseek(fin, 0, SEEK_SET);
+				fseeko(fin, from_hdr_data_start, SEEK_SET);
 				first = true;
 				goto restart;
 			}
 			return false;
 		}
 		if (ntohl(v) != FILE_HDR_ID) {
+			/* In a v2 recording the first word that is not a
+			   frame header is the start of the footer index */
+			if (from_with_hdr_v2) {
+				if (stream_loop) {
+					fseeko(fin, from_hdr_data_start, SEEK_SET);
+					first = true;
+					goto restart;
+				}
+				return false;
+			}
 			fprintf(stderr, "Unknown header ID\n");
 			return false;
 		}
@@ -1131,7 +1536,7 @@ restart:
 			return false;
 		}
 		if (j == 0 && sz == 0 && stream_loop) {
-			fseek(fin, 0, SEEK_SET);
+			fseeko(fin, from_hdr_data_start, SEEK_SET);
 			first = true;
 			goto restart;
 		}
@@ -1231,6 +1636,15 @@ static int do_setup_out_buffers(cv4l_fd &fd, cv4l_queue &q, FILE *fin, bool qbuf
 			stream_out_refresh = true;
 	}
 
+	/*
+	 * A static pattern without alternating fields produces identical
+	 * content in every output buffer, so the TPG only has to render the
+	 * first buffer and the others can be cloned from it. At 4K this
+	 * cuts the time from reqbufs to streamon considerably.
+	 */
+	bool clone_pattern = is_video && can_fill && !output_field_alt &&
+			     !stream_out_refresh && !fin;
+
 	for (unsigned i = 0; i < q.g_buffers(); i++) {
 		cv4l_buffer buf(q);
 
@@ -1253,8 +1667,14 @@ static int do_setup_out_buffers(cv4l_fd &fd, cv4l_queue &q, FILE *fin, bool qbuf
 			}
 
 			if (can_fill) {
-				for (unsigned j = 0; j < q.g_num_planes(); j++)
-					tpg_fillbuffer(&tpg, stream_out_std, j, static_cast<u8 *>(q.g_dataptr(i, j)));
+				for (unsigned j = 0; j < q.g_num_planes(); j++) {
+					if (clone_pattern && i)
+						memcpy(q.g_dataptr(i, j),
+						       q.g_dataptr(0, j),
+						       q.g_length(j));
+					else
+						tpg_fillbuffer(&tpg, stream_out_std, j, static_cast<u8 *>(q.g_dataptr(i, j)));
+				}
 			}
 		}
 		if (is_meta)
@@ -1316,17 +1736,108 @@ static int do_setup_out_buffers(cv4l_fd &fd, cv4l_queue &q, FILE *fin, bool qbuf
 	return 0;
 }
 
+#ifndef NO_STREAM_TO
+/*
+ * --stream-to-direct: write the plane with O_DIRECT straight from the
+ * mmap'd capture buffer, bypassing both the stdio copy and the page
+ * cache. O_DIRECT requires the memory address, the file offset and the
+ * transfer size to be logical-block aligned; capture planes are page
+ * aligned and plane sizes are nearly always a multiple of the block
+ * size, so whole frames normally qualify. The first time the kernel
+ * refuses a write (EINVAL) O_DIRECT is dropped for the rest of the
+ * recording and plain writes take over.
+ */
+static void write_plane_direct(__u8 *p, __u32 used)
+{
+	while (used) {
+		ssize_t sz = write(to_direct_fd, p, used);
+
+		if (sz < 0 && errno == EINVAL && !direct_failed) {
+			direct_failed = true;
+			fcntl(to_direct_fd, F_SETFL,
+			      fcntl(to_direct_fd, F_GETFL) & ~O_DIRECT);
+			fprintf(stderr, "O_DIRECT alignment not met, using plain writes\n");
+			continue;
+		}
+		if (sz <= 0) {
+			fprintf(stderr, "direct write failed: %s\n",
+				strerror(errno));
+			break;
+		}
+		p += sz;
+		used -= sz;
+	}
+}
+
+/*
+ * Send a whole iovec over the socket, resuming after partial writes.
+ * A frame packet normally goes on the wire with a single writev()
+ * straight from the codec buffer instead of being copied into the
+ * stdio buffer one header word and payload at a time.
+ */
+static bool write_all_iov(int fd, struct iovec *iov, unsigned niov)
+{
+	while (niov) {
+		ssize_t ret = writev(fd, iov, niov);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		while (niov && static_cast<size_t>(ret) >= iov[0].iov_len) {
+			ret -= iov[0].iov_len;
+			iov++;
+			niov--;
+		}
+		if (niov) {
+			iov[0].iov_base = static_cast<__u8 *>(iov[0].iov_base) + ret;
+			iov[0].iov_len -= ret;
+		}
+	}
+	return true;
+}
+#endif
+
 static void write_buffer_to_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &buf,
 				 cv4l_fmt &fmt, FILE *fout)
 {
 #ifndef NO_STREAM_TO
 	unsigned comp_size[VIDEO_MAX_PLANES];
 	__u8 *comp_ptr[VIDEO_MAX_PLANES];
+	off_t v2_off = 0;
+
+	if (to_direct_fd >= 0) {
+		for (unsigned j = 0; j < buf.g_num_planes(); j++) {
+			__u32 used = buf.g_bytesused(j);
+			unsigned offset = buf.g_data_offset(j);
+
+			if (offset > used)
+				offset = 0;
+			write_plane_direct(static_cast<__u8 *>(q.g_dataptr(buf.g_index(), j)) + offset,
+					   used - offset);
+		}
+		return;
+	}
 
 	if (host_fd_to >= 0) {
 		unsigned tot_comp_size = 0;
 		unsigned tot_used = 0;
-
+		__u32 hdrs[5 + 4 * VIDEO_MAX_PLANES];
+		struct iovec iov[2 + 2 * VIDEO_MAX_PLANES];
+		unsigned nhdrs = 0;
+		unsigned niov = 0;
+		unsigned hdr_iov;
+
+		/* the link is badly backlogged: drop the frame to catch up */
+		if (ctx && !fwht_rate_begin(ctx))
+			return;
+		if (host_udp_to) {
+			/* any datagram can get lost, so the format goes first */
+			iov[niov].iov_base = host_fmt_pkt;
+			iov[niov].iov_len = host_fmt_words * sizeof(__u32);
+			niov++;
+		}
 		for (unsigned j = 0; j < buf.g_num_planes(); j++) {
 			__u32 used = buf.g_bytesused(j);
 			unsigned offset = buf.g_data_offset(j);
@@ -1343,15 +1854,68 @@ static void write_buffer_to_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &buf,
 			tot_comp_size += comp_size[j];
 			tot_used += used - offset;
 		}
-		write_u32(fout, ctx ? V4L_STREAM_PACKET_FRAME_VIDEO_FWHT :
-				V4L_STREAM_PACKET_FRAME_VIDEO_RLE);
-		write_u32(fout, V4L_STREAM_PACKET_FRAME_VIDEO_SIZE(buf.g_num_planes()) + tot_comp_size);
-		write_u32(fout, V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR);
-		write_u32(fout, buf.g_field());
-		write_u32(fout, buf.g_flags());
+		hdrs[nhdrs++] = htonl(ctx ? V4L_STREAM_PACKET_FRAME_VIDEO_FWHT :
+				      V4L_STREAM_PACKET_FRAME_VIDEO_RLE);
+		hdrs[nhdrs++] = htonl(V4L_STREAM_PACKET_FRAME_VIDEO_SIZE(buf.g_num_planes()) + tot_comp_size);
+		hdrs[nhdrs++] = htonl(V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_HDR);
+		hdrs[nhdrs++] = htonl(buf.g_field());
+		hdrs[nhdrs++] = htonl(buf.g_flags());
+		hdr_iov = niov;
+		iov[niov].iov_base = hdrs;
+		iov[niov].iov_len = nhdrs * sizeof(__u32);
+		niov++;
+		for (unsigned j = 0; j < buf.g_num_planes(); j++) {
+			__u32 used = buf.g_bytesused(j);
+			unsigned offset = buf.g_data_offset(j);
+
+			if (offset > used) {
+				// Should never happen
+				fprintf(stderr, "offset %d > used %d!\n",
+					offset, used);
+				offset = 0;
+			}
+			used -= offset;
+			/*
+			 * The plane header words are contiguous in hdrs[], so
+			 * the first plane's header rides along with the packet
+			 * header in iov[0].
+			 */
+			hdrs[nhdrs++] = htonl(V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR);
+			hdrs[nhdrs++] = htonl(used);
+			hdrs[nhdrs++] = htonl(comp_size[j]);
+			hdrs[nhdrs++] = htonl(v4l_stream_crc32c(comp_ptr[j] + offset,
+								comp_size[j]));
+			if (j == 0)
+				iov[hdr_iov].iov_len = nhdrs * sizeof(__u32);
+			else {
+				iov[niov].iov_base = &hdrs[nhdrs - 4];
+				iov[niov].iov_len = 4 * sizeof(__u32);
+				niov++;
+			}
+			iov[niov].iov_base = comp_ptr[j] + offset;
+			iov[niov].iov_len = comp_size[j];
+			niov++;
+		}
 		comp_perc += (tot_comp_size * 100 / tot_used);
 		comp_perc_count++;
+		if (ctx)
+			fwht_rate_done(ctx, tot_comp_size);
+		if (host_udp_to) {
+			if (!v4l_stream_udp_send(host_fd_to, host_udp_seq++,
+						 iov, niov))
+				fprintf(stderr, "send to host failed: %s\n",
+					strerror(errno));
+			return;
+		}
+		/* anything still in the stdio buffer must go out first */
+		fflush(fout);
+		if (!write_all_iov(host_fd_to, iov, niov))
+			fprintf(stderr, "send to host failed: %s\n",
+				strerror(errno));
+		return;
 	}
+	if (to_with_hdr_v2)
+		v2_off = ftello(fout);
 	if (to_with_hdr)
 		write_u32(fout, FILE_HDR_ID);
 	for (unsigned j = 0; j < buf.g_num_planes(); j++) {
@@ -1366,18 +1930,10 @@ static void write_buffer_to_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &buf,
 			offset = 0;
 		}
 		used -= offset;
-		if (host_fd_to >= 0) {
-			write_u32(fout, V4L_STREAM_PACKET_FRAME_VIDEO_SIZE_PLANE_HDR);
-			write_u32(fout, used);
-			write_u32(fout, comp_size[j]);
-			used = comp_size[j];
-		} else if (to_with_hdr) {
+		if (to_with_hdr)
 			write_u32(fout, used);
-		}
-		if (host_fd_to >= 0)
-			sz = fwrite(comp_ptr[j] + offset, 1, used, fout);
-		else if (codec_type != NOT_CODEC && support_cap_compose &&
-			 v4l2_fwht_find_pixfmt(fmt.g_pixelformat()))
+		if (codec_type != NOT_CODEC && support_cap_compose &&
+		    v4l2_fwht_find_pixfmt(fmt.g_pixelformat()))
 			read_write_padded_frame(fmt, static_cast<u8 *>(q.g_dataptr(buf.g_index(), j)) + offset,
 						fout, sz, used, used, false);
 		else
@@ -1386,18 +1942,156 @@ static void write_buffer_to_file(cv4l_fd &fd, cv4l_queue &q, cv4l_buffer &buf,
 		if (sz != used)
 			fprintf(stderr, "%u != %u\n", sz, used);
 	}
-	if (host_fd_to >= 0)
-		fflush(fout);
+	if (to_with_hdr_v2) {
+		hdr_v2_idx.push_back(v2_off >> 32);
+		hdr_v2_idx.push_back(v2_off & 0xffffffff);
+		hdr_v2_idx.push_back(ftello(fout) - v2_off);
+		hdr_v2_idx.push_back(buf.g_sequence());
+		hdr_v2_idx.push_back(buf.g_timestamp().tv_sec);
+		hdr_v2_idx.push_back(buf.g_timestamp().tv_usec);
+	}
 #endif
 }
 
+/* Append the footer index of a --stream-to-hdr2 recording. Called just
+   before the file is closed; until then an interrupted recording is still
+   readable with a linear scan since the frame records match the v1 layout. */
+static void hdr_v2_write_index(FILE *fout)
+{
+	if (!to_with_hdr_v2 || !fout || fout == stdout)
+		return;
+	for (__u32 v : hdr_v2_idx)
+		write_u32(fout, v);
+	write_u32(fout, hdr_v2_idx.size() / FILE_IDX_ENTRY_WORDS);
+	write_u32(fout, FILE_IDX_ID);
+	hdr_v2_idx.clear();
+}
+
+/*
+ * Writer thread support (--stream-write-thread): dequeued buffers are handed
+ * to a separate thread through a bounded single-producer single-consumer
+ * ring, so a slow disk stalls the writer instead of VIDIOC_DQBUF. For
+ * --stream-to-host this moves the FWHT compression off the capture thread
+ * as well, and since the ring is FIFO and drained by a single thread the
+ * frames still hit the socket in capture order (which also keeps the
+ * codec's reference frame state consistent). A buffer is only requeued once
+ * the writer is done with it; when no ring slot is free the frame is
+ * dropped (and accounted for in the fps statistics) rather than blocking
+ * the capture loop.
+ */
+struct writer_thread_ctx {
+	cv4l_fd *fd;
+	cv4l_queue *q;
+	cv4l_fmt fmt;
+	FILE *fout;
+	pthread_t thread;
+	bool running;
+	sem_t avail;
+	std::atomic<bool> stop;
+	std::atomic<unsigned> head; /* next slot filled by the capture loop */
+	std::atomic<unsigned> tail; /* next slot consumed by the writer */
+	unsigned depth;
+	cv4l_buffer ring[VIDEO_MAX_FRAME];
+};
+
+static writer_thread_ctx writer_ctx;
+
+static void *writer_thread(void *arg)
+{
+	writer_thread_ctx *ctx = static_cast<writer_thread_ctx *>(arg);
+
+	for (;;) {
+		sem_wait(&ctx->avail);
+
+		unsigned tail = ctx->tail.load(std::memory_order_relaxed);
+
+		if (tail == ctx->head.load(std::memory_order_acquire)) {
+			if (ctx->stop.load(std::memory_order_acquire))
+				break;
+			continue;
+		}
+
+		cv4l_buffer buf(ctx->ring[tail % VIDEO_MAX_FRAME]);
+
+		ctx->tail.store(tail + 1, std::memory_order_release);
+
+		write_buffer_to_file(*ctx->fd, *ctx->q, buf, ctx->fmt,
+				     ctx->fout);
+
+		/*
+		 * Just as in do_handle_cap EINVAL can happen if this was the
+		 * last buffer before a dynamic resolution change sequence.
+		 */
+		if (ctx->fd->qbuf(buf) && errno != EINVAL) {
+			fprintf(stderr, "%s: qbuf error\n", __func__);
+			break;
+		}
+	}
+	return nullptr;
+}
+
+static bool writer_start(cv4l_fd &fd, cv4l_queue &q, cv4l_fmt &fmt, FILE *fout)
+{
+	if (!options[OptStreamWriteThread] || !fout)
+		return false;
+
+	writer_ctx.fd = &fd;
+	writer_ctx.q = &q;
+	writer_ctx.fmt = fmt;
+	writer_ctx.fout = fout;
+	writer_ctx.stop = false;
+	writer_ctx.head = 0;
+	writer_ctx.tail = 0;
+	/* Keep at least two buffers with the driver at all times */
+	writer_ctx.depth = q.g_buffers() > 3 ? q.g_buffers() - 2 : 1;
+	if (writer_ctx.depth > VIDEO_MAX_FRAME)
+		writer_ctx.depth = VIDEO_MAX_FRAME;
+	sem_init(&writer_ctx.avail, 0, 0);
+	if (pthread_create(&writer_ctx.thread, nullptr, writer_thread,
+			   &writer_ctx)) {
+		fprintf(stderr, "failed to start writer thread\n");
+		sem_destroy(&writer_ctx.avail);
+		return false;
+	}
+	writer_ctx.running = true;
+	return true;
+}
+
+static void writer_stop()
+{
+	if (!writer_ctx.running)
+		return;
+	writer_ctx.stop.store(true, std::memory_order_release);
+	sem_post(&writer_ctx.avail);
+	pthread_join(writer_ctx.thread, nullptr);
+	sem_destroy(&writer_ctx.avail);
+	writer_ctx.running = false;
+}
+
+static bool writer_push(cv4l_buffer &buf)
+{
+	unsigned head = writer_ctx.head.load(std::memory_order_relaxed);
+
+	if (head - writer_ctx.tail.load(std::memory_order_acquire) >=
+	    writer_ctx.depth)
+		return false;
+	writer_ctx.ring[head % VIDEO_MAX_FRAME] = buf;
+	writer_ctx.head.store(head + 1, std::memory_order_release);
+	sem_post(&writer_ctx.avail);
+	return true;
+}
+
+/*
+ * buf is owned by the caller and reused across calls so the descriptor
+ * (including its plane array) is not rebuilt for every frame. The caller
+ * must (re)init it from q whenever the queue is (re)configured.
+ */
 static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 			 unsigned &count, fps_timestamps &fps_ts, cv4l_fmt &fmt,
-			 bool ignore_count_skip)
+			 bool ignore_count_skip, cv4l_buffer &buf)
 {
 	char ch = '<';
 	int ret;
-	cv4l_buffer buf(q);
 
 	for (;;) {
 		ret = fd.dqbuf(buf);
@@ -1421,15 +2115,38 @@ static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 			return QUEUE_ERROR;
 	}
 
+	if (options[OptStreamBench])
+		bench_add_dequeue(buf);
+	if (options[OptStreamTune])
+		tune_add_dequeue();
+
 	bool is_empty_frame = !buf.g_bytesused(0);
 	bool is_error_frame = buf.g_flags() & V4L2_BUF_FLAG_ERROR;
+	bool deferred = false;
 
 	double ts_secs = buf.g_timestamp().tv_sec + buf.g_timestamp().tv_usec / 1000000.0;
 	fps_ts.add_ts(ts_secs, buf.g_sequence(), buf.g_field());
 
-	if (fout && (!stream_skip || ignore_count_skip) &&
+	if (options[OptMetaLogTo] && v4l_type_is_meta(buf.g_type()) &&
 	    !is_empty_frame && !is_error_frame)
-		write_buffer_to_file(fd, q, buf, fmt, fout);
+		meta_log_buffer(buf, fmt, q);
+
+	if (fout && (!stream_skip || ignore_count_skip) &&
+	    !is_empty_frame && !is_error_frame) {
+		if (writer_ctx.running && index == nullptr && !last_buffer) {
+			deferred = writer_push(buf);
+			/* The writer is behind and owns all ring slots, drop
+			   the frame instead of stalling VIDIOC_DQBUF */
+			if (!deferred)
+				fps_ts.add_dropped(1);
+		} else {
+			/* Drain the writer first so the final buffer cannot
+			   overtake frames that are still queued for it */
+			if (writer_ctx.running && last_buffer)
+				writer_stop();
+			write_buffer_to_file(fd, q, buf, fmt, fout);
+		}
+	}
 
 	if (buf.g_flags() & V4L2_BUF_FLAG_KEYFRAME)
 		ch = 'K';
@@ -1438,11 +2155,14 @@ static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 	else if (buf.g_flags() & V4L2_BUF_FLAG_BFRAME)
 		ch = 'B';
 	if (verbose) {
+		/* comp_perc_count can be 0 when the writer thread has not
+		   compressed a frame yet */
 		print_concise_buffer(stderr, buf, fmt, q, fps_ts,
-				     host_fd_to >= 0 ? 100 - comp_perc / comp_perc_count : -1);
+				     host_fd_to >= 0 && comp_perc_count ?
+				     100 - comp_perc / comp_perc_count : -1);
 		comp_perc_count = comp_perc = 0;
 	}
-	if (!last_buffer && index == nullptr) {
+	if (!last_buffer && !deferred && index == nullptr) {
 		/*
 		 * EINVAL in qbuf can happen if this is the last buffer before
 		 * a dynamic resolution change sequence. In this case the buffer
@@ -1457,6 +2177,9 @@ static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 	if (index)
 		*index = buf.g_index();
 
+	if (options[OptStreamBench])
+		bench_add_requeue();
+
 	if (!verbose) {
 		fprintf(stderr, "%c", ch);
 		fflush(stderr);
@@ -1467,7 +2190,7 @@ static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 			fprintf(stderr, " %.02f fps", fps_ts.fps());
 			if (dropped)
 				fprintf(stderr, ", dropped buffers: %u", dropped);
-			if (host_fd_to >= 0)
+			if (host_fd_to >= 0 && comp_perc_count)
 				fprintf(stderr, " %d%% compression", 100 - comp_perc / comp_perc_count);
 			comp_perc_count = comp_perc = 0;
 			fprintf(stderr, "\n");
@@ -1498,11 +2221,11 @@ static int do_handle_cap(cv4l_fd &fd, cv4l_queue &q, FILE *fout, int *index,
 	return 0;
 }
 
+/* As with do_handle_cap, buf is a caller-owned reusable descriptor for q */
 static int do_handle_out(cv4l_fd &fd, cv4l_queue &q, FILE *fin, cv4l_buffer *cap,
 			 unsigned &count, fps_timestamps &fps_ts, cv4l_fmt fmt,
-			 bool stopped, bool ignore_count_skip)
+			 bool stopped, bool ignore_count_skip, cv4l_buffer &buf)
 {
-	cv4l_buffer buf(q);
 	bool is_meta = q.g_type() == V4L2_BUF_TYPE_META_OUTPUT;
 	int ret = 0;
 
@@ -1680,14 +2403,38 @@ static FILE *open_output_file(cv4l_fd &fd)
 	if (file_to) {
 		if (!strcmp(file_to, "-"))
 			return stdout;
+		if (to_direct) {
+			to_direct_fd = open(file_to, O_WRONLY | O_CREAT |
+					    O_TRUNC | O_DIRECT, 0666);
+			direct_failed = false;
+			if (to_direct_fd < 0) {
+				fprintf(stderr, "could not open %s for direct writing: %s\n",
+					file_to, strerror(errno));
+				return nullptr;
+			}
+			/* Only used as a handle by the callers, all writes
+			   bypass stdio through to_direct_fd */
+			return fdopen(to_direct_fd, "w");
+		}
 		fout = fopen(file_to, "w+");
-		if (!fout)
+		if (!fout) {
 			fprintf(stderr, "could not open %s for writing\n", file_to);
+			return fout;
+		}
+		if (to_with_hdr_v2) {
+			write_u32(fout, FILE_HDR_V2_ID);
+			hdr_v2_idx.clear();
+		}
 		return fout;
 	}
 	if (!host_to)
 		return nullptr;
 
+	if (!strncmp(host_to, "udp://", 6)) {
+		host_udp_to = true;
+		host_to += 6;
+	}
+
 	char *p = std::strchr(host_to, ':');
 	struct sockaddr_in serv_addr;
 	struct hostent *server;
@@ -1702,7 +2449,7 @@ static FILE *open_output_file(cv4l_fd &fd)
 		host_port_to = strtoul(p + 1, nullptr, 0);
 		*p = '\0';
 	}
-	host_fd_to = socket(AF_INET, SOCK_STREAM, 0);
+	host_fd_to = socket(AF_INET, host_udp_to ? SOCK_DGRAM : SOCK_STREAM, 0);
 	if (host_fd_to < 0) {
 		fprintf(stderr, "cannot open socket");
 		std::exit(EXIT_SUCCESS);
@@ -1722,30 +2469,48 @@ static FILE *open_output_file(cv4l_fd &fd)
 		fprintf(stderr, "could not connect\n");
 		std::exit(EXIT_SUCCESS);
 	}
+	if (!host_udp_to) {
+		/*
+		 * Each frame packet is sent with a single writev(), header and
+		 * payload together, so Nagle's algorithm only adds latency
+		 * here.
+		 */
+		int nodelay = 1;
+		setsockopt(host_fd_to, IPPROTO_TCP, TCP_NODELAY,
+			   &nodelay, sizeof(nodelay));
+	}
 	fout = fdopen(host_fd_to, "a");
-	write_u32(fout, V4L_STREAM_ID);
-	write_u32(fout, V4L_STREAM_VERSION);
-	write_u32(fout, V4L_STREAM_PACKET_FMT_VIDEO);
-	write_u32(fout, V4L_STREAM_PACKET_FMT_VIDEO_SIZE(cfmt.g_num_planes()));
-	write_u32(fout, V4L_STREAM_PACKET_FMT_VIDEO_SIZE_FMT);
-	write_u32(fout, cfmt.g_num_planes());
-	write_u32(fout, cfmt.g_pixelformat());
-	write_u32(fout, cfmt.g_width());
-	write_u32(fout, cfmt.g_height());
-	write_u32(fout, cfmt.g_field());
-	write_u32(fout, cfmt.g_colorspace());
-	write_u32(fout, cfmt.g_ycbcr_enc());
-	write_u32(fout, cfmt.g_quantization());
-	write_u32(fout, cfmt.g_xfer_func());
-	write_u32(fout, cfmt.g_flags());
-	write_u32(fout, aspect.numerator);
-	write_u32(fout, aspect.denominator);
+	/*
+	 * Build the FMT_VIDEO packet. TCP sends it once up front, the
+	 * datagram transport prepends it to every frame instead.
+	 */
+	host_fmt_words = 0;
+	host_fmt_pkt[host_fmt_words++] = htonl(V4L_STREAM_PACKET_FMT_VIDEO);
+	host_fmt_pkt[host_fmt_words++] = htonl(V4L_STREAM_PACKET_FMT_VIDEO_SIZE(cfmt.g_num_planes()));
+	host_fmt_pkt[host_fmt_words++] = htonl(V4L_STREAM_PACKET_FMT_VIDEO_SIZE_FMT);
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_num_planes());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_pixelformat());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_width());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_height());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_field());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_colorspace());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_ycbcr_enc());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_quantization());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_xfer_func());
+	host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_flags());
+	host_fmt_pkt[host_fmt_words++] = htonl(aspect.numerator);
+	host_fmt_pkt[host_fmt_words++] = htonl(aspect.denominator);
 	for (unsigned i = 0; i < cfmt.g_num_planes(); i++) {
-		write_u32(fout, V4L_STREAM_PACKET_FMT_VIDEO_SIZE_FMT_PLANE);
-		write_u32(fout, cfmt.g_sizeimage(i));
-		write_u32(fout, cfmt.g_bytesperline(i));
+		host_fmt_pkt[host_fmt_words++] = htonl(V4L_STREAM_PACKET_FMT_VIDEO_SIZE_FMT_PLANE);
+		host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_sizeimage(i));
+		host_fmt_pkt[host_fmt_words++] = htonl(cfmt.g_bytesperline(i));
 		bpl_cap[i] = rle_calc_bpl(cfmt.g_bytesperline(i), cfmt.g_pixelformat());
 	}
+	if (!host_udp_to) {
+		write_u32(fout, V4L_STREAM_ID);
+		write_u32(fout, V4L_STREAM_VERSION);
+		fwrite(host_fmt_pkt, sizeof(__u32), host_fmt_words, fout);
+	}
 	if (!host_lossless) {
 		unsigned visible_width = support_cap_compose ? composed_width : cfmt.g_width();
 		unsigned visible_height = support_cap_compose ? composed_height : cfmt.g_height();
@@ -1754,24 +2519,137 @@ static FILE *open_output_file(cv4l_fd &fd)
 				 cfmt.g_width(), cfmt.g_height(),
 				 cfmt.g_field(), cfmt.g_colorspace(), cfmt.g_xfer_func(),
 				 cfmt.g_ycbcr_enc(), cfmt.g_quantization());
+		if (ctx && options[OptStreamRateControl])
+			fwht_rate_control(ctx, host_fd_to);
 	}
 	fflush(fout);
 #endif
 	return fout;
 }
 
+/*
+ * Open and prepare the --stream-cap-device devices so that after the main
+ * device all of them can be started back to back, aligning the start of
+ * the streams as closely as one process can.
+ */
+static bool extra_cap_devs_prepare()
+{
+	for (unsigned i = 0; i < num_extra_cap_devs; i++) {
+		extra_cap_dev &dev = extra_cap_devs[i];
+
+		if (dev.fd.open(dev.devname, true) < 0) {
+			fprintf(stderr, "cannot open %s: %s\n",
+				dev.devname, strerror(errno));
+			return false;
+		}
+		dev.fd.s_trace(0);
+		dev.q.init(dev.fd.g_type(), memory);
+		if (dev.q.reqbufs(&dev.fd, reqbufs_count_cap) ||
+		    dev.q.obtain_bufs(&dev.fd) ||
+		    dev.q.queue_all(&dev.fd)) {
+			fprintf(stderr, "%s: failed to setup buffers\n",
+				dev.devname);
+			return false;
+		}
+		dev.fd.g_fmt(dev.fmt);
+		dev.fps_ts.reset();
+		dev.fps_ts.determine_field(dev.fd.g_fd(), dev.q.g_type());
+		dev.count = 0;
+	}
+	return true;
+}
+
+static bool extra_cap_devs_streamon()
+{
+	for (unsigned i = 0; i < num_extra_cap_devs; i++)
+		if (extra_cap_devs[i].fd.streamon()) {
+			fprintf(stderr, "%s: streamon failed\n",
+				extra_cap_devs[i].devname);
+			return false;
+		}
+	return true;
+}
+
+static int extra_cap_dev_handle(extra_cap_dev &dev)
+{
+	cv4l_buffer buf(dev.q);
+	int ret = dev.fd.dqbuf(buf);
+
+	if (ret == EAGAIN)
+		return 0;
+	if (ret) {
+		fprintf(stderr, "%s: VIDIOC_DQBUF failed: %s\n",
+			dev.devname, strerror(errno));
+		return -1;
+	}
+
+	double ts_secs = buf.g_timestamp().tv_sec +
+		buf.g_timestamp().tv_usec / 1000000.0;
+	dev.fps_ts.add_ts(ts_secs, buf.g_sequence(), buf.g_field());
+	dev.count++;
+
+	if (dev.fd.qbuf(buf)) {
+		fprintf(stderr, "%s: qbuf error\n", dev.devname);
+		return -1;
+	}
+
+	if (!verbose && dev.fps_ts.has_fps()) {
+		unsigned dropped = dev.fps_ts.dropped();
+
+		fprintf(stderr, "\n%s: %.02f fps", dev.devname,
+			dev.fps_ts.fps());
+		if (dropped)
+			fprintf(stderr, ", dropped buffers: %u", dropped);
+		fprintf(stderr, "\n");
+	}
+	return 0;
+}
+
+/* Stop all extra capture devices and print the combined drop report;
+   primary_dropped is the cumulative drop count of the main device */
+static void extra_cap_devs_stop(unsigned primary_dropped)
+{
+	unsigned total = primary_dropped;
+	bool any_open = false;
+
+	for (unsigned i = 0; i < num_extra_cap_devs; i++)
+		if (extra_cap_devs[i].fd.g_fd() >= 0)
+			any_open = true;
+	if (!any_open)
+		return;
+
+	for (unsigned i = 0; i < num_extra_cap_devs; i++) {
+		extra_cap_dev &dev = extra_cap_devs[i];
+
+		if (dev.fd.g_fd() < 0)
+			continue;
+		dev.fd.streamoff();
+		dev.q.free(&dev.fd);
+		dev.fd.close();
+		fprintf(stderr, "%s: captured %u buffers, dropped %u\n",
+			dev.devname, dev.count, dev.fps_ts.total_dropped());
+		total += dev.fps_ts.total_dropped();
+	}
+	fprintf(stderr, "total dropped buffers over %u devices: %u\n",
+		num_extra_cap_devs + 1, total);
+}
+
 static void streaming_set_cap(cv4l_fd &fd, cv4l_fd &exp_fd)
 {
 	int fd_flags = fcntl(fd.g_fd(), F_GETFL);
 	cv4l_queue q(fd.g_type(), memory);
 	cv4l_queue exp_q(exp_fd.g_type(), V4L2_MEMORY_MMAP);
 	fps_timestamps fps_ts;
-	bool use_poll = options[OptStreamPoll];
+	/* Extra capture devices need the non-blocking select loop so one
+	   slow device cannot stall the others */
+	bool use_poll = options[OptStreamPoll] || num_extra_cap_devs;
 	unsigned count;
+	unsigned tune_rounds = 0;
 	bool eos;
 	bool source_change;
 	FILE *fout = nullptr;
 	cv4l_fmt fmt;
+	cv4l_buffer cap_buf;
 
 	if (!(capabilities & (V4L2_CAP_VIDEO_CAPTURE | V4L2_CAP_VIDEO_CAPTURE_MPLANE |
 			      V4L2_CAP_VBI_CAPTURE | V4L2_CAP_SLICED_VBI_CAPTURE |
@@ -1804,6 +2682,7 @@ recover:
 	eos = false;
 	source_change = false;
 	count = 0;
+	tune_reset();
 
 	if (!stream_no_query) {
 		cv4l_disable_trace dt(fd);
@@ -1851,14 +2730,26 @@ recover:
 
 	fps_ts.determine_field(fd.g_fd(), q.g_type());
 
+	if (!extra_cap_devs_prepare())
+		goto done;
+
+	/* All devices are fully prepared at this point, so the streamons
+	   happen back to back to align the stream starts */
 	if (fd.streamon())
 		goto done;
 
+	if (!extra_cap_devs_streamon())
+		goto done;
+
 	fd.s_trace(0);
 	exp_fd.s_trace(0);
 
 	fd.g_fmt(fmt);
 
+	writer_start(fd, q, fmt, fout);
+
+	cap_buf.init(q);
+
 	while (stream_sleep == 0)
 		sleep(100);
 
@@ -1869,13 +2760,21 @@ recover:
 		fd_set read_fds;
 		fd_set exception_fds;
 		struct timeval tv = { use_poll ? 2 : 0, 0 };
+		int max_fd = fd.g_fd();
 		int r;
 
 		FD_ZERO(&exception_fds);
 		FD_SET(fd.g_fd(), &exception_fds);
 		FD_ZERO(&read_fds);
 		FD_SET(fd.g_fd(), &read_fds);
-		r = select(fd.g_fd() + 1, use_poll ? &read_fds : nullptr, nullptr, &exception_fds, &tv);
+		for (unsigned i = 0; i < num_extra_cap_devs; i++) {
+			int efd = extra_cap_devs[i].fd.g_fd();
+
+			FD_SET(efd, &read_fds);
+			if (efd > max_fd)
+				max_fd = efd;
+		}
+		r = select(max_fd + 1, use_poll ? &read_fds : nullptr, nullptr, &exception_fds, &tv);
 
 		if (r == -1) {
 			if (EINTR == errno)
@@ -1913,15 +2812,47 @@ recover:
 
 		if (FD_ISSET(fd.g_fd(), &read_fds)) {
 			r = do_handle_cap(fd, q, fout, nullptr,
-					  count, fps_ts, fmt, false);
+					  count, fps_ts, fmt, false, cap_buf);
 			if (r < 0)
 				break;
 		}
 
+		bool extra_error = false;
+
+		for (unsigned i = 0; i < num_extra_cap_devs; i++)
+			if (FD_ISSET(extra_cap_devs[i].fd.g_fd(), &read_fds) &&
+			    extra_cap_dev_handle(extra_cap_devs[i]) < 0) {
+				extra_error = true;
+				break;
+			}
+		if (extra_error)
+			break;
 	}
+	writer_stop();
 	fd.streamoff();
 	fcntl(fd.g_fd(), F_SETFL, fd_flags);
 	fprintf(stderr, "\n");
+	if (options[OptStreamBench])
+		bench_report();
+	extra_cap_devs_stop(fps_ts.total_dropped());
+
+	if (options[OptStreamTune] && tune_samples) {
+		unsigned rec = tune_recommend(q.g_buffers(),
+					      fps_ts.total_dropped());
+
+		/* Renegotiate between sessions: free the buffers, request
+		   the recommended count and restart the stream. Only done
+		   once, and not when the frames go somewhere, since a
+		   restart would redo the output from scratch */
+		if (rec != q.g_buffers() && !eos && !fout &&
+		    tune_rounds++ == 0) {
+			fprintf(stderr, "stream-tune: restarting with %u buffers\n", rec);
+			reqbufs_count_cap = rec;
+			q.free(&fd);
+			tpg_free(&tpg);
+			goto recover;
+		}
+	}
 
 	q.free(&fd);
 	tpg_free(&tpg);
@@ -1929,15 +2860,100 @@ recover:
 		goto recover;
 
 done:
+	writer_stop();
+	extra_cap_devs_stop(fps_ts.total_dropped());
 	if (options[OptStreamDmaBuf])
 		exp_q.close_exported_fds();
 	if (fout && fout != stdout) {
-		if (host_fd_to >= 0)
+		if (host_udp_to) {
+			__u32 end = htonl(V4L_STREAM_PACKET_END);
+			struct iovec iov = { &end, sizeof(end) };
+
+			v4l_stream_udp_send(host_fd_to, host_udp_seq++, &iov, 1);
+		} else if (host_fd_to >= 0)
 			write_u32(fout, V4L_STREAM_PACKET_END);
+		hdr_v2_write_index(fout);
 		fclose(fout);
+		to_direct_fd = -1;
 	}
 }
 
+/*
+ * Recognize the indexed v2 variant of the --stream-to-hdr format and mmap
+ * its footer index, so the --stream-from-frame start frame is an O(1)
+ * lookup instead of a linear scan through a multi-GB recording.
+ */
+static void open_input_hdr_v2(FILE *fin)
+{
+	long pagesz = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	__u32 trailer[2];
+	off_t idx_off, pg_off;
+
+	if (read_u32(fin) != FILE_HDR_V2_ID) {
+		fseek(fin, 0, SEEK_SET);
+		return;
+	}
+	from_with_hdr = from_with_hdr_v2 = true;
+	from_hdr_data_start = ftello(fin);
+
+	if (fstat(fileno(fin), &st))
+		goto out;
+	if (fseeko(fin, -static_cast<off_t>(sizeof(trailer)), SEEK_END) ||
+	    fread(trailer, 1, sizeof(trailer), fin) != sizeof(trailer))
+		goto out;
+	/* No trailer means the recording was interrupted before the footer
+	   was appended; the frames can still be read sequentially */
+	if (ntohl(trailer[1]) != FILE_IDX_ID)
+		goto out;
+	from_idx_frames = ntohl(trailer[0]);
+	idx_off = st.st_size - sizeof(trailer) -
+		  static_cast<off_t>(from_idx_frames) * FILE_IDX_ENTRY_WORDS * sizeof(__u32);
+	if (idx_off < from_hdr_data_start) {
+		from_idx_frames = 0;
+		goto out;
+	}
+	pg_off = idx_off & ~static_cast<off_t>(pagesz - 1);
+	from_idx_map_len = st.st_size - pg_off;
+	from_idx_map = mmap(nullptr, from_idx_map_len, PROT_READ, MAP_PRIVATE,
+			    fileno(fin), pg_off);
+	if (from_idx_map == MAP_FAILED) {
+		from_idx_map = nullptr;
+		from_idx_frames = 0;
+		goto out;
+	}
+	from_idx = reinterpret_cast<const __u32 *>(
+		static_cast<const __u8 *>(from_idx_map) + (idx_off - pg_off));
+
+out:
+	if (stream_from_frame) {
+		if (from_idx && stream_from_frame < from_idx_frames) {
+			const __u32 *e = from_idx +
+				static_cast<size_t>(stream_from_frame) * FILE_IDX_ENTRY_WORDS;
+
+			from_hdr_data_start = (static_cast<off_t>(ntohl(e[0])) << 32) |
+					      ntohl(e[1]);
+		} else {
+			fprintf(stderr, "cannot start at frame %u: %s\n",
+				stream_from_frame,
+				from_idx ? "beyond the last indexed frame" :
+					   "the recording has no footer index");
+		}
+	}
+	fseeko(fin, from_hdr_data_start, SEEK_SET);
+}
+
+static void hdr_v2_from_close()
+{
+	if (from_idx_map)
+		munmap(from_idx_map, from_idx_map_len);
+	from_idx_map = nullptr;
+	from_idx = nullptr;
+	from_idx_frames = 0;
+	from_with_hdr_v2 = false;
+	from_hdr_data_start = 0;
+}
+
 static FILE *open_input_file(cv4l_fd &fd, __u32 type)
 {
 	FILE *fin = nullptr;
@@ -1946,13 +2962,21 @@ static FILE *open_input_file(cv4l_fd &fd, __u32 type)
 		if (!strcmp(file_from, "-"))
 			return stdin;
 		fin = fopen(file_from, "r");
-		if (!fin)
+		if (!fin) {
 			fprintf(stderr, "could not open %s for reading\n", file_from);
+			return fin;
+		}
+		open_input_hdr_v2(fin);
 		return fin;
 	}
 	if (!host_from)
 		return nullptr;
 
+	bool host_udp_from = !strncmp(host_from, "udp://", 6);
+
+	if (host_udp_from)
+		host_from += 6;
+
 	char *p = std::strchr(host_from, ':');
 	int listen_fd;
 	socklen_t clilen;
@@ -1962,7 +2986,7 @@ static FILE *open_input_file(cv4l_fd &fd, __u32 type)
 		host_port_from = strtoul(p + 1, nullptr, 0);
 		*p = '\0';
 	}
-	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	listen_fd = socket(AF_INET, host_udp_from ? SOCK_DGRAM : SOCK_STREAM, 0);
 	if (listen_fd < 0) {
 		fprintf(stderr, "could not opening socket\n");
 		std::exit(EXIT_FAILURE);
@@ -1974,20 +2998,26 @@ static FILE *open_input_file(cv4l_fd &fd, __u32 type)
 		fprintf(stderr, "could not bind\n");
 		std::exit(EXIT_FAILURE);
 	}
-	listen(listen_fd, 1);
-	clilen = sizeof(cli_addr);
-	host_fd_from = accept(listen_fd, reinterpret_cast<struct sockaddr *>(&cli_addr), &clilen);
-	if (host_fd_from < 0) {
-		fprintf(stderr, "could not accept\n");
-		std::exit(EXIT_FAILURE);
+	if (host_udp_from) {
+		host_fd_from = listen_fd;
+		fin = v4l_stream_udp_fopen(host_fd_from);
+	} else {
+		listen(listen_fd, 1);
+		clilen = sizeof(cli_addr);
+		host_fd_from = accept(listen_fd, reinterpret_cast<struct sockaddr *>(&cli_addr), &clilen);
+		if (host_fd_from < 0) {
+			fprintf(stderr, "could not accept\n");
+			std::exit(EXIT_FAILURE);
+		}
+		fin = fdopen(host_fd_from, "r");
 	}
-	fin = fdopen(host_fd_from, "r");
 	if (read_u32(fin) != V4L_STREAM_ID) {
 		fprintf(stderr, "unknown protocol ID\n");
 		std::exit(EXIT_FAILURE);
 	}
-	if (read_u32(fin) != V4L_STREAM_VERSION) {
-		fprintf(stderr, "unknown protocol version\n");
+	__u32 version = read_u32(fin);
+	if (!version || version > V4L_STREAM_VERSION) {
+		fprintf(stderr, "unknown protocol version %u\n", version);
 		std::exit(EXIT_FAILURE);
 	}
 	for (;;) {
@@ -2076,6 +3106,7 @@ static void streaming_set_out(cv4l_fd &fd, cv4l_fd &exp_fd)
 	bool stopped = false;
 	FILE *fin = nullptr;
 	cv4l_fmt fmt;
+	cv4l_buffer out_buf;
 
 	fd.g_fmt(fmt);
 
@@ -2135,6 +3166,8 @@ static void streaming_set_out(cv4l_fd &fd, cv4l_fd &exp_fd)
 	fd.s_trace(0);
 	exp_fd.s_trace(0);
 
+	out_buf.init(q);
+
 	while (stream_sleep == 0)
 		sleep(100);
 
@@ -2171,7 +3204,7 @@ static void streaming_set_out(cv4l_fd &fd, cv4l_fd &exp_fd)
 			}
 		}
 		r = do_handle_out(fd, q, fin, nullptr,
-				  count, fps_ts, fmt, stopped, false);
+				  count, fps_ts, fmt, stopped, false, out_buf);
 		if (r == QUEUE_STOPPED)
 			stopped = true;
 		if (r < 0)
@@ -2193,8 +3226,10 @@ static void streaming_set_out(cv4l_fd &fd, cv4l_fd &exp_fd)
 done:
 	if (options[OptStreamOutDmaBuf])
 		exp_q.close_exported_fds();
-	if (fin && fin != stdin)
+	if (fin && fin != stdin) {
+		hdr_v2_from_close();
 		fclose(fin);
+	}
 }
 
 enum stream_type {
@@ -2263,6 +3298,8 @@ static void stateful_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 	fd_set *ex_fds = &fds[1]; /* for capture */
 	fd_set *wr_fds = &fds[2]; /* for output */
 	bool cap_streaming = false;
+	cv4l_buffer cap_buf;
+	cv4l_buffer out_buf;
 	static struct v4l2_encoder_cmd enc_stop = {
 		.cmd = V4L2_ENC_CMD_STOP,
 	};
@@ -2308,6 +3345,9 @@ static void stateful_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 		if (capture_setup(fd, in, exp_fd_p))
 			return;
 
+	cap_buf.init(in);
+	out_buf.init(out);
+
 	fps_ts[CAP].determine_field(fd.g_fd(), in.g_type());
 	fps_ts[OUT].determine_field(fd.g_fd(), out.g_type());
 
@@ -2366,7 +3406,7 @@ static void stateful_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 		if (rd_fds && FD_ISSET(fd.g_fd(), rd_fds)) {
 			r = do_handle_cap(fd, in, fin, nullptr,
 					  count[CAP], fps_ts[CAP], fmt_in,
-					  ignore_count_skip);
+					  ignore_count_skip, cap_buf);
 			if (r == QUEUE_STOPPED)
 				break;
 			if (r < 0) {
@@ -2381,7 +3421,7 @@ static void stateful_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 		if (wr_fds && FD_ISSET(fd.g_fd(), wr_fds)) {
 			r = do_handle_out(fd, out, fout, nullptr,
 					  count[OUT], fps_ts[OUT], fmt_out, stopped,
-					  !ignore_count_skip);
+					  !ignore_count_skip, out_buf);
 			if (r == QUEUE_STOPPED) {
 				stopped = true;
 				if (have_eos) {
@@ -2431,6 +3471,8 @@ static void stateful_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 				last_buffer = false;
 				if (capture_setup(fd, in, exp_fd_p, &fmt_in))
 					return;
+				/* The capture queue was rebuilt with the new format */
+				cap_buf.init(in);
 				fps_ts[CAP].reset();
 				fps_ts[OUT].reset();
 				cap_streaming = true;
@@ -2499,98 +3541,133 @@ static void stateless_m2m(cv4l_fd &fd, cv4l_queue &in, cv4l_queue &out,
 	int index = 0;
 	bool queue_lst_buf = false;
 	cv4l_buffer last_in_buf;
+	cv4l_buffer cap_buf(in);
+	cv4l_buffer out_buf(out);
 
 	fcntl(fd.g_fd(), F_SETFL, fd_flags | O_NONBLOCK);
 
 	while (true) {
-		fd_set except_fds;
-		int req_fd = fwht_reqs[index].fd;
-		struct timeval tv = { 2, 0 };
+		struct pollfd pfds[VIDEO_MAX_FRAME];
+		unsigned nfds = 0;
 
-		if (req_fd < 0)
+		if (fwht_reqs[index].fd < 0)
 			break;
 
-		FD_ZERO(&except_fds);
-		FD_SET(req_fd, &except_fds);
+		/*
+		 * Poll the whole pool of in-flight requests at once instead
+		 * of waiting on them one frame at a time, so the decoder
+		 * pipeline stays as deep as the number of output buffers.
+		 */
+		for (unsigned i = 0; i < out.g_buffers(); i++) {
+			if (fwht_reqs[i].fd < 0)
+				continue;
+			pfds[nfds].fd = fwht_reqs[i].fd;
+			pfds[nfds].events = POLLPRI;
+			pfds[nfds].revents = 0;
+			nfds++;
+		}
 
-		int rc = select(req_fd + 1, nullptr, nullptr, &except_fds, &tv);
+		int rc = poll(pfds, nfds, 2000);
 
 		if (rc == 0) {
 			fprintf(stderr, "Timeout when waiting for media request\n");
 			return;
 		}
 		if (rc < 0) {
-			fprintf(stderr, "Unable to select media request: %s\n",
+			fprintf(stderr, "Unable to poll media requests: %s\n",
 				strerror(errno));
 			return;
 		}
+
 		/*
-		 * it is safe to queue back last cap buffer only after
-		 * the following request is done so that the buffer
-		 * is not needed anymore as a reference frame
+		 * Harvest every request that completed, in submission order.
+		 * A request that is requeued during the sweep shows up with
+		 * a fresh fd state only in the next poll, and the sweep is
+		 * bounded by nfds so it cannot act on such a stale result.
 		 */
-		if (queue_lst_buf) {
-			if (fd.qbuf(last_in_buf)) {
-				fprintf(stderr, "%s: qbuf failed\n", __func__);
-				return;
+		for (unsigned harvested = 0; harvested < nfds; harvested++) {
+			int req_fd = fwht_reqs[index].fd;
+			bool ready = false;
+
+			if (req_fd < 0)
+				break;
+			for (unsigned i = 0; i < nfds; i++)
+				if (pfds[i].fd == req_fd &&
+				    (pfds[i].revents & POLLPRI)) {
+					ready = true;
+					break;
+				}
+			if (!ready)
+				break;
+			/*
+			 * it is safe to queue back last cap buffer only after
+			 * the following request is done so that the buffer
+			 * is not needed anymore as a reference frame
+			 */
+			if (queue_lst_buf) {
+				if (fd.qbuf(last_in_buf)) {
+					fprintf(stderr, "%s: qbuf failed\n", __func__);
+					return;
+				}
 			}
-		}
-		int buf_idx = -1;
-		/*
-		 * fin is not sent to do_handle_cap since the capture buf is
-		 * written to the file in current function
-		 */
-		rc = do_handle_cap(fd, in, nullptr, &buf_idx, count[CAP],
-				   fps_ts[CAP], fmt_in, false);
-		if (rc && rc != QUEUE_STOPPED) {
-			fprintf(stderr, "%s: do_handle_cap err\n", __func__);
-			return;
-		}
-		/*
-		 * in case of an error in the frame, set last ts to 0 as a
-		 * means to recover so that next request will not use a
-		 * reference buffer. Otherwise the error flag will be set to
-		 * all the future capture buffers.
-		 */
-		if (buf_idx == -1) {
-			fprintf(stderr, "%s: frame returned with error\n", __func__);
-			last_fwht_bf_ts	= 0;
-		} else {
-			cv4l_buffer cap_buf(in, index);
-			if (fd.querybuf(cap_buf))
+			int buf_idx = -1;
+			/*
+			 * fin is not sent to do_handle_cap since the capture buf is
+			 * written to the file in current function
+			 */
+			rc = do_handle_cap(fd, in, nullptr, &buf_idx, count[CAP],
+					   fps_ts[CAP], fmt_in, false, cap_buf);
+			if (rc && rc != QUEUE_STOPPED) {
+				fprintf(stderr, "%s: do_handle_cap err\n", __func__);
 				return;
-			last_in_buf = cap_buf;
-			queue_lst_buf = true;
-			if (fin && cap_buf.g_bytesused(0) &&
-			    !(cap_buf.g_flags() & V4L2_BUF_FLAG_ERROR)) {
-				int idx = get_fwht_req_by_ts(cap_buf.g_timestamp_ns());
-
-				if (idx < 0) {
-					fprintf(stderr, "%s: could not find request from buffer\n", __func__);
-					fprintf(stderr, "%s: ts = %llu\n", __func__, cap_buf.g_timestamp_ns());
+			}
+			/*
+			 * in case of an error in the frame, set last ts to 0 as a
+			 * means to recover so that next request will not use a
+			 * reference buffer. Otherwise the error flag will be set to
+			 * all the future capture buffers.
+			 */
+			if (buf_idx == -1) {
+				fprintf(stderr, "%s: frame returned with error\n", __func__);
+				last_fwht_bf_ts	= 0;
+			} else {
+				cv4l_buffer cap_buf(in, index);
+				if (fd.querybuf(cap_buf))
 					return;
+				last_in_buf = cap_buf;
+				queue_lst_buf = true;
+				if (fin && cap_buf.g_bytesused(0) &&
+				    !(cap_buf.g_flags() & V4L2_BUF_FLAG_ERROR)) {
+					int idx = get_fwht_req_by_ts(cap_buf.g_timestamp_ns());
+
+					if (idx < 0) {
+						fprintf(stderr, "%s: could not find request from buffer\n", __func__);
+						fprintf(stderr, "%s: ts = %llu\n", __func__, cap_buf.g_timestamp_ns());
+						return;
+					}
+					composed_width = fwht_reqs[idx].params.width;
+					composed_height = fwht_reqs[idx].params.height;
+					write_buffer_to_file(fd, in, cap_buf,
+							     fmt_in, fin);
 				}
-				composed_width = fwht_reqs[idx].params.width;
-				composed_height = fwht_reqs[idx].params.height;
-				write_buffer_to_file(fd, in, cap_buf,
-						     fmt_in, fin);
 			}
-		}
-		if (rc == QUEUE_STOPPED)
-			return;
+			if (rc == QUEUE_STOPPED)
+				return;
 
-		if (!stopped) {
-			rc = do_handle_out(fd, out, fout, nullptr, count[OUT],
-					   fps_ts[OUT], fmt_out, false, true);
-			if (rc) {
-				stopped = true;
-				if (rc != QUEUE_STOPPED)
-					fprintf(stderr, "%s: output stream ended\n", __func__);
-				close(req_fd);
-				fwht_reqs[index].fd = -1;
+			if (!stopped) {
+				rc = do_handle_out(fd, out, fout, nullptr, count[OUT],
+						   fps_ts[OUT], fmt_out, false, true,
+						   out_buf);
+				if (rc) {
+					stopped = true;
+					if (rc != QUEUE_STOPPED)
+						fprintf(stderr, "%s: output stream ended\n", __func__);
+					close(req_fd);
+					fwht_reqs[index].fd = -1;
+				}
 			}
+			index = (index + 1) % out.g_buffers();
 		}
-		index = (index + 1) % out.g_buffers();
 	}
 
 	fcntl(fd.g_fd(), F_SETFL, fd_flags);
@@ -2652,11 +3729,15 @@ done:
 	if (options[OptStreamDmaBuf] || options[OptStreamOutDmaBuf])
 		exp_q.close_exported_fds();
 
-	if (file[CAP] && file[CAP] != stdout)
+	if (file[CAP] && file[CAP] != stdout) {
+		hdr_v2_write_index(file[CAP]);
 		fclose(file[CAP]);
+	}
 
-	if (file[OUT] && file[OUT] != stdin)
+	if (file[OUT] && file[OUT] != stdin) {
+		hdr_v2_from_close();
 		fclose(file[OUT]);
+	}
 }
 
 static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
@@ -2665,6 +3746,7 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 	bool use_poll = options[OptStreamPoll];
 	bool use_dmabuf = options[OptStreamDmaBuf] || options[OptStreamOutDmaBuf];
 	bool use_userptr = options[OptStreamUser] && options[OptStreamOutUser];
+	bool auto_dmabuf = false;
 	__u32 out_type = out_fd.has_vid_m2m() ? v4l_type_invert(out_fd.g_type()) : out_fd.g_type();
 	cv4l_queue in(fd.g_type(), memory);
 	cv4l_queue out(out_type, out_memory);
@@ -2674,6 +3756,8 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 	fd_set fds;
 	unsigned cnt = 0;
 	cv4l_fmt fmt[2];
+	cv4l_buffer cap_buf;
+	cv4l_buffer out_buf;
 
 	out_fd.g_fmt(fmt[OUT], out.g_type());
 	fd.g_fmt(fmt[CAP], in.g_type());
@@ -2704,11 +3788,28 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 	if (options[OptStreamOutDmaBuf])
 		reqbufs_count_out = reqbufs_count_cap;
 	if (!use_dmabuf && !use_userptr) {
-		fprintf(stderr, "Allowed combinations (for now):\n");
-		fprintf(stderr, "\t--stream-mmap and --stream-out-dmabuf\n");
-		fprintf(stderr, "\t--stream-dmabuf and --stream-out-mmap\n");
-		fprintf(stderr, "\t--stream-user and --stream-out-user\n");
-		return;
+		if (options[OptStreamMmap] && options[OptStreamOutMmap] &&
+		    fmt[CAP].g_pixelformat() == fmt[OUT].g_pixelformat() &&
+		    fmt[CAP].g_width() == fmt[OUT].g_width() &&
+		    fmt[CAP].g_height() == fmt[OUT].g_height()) {
+			/* Both sides are mmap and the formats line up: bridge
+			   the queues by exporting the capture buffers as
+			   dmabufs and importing them on the output side, so
+			   no frame is ever copied */
+			auto_dmabuf = use_dmabuf = true;
+			out_memory = V4L2_MEMORY_DMABUF;
+			out.init(out_type, out_memory);
+			reqbufs_count_out = reqbufs_count_cap;
+			if (verbose)
+				fprintf(stderr, "matching formats, using zero-copy dmabuf bridging\n");
+		} else {
+			fprintf(stderr, "Allowed combinations (for now):\n");
+			fprintf(stderr, "\t--stream-mmap and --stream-out-mmap (matching formats, zero-copy)\n");
+			fprintf(stderr, "\t--stream-mmap and --stream-out-dmabuf\n");
+			fprintf(stderr, "\t--stream-dmabuf and --stream-out-mmap\n");
+			fprintf(stderr, "\t--stream-user and --stream-out-user\n");
+			return;
+		}
 	}
 
 	if (file_to) {
@@ -2720,6 +3821,10 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 			fprintf(stderr, "could not open %s for writing\n", file_to);
 			return;
 		}
+		if (to_with_hdr_v2 && file[CAP] != stdout) {
+			write_u32(file[CAP], FILE_HDR_V2_ID);
+			hdr_v2_idx.clear();
+		}
 	}
 
 	if (file_from) {
@@ -2731,6 +3836,8 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 			fprintf(stderr, "could not open %s for reading\n", file_from);
 			return;
 		}
+		if (file[OUT] != stdin)
+			open_input_hdr_v2(file[OUT]);
 	}
 
 	if (in.reqbufs(&fd, reqbufs_count_cap) ||
@@ -2740,7 +3847,7 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 	if (options[OptStreamDmaBuf]) {
 		if (in.export_bufs(&out_fd, out.g_type()))
 			goto done;
-	} else if (options[OptStreamOutDmaBuf]) {
+	} else if (options[OptStreamOutDmaBuf] || auto_dmabuf) {
 		if (out.export_bufs(&fd, in.g_type()))
 			goto done;
 	}
@@ -2774,6 +3881,9 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 	fd.s_trace(0);
 	out_fd.s_trace(0);
 
+	cap_buf.init(in);
+	out_buf.init(out);
+
 	while (stream_sleep == 0)
 		sleep(100);
 
@@ -2806,7 +3916,8 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 			int index = -1;
 
 			r = do_handle_cap(fd, in, file[CAP], &index,
-					  count[CAP], fps_ts[CAP], fmt[CAP], true);
+					  count[CAP], fps_ts[CAP], fmt[CAP], true,
+					  cap_buf);
 			if (r)
 				fprintf(stderr, "handle cap %d\n", r);
 			if (!r) {
@@ -2816,7 +3927,7 @@ static void streaming_set_cap2out(cv4l_fd &fd, cv4l_fd &out_fd)
 					break;
 				r = do_handle_out(out_fd, out, file[OUT], &buf,
 						  count[OUT], fps_ts[OUT], fmt[OUT],
-						  false, false);
+						  false, false, out_buf);
 			}
 			if (r)
 				fprintf(stderr, "handle out %d\n", r);
@@ -2838,18 +3949,22 @@ done:
 
 	if (options[OptStreamDmaBuf])
 		out.close_exported_fds();
-	if (options[OptStreamOutDmaBuf])
+	if (options[OptStreamOutDmaBuf] || auto_dmabuf)
 		in.close_exported_fds();
 
 	in.free(&fd);
 	out.free(&out_fd);
 	tpg_free(&tpg);
 
-	if (file[CAP] && file[CAP] != stdout)
+	if (file[CAP] && file[CAP] != stdout) {
+		hdr_v2_write_index(file[CAP]);
 		fclose(file[CAP]);
+	}
 
-	if (file[OUT] && file[OUT] != stdin)
+	if (file[OUT] && file[OUT] != stdin) {
+		hdr_v2_from_close();
 		fclose(file[OUT]);
+	}
 }
 
 void streaming_set(cv4l_fd &fd, cv4l_fd &out_fd, cv4l_fd &exp_fd)
@@ -1,3 +1,8 @@
+#include <map>
+#include <vector>
+
+#include <pthread.h>
+
 #include "v4l2-ctl.h"
 
 struct mbus_name {
@@ -19,6 +24,8 @@ static const struct mbus_name mbus_names[] = {
 #define SelectionFlags 		(1L<<4)
 
 static __u32 list_mbus_codes_pad;
+static __u32 list_mbus_codes_last_pad;
+static __u32 frmsize_last_pad;
 static __u32 get_fmt_pad;
 static __u32 get_sel_pad;
 static __u32 get_fps_pad;
@@ -36,13 +43,17 @@ static double set_fps;
 void subdev_usage()
 {
 	printf("\nSub-Device options:\n"
-	       "  --list-subdev-mbus-codes <pad>\n"
+	       "  --list-subdev-mbus-codes [<pad>|<frompad>-<topad>]\n"
 	       "                      display supported mediabus codes for this pad (0 is default)\n"
+	       "                      a pad range enumerates multiple pads in one go\n"
 	       "                      [VIDIOC_SUBDEV_ENUM_MBUS_CODE]\n"
-	       "  --list-subdev-framesizes pad=<pad>,code=<code>\n"
+	       "  --list-subdev-framesizes pad=<pad>[,code=<code>]\n"
 	       "                     list supported framesizes for this pad and code\n"
 	       "                     [VIDIOC_SUBDEV_ENUM_FRAME_SIZE]\n"
-	       "                     <code> is the value of the mediabus code\n"
+	       "                     <pad> may be a range <frompad>-<topad>\n"
+	       "                     <code> is the value of the mediabus code, if no code is\n"
+	       "                     given then the framesizes of all mediabus codes of the\n"
+	       "                     pad are listed\n"
 	       "  --list-subdev-frameintervals pad=<pad>,width=<w>,height=<h>,code=<code>\n"
 	       "                     list supported frame intervals for this pad and code and\n"
 	       "                     the given width and height [VIDIOC_SUBDEV_ENUM_FRAME_INTERVAL]\n"
@@ -85,6 +96,20 @@ void subdev_usage()
 	       );
 }
 
+static void parse_pad_range(const char *value, __u32 &first, __u32 &last)
+{
+	char *end;
+
+	first = strtoul(value, &end, 0);
+	last = first;
+	if (*end == '-')
+		last = strtoul(end + 1, nullptr, 0);
+	if (last < first) {
+		fprintf(stderr, "Invalid pad range %s\n", value);
+		std::exit(EXIT_FAILURE);
+	}
+}
+
 void subdev_cmd(int ch, char *optarg)
 {
 	char *value, *subs;
@@ -92,7 +117,8 @@ void subdev_cmd(int ch, char *optarg)
 	switch (ch) {
 	case OptListSubDevMBusCodes:
 		if (optarg)
-			list_mbus_codes_pad = strtoul(optarg, nullptr, 0);
+			parse_pad_range(optarg, list_mbus_codes_pad,
+					list_mbus_codes_last_pad);
 		break;
 	case OptListSubDevFrameSizes:
 		subs = optarg;
@@ -105,7 +131,7 @@ void subdev_cmd(int ch, char *optarg)
 
 			switch (parse_subopt(&subs, subopts, &value)) {
 			case 0:
-				frmsize.pad = strtoul(value, nullptr, 0);
+				parse_pad_range(value, frmsize.pad, frmsize_last_pad);
 				break;
 			case 1:
 				frmsize.code = strtoul(value, nullptr, 0);
@@ -566,18 +592,127 @@ static void print_mbus_code(__u32 code)
 		printf("\t0x%04x", code);
 }
 
-static void print_mbus_codes(int fd, __u32 pad)
+/*
+ * Enumeration results are cached per pad for the duration of the
+ * invocation, so listing the framesizes of all mediabus codes of a pad
+ * enumerates the codes only once.
+ */
+static std::map<__u32, std::vector<struct v4l2_subdev_mbus_code_enum> > mbus_code_cache;
+static std::map<__u32, std::vector<struct v4l2_subdev_frame_size_enum> > frame_size_cache;
+
+static const std::vector<struct v4l2_subdev_mbus_code_enum> &
+enum_mbus_codes(int fd, __u32 pad)
 {
+	std::vector<struct v4l2_subdev_mbus_code_enum> &codes = mbus_code_cache[pad];
 	struct v4l2_subdev_mbus_code_enum mbus_code = {};
 
+	if (!codes.empty())
+		return codes;
 	mbus_code.pad = pad;
 	mbus_code.which = V4L2_SUBDEV_FORMAT_TRY;
+	while (!test_ioctl(fd, VIDIOC_SUBDEV_ENUM_MBUS_CODE, &mbus_code)) {
+		codes.push_back(mbus_code);
+		mbus_code.index++;
+	}
+	return codes;
+}
+
+static void enum_mbus_codes_pad(int fd, __u32 pad)
+{
+	enum_mbus_codes(fd, pad);
+}
+
+static void enum_frame_sizes_pad(int fd, __u32 pad)
+{
+	std::vector<struct v4l2_subdev_frame_size_enum> &sizes = frame_size_cache[pad];
+	struct v4l2_subdev_frame_size_enum fse = {};
+
+	fse.pad = pad;
+	fse.which = V4L2_SUBDEV_FORMAT_TRY;
+	if (frmsize.code) {
+		fse.code = frmsize.code;
+		while (test_ioctl(fd, VIDIOC_SUBDEV_ENUM_FRAME_SIZE, &fse) >= 0) {
+			sizes.push_back(fse);
+			fse.index++;
+		}
+		return;
+	}
+	/* No code was given, so list the framesizes of every code of the pad */
+	for (const auto &mbus_code : enum_mbus_codes(fd, pad)) {
+		fse.code = mbus_code.code;
+		fse.index = 0;
+		while (test_ioctl(fd, VIDIOC_SUBDEV_ENUM_FRAME_SIZE, &fse) >= 0) {
+			sizes.push_back(fse);
+			fse.index++;
+		}
+	}
+}
+
+#define PAD_ENUM_THREADS 4
+
+struct pad_enum_work {
+	int fd;
+	const std::vector<__u32> *pads;
+	size_t next;
+	void (*fn)(int fd, __u32 pad);
+	pthread_mutex_t lock;
+};
+
+static void *pad_enum_worker(void *arg)
+{
+	struct pad_enum_work *w = static_cast<struct pad_enum_work *>(arg);
 
 	for (;;) {
-		int ret = test_ioctl(fd, VIDIOC_SUBDEV_ENUM_MBUS_CODE, &mbus_code);
+		pthread_mutex_lock(&w->lock);
+		if (w->next >= w->pads->size()) {
+			pthread_mutex_unlock(&w->lock);
+			return nullptr;
+		}
+		__u32 pad = (*w->pads)[w->next++];
 
-		if (ret)
+		pthread_mutex_unlock(&w->lock);
+		w->fn(w->fd, pad);
+	}
+}
+
+/*
+ * The subdev enumeration ioctls are read-only, so pads can safely be
+ * enumerated in parallel on the same fd: ISP subdevs expose dozens of
+ * pads with hundreds of code/size combinations and a serial full dump
+ * takes seconds. The cache entries for all pads must be created before
+ * calling this, so the workers only fill in their own entries and never
+ * modify the maps themselves.
+ */
+static void for_each_pad(int fd, const std::vector<__u32> &pads,
+			 void (*fn)(int fd, __u32 pad))
+{
+	pthread_t threads[PAD_ENUM_THREADS];
+	struct pad_enum_work w = {};
+	unsigned n = pads.size() < PAD_ENUM_THREADS ? pads.size() : PAD_ENUM_THREADS;
+	unsigned i;
+
+	if (pads.size() == 1) {
+		fn(fd, pads[0]);
+		return;
+	}
+	w.fd = fd;
+	w.pads = &pads;
+	w.fn = fn;
+	pthread_mutex_init(&w.lock, nullptr);
+	for (i = 0; i < n; i++)
+		if (pthread_create(&threads[i], nullptr, pad_enum_worker, &w))
 			break;
+	if (i == 0)
+		for (__u32 pad : pads)
+			fn(fd, pad);
+	while (i--)
+		pthread_join(threads[i], nullptr);
+	pthread_mutex_destroy(&w.lock);
+}
+
+static void print_mbus_codes(int fd, __u32 pad)
+{
+	for (const auto &mbus_code : enum_mbus_codes(fd, pad)) {
 		print_mbus_code(mbus_code.code);
 		if (mbus_code.flags) {
 			bool is_hsv = mbus_code.code == MEDIA_BUS_FMT_AHSV8888_1X32;
@@ -585,7 +720,6 @@ static void print_mbus_codes(int fd, __u32 pad)
 			printf(", %s", mbus2s(mbus_code.flags, is_hsv).c_str());
 		}
 		printf("\n");
-		mbus_code.index++;
 	}
 }
 
@@ -623,18 +757,44 @@ void subdev_list(cv4l_fd &_fd)
 	int fd = _fd.g_fd();
 
 	if (options[OptListSubDevMBusCodes]) {
-		printf("ioctl: VIDIOC_SUBDEV_ENUM_MBUS_CODE (pad=%u)\n",
-		       list_mbus_codes_pad);
-		print_mbus_codes(fd, list_mbus_codes_pad);
+		std::vector<__u32> pads;
+
+		for (__u32 pad = list_mbus_codes_pad;
+		     pad <= list_mbus_codes_last_pad; pad++)
+			pads.push_back(pad);
+		for (__u32 pad : pads)
+			mbus_code_cache[pad];
+		for_each_pad(fd, pads, enum_mbus_codes_pad);
+		for (__u32 pad : pads) {
+			printf("ioctl: VIDIOC_SUBDEV_ENUM_MBUS_CODE (pad=%u)\n",
+			       pad);
+			print_mbus_codes(fd, pad);
+		}
 	}
 	if (options[OptListSubDevFrameSizes]) {
-		printf("ioctl: VIDIOC_SUBDEV_ENUM_FRAME_SIZE (pad=%u)\n",
-		       frmsize.pad);
-		frmsize.index = 0;
-		frmsize.which = V4L2_SUBDEV_FORMAT_TRY;
-		while (test_ioctl(fd, VIDIOC_SUBDEV_ENUM_FRAME_SIZE, &frmsize) >= 0) {
-			print_frmsize(frmsize);
-			frmsize.index++;
+		std::vector<__u32> pads;
+
+		for (__u32 pad = frmsize.pad; pad <= frmsize_last_pad; pad++)
+			pads.push_back(pad);
+		for (__u32 pad : pads) {
+			frame_size_cache[pad];
+			if (!frmsize.code)
+				mbus_code_cache[pad];
+		}
+		for_each_pad(fd, pads, enum_frame_sizes_pad);
+		for (__u32 pad : pads) {
+			__u32 last_code = 0;
+
+			printf("ioctl: VIDIOC_SUBDEV_ENUM_FRAME_SIZE (pad=%u)\n",
+			       pad);
+			for (const auto &fse : frame_size_cache[pad]) {
+				if (!frmsize.code && fse.code != last_code) {
+					print_mbus_code(fse.code);
+					printf("\n");
+					last_code = fse.code;
+				}
+				print_frmsize(fse);
+			}
 		}
 	}
 	if (options[OptListSubDevFrameIntervals]) {
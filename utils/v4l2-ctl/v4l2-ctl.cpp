@@ -130,6 +130,7 @@ static struct option long_options[] = {
 	{"list-ctrls", no_argument, nullptr, OptListCtrls},
 	{"list-ctrls-menus", no_argument, nullptr, OptListCtrlsMenus},
 	{"set-ctrl", required_argument, nullptr, OptSetCtrl},
+	{"set-ctrl-from-file", required_argument, nullptr, OptSetCtrlFromFile},
 	{"get-ctrl", required_argument, nullptr, OptGetCtrl},
 	{"get-tuner", no_argument, nullptr, OptGetTuner},
 	{"set-tuner", required_argument, nullptr, OptSetTuner},
@@ -205,6 +206,7 @@ static struct option long_options[] = {
 	{"sleep", required_argument, nullptr, OptSleep},
 	{"list-devices", no_argument, nullptr, OptListDevices},
 	{"list-dv-timings", optional_argument, nullptr, OptListDvTimings},
+	{"list-modelines", no_argument, nullptr, OptListModelines},
 	{"query-dv-timings", no_argument, nullptr, OptQueryDvTimings},
 	{"get-dv-timings", no_argument, nullptr, OptGetDvTimings},
 	{"set-dv-bt-timings", required_argument, nullptr, OptSetDvBtTimings},
@@ -236,20 +238,31 @@ static struct option long_options[] = {
 	{"stream-loop", no_argument, nullptr, OptStreamLoop},
 	{"stream-sleep", required_argument, nullptr, OptStreamSleep},
 	{"stream-poll", no_argument, nullptr, OptStreamPoll},
+	{"stream-write-thread", no_argument, nullptr, OptStreamWriteThread},
+	{"stream-cap-device", required_argument, nullptr, OptStreamCapDevice},
+	{"stream-bench", no_argument, nullptr, OptStreamBench},
+	{"stream-tune", no_argument, nullptr, OptStreamTune},
 	{"stream-no-query", no_argument, nullptr, OptStreamNoQuery},
 #ifndef NO_STREAM_TO
 	{"stream-to", required_argument, nullptr, OptStreamTo},
 	{"stream-to-hdr", required_argument, nullptr, OptStreamToHdr},
+	{"stream-to-hdr2", required_argument, nullptr, OptStreamToHdr2},
+	{"stream-to-direct", required_argument, nullptr, OptStreamToDirect},
 	{"stream-lossless", no_argument, nullptr, OptStreamLossless},
+	{"stream-rate-control", no_argument, nullptr, OptStreamRateControl},
 	{"stream-to-host", required_argument, nullptr, OptStreamToHost},
 #endif
 	{"stream-buf-caps", no_argument, nullptr, OptStreamBufCaps},
 	{"stream-show-delta-now", no_argument, nullptr, OptStreamShowDeltaNow},
 	{"stream-mmap", optional_argument, nullptr, OptStreamMmap},
+	{"stream-sdr-to", required_argument, nullptr, OptStreamSdrTo},
+	{"meta-log-to", required_argument, nullptr, OptMetaLogTo},
+	{"meta-log-print", required_argument, nullptr, OptMetaLogPrint},
 	{"stream-user", optional_argument, nullptr, OptStreamUser},
 	{"stream-dmabuf", no_argument, nullptr, OptStreamDmaBuf},
 	{"stream-from", required_argument, nullptr, OptStreamFrom},
 	{"stream-from-hdr", required_argument, nullptr, OptStreamFromHdr},
+	{"stream-from-frame", required_argument, nullptr, OptStreamFromFrame},
 	{"stream-from-host", required_argument, nullptr, OptStreamFromHost},
 	{"stream-out-pattern", required_argument, nullptr, OptStreamOutPattern},
 	{"stream-out-square", no_argument, nullptr, OptStreamOutSquare},
@@ -1366,7 +1379,11 @@ int main(int argc, char **argv)
 			capabilities = vcap.device_caps;
 	}
 
-	media_fd = mi_get_media_fd(fd, is_subdev ? 0 : (const char *)vcap.bus_info);
+	/* Finding the media device means opening every /dev/media* node and
+	   comparing bus_info, which is most of the syscall preamble of a
+	   plain v4l2-ctl invocation. Skip it unless the result is used. */
+	if (options[OptGetDriverInfo] || options[OptAll])
+		media_fd = mi_get_media_fd(fd, is_subdev ? 0 : (const char *)vcap.bus_info);
 
 	priv_magic = (capabilities & V4L2_CAP_EXT_PIX_FORMAT) ?
 			V4L2_PIX_FMT_PRIV_MAGIC : 0;
@@ -1414,7 +1431,17 @@ int main(int argc, char **argv)
 		}
 	}
 
-	common_process_controls(c_fd);
+	/* Enumerating every control can take hundreds of ioctls on complex
+	   drivers, so only build the control map when an option (or a
+	   control event subscription) actually consumes it. */
+	bool need_ctrls = options[OptGetCtrl] || options[OptSetCtrl] ||
+			  options[OptListCtrls] || options[OptListCtrlsMenus] ||
+			  options[OptAll];
+	for (const auto &e : events)
+		if (e.ev == V4L2_EVENT_CTRL)
+			need_ctrls = true;
+	if (need_ctrls)
+		common_process_controls(c_fd);
 
 	for (auto &e : events) {
 		if (e.ev != V4L2_EVENT_CTRL)
@@ -1526,6 +1553,7 @@ int main(int argc, char **argv)
 	/* Special case: handled last */
 
 	streaming_set(c_fd, c_out_fd, c_exp_fd);
+	sdr_stream(c_fd);
 
 	for (const auto &e : events) {
 		struct v4l2_event_subscription sub;
@@ -218,11 +218,18 @@ enum Option {
 	OptStreamLoop,
 	OptStreamSleep,
 	OptStreamPoll,
+	OptStreamWriteThread,
+	OptStreamCapDevice,
+	OptStreamBench,
+	OptStreamTune,
 	OptStreamNoQuery,
 	OptStreamTo,
 	OptStreamToHdr,
+	OptStreamToHdr2,
+	OptStreamToDirect,
 	OptStreamToHost,
 	OptStreamLossless,
+	OptStreamRateControl,
 	OptStreamShowDeltaNow,
 	OptStreamBufCaps,
 	OptStreamMmap,
@@ -230,6 +237,7 @@ enum Option {
 	OptStreamDmaBuf,
 	OptStreamFrom,
 	OptStreamFromHdr,
+	OptStreamFromFrame,
 	OptStreamFromHost,
 	OptStreamOutPattern,
 	OptStreamOutSquare,
@@ -264,6 +272,11 @@ enum Option {
 	OptHelpStreaming,
 	OptHelpEdid,
 	OptHelpAll,
+	OptSetCtrlFromFile,
+	OptListModelines,
+	OptStreamSdrTo,
+	OptMetaLogTo,
+	OptMetaLogPrint,
 	OptVersion,
 	OptLast = 512
 };
@@ -399,6 +412,7 @@ void sdr_cmd(int ch, char *optarg);
 void sdr_set(cv4l_fd &fd);
 void sdr_get(cv4l_fd &fd);
 void sdr_list(cv4l_fd &fd);
+void sdr_stream(cv4l_fd &fd);
 
 // v4l2-ctl-meta.cpp
 void meta_usage(void);
@@ -407,6 +421,7 @@ void meta_set(cv4l_fd &fd);
 void meta_get(cv4l_fd &fd);
 void meta_list(cv4l_fd &fd);
 void print_meta_buffer(FILE *f, cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q);
+void meta_log_buffer(cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q);
 void meta_fillbuffer(cv4l_buffer &buf, cv4l_fmt &fmt, cv4l_queue &q);
 
 // v4l2-ctl-subdev.cpp
@@ -451,4 +466,6 @@ bool calc_cvt_modeline(int image_width, int image_height,
 bool calc_gtf_modeline(int image_width, int image_height,
 		       int refresh_rate, bool reduced_blanking,
 		       bool interlaced, struct v4l2_bt_timings *gtf);
+
+void list_modelines();
 #endif
@@ -1 +0,0 @@
-../common/v4l2-info.cpp
\ No newline at end of file
@@ -27,6 +27,8 @@
 #include <config.h>
 #include "../libmedia_dev/get_media_devices.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <argp.h>
 
 const char *argp_program_version = "v4l2-sysfs-path version " V4L_UTILS_VERSION;
@@ -34,10 +36,12 @@ const char *argp_program_bug_address = "Mauro Carvalho Chehab <mchehab@kernel.or
 
 static const struct argp_option options[] = {
 	{"device", 'd', 0, 0, "use alternative device show mode", 0},
+	{"json", 'j', 0, 0, "show the complete association map as JSON", 0},
 	{ 0, 0, 0, 0, 0, 0 }
 };
 
 static int device_mode = 0;
+static int json_mode = 0;
 
 static error_t parse_opt(int k, char *arg, struct argp_state *state)
 {
@@ -45,6 +49,9 @@ static error_t parse_opt(int k, char *arg, struct argp_state *state)
 	case 'd':
 		device_mode++;
 		break;
+	case 'j':
+		json_mode++;
+		break;
 	default:
 		return ARGP_ERR_UNKNOWN;
 	}
@@ -56,78 +63,187 @@ static struct argp argp = {
 	.parser = parse_opt,
 };
 
-static void print_all_associated_devices(void *md, const char *vid,
-					 const enum device_type type)
+struct map_entry {
+	const char *device;
+	const char *node;
+	enum device_type type;
+	enum bus_type bus;
+	unsigned major, minor;
+};
+
+struct device_map {
+	struct map_entry *entry;
+	int size;
+	int alloc;
+};
+
+static void collect_entry(const char *device, const char *node,
+			  const enum device_type type,
+			  const enum bus_type bus,
+			  const unsigned major, const unsigned minor,
+			  void *priv)
 {
-	const char *devname = NULL;
-	int first = 1;
+	struct device_map *map = priv;
+	struct map_entry *e;
+
+	if (map->size == map->alloc) {
+		map->alloc = map->alloc ? map->alloc * 2 : 64;
+		map->entry = realloc(map->entry,
+				     map->alloc * sizeof(*map->entry));
+		if (!map->entry) {
+			perror("Can't store the device map");
+			exit(1);
+		}
+	}
+	e = &map->entry[map->size++];
+	e->device = device;
+	e->node = node;
+	e->type = type;
+	e->bus = bus;
+	e->major = major;
+	e->minor = minor;
+}
 
-	do {
-		devname = get_associated_device(md, devname, type,
-						vid, MEDIA_V4L_VIDEO);
-		if (devname) {
-			if (first) {
-				printf("\t%s: ", media_device_type(type));
-				first = 0;
-			}
+/*
+ * Returns the end of the group of nodes that share the parent device of
+ * map->entry[start]. The map is sorted by (device, type, node), so all
+ * the nodes of a physical device are adjacent and every association
+ * query can be answered from one walk over the map, instead of a new
+ * array scan per (device, type) pair.
+ */
+static int group_end(const struct device_map *map, int start)
+{
+	int i;
+
+	for (i = start; i < map->size; i++)
+		if (strcmp(map->entry[i].device, map->entry[start].device))
+			break;
+	return i;
+}
+
+static void print_associated_devices(const struct device_map *map)
+{
+	int g_start, g_end, i, j, type;
 
-			printf("%s ", devname);
+	for (g_start = 0; g_start < map->size; g_start = g_end) {
+		g_end = group_end(map, g_start);
+
+		for (i = g_start; i < g_end; i++) {
+			if (map->entry[i].type != MEDIA_V4L_VIDEO)
+				break;
+			printf("Video device: %s\n", map->entry[i].node);
+
+			for (type = 0; type <= MEDIA_SND_HW; type++) {
+				int first = 1;
+
+				for (j = g_start; j < g_end; j++) {
+					if (map->entry[j].type != type || j == i)
+						continue;
+					if (first) {
+						printf("\t%s: ",
+						       media_device_type(type));
+						first = 0;
+					}
+					printf("%s ", map->entry[j].node);
+				}
+				if (!first)
+					printf("\n");
+			}
 		}
-	} while (devname);
-	if (!first)
-		printf("\n");
+	}
 }
 
-static void print_all_alsa_independent_playback(void *md)
+static void print_alsa_independent_playback(const struct device_map *map)
 {
-	const char *devname = NULL;
-	int first = 1;
+	int g_start, g_end, i, first = 1;
 
-	do {
-		devname = get_not_associated_device(md, devname, MEDIA_SND_OUT,
-						    MEDIA_V4L_VIDEO);
-		if (devname) {
+	for (g_start = 0; g_start < map->size; g_start = g_end) {
+		g_end = group_end(map, g_start);
+
+		/* Sorted by type: a device with video nodes starts with one */
+		if (map->entry[g_start].type == MEDIA_V4L_VIDEO)
+			continue;
+
+		for (i = g_start; i < g_end; i++) {
+			if (map->entry[i].type != MEDIA_SND_OUT)
+				continue;
 			if (first) {
 				printf("Alsa playback device(s): ");
 				first = 0;
 			}
-
-			printf("%s ", devname);
+			printf("%s ", map->entry[i].node);
 		}
-	} while (devname);
+	}
 	if (!first)
 		printf("\n");
 }
 
+static const char *bus_name(const enum bus_type bus)
+{
+	switch (bus) {
+	case MEDIA_BUS_VIRTUAL:
+		return "virtual";
+	case MEDIA_BUS_PCI:
+		return "pci";
+	case MEDIA_BUS_USB:
+		return "usb";
+	default:
+		return "unknown";
+	}
+}
+
+/*
+ * Emits the complete association map as JSON, one object per physical
+ * device, so inventory tools get the full topology from a single run
+ * instead of invoking this tool once per node.
+ */
+static void print_json_map(const struct device_map *map)
+{
+	int g_start, g_end, i;
+
+	printf("{ \"devices\": [");
+	for (g_start = 0; g_start < map->size; g_start = g_end) {
+		const struct map_entry *e = &map->entry[g_start];
+
+		g_end = group_end(map, g_start);
+
+		printf("%s\n  { \"device\": \"%s\", \"bus\": \"%s\", \"nodes\": [",
+		       g_start ? "," : "", e->device, bus_name(e->bus));
+		for (i = g_start; i < g_end; i++) {
+			e = &map->entry[i];
+			printf("%s\n    { \"node\": \"%s\", \"type\": \"%s\", \"major\": %u, \"minor\": %u }",
+			       i > g_start ? "," : "", e->node,
+			       media_device_type(e->type), e->major, e->minor);
+		}
+		printf(" ] }");
+	}
+	printf("%s] }\n", map->size ? "\n" : " ");
+}
+
 int main(int argc, char *argv[])
 {
+	struct device_map map = { NULL, 0, 0 };
 	void *md;
-	const char *vid;
-	int i;
 
 	argp_parse(&argp, argc, argv, 0, 0, 0);
 
 	md = discover_media_devices();
-
-	if (device_mode) {
-		display_media_devices(md);
+	if (md)
+		for_each_media_device(md, collect_entry, &map);
+
+	if (json_mode) {
+		print_json_map(&map);
+	} else if (device_mode) {
+		if (md)
+			display_media_devices(md);
 	} else {
-		vid = NULL;
-		do {
-			vid = get_associated_device(md, vid, MEDIA_V4L_VIDEO,
-						NULL, NONE);
-			if (!vid)
-				break;
-			printf("Video device: %s\n", vid);
-
-			for (i = 0; i <= MEDIA_SND_HW; i++)
-				print_all_associated_devices(md, vid, i);
-		} while (vid);
-
-		print_all_alsa_independent_playback(md);
+		print_associated_devices(&map);
+		print_alsa_independent_playback(&map);
 	}
 
-	free_media_devices(md);
+	free(map.entry);
+	if (md)
+		free_media_devices(md);
 
 	return 0;
 }
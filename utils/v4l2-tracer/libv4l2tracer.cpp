@@ -4,13 +4,30 @@
  */
 
 #include "trace.h"
+#include "v4l2-tracer-live.h"
 #include <config.h> /* For PROMOTED_MODE_T */
 #include <dlfcn.h>
 #include <stdarg.h>
 
 extern struct trace_context ctx_trace;
 
-const std::list<unsigned long> ioctls = {
+/*
+ * The intercepted calls are on the traced application's hot path, so the
+ * originals are resolved once by the library constructor instead of
+ * calling dlsym() on every interception, and the traced ioctl set is a
+ * sorted array probed with a binary search instead of a linear list scan.
+ * The dlsym() fallbacks below only run if a call is intercepted before
+ * this library's constructor, e.g. from another library's constructor.
+ */
+static int (*original_open)(const char *path, int oflag, ...);
+static int (*original_open64)(const char *path, int oflag, ...);
+static int (*original_close)(int fd);
+static void *(*original_mmap)(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
+static void *(*original_mmap64)(void *addr, size_t len, int prot, int flags, int fildes, off_t off);
+static int (*original_munmap)(void *start, size_t length);
+static int (*original_ioctl)(int fd, unsigned long cmd, ...);
+
+static unsigned long ioctls[] = {
 	VIDIOC_QUERYCAP,
 	VIDIOC_STREAMON,
 	VIDIOC_STREAMOFF,
@@ -47,6 +64,116 @@ const std::list<unsigned long> ioctls = {
 	MEDIA_REQUEST_IOC_REINIT,
 };
 
+/*
+ * Optional subset of ioctls selected with -f/--filter, sorted. When
+ * non-empty, only these ioctls are traced and everything else goes
+ * straight to the original syscall, so tracing can stay enabled with
+ * near-zero overhead for the filtered-out calls.
+ */
+static std::vector<unsigned long> ioctl_filter;
+
+static void parse_ioctl_filter(void)
+{
+	const char *filter = getenv("V4L2_TRACER_OPTION_FILTER_IOCTLS");
+	if (filter == nullptr)
+		return;
+
+	std::string list = filter;
+	size_t start = 0;
+
+	while (start < list.length()) {
+		size_t end = list.find(',', start);
+		if (end == std::string::npos)
+			end = list.length();
+		std::string name = list.substr(start, end - start);
+		start = end + 1;
+
+		unsigned long cmd = s2val(name.c_str(), ioctl_val_def);
+		if (std::binary_search(std::begin(ioctls), std::end(ioctls), cmd)) {
+			ioctl_filter.push_back(cmd);
+		} else {
+			fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+			fprintf(stderr, "warning: \'%s\' is not a traceable ioctl, ignoring it\n",
+			        name.c_str());
+		}
+	}
+	std::sort(ioctl_filter.begin(), ioctl_filter.end());
+}
+
+/* Live mode (--live): see v4l2-tracer-live.h for the ring layout. */
+static struct v4l2_tracer_live_ring *live_ring;
+static char live_ring_name[64];
+
+static void live_init(void)
+{
+	if (live_ring != nullptr || getenv("V4L2_TRACER_OPTION_LIVE") == nullptr)
+		return;
+
+	snprintf(live_ring_name, sizeof(live_ring_name), "/v4l2-tracer-%d", getpid());
+	int shm_fd = shm_open(live_ring_name, O_CREAT | O_RDWR, 0644);
+	if (shm_fd < 0)
+		return;
+	if (ftruncate(shm_fd, sizeof(*live_ring)) != 0) {
+		close(shm_fd);
+		shm_unlink(live_ring_name);
+		return;
+	}
+	live_ring = (struct v4l2_tracer_live_ring *) mmap(nullptr, sizeof(*live_ring),
+							  PROT_READ | PROT_WRITE,
+							  MAP_SHARED, shm_fd, 0);
+	close(shm_fd);
+	if (live_ring == MAP_FAILED) {
+		live_ring = nullptr;
+		shm_unlink(live_ring_name);
+		return;
+	}
+	live_ring->magic = V4L2_TRACER_LIVE_MAGIC;
+	live_ring->version = V4L2_TRACER_LIVE_VERSION;
+	live_ring->capacity = V4L2_TRACER_LIVE_CAPACITY;
+	live_ring->record_size = sizeof(struct v4l2_tracer_live_event);
+	__atomic_store_n(&live_ring->head, 0, __ATOMIC_RELEASE);
+}
+
+static void live_publish(int fd, unsigned long cmd, const struct timespec *ts_start,
+			 const struct timespec *ts_end, int error)
+{
+	__u64 head = __atomic_load_n(&live_ring->head, __ATOMIC_RELAXED);
+	struct v4l2_tracer_live_event *ev =
+		&live_ring->events[head % V4L2_TRACER_LIVE_CAPACITY];
+
+	ev->ts_ns = ts_start->tv_sec * 1000000000ULL + ts_start->tv_nsec;
+	ev->duration_ns = (ts_end->tv_sec - ts_start->tv_sec) * 1000000000ULL +
+		ts_end->tv_nsec - ts_start->tv_nsec;
+	ev->cmd = cmd;
+	ev->fd = fd;
+	ev->error = error;
+	/* Publish the record before moving head past it. */
+	__atomic_store_n(&live_ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static void __attribute__((destructor)) live_exit(void)
+{
+	if (live_ring == nullptr)
+		return;
+	munmap(live_ring, sizeof(*live_ring));
+	live_ring = nullptr;
+	shm_unlink(live_ring_name);
+}
+
+static void __attribute__((constructor)) libv4l2tracer_init(void)
+{
+	live_init();
+	original_open = (int (*)(const char*, int, ...)) dlsym(RTLD_NEXT, "open");
+	original_open64 = (int (*)(const char*, int, ...)) dlsym(RTLD_NEXT, "open64");
+	original_close = (int (*)(int)) dlsym(RTLD_NEXT, "close");
+	original_mmap = (void*(*)(void*, size_t, int, int, int, off_t)) dlsym(RTLD_NEXT, "mmap");
+	original_mmap64 = (void*(*)(void*, size_t, int, int, int, off_t)) dlsym(RTLD_NEXT, "mmap64");
+	original_munmap = (int(*)(void *, size_t)) dlsym(RTLD_NEXT, "munmap");
+	original_ioctl = (int (*)(int, long unsigned int, ...)) dlsym(RTLD_NEXT, "ioctl");
+	std::sort(std::begin(ioctls), std::end(ioctls));
+	parse_ioctl_filter();
+}
+
 int open(const char *path, int oflag, ...)
 {
 	errno = 0;
@@ -59,8 +186,8 @@ int open(const char *path, int oflag, ...)
 		va_end(argp);
 	}
 
-	int (*original_open)(const char *path, int oflag, ...) = nullptr;
-	original_open = (int (*)(const char*, int, ...)) dlsym(RTLD_NEXT, "open");
+	if (original_open == nullptr)
+		libv4l2tracer_init();
 	int fd = (*original_open)(path, oflag, mode);
 
 	if (is_debug()) {
@@ -95,8 +222,8 @@ int open64(const char *path, int oflag, ...)
 		va_end(argp);
 	}
 
-	int (*original_open64)(const char *path, int oflag, ...) = nullptr;
-	original_open64 = (int (*)(const char*, int, ...)) dlsym(RTLD_NEXT, "open64");
+	if (original_open64 == nullptr)
+		libv4l2tracer_init();
 	int fd = (*original_open64)(path, oflag, mode);
 
 	if (is_debug()) {
@@ -123,8 +250,8 @@ int open64(const char *path, int oflag, ...)
 int close(int fd)
 {
 	errno = 0;
-	int (*original_close)(int fd) = nullptr;
-	original_close = (int (*)(int)) dlsym(RTLD_NEXT, "close");
+	if (original_close == nullptr)
+		libv4l2tracer_init();
 
 	if (getenv("V4L2_TRACER_PAUSE_TRACE") != nullptr)
 		return (*original_close)(fd);
@@ -160,8 +287,8 @@ int close(int fd)
 void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
 {
 	errno = 0;
-	void *(*original_mmap)(void *addr, size_t len, int prot, int flags, int fildes, off_t off) = nullptr;
-	original_mmap = (void*(*)(void*, size_t, int, int, int, off_t)) dlsym(RTLD_NEXT, "mmap");
+	if (original_mmap == nullptr)
+		libv4l2tracer_init();
 	void *buf_address_pointer = (*original_mmap)(addr, len, prot, flags, fildes, off);
 
 	set_buffer_address_trace(fildes, off, (unsigned long) buf_address_pointer);
@@ -175,8 +302,8 @@ void *mmap(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
 void *mmap64(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
 {
 	errno = 0;
-	void *(*original_mmap64)(void *addr, size_t len, int prot, int flags, int fildes, off_t off) = nullptr;
-	original_mmap64 = (void*(*)(void*, size_t, int, int, int, off_t)) dlsym(RTLD_NEXT, "mmap64");
+	if (original_mmap64 == nullptr)
+		libv4l2tracer_init();
 	void *buf_address_pointer = (*original_mmap64)(addr, len, prot, flags, fildes, off);
 
 	set_buffer_address_trace(fildes, off, (unsigned long) buf_address_pointer);
@@ -190,8 +317,8 @@ void *mmap64(void *addr, size_t len, int prot, int flags, int fildes, off_t off)
 int munmap(void *start, size_t length)
 {
 	errno = 0;
-	int(*original_munmap)(void *start, size_t length) = nullptr;
-	original_munmap = (int(*)(void *, size_t)) dlsym(RTLD_NEXT, "munmap");
+	if (original_munmap == nullptr)
+		libv4l2tracer_init();
 	int ret = (*original_munmap)(start, length);
 
 	/* Only trace the unmapping if the original mapping was traced. */
@@ -222,16 +349,33 @@ int ioctl(int fd, unsigned long cmd, ...)
 	void *arg = va_arg(argp, void *);
 	va_end(argp);
 
-	int (*original_ioctl)(int fd, unsigned long cmd, ...) = nullptr;
-	original_ioctl = (int (*)(int, long unsigned int, ...)) dlsym(RTLD_NEXT, "ioctl");
+	if (original_ioctl == nullptr)
+		libv4l2tracer_init();
 
-	if (getenv("V4L2_TRACER_PAUSE_TRACE") != nullptr)
+	/* Don't trace ioctls that are not in the specified ioctls list. */
+	if (!std::binary_search(std::begin(ioctls), std::end(ioctls), cmd))
 		return (*original_ioctl)(fd, cmd, arg);
 
-	/* Don't trace ioctls that are not in the specified ioctls list. */
-	if (find(ioctls.begin(), ioctls.end(), cmd) == ioctls.end())
+	/* Don't trace ioctls excluded by the -f/--filter option. */
+	if (!ioctl_filter.empty() &&
+	    !std::binary_search(ioctl_filter.begin(), ioctl_filter.end(), cmd))
+		return (*original_ioctl)(fd, cmd, arg);
+
+	if (getenv("V4L2_TRACER_PAUSE_TRACE") != nullptr)
 		return (*original_ioctl)(fd, cmd, arg);
 
+	/* Live mode: publish a fixed-size record, no json and no file I/O. */
+	if (live_ring != nullptr) {
+		struct timespec ts_start, ts_end;
+		clock_gettime(CLOCK_MONOTONIC, &ts_start);
+		int ret = (*original_ioctl)(fd, cmd, arg);
+		int ioctl_errno = errno;
+		clock_gettime(CLOCK_MONOTONIC, &ts_end);
+		live_publish(fd, cmd, &ts_start, &ts_end, ret < 0 ? ioctl_errno : 0);
+		errno = ioctl_errno;
+		return ret;
+	}
+
 	json_object *ioctl_obj = json_object_new_object();
 	json_object_object_add(ioctl_obj, "fd", json_object_new_int(fd));
 	json_object_object_add(ioctl_obj, "ioctl",
@@ -266,8 +410,16 @@ int ioctl(int fd, unsigned long cmd, ...)
 			json_object_put(ioctl_args_userspace);
 	}
 
-	/* Make the original ioctl call. */
+	/* Make the original ioctl call, timing it for "v4l2-tracer report". */
+	struct timespec ts_start, ts_end;
+	clock_gettime(CLOCK_MONOTONIC, &ts_start);
 	int ret = (*original_ioctl)(fd, cmd, arg);
+	int ioctl_errno = errno;
+	clock_gettime(CLOCK_MONOTONIC, &ts_end);
+	errno = ioctl_errno;
+	json_object_object_add(ioctl_obj, "duration_ns", json_object_new_uint64(
+		(ts_end.tv_sec - ts_start.tv_sec) * 1000000000ULL +
+		ts_end.tv_nsec - ts_start.tv_nsec));
 
 	if (errno)
 		json_object_object_add(ioctl_obj, "errno", json_object_new_string(strerrorname_np(errno)));
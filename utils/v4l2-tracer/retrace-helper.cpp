@@ -7,27 +7,39 @@
 
 struct retrace_context ctx_retrace = {};
 
+/*
+ * Serializes access to ctx_retrace, which is shared between the replay
+ * threads of a parallel retrace (v4l2-tracer --parallel).
+ */
+static pthread_mutex_t ctx_retrace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 bool buffer_in_retrace_context(int fd, __u32 offset)
 {
 	bool buffer_in_retrace_context = false;
+
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	for (auto &b : ctx_retrace.buffers) {
 		if ((b.fd == fd) && (b.offset == offset)) {
 			buffer_in_retrace_context = true;
 			break;
 		}
 	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 	return buffer_in_retrace_context;
 }
 
 int get_buffer_fd_retrace(__u32 type, __u32 index)
 {
 	int fd = -1;
+
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	for (auto &b : ctx_retrace.buffers) {
 		if ((b.type == type) && (b.index == index)) {
 			fd = b.fd;
 			break;
 		}
 	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 	return fd;
 }
 
@@ -38,21 +50,26 @@ void add_buffer_retrace(int fd, __u32 type, __u32 index, __u32 offset)
 	buf.type = type;
 	buf.index = index;
 	buf.offset = offset;
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	ctx_retrace.buffers.push_front(buf);
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 }
 
 void remove_buffer_retrace(int fd)
 {
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	for (auto it = ctx_retrace.buffers.begin(); it != ctx_retrace.buffers.end(); ++it) {
 		if (it->fd == fd) {
 			ctx_retrace.buffers.erase(it);
 			break;
 		}
 	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 }
 
 void set_buffer_address_retrace(int fd, __u32 offset, long address_trace, long address_retrace)
 {
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	for (auto &b : ctx_retrace.buffers) {
 		if ((b.fd == fd) && (b.offset == offset)) {
 			b.address_trace = address_trace;
@@ -60,17 +77,21 @@ void set_buffer_address_retrace(int fd, __u32 offset, long address_trace, long a
 			break;
 		}
 	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 }
 
 long get_retrace_address_from_trace_address(long address_trace)
 {
 	long address_retrace = 0;
+
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	for (auto &b : ctx_retrace.buffers) {
 		if (b.address_trace == address_trace) {
 			address_retrace = b.address_retrace;
 			break;
 		}
 	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 	return address_retrace;
 }
 
@@ -86,16 +107,21 @@ void add_fd(int fd_trace, int fd_retrace)
 {
 	std::pair<int, int> new_pair;
 	new_pair = std::make_pair(fd_trace, fd_retrace);
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	ctx_retrace.retrace_fds.insert(new_pair);
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 }
 
 int get_fd_retrace_from_fd_trace(int fd_trace)
 {
 	int fd_retrace = -1;
 	std::unordered_map<int, int>::const_iterator it;
+
+	pthread_mutex_lock(&ctx_retrace_mutex);
 	it = ctx_retrace.retrace_fds.find(fd_trace);
 	if (it != ctx_retrace.retrace_fds.end())
 		fd_retrace = it->second;
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 	return fd_retrace;
 }
 
@@ -179,6 +205,13 @@ std::string get_path_retrace_from_path_trace(std::string path_trace, json_object
 	return "";
 }
 
+/*
+ * Payloads from the trace file, keyed by their "mem_hash" value. The trace
+ * only stores the data of the first occurrence of a payload; duplicates
+ * just carry the hash and are resolved from this map.
+ */
+static std::unordered_map<std::string, json_object *> retrace_mem_arrays;
+
 void write_to_output_buffer(unsigned char *buffer_pointer, int bytesused, json_object *mem_obj)
 {
 	int byteswritten = 0;
@@ -186,9 +219,31 @@ void write_to_output_buffer(unsigned char *buffer_pointer, int bytesused, json_o
 	json_object *line_obj;
 	size_t number_of_lines;
 	std::string compressed_video_data;
+	std::string mem_hash;
+
+	json_object *mem_hash_obj;
+	if (json_object_object_get_ex(mem_obj, "mem_hash", &mem_hash_obj) &&
+	    json_object_get_string(mem_hash_obj) != nullptr)
+		mem_hash = json_object_get_string(mem_hash_obj);
 
 	json_object *mem_array_obj;
-	json_object_object_get_ex(mem_obj, "mem_array", &mem_array_obj);
+	pthread_mutex_lock(&ctx_retrace_mutex);
+	if (json_object_object_get_ex(mem_obj, "mem_array", &mem_array_obj)) {
+		if (!mem_hash.empty() && retrace_mem_arrays.count(mem_hash) == 0)
+			retrace_mem_arrays[mem_hash] = json_object_get(mem_array_obj);
+	} else {
+		/* Deduplicated payload, look up the stored data by its hash. */
+		auto it = retrace_mem_arrays.find(mem_hash);
+		if (it == retrace_mem_arrays.end()) {
+			pthread_mutex_unlock(&ctx_retrace_mutex);
+			fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+			fprintf(stderr, "warning: payload with hash \'%s\' not found in trace file.\n",
+			        mem_hash.c_str());
+			return;
+		}
+		mem_array_obj = it->second;
+	}
+	pthread_mutex_unlock(&ctx_retrace_mutex);
 	number_of_lines = json_object_array_length(mem_array_obj);
 
 	for (long unsigned int i = 0; i < number_of_lines; i++) {
@@ -196,6 +251,18 @@ void write_to_output_buffer(unsigned char *buffer_pointer, int bytesused, json_o
 		if (json_object_get_string(line_obj) != nullptr)
 			compressed_video_data = json_object_get_string(line_obj);
 
+		/* A "z<count>" entry stands for a run of <count> zero bytes. */
+		if (!compressed_video_data.empty() && compressed_video_data[0] == 'z') {
+			int run = atoi(compressed_video_data.c_str() + 1);
+
+			if (run > 0) {
+				memset(buffer_pointer, 0, run);
+				buffer_pointer += run;
+				byteswritten += run;
+			}
+			continue;
+		}
+
 		for (long unsigned i = 0; i < compressed_video_data.length(); i++) {
 			if (std::isspace(compressed_video_data[i]) != 0)
 				continue;
@@ -4,6 +4,8 @@
  */
 
 #include "retrace.h"
+#include <climits>
+#include <sys/stat.h>
 
 extern struct retrace_context ctx_retrace;
 
@@ -1329,45 +1331,381 @@ void retrace_object(json_object *jobj)
 	fprintf(stderr, "warning: unexpected JSON object in trace file.\n");
 }
 
-void retrace_array(json_object *root_array_obj)
+/*
+ * Pacing state for --pace: replay the events on the schedule given by the
+ * "ts_ns" timestamps in the trace, divided by the speed factor. A factor
+ * of 0 (the default) replays at maximum rate as before.
+ */
+static double pace_factor;
+static unsigned long long pace_trace_start_ns;
+static unsigned long long pace_wall_start_ns;
+static unsigned pace_behind_count;
+static unsigned long long pace_max_lag_ns;
+/* Guards the pacing state when replay threads pace concurrently. */
+static pthread_mutex_t pace_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned long long get_monotonic_ns(void)
 {
-	json_object *jobj;
-	struct array_list *array_list_pointer = json_object_get_array(root_array_obj);
-	size_t json_objects_in_file = array_list_length(array_list_pointer);
+	struct timespec ts;
 
-	if (json_objects_in_file < 3) {
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Sleep until the event is due on the requested schedule, or record by how
+ * far the replay fell behind it. Traces without timestamps are replayed at
+ * maximum rate.
+ */
+static void pace_event(json_object *jobj)
+{
+	/* Consider the replay behind schedule only above this lag. */
+	const unsigned long long lag_threshold_ns = 1000000ULL;
+
+	json_object *ts_obj;
+	if (!json_object_object_get_ex(jobj, "ts_ns", &ts_obj))
+		return;
+	unsigned long long ts_ns = json_object_get_uint64(ts_obj);
+
+	pthread_mutex_lock(&pace_mutex);
+	if (pace_trace_start_ns == 0) {
+		pace_trace_start_ns = ts_ns;
+		pace_wall_start_ns = get_monotonic_ns();
+		pthread_mutex_unlock(&pace_mutex);
+		return;
+	}
+
+	unsigned long long target_ns = pace_wall_start_ns +
+		(unsigned long long)((ts_ns - pace_trace_start_ns) / pace_factor);
+	pthread_mutex_unlock(&pace_mutex);
+	unsigned long long now_ns = get_monotonic_ns();
+
+	if (now_ns < target_ns) {
+		struct timespec req = {
+			(time_t)((target_ns - now_ns) / 1000000000ULL),
+			(long)((target_ns - now_ns) % 1000000000ULL)
+		};
+		nanosleep(&req, nullptr);
+	} else if (now_ns - target_ns > lag_threshold_ns) {
+		pthread_mutex_lock(&pace_mutex);
+		pace_behind_count++;
+		if (now_ns - target_ns > pace_max_lag_ns)
+			pace_max_lag_ns = now_ns - target_ns;
+		pthread_mutex_unlock(&pace_mutex);
+	}
+}
+
+static void pace_report(size_t total_events)
+{
+	if (pace_behind_count == 0) {
+		fprintf(stderr, "Replay kept the %gx schedule for all %zu events.\n",
+		        pace_factor, total_events);
+		return;
+	}
+	fprintf(stderr, "Replay fell behind the %gx schedule for %u of %zu events, "
+	        "worst by %.3f ms.\n",
+	        pace_factor, pace_behind_count, total_events,
+	        pace_max_lag_ns / 1000000.0);
+}
+
+/*
+ * Parallel replay (--parallel): the records of a multi-instance trace are
+ * partitioned into independent streams and each stream is replayed on its
+ * own thread, in trace order within the stream. Two file descriptors
+ * belong to the same stream if the trace ties them together: a request fd
+ * is merged with the media fd it was allocated from and with any video fd
+ * that queues buffers or controls to it, so cross-fd dependencies through
+ * shared buffers and requests stay ordered. Records that carry no fd (the
+ * trace header) are replayed before the threads start.
+ */
+struct replay_event {
+	size_t pos;
+	int len;
+};
+
+struct replay_stream {
+	int root_fd;
+	const char *data;
+	std::vector<replay_event> events;
+	pthread_t thread;
+	unsigned long long elapsed_ns;
+};
+
+/* Union-find over the file descriptors seen in the trace. */
+static std::unordered_map<int, int> replay_fd_parent;
+
+static int replay_find(int fd)
+{
+	if (replay_fd_parent.count(fd) == 0)
+		replay_fd_parent[fd] = fd;
+	int root = fd;
+	while (replay_fd_parent[root] != root)
+		root = replay_fd_parent[root];
+	while (replay_fd_parent[fd] != root) {
+		int next = replay_fd_parent[fd];
+		replay_fd_parent[fd] = root;
+		fd = next;
+	}
+	return root;
+}
+
+static void replay_union(int fd1, int fd2)
+{
+	replay_fd_parent[replay_find(fd1)] = replay_find(fd2);
+}
+
+/* Merge the record's fd with every request_fd found in its arguments. */
+static void replay_scan_request_fds(json_object *jobj, int fd)
+{
+	if (json_object_get_type(jobj) == json_type_array) {
+		for (size_t i = 0; i < json_object_array_length(jobj); i++)
+			replay_scan_request_fds(json_object_array_get_idx(jobj, i), fd);
+		return;
+	}
+	if (json_object_get_type(jobj) != json_type_object)
+		return;
+	json_object_object_foreach(jobj, key, val) {
+		if (strcmp(key, "request_fd") == 0)
+			replay_union(fd, json_object_get_int(val));
+		else
+			replay_scan_request_fds(val, fd);
+	}
+}
+
+/*
+ * The fd a record belongs to, or -1 for records without one. munmap()
+ * records only carry the mapped address, so mmap records register their
+ * address here for the lookup.
+ */
+static int replay_event_fd(json_object *jobj,
+			   std::unordered_map<long, int> &addr_to_fd)
+{
+	json_object *tmp;
+
+	if (json_object_object_get_ex(jobj, "fd", &tmp))
+		return json_object_get_int(tmp);
+
+	if (json_object_object_get_ex(jobj, "mmap", &tmp) ||
+	    json_object_object_get_ex(jobj, "mmap64", &tmp)) {
+		json_object *fildes_obj;
+		if (!json_object_object_get_ex(tmp, "fildes", &fildes_obj))
+			return -1;
+		int fd = json_object_get_int(fildes_obj);
+		json_object *addr_obj;
+		if (json_object_object_get_ex(jobj, "buffer_address", &addr_obj))
+			addr_to_fd[(long)json_object_get_int64(addr_obj)] = fd;
+		return fd;
+	}
+
+	if (json_object_object_get_ex(jobj, "munmap", &tmp)) {
+		json_object *start_obj;
+		if (!json_object_object_get_ex(tmp, "start", &start_obj))
+			return -1;
+		auto it = addr_to_fd.find((long)json_object_get_int64(start_obj));
+		return it == addr_to_fd.end() ? -1 : it->second;
+	}
+
+	return -1;
+}
+
+static void *replay_stream_worker(void *arg)
+{
+	replay_stream *stream = (replay_stream *)arg;
+	json_tokener *tokener = json_tokener_new();
+	unsigned long long start_ns = get_monotonic_ns();
+
+	for (auto &ev : stream->events) {
+		json_tokener_reset(tokener);
+		json_object *jobj = json_tokener_parse_ex(tokener,
+							  stream->data + ev.pos, ev.len);
+		if (jobj == nullptr)
+			continue;
+		if (pace_factor > 0)
+			pace_event(jobj);
+		retrace_object(jobj);
+		json_object_put(jobj);
+	}
+	json_tokener_free(tokener);
+	stream->elapsed_ns = get_monotonic_ns() - start_ns;
+	return nullptr;
+}
+
+static int retrace_parallel(const char *data, size_t size, const char *filename)
+{
+	json_tokener *tokener = json_tokener_new();
+	std::unordered_map<long, int> addr_to_fd;
+	std::vector<std::pair<replay_event, int>> events;
+	size_t pos = 0;
+
+	/* Skip the opening bracket of the json array. */
+	while (pos < size && (isspace(data[pos]) || data[pos] == '['))
+		pos++;
+
+	/* First pass: find the record boundaries and their streams. */
+	while (pos < size) {
+		while (pos < size && (isspace(data[pos]) || data[pos] == ','))
+			pos++;
+		if (pos >= size || data[pos] == ']')
+			break;
+
+		int chunk = size - pos > INT_MAX ? INT_MAX : (int)(size - pos);
+
+		json_tokener_reset(tokener);
+		json_object *jobj = json_tokener_parse_ex(tokener, data + pos, chunk);
+		if (jobj == nullptr) {
+			fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+			fprintf(stderr, "cannot parse JSON-object at offset %zu in file: %s: %s\n",
+			        pos, filename,
+			        json_tokener_error_desc(json_tokener_get_error(tokener)));
+			json_tokener_free(tokener);
+			return 1;
+		}
+		int len = json_tokener_get_parse_end(tokener);
+
+		int fd = replay_event_fd(jobj, addr_to_fd);
+		if (fd >= 0) {
+			replay_find(fd);
+			replay_scan_request_fds(jobj, fd);
+			events.push_back({ { pos, len }, fd });
+		} else {
+			/* Header records, replay them before the streams start. */
+			retrace_object(jobj);
+		}
+		json_object_put(jobj);
+		pos += len;
+	}
+	json_tokener_free(tokener);
+
+	if (events.size() < 3) {
 		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
 		fprintf(stderr, "warning: trace file may be empty.\n");
 	}
 
-	for (size_t i = 0; i < json_objects_in_file; i++) {
-		jobj = (json_object *) array_list_get_idx(array_list_pointer, i);
-		retrace_object(jobj);
+	/* Group the events into one stream per union-find root. */
+	std::unordered_map<int, replay_stream> streams;
+	for (auto &ev : events) {
+		replay_stream &stream = streams[replay_find(ev.second)];
+		stream.root_fd = replay_find(ev.second);
+		stream.data = data;
+		stream.events.push_back(ev.first);
+	}
+
+	fprintf(stderr, "Replaying %zu events on %zu stream(s).\n",
+	        events.size(), streams.size());
+
+	for (auto &pair : streams) {
+		if (pthread_create(&pair.second.thread, nullptr,
+				   replay_stream_worker, &pair.second) != 0) {
+			/* Thread creation failed, replay this stream inline. */
+			replay_stream_worker(&pair.second);
+			pair.second.thread = pthread_self();
+		}
 	}
+	for (auto &pair : streams)
+		if (!pthread_equal(pair.second.thread, pthread_self()))
+			pthread_join(pair.second.thread, nullptr);
+
+	for (auto &pair : streams)
+		fprintf(stderr, "Stream (trace fd %d): %zu events in %.3f s (%.0f events/s).\n",
+		        pair.second.root_fd, pair.second.events.size(),
+		        pair.second.elapsed_ns / 1e9,
+		        pair.second.elapsed_ns ?
+		        pair.second.events.size() * 1e9 / pair.second.elapsed_ns : 0.0);
+
+	if (pace_factor > 0)
+		pace_report(events.size());
+
+	return 0;
 }
 
+/*
+ * Parse and replay the trace one record at a time from a read-only mapping
+ * of the file instead of loading the whole json tree into memory, so
+ * multi-GB traces can be retraced on the boards they were captured on.
+ */
 int retrace(std::string trace_filename)
 {
-	FILE *trace_file = fopen(trace_filename.c_str(), "r");
-	if (trace_file == nullptr) {
+	int fd = open(trace_filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+		fprintf(stderr, "Trace file error: \'%s\'\n", trace_filename.c_str());
+		return 1;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
 		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
 		fprintf(stderr, "Trace file error: \'%s\'\n", trace_filename.c_str());
+		close(fd);
+		return 1;
+	}
+	size_t size = st.st_size;
+
+	char *data = (char *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+		fprintf(stderr, "cannot mmap trace file: %s\n", trace_filename.c_str());
 		return 1;
 	}
-	fclose(trace_file);
 
 	fprintf(stderr, "Retracing: %s\n", trace_filename.c_str());
 
-	json_object *root_array_obj = json_object_from_file(trace_filename.c_str());
+	if (getenv("V4L2_TRACER_OPTION_PACE") != nullptr)
+		pace_factor = atof(getenv("V4L2_TRACER_OPTION_PACE"));
+
+	if (getenv("V4L2_TRACER_OPTION_PARALLEL") != nullptr) {
+		int ret = retrace_parallel(data, size, trace_filename.c_str());
+		munmap(data, size);
+		return ret;
+	}
+
+	json_tokener *tokener = json_tokener_new();
+	size_t json_objects_in_file = 0;
+	size_t pos = 0;
+	int ret = 0;
+
+	/* Skip the opening bracket of the json array. */
+	while (pos < size && (isspace(data[pos]) || data[pos] == '['))
+		pos++;
 
-	if (root_array_obj == nullptr) {
+	while (pos < size) {
+		while (pos < size && (isspace(data[pos]) || data[pos] == ','))
+			pos++;
+		if (pos >= size || data[pos] == ']')
+			break;
+
+		/* json_tokener_parse_ex() takes an int length, cap it for huge traces. */
+		int chunk = size - pos > INT_MAX ? INT_MAX : (int)(size - pos);
+
+		json_tokener_reset(tokener);
+		json_object *jobj = json_tokener_parse_ex(tokener, data + pos, chunk);
+		if (jobj == nullptr) {
+			fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+			fprintf(stderr, "cannot parse JSON-object at offset %zu in file: %s: %s\n",
+			        pos, trace_filename.c_str(),
+			        json_tokener_error_desc(json_tokener_get_error(tokener)));
+			ret = 1;
+			break;
+		}
+		pos += json_tokener_get_parse_end(tokener);
+		json_objects_in_file++;
+
+		if (pace_factor > 0)
+			pace_event(jobj);
+		retrace_object(jobj);
+		json_object_put(jobj);
+	}
+	json_tokener_free(tokener);
+	munmap(data, size);
+
+	if (json_objects_in_file < 3) {
 		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
-		fprintf(stderr, "cannot get JSON-object from file: %s\n", trace_filename.c_str());
-		return 1;
+		fprintf(stderr, "warning: trace file may be empty.\n");
 	}
 
-	retrace_array(root_array_obj);
-	json_object_put(root_array_obj);
+	if (pace_factor > 0)
+		pace_report(json_objects_in_file);
 
-	return 0;
+	return ret;
 }
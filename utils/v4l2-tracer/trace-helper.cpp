@@ -4,6 +4,7 @@
  */
 
 #include "trace.h"
+#include <deque>
 #include <math.h>
 
 struct trace_context ctx_trace = {};
@@ -469,14 +470,30 @@ void query_ext_ctrl_setup(int fd, struct v4l2_query_ext_ctrl *ptr)
 	}
 }
 
-void write_json_object_to_json_file(json_object *jobj)
-{
-	std::string json_str;
-	if (getenv("V4L2_TRACER_OPTION_COMPACT_PRINT") != nullptr)
-		json_str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
-	else
-		json_str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
+/*
+ * Serializing the json object and writing it to the trace file inline
+ * adds milliseconds of jitter to the traced call, enough to hide the
+ * timing bugs being traced. The traced thread therefore only queues a
+ * reference to the object; a background writer thread serializes the
+ * objects, writes them out and flushes once the queue runs empty. The
+ * queue is bounded so a fast tracee blocks instead of exhausting
+ * memory. V4L2_TRACER_OPTION_SYNC_WRITE (v4l2-tracer --sync) restores
+ * the synchronous writes, e.g. for tracing an application that crashes
+ * before the queue can be drained.
+ */
+#define TRACE_WRITE_QUEUE_MAX 1024
 
+static std::deque<json_object *> trace_write_queue;
+static pthread_mutex_t trace_write_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trace_write_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t trace_write_popped = PTHREAD_COND_INITIALIZER;
+static pthread_t trace_write_thread;
+static bool trace_write_running;
+static bool trace_write_stop;
+static bool trace_write_in_flight;
+
+static void write_json_string_to_json_file(const std::string &json_str)
+{
 	if (ctx_trace.trace_file == nullptr) {
 		std::string filename;
 		if (getenv("TRACE_ID") != nullptr)
@@ -488,13 +505,108 @@ void write_json_object_to_json_file(json_object *jobj)
 
 	fwrite(json_str.c_str(), sizeof(char), json_str.length(), ctx_trace.trace_file);
 	fputs(",\n", ctx_trace.trace_file);
-	fflush(ctx_trace.trace_file);
+}
+
+static std::string json_object_to_trace_string(json_object *jobj)
+{
+	if (getenv("V4L2_TRACER_OPTION_COMPACT_PRINT") != nullptr)
+		return json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
+	return json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PRETTY);
+}
+
+static void *trace_write_thread_fn(void *)
+{
+	pthread_mutex_lock(&trace_write_lock);
+	for (;;) {
+		while (trace_write_queue.empty() && !trace_write_stop)
+			pthread_cond_wait(&trace_write_filled, &trace_write_lock);
+		if (trace_write_queue.empty())
+			break;
+
+		json_object *jobj = trace_write_queue.front();
+		trace_write_queue.pop_front();
+		trace_write_in_flight = true;
+		pthread_mutex_unlock(&trace_write_lock);
+
+		write_json_string_to_json_file(json_object_to_trace_string(jobj));
+		json_object_put(jobj);
+
+		pthread_mutex_lock(&trace_write_lock);
+		trace_write_in_flight = false;
+		if (trace_write_queue.empty() && ctx_trace.trace_file != nullptr)
+			fflush(ctx_trace.trace_file);
+		pthread_cond_broadcast(&trace_write_popped);
+	}
+	pthread_mutex_unlock(&trace_write_lock);
+	return nullptr;
+}
+
+/* Wait until every queued object has hit the file. Caller holds the lock. */
+static void trace_write_drain(void)
+{
+	while (!trace_write_queue.empty() || trace_write_in_flight)
+		pthread_cond_wait(&trace_write_popped, &trace_write_lock);
+}
+
+void write_json_object_to_json_file(json_object *jobj)
+{
+	struct timespec ts;
+
+	/* Monotonic timestamp of the traced call, used by retrace --pace. */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	json_object_object_add(jobj, "ts_ns",
+	                       json_object_new_uint64(ts.tv_sec * 1000000000ULL + ts.tv_nsec));
+
+	if (getenv("V4L2_TRACER_OPTION_SYNC_WRITE") != nullptr) {
+		write_json_string_to_json_file(json_object_to_trace_string(jobj));
+		fflush(ctx_trace.trace_file);
+		return;
+	}
+
+	pthread_mutex_lock(&trace_write_lock);
+	if (!trace_write_running &&
+	    pthread_create(&trace_write_thread, nullptr,
+			   trace_write_thread_fn, nullptr) == 0)
+		trace_write_running = true;
+	if (!trace_write_running) {
+		/* No writer thread, fall back to a synchronous write. */
+		pthread_mutex_unlock(&trace_write_lock);
+		write_json_string_to_json_file(json_object_to_trace_string(jobj));
+		fflush(ctx_trace.trace_file);
+		return;
+	}
+	while (trace_write_queue.size() >= TRACE_WRITE_QUEUE_MAX)
+		pthread_cond_wait(&trace_write_popped, &trace_write_lock);
+	trace_write_queue.push_back(json_object_get(jobj));
+	pthread_cond_signal(&trace_write_filled);
+	pthread_mutex_unlock(&trace_write_lock);
 }
 
 void close_json_file(void)
 {
+	pthread_mutex_lock(&trace_write_lock);
+	if (trace_write_running)
+		trace_write_drain();
 	if (ctx_trace.trace_file != nullptr) {
 		fclose(ctx_trace.trace_file);
 		ctx_trace.trace_file = 0;
 	}
+	pthread_mutex_unlock(&trace_write_lock);
+}
+
+/* Flush whatever is still queued when the traced process exits. */
+static void __attribute__((destructor)) trace_write_shutdown(void)
+{
+	pthread_mutex_lock(&trace_write_lock);
+	if (!trace_write_running) {
+		pthread_mutex_unlock(&trace_write_lock);
+		return;
+	}
+	trace_write_stop = true;
+	pthread_cond_signal(&trace_write_filled);
+	pthread_mutex_unlock(&trace_write_lock);
+	pthread_join(trace_write_thread, nullptr);
+	trace_write_running = false;
+	if (ctx_trace.trace_file != nullptr)
+		fflush(ctx_trace.trace_file);
 }
@@ -4,9 +4,29 @@
  */
 
 #include "trace.h"
+#include <unordered_set>
 
 extern struct trace_context ctx_trace;
 
+/*
+ * Payloads already written to the trace file, keyed by content hash.
+ * Decoders queue the same reference frames over and over, so repeated
+ * payloads are stored only once and later occurrences just record the
+ * hash for retrace to look up.
+ */
+static std::unordered_set<unsigned long long> traced_mem_hashes;
+
+static unsigned long long fnv1a_hash(const unsigned char *buf, __u32 len)
+{
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+
+	for (__u32 i = 0; i < len; i++) {
+		hash ^= buf[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 void trace_open(int fd, const char *path, int oflag, mode_t mode, bool is_open64)
 {
 	json_object *open_obj = json_object_new_object();
@@ -102,6 +122,29 @@ json_object *trace_buffer(unsigned char *buffer_pointer, __u32 bytesused)
 	json_object *mem_array_obj = json_object_new_array();
 
 	for (__u32 i = 0; i < bytesused; i++) {
+		/*
+		 * Coalesce long runs of zero bytes (codec padding) into a
+		 * single "z<count>" entry instead of hex dumping them.
+		 */
+		if (buffer_pointer[i] == 0) {
+			__u32 run = 1;
+
+			while (i + run < bytesused && buffer_pointer[i + run] == 0)
+				run++;
+			if (run >= MAX_BYTES_PER_LINE) {
+				if (!str.empty()) {
+					json_object_array_add(mem_array_obj,
+					                      json_object_new_string(str.c_str()));
+					str.clear();
+					byte_count_per_line = 0;
+				}
+				std::string zrun = "z" + std::to_string(run);
+				json_object_array_add(mem_array_obj,
+				                      json_object_new_string(zrun.c_str()));
+				i += run - 1;
+				continue;
+			}
+		}
 		memset(buf, 0, BUF_SIZE);
 		/* Each byte e.g. D9 will write a string of two characters "D9". */
 		sprintf(buf, "%02x", buffer_pointer[i]);
@@ -128,6 +171,14 @@ json_object *trace_buffer(unsigned char *buffer_pointer, __u32 bytesused)
 
 void trace_mem(int fd, __u32 offset, __u32 type, int index, __u32 bytesused, unsigned long start)
 {
+	/*
+	 * Payload capture is disabled with -n/--no_payload: such a trace is
+	 * meant for timing analysis, not for retracing, so skip the whole
+	 * memory record rather than hex dumping the buffer.
+	 */
+	if (getenv("V4L2_TRACER_OPTION_NO_PAYLOAD") != nullptr)
+		return;
+
 	json_object *mem_obj = json_object_new_object();
 	json_object_object_add(mem_obj, "mem_dump",
 	                       json_object_new_string(val2s(type, v4l2_buf_type_val_def).c_str()));
@@ -139,8 +190,17 @@ void trace_mem(int fd, __u32 offset, __u32 type, int index, __u32 bytesused, uns
 
 	if ((type == V4L2_BUF_TYPE_VIDEO_OUTPUT || type == V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE) ||
 	    (getenv("V4L2_TRACER_OPTION_WRITE_DECODED_TO_JSON_FILE") != nullptr)) {
-		json_object *mem_array_obj = trace_buffer((unsigned char*) start, bytesused);
-		json_object_object_add(mem_obj, "mem_array", mem_array_obj);
+		char hash_str[17];
+		unsigned long long hash = fnv1a_hash((unsigned char *) start, bytesused);
+
+		sprintf(hash_str, "%016llx", hash);
+		json_object_object_add(mem_obj, "mem_hash", json_object_new_string(hash_str));
+
+		/* Only store the payload the first time this content is seen. */
+		if (traced_mem_hashes.insert(hash).second) {
+			json_object *mem_array_obj = trace_buffer((unsigned char*) start, bytesused);
+			json_object_object_add(mem_obj, "mem_array", mem_array_obj);
+		}
 	}
 
 	write_json_object_to_json_file(mem_obj);
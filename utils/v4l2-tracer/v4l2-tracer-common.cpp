@@ -30,13 +30,31 @@ void print_usage(void)
 	print_v4l2_tracer_info();
 	fprintf(stderr, "Usage:\n\tv4l2-tracer [options] trace <tracee>\n"
 	        "\tv4l2-tracer [options] retrace <trace_file>.json\n"
-	        "\tv4l2-tracer clean <trace_file>.json\n\n"
+	        "\tv4l2-tracer clean <trace_file>.json\n"
+	        "\tv4l2-tracer report <trace_file>.json\n\n"
 
 	        "\tCommon options:\n"
 	        "\t\t-c, --compact     Write minimal whitespace in JSON file.\n"
+	        "\t\t-f, --filter <ioctls>\n"
+	        "\t\t                  Trace only the given comma-separated ioctls, e.g.\n"
+	        "\t\t                  VIDIOC_QBUF,VIDIOC_DQBUF. Everything else goes\n"
+	        "\t\t                  straight to the original syscall.\n"
 	        "\t\t-g, --debug       Turn on verbose reporting plus additional debug info.\n"
 	        "\t\t-h, --help        Display this message.\n"
+	        "\t\t-j, --parallel    Retrace independent streams on separate threads,\n"
+	        "\t\t                  reporting per-stream replay throughput.\n"
+	        "\t\t-l, --live        Publish fixed-size ioctl records to a shared-memory\n"
+	        "\t\t                  ring (/v4l2-tracer-<pid>) for an external consumer\n"
+	        "\t\t                  instead of writing the JSON trace file.\n"
+	        "\t\t-n, --no_payload  Don't capture buffer payloads, only the calls\n"
+	        "\t\t                  themselves. Such a trace cannot be retraced.\n"
+	        "\t\t-p, --pace <factor>\n"
+	        "\t\t                  Retrace on the original timing divided by <factor>,\n"
+	        "\t\t                  e.g. 1 replays at the recorded rate, 2 at twice the\n"
+	        "\t\t                  speed. Default is to retrace at maximum rate.\n"
 	        "\t\t-r  --raw         Write decoded video frame data to JSON file.\n"
+	        "\t\t-s, --sync        Write the trace file synchronously from the traced\n"
+	        "\t\t                  thread instead of from a background writer thread.\n"
 	        "\t\t-v, --verbose     Turn on verbose reporting.\n"
 	        "\t\t-y, --yuv         Write decoded video frame data to yuv file.\n\n"
 
@@ -92,16 +110,75 @@ std::string number2s(long num)
 	return "0x" + stream.str();
 }
 
+/*
+ * The constexpr *_val_def tables are in header order, so looking a value
+ * up meant scanning them linearly on every traced ioctl and control.
+ * Instead, sort an index of the table on its first use and binary search
+ * it afterwards. Building lazily keeps LD_PRELOAD startup free of any
+ * table construction for short-lived commands that never do a lookup.
+ */
+static const std::vector<const val_def *> &val_def_index(const val_def *def, bool by_str)
+{
+	static std::unordered_map<const void *, std::vector<const val_def *>> indexes;
+	static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+	/* Key the value-sorted and string-sorted indexes separately. */
+	const void *key = by_str ? (const void *)def->str : (const void *)def;
+
+	pthread_mutex_lock(&lock);
+	std::vector<const val_def *> &index = indexes[key];
+	if (index.empty()) {
+		for (const val_def *d = def; d->val != -1; d++)
+			index.push_back(d);
+		if (by_str)
+			std::sort(index.begin(), index.end(),
+				  [](const val_def *a, const val_def *b) {
+					return strcmp(a->str, b->str) < 0;
+				  });
+		else
+			std::sort(index.begin(), index.end(),
+				  [](const val_def *a, const val_def *b) {
+					return a->val < b->val;
+				  });
+	}
+	pthread_mutex_unlock(&lock);
+	return index;
+}
+
+static const val_def *val_def_find_val(long val, const val_def *def)
+{
+	if (def->val == -1)
+		return nullptr;
+	const std::vector<const val_def *> &index = val_def_index(def, false);
+	auto it = std::lower_bound(index.begin(), index.end(), val,
+				   [](const val_def *d, long v) { return d->val < v; });
+	if (it != index.end() && (*it)->val == val)
+		return *it;
+	return nullptr;
+}
+
+static const val_def *val_def_find_str(const char *str, const val_def *def)
+{
+	if (def->val == -1)
+		return nullptr;
+	const std::vector<const val_def *> &index = val_def_index(def, true);
+	auto it = std::lower_bound(index.begin(), index.end(), str,
+				   [](const val_def *d, const char *s) {
+					return strcmp(d->str, s) < 0;
+				   });
+	if (it != index.end() && strcmp((*it)->str, str) == 0)
+		return *it;
+	return nullptr;
+}
+
 std::string val2s(long val, const val_def *def)
 {
 	if (def == nullptr)
 		return number2s(val);
 
-	while ((def->val != -1) && (def->val != val))
-		def++;
-
-	if (def->val == val)
-		return def->str;
+	const val_def *found = val_def_find_val(val, def);
+	if (found != nullptr)
+		return found->str;
 
 	return number2s(val);
 }
@@ -232,11 +309,9 @@ long s2val(const char *char_str, const val_def *def)
 	if (def == nullptr)
 		return s2number(char_str);
 
-	while ((def->val != -1) && (def->str != str))
-		def++;
-
-	if (def->str == str)
-		return def->val;
+	const val_def *found = val_def_find_str(char_str, def);
+	if (found != nullptr)
+		return found->val;
 
 	return s2number(char_str);
 }
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Shared-memory live event ring published by libv4l2tracer.
+ *
+ * With V4L2_TRACER_OPTION_LIVE set (v4l2-tracer --live), the interposer
+ * publishes one fixed-size record per traced ioctl into a POSIX shared
+ * memory segment named /v4l2-tracer-<pid> instead of writing the JSON
+ * trace file, so an external telemetry agent can sample the V4L2
+ * activity of a production process with bounded memory and no disk I/O.
+ *
+ * The ring has a single producer (the traced process) and is drained by
+ * an external consumer: read head with acquire semantics, read the
+ * records behind it, then re-read head; if it advanced by more than the
+ * capacity the oldest records were overwritten and the consumer fell
+ * behind.
+ */
+
+#ifndef V4L2_TRACER_LIVE_H
+#define V4L2_TRACER_LIVE_H
+
+#include <linux/types.h>
+
+#define V4L2_TRACER_LIVE_MAGIC 0x4c325634
+#define V4L2_TRACER_LIVE_VERSION 1
+#define V4L2_TRACER_LIVE_CAPACITY 1024
+
+struct v4l2_tracer_live_event {
+	__u64 ts_ns;       /* CLOCK_MONOTONIC timestamp of the call */
+	__u64 duration_ns; /* time spent in the original ioctl */
+	__u32 cmd;         /* the ioctl request code */
+	__s32 fd;
+	__s32 error;       /* errno after the call, 0 on success */
+	__u32 reserved;
+};
+
+struct v4l2_tracer_live_ring {
+	__u32 magic;
+	__u32 version;
+	__u32 capacity;
+	__u32 record_size;
+	/* Total records published; the newest is events[(head - 1) % capacity]. */
+	__u64 head;
+	struct v4l2_tracer_live_event events[V4L2_TRACER_LIVE_CAPACITY];
+};
+
+#endif
@@ -5,6 +5,8 @@
 
 #include "retrace.h"
 #include <climits>
+#include <map>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <time.h>
 
@@ -13,10 +15,16 @@ int tracer(int argc, char *argv[], bool retrace = false);
 enum Options {
 	V4l2TracerOptCompactPrint = 'c',
 	V4l2TracerOptSetVideoDevice = 'd',
+	V4l2TracerOptFilterIoctls = 'f',
 	V4l2TracerOptDebug = 'g',
 	V4l2TracerOptHelp = 'h',
+	V4l2TracerOptParallelReplay = 'j',
+	V4l2TracerOptLiveMode = 'l',
 	V4l2TracerOptSetMediaDevice = 'm',
+	V4l2TracerOptNoPayload = 'n',
+	V4l2TracerOptPace = 'p',
 	V4l2TracerOptWriteDecodedToJson = 'r',
+	V4l2TracerOptSyncWrite = 's',
 	V4l2TracerOptVerbose = 'v',
 	V4l2TracerOptWriteDecodedToYUVFile = 'y',
 };
@@ -25,9 +33,15 @@ const static struct option long_options[] = {
 	{ "compact", no_argument, nullptr, V4l2TracerOptCompactPrint },
 	{ "video_device", required_argument, nullptr, V4l2TracerOptSetVideoDevice },
 	{ "debug", no_argument, nullptr, V4l2TracerOptDebug },
+	{ "filter", required_argument, nullptr, V4l2TracerOptFilterIoctls },
 	{ "help", no_argument, nullptr, V4l2TracerOptHelp },
+	{ "live", no_argument, nullptr, V4l2TracerOptLiveMode },
 	{ "media_device", required_argument, nullptr, V4l2TracerOptSetMediaDevice },
+	{ "no_payload", no_argument, nullptr, V4l2TracerOptNoPayload },
+	{ "pace", required_argument, nullptr, V4l2TracerOptPace },
+	{ "parallel", no_argument, nullptr, V4l2TracerOptParallelReplay },
 	{ "raw", no_argument, nullptr, V4l2TracerOptWriteDecodedToJson },
+	{ "sync", no_argument, nullptr, V4l2TracerOptSyncWrite },
 	{ "verbose", no_argument, nullptr, V4l2TracerOptVerbose },
 	{ "yuv", no_argument, nullptr, V4l2TracerOptWriteDecodedToYUVFile },
 	{ nullptr, 0, nullptr, 0 }
@@ -36,10 +50,16 @@ const static struct option long_options[] = {
 const char short_options[] = {
 	V4l2TracerOptCompactPrint,
 	V4l2TracerOptSetVideoDevice, ':',
+	V4l2TracerOptFilterIoctls, ':',
 	V4l2TracerOptDebug,
 	V4l2TracerOptHelp,
+	V4l2TracerOptNoPayload,
+	V4l2TracerOptLiveMode,
+	V4l2TracerOptParallelReplay,
 	V4l2TracerOptSetMediaDevice, ':',
+	V4l2TracerOptPace, ':',
 	V4l2TracerOptWriteDecodedToJson,
+	V4l2TracerOptSyncWrite,
 	V4l2TracerOptVerbose,
 	V4l2TracerOptWriteDecodedToYUVFile
 };
@@ -112,9 +132,33 @@ int get_options(int argc, char *argv[])
 			}
 			break;
 		}
+		case V4l2TracerOptFilterIoctls:
+			setenv("V4L2_TRACER_OPTION_FILTER_IOCTLS", optarg, 0);
+			break;
+		case V4l2TracerOptNoPayload:
+			setenv("V4L2_TRACER_OPTION_NO_PAYLOAD", "true", 0);
+			break;
+		case V4l2TracerOptLiveMode:
+			setenv("V4L2_TRACER_OPTION_LIVE", "true", 0);
+			break;
+		case V4l2TracerOptParallelReplay:
+			setenv("V4L2_TRACER_OPTION_PARALLEL", "true", 0);
+			break;
+		case V4l2TracerOptPace: {
+			if (atof(optarg) <= 0) {
+				fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+				fprintf(stderr, "pace factor \'%s\' is not a positive number\n", optarg);
+				return -1;
+			}
+			setenv("V4L2_TRACER_OPTION_PACE", optarg, 0);
+			break;
+		}
 		case V4l2TracerOptWriteDecodedToJson:
 			setenv("V4L2_TRACER_OPTION_WRITE_DECODED_TO_JSON_FILE", "true", 0);
 			break;
+		case V4l2TracerOptSyncWrite:
+			setenv("V4L2_TRACER_OPTION_SYNC_WRITE", "true", 0);
+			break;
 		case V4l2TracerOptVerbose:
 			setenv("V4L2_TRACER_OPTION_VERBOSE", "true", 0);
 			break;
@@ -195,6 +239,213 @@ int clean(std::string trace_filename)
 	return 0;
 }
 
+/*
+ * "v4l2-tracer report <trace>.json": one streaming pass over the trace
+ * computing per-ioctl latency statistics, queue-to-dequeue latencies,
+ * buffer queue occupancy over time and inter-frame intervals. The summary
+ * is printed to stdout and the occupancy timeline written as CSV next to
+ * the trace file.
+ */
+struct report_stats {
+	unsigned long count;
+	unsigned long long sum_ns;
+	unsigned long long min_ns;
+	unsigned long long max_ns;
+};
+
+static void report_add_sample(report_stats &stats, unsigned long long ns)
+{
+	if (stats.count == 0 || ns < stats.min_ns)
+		stats.min_ns = ns;
+	if (ns > stats.max_ns)
+		stats.max_ns = ns;
+	stats.sum_ns += ns;
+	stats.count++;
+}
+
+static void report_print_stats(const std::map<std::string, report_stats> &table)
+{
+	for (auto &pair : table)
+		printf("\t%-42s %8lu %10.1f %10.1f %10.1f\n",
+		       pair.first.c_str(), pair.second.count,
+		       pair.second.min_ns / 1000.0,
+		       pair.second.sum_ns / 1000.0 / pair.second.count,
+		       pair.second.max_ns / 1000.0);
+}
+
+/* The v4l2_buffer of a QBUF/DQBUF record, from whichever side traced it. */
+static json_object *report_get_buffer(json_object *jobj)
+{
+	json_object *args_obj;
+	json_object *buf_obj;
+
+	if (json_object_object_get_ex(jobj, "from_driver", &args_obj) &&
+	    json_object_object_get_ex(args_obj, "v4l2_buffer", &buf_obj))
+		return buf_obj;
+	if (json_object_object_get_ex(jobj, "from_userspace", &args_obj) &&
+	    json_object_object_get_ex(args_obj, "v4l2_buffer", &buf_obj))
+		return buf_obj;
+	return nullptr;
+}
+
+int report(std::string trace_filename)
+{
+	int fd = open(trace_filename.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || st.st_size == 0) {
+		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+		fprintf(stderr, "Trace file error: \'%s\'\n", trace_filename.c_str());
+		if (fd >= 0)
+			close(fd);
+		return 1;
+	}
+	size_t size = st.st_size;
+	char *data = (char *) mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+		fprintf(stderr, "cannot mmap trace file: %s\n", trace_filename.c_str());
+		return 1;
+	}
+
+	std::string csv_filename =
+		trace_filename.substr(0, trace_filename.find(".json")) + "_occupancy.csv";
+	FILE *csv_file = fopen(csv_filename.c_str(), "w");
+	if (csv_file == nullptr) {
+		fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+		fprintf(stderr, "cannot open \'%s\'\n", csv_filename.c_str());
+		munmap(data, size);
+		return 1;
+	}
+	fputs("ts_ms,fd,queue,occupancy\n", csv_file);
+
+	/* Per-ioctl call duration, keyed by ioctl name. */
+	std::map<std::string, report_stats> ioctl_stats;
+	/* QBUF-to-DQBUF latency and inter-DQBUF interval, keyed by fd/queue. */
+	std::map<std::string, report_stats> queue_stats;
+	std::map<std::string, report_stats> interframe_stats;
+	std::unordered_map<std::string, unsigned> occupancy;
+	std::unordered_map<std::string, unsigned long long> qbuf_ts;
+	std::unordered_map<std::string, unsigned long long> last_dqbuf_ts;
+	unsigned long long first_ts_ns = 0;
+
+	json_tokener *tokener = json_tokener_new();
+	size_t pos = 0;
+
+	while (pos < size && (isspace(data[pos]) || data[pos] == '['))
+		pos++;
+
+	while (pos < size) {
+		while (pos < size && (isspace(data[pos]) || data[pos] == ','))
+			pos++;
+		if (pos >= size || data[pos] == ']')
+			break;
+
+		int chunk = size - pos > INT_MAX ? INT_MAX : (int)(size - pos);
+
+		json_tokener_reset(tokener);
+		json_object *jobj = json_tokener_parse_ex(tokener, data + pos, chunk);
+		if (jobj == nullptr) {
+			fprintf(stderr, "%s:%s:%d: ", __FILE__, __func__, __LINE__);
+			fprintf(stderr, "cannot parse JSON-object at offset %zu in file: %s: %s\n",
+			        pos, trace_filename.c_str(),
+			        json_tokener_error_desc(json_tokener_get_error(tokener)));
+			json_tokener_free(tokener);
+			fclose(csv_file);
+			munmap(data, size);
+			return 1;
+		}
+		pos += json_tokener_get_parse_end(tokener);
+
+		json_object *tmp_obj;
+		unsigned long long ts_ns = 0;
+		if (json_object_object_get_ex(jobj, "ts_ns", &tmp_obj))
+			ts_ns = json_object_get_uint64(tmp_obj);
+		if (first_ts_ns == 0)
+			first_ts_ns = ts_ns;
+
+		if (!json_object_object_get_ex(jobj, "ioctl", &tmp_obj)) {
+			json_object_put(jobj);
+			continue;
+		}
+		std::string name;
+		if (json_object_get_string(tmp_obj) != nullptr)
+			name = json_object_get_string(tmp_obj);
+
+		if (json_object_object_get_ex(jobj, "duration_ns", &tmp_obj))
+			report_add_sample(ioctl_stats[name],
+			                  json_object_get_uint64(tmp_obj));
+
+		bool is_qbuf = name == "VIDIOC_QBUF";
+		bool is_dqbuf = name == "VIDIOC_DQBUF";
+		json_object *buf_obj;
+		if ((is_qbuf || is_dqbuf) &&
+		    (buf_obj = report_get_buffer(jobj)) != nullptr) {
+			int ioctl_fd = -1;
+			if (json_object_object_get_ex(jobj, "fd", &tmp_obj))
+				ioctl_fd = json_object_get_int(tmp_obj);
+			std::string type;
+			if (json_object_object_get_ex(buf_obj, "type", &tmp_obj) &&
+			    json_object_get_string(tmp_obj) != nullptr)
+				type = json_object_get_string(tmp_obj);
+			unsigned index = 0;
+			if (json_object_object_get_ex(buf_obj, "index", &tmp_obj))
+				index = (unsigned) json_object_get_uint64(tmp_obj);
+
+			std::string queue_key = std::to_string(ioctl_fd) + "/" + type;
+			std::string buf_key = queue_key + "/" + std::to_string(index);
+
+			if (is_qbuf) {
+				occupancy[queue_key]++;
+				qbuf_ts[buf_key] = ts_ns;
+			} else {
+				if (occupancy[queue_key] > 0)
+					occupancy[queue_key]--;
+				auto it = qbuf_ts.find(buf_key);
+				if (it != qbuf_ts.end() && ts_ns > it->second) {
+					report_add_sample(queue_stats[queue_key],
+					                  ts_ns - it->second);
+					qbuf_ts.erase(it);
+				}
+				auto last = last_dqbuf_ts.find(queue_key);
+				if (last != last_dqbuf_ts.end() && ts_ns > last->second)
+					report_add_sample(interframe_stats[queue_key],
+					                  ts_ns - last->second);
+				last_dqbuf_ts[queue_key] = ts_ns;
+			}
+			fprintf(csv_file, "%.3f,%d,%s,%u\n",
+			        (ts_ns - first_ts_ns) / 1000000.0, ioctl_fd,
+			        type.c_str(), occupancy[queue_key]);
+		}
+		json_object_put(jobj);
+	}
+	json_tokener_free(tokener);
+	munmap(data, size);
+	fclose(csv_file);
+
+	printf("Report for %s:\n\n", trace_filename.c_str());
+	printf("ioctl durations (us):\n");
+	printf("\t%-42s %8s %10s %10s %10s\n", "ioctl", "count", "min", "avg", "max");
+	report_print_stats(ioctl_stats);
+	if (!queue_stats.empty()) {
+		printf("\nQBUF to DQBUF latency per fd/queue (us):\n");
+		printf("\t%-42s %8s %10s %10s %10s\n", "queue", "count", "min", "avg", "max");
+		report_print_stats(queue_stats);
+	}
+	if (!interframe_stats.empty()) {
+		printf("\nInter-DQBUF interval per fd/queue (us):\n");
+		printf("\t%-42s %8s %10s %10s %10s\n", "queue", "count", "min", "avg", "max");
+		report_print_stats(interframe_stats);
+		for (auto &pair : interframe_stats)
+			if (pair.second.sum_ns)
+				printf("\t%-42s %.2f frames/sec\n", pair.first.c_str(),
+				       pair.second.count * 1e9 / pair.second.sum_ns);
+	}
+	printf("\nQueue occupancy timeline: %s\n", csv_filename.c_str());
+
+	return 0;
+}
+
 int tracer(int argc, char *argv[], bool retrace)
 {
 	char *exec[argc];
@@ -400,6 +651,8 @@ int main(int argc, char *argv[])
 		ret = retrace(argv[optind]);
 	} else if (command == "clean") {
 		ret = clean (argv[optind]);
+	} else if (command == "report") {
+		ret = report(argv[optind]);
 	} else {
 		if (is_debug()) {
 			fprintf(stderr, "%s:%s:%d\n", __FILE__, __func__, __LINE__);